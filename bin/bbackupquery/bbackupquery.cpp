@@ -14,6 +14,7 @@
 #endif
 
 #include <errno.h>
+#include <signal.h>
 #include <cstdio>
 #include <cstdlib>
 
@@ -51,8 +52,10 @@
 #include "SSLLib.h"
 #include "BackupStoreConstants.h"
 #include "BackupStoreException.h"
+#include "autogen_ConnectionException.h"
 #include "autogen_BackupProtocol.h"
 #include "BackupQueries.h"
+#include "BackupClientRestore.h"
 #include "FdGetLine.h"
 #include "BackupClientCryptoKeys.h"
 #include "BannerText.h"
@@ -91,6 +94,54 @@ void PrintUsageAndExit()
 	exit(1);
 }
 
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    StoreConnectionFactory
+//		Purpose: Opens read-only connections to the store, the same
+//			 way as the main one, for restoring files in parallel
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class StoreConnectionFactory : public RestoreConnectionFactory
+{
+public:
+	StoreConnectionFactory(TLSContext &rContext, const Configuration &rConf)
+	: mrContext(rContext),
+	  mrConf(rConf)
+	{ }
+
+	virtual std::auto_ptr<BackupProtocolCallable> OpenConnection()
+	{
+		std::auto_ptr<SocketStream> apSocket(new SocketStreamTLS);
+		static_cast<SocketStreamTLS &>(*apSocket).Open(mrContext,
+			Socket::TypeINET,
+			mrConf.GetKeyValue("StoreHostname").c_str(),
+			mrConf.GetKeyValueInt("StorePort"));
+
+		std::auto_ptr<BackupProtocolClient>
+			apConnection(new BackupProtocolClient(apSocket));
+		apConnection->Handshake();
+
+		std::auto_ptr<BackupProtocolVersion> serverVersion(
+			apConnection->QueryVersion(BACKUP_STORE_SERVER_VERSION));
+		if(serverVersion->GetVersion() != BACKUP_STORE_SERVER_VERSION)
+		{
+			THROW_EXCEPTION(BackupStoreException, WrongServerVersion)
+		}
+
+		apConnection->QueryLogin(mrConf.GetKeyValueUint32("AccountNumber"),
+			BackupProtocolLogin::Flags_ReadOnly,
+			PROTOCOL_CURRENT_VERSION);
+
+		return std::auto_ptr<BackupProtocolCallable>(apConnection);
+	}
+
+private:
+	TLSContext &mrContext;
+	const Configuration &mrConf;
+};
+
 #ifdef HAVE_LIBREADLINE
 static BackupProtocolClient* pProtocol;
 static const Configuration* pConfig;
@@ -357,6 +408,12 @@ int main(int argc, const char *argv[])
 	// Easier coding
 	const Configuration &conf(*config);
 	
+	#ifndef WIN32
+		// Ignore SIGPIPE so that if one of the connections used to
+		// restore files is broken, the rest of the restore goes on.
+		::signal(SIGPIPE, SIG_IGN);
+	#endif
+
 	// Setup and connect
 	// 1. TLS context
 	SSLLib::Initialise();
@@ -395,7 +452,43 @@ int main(int argc, const char *argv[])
 	
 	// 4. Log in to server
 	BOX_INFO("Login to store...");
-	// Check the version of the server
+	// Check the version of the server, asking for the newest one that we
+	// can use first. Older servers reject that version, but we can try
+	// again with the next one down, and finally the basic one.
+	int32_t versions[] = {
+		BACKUP_STORE_SERVER_VERSION_FILE_RANGES,
+		BACKUP_STORE_SERVER_VERSION_TREE_LISTING
+	};
+	int32_t version = BACKUP_STORE_SERVER_VERSION;
+	for(unsigned int v = 0; v < sizeof(versions)/sizeof(versions[0]); v++)
+	{
+		HideSpecificExceptionGuard guard(ConnectionException::ExceptionType,
+			ConnectionException::Protocol_UnexpectedReply);
+		try
+		{
+			std::auto_ptr<BackupProtocolVersion> serverVersion(
+				connection.QueryVersion(versions[v]));
+			if(serverVersion->GetVersion() == versions[v])
+			{
+				version = versions[v];
+				break;
+			}
+		}
+		catch(ConnectionException &e)
+		{
+			int type, subtype;
+			if(e.GetSubType() != ConnectionException::Protocol_UnexpectedReply ||
+				!connection.GetLastError(type, subtype) ||
+				type != BackupProtocolError::ErrorType ||
+				subtype != BackupProtocolError::Err_WrongVersion)
+			{
+				throw;
+			}
+			BOX_INFO("Server does not support protocol version " <<
+				versions[v]);
+		}
+	}
+	if(version == BACKUP_STORE_SERVER_VERSION)
 	{
 		std::auto_ptr<BackupProtocolVersion> serverVersion(connection.QueryVersion(BACKUP_STORE_SERVER_VERSION));
 		if(serverVersion->GetVersion() != BACKUP_STORE_SERVER_VERSION)
@@ -414,6 +507,12 @@ int main(int argc, const char *argv[])
 	
 	// Set up a context for our work
 	BackupQueries context(connection, conf, readWrite);
+	StoreConnectionFactory restoreConnections(tlsContext, conf);
+	context.SetRestoreConnectionFactory(&restoreConnections);
+	context.SetTreeListingSupported(
+		version >= BACKUP_STORE_SERVER_VERSION_TREE_LISTING);
+	context.SetFileRangesSupported(
+		version >= BACKUP_STORE_SERVER_VERSION_FILE_RANGES);
 	
 	// Start running commands... first from the command line
 	{
@@ -0,0 +1,1358 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    testbackupdiff.cpp
+//		Purpose: Test diffing routines for backup store files
+//		Created: 12/1/04
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Test.h"
+#include "BackupClientCryptoKeys.h"
+#include "BackupClientFileAttributes.h"
+#include "BackupStoreConstants.h"
+#include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
+#include "BackupStoreFileEncodeStream.h"
+#include "BackupStoreFilenameClear.h"
+#include "FileStream.h"
+#include "MemBlockStream.h"
+#include "MD5Digest.h"
+#include "RollingChecksum.h"
+#include "BackupStoreFileWire.h"
+#include "BackupStoreObjectMagic.h"
+#include "BackupStoreFileCryptVar.h"
+#include "BackupStoreException.h"
+#include "BoxTime.h"
+#include "CollectInBufferStream.h"
+
+#include "MemLeakFindOn.h"
+
+using namespace BackupStoreFileCryptVar;
+
+
+// from another file
+void create_test_files();
+
+bool files_identical(const char *file1, const char *file2)
+{
+	FileStream f1(file1);
+	FileStream f2(file2);
+	
+	if(f1.BytesLeftToRead() != f2.BytesLeftToRead())
+	{
+		return false;
+	}
+	
+	while(f1.StreamDataLeft())
+	{
+		char buffer1[2048];
+		char buffer2[2048];
+		int s = f1.Read(buffer1, sizeof(buffer1));
+		if(f2.Read(buffer2, s) != s)
+		{
+			return false;
+		}
+		if(::memcmp(buffer1, buffer2, s) != 0)
+		{
+			return false;
+		}
+	}
+	
+	if(f2.StreamDataLeft())
+	{
+		return false;
+	}
+	
+	return true;
+}
+
+bool make_file_of_zeros(const char *filename, size_t size)
+{
+	#ifdef WIN32
+	HANDLE handle = openfile(filename, O_WRONLY | O_CREAT | O_EXCL, 0);
+	TEST_THAT(handle != INVALID_HANDLE_VALUE);
+	TEST_THAT(SetFilePointer(handle, size, NULL, FILE_BEGIN)
+		!= INVALID_SET_FILE_POINTER);
+	TEST_THAT(GetLastError() == NO_ERROR);
+	BOOL result = SetEndOfFile(handle);
+	if (result != TRUE)
+	{
+		BOX_ERROR("Failed to create large file " << filename <<
+			" (" << (size >> 20) << " MB): " <<
+			GetErrorMessage(GetLastError()));
+	}
+	TEST_THAT(result == TRUE);
+	TEST_THAT(CloseHandle(handle) == TRUE);
+	#else
+	int fd = open(filename, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) perror(filename);
+	TEST_THAT(fd >= 0);
+	TEST_THAT(ftruncate(fd, size) == 0);
+	TEST_THAT(close(fd) == 0);
+	#endif
+
+	bool correct_size = ((size_t)TestGetFileSize(filename) == size);
+	TEST_THAT(correct_size);
+	if (!correct_size)
+	{
+		BOX_ERROR("Failed to create large file " << filename <<
+			" (" << (size >> 20) << " MB): " <<
+			"got " << (TestGetFileSize(filename) >> 20) <<
+			" MB instead");
+	}
+	return correct_size;
+}
+
+
+void check_encoded_file(const char *filename, int64_t OtherFileID, int new_blocks_expected, int old_blocks_expected)
+{
+	FileStream enc(filename);
+	
+	// Use the interface verify routine
+	int64_t otherIDFromFile = 0;
+	TEST_THAT(BackupStoreFile::VerifyEncodedFileFormat(enc, &otherIDFromFile));
+	TEST_THAT(otherIDFromFile == OtherFileID);
+	
+	// Now do our own reading
+	enc.Seek(0, IOStream::SeekType_Absolute);
+	BackupStoreFile::MoveStreamPositionToBlockIndex(enc);
+	// Read in header to check magic value is as expected
+	file_BlockIndexHeader hdr;
+	TEST_THAT(enc.ReadFullBuffer(&hdr, sizeof(hdr), 0));
+	TEST_THAT(hdr.mMagicValue == (int32_t)htonl(OBJECTMAGIC_FILE_BLOCKS_MAGIC_VALUE_V1));
+	TEST_THAT((uint64_t)box_ntoh64(hdr.mOtherFileID) == (uint64_t)OtherFileID);
+	// number of blocks
+	int64_t nblocks = box_ntoh64(hdr.mNumBlocks);
+	BOX_TRACE("Reading index from '" << filename << "', has " <<
+		nblocks << " blocks");
+	BOX_TRACE("======== ===== ========== ======== ========");
+	BOX_TRACE("   Index Where  EncSz/Idx     Size  WChcksm");
+	// Read them all in
+	int64_t nnew = 0, nold = 0;
+	for(int64_t b = 0; b < nblocks; ++b)
+	{
+		file_BlockIndexEntry en;
+		TEST_THAT(enc.ReadFullBuffer(&en, sizeof(en), 0));
+		int64_t s = box_ntoh64(en.mEncodedSize);
+
+		// Decode the rest
+		uint64_t iv = box_ntoh64(hdr.mEntryIVBase);
+		iv += b;
+		sBlowfishDecryptBlockEntry.SetIV(&iv);
+		file_BlockIndexEntryEnc entryEnc;
+		sBlowfishDecryptBlockEntry.TransformBlock(&entryEnc,
+			sizeof(entryEnc), en.mEnEnc, sizeof(en.mEnEnc));
+
+
+		if(s > 0)
+		{
+			nnew++;
+			BOX_TRACE(std::setw(8) << b << " this  s=" << 
+				std::setw(8) << s << " " <<
+				std::setw(8) << ntohl(entryEnc.mSize) << " " <<
+				std::setw(8) << std::setfill('0') <<
+				std::hex << ntohl(entryEnc.mWeakChecksum));
+		}
+		else
+		{
+			nold++;
+			BOX_TRACE(std::setw(8) << b << " other i=" << 
+				std::setw(8) << (0-s) << " " <<
+				std::setw(8) << ntohl(entryEnc.mSize) << " " <<
+				std::setw(8) << std::setfill('0') <<
+				std::hex << ntohl(entryEnc.mWeakChecksum));
+		}
+	}
+	BOX_TRACE("======== ===== ========== ======== ========");
+	TEST_THAT(new_blocks_expected == nnew);
+	TEST_THAT(old_blocks_expected == nold);
+}
+
+void test_diff(int from, int to, int new_blocks_expected, int old_blocks_expected, bool expect_completely_different = false)
+{
+	// First, get the block index of the thing it's comparing against
+	char from_encoded[256];
+	sprintf(from_encoded, "testfiles/f%d.encoded", from);
+	FileStream blockindex(from_encoded);
+	BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+
+	// make filenames
+	char from_orig[256];
+	sprintf(from_orig, "testfiles/f%d", from);
+	char to_encoded[256];
+	sprintf(to_encoded, "testfiles/f%d.encoded", to);
+	char to_diff[256];
+	sprintf(to_diff, "testfiles/f%d.diff", to);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", to);
+	char rev_diff[256];
+	sprintf(rev_diff, "testfiles/f%d.revdiff", to);
+	char from_rebuild[256];
+	sprintf(from_rebuild, "testfiles/f%d.rebuilt", to);
+	char from_rebuild_dec[256];
+	sprintf(from_rebuild_dec, "testfiles/f%d.rebuilt_dec", to);
+	
+	// Then call the encode varient for diffing files
+	bool completelyDifferent = !expect_completely_different;	// oposite of what we want
+	{
+		BackupStoreFilenameClear f1name("filename");
+		FileStream out(to_diff, O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(
+			BackupStoreFile::EncodeFileDiff(
+				to_orig, 
+				1 /* dir ID */, 
+				f1name,
+				1000 + from /* object ID of the file diffing from */, 
+				blockindex, 
+				IOStream::TimeOutInfinite,
+				NULL, // DiffTimer interface
+				0, 
+				&completelyDifferent));
+		encoded->CopyStreamTo(out);
+	}
+	TEST_THAT(completelyDifferent == expect_completely_different);
+	
+	// Test that the number of blocks in the file match what's expected
+	check_encoded_file(to_diff, expect_completely_different?(0):(1000 + from), new_blocks_expected, old_blocks_expected);
+
+	// filename
+	char to_testdec[256];
+	sprintf(to_testdec, "testfiles/f%d.testdec", to);
+	
+	if(!completelyDifferent)
+	{
+		// Then produce a combined file
+		{
+			FileStream diff(to_diff);
+			FileStream diff2(to_diff);
+			FileStream from(from_encoded);
+			FileStream out(to_encoded, O_WRONLY | O_CREAT | O_EXCL);
+			BackupStoreFile::CombineFile(diff, diff2, from, out);
+		}
+		
+		// And check it
+		check_encoded_file(to_encoded, 0, new_blocks_expected + old_blocks_expected, 0);
+	}
+	else
+	{
+#ifdef WIN32
+		// Emulate the above stage!
+		char src[256], dst[256];
+		sprintf(src, "testfiles\\f%d.diff", to);
+		sprintf(dst, "testfiles\\f%d.encoded", to);
+		TEST_THAT(CopyFile(src, dst, FALSE) != 0)
+#else
+		// Emulate the above stage!
+		char cmd[256];
+		sprintf(cmd, "cp testfiles/f%d.diff testfiles/f%d.encoded", to, to);
+		::system(cmd);
+#endif
+	}
+
+	// Decode it
+	{
+		FileStream enc(to_encoded);
+		BackupStoreFile::DecodeFile(enc, to_testdec, IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(to_orig, to_testdec));
+	}
+	
+	// Then do some comparisons against the block index
+	{
+		FileStream index(to_encoded);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(index);
+		TEST_THAT(BackupStoreFile::CompareFileContentsAgainstBlockIndex(to_orig, index, IOStream::TimeOutInfinite) == true);
+	}
+	{
+		char from_orig[256];
+		sprintf(from_orig, "testfiles/f%d", from);
+		FileStream index(to_encoded);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(index);
+		TEST_THAT(BackupStoreFile::CompareFileContentsAgainstBlockIndex(from_orig, index, IOStream::TimeOutInfinite) == files_identical(from_orig, to_orig));
+	}
+	
+	// Check that combined index creation works as expected
+	{
+		// Load a combined index into memory
+		FileStream diff(to_diff);
+		FileStream from(from_encoded);
+		std::auto_ptr<IOStream> indexCmbStr(BackupStoreFile::CombineFileIndices(diff, from));
+		IOStream::pos_type indexCmbSize = indexCmbStr->BytesLeftToRead();
+		CollectInBufferStream indexCmb;
+		indexCmbStr->CopyStreamTo(indexCmb);
+		// Then check that it's as expected!
+		FileStream result(to_encoded);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(result);
+		CollectInBufferStream index;
+		result.CopyStreamTo(index);
+		TEST_THAT(indexCmb.GetSize() == index.GetSize());
+		TEST_THAT(indexCmbSize == index.GetSize());
+		TEST_THAT(::memcmp(indexCmb.GetBuffer(), index.GetBuffer(), index.GetSize()) == 0);
+	}
+	
+	// Check that reverse delta can be made, and that it decodes OK
+	{
+		// Create reverse delta
+		{
+			bool reversedCompletelyDifferent = !completelyDifferent;
+			FileStream diff(to_diff);
+			FileStream from(from_encoded);
+			FileStream from2(from_encoded);
+			FileStream reversed(rev_diff, O_WRONLY | O_CREAT);
+			BackupStoreFile::ReverseDiffFile(diff, from, from2, reversed, to, &reversedCompletelyDifferent);
+			TEST_THAT(reversedCompletelyDifferent == completelyDifferent);
+		}
+		// Use it to combine a file
+		{
+			FileStream diff(rev_diff);
+			FileStream diff2(rev_diff);
+			FileStream from(to_encoded);
+			FileStream out(from_rebuild, O_WRONLY | O_CREAT | O_EXCL);
+			BackupStoreFile::CombineFile(diff, diff2, from, out);
+		}
+		// And then confirm that this file is actually the one we want
+		{
+			FileStream enc(from_rebuild);
+			BackupStoreFile::DecodeFile(enc, from_rebuild_dec, IOStream::TimeOutInfinite);
+			TEST_THAT(files_identical(from_orig, from_rebuild_dec));
+		}
+		// Do some extra checking
+		{
+			TEST_THAT(files_identical(from_rebuild, from_encoded));
+		}
+	}
+}
+
+typedef struct
+{
+	int64_t mEncodedSize;	// or 0 - index of block in other file
+	int32_t mSize;
+	uint32_t mWeakChecksum;
+	uint8_t mStrongChecksum[MD5Digest::DigestLength];
+} test_block_index_entry;
+
+void read_block_index(const char *filename, int64_t &rOtherFileID,
+	std::vector<test_block_index_entry> &rEntries)
+{
+	FileStream enc(filename);
+	BackupStoreFile::MoveStreamPositionToBlockIndex(enc);
+	file_BlockIndexHeader hdr;
+	TEST_THAT(enc.ReadFullBuffer(&hdr, sizeof(hdr), 0));
+	rOtherFileID = box_ntoh64(hdr.mOtherFileID);
+
+	int64_t nblocks = box_ntoh64(hdr.mNumBlocks);
+	for(int64_t b = 0; b < nblocks; ++b)
+	{
+		file_BlockIndexEntry en;
+		TEST_THAT(enc.ReadFullBuffer(&en, sizeof(en), 0));
+
+		uint64_t iv = box_ntoh64(hdr.mEntryIVBase);
+		iv += b;
+		iv = box_hton64(iv);
+		sBlowfishDecryptBlockEntry.SetIV(&iv);
+		file_BlockIndexEntryEnc entryEnc;
+		sBlowfishDecryptBlockEntry.TransformBlock(&entryEnc,
+			sizeof(entryEnc), en.mEnEnc, sizeof(en.mEnEnc));
+
+		test_block_index_entry entry;
+		entry.mEncodedSize = box_ntoh64(en.mEncodedSize);
+		entry.mSize = ntohl(entryEnc.mSize);
+		entry.mWeakChecksum = ntohl(entryEnc.mWeakChecksum);
+		::memcpy(entry.mStrongChecksum, entryEnc.mStrongChecksum,
+			sizeof(entry.mStrongChecksum));
+		rEntries.push_back(entry);
+	}
+}
+
+// Check that the single pass search for matching blocks produces the same
+// recipe as the original search which reads the file once per block size,
+// rolling the checksums with the given implementation of RollForwardBatch().
+void test_diff_search_methods_agree(int from, int to, int impl)
+{
+	char from_encoded[256];
+	sprintf(from_encoded, "testfiles/f%d.encoded", from);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", to);
+
+	int64_t other_file_id[2];
+	bool completely_different[2];
+	std::vector<test_block_index_entry> entries[2];
+
+	for(int method = 0; method < 2; ++method)
+	{
+		char to_diff[256];
+		sprintf(to_diff, "testfiles/f%d-f%d.diff%d-%d", from, to, impl,
+			method);
+		BackupStoreFile::DiffUseMultiPassSearch = (method == 1);
+		{
+			FileStream blockindex(from_encoded);
+			BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+			BackupStoreFilenameClear fname("filename");
+			FileStream out(to_diff, O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded(
+				BackupStoreFile::EncodeFileDiff(to_orig, 
+					1 /* dir ID */, fname,
+					1000 + from /* object ID of the file diffing from */, 
+					blockindex, IOStream::TimeOutInfinite,
+					NULL, // DiffTimer interface
+					0, &completely_different[method]));
+			encoded->CopyStreamTo(out);
+		}
+		read_block_index(to_diff, other_file_id[method], entries[method]);
+	}
+	BackupStoreFile::DiffUseMultiPassSearch = false;
+
+	TEST_EQUAL_LINE(completely_different[1], completely_different[0],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(other_file_id[1], other_file_id[0],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(entries[1].size(), entries[0].size(),
+		"f" << from << " to f" << to);
+	if(entries[0].size() != entries[1].size())
+	{
+		return;
+	}
+
+	for(size_t i = 0; i < entries[0].size(); ++i)
+	{
+		// New blocks are compressed and encrypted independently, so
+		// only the blocks reused from the other file must be identical.
+		TEST_EQUAL_LINE((entries[1][i].mEncodedSize > 0),
+			(entries[0][i].mEncodedSize > 0),
+			"f" << from << " to f" << to << " block " << i);
+		if(entries[1][i].mEncodedSize <= 0)
+		{
+			TEST_EQUAL_LINE(entries[1][i].mEncodedSize,
+				entries[0][i].mEncodedSize,
+				"f" << from << " to f" << to << " block " << i);
+		}
+		TEST_EQUAL_LINE(entries[1][i].mSize, entries[0][i].mSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[1][i].mWeakChecksum,
+			entries[0][i].mWeakChecksum,
+			"f" << from << " to f" << to << " block " << i);
+	}
+}
+
+// Check that encoding new blocks on worker threads produces the same blocks
+// as encoding them on the calling thread, both for whole files and for diffs,
+// and that the result decodes to the original file.
+void test_encoding_threads_agree(int from, int to, int threads)
+{
+	char from_encoded[256];
+	sprintf(from_encoded, "testfiles/f%d.encoded", from);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", to);
+
+	std::vector<test_block_index_entry> entries[2];
+	int64_t other_file_id[2];
+
+	for(int method = 0; method < 2; ++method)
+	{
+		char to_encoded[256];
+		sprintf(to_encoded, "testfiles/f%d-f%d.threads%d-%d", from, to,
+			threads, method);
+		BackupStoreFile::SetEncodingThreads((method == 0) ? 0 : threads);
+		{
+			BackupStoreFilenameClear fname("filename");
+			FileStream out(to_encoded, O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded;
+			if(from < 0)
+			{
+				encoded = BackupStoreFile::EncodeFile(to_orig,
+					1 /* dir ID */, fname);
+			}
+			else
+			{
+				FileStream blockindex(from_encoded);
+				BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+				encoded = BackupStoreFile::EncodeFileDiff(to_orig,
+					1 /* dir ID */, fname,
+					1000 + from /* object ID of the file diffing from */,
+					blockindex, IOStream::TimeOutInfinite,
+					NULL, // DiffTimer interface
+					0, 0);
+			}
+			encoded->CopyStreamTo(out);
+		}
+		read_block_index(to_encoded, other_file_id[method], entries[method]);
+
+		if(from < 0)
+		{
+			char decoded[256];
+			sprintf(decoded, "%s.dec", to_encoded);
+			FileStream enc(to_encoded);
+			BackupStoreFile::DecodeFile(enc, decoded,
+				IOStream::TimeOutInfinite);
+			TEST_THAT(files_identical(to_orig, decoded));
+		}
+	}
+	BackupStoreFile::SetEncodingThreads(0);
+
+	TEST_EQUAL_LINE(other_file_id[0], other_file_id[1],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(entries[0].size(), entries[1].size(),
+		"f" << from << " to f" << to);
+	if(entries[0].size() != entries[1].size())
+	{
+		return;
+	}
+
+	// Each chunk has a random IV, but the compressed and padded sizes
+	// don't depend on it, so everything in the index must match.
+	for(size_t i = 0; i < entries[0].size(); ++i)
+	{
+		TEST_EQUAL_LINE(entries[0][i].mEncodedSize,
+			entries[1][i].mEncodedSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[0][i].mSize, entries[1][i].mSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[0][i].mWeakChecksum,
+			entries[1][i].mWeakChecksum,
+			"f" << from << " to f" << to << " block " << i);
+	}
+}
+
+// Decode the files written by test_encoding_threads_agree() on several
+// threads at once, each using its own copies of the decryption contexts,
+// as a parallel restore does.
+void test_decoding_threads(int threads)
+{
+	std::vector<BackupStoreFile::DecodingContexts *> contexts;
+	for(int t = 0; t < threads; ++t)
+	{
+		contexts.push_back(new BackupStoreFile::DecodingContexts);
+	}
+
+	std::vector<std::thread> workers;
+	std::vector<int> failures(threads, 0);
+	for(int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([t, &contexts, &failures]()
+		{
+			contexts[t]->Use();
+			for(int to = 0; to <= 9; ++to)
+			{
+				char encoded[256], decoded[256];
+				sprintf(encoded, "testfiles/f-1-f%d.threads3-0", to);
+				sprintf(decoded, "%s.dec-thread%d", encoded, t);
+				try
+				{
+					FileStream enc(encoded);
+					BackupClientFileAttributes attr;
+					BackupStoreFile::DecodeFile(enc, decoded,
+						IOStream::TimeOutInfinite, 0, &attr);
+					// decrypts the attributes on this thread
+					attr.IsSymLink();
+				}
+				catch(...)
+				{
+					failures[t]++;
+				}
+			}
+			contexts[t]->StopUsing();
+		}));
+	}
+
+	for(int t = 0; t < threads; ++t)
+	{
+		workers[t].join();
+		delete contexts[t];
+		TEST_EQUAL_LINE(0, failures[t], "thread " << t);
+
+		for(int to = 0; to <= 9; ++to)
+		{
+			char orig[256], decoded[256];
+			sprintf(orig, "testfiles/f%d", to);
+			sprintf(decoded, "testfiles/f-1-f%d.threads3-0.dec-thread%d",
+				to, t);
+			TEST_THAT(files_identical(orig, decoded));
+		}
+	}
+}
+
+// Not a pass/fail test: report how fast a large file encodes with and
+// without worker threads.
+void test_encoding_threads_throughput(const char *filename, int64_t size)
+{
+	{
+		FileStream out(filename, O_WRONLY | O_CREAT | O_EXCL);
+		// Partly compressible data: pseudo-random bytes from a small
+		// alphabet, so that both the compression and encryption are
+		// doing real work.
+		std::vector<uint8_t> buffer(64*1024);
+		uint32_t seed = 0x12345678;
+		for(int64_t written = 0; written < size; written += buffer.size())
+		{
+			for(size_t i = 0; i < buffer.size(); ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				buffer[i] = 'a' + ((seed >> 16) % 32);
+			}
+			out.Write(&buffer[0], buffer.size());
+		}
+	}
+
+	int thread_counts[] = {0, 2, 4};
+	for(size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); ++t)
+	{
+		BackupStoreFile::SetEncodingThreads(thread_counts[t]);
+		box_time_t start = GetCurrentBoxTime();
+		{
+			BackupStoreFilenameClear fname("throughput");
+			std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile(
+				filename, 1 /* dir ID */, fname));
+			char buffer[64*1024];
+			while(encoded->StreamDataLeft())
+			{
+				encoded->Read(buffer, sizeof(buffer));
+			}
+		}
+		box_time_t elapsed = GetCurrentBoxTime() - start;
+		if(elapsed == 0) elapsed = 1;
+		BOX_NOTICE("Encoded " << (size / (1024*1024)) << " MB with " <<
+			thread_counts[t] << " encoding threads in " <<
+			BOX_FORMAT_MICROSECONDS(elapsed) << ": " <<
+			((double)size * MICRO_SEC_IN_SEC / elapsed / (1024*1024)) <<
+			" MB/s");
+	}
+	BackupStoreFile::SetEncodingThreads(0);
+
+	remove(filename);
+}
+
+// Bigger files are cut into bigger blocks by content, as they are with fixed
+// sizes, so that there aren't too many of them
+void test_chunk_sizes_scale_with_file_size()
+{
+	int64_t normalSizeLimit = (int64_t)BACKUP_FILE_CHUNK_NORMAL_SIZE *
+		BACKUP_FILE_INCREASE_BLOCK_SIZE_AFTER;
+	TEST_EQUAL(0, BackupStoreFileChunker::GetSizeShift(0));
+	TEST_EQUAL(0, BackupStoreFileChunker::GetSizeShift(normalSizeLimit));
+	TEST_EQUAL(1, BackupStoreFileChunker::GetSizeShift(normalSizeLimit + 1));
+	TEST_EQUAL(1, BackupStoreFileChunker::GetSizeShift(normalSizeLimit * 2));
+	TEST_EQUAL(2, BackupStoreFileChunker::GetSizeShift(normalSizeLimit * 2 + 1));
+
+	// But never bigger than the biggest block
+	int maxShift = BackupStoreFileChunker::GetSizeShift(
+		(int64_t)1 << 50);
+	TEST_EQUAL(BACKUP_FILE_MAX_BLOCK_SIZE,
+		(BACKUP_FILE_CHUNK_MAX_SIZE << maxShift));
+
+	const int size = 8*1024*1024;
+	std::vector<uint8_t> data(size);
+	uint32_t seed = 0x12345678;
+	for(int i = 0; i < size; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+
+	int shifts[] = {0, maxShift};
+	for(unsigned int s = 0; s < sizeof(shifts)/sizeof(shifts[0]); s++)
+	{
+		int shift = shifts[s];
+		MemBlockStream stream(&data[0], size);
+		BackupStoreFileChunker chunker(stream, size, shift);
+		TEST_EQUAL((BACKUP_FILE_MIN_BLOCK_SIZE << shift),
+			chunker.GetMinSize());
+		TEST_EQUAL((BACKUP_FILE_CHUNK_NORMAL_SIZE << shift),
+			chunker.GetNormalSize());
+		TEST_EQUAL((BACKUP_FILE_CHUNK_MAX_SIZE << shift),
+			chunker.GetMaxSize());
+
+		std::vector<int32_t> sizes;
+		const uint8_t *pchunk = 0;
+		int32_t chunkSize = 0;
+		while(chunker.NextChunk(pchunk, chunkSize))
+		{
+			sizes.push_back(chunkSize);
+		}
+		TEST_THAT_OR(sizes.size() > 1, continue);
+
+		int64_t total = 0;
+		for(size_t i = 0; i < sizes.size(); ++i)
+		{
+			if(i + 1 < sizes.size())
+			{
+				TEST_THAT(sizes[i] >= chunker.GetMinSize());
+			}
+			TEST_THAT(sizes[i] <= chunker.GetMaxSize());
+			total += sizes[i];
+		}
+		TEST_EQUAL(size, total);
+
+		// Blocks tend towards the normal size
+		int64_t mean = total / sizes.size();
+		TEST_THAT(mean > chunker.GetNormalSize() / 2);
+		TEST_THAT(mean < chunker.GetNormalSize() * 2);
+	}
+}
+
+// Encode a file with content defined chunking, then insert and delete some
+// bytes and check that the diff reuses all but the blocks around the changes,
+// and that both decode to the right thing.
+void test_content_defined_chunking(int threads)
+{
+	const int size = 2*1024*1024;
+	std::vector<uint8_t> data(size);
+	uint32_t seed = 0x9abcdef0;
+	for(int i = 0; i < size; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+	std::vector<uint8_t> changed(data.begin(), data.begin() + 300000);
+	changed.insert(changed.end(), data.begin() + 300050,
+		data.begin() + 1100000);
+	changed.insert(changed.end(), 100, 'x');
+	changed.insert(changed.end(), data.begin() + 1100000, data.end());
+
+	char orig[2][256], encoded[2][256], decoded[2][256];
+	for(int v = 0; v < 2; ++v)
+	{
+		sprintf(orig[v], "testfiles/cdc%d-%d", v, threads);
+		sprintf(encoded[v], "testfiles/cdc%d-%d.encoded", v, threads);
+		sprintf(decoded[v], "testfiles/cdc%d-%d.testdec", v, threads);
+		FileStream out(orig[v], O_WRONLY | O_CREAT | O_EXCL);
+		const std::vector<uint8_t> &rdata((v == 0) ? data : changed);
+		out.Write(&rdata[0], rdata.size());
+	}
+
+	BackupStoreFile::ContentDefinedChunking = true;
+	BackupStoreFile::SetEncodingThreads(threads);
+
+	{
+		BackupStoreFilenameClear fname("cdc");
+		FileStream out(encoded[0], O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> enc(BackupStoreFile::EncodeFile(
+			orig[0], 1 /* dir ID */, fname));
+		enc->CopyStreamTo(out);
+	}
+
+	int64_t other_file_id;
+	std::vector<test_block_index_entry> entries;
+	read_block_index(encoded[0], other_file_id, entries);
+	TEST_THAT(entries.size() > 16);
+	bool all_same_size = true;
+	for(size_t i = 0; i < entries.size(); ++i)
+	{
+		if(i + 1 < entries.size())
+		{
+			TEST_THAT(entries[i].mSize >= BACKUP_FILE_MIN_BLOCK_SIZE);
+		}
+		TEST_THAT(entries[i].mSize <= BACKUP_FILE_CHUNK_MAX_SIZE);
+		if(entries[i].mSize != entries[0].mSize)
+		{
+			all_same_size = false;
+		}
+	}
+	TEST_THAT(!all_same_size);
+
+	{
+		FileStream enc(encoded[0]);
+		BackupStoreFile::DecodeFile(enc, decoded[0],
+			IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(orig[0], decoded[0]));
+	}
+
+	char diff[256];
+	sprintf(diff, "testfiles/cdc1-%d.diff", threads);
+	{
+		FileStream blockindex(encoded[0]);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+		BackupStoreFilenameClear fname("cdc");
+		FileStream out(diff, O_WRONLY | O_CREAT | O_EXCL);
+		bool completely_different = true;
+		std::auto_ptr<IOStream> enc(BackupStoreFile::EncodeFileDiff(
+			orig[1], 1 /* dir ID */, fname,
+			2000 /* object ID of the file diffing from */,
+			blockindex, IOStream::TimeOutInfinite,
+			NULL, // DiffTimer interface
+			0, &completely_different));
+		enc->CopyStreamTo(out);
+		TEST_THAT(!completely_different);
+	}
+
+	std::vector<test_block_index_entry> diff_entries;
+	read_block_index(diff, other_file_id, diff_entries);
+	TEST_EQUAL(2000, other_file_id);
+	int new_blocks = 0;
+	for(size_t i = 0; i < diff_entries.size(); ++i)
+	{
+		if(diff_entries[i].mEncodedSize > 0) new_blocks++;
+	}
+	// Each change should only affect the block it's in, and perhaps
+	// the one after it.
+	TEST_THAT(new_blocks >= 2 && new_blocks <= 4);
+	TEST_THAT((int)diff_entries.size() - new_blocks >=
+		(int)entries.size() - 4);
+
+	{
+		FileStream diff1(diff);
+		FileStream diff2(diff);
+		FileStream from(encoded[0]);
+		FileStream out(encoded[1], O_WRONLY | O_CREAT | O_EXCL);
+		BackupStoreFile::CombineFile(diff1, diff2, from, out);
+	}
+	{
+		FileStream enc(encoded[1]);
+		BackupStoreFile::DecodeFile(enc, decoded[1],
+			IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(orig[1], decoded[1]));
+	}
+
+	BackupStoreFile::SetEncodingThreads(0);
+	BackupStoreFile::ContentDefinedChunking = false;
+}
+
+// Check that the fingerprints calculated from a file are those of the blocks
+// that encoding it creates, and that a changed file keeps most of them.
+void test_block_fingerprints(const char *orig, const char *encoded,
+	const char *changed, bool chunked)
+{
+	BackupStoreFile::ContentDefinedChunking = chunked;
+
+	int64_t other_file_id;
+	std::vector<test_block_index_entry> entries;
+	read_block_index(encoded, other_file_id, entries);
+	TEST_EQUAL(0, other_file_id);
+
+	std::vector<uint64_t> fingerprints;
+	BackupStoreFile::CalculateBlockFingerprints(orig, fingerprints);
+	TEST_EQUAL(entries.size(), fingerprints.size());
+
+	std::set<uint64_t> unique;
+	for(size_t i = 0; i < entries.size() && i < fingerprints.size(); ++i)
+	{
+		TEST_EQUAL(BackupStoreFile::GetBlockFingerprint(entries[i].mSize,
+			entries[i].mWeakChecksum, entries[i].mStrongChecksum),
+			fingerprints[i]);
+		unique.insert(fingerprints[i]);
+	}
+
+	// A copy has the same fingerprints
+	std::vector<uint64_t> again;
+	BackupStoreFile::CalculateBlockFingerprints(orig, again);
+	TEST_THAT(again == fingerprints);
+
+	// Only the first few blocks, when asked
+	std::vector<uint64_t> prefix;
+	BackupStoreFile::CalculateBlockFingerprints(orig, prefix, 2);
+	TEST_EQUAL(2, prefix.size());
+	TEST_THAT(std::equal(prefix.begin(), prefix.end(), fingerprints.begin()));
+
+	// The encoder collects the fingerprints of the blocks of the file as
+	// the store will keep it, after combining a diff with the file it was
+	// made from, so some of them are those of the old blocks.
+	{
+		FileStream blockIndex(encoded);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockIndex);
+		BackupStoreFilenameClear name("filename");
+		std::auto_ptr<BackupStoreFileEncodeStream> diff(
+			BackupStoreFile::EncodeFileDiff(changed, 1 /* dir ID */,
+				name, 1000 /* ID of the file diffed from */,
+				blockIndex, IOStream::TimeOutInfinite,
+				NULL /* DiffTimer */, 0 /* modification time */,
+				0 /* completely different */));
+		diff->CollectBlockFingerprints();
+		{
+			FileStream out("testfiles/fingerprints.diff",
+				O_WRONLY | O_CREAT | O_TRUNC);
+			diff->CopyStreamTo(out);
+		}
+		{
+			FileStream diffIn("testfiles/fingerprints.diff");
+			FileStream diffIn2("testfiles/fingerprints.diff");
+			FileStream from(encoded);
+			FileStream out("testfiles/fingerprints.combined",
+				O_WRONLY | O_CREAT | O_TRUNC);
+			BackupStoreFile::CombineFile(diffIn, diffIn2, from, out);
+		}
+
+		std::vector<test_block_index_entry> combined;
+		read_block_index("testfiles/fingerprints.combined",
+			other_file_id, combined);
+		const std::vector<uint64_t> &collected(
+			diff->GetBlockFingerprints());
+		TEST_EQUAL_OR(combined.size(), collected.size(), return);
+		int reused = 0;
+		for(size_t i = 0; i < combined.size(); ++i)
+		{
+			TEST_EQUAL(BackupStoreFile::GetBlockFingerprint(
+				combined[i].mSize, combined[i].mWeakChecksum,
+				combined[i].mStrongChecksum), collected[i]);
+			if(unique.find(collected[i]) != unique.end())
+			{
+				reused++;
+			}
+		}
+		TEST_THAT(reused > 0);
+	}
+
+	std::vector<uint64_t> changed_fingerprints;
+	BackupStoreFile::CalculateBlockFingerprints(changed,
+		changed_fingerprints);
+	int found = 0;
+	for(size_t i = 0; i < changed_fingerprints.size(); ++i)
+	{
+		if(unique.find(changed_fingerprints[i]) != unique.end())
+		{
+			found++;
+		}
+	}
+	if(chunked)
+	{
+		// Only the blocks around the changes are different
+		TEST_THAT(found >= (int)changed_fingerprints.size() - 4);
+	}
+	else
+	{
+		TEST_THAT(found < (int)changed_fingerprints.size());
+	}
+
+	BackupStoreFile::ContentDefinedChunking = false;
+}
+
+void test_combined_diff(int version1, int version2, int serial)
+{
+	char combined_file[256];
+	char last_diff[256];
+	sprintf(last_diff, "testfiles/f%d.diff", version1 + 1);	// ie from version1 to version1 + 1
+
+	for(int v = version1 + 2; v <= version2; ++v)
+	{
+		FileStream diff1(last_diff);
+		char next_diff[256];
+		sprintf(next_diff, "testfiles/f%d.diff", v);
+		FileStream diff2(next_diff);
+		FileStream diff2b(next_diff);
+		sprintf(combined_file, "testfiles/comb%d_%d.cmbdiff", version1, v);
+		FileStream out(combined_file, O_WRONLY | O_CREAT);
+		BackupStoreFile::CombineDiffs(diff1, diff2, diff2b, out);
+		strcpy(last_diff, combined_file);
+	}
+
+	// Then do a combine on it, and check that it decodes to the right thing
+	char orig_enc[256];
+	sprintf(orig_enc, "testfiles/f%d.encoded", version1);	
+	char combined_out[256];
+	sprintf(combined_out, "testfiles/comb%d_%d.out", version1, version2);
+
+	{
+		FileStream diff(combined_file);
+		FileStream diff2(combined_file);
+		FileStream from(orig_enc);
+		FileStream out(combined_out, O_WRONLY | O_CREAT);
+		BackupStoreFile::CombineFile(diff, diff2, from, out);
+	}
+
+	char combined_out_dec[256];
+	sprintf(combined_out_dec, "testfiles/comb%d_%d_s%d.dec", version1, version2, serial);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", version2);
+
+	{
+		FileStream enc(combined_out);
+		BackupStoreFile::DecodeFile(enc, combined_out_dec, IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(to_orig, combined_out_dec));
+	}
+
+}
+
+void test_combined_patch_chain(int version1, int version2)
+{
+	// Each diff refers to the blocks of the version before, just as
+	// each reverse diff in the store refers to the version after.
+	std::vector<IOStream *> chain;
+	for(int v = version2; v > version1; --v)
+	{
+		char diff[256];
+		sprintf(diff, "testfiles/f%d.diff", v);
+		chain.push_back(new FileStream(diff));
+	}
+	char orig_enc[256];
+	sprintf(orig_enc, "testfiles/f%d.encoded", version1);
+	chain.push_back(new FileStream(orig_enc));
+
+	std::auto_ptr<IOStream> combined(
+		BackupStoreFile::CombinePatchChain(chain));
+
+	char combined_dec[256];
+	sprintf(combined_dec, "testfiles/chain%d_%d.dec", version1, version2);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", version2);
+	BackupStoreFile::DecodeFile(*combined, combined_dec,
+		IOStream::TimeOutInfinite);
+	TEST_THAT(files_identical(to_orig, combined_dec));
+}
+
+// Read parts of a version with a seekable decoded stream over its patch
+// chain, in the order the store serves them to GetFileRange.
+void test_file_ranges(int version1, int version2)
+{
+	std::vector<IOStream *> chain;
+	for(int v = version2; v > version1; --v)
+	{
+		char diff[256];
+		sprintf(diff, "testfiles/f%d.diff", v);
+		chain.push_back(new FileStream(diff));
+	}
+	char orig_enc[256];
+	sprintf(orig_enc, "testfiles/f%d.encoded", version1);
+	chain.push_back(new FileStream(orig_enc));
+
+	std::auto_ptr<IOStream> combined(
+		BackupStoreFile::CombinePatchChain(chain,
+			true /* in file order */));
+	std::auto_ptr<BackupStoreFile::DecodedStream> decoded(
+		BackupStoreFile::DecodeFileStream(*combined,
+			IOStream::TimeOutInfinite, NULL, true /* seekable */));
+
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", version2);
+	CollectInBufferStream expected;
+	{
+		FileStream orig(to_orig);
+		orig.CopyStreamTo(expected);
+	}
+	expected.SetForReading();
+	int64_t size = expected.GetSize();
+	TEST_EQUAL(size, decoded->BytesLeftToRead());
+
+	// Forwards and backwards, within blocks and across them
+	int64_t offsets[] = {size / 2, 0, size - 1, 4095, 4096, size / 3,
+		size / 3 + 10, 1, size};
+	for(unsigned int i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++)
+	{
+		int64_t offset = offsets[i];
+		if(offset < 0 || offset > size) continue;
+		decoded->Seek(offset, IOStream::SeekType_Absolute);
+		TEST_EQUAL(offset, decoded->GetPosition());
+
+		char buffer[10000];
+		int toRead = sizeof(buffer);
+		if(size - offset < toRead) toRead = (int)(size - offset);
+		TEST_THAT(decoded->ReadFullBuffer(buffer, toRead, 0));
+		TEST_THAT(::memcmp(buffer, ((const char *)expected.GetBuffer()) +
+			offset, toRead) == 0);
+	}
+
+	if(size > 0)
+	{
+		decoded->Seek(-1, IOStream::SeekType_End);
+		TEST_EQUAL(size - 1, decoded->GetPosition());
+	}
+	TEST_CHECK_THROWS(decoded->Seek(size + 1, IOStream::SeekType_Absolute),
+		BackupStoreException, SeekOutsideDecodedFile);
+}
+
+#define MAX_DIFF 9
+void test_combined_diffs()
+{
+	int serial = 0;
+
+	// Number of items to combine at once
+	for(int stages = 2; stages <= 4; ++stages)
+	{
+		// Offset to get complete coverage
+		for(int offset = 0; offset < stages; ++offset)
+		{
+			// And then actual end file number
+			for(int f = 0; f <= (MAX_DIFF - stages - offset); ++f)
+			{
+				// And finally, do something!
+				test_combined_diff(offset + f, offset + f + stages, ++serial);
+			}
+		}
+	}
+}
+
+int test(int argc, const char *argv[])
+{
+	// Want to trace out all the details
+	#ifndef BOX_RELEASE_BUILD
+	#ifndef WIN32
+	BackupStoreFile::TraceDetailsOfDiffProcess = true;
+	#endif
+	#endif
+
+	// Create all the test files
+	create_test_files();
+
+	// Setup the crypto
+	BackupClientCryptoKeys_Setup("testfiles/backup.keys");	
+
+	// Encode the first file
+	{
+		BackupStoreFilenameClear f0name("f0");
+		FileStream out("testfiles/f0.encoded", O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile("testfiles/f0", 1 /* dir ID */, f0name));
+		encoded->CopyStreamTo(out);
+		out.Close();
+		check_encoded_file("testfiles/f0.encoded", 0, 33, 0);
+	}
+	
+	// Check the "seek to index" code
+	{
+		FileStream enc("testfiles/f0.encoded");
+		BackupStoreFile::MoveStreamPositionToBlockIndex(enc);
+		// Read in header to check magic value is as expected
+		file_BlockIndexHeader hdr;
+		TEST_THAT(enc.ReadFullBuffer(&hdr, sizeof(hdr), 0));
+		TEST_THAT(hdr.mMagicValue == (int32_t)htonl(OBJECTMAGIC_FILE_BLOCKS_MAGIC_VALUE_V1));
+	}
+
+	// Diff some files -- parameters are from number, to number,
+	// then the number of new blocks expected, and the number of old blocks expected.
+	
+	// Diff the original file to a copy of itself, and check that there is no data in the file
+	// This checks that the hash table is constructed properly, because two of the blocks share
+	// the same weak checksum.
+	test_diff(0, 1, 0, 33);
+
+	// Insert some new data
+	// Blocks from old file moved whole, but put in different order
+	test_diff(1, 2, 7, 32);
+
+	// Delete some data, but not on block boundaries
+	test_diff(2, 3, 1, 29);
+
+	// Add a very small amount of data, not on block boundary
+	// delete a little data
+	test_diff(3, 4, 3, 25);
+
+	// 1 byte insertion between two blocks
+	test_diff(4, 5, 1, 28);
+
+	// a file with some new content at the very beginning
+	// NOTE: You might expect the last numbers to be 2, 29, but the small 1 byte block isn't searched for
+	test_diff(5, 6, 3, 28);
+	
+	// some new content at the very end
+	// NOTE: 1 byte block deleted, so number aren't what you'd initial expect.
+	test_diff(6, 7, 2, 30);
+	
+	// a completely different file, with no blocks matching.
+	test_diff(7, 8, 14, 0, true /* completely different expected */);
+	
+	// diff to zero sized file
+	test_diff(8, 9, 0, 0, true /* completely different expected */);
+	
+	// Check that both searches for matching blocks find the same blocks,
+	// diffing every version against every other, with every way of
+	// rolling the checksums which this CPU supports.
+	int bestBatch = RollingChecksum::GetBatchImplementation();
+	for(int impl = 0; impl < RollingChecksum::Batch_Max; ++impl)
+	{
+		if(!RollingChecksum::SetBatchImplementation(impl))
+		{
+			continue;
+		}
+
+		for(int from = 0; from <= 8; ++from)
+		{
+			for(int to = 0; to <= 9; ++to)
+			{
+				if(from != to)
+				{
+					test_diff_search_methods_agree(from, to, impl);
+				}
+			}
+		}
+	}
+	RollingChecksum::SetBatchImplementation(bestBatch);
+
+	// Check that encoding on worker threads gives the same result, for
+	// whole files and for diffs, with more threads than there are blocks
+	for(int to = 0; to <= 9; ++to)
+	{
+		test_encoding_threads_agree(-1, to, 3);
+	}
+	for(int from = 0; from <= 8; ++from)
+	{
+		test_encoding_threads_agree(from, from + 1, 2);
+		test_encoding_threads_agree(from, from + 1, 16);
+	}
+	test_decoding_threads(4);
+	test_encoding_threads_throughput("testfiles/throughput", 32*1024*1024);
+
+	// Content defined chunking, encoding on the calling thread and on
+	// worker threads
+	test_chunk_sizes_scale_with_file_size();
+	test_content_defined_chunking(0);
+	test_content_defined_chunking(2);
+
+	// Fingerprints of blocks, for finding them in other files
+	test_block_fingerprints("testfiles/f0", "testfiles/f0.encoded",
+		"testfiles/f2", false);
+	test_block_fingerprints("testfiles/cdc0-0", "testfiles/cdc0-0.encoded",
+		"testfiles/cdc1-0", true);
+
+	// Test that combining diffs works
+	test_combined_diffs();
+
+	// Rebuild versions from whole chains of diffs in one go
+	for(int v = 0; v <= MAX_DIFF; ++v)
+	{
+		test_combined_patch_chain(v, v);
+		if(v > 0) test_combined_patch_chain(0, v);
+		if(v > 2) test_combined_patch_chain(v - 2, v);
+		test_file_ranges(v, v);
+		if(v > 0) test_file_ranges(0, v);
+	}
+	
+	// Check zero sized file works OK to encode on its own, using normal encoding
+	{
+		{
+			// Encode
+			BackupStoreFilenameClear fn("filename");
+			FileStream out("testfiles/f9.zerotest", O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile("testfiles/f9", 1 /* dir ID */, fn));
+			encoded->CopyStreamTo(out);
+			out.Close();
+			check_encoded_file("testfiles/f9.zerotest", 0, 0, 0);		
+		}
+		{
+			// Decode
+			FileStream enc("testfiles/f9.zerotest");
+			BackupStoreFile::DecodeFile(enc, "testfiles/f9.testdec.zero", IOStream::TimeOutInfinite);
+			TEST_THAT(files_identical("testfiles/f9", "testfiles/f9.testdec.zero"));
+		}
+	}
+	
+#ifndef WIN32	
+	// Check that symlinks aren't diffed
+	TEST_THAT(::symlink("f2", "testfiles/f2.symlink") == 0)
+	// And go and diff it against the previous encoded file
+	{
+		bool completelyDifferent = false;
+		{
+			FileStream blockindex("testfiles/f1.encoded");
+			BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+			
+			BackupStoreFilenameClear f1name("filename");
+			FileStream out("testfiles/f2.symlink.diff", O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded(
+				BackupStoreFile::EncodeFileDiff(
+					"testfiles/f2.symlink", 
+					1 /* dir ID */, 
+					f1name,
+					1001 /* object ID of the file diffing from */, 
+					blockindex, 
+					IOStream::TimeOutInfinite,
+					NULL, // DiffTimer interface
+					0, 
+					&completelyDifferent));
+			encoded->CopyStreamTo(out);
+		}
+		TEST_THAT(completelyDifferent == true);
+		check_encoded_file("testfiles/f2.symlink.diff", 0, 0, 0);		
+	}
+#endif
+
+	// Check that diffing against a file which isn't "complete" and 
+	// references another isn't allowed
+	{
+		FileStream blockindex("testfiles/f1.diff");
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+		
+		BackupStoreFilenameClear f1name("filename");
+		FileStream out("testfiles/f2.testincomplete", O_WRONLY | O_CREAT | O_EXCL);
+		TEST_CHECK_THROWS(BackupStoreFile::EncodeFileDiff("testfiles/f2", 1 /* dir ID */, f1name,
+			1001 /* object ID of the file diffing from */, blockindex, IOStream::TimeOutInfinite,
+			0, 0), BackupStoreException, CannotDiffAnIncompleteStoreFile);
+	}
+
+	// Found a nasty case where files of lots of the same thing 
+	// suck up lots of processor time -- because of lots of matches 
+	// found. Check this out!
+
+	#ifdef WIN32
+	BOX_WARNING("Testing diffing two large streams, may take a while!");
+	::fflush(stderr);
+	#endif
+
+	if (!make_file_of_zeros("testfiles/zero.0", 20*1024*1024))
+	{
+		return 1;
+	}
+
+	if (!make_file_of_zeros("testfiles/zero.1", 200*1024*1024))
+	{
+		remove("testfiles/zero.0");
+		return 1;
+	}
+
+	// Generate a first encoded file
+	{
+		BackupStoreFilenameClear f0name("zero.0");
+		FileStream out("testfiles/zero.0.enc", O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile("testfiles/zero.0", 1 /* dir ID */, f0name));
+		encoded->CopyStreamTo(out);
+	}
+	// Then diff from it -- time how long it takes...
+	{
+		int beginTime = time(0);
+		FileStream blockindex("testfiles/zero.0.enc");
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+
+		BackupStoreFilenameClear f1name("zero.1");
+		FileStream out("testfiles/zero.1.enc", O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFileDiff("testfiles/zero.1", 1 /* dir ID */, f1name,
+			2000 /* object ID of the file diffing from */, blockindex, IOStream::TimeOutInfinite,
+			0, 0));
+		encoded->CopyStreamTo(out);
+
+		printf("Time taken: %d seconds\n", (int)(time(0) - beginTime));
+
+		#ifdef WIN32
+		TEST_THAT(time(0) < (beginTime + 300));
+		#else
+		TEST_THAT(time(0) < (beginTime + 40));
+		#endif
+	}
+	// Remove zero-files to save disk space
+	remove("testfiles/zero.0");
+	remove("testfiles/zero.1");
+
+#if 0
+	// Code for a nasty real world example! (16Mb files, won't include them in the distribution
+	// for obvious reasons...)
+	// Generate a first encoded file
+	{
+		BackupStoreFilenameClear f0name("0000000000000000.old");
+		FileStream out("testfiles/0000000000000000.enc.0", O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile("/Users/ben/Desktop/0000000000000000.old", 1 /* dir ID */, f0name));
+		encoded->CopyStreamTo(out);
+	}
+	// Then diff from it -- time how long it takes...
+	{
+		int beginTime = time(0);
+		FileStream blockindex("testfiles/0000000000000000.enc.0");
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+
+		BackupStoreFilenameClear f1name("0000000000000000.new");
+		FileStream out("testfiles/0000000000000000.enc.1", O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFileDiff("/Users/ben/Desktop/0000000000000000.new", 1 /* dir ID */, f1name,
+			2000 /* object ID of the file diffing from */, blockindex, IOStream::TimeOutInfinite,
+			0, 0));
+		encoded->CopyStreamTo(out);
+		TEST_THAT(time(0) < (beginTime + 20));
+	}
+#endif // 0
+
+	return 0;
+}
+
+
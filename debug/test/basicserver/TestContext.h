@@ -0,0 +1,7 @@
+
+class TestContext
+{
+public:
+	TestContext();
+	~TestContext();
+};
@@ -0,0 +1,6 @@
+# $OpenBSD: dot.profile,v 1.3 2002/06/09 06:15:15 todd Exp $
+#
+# sh/ksh initialization
+
+PATH=$HOME/bin:/bin:/sbin:/usr/bin:/usr/sbin:/usr/local/bin:/usr/local/sbin:/usr/games:.
+export PATH HOME TERM
@@ -0,0 +1,715 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    testhttpserver.cpp
+//		Purpose: Test code for HTTP server class
+//		Created: 26/3/04
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef HAVE_SIGNAL_H
+	#include <signal.h>
+#endif
+
+#include <openssl/hmac.h>
+
+#include "autogen_HTTPException.h"
+#include "CollectInBufferStream.h"
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include "HTTPServer.h"
+#include "IOStreamGetLine.h"
+#include "S3Client.h"
+#include "S3Simulator.h"
+#include "ServerControl.h"
+#include "Test.h"
+#include "Utils.h"
+#include "decode.h"
+#include "encode.h"
+
+#include "MemLeakFindOn.h"
+
+#define SHORT_TIMEOUT 5000
+
+// A stream which doesn't say how much data it has, so responses which send
+// it can't say how long they are either
+class UnknownSizeStream : public CollectInBufferStream
+{
+public:
+	virtual pos_type BytesLeftToRead() {return IOStream::SizeOfStreamUnknown;}
+};
+
+// Enough for several chunks, as HTTPResponse sends them
+#define STREAM_RESPONSE_REPEATS 4000
+#define STREAM_RESPONSE_TEXT "0123456789"
+
+class TestWebServer : public HTTPServer
+{
+public:
+	TestWebServer();
+	~TestWebServer();
+
+	virtual void Handle(HTTPRequest &rRequest, HTTPResponse &rResponse);
+
+};
+
+// Build a nice HTML response, so this can also be tested neatly in a browser
+void TestWebServer::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
+{
+	// Test redirection mechanism
+	if(rRequest.GetRequestURI() == "/redirect")
+	{
+		rResponse.SetAsRedirect("/redirected");
+		return;
+	}
+
+	// Test streaming a response of unknown size
+	if(rRequest.GetRequestURI() == "/stream")
+	{
+		std::auto_ptr<UnknownSizeStream> apStream(new UnknownSizeStream);
+		for(int i = 0; i < STREAM_RESPONSE_REPEATS; i++)
+		{
+			apStream->IOStream::Write(STREAM_RESPONSE_TEXT);
+		}
+		apStream->SetForReading();
+		rResponse.SetResponseCode(HTTPResponse::Code_OK);
+		rResponse.SetContentType("text/plain");
+		rResponse.SetResponseStream(std::auto_ptr<IOStream>(apStream.release()));
+		return;
+	}
+
+	// Set a cookie?
+	if(rRequest.GetRequestURI() == "/set-cookie")
+	{
+		rResponse.SetCookie("SetByServer", "Value1");
+	}
+
+	#define DEFAULT_RESPONSE_1 "<html>\n<head><title>TEST SERVER RESPONSE</title></head>\n<body><h1>Test response</h1>\n<p><b>URI:</b> "
+	#define DEFAULT_RESPONSE_3 "</p>\n<p><b>Query string:</b> "
+	#define DEFAULT_RESPONSE_4 "</p>\n<p><b>Method:</b> "
+	#define DEFAULT_RESPONSE_5 "</p>\n<p><b>Decoded query:</b><br>"
+	#define DEFAULT_RESPONSE_6 "</p>\n<p><b>Content type:</b> "
+	#define DEFAULT_RESPONSE_7 "</p>\n<p><b>Content length:</b> "
+	#define DEFAULT_RESPONSE_8 "</p>\n<p><b>Cookies:</b><br>\n"
+	#define DEFAULT_RESPONSE_2 "</p>\n</body>\n</html>\n"
+
+	rResponse.SetResponseCode(HTTPResponse::Code_OK);
+	rResponse.SetContentType("text/html");
+	rResponse.Write(DEFAULT_RESPONSE_1, sizeof(DEFAULT_RESPONSE_1) - 1);
+	const std::string &ruri(rRequest.GetRequestURI());
+	rResponse.Write(ruri.c_str(), ruri.size());
+	rResponse.Write(DEFAULT_RESPONSE_3, sizeof(DEFAULT_RESPONSE_3) - 1);
+	const std::string &rquery(rRequest.GetQueryString());
+	rResponse.Write(rquery.c_str(), rquery.size());
+	rResponse.Write(DEFAULT_RESPONSE_4, sizeof(DEFAULT_RESPONSE_4) - 1);
+	{
+		const char *m = "????";
+		switch(rRequest.GetMethod())
+		{
+		case HTTPRequest::Method_GET: m = "GET "; break;
+		case HTTPRequest::Method_HEAD: m = "HEAD"; break;
+		case HTTPRequest::Method_POST: m = "POST"; break;
+		default: m = "UNKNOWN";
+		}
+		rResponse.Write(m, 4);
+	}
+	rResponse.Write(DEFAULT_RESPONSE_5, sizeof(DEFAULT_RESPONSE_5) - 1);
+	{
+		const HTTPRequest::Query_t &rquery(rRequest.GetQuery());
+		for(HTTPRequest::Query_t::const_iterator i(rquery.begin()); i != rquery.end(); ++i)
+		{
+			rResponse.Write("\nPARAM:", 7);
+			rResponse.Write(i->first.c_str(), i->first.size());
+			rResponse.Write("=", 1);
+			rResponse.Write(i->second.c_str(), i->second.size());
+			rResponse.Write("<br>\n", 4);
+		}
+	}
+	rResponse.Write(DEFAULT_RESPONSE_6, sizeof(DEFAULT_RESPONSE_6) - 1);
+	const std::string &rctype(rRequest.GetContentType());
+	rResponse.Write(rctype.c_str(), rctype.size());
+	rResponse.Write(DEFAULT_RESPONSE_7, sizeof(DEFAULT_RESPONSE_7) - 1);
+	{
+		char l[32];
+		rResponse.Write(l, ::sprintf(l, "%d", rRequest.GetContentLength()));
+	}
+	rResponse.Write(DEFAULT_RESPONSE_8, sizeof(DEFAULT_RESPONSE_8) - 1);
+	const HTTPRequest::CookieJar_t *pcookies = rRequest.GetCookies();
+	if(pcookies != 0)
+	{
+		HTTPRequest::CookieJar_t::const_iterator i(pcookies->begin());
+		for(; i != pcookies->end(); ++i)
+		{
+			char t[512];
+			rResponse.Write(t, ::sprintf(t, "COOKIE:%s=%s<br>\n", i->first.c_str(), i->second.c_str()));
+		}
+	}
+	rResponse.Write(DEFAULT_RESPONSE_2, sizeof(DEFAULT_RESPONSE_2) - 1);
+}
+
+TestWebServer::TestWebServer() {}
+TestWebServer::~TestWebServer() {}
+
+int test(int argc, const char *argv[])
+{
+	if(argc >= 2 && ::strcmp(argv[1], "server") == 0)
+	{
+		// Run a server
+		TestWebServer server;
+		return server.Main("doesnotexist", argc - 1, argv + 1);
+	}
+
+	if(argc >= 2 && ::strcmp(argv[1], "s3server") == 0)
+	{
+		// Run a server
+		S3Simulator server;
+		return server.Main("doesnotexist", argc - 1, argv + 1);
+	}
+
+#ifndef WIN32
+	TEST_THAT(system("rm -rf *.memleaks") == 0);
+#endif
+
+	// Start the server
+	int pid = StartDaemon(0, TEST_EXECUTABLE " server testfiles/httpserver.conf",
+		"testfiles/httpserver.pid");
+	TEST_THAT_OR(pid > 0, return 1);
+
+	// Run the request script
+	TEST_THAT(::system("perl testfiles/testrequests.pl") == 0);
+
+	#ifndef WIN32
+	signal(SIGPIPE, SIG_IGN);
+	#endif
+
+	SocketStream sock;
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+
+	for (int i = 0; i < 4; i++)
+	{
+		HTTPRequest request(HTTPRequest::Method_GET,
+			"/test-one/34/341s/234?p1=vOne&p2=vTwo");
+
+		// first set of passes has keepalive off, so the server closes
+		// the socket after each response, and the rest share one socket.
+		request.SetClientKeepAliveRequested(i >= 2);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+
+		TEST_THAT(response.GetResponseCode() == HTTPResponse::Code_OK);
+		TEST_EQUAL((i >= 2), response.IsKeepAlive());
+		TEST_THAT(response.GetContentType() == "text/html");
+
+		IOStreamGetLine getline(response);
+		std::string line;
+
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<html>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<head><title>TEST SERVER RESPONSE</title></head>",
+			line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<body><h1>Test response</h1>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>URI:</b> /test-one/34/341s/234</p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Query string:</b> p1=vOne&p2=vTwo</p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Method:</b> GET </p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Decoded query:</b><br>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("PARAM:p1=vOne<br>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("PARAM:p2=vTwo<br></p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Content type:</b> </p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Content length:</b> -1</p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("<p><b>Cookies:</b><br>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("</p>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("</body>", line);
+		TEST_THAT(getline.GetLine(line));
+		TEST_EQUAL("</html>", line);
+
+		if(!response.IsKeepAlive())
+		{
+			BOX_TRACE("Server will close the connection, closing our end too.");
+			char c;
+			TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+			TEST_THAT(!sock.StreamDataLeft());
+			sock.Close();
+			sock.Open(Socket::TypeINET, "localhost", 1080);
+		}
+		else
+		{
+			BOX_TRACE("Server will keep the connection open for more requests.");
+		}
+	}
+
+	sock.Close();
+
+	// A response of unknown size is sent in chunks to HTTP/1.1 clients,
+	// and the connection stays open for the next request
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		std::string expected;
+		for(int i = 0; i < STREAM_RESPONSE_REPEATS; i++)
+		{
+			expected += STREAM_RESPONSE_TEXT;
+		}
+
+		HTTPRequest request(HTTPRequest::Method_GET, "/stream");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(response.IsKeepAlive());
+		TEST_EQUAL(expected, std::string((const char *)response.GetBuffer(),
+			response.GetSize()));
+
+		HTTPRequest request2(HTTPRequest::Method_GET, "/after-stream");
+		request2.SetClientKeepAliveRequested(true);
+		request2.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response2;
+		response2.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response2.GetResponseCode());
+		TEST_THAT(response2.IsKeepAlive());
+		IOStreamGetLine getline(response2);
+		std::string line;
+		for(int i = 0; i < 4; i++)
+		{
+			TEST_THAT(getline.GetLine(line));
+		}
+		TEST_EQUAL("<p><b>URI:</b> /after-stream</p>", line);
+
+		// The third request on a connection is the last one, as
+		// configured by KeepAliveMaxRequests
+		HTTPRequest request3(HTTPRequest::Method_GET, "/last");
+		request3.SetClientKeepAliveRequested(true);
+		request3.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response3;
+		response3.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response3.GetResponseCode());
+		TEST_THAT(!response3.IsKeepAlive());
+		char c;
+		TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
+
+	// HTTP/1.0 clients don't understand chunks, so the end of the stream
+	// is marked by closing the connection instead
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		sock.IOStream::Write("GET /stream HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(!response.IsKeepAlive());
+		TEST_EQUAL(STREAM_RESPONSE_REPEATS * (sizeof(STREAM_RESPONSE_TEXT) - 1),
+			response.GetSize());
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
+
+	// Idle kept-alive connections are closed after KeepAliveTimeout
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		HTTPRequest request(HTTPRequest::Method_GET, "/idle");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(response.IsKeepAlive());
+
+		char c;
+		TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
+
+	// Kill it
+	TEST_THAT(StopDaemon(pid, "testfiles/httpserver.pid",
+		"generic-httpserver.memleaks", true));
+
+	// correct, official signature should succeed, with lower-case header
+	{
+		// http://docs.amazonwebservices.com/AmazonS3/2006-03-01/RESTAuthentication.html
+		HTTPRequest request(HTTPRequest::Method_GET, "/photos/puppy.jpg");
+		request.SetHostName("johnsmith.s3.amazonaws.com");
+		request.AddHeader("date", "Tue, 27 Mar 2007 19:36:42 +0000");
+		request.AddHeader("authorization",
+			"AWS 0PN5J17HBGZHT7JJ3X82:xXjDGYUmKxnwqr5KXNPGldn5LbA=");
+
+		S3Simulator simulator;
+		simulator.Configure("testfiles/s3simulator.conf");
+
+		CollectInBufferStream response_buffer;
+		HTTPResponse response(&response_buffer);
+
+		simulator.Handle(request, response);
+		TEST_EQUAL(200, response.GetResponseCode());
+
+		// The object is streamed from the file, not in the response yet
+		TEST_THAT(response.HasResponseStream());
+		response.CollectResponseStream();
+		std::string response_data((const char *)response.GetBuffer(),
+			response.GetSize());
+		TEST_EQUAL("omgpuppies!\n", response_data);
+	}
+
+	// modified signature should fail
+	{
+		// http://docs.amazonwebservices.com/AmazonS3/2006-03-01/RESTAuthentication.html
+		HTTPRequest request(HTTPRequest::Method_GET, "/photos/puppy.jpg");
+		request.SetHostName("johnsmith.s3.amazonaws.com");
+		request.AddHeader("date", "Tue, 27 Mar 2007 19:36:42 +0000");
+		request.AddHeader("authorization",
+			"AWS 0PN5J17HBGZHT7JJ3X82:xXjDGYUmKxnwqr5KXNPGldn5LbB=");
+
+		S3Simulator simulator;
+		simulator.Configure("testfiles/s3simulator.conf");
+
+		CollectInBufferStream response_buffer;
+		HTTPResponse response(&response_buffer);
+
+		simulator.Handle(request, response);
+		TEST_EQUAL(401, response.GetResponseCode());
+
+		std::string response_data((const char *)response.GetBuffer(),
+			response.GetSize());
+		TEST_EQUAL("<html><head>"
+			"<title>Internal Server Error</title></head>\n"
+			"<h1>Internal Server Error</h1>\n"
+			"<p>An error, type Authentication Failed occured "
+			"when processing the request.</p>"
+			"<p>Please try again later.</p></body>\n"
+			"</html>\n", response_data);
+	}
+
+	// S3Client tests with S3Simulator in-process server for debugging
+	{
+		S3Simulator simulator;
+		simulator.Configure("testfiles/s3simulator.conf");
+		S3Client client(&simulator, "johnsmith.s3.amazonaws.com",
+			"0PN5J17HBGZHT7JJ3X82",
+			"uV3F3YluFJax1cknvbcGwgjvx4QpvB+leU8dUj2o");
+		
+		HTTPResponse response = client.GetObject("/photos/puppy.jpg");
+		TEST_EQUAL(200, response.GetResponseCode());
+		std::string response_data((const char *)response.GetBuffer(),
+			response.GetSize());
+		TEST_EQUAL("omgpuppies!\n", response_data);
+
+		// make sure that assigning to HTTPResponse does clear stream
+		response = client.GetObject("/photos/puppy.jpg");
+		TEST_EQUAL(200, response.GetResponseCode());
+		response_data = std::string((const char *)response.GetBuffer(),
+			response.GetSize());
+		TEST_EQUAL("omgpuppies!\n", response_data);
+
+		response = client.GetObject("/nonexist");
+		TEST_EQUAL(404, response.GetResponseCode());
+		
+		FileStream fs("testfiles/testrequests.pl");
+		response = client.PutObject("/newfile", fs);
+		TEST_EQUAL(200, response.GetResponseCode());
+
+		response = client.GetObject("/newfile");
+		TEST_EQUAL(200, response.GetResponseCode());
+		FileStream fs2("testfiles/testrequests.pl");
+		TEST_THAT(fs2.CompareWith(response));
+		TEST_EQUAL(0, ::unlink("testfiles/newfile"));
+
+		// Multipart upload, with parts much smaller than S3 allows
+		// to make several of them
+		FileStream original("testfiles/testrequests.pl");
+		client.PutObjectMultipart("/multipart", original, 1000);
+		response = client.GetObject("/multipart");
+		TEST_EQUAL(200, response.GetResponseCode());
+		FileStream original2("testfiles/testrequests.pl");
+		TEST_THAT(original2.CompareWith(response));
+		TEST_EQUAL(0, ::unlink("testfiles/multipart"));
+
+		// A part's ETag is its MD5 digest, and a different one
+		// can't complete the upload
+		std::string uploadID = client.CreateMultipartUpload("/multipart");
+		CollectInBufferStream part;
+		part.Write("hello", 5);
+		part.SetForReading();
+		response = client.UploadPart("/multipart", uploadID, 1, part);
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL("\"5d41402abc4b2a76b9719d911017c592\"",
+			response.GetHeaderValue("ETag"));
+
+		std::vector<std::string> etags;
+		etags.push_back("\"828ef3fdfa96f00ad9f27c383fc9ac7f\"");
+		response = client.CompleteMultipartUpload("/multipart",
+			uploadID, etags);
+		TEST_EQUAL(400, response.GetResponseCode());
+		TEST_THAT(!FileExists("testfiles/multipart"));
+
+		// Aborting it deletes the parts, and the upload can't be
+		// used again
+		response = client.AbortMultipartUpload("/multipart", uploadID);
+		TEST_EQUAL(204, response.GetResponseCode());
+		TEST_THAT(!FileExists("testfiles/multipart.upload-" + uploadID));
+		TEST_THAT(!FileExists("testfiles/multipart.upload-" + uploadID +
+			".1"));
+		part.Seek(0, IOStream::SeekType_Absolute);
+		response = client.UploadPart("/multipart", uploadID, 1, part);
+		TEST_EQUAL(404, response.GetResponseCode());
+		response = client.AbortMultipartUpload("/multipart", uploadID);
+		TEST_EQUAL(404, response.GetResponseCode());
+	}
+
+	{
+		HTTPRequest request(HTTPRequest::Method_PUT, "/newfile");
+		request.SetHostName("quotes.s3.amazonaws.com");
+		request.AddHeader("date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request.AddHeader("authorization",
+			"AWS 0PN5J17HBGZHT7JJ3X82:XtMYZf0hdOo4TdPYQknZk0Lz7rw=");
+		request.AddHeader("Content-Type", "text/plain");
+
+		FileStream fs("testfiles/testrequests.pl");
+		fs.CopyStreamTo(request);
+		request.SetForReading();
+
+		CollectInBufferStream response_buffer;
+		HTTPResponse response(&response_buffer);
+
+		S3Simulator simulator;
+		simulator.Configure("testfiles/s3simulator.conf");
+		simulator.Handle(request, response);
+
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL("LriYPLdmOdAiIfgSm/F1YsViT1LW94/xUQxMsF7xiEb1a0wiIOIxl+zbwZ163pt7",
+			response.GetHeaderValue("x-amz-id-2"));
+		TEST_EQUAL("F2A8CCCA26B4B26D", response.GetHeaderValue("x-amz-request-id"));
+		TEST_EQUAL("Wed, 01 Mar  2006 12:00:00 GMT", response.GetHeaderValue("Date"));
+		TEST_EQUAL("Sun, 1 Jan 2006 12:00:00 GMT", response.GetHeaderValue("Last-Modified"));
+		TEST_EQUAL("\"828ef3fdfa96f00ad9f27c383fc9ac7f\"", response.GetHeaderValue("ETag"));
+		TEST_EQUAL("", response.GetContentType());
+		TEST_EQUAL("AmazonS3", response.GetHeaderValue("Server"));
+		TEST_EQUAL(0, response.GetSize());
+
+		FileStream f1("testfiles/testrequests.pl");
+		FileStream f2("testfiles/newfile");
+		TEST_THAT(f1.CompareWith(f2));
+		TEST_EQUAL(0, EMU_UNLINK("testfiles/newfile"));
+	}
+
+	// Start the S3Simulator server
+	pid = StartDaemon(0, TEST_EXECUTABLE " s3server testfiles/s3simulator.conf",
+		"testfiles/s3simulator.pid");
+	TEST_THAT_OR(pid > 0, return 1);
+
+	{
+		SocketStream sock;
+		sock.Open(Socket::TypeINET, "localhost", 1080);
+
+		HTTPRequest request(HTTPRequest::Method_GET, "/nonexist");
+		request.SetHostName("quotes.s3.amazonaws.com");
+		request.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:0cSX/YPdtXua1aFFpYmH1tc0ajA=");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		std::string value;
+		TEST_EQUAL(404, response.GetResponseCode());
+	}
+
+	#ifndef WIN32 // much harder to make files inaccessible on WIN32
+	// Make file inaccessible, should cause server to return a 403 error,
+	// unless of course the test is run as root :)
+	{
+		SocketStream sock;
+		sock.Open(Socket::TypeINET, "localhost", 1080);
+
+		TEST_THAT(chmod("testfiles/testrequests.pl", 0) == 0);
+		HTTPRequest request(HTTPRequest::Method_GET,
+			"/testrequests.pl");
+		request.SetHostName("quotes.s3.amazonaws.com");
+		request.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:qc1e8u8TVl2BpIxwZwsursIb8U8=");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		std::string value;
+		TEST_EQUAL(403, response.GetResponseCode());
+		TEST_THAT(chmod("testfiles/testrequests.pl", 0755) == 0);
+	}
+	#endif
+
+	{
+		SocketStream sock;
+		sock.Open(Socket::TypeINET, "localhost", 1080);
+
+		HTTPRequest request(HTTPRequest::Method_GET,
+			"/testrequests.pl");
+		request.SetHostName("quotes.s3.amazonaws.com");
+		request.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:qc1e8u8TVl2BpIxwZwsursIb8U8=");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		std::string value;
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL("qBmKRcEWBBhH6XAqsKU/eg24V3jf/kWKN9dJip1L/FpbYr9FDy7wWFurfdQOEMcY", response.GetHeaderValue("x-amz-id-2"));
+		TEST_EQUAL("F2A8CCCA26B4B26D", response.GetHeaderValue("x-amz-request-id"));
+		TEST_EQUAL("Wed, 01 Mar  2006 12:00:00 GMT", response.GetHeaderValue("Date"));
+		TEST_EQUAL("Sun, 1 Jan 2006 12:00:00 GMT", response.GetHeaderValue("Last-Modified"));
+		TEST_EQUAL("\"828ef3fdfa96f00ad9f27c383fc9ac7f\"", response.GetHeaderValue("ETag"));
+		TEST_EQUAL("text/plain", response.GetContentType());
+		TEST_EQUAL("AmazonS3", response.GetHeaderValue("Server"));
+
+		FileStream file("testfiles/testrequests.pl");
+		TEST_THAT(file.CompareWith(response));
+
+		// Objects are streamed with their length, so the connection
+		// can be used again
+		TEST_THAT(response.IsKeepAlive());
+		HTTPRequest request2(HTTPRequest::Method_GET,
+			"/testrequests.pl");
+		request2.SetHostName("quotes.s3.amazonaws.com");
+		request2.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request2.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:qc1e8u8TVl2BpIxwZwsursIb8U8=");
+		request2.SetClientKeepAliveRequested(true);
+		request2.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response2;
+		response2.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(200, response2.GetResponseCode());
+		FileStream file2("testfiles/testrequests.pl");
+		TEST_THAT(file2.CompareWith(response2));
+	}
+
+	{
+		SocketStream sock;
+		sock.Open(Socket::TypeINET, "localhost", 1080);
+
+		HTTPRequest request(HTTPRequest::Method_PUT, "/newfile");
+		request.SetHostName("quotes.s3.amazonaws.com");
+		request.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:kfY1m6V3zTufRy2kj92FpQGKz4M=");
+		request.AddHeader("Content-Type", "text/plain");
+		FileStream fs("testfiles/testrequests.pl");
+		HTTPResponse response;
+		request.SendWithStream(sock, SHORT_TIMEOUT, &fs, response);
+		std::string value;
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL("LriYPLdmOdAiIfgSm/F1YsViT1LW94/xUQxMsF7xiEb1a0wiIOIxl+zbwZ163pt7", response.GetHeaderValue("x-amz-id-2"));
+		TEST_EQUAL("F2A8CCCA26B4B26D", response.GetHeaderValue("x-amz-request-id"));
+		TEST_EQUAL("Wed, 01 Mar  2006 12:00:00 GMT", response.GetHeaderValue("Date"));
+		TEST_EQUAL("Sun, 1 Jan 2006 12:00:00 GMT", response.GetHeaderValue("Last-Modified"));
+		TEST_EQUAL("\"828ef3fdfa96f00ad9f27c383fc9ac7f\"", response.GetHeaderValue("ETag"));
+		TEST_EQUAL("", response.GetContentType());
+		TEST_EQUAL("AmazonS3", response.GetHeaderValue("Server"));
+		TEST_EQUAL(0, response.GetSize());
+
+		FileStream f1("testfiles/testrequests.pl");
+		FileStream f2("testfiles/newfile");
+		TEST_THAT(f1.CompareWith(f2));
+		TEST_THAT(EMU_UNLINK("testfiles/newfile") == 0);
+	}
+
+	// S3Client keeps connections to the server open, and can make
+	// several requests at once
+	{
+		S3Client client("localhost", 1080, "0PN5J17HBGZHT7JJ3X82",
+			"uV3F3YluFJax1cknvbcGwgjvx4QpvB+leU8dUj2o",
+			3 /* connections */);
+
+		for (int i = 0; i < 3; i++)
+		{
+			HTTPResponse response =
+				client.GetObject("/testrequests.pl");
+			TEST_EQUAL(200, response.GetResponseCode());
+			FileStream file("testfiles/testrequests.pl");
+			TEST_THAT(file.CompareWith(response));
+		}
+
+		// A HEAD response has the length of the object, but not
+		// the object itself
+		int64_t size;
+		TEST_THAT(FileExists("testfiles/testrequests.pl", &size));
+		HTTPResponse response = client.HeadObject("/testrequests.pl");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(size, response.GetContentLength());
+		TEST_EQUAL(0, response.GetSize());
+		TEST_EQUAL(1, client.GetNumConnectionsOpened());
+
+		std::vector<std::future<HTTPResponse> > responses;
+		for (int i = 0; i < 8; i++)
+		{
+			responses.push_back(
+				client.GetObjectAsync("/testrequests.pl"));
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			HTTPResponse response = responses[i].get();
+			TEST_EQUAL(200, response.GetResponseCode());
+			FileStream file("testfiles/testrequests.pl");
+			TEST_THAT(file.CompareWith(response));
+		}
+		TEST_THAT(client.GetNumConnectionsOpened() <= 3);
+
+		// Parts of a multipart upload are sent several at once
+		CollectInBufferStream original;
+		for (int i = 0; i < 20000; i++)
+		{
+			original.Write(&i, sizeof(i));
+		}
+		original.SetForReading();
+		client.PutObjectMultipart("/multipart", original, 16*1024);
+
+		response = client.GetObject("/multipart");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(original.GetSize(), response.GetSize());
+		TEST_EQUAL(0, memcmp(original.GetBuffer(), response.GetBuffer(),
+			original.GetSize()));
+		TEST_EQUAL(0, EMU_UNLINK("testfiles/multipart"));
+		TEST_THAT(client.GetNumConnectionsOpened() <= 3);
+
+		// The server closes connections which are idle for too long,
+		// and a new one is opened instead
+		int64_t opened = client.GetNumConnectionsOpened();
+		safe_sleep(2);
+		response = client.GetObject("/testrequests.pl");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(opened + 1, client.GetNumConnectionsOpened());
+	}
+
+	// Kill it
+	TEST_THAT(StopDaemon(pid, "testfiles/s3simulator.pid",
+		"s3simulator.memleaks", true));
+
+	return 0;
+}
+
@@ -0,0 +1,243 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupClientFileRangeStream.cpp
+//		Purpose: Read an encoded file on the store a range at a time
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <string.h>
+
+#include "autogen_BackupProtocol.h"
+#include "autogen_ClientException.h"
+#include "BackupClientFileRangeStream.h"
+#include "CommonException.h"
+
+#include "MemLeakFindOn.h"
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::BackupClientFileRangeStream(
+//			 BackupProtocolCallable &, int64_t, int64_t, int)
+//		Purpose: Constructor. Fetches the start of the file, which
+//			 also finds out how big it is.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientFileRangeStream::BackupClientFileRangeStream(
+	BackupProtocolCallable &rProtocol, int64_t InDirectory,
+	int64_t ObjectID, int ReadAheadSize)
+	: mrProtocol(rProtocol),
+	  mInDirectory(InDirectory),
+	  mObjectID(ObjectID),
+	  mReadAheadSize(ReadAheadSize),
+	  mSize(-1),
+	  mPosition(0),
+	  mBufferStart(0),
+	  mNumberOfFetches(0)
+{
+	ASSERT(ReadAheadSize > 0);
+	Fetch(0, mReadAheadSize);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::~BackupClientFileRangeStream()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientFileRangeStream::~BackupClientFileRangeStream()
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::Fetch(int64_t, int64_t)
+//		Purpose: Private. Replace the buffer with data from the file
+//			 starting at Offset, at least Length bytes of it if the
+//			 file is long enough.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileRangeStream::Fetch(int64_t Offset, int64_t Length)
+{
+	if(Length < mReadAheadSize)
+	{
+		Length = mReadAheadSize;
+	}
+
+	std::auto_ptr<BackupProtocolSuccess> reply(mrProtocol.QueryGetFileRange(
+		mInDirectory, mObjectID, Offset, Length));
+	++mNumberOfFetches;
+
+	int64_t size = reply->GetObjectID();
+	if(mSize != -1 && size != mSize)
+	{
+		THROW_EXCEPTION(ClientException, RemoteFileRangeIncomplete)
+	}
+	mSize = size;
+
+	mBuffer.Reset();
+	mBufferStart = Offset;
+	if(Offset < mSize)
+	{
+		std::auto_ptr<IOStream> range(mrProtocol.ReceiveStream());
+		range->CopyStreamTo(mBuffer, mrProtocol.GetTimeout(),
+			64*1024 /* buffer size */);
+	}
+	mBuffer.SetForReading();
+
+	int64_t expected = mSize - Offset;
+	if(expected > Length) expected = Length;
+	if(expected < 0) expected = 0;
+	if(mBuffer.GetSize() != expected)
+	{
+		THROW_EXCEPTION(ClientException, RemoteFileRangeIncomplete)
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::Read(void *, int, int)
+//		Purpose: As interface. Fetches more of the file if the data
+//			 at the current position hasn't been fetched.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientFileRangeStream::Read(void *pBuffer, int NBytes, int Timeout)
+{
+	if(mPosition >= mSize || NBytes <= 0)
+	{
+		return 0;
+	}
+
+	int64_t positionInBuffer = mPosition - mBufferStart;
+	if(positionInBuffer < 0 || positionInBuffer >= mBuffer.GetSize())
+	{
+		Fetch(mPosition, NBytes);
+		positionInBuffer = 0;
+	}
+
+	int64_t available = mBuffer.GetSize() - positionInBuffer;
+	int bytes = (available < NBytes) ? (int)available : NBytes;
+	::memcpy(pBuffer, ((uint8_t*)mBuffer.GetBuffer()) + positionInBuffer,
+		bytes);
+	mPosition += bytes;
+	return bytes;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::BytesLeftToRead()
+//		Purpose: As interface.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream::pos_type BackupClientFileRangeStream::BytesLeftToRead()
+{
+	return mSize - mPosition;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::Write(const void *, int, int)
+//		Purpose: As interface. The file can only be read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileRangeStream::Write(const void *pBuffer, int NBytes,
+	int Timeout)
+{
+	THROW_EXCEPTION(CommonException, NotSupported)
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::StreamDataLeft()
+//		Purpose: As interface.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupClientFileRangeStream::StreamDataLeft()
+{
+	return mPosition < mSize;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::StreamClosed()
+//		Purpose: As interface. Always closed for writing.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupClientFileRangeStream::StreamClosed()
+{
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::GetPosition()
+//		Purpose: As interface.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream::pos_type BackupClientFileRangeStream::GetPosition() const
+{
+	return mPosition;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileRangeStream::Seek(pos_type, int)
+//		Purpose: As interface. Nothing is fetched until the next read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileRangeStream::Seek(pos_type Offset, int SeekType)
+{
+	int64_t newPosition = Offset;
+	switch(SeekType)
+	{
+	case IOStream::SeekType_Absolute:
+		break;
+	case IOStream::SeekType_Relative:
+		newPosition += mPosition;
+		break;
+	case IOStream::SeekType_End:
+		newPosition += mSize;
+		break;
+	default:
+		THROW_EXCEPTION(CommonException, IOStreamBadSeekType)
+	}
+
+	if(newPosition < 0 || newPosition > mSize)
+	{
+		THROW_EXCEPTION(ClientException, SeekOutsideRemoteFile)
+	}
+
+	mPosition = newPosition;
+}
@@ -0,0 +1,76 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupClientFileRangeStream.h
+//		Purpose: Read an encoded file on the store a range at a time
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPCLIENTFILERANGESTREAM__H
+#define BACKUPCLIENTFILERANGESTREAM__H
+
+#include "CollectInBufferStream.h"
+#include "IOStream.h"
+
+class BackupProtocolCallable;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupClientFileRangeStream
+//		Purpose: A seekable stream of an encoded file on the store, in
+//			 file order. Only the parts which are read are fetched,
+//			 with GetFileRange, so the server must accept
+//			 BACKUP_STORE_SERVER_VERSION_FILE_RANGES. Decode it with
+//			 BackupStoreFile::DecodeFileStream(), with Seekable set,
+//			 to read part of the file without downloading it all.
+//
+//			 Each fetch is at least ReadAheadSize bytes, so the many
+//			 small reads made when decoding the headers don't each
+//			 need a round trip.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupClientFileRangeStream : public IOStream
+{
+public:
+	BackupClientFileRangeStream(BackupProtocolCallable &rProtocol,
+		int64_t InDirectory, int64_t ObjectID,
+		int ReadAheadSize = 64*1024);
+	~BackupClientFileRangeStream();
+private:
+	// no copying
+	BackupClientFileRangeStream(const BackupClientFileRangeStream &);
+	BackupClientFileRangeStream &operator=(const BackupClientFileRangeStream &);
+
+public:
+	virtual int Read(void *pBuffer, int NBytes,
+		int Timeout = IOStream::TimeOutInfinite);
+	virtual pos_type BytesLeftToRead();
+	virtual void Write(const void *pBuffer, int NBytes,
+		int Timeout = IOStream::TimeOutInfinite);
+	virtual bool StreamDataLeft();
+	virtual bool StreamClosed();
+	virtual pos_type GetPosition() const;
+	virtual void Seek(pos_type Offset, int SeekType);
+
+	// Number of GetFileRange commands sent, primarily for tests
+	int64_t GetNumberOfFetches() const {return mNumberOfFetches;}
+
+private:
+	void Fetch(int64_t Offset, int64_t Length);
+
+	BackupProtocolCallable &mrProtocol;
+	int64_t mInDirectory;
+	int64_t mObjectID;
+	int mReadAheadSize;
+	int64_t mSize;
+	int64_t mPosition;
+	// The data last fetched, from mBufferStart onwards
+	CollectInBufferStream mBuffer;
+	int64_t mBufferStart;
+	int64_t mNumberOfFetches;
+};
+
+#endif // BACKUPCLIENTFILERANGESTREAM__H
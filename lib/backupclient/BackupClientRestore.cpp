@@ -21,12 +21,19 @@
 #include <stdio.h>
 #include <errno.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "BackupClientRestore.h"
 #include "autogen_BackupProtocol.h"
 #include "CommonException.h"
 #include "BackupClientFileAttributes.h"
 #include "IOStream.h"
 #include "BackupStoreDirectory.h"
+#include "BackupStoreDirectoryTree.h"
 #include "BackupStoreFile.h"
 #include "CollectInBufferStream.h"
 #include "FileStream.h"
@@ -36,6 +43,14 @@
 
 #define MAX_BYTES_WRITTEN_BETWEEN_RESTORE_INFO_SAVES (128*1024)
 
+// When fetching files over several connections, the number of files
+// queued or being fetched for each one
+#define RESTORE_FILES_IN_FLIGHT_PER_CONNECTION 4
+
+// How often to show the server that the main connection is still in use,
+// while it waits for files fetched over the others
+#define RESTORE_KEEP_ALIVE_INTERVAL 60
+
 class RestoreResumeInfo
 {
 public:
@@ -188,6 +203,8 @@ public:
 	std::string mNextLevelLocalName;
 };
 
+class RestoreFileFetcher;
+
 // parameters structure
 typedef struct
 {
@@ -199,15 +216,933 @@ typedef struct
 	box_time_t SnapshotTime;
 	std::string mRestoreResumeInfoFilename;
 	RestoreResumeInfo mResumeInfo;
+	int64_t mBytesWrittenSinceLastRestoreInfoSave;
+	// Fetches files over other connections, or NULL to fetch them
+	// one at a time over the main connection
+	RestoreFileFetcher *mpFetcher;
+	// Listings of the directories to restore, fetched a batch at a
+	// time, or NULL to list each directory as it's restored
+	BackupStoreDirectoryTree *mpTree;
 } RestoreParams;
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    GetListingFlags(const RestoreParams &, int16_t &,
+//			 int16_t &)
+//		Purpose: Returns the flags for listing directories which give
+//			 the entries appropriate to the restore type
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void GetListingFlags(const RestoreParams &Params,
+	int16_t &rFlagsMustBeSet, int16_t &rFlagsNotToBeSet)
+{
+	rFlagsMustBeSet = Params.RestoreDeleted?(BackupProtocolListDirectory::Flags_Deleted):(BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING);
+	rFlagsNotToBeSet = BackupProtocolListDirectory::Flags_OldVersion  | (Params.RestoreAny || Params.RestoreDeleted?(0):(BackupProtocolListDirectory::Flags_Deleted));
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    FinishRestoringFile(RestoreParams &,
+//			 RestoreResumeInfo *, int64_t, const std::string &,
+//			 RestoreInfos &)
+//		Purpose: Records a file as restored, in the resume info at
+//			 pLevel if it's not NULL, and saves the resume info
+//			 if enough has been written since it was last saved.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static int FinishRestoringFile(RestoreParams &Params,
+	RestoreResumeInfo *pLevel, int64_t ObjectID,
+	const std::string &localFilename, RestoreInfos &infos)
+{
+	// Progress display?
+	if(Params.PrintDots)
+	{
+		printf(".");
+		fflush(stdout);
+	}
+
+	// Add it to the list of done itmes
+	if(pLevel != 0)
+	{
+		pLevel->mRestoredObjects.insert(ObjectID);
+	}
+		
+	// Save restore info?
+	int64_t fileSize = 0;
+	bool exists = false;
+
+	try
+	{
+		exists = FileExists(
+			localFilename.c_str(),
+			&fileSize, 
+			true /* treat links as not 
+				existing */);
+	}
+	catch(std::exception &e)
+	{
+		BOX_ERROR("Failed to determine "
+			"whether file exists: '" <<
+			localFilename << "': " <<
+			e.what());
+		
+		if (Params.ContinueAfterErrors)
+		{
+			infos.totalFilesSkipped++;
+			Params.ContinuedAfterError = true;
+		}
+		else
+		{
+			infos.totalFilesFailed++;
+			return Restore_UnknownError;
+		}
+	}
+	catch(...)
+	{
+		BOX_ERROR("Failed to determine "
+			"whether file exists: '" <<
+			localFilename << "': "
+			"unknown error");
+		
+		if (Params.ContinueAfterErrors)
+		{
+			infos.totalFilesSkipped++;
+			Params.ContinuedAfterError = true;
+		}
+		else
+		{
+			infos.totalFilesFailed++;
+			return Restore_UnknownError;
+		}
+	}
+
+	BOX_INFO("Object ID " << BOX_FORMAT_OBJECTID(ObjectID) <<
+		" fetched successfully. ("<<fileSize<<" B)");
+	infos.totalFilesRestored++;
+	infos.totalBytesRestored += fileSize;
+
+	if(exists)
+	{
+		// File exists...
+		Params.mBytesWrittenSinceLastRestoreInfoSave += fileSize;
+
+		if(Params.mBytesWrittenSinceLastRestoreInfoSave > MAX_BYTES_WRITTEN_BETWEEN_RESTORE_INFO_SAVES)
+		{
+			// Save the restore info, in
+			// case it's needed later
+			try
+			{
+				Params.mResumeInfo.Save(Params.mRestoreResumeInfoFilename);
+			}
+			catch(std::exception &e)
+			{
+				BOX_ERROR("Failed to save resume info file '" <<
+					Params.mRestoreResumeInfoFilename <<
+					"': " << e.what());
+				infos.totalFilesFailed++;
+				return Restore_UnknownError;
+			}
+			catch(...)
+			{
+				BOX_ERROR("Failed to save resume info file '" <<
+					Params.mRestoreResumeInfoFilename <<
+					"': unknown error");
+				infos.totalFilesFailed++;
+				return Restore_UnknownError;
+			}
+
+			Params.mBytesWrittenSinceLastRestoreInfoSave = 0;
+		}
+	}
+
+	return Restore_Complete;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RestoreDirectory
+//		Purpose: A directory being restored while its files are fetched
+//			 over other connections. It's finished once the walk
+//			 has left it and all its files have arrived, and then
+//			 its attributes are set. It's complete once all its
+//			 subdirectories are complete too.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RestoreDirectory
+{
+public:
+	RestoreDirectory(RestoreDirectory *pParent, int64_t ObjectID,
+		const std::string &rLocalName,
+		const BackupClientFileAttributes &rAttributes,
+		RestoreResumeInfo &rLevel)
+	: mpParent(pParent),
+	  mObjectID(ObjectID),
+	  mLocalName(rLocalName),
+	  mAttributes(rAttributes),
+	  mpLevel(&rLevel),
+	  mWalkFinished(false),
+	  mAttributesWritten(false),
+	  mFilesInFlight(0),
+	  mIncompleteSubdirs(0)
+	{
+	}
+
+	RestoreDirectory *mpParent;
+	int64_t mObjectID;
+	std::string mLocalName;
+	BackupClientFileAttributes mAttributes;
+	// Where files are recorded in the resume info, only while the walk
+	// is in this directory, as the level is removed when it leaves.
+	// Files which arrive afterwards aren't recorded, and the whole
+	// directory is restored again on resume unless it completes.
+	RestoreResumeInfo *mpLevel;
+	bool mWalkFinished;
+	bool mAttributesWritten;
+	int mFilesInFlight;
+	int mIncompleteSubdirs;
+};
+
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RestoreFileFetcher
+//		Purpose: Fetches and decodes files on a pool of worker
+//			 threads, each with its own connection to the store,
+//			 while the main thread walks the directories over the
+//			 main connection.
+//
+//			 The workers only write the file data. Everything else
+//			 is done on the main thread as files arrive: the
+//			 attributes are written, errors and progress are
+//			 logged, and the resume info is updated, in the same
+//			 way as fetching the files one at a time.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RestoreFileFetcher
+{
+public:
+	RestoreFileFetcher(BackupProtocolCallable &rConnection,
+		RestoreConnectionFactory &rFactory, int NumConnections,
+		RestoreParams &rParams, RestoreInfos &rInfos);
+	~RestoreFileFetcher();
+private:
+	// no copying
+	RestoreFileFetcher(const RestoreFileFetcher &);
+	RestoreFileFetcher &operator=(const RestoreFileFetcher &);
+
+public:
+	int GetNumConnections() const { return (int)mWorkers.size(); }
+
+	RestoreDirectory *StartDirectory(RestoreDirectory *pParent,
+		int64_t ObjectID, const std::string &rLocalName,
+		const BackupClientFileAttributes &rAttributes,
+		RestoreResumeInfo &rLevel);
+	int FinishDirectory(RestoreDirectory &rDirectory);
+	int Fetch(RestoreDirectory &rDirectory, int64_t DirectoryID,
+		BackupStoreDirectory::Entry &rEntry,
+		const std::string &rLocalFilename);
+	int WaitForFile(const std::string &rLocalFilename);
+	int WaitForAll();
+
+private:
+	typedef struct
+	{
+		RestoreDirectory *mpDirectory;
+		int64_t mDirectoryID;
+		int64_t mObjectID;
+		std::string mLocalFilename;
+		bool mHasAttributes;
+		BackupClientFileAttributes mAttributes;
+		// Set when a worker's connection failed fetching it
+		bool mRetried;
+		// Set when fetched
+		bool mFailed;
+		std::string mError;
+		BackupClientFileAttributes mDecodedAttributes;
+	} Job;
+
+	typedef struct
+	{
+		std::auto_ptr<BackupProtocolCallable> mapConnection;
+		std::auto_ptr<BackupStoreFile::DecodingContexts> mapContexts;
+	} Worker;
+
+	static bool FetchFile(BackupProtocolCallable &rConnection, Job &rJob);
+	void WorkerThread(Worker *pWorker);
+	int Collect(bool Wait);
+	int FinishFile(Job &rJob);
+	int CheckDirectory(RestoreDirectory *pDirectory);
+	void KeepAlive();
+
+	BackupProtocolCallable &mrConnection;
+	RestoreParams &mrParams;
+	RestoreInfos &mrInfos;
+	int mMaxInFlight;
+	int mInFlight;
+	box_time_t mLastKeepAlive;
+	std::set<RestoreDirectory *> mDirectories;
+	std::multiset<std::string> mFilenamesInFlight;
+
+	std::vector<Worker *> mWorkers;
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	std::deque<Job *> mQueue;
+	std::deque<Job *> mDone;
+	int mLiveWorkers;
+	// As last seen by the main thread, to log connections lost
+	int mReportedLiveWorkers;
+	bool mStopping;
+	bool mLostConnections;
+};
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::RestoreFileFetcher(
+//			 BackupProtocolCallable &, RestoreConnectionFactory &,
+//			 int, RestoreParams &, RestoreInfos &)
+//		Purpose: Constructor. Opens up to NumConnections connections
+//			 and starts a worker for each one. Fewer are used if
+//			 the store refuses some of them, so check
+//			 GetNumConnections() afterwards.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RestoreFileFetcher::RestoreFileFetcher(BackupProtocolCallable &rConnection,
+	RestoreConnectionFactory &rFactory, int NumConnections,
+	RestoreParams &rParams, RestoreInfos &rInfos)
+: mrConnection(rConnection),
+  mrParams(rParams),
+  mrInfos(rInfos),
+  mMaxInFlight(0),
+  mInFlight(0),
+  mLastKeepAlive(GetCurrentBoxTime()),
+  mLiveWorkers(0),
+  mReportedLiveWorkers(0),
+  mStopping(false),
+  mLostConnections(false)
+{
+	for(int c = 0; c < NumConnections; ++c)
+	{
+		std::auto_ptr<Worker> apworker(new Worker);
+		try
+		{
+			apworker->mapConnection = rFactory.OpenConnection();
+		}
+		catch(std::exception &e)
+		{
+			BOX_WARNING("Failed to open connection " << (c + 1) <<
+				" of " << NumConnections << " to the store "
+				"for restoring files: " << e.what());
+			break;
+		}
+		apworker->mapContexts.reset(
+			new BackupStoreFile::DecodingContexts);
+		mWorkers.push_back(apworker.release());
+	}
+
+	mMaxInFlight = mWorkers.size() * RESTORE_FILES_IN_FLIGHT_PER_CONNECTION;
+	mLiveWorkers = mWorkers.size();
+	mReportedLiveWorkers = mLiveWorkers;
+
+	for(size_t w = 0; w < mWorkers.size(); ++w)
+	{
+		mThreads.push_back(std::thread(&RestoreFileFetcher::WorkerThread,
+			this, mWorkers[w]));
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::~RestoreFileFetcher()
+//		Purpose: Destructor. Stops the workers, abandoning any files
+//			 not fetched yet, and logs out of their connections.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RestoreFileFetcher::~RestoreFileFetcher()
+{
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for(size_t t = 0; t < mThreads.size(); ++t)
+	{
+		mThreads[t].join();
+	}
+
+	for(size_t w = 0; w < mWorkers.size(); ++w)
+	{
+		if(mWorkers[w]->mapConnection.get() != 0)
+		{
+			try
+			{
+				mWorkers[w]->mapConnection->QueryFinished();
+			}
+			catch(...)
+			{
+				// the restore is over, so it doesn't matter
+			}
+		}
+		delete mWorkers[w];
+	}
+
+	while(!mQueue.empty())
+	{
+		delete mQueue.front();
+		mQueue.pop_front();
+	}
+	while(!mDone.empty())
+	{
+		delete mDone.front();
+		mDone.pop_front();
+	}
+	for(std::set<RestoreDirectory *>::iterator i(mDirectories.begin());
+		i != mDirectories.end(); ++i)
+	{
+		delete *i;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::StartDirectory(RestoreDirectory *,
+//			 int64_t, const std::string &,
+//			 const BackupClientFileAttributes &, RestoreResumeInfo &)
+//		Purpose: Called when the walk enters a directory, which has
+//			 been created with its initial attributes. pParent is
+//			 NULL for a directory whose completion isn't to be
+//			 recorded in its parent's resume info.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RestoreDirectory *RestoreFileFetcher::StartDirectory(RestoreDirectory *pParent,
+	int64_t ObjectID, const std::string &rLocalName,
+	const BackupClientFileAttributes &rAttributes,
+	RestoreResumeInfo &rLevel)
+{
+	RestoreDirectory *pdir = new RestoreDirectory(pParent, ObjectID,
+		rLocalName, rAttributes, rLevel);
+	mDirectories.insert(pdir);
+	if(pParent != 0)
+	{
+		pParent->mIncompleteSubdirs++;
+	}
+	return pdir;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::FinishDirectory(RestoreDirectory &)
+//		Purpose: Called when the walk leaves a directory, before its
+//			 level of the resume info is removed. Its attributes
+//			 are set as soon as all its files have arrived.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::FinishDirectory(RestoreDirectory &rDirectory)
+{
+	rDirectory.mWalkFinished = true;
+	rDirectory.mpLevel = 0;
+	return CheckDirectory(&rDirectory);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::Fetch(RestoreDirectory &, int64_t,
+//			 BackupStoreDirectory::Entry &, const std::string &)
+//		Purpose: Queues a file to be fetched, first waiting for room
+//			 if too many are in flight already. Processes any
+//			 files which have arrived, returning Restore_Complete
+//			 unless one of them failed and the restore must stop.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::Fetch(RestoreDirectory &rDirectory,
+	int64_t DirectoryID, BackupStoreDirectory::Entry &rEntry,
+	const std::string &rLocalFilename)
+{
+	while(mInFlight >= mMaxInFlight)
+	{
+		int result = Collect(true);
+		if(result != Restore_Complete)
+		{
+			return result;
+		}
+	}
+
+	Job *pjob = new Job;
+	pjob->mpDirectory = &rDirectory;
+	pjob->mDirectoryID = DirectoryID;
+	pjob->mObjectID = rEntry.GetObjectID();
+	pjob->mLocalFilename = rLocalFilename;
+	pjob->mHasAttributes = rEntry.HasAttributes();
+	if(pjob->mHasAttributes)
+	{
+		pjob->mAttributes = rEntry.GetAttributes();
+	}
+	pjob->mRetried = false;
+	pjob->mFailed = false;
+
+	rDirectory.mFilesInFlight++;
+	mFilenamesInFlight.insert(rLocalFilename);
+	mInFlight++;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mQueue.push_back(pjob);
+	}
+	mWorkAvailable.notify_one();
+
+	return Collect(false);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::WaitForFile(const std::string &)
+//		Purpose: Waits for any file being fetched to the given local
+//			 filename to arrive
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::WaitForFile(const std::string &rLocalFilename)
+{
+	while(mFilenamesInFlight.find(rLocalFilename) !=
+		mFilenamesInFlight.end())
+	{
+		int result = Collect(true);
+		if(result != Restore_Complete)
+		{
+			return result;
+		}
+	}
+	return Restore_Complete;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::WaitForAll()
+//		Purpose: Waits for every file queued to arrive
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::WaitForAll()
+{
+	while(mInFlight > 0)
+	{
+		int result = Collect(true);
+		if(result != Restore_Complete)
+		{
+			return result;
+		}
+	}
+	return Restore_Complete;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::FetchFile(BackupProtocolCallable &,
+//			 Job &)
+//		Purpose: Static. Fetches and decodes one file over the given
+//			 connection, without writing its attributes or logging
+//			 anything. Returns false if the connection can't be
+//			 used any more.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool RestoreFileFetcher::FetchFile(BackupProtocolCallable &rConnection,
+	Job &rJob)
+{
+	std::auto_ptr<IOStream> objectStream;
+	try
+	{
+		rConnection.QueryGetFile(rJob.mDirectoryID, rJob.mObjectID);
+		objectStream = rConnection.ReceiveStream();
+		BackupStoreFile::DecodeFile(*objectStream,
+			rJob.mLocalFilename.c_str(), rConnection.GetTimeout(),
+			rJob.mHasAttributes ? &rJob.mAttributes : 0,
+			&rJob.mDecodedAttributes);
+		return true;
+	}
+	catch(std::exception &e)
+	{
+		rJob.mFailed = true;
+		rJob.mError = e.what();
+	}
+	catch(...)
+	{
+		rJob.mFailed = true;
+		rJob.mError = "unknown error";
+	}
+
+	// Make sure the connection is still usable for the next file
+	try
+	{
+		if(objectStream.get() != 0)
+		{
+			objectStream->Flush();
+		}
+		rConnection.QueryGetIsAlive();
+	}
+	catch(...)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::WorkerThread(Worker *)
+//		Purpose: Fetches queued files until stopped, or until its
+//			 connection fails, when the file it was fetching is
+//			 queued again for the others
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RestoreFileFetcher::WorkerThread(Worker *pWorker)
+{
+	pWorker->mapContexts->Use();
+
+	while(true)
+	{
+		Job *pjob = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while(!mStopping && mQueue.empty())
+			{
+				mWorkAvailable.wait(lock);
+			}
+			if(mStopping)
+			{
+				break;
+			}
+			pjob = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		bool usable = FetchFile(*(pWorker->mapConnection), *pjob);
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			if(!usable)
+			{
+				mLiveWorkers--;
+			}
+			if(!usable && (!pjob->mRetried || mLiveWorkers == 0))
+			{
+				// The file probably failed because the
+				// connection did, so give it to another
+				// worker, or to the main connection if this
+				// was the last one. Only one other worker
+				// tries, in case it's the file that breaks
+				// them.
+				pjob->mRetried = true;
+				pjob->mFailed = false;
+				pjob->mError.clear();
+				mQueue.push_front(pjob);
+			}
+			else
+			{
+				mDone.push_back(pjob);
+			}
+		}
+		mWorkAvailable.notify_one();
+		mWorkDone.notify_one();
+
+		if(!usable)
+		{
+			// Don't try to log out of it later
+			pWorker->mapConnection.reset();
+			break;
+		}
+	}
+
+	pWorker->mapContexts->StopUsing();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::Collect(bool)
+//		Purpose: Processes the files which have arrived, waiting for
+//			 at least one if Wait is set. If no connections are
+//			 left, files still queued are fetched over the main
+//			 connection instead.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::Collect(bool Wait)
+{
+	std::deque<Job *> done;
+	std::deque<Job *> orphaned;
+	int liveWorkers = 0;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			if(Wait && mDone.empty() && mLiveWorkers > 0)
+			{
+				mWorkDone.wait_for(lock, std::chrono::seconds(1));
+			}
+			if(!Wait || !mDone.empty() || mLiveWorkers == 0)
+			{
+				liveWorkers = mLiveWorkers;
+				done.swap(mDone);
+				if(mLiveWorkers == 0)
+				{
+					orphaned.swap(mQueue);
+				}
+				break;
+			}
+		}
+		KeepAlive();
+	}
+
+	if(liveWorkers < mReportedLiveWorkers && liveWorkers > 0)
+	{
+		BOX_WARNING("Lost a connection to the store for restoring "
+			"files, continuing with " << liveWorkers);
+	}
+	mReportedLiveWorkers = liveWorkers;
+
+	if(!orphaned.empty() && !mLostConnections)
+	{
+		BOX_WARNING("Lost all connections to the store for restoring "
+			"files, fetching the rest over the main connection");
+		mLostConnections = true;
+	}
+
+	while(!orphaned.empty())
+	{
+		Job *pjob = orphaned.front();
+		orphaned.pop_front();
+		FetchFile(mrConnection, *pjob);
+		done.push_back(pjob);
+	}
+
+	int result = Restore_Complete;
+	while(!done.empty())
+	{
+		std::auto_ptr<Job> apjob(done.front());
+		done.pop_front();
+		mInFlight--;
+		mFilenamesInFlight.erase(
+			mFilenamesInFlight.find(apjob->mLocalFilename));
+
+		if(result == Restore_Complete)
+		{
+			result = FinishFile(*apjob);
+		}
+	}
+
+	mLastKeepAlive = GetCurrentBoxTime();
+	return result;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::KeepAlive()
+//		Purpose: Stops the server timing out the main connection,
+//			 which is idle while waiting for large files
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RestoreFileFetcher::KeepAlive()
+{
+	box_time_t now = GetCurrentBoxTime();
+	if(now - mLastKeepAlive > SecondsToBoxTime(RESTORE_KEEP_ALIVE_INTERVAL))
+	{
+		mrConnection.QueryGetIsAlive();
+		mLastKeepAlive = now;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::FinishFile(Job &)
+//		Purpose: Completes the restore of a file which has arrived,
+//			 on the main thread
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::FinishFile(Job &rJob)
+{
+	RestoreDirectory &rdir(*rJob.mpDirectory);
+	rdir.mFilesInFlight--;
+
+	if(rJob.mFailed)
+	{
+		BOX_ERROR("Failed to restore file '" <<
+			rJob.mLocalFilename << "': " << rJob.mError);
+
+		if (mrParams.ContinueAfterErrors)
+		{
+			mrInfos.totalFilesSkipped++;
+			mrParams.ContinuedAfterError = true;
+		}
+		else
+		{
+			mrInfos.totalFilesFailed++;
+			return Restore_UnknownError;
+		}
+	}
+	else
+	{
+		try
+		{
+			rJob.mDecodedAttributes.WriteAttributes(
+				rJob.mLocalFilename);
+		}
+		catch (std::exception& e)
+		{
+			BOX_WARNING("Failed to restore attributes on " <<
+				rJob.mLocalFilename << ": " << e.what());
+		}
+	}
+
+	int result = FinishRestoringFile(mrParams, rdir.mpLevel,
+		rJob.mObjectID, rJob.mLocalFilename, mrInfos);
+	if(result != Restore_Complete)
+	{
+		return result;
+	}
+
+	return CheckDirectory(&rdir);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RestoreFileFetcher::CheckDirectory(RestoreDirectory *)
+//		Purpose: Sets the attributes of a directory once it's
+//			 finished, and records it as done in its parent's
+//			 resume info once it's complete, which may complete
+//			 its parent in turn.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RestoreFileFetcher::CheckDirectory(RestoreDirectory *pDirectory)
+{
+	while(pDirectory != 0)
+	{
+		if(!pDirectory->mWalkFinished || pDirectory->mFilesInFlight > 0)
+		{
+			return Restore_Complete;
+		}
+
+		if(!pDirectory->mAttributesWritten)
+		{
+			pDirectory->mAttributesWritten = true;
+
+			// now remove the user writable flag, if we added it
+			try
+			{
+				pDirectory->mAttributes.WriteAttributes(
+					pDirectory->mLocalName, false);
+			}
+			catch(std::exception &e)
+			{
+				BOX_ERROR("Failed to restore attributes for '" <<
+					pDirectory->mLocalName << "': " <<
+					e.what());
+				if (mrParams.ContinueAfterErrors)
+				{
+					mrParams.ContinuedAfterError = true;
+				}
+				else
+				{
+					return Restore_UnknownError;
+				}
+			}
+			catch(...)
+			{
+				BOX_ERROR("Failed to restore attributes for '" <<
+					pDirectory->mLocalName << "': "
+					"unknown error");
+				if (mrParams.ContinueAfterErrors)
+				{
+					mrParams.ContinuedAfterError = true;
+				}
+				else
+				{
+					return Restore_UnknownError;
+				}
+			}
+		}
+
+		if(pDirectory->mIncompleteSubdirs > 0)
+		{
+			return Restore_Complete;
+		}
+
+		RestoreDirectory *pparent = pDirectory->mpParent;
+		if(pparent != 0)
+		{
+			if(pparent->mpLevel != 0)
+			{
+				pparent->mpLevel->mRestoredObjects.insert(
+					pDirectory->mObjectID);
+			}
+			pparent->mIncompleteSubdirs--;
+		}
+
+		mDirectories.erase(pDirectory);
+		delete pDirectory;
+		pDirectory = pparent;
+	}
+
+	return Restore_Complete;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
 //		Name:    BackupClientRestoreDir(BackupProtocolCallable &,
 //			 int64_t, const char *, bool)
-//		Purpose: Restore a directory
+//		Purpose: Restore a directory. When files are fetched in
+//			 parallel, pParentDirectory is the parent being
+//			 restored, which is told when this one is complete.
 //		Created: 23/11/03
 //
 // --------------------------------------------------------------------------
@@ -215,13 +1150,15 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 	int64_t DirectoryID, const std::string &rRemoteDirectoryName,
 	const std::string &rLocalDirectoryName,
 	RestoreParams &Params, RestoreResumeInfo &rLevel,
-	RestoreInfos &infos)
+	RestoreInfos &infos, RestoreDirectory *pParentDirectory = NULL)
 {
 	// If we're resuming... check that we haven't got a next level to
 	// look at
 	if(rLevel.mpNextLevel != 0)
 	{
 		// Recurse immediately
+		int64_t failedBefore = infos.totalFilesFailed +
+			infos.totalFilesSkipped;
 		std::string localDirname(rLocalDirectoryName + 
 			DIRECTORY_SEPARATOR_ASCHAR + 
 			rLevel.mNextLevelLocalName);
@@ -229,9 +1166,28 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 			rRemoteDirectoryName + '/' +
 			rLevel.mNextLevelLocalName, localDirname,
 			Params, *rLevel.mpNextLevel, infos);
+
+		// This directory hasn't started yet, so wait for all
+		// the files in that one before recording it as done
+		bool filesFailed = false;
+		if(Params.mpFetcher != 0)
+		{
+			int result = Params.mpFetcher->WaitForAll();
+			if(result != Restore_Complete)
+			{
+				return result;
+			}
+			// Restore it again on resume if any were skipped,
+			// wherever in the walk they were collected
+			filesFailed = (infos.totalFilesFailed +
+				infos.totalFilesSkipped != failedBefore);
+		}
 		
 		// Add it to the list of done itmes
-		rLevel.mRestoredObjects.insert(rLevel.mNextLevelID);
+		if(!filesFailed)
+		{
+			rLevel.mRestoredObjects.insert(rLevel.mNextLevelID);
+		}
 
 		// Remove the level for the recursed directory
 		rLevel.RemoveLevel();
@@ -444,20 +1400,31 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 	}
 
 	// Fetch the directory listing from the server -- getting a
-	// list of files which is appropriate to the restore type
-	
-	rConnection.QueryListDirectory(
-		DirectoryID,
-		Params.RestoreDeleted?(BackupProtocolListDirectory::Flags_Deleted):(BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING),
-		BackupProtocolListDirectory::Flags_OldVersion  | (Params.RestoreAny || Params.RestoreDeleted?(0):(BackupProtocolListDirectory::Flags_Deleted)),
-		true /* want attributes */,
-		Params.SnapshotTime);
+	// list of files which is appropriate to the restore type -- unless
+	// it was fetched already
+	std::auto_ptr<BackupStoreDirectory> apdir;
+	if(Params.mpTree != NULL)
+	{
+		apdir = Params.mpTree->Take(DirectoryID);
+	}
 
-	
-	// Retrieve the directory from the stream following
-	BackupStoreDirectory dir;
-	std::auto_ptr<IOStream> dirstream(rConnection.ReceiveStream());
-	dir.ReadFromStream(*dirstream, rConnection.GetTimeout());
+	if(apdir.get() == NULL)
+	{
+		int16_t flagsMustBeSet, flagsNotToBeSet;
+		GetListingFlags(Params, flagsMustBeSet, flagsNotToBeSet);
+		rConnection.QueryListDirectory(
+			DirectoryID,
+			flagsMustBeSet,
+			flagsNotToBeSet,
+			true /* want attributes */,
+			Params.SnapshotTime);
+
+		// Retrieve the directory from the stream following
+		apdir.reset(new BackupStoreDirectory);
+		std::auto_ptr<IOStream> dirstream(rConnection.ReceiveStream());
+		apdir->ReadFromStream(*dirstream, rConnection.GetTimeout());
+	}
+	BackupStoreDirectory &dir(*apdir);
 
 	// Apply attributes to the directory
 	const StreamableMemBlock &dirAttrBlock(dir.GetAttributes());
@@ -499,7 +1466,13 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 		}
 	}
 
-	int64_t bytesWrittenSinceLastRestoreInfoSave = 0;
+	RestoreDirectory *pdirectory = 0;
+	if(Params.mpFetcher != 0)
+	{
+		pdirectory = Params.mpFetcher->StartDirectory(
+			pParentDirectory, DirectoryID, rLocalDirectoryName,
+			dirAttr, rLevel);
+	}
 	
 	// Process files
 	{
@@ -517,6 +1490,18 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 				std::string localFilename(rLocalDirectoryName +
 					DIRECTORY_SEPARATOR_ASCHAR +
 					nm.GetClearFilename());
+
+				// Another version with the same name may still
+				// be on its way, and must arrive first
+				if(pdirectory != 0)
+				{
+					int result = Params.mpFetcher->WaitForFile(
+						localFilename);
+					if (result != Restore_Complete)
+					{
+						return result;
+					}
+				}
 				
 				// Unlink anything which already exists:
 				// For resuming restores, we can't overwrite
@@ -545,6 +1530,18 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 					nm.GetClearFilename() << " (" <<
 					en->GetSizeInBlocks() << " blocks)");
 
+				if(pdirectory != 0)
+				{
+					int result = Params.mpFetcher->Fetch(
+						*pdirectory, DirectoryID, *en,
+						localFilename);
+					if (result != Restore_Complete)
+					{
+						return result;
+					}
+					continue;
+				}
+
 				// Request it from the store
 				rConnection.QueryGetFile(DirectoryID,
 					en->GetObjectID());
@@ -610,111 +1607,19 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 					}
 				}
 				
-				// Progress display?
-				if(Params.PrintDots)
-				{
-					printf(".");
-					fflush(stdout);
-				}
-
-				// Add it to the list of done itmes
-				rLevel.mRestoredObjects.insert(en->GetObjectID());
-					
-				// Save restore info?
-				int64_t fileSize = 0;
-				bool exists = false;
-
-				try
-				{
-					exists = FileExists(
-						localFilename.c_str(),
-						&fileSize, 
-						true /* treat links as not 
-							existing */);
-				}
-				catch(std::exception &e)
-				{
-					BOX_ERROR("Failed to determine "
-						"whether file exists: '" <<
-						localFilename << "': " <<
-						e.what());
-					
-					if (Params.ContinueAfterErrors)
-					{
-						infos.totalFilesSkipped++;
-						Params.ContinuedAfterError = true;
-					}
-					else
-					{
-						infos.totalFilesFailed++;
-						return Restore_UnknownError;
-					}
-				}
-				catch(...)
-				{
-					BOX_ERROR("Failed to determine "
-						"whether file exists: '" <<
-						localFilename << "': "
-						"unknown error");
-					
-					if (Params.ContinueAfterErrors)
-					{
-						infos.totalFilesSkipped++;
-						Params.ContinuedAfterError = true;
-					}
-					else
-					{
-						infos.totalFilesFailed++;
-						return Restore_UnknownError;
-					}
-				}
-
-                BOX_INFO("Object ID " << BOX_FORMAT_OBJECTID(en->GetObjectID()) <<
-                    " fetched successfully. ("<<fileSize<<" B)");
-				infos.totalFilesRestored++;
-				infos.totalBytesRestored += fileSize;
-
-				if(exists)
+				int result = FinishRestoringFile(Params,
+					&rLevel, en->GetObjectID(),
+					localFilename, infos);
+				if (result != Restore_Complete)
 				{
-					// File exists...
-					bytesWrittenSinceLastRestoreInfoSave
-						+= fileSize;
-				
-
-					if(bytesWrittenSinceLastRestoreInfoSave > MAX_BYTES_WRITTEN_BETWEEN_RESTORE_INFO_SAVES)
-					{
-						// Save the restore info, in
-						// case it's needed later
-						try
-						{
-							Params.mResumeInfo.Save(Params.mRestoreResumeInfoFilename);
-						}
-						catch(std::exception &e)
-						{
-							BOX_ERROR("Failed to save resume info file '" <<
-								Params.mRestoreResumeInfoFilename <<
-								"': " << e.what());
-							infos.totalFilesFailed++;
-							return Restore_UnknownError;
-						}
-						catch(...)
-						{
-							BOX_ERROR("Failed to save resume info file '" <<
-								Params.mRestoreResumeInfoFilename <<
-								"': unknown error");
-							infos.totalFilesFailed++;
-							return Restore_UnknownError;
-						}
-
-						bytesWrittenSinceLastRestoreInfoSave = 0;
-					}
+					return result;
 				}
 			}
 		}
 	}
 
 	// Make sure the restore info has been saved	
-	if(bytesWrittenSinceLastRestoreInfoSave != 0)
+	if(Params.mBytesWrittenSinceLastRestoreInfoSave != 0)
 	{
 		// Save the restore info, in case it's needed later
 		try
@@ -751,7 +1656,7 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 			}
 		}
 		
-		bytesWrittenSinceLastRestoreInfoSave = 0;
+		Params.mBytesWrittenSinceLastRestoreInfoSave = 0;
 	}
 
 	
@@ -787,7 +1692,7 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 					rConnection, en->GetObjectID(), 
 					rRemoteDirectoryName + '/' + 
 					nm.GetClearFilename(), localDirname,
-					Params, rnextLevel, infos);
+					Params, rnextLevel, infos, pdirectory);
 
 				if (result != Restore_Complete)
 				{
@@ -797,12 +1702,21 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 				// Remove the level for the above call
 				rLevel.RemoveLevel();
 				
-				// Add it to the list of done itmes
-				rLevel.mRestoredObjects.insert(en->GetObjectID());
+				// Add it to the list of done itmes, unless
+				// the fetcher will when its files arrive
+				if(pdirectory == 0)
+				{
+					rLevel.mRestoredObjects.insert(en->GetObjectID());
+				}
 			}
 		}
 	}
 
+	if(pdirectory != 0)
+	{
+		return Params.mpFetcher->FinishDirectory(*pdirectory);
+	}
+
 	// now remove the user writable flag, if we added it earlier
 	try
 	{
@@ -866,6 +1780,16 @@ static int BackupClientRestoreDir(BackupProtocolCallable &rConnection,
 //			 on error, unless ContinueAfterError is true and
 //			 the error is recoverable, in which case it returns
 //			 Restore_CompleteWithErrors)
+//
+//			 If NumConnections is more than one, that many more
+//			 connections are opened with pConnectionFactory to
+//			 fetch and decode files in parallel, and rConnection
+//			 is only used to list directories.
+//
+//			 Set ListWholeTree if the store understands
+//			 ListDirectoryTree, to fetch the listings of the
+//			 directories in large batches instead of one at a
+//			 time.
 //		Created: 23/11/03
 //
 // --------------------------------------------------------------------------
@@ -874,7 +1798,8 @@ int BackupClientRestore(BackupProtocolCallable &rConnection,
 	const std::string& LocalDirectoryName, box_time_t SnapshotTime, bool PrintDots, bool RestoreDeleted,
 	bool RestoreAny, bool UndeleteAfterRestoreDeleted, 
 	bool Resume, bool ContinueAfterErrors,
-	RestoreInfos &infos)
+	RestoreInfos &infos, RestoreConnectionFactory *pConnectionFactory,
+	int NumConnections, bool ListWholeTree)
 {
 	// Parameter block
 	RestoreParams params;
@@ -886,6 +1811,9 @@ int BackupClientRestore(BackupProtocolCallable &rConnection,
 	params.SnapshotTime = SnapshotTime;
 	params.mRestoreResumeInfoFilename = LocalDirectoryName;
 	params.mRestoreResumeInfoFilename += ".boxbackupresume";
+	params.mBytesWrittenSinceLastRestoreInfoSave = 0;
+	params.mpFetcher = NULL;
+	params.mpTree = NULL;
 
 	// Target exists?
 	int targetExistance = ObjectExists(LocalDirectoryName);
@@ -920,11 +1848,46 @@ int BackupClientRestore(BackupProtocolCallable &rConnection,
 		return Restore_TargetExists;
 	}
 	
+	// List the directories in batches?
+	std::auto_ptr<BackupStoreDirectoryTree> aptree;
+	if(ListWholeTree)
+	{
+		int16_t flagsMustBeSet, flagsNotToBeSet;
+		GetListingFlags(params, flagsMustBeSet, flagsNotToBeSet);
+		aptree.reset(new BackupStoreDirectoryTree(rConnection,
+			flagsMustBeSet, flagsNotToBeSet, SnapshotTime));
+		aptree->List(DirectoryID);
+		params.mpTree = aptree.get();
+	}
+
+	// Fetch files over more connections?
+	std::auto_ptr<RestoreFileFetcher> apfetcher;
+	if(pConnectionFactory != NULL && NumConnections > 1)
+	{
+		apfetcher.reset(new RestoreFileFetcher(rConnection,
+			*pConnectionFactory, NumConnections, params, infos));
+		if(apfetcher->GetNumConnections() > 0)
+		{
+			BOX_TRACE("Fetching files over " <<
+				apfetcher->GetNumConnections() <<
+				" connections");
+			params.mpFetcher = apfetcher.get();
+		}
+		else
+		{
+			apfetcher.reset();
+		}
+	}
+
 	// Restore the directory
 	int result = BackupClientRestoreDir(rConnection, DirectoryID,
 		RemoteDirectoryName, LocalDirectoryName, params,
 		params.mResumeInfo,
 		infos);
+	if (result == Restore_Complete && params.mpFetcher != NULL)
+	{
+		result = params.mpFetcher->WaitForAll();
+	}
 	if (result != Restore_Complete)
 	{
 		return result;
@@ -9,6 +9,8 @@
 
 #ifndef BACKUPCLIENTRESTORE_H
 #define BACKUPCLIENTRESTORE_H
+#include <memory>
+
 #include "BoxTime.h"
 
 class BackupProtocolCallable;
@@ -54,6 +56,23 @@ class RestoreInfos  {
 
 };
 
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RestoreConnectionFactory
+//		Purpose: Opens more connections to the store, logged in to the
+//			 account being restored, so that BackupClientRestore()
+//			 can fetch several files at once
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RestoreConnectionFactory
+{
+public:
+	virtual ~RestoreConnectionFactory() { }
+	virtual std::auto_ptr<BackupProtocolCallable> OpenConnection() = 0;
+};
+
 int BackupClientRestore(BackupProtocolCallable &rConnection,
 	int64_t DirectoryID,
 	const std::string& RemoteDirectoryName,
@@ -65,7 +84,10 @@ int BackupClientRestore(BackupProtocolCallable &rConnection,
 	bool UndeleteAfterRestoreDeleted,
 	bool Resume,
 	bool ContinueAfterErrors,
-	RestoreInfos &infos);
+	RestoreInfos &infos,
+	RestoreConnectionFactory *pConnectionFactory = NULL,
+	int NumConnections = 1,
+	bool ListWholeTree = false);
 
 #endif // BACKUPCLIENTRESTORE_H
 
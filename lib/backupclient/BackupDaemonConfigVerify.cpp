@@ -104,6 +104,30 @@ static const ConfigurationVerifyKey verifyrootkeys[] =
 	// of seconds to wait before trying again if not
 
 	ConfigurationVerifyKey("MaximumDiffingTime", ConfigTest_IsInt),
+	ConfigurationVerifyKey("EncodingThreads", ConfigTest_IsInt, 0),
+	// number of threads compressing and encrypting file data for
+	// upload, 0 to encode on the main thread
+	ConfigurationVerifyKey("ContentDefinedChunking", ConfigTest_IsBool,
+		false),
+	// cut new file data into blocks at boundaries found in the data
+	ConfigurationVerifyKey("ReuseBlocksFromOtherFiles", ConfigTest_IsBool,
+		false),
+	// upload new files as patches to other files on the server which
+	// contain the same blocks, such as the file they were copied from
+	ConfigurationVerifyKey("DirectoryScanThreads", ConfigTest_IsInt, 0),
+	// number of threads reading directories and the attributes of
+	// their contents ahead of the sync, 0 to read them as it goes
+	ConfigurationVerifyKey("MaxCommandsInFlight", ConfigTest_IsInt, 16),
+	// number of metadata commands sent to the server before waiting
+	// for their replies, 1 to wait for each one
+	ConfigurationVerifyKey("MaxFilesPerUpload", ConfigTest_IsInt, 64),
+	// number of small files in one directory sent to the server in one
+	// command, 1 to send each one separately
+	ConfigurationVerifyKey("BatchedUploadMaxSize", ConfigTest_IsInt, 16384),
+	// files up to this size may be sent with others, see MaxFilesPerUpload
+	ConfigurationVerifyKey("RestoreConnections", ConfigTest_IsInt, 1),
+	// number of connections bbackupquery uses to fetch files when
+	// restoring a directory, 1 to fetch them over its own connection
 	ConfigurationVerifyKey("DeleteRedundantLocationsAfter",
 		ConfigTest_IsInt, 172800),
 
@@ -125,7 +149,7 @@ static const ConfigurationVerifyKey verifyrootkeys[] =
 	// set the level of verbosity of file logging
 	ConfigurationVerifyKey("LogFileOverwrite", ConfigTest_IsBool, false),
     // set the number of sync stats to keep in memory
-    ConfigurationVerifyKey("StatsHistoryLength", ConfigTest_IsUint32, 1),
+    ConfigurationVerifyKey("StatsHistoryLength", ConfigTest_IsInt | ConfigTest_IsUint32, 1),
 	ConfigurationVerifyKey("OperationHistoryFile", 0, "/tmp/bbackupd.history"),
 	// overwrite the log file on each backup
 	ConfigurationVerifyKey("CommandSocket", 0),
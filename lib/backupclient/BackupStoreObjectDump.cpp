@@ -116,10 +116,10 @@ void BackupStoreDirectory::Dump(void *clibFileHandle, bool ToTrace)
 		int16_t f = (*i)->GetFlags();
 #ifdef WIN32
 		OutputLine(file, ToTrace, 
-			"%06I64x %4I64d %016I64x %4d %3d %4d%s%s%s%s%s     %s %s  %s \n",
+			"%06I64x %4I64d %016I64x %4d %3d %4d%s%s%s%s%s%s     %s %s  %s \n",
 #else
 		OutputLine(file, ToTrace, 
-			"%06llx %4lld %016llx %4d %3d %4d %s %s %s%s%s%s%s\n",
+			"%06llx %4lld %016llx %4d %3d %4d %s %s %s%s%s%s%s%s\n",
 #endif
 			(*i)->GetObjectID(),
 			(*i)->GetSizeInBlocks(),
@@ -134,6 +134,7 @@ void BackupStoreDirectory::Dump(void *clibFileHandle, bool ToTrace)
 			((f & BackupStoreDirectory::Entry::Flags_Deleted)?" del":""),
 			((f & BackupStoreDirectory::Entry::Flags_OldVersion)?" old":""),
 			((f & BackupStoreDirectory::Entry::Flags_RemoveASAP)?" removeASAP":""),
+			((f & BackupStoreDirectory::Entry::Flags_PatchFromOlder)?" patchFromOlder":""),
 
 
 			depends);
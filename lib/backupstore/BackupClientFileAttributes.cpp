@@ -100,6 +100,8 @@ namespace
 {
 	CipherContext sBlowfishEncrypt;
 	CipherContext sBlowfishDecrypt;
+	// Used instead of sBlowfishDecrypt by threads decoding files
+	thread_local CipherContext *spThreadBlowfishDecrypt = 0;
 	uint8_t sAttributeHashSecret[MAX_ATTRIBUTE_HASH_SECRET_LENGTH];
 	int sAttributeHashSecretLength = 0;
 }
@@ -536,14 +538,39 @@ void BackupClientFileAttributes::FillAttributesLink(
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupClientFileAttributes::FillExtendedAttr(const char *, unsigned char**)
-//		Purpose: Private function, read the extended attributes of the file into the block
+//		Name:    BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &, const std::string &)
+//		Purpose: Read the extended attributes of the file into the block,
+//			 logging and throwing exceptions on errors
 //		Created: 2005/06/12
 //
 // --------------------------------------------------------------------------
 void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBlock,
 	const std::string& Filename)
 {
+	int error = 0;
+	std::string attrKey;
+	int result = ReadExtendedAttr(outputBlock, Filename, error, attrKey);
+	ReportExtendedAttr(result, error, Filename, attrKey);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileAttributes::ReadExtendedAttr(StreamableMemBlock &, const std::string &, int &, std::string &)
+//		Purpose: Read the extended attributes of the file into the block,
+//			 without logging anything, so that it can be called on
+//			 any thread. Returns one of the ExtendedAttr_* values,
+//			 with the errno and the name of the attribute which
+//			 failed, for ReportExtendedAttr() to report later.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientFileAttributes::ReadExtendedAttr(StreamableMemBlock &outputBlock,
+	const std::string& Filename, int &rErrnoOut, std::string &rAttrKeyOut)
+{
+	rErrnoOut = 0;
+	int result = ExtendedAttr_OK;
+
 #if defined HAVE_LLISTXATTR && defined HAVE_LGETXATTR
 	int listBufferSize = 10000;
 	char* list = new char[listBufferSize];
@@ -611,11 +638,10 @@ void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBloc
 				int valueSize = ::lgetxattr(Filename.c_str(), attrKey.c_str(), 0, 0);
 				if(valueSize<0)
 				{
-					BOX_LOG_SYS_ERROR("Failed to get "
-						"extended attribute size of "
-						"'" << Filename << "': " <<
-						attrKey);
-					THROW_EXCEPTION(CommonException, OSFileError);
+					rErrnoOut = errno;
+					rAttrKeyOut = attrKey;
+					result = ExtendedAttr_SizeFailed;
+					break;
 				}
 
 				// Resize block, if needed
@@ -632,11 +658,10 @@ void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBloc
 					xattrBufferSize-xattrSize);
 				if(valueSize<0)
 				{
-					BOX_LOG_SYS_ERROR("Failed to get "
-						"extended attribute of " 
-						"'" << Filename << "': " <<
-						attrKey);
-					THROW_EXCEPTION(CommonException, OSFileError);
+					rErrnoOut = errno;
+					rAttrKeyOut = attrKey;
+					result = ExtendedAttr_ValueFailed;
+					break;
 				}
 				xattrSize += valueSize;
 
@@ -645,14 +670,18 @@ void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBloc
 				std::memcpy(buffer+valueSizeOffset, &valueLength, sizeof(uint32_t));
 			}
 
-			// Fill in attribute block size
-			uint32_t xattrBlockLength = htonl(xattrSize-xattrBlockSizeOffset-sizeof(uint32_t));
-			std::memcpy(buffer+xattrBlockSizeOffset, &xattrBlockLength, sizeof(uint32_t));
+			if(result == ExtendedAttr_OK)
+			{
+				// Fill in attribute block size
+				uint32_t xattrBlockLength = htonl(xattrSize-xattrBlockSizeOffset-sizeof(uint32_t));
+				std::memcpy(buffer+xattrBlockSizeOffset, &xattrBlockLength, sizeof(uint32_t));
 
-			outputBlock.ResizeBlock(xattrSize);
+				outputBlock.ResizeBlock(xattrSize);
+			}
 		}
 		else if(listSize<0)
 		{
+			rErrnoOut = errno;
 			if(errno == EOPNOTSUPP || errno == EACCES
 #if HAVE_DECL_ENOTSUP
 				// NetBSD uses ENOTSUP instead
@@ -662,27 +691,19 @@ void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBloc
 			)
 			{
 				// Not supported by OS, or not on this filesystem
-				BOX_TRACE(BOX_SYS_ERRNO_MESSAGE(errno,
-					BOX_FILE_MESSAGE(Filename, "Failed to "
-						"list extended attributes")));
+				result = ExtendedAttr_NotSupported;
 			}
 			else if(errno == ERANGE)
 			{
-				BOX_ERROR("Failed to list extended "
-					"attributes of '" << Filename << "': "
-					"buffer too small, not backed up");
+				result = ExtendedAttr_ListTooLarge;
 			}
 			else if(errno == ENOENT)
 			{
-				BOX_ERROR("Failed to list extended "
-					"attributes of '" << Filename << "': "
-					"file no longer exists");
+				result = ExtendedAttr_FileNotFound;
 			}
 			else
 			{
-				THROW_SYS_FILE_ERROR("Failed to list extended "
-					"attributes for unknown reason", Filename,
-					CommonException, OSFileError);
+				result = ExtendedAttr_ListFailed;
 			}
 		}
 	}
@@ -693,6 +714,66 @@ void BackupClientFileAttributes::FillExtendedAttr(StreamableMemBlock &outputBloc
 	}
 	delete[] list;
 #endif // defined HAVE_LLISTXATTR && defined HAVE_LGETXATTR
+
+	return result;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileAttributes::ReportExtendedAttr(int, int, const std::string &, const std::string &)
+//		Purpose: Log the result of ReadExtendedAttr(), and throw an
+//			 exception if it failed in a way which can't be ignored
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileAttributes::ReportExtendedAttr(int Result, int Errno,
+	const std::string& Filename, const std::string &rAttrKey)
+{
+	errno = Errno;
+
+	switch(Result)
+	{
+	case ExtendedAttr_OK:
+		break;
+
+	case ExtendedAttr_NotSupported:
+		BOX_TRACE(BOX_SYS_ERRNO_MESSAGE(Errno,
+			BOX_FILE_MESSAGE(Filename, "Failed to "
+				"list extended attributes")));
+		break;
+
+	case ExtendedAttr_ListTooLarge:
+		BOX_ERROR("Failed to list extended "
+			"attributes of '" << Filename << "': "
+			"buffer too small, not backed up");
+		break;
+
+	case ExtendedAttr_FileNotFound:
+		BOX_ERROR("Failed to list extended "
+			"attributes of '" << Filename << "': "
+			"file no longer exists");
+		break;
+
+	case ExtendedAttr_SizeFailed:
+		BOX_LOG_SYS_ERROR("Failed to get "
+			"extended attribute size of "
+			"'" << Filename << "': " <<
+			rAttrKey);
+		THROW_EXCEPTION(CommonException, OSFileError);
+
+	case ExtendedAttr_ValueFailed:
+		BOX_LOG_SYS_ERROR("Failed to get "
+			"extended attribute of " 
+			"'" << Filename << "': " <<
+			rAttrKey);
+		THROW_EXCEPTION(CommonException, OSFileError);
+
+	default:
+		THROW_SYS_FILE_ERROR("Failed to list extended "
+			"attributes for unknown reason", Filename,
+			CommonException, OSFileError);
+	}
 }
 
 // --------------------------------------------------------------------------
@@ -1060,8 +1141,12 @@ StreamableMemBlock *BackupClientFileAttributes::MakeClear(const StreamableMemBlo
 			THROW_EXCEPTION(BackupStoreException, BadEncryptedAttributes);
 		}
 		
+		// Which context to use
+		CipherContext &decrypt(spThreadBlowfishDecrypt
+			? *spThreadBlowfishDecrypt : sBlowfishDecrypt);
+
 		// How much space is needed for the output?
-		int maxDecryptedSize = sBlowfishDecrypt.MaxOutSizeForInBufferSize(rEncrypted.GetSize() - ivSize);
+		int maxDecryptedSize = decrypt.MaxOutSizeForInBufferSize(rEncrypted.GetSize() - ivSize);
 		
 		// Allocate it
 		pdecrypted = new StreamableMemBlock(maxDecryptedSize);
@@ -1076,10 +1161,10 @@ StreamableMemBlock *BackupClientFileAttributes::MakeClear(const StreamableMemBlo
 		}
 
 		// Set IV
-		sBlowfishDecrypt.SetIV(encBlock + 1);
+		decrypt.SetIV(encBlock + 1);
 		
 		// Decrypt
-		int decryptedSize = sBlowfishDecrypt.TransformBlock(pdecrypted->GetBuffer(), maxDecryptedSize, encBlock + 1 + ivSize, rEncrypted.GetSize() - (ivSize + 1));
+		int decryptedSize = decrypt.TransformBlock(pdecrypted->GetBuffer(), maxDecryptedSize, encBlock + 1 + ivSize, rEncrypted.GetSize() - (ivSize + 1));
 
 		// Resize block to fit
 		pdecrypted->ResizeBlock(decryptedSize);
@@ -1112,6 +1197,38 @@ void BackupClientFileAttributes::SetBlowfishKey(const void *pKey, int KeyLength)
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileAttributes::CopyDecryptContext(CipherContext &)
+//		Purpose: Static. Initialises rContextOut as a copy of the
+//			 context used to decrypt attributes, for another
+//			 thread to use with SetThreadDecryptContext().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileAttributes::CopyDecryptContext(CipherContext &rContextOut)
+{
+	rContextOut.Init(sBlowfishDecrypt);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileAttributes::SetThreadDecryptContext(CipherContext *)
+//		Purpose: Static. Decrypt attributes on the calling thread
+//			 with the given context, or with the shared one if
+//			 NULL. The context must stay valid until it's unset.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientFileAttributes::SetThreadDecryptContext(CipherContext *pContext)
+{
+	spThreadBlowfishDecrypt = pContext;
+}
+
+
 
 // --------------------------------------------------------------------------
 //
@@ -1194,6 +1311,25 @@ void BackupClientFileAttributes::SetAttributeHashSecret(const void *pSecret, int
 // --------------------------------------------------------------------------
 uint64_t BackupClientFileAttributes::GenerateAttributeHash(EMU_STRUCT_STAT &st,
 	const std::string &filename, const std::string &leafname)
+{
+	StreamableMemBlock xattr;
+	FillExtendedAttr(xattr, filename.c_str());
+	return GenerateAttributeHash(st, xattr, leafname);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientFileAttributes::GenerateAttributeHash(
+//			 struct stat &, const StreamableMemBlock &,
+//			 const std::string &)
+//		Purpose: As above, for a file whose extended attributes have
+//			 already been read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+uint64_t BackupClientFileAttributes::GenerateAttributeHash(EMU_STRUCT_STAT &st,
+	const StreamableMemBlock &xattr, const std::string &leafname)
 {
 	if(sAttributeHashSecretLength == 0)
 	{
@@ -1218,9 +1354,6 @@ uint64_t BackupClientFileAttributes::GenerateAttributeHash(EMU_STRUCT_STAT &st,
 	hashData.fileCreationTime = box_hton64(st.st_ctime);
 	#endif
 
-	StreamableMemBlock xattr;
-	FillExtendedAttr(xattr, filename.c_str());
-
 	// Create a MD5 hash of the data, filename, and secret
 	MD5Digest digest;
 	digest.Add(&hashData, sizeof(hashData));
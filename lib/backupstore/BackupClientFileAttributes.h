@@ -15,6 +15,8 @@
 #include "StreamableMemBlock.h"
 #include "BoxTime.h"
 
+class CipherContext;
+
 EMU_STRUCT_STAT; // declaration
 
 // --------------------------------------------------------------------------
@@ -54,13 +56,34 @@ public:
 	bool IsSymLink() const;
 
 	static void SetBlowfishKey(const void *pKey, int KeyLength);
+	static void CopyDecryptContext(CipherContext &rContextOut);
+	static void SetThreadDecryptContext(CipherContext *pContext);
 	static void SetAttributeHashSecret(const void *pSecret, int SecretLength);
 	
 	static uint64_t GenerateAttributeHash(EMU_STRUCT_STAT &st,
 		const std::string& Filename, const std::string &leafname);
+	static uint64_t GenerateAttributeHash(EMU_STRUCT_STAT &st,
+		const StreamableMemBlock &xattr, const std::string &leafname);
 	static void FillExtendedAttr(StreamableMemBlock &outputBlock,
 		const std::string& Filename);
 
+	// Results of ReadExtendedAttr()
+	enum
+	{
+		ExtendedAttr_OK = 0,
+		ExtendedAttr_NotSupported,
+		ExtendedAttr_ListTooLarge,
+		ExtendedAttr_FileNotFound,
+		ExtendedAttr_ListFailed,
+		ExtendedAttr_SizeFailed,
+		ExtendedAttr_ValueFailed
+	};
+	static int ReadExtendedAttr(StreamableMemBlock &outputBlock,
+		const std::string& Filename, int &rErrnoOut,
+		std::string &rAttrKeyOut);
+	static void ReportExtendedAttr(int Result, int Errno,
+		const std::string& Filename, const std::string &rAttrKey);
+
 private:
 	static void FillAttributes(StreamableMemBlock &outputBlock,
 		const std::string& Filename, const EMU_STRUCT_STAT &st,
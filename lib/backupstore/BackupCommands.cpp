@@ -11,13 +11,16 @@
 
 #include <set>
 #include <sstream>
+#include <vector>
 
 #include "autogen_BackupProtocol.h"
 #include "autogen_RaidFileException.h"
 #include "BackupConstants.h"
 #include "BackupStoreContext.h"
+#include "BackupStoreDeferredPatch.h"
 #include "BackupStoreConstants.h"
 #include "BackupStoreDirectory.h"
+#include "BackupStoreDirectoryTree.h"
 #include "BackupStoreException.h"
 #include "BackupsList.h"
 #include "BackupStoreFile.h"
@@ -25,7 +28,7 @@
 #include "BufferedStream.h"
 #include "CollectInBufferStream.h"
 #include "FileStream.h"
-#include "InvisibleTempFileStream.h"
+#include "PartialReadStream.h"
 #include "RaidFileController.h"
 #include "StreamableMemBlock.h"
 
@@ -104,6 +107,10 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolReplyable::HandleException(Bo
 		{
 			return PROTOCOL_ERROR(Err_CannotResumeUpload);
 		}
+		else if(e.GetSubType() == BackupStoreException::DiffFromIDNotFoundInDirectory)
+		{
+			return PROTOCOL_ERROR(Err_DiffFromFileDoesNotExist);
+		}
 	}
 
 	throw;
@@ -124,8 +131,14 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolVersion::DoCommand(BackupProt
 {
 	CHECK_PHASE(Phase_Version)
 
-	// Correct version?
-	if(mVersion != BACKUP_STORE_SERVER_VERSION)
+	// Correct version? Commands are always handled strictly in order, so
+	// a client which pipelines them needs nothing else from us.
+	if(mVersion != BACKUP_STORE_SERVER_VERSION &&
+		mVersion != BACKUP_STORE_SERVER_VERSION_PIPELINING &&
+		mVersion != BACKUP_STORE_SERVER_VERSION_TREE_LISTING &&
+		mVersion != BACKUP_STORE_SERVER_VERSION_SHARED_BLOCKS &&
+		mVersion != BACKUP_STORE_SERVER_VERSION_BATCHED_UPLOAD &&
+		mVersion != BACKUP_STORE_SERVER_VERSION_FILE_RANGES)
 	{
 		return PROTOCOL_ERROR(Err_WrongVersion);
 	}
@@ -133,8 +146,8 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolVersion::DoCommand(BackupProt
 	// Mark the next phase
 	rContext.SetPhase(BackupStoreContext::Phase_Login);
 
-	// Return our version
-	return std::auto_ptr<BackupProtocolMessage>(new BackupProtocolVersion(BACKUP_STORE_SERVER_VERSION));
+	// Return the version that the client asked for
+	return std::auto_ptr<BackupProtocolMessage>(new BackupProtocolVersion(mVersion));
 }
 
 
@@ -311,6 +324,131 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolListDirectory::DoCommand(Back
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolListDirectoryTree::DoCommand(Protocol &, BackupStoreContext &)
+//		Purpose: Command to list a directory and all the directories
+//			 below it
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolListDirectoryTree::DoCommand(BackupProtocolReplyable &rProtocol, BackupStoreContext &rContext) const
+{
+	CHECK_PHASE(Phase_Commands)
+
+	// Make sure the top directory exists, so that the client gets an
+	// error instead of an empty tree
+	rContext.GetDirectory(mObjectID);
+
+	// The rest is read while the stream is being sent
+	std::auto_ptr<IOStream> stream(new BackupStoreDirectoryTreeStream(
+		rContext, mObjectID, mFlagsMustBeSet, mFlagsNotToBeSet,
+		mSnapshotTime, mSendAttributes, mMaxDirectories));
+	rProtocol.SendStreamAfterCommand(stream);
+
+	return std::auto_ptr<BackupProtocolMessage>(
+		new BackupProtocolSuccess(mObjectID));
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    ReadBlockFingerprints(IOStream &, int,
+//			 std::vector<uint64_t> &)
+//		Purpose: Read the stream of block fingerprints which follows
+//			 AddBlockFingerprints and FindBlockFingerprints
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void ReadBlockFingerprints(IOStream &rDataStream, int Timeout,
+	std::vector<uint64_t> &rFingerprintsOut)
+{
+	CollectInBufferStream buffer;
+	if(!rDataStream.CopyStreamTo(buffer, Timeout))
+	{
+		THROW_EXCEPTION(BackupStoreException, ReadFileFromStreamTimedOut)
+	}
+	if((buffer.GetSize() % sizeof(uint64_t)) != 0)
+	{
+		THROW_EXCEPTION(BackupStoreException, BadBlockFingerprintStream)
+	}
+
+	const uint64_t *pfingerprint = (const uint64_t *)buffer.GetBuffer();
+	int count = buffer.GetSize() / sizeof(uint64_t);
+	rFingerprintsOut.reserve(count);
+	for(int i = 0; i < count; ++i)
+	{
+		rFingerprintsOut.push_back(box_ntoh64(pfingerprint[i]));
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolAddBlockFingerprints::DoCommand(Protocol &, BackupStoreContext &)
+//		Purpose: Command to record the blocks in a stored file
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolAddBlockFingerprints::DoCommand(
+	BackupProtocolReplyable &rProtocol, BackupStoreContext &rContext,
+	IOStream& rDataStream) const
+{
+	CHECK_PHASE(Phase_Commands)
+	CHECK_WRITEABLE_SESSION
+
+	std::vector<uint64_t> fingerprints;
+	ReadBlockFingerprints(rDataStream, rProtocol.GetTimeout(), fingerprints);
+
+	if(!rContext.ObjectExists(mObjectID,
+		BackupStoreContext::ObjectExists_File))
+	{
+		return PROTOCOL_ERROR(Err_DoesNotExist);
+	}
+
+	rContext.AddBlockFingerprints(mObjectID, fingerprints);
+
+	return std::auto_ptr<BackupProtocolMessage>(
+		new BackupProtocolSuccess(mObjectID));
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolFindBlockFingerprints::DoCommand(Protocol &, BackupStoreContext &)
+//		Purpose: Command to find stored files containing blocks
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolFindBlockFingerprints::DoCommand(
+	BackupProtocolReplyable &rProtocol, BackupStoreContext &rContext,
+	IOStream& rDataStream) const
+{
+	CHECK_PHASE(Phase_Commands)
+	CHECK_WRITEABLE_SESSION
+
+	std::vector<uint64_t> fingerprints;
+	ReadBlockFingerprints(rDataStream, rProtocol.GetTimeout(), fingerprints);
+
+	std::auto_ptr<CollectInBufferStream> stream(new CollectInBufferStream);
+	for(std::vector<uint64_t>::const_iterator i = fingerprints.begin();
+		i != fingerprints.end(); ++i)
+	{
+		int64_t id = box_hton64(rContext.FindFileWithBlock(*i));
+		stream->Write(&id, sizeof(id));
+	}
+	stream->SetForReading();
+
+	std::auto_ptr<IOStream> reply(stream.release());
+	rProtocol.SendStreamAfterCommand(reply);
+
+	return std::auto_ptr<BackupProtocolMessage>(
+		new BackupProtocolSuccess(fingerprints.size()));
+}
 
 
 // --------------------------------------------------------------------------
@@ -401,6 +539,54 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolStoreFileWithResume::DoComman
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolStoreFiles::DoCommand(Protocol &, BackupStoreContext &)
+//		Purpose: Command to store a batch of files in one directory
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolStoreFiles::DoCommand(
+	BackupProtocolReplyable &rProtocol, BackupStoreContext &rContext,
+	IOStream& rDataStream) const
+{
+	CHECK_PHASE(Phase_Commands)
+	CHECK_WRITEABLE_SESSION
+
+	std::auto_ptr<BackupProtocolMessage> hookResult =
+		rContext.StartCommandHook(*this);
+	if(hookResult.get())
+	{
+		return hookResult;
+	}
+
+	if(!rContext.ObjectExists(mDirectoryObjectID,
+		BackupStoreContext::ObjectExists_Directory))
+	{
+		return PROTOCOL_ERROR(Err_DoesNotExist);
+	}
+
+	std::vector<int64_t> ids;
+	rContext.AddFiles(rDataStream, mDirectoryObjectID, mNumberOfFiles, ids);
+
+	std::auto_ptr<CollectInBufferStream> stream(new CollectInBufferStream);
+	for(std::vector<int64_t>::const_iterator i = ids.begin();
+		i != ids.end(); ++i)
+	{
+		int64_t id = box_hton64(*i);
+		stream->Write(&id, sizeof(id));
+	}
+	stream->SetForReading();
+
+	std::auto_ptr<IOStream> reply(stream.release());
+	rProtocol.SendStreamAfterCommand(reply);
+
+	return std::auto_ptr<BackupProtocolMessage>(
+		new BackupProtocolSuccess(ids.size()));
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -429,6 +615,116 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetObject::DoCommand(BackupPr
 	return std::auto_ptr<BackupProtocolMessage>(new BackupProtocolSuccess(mObjectID));
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    FindPatchChain(BackupStoreContext &,
+//			 const BackupStoreDirectory &, int64_t,
+//			 std::vector<int64_t> &)
+//		Purpose: Find the objects needed to rebuild a file, starting
+//			 with the file itself. Each is a patch from the next,
+//			 and the last is complete, so a complete file gives a
+//			 chain of one. Returns false if the directory doesn't
+//			 have all of them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static bool FindPatchChain(BackupStoreContext &rContext,
+	const BackupStoreDirectory &rDir, int64_t ObjectID,
+	std::vector<int64_t> &rChainOut)
+{
+	rChainOut.clear();
+
+	BackupStoreDirectory::Entry *pfileEntry = rDir.FindEntryByID(ObjectID);
+	ASSERT(pfileEntry != 0);
+
+	if(pfileEntry->IsPatchFromOlder())
+	{
+		// A patch from the version before, which stays complete
+		// until housekeeping reverses the patch
+		rChainOut.push_back(ObjectID);
+		rChainOut.push_back(pfileEntry->GetDependsOlder());
+		return true;
+	}
+
+	if(pfileEntry->GetDependsNewer() == 0 ||
+		BackupStoreDeferredPatch::IsPending(rDir, *pfileEntry))
+	{
+		// Complete already
+		rChainOut.push_back(ObjectID);
+		return true;
+	}
+
+	// File exists, but is a patch from a new version. Generate the older version.
+	int64_t id = ObjectID;
+	BackupStoreDirectory::Entry *en = 0;
+	do
+	{
+		rChainOut.push_back(id);
+		en = rDir.FindEntryByID(id);
+		if(en == 0)
+		{
+			BOX_ERROR("Object " <<
+				BOX_FORMAT_OBJECTID(ObjectID) <<
+				" in dir " <<
+				BOX_FORMAT_OBJECTID(rDir.GetObjectID()) <<
+				" for account " <<
+				BOX_FORMAT_ACCOUNT(rContext.GetClientID()) <<
+				" references object " <<
+				BOX_FORMAT_OBJECTID(id) <<
+				" which does not exist in dir");
+			return false;
+		}
+		id = en->GetDependsNewer();
+
+		// Complete, if the newer version is a patch from it
+		if(id != 0 && BackupStoreDeferredPatch::IsPending(rDir, *en))
+		{
+			id = 0;
+		}
+	}
+	while(en != 0 && id != 0);
+
+	// OK! The last entry in the chain is the full file, the others are patches back from it.
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    OpenPatchChain(BackupStoreContext &,
+//			 const std::vector<int64_t> &, bool)
+//		Purpose: Open all the objects found by FindPatchChain(), and
+//			 return a stream of the complete file rebuilt from
+//			 them, see BackupStoreFile::CombinePatchChain().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static std::auto_ptr<IOStream> OpenPatchChain(BackupStoreContext &rContext,
+	const std::vector<int64_t> &rPatchChain, bool InFileOrder)
+{
+	std::vector<IOStream *> chain;
+	try
+	{
+		for(size_t p = 0; p < rPatchChain.size(); ++p)
+		{
+			chain.push_back(rContext.OpenObject(rPatchChain[p]).release());
+		}
+
+		return BackupStoreFile::CombinePatchChain(chain, InFileOrder);
+	}
+	catch(...)
+	{
+		for(size_t p = 0; p < chain.size(); ++p)
+		{
+			delete chain[p];
+		}
+		throw;
+	}
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -463,81 +759,18 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetFile::DoCommand(BackupProt
 	std::auto_ptr<IOStream> stream;
 
 	// Does this depend on anything?
-	if(pfileEntry->GetDependsNewer() != 0)
+	std::vector<int64_t> patchChain;
+	if(!FindPatchChain(rContext, rdir, mObjectID, patchChain))
 	{
-		// File exists, but is a patch from a new version. Generate the older version.
-		std::vector<int64_t> patchChain;
-		int64_t id = mObjectID;
-		BackupStoreDirectory::Entry *en = 0;
-		do
-		{
-			patchChain.push_back(id);
-			en = rdir.FindEntryByID(id);
-			if(en == 0)
-			{
-				BOX_ERROR("Object " <<
-					BOX_FORMAT_OBJECTID(mObjectID) <<
-					" in dir " <<
-					BOX_FORMAT_OBJECTID(mInDirectory) <<
-					" for account " <<
-					BOX_FORMAT_ACCOUNT(rContext.GetClientID()) <<
-					" references object " <<
-					BOX_FORMAT_OBJECTID(id) <<
-					" which does not exist in dir");
-				return PROTOCOL_ERROR(Err_PatchConsistencyError);
-			}
-			id = en->GetDependsNewer();
-		}
-		while(en != 0 && id != 0);
-
-		// OK! The last entry in the chain is the full file, the others are patches back from it.
-		// Open the last one, which is the current from file
-		std::auto_ptr<IOStream> from(rContext.OpenObject(patchChain[patchChain.size() - 1]));
-
-		// Then, for each patch in the chain, do a combine
-		for(int p = ((int)patchChain.size()) - 2; p >= 0; --p)
-		{
-			// ID of patch
-			int64_t patchID = patchChain[p];
-
-			// Open it a couple of times
-			std::auto_ptr<IOStream> diff(rContext.OpenObject(patchID));
-			std::auto_ptr<IOStream> diff2(rContext.OpenObject(patchID));
-
-			// Choose a temporary filename for the result of the combination
-			std::ostringstream fs;
-			fs << rContext.GetAccountRoot() << ".recombinetemp." << p;
-			std::string tempFn =
-				RaidFileController::DiscSetPathToFileSystemPath(
-					rContext.GetStoreDiscSet(), fs.str(),
-					p + 16);
-
-			// Open the temporary file
-			std::auto_ptr<IOStream> combined(
-				new InvisibleTempFileStream(
-					tempFn, O_RDWR | O_CREAT | O_EXCL |
-					O_BINARY | O_TRUNC));
-
-			// Do the combining
-			BackupStoreFile::CombineFile(*diff, *diff2, *from, *combined);
-
-			// Move to the beginning of the combined file
-			combined->Seek(0, IOStream::SeekType_Absolute);
-
-			// Then shuffle round for the next go
-			if (from.get()) from->Close();
-			from = combined;
-		}
-
-		// Now, from contains a nice file to send to the client. Reorder it
-		{
-			// Write nastily to allow this to work with gcc 2.x
-			std::auto_ptr<IOStream> t(BackupStoreFile::ReorderFileToStreamOrder(from.get(), true /* take ownership */));
-			stream = t;
-		}
+		return PROTOCOL_ERROR(Err_PatchConsistencyError);
+	}
 
-		// Release from file to avoid double deletion
-		from.release();
+	if(patchChain.size() > 1)
+	{
+		// Combine them in one pass, straight into a stream ready to send.
+		std::auto_ptr<IOStream> t(OpenPatchChain(rContext, patchChain,
+			false /* stream order */));
+		stream = t;
 	}
 	else
 	{
@@ -577,6 +810,86 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetFile::DoCommand(BackupProt
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolGetFileRange::DoCommand(Protocol &, BackupStoreContext &)
+//		Purpose: Command to get part of a file from the server, in
+//			 file order. A file stored as a patch is read from the
+//			 objects it's rebuilt from, without rebuilding it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolGetFileRange::DoCommand(BackupProtocolReplyable &rProtocol, BackupStoreContext &rContext) const
+{
+	CHECK_PHASE(Phase_Commands)
+
+	// Check the objects exist
+	if(!rContext.ObjectExists(mObjectID)
+		|| !rContext.ObjectExists(mInDirectory))
+	{
+		return PROTOCOL_ERROR(Err_DoesNotExist);
+	}
+
+	// Check the file is in the directory every time, even if it was
+	// opened by an earlier command, which may have named another one
+	const BackupStoreDirectory &rdir(rContext.GetDirectory(mInDirectory));
+	if(rdir.FindEntryByID(mObjectID) == 0)
+	{
+		return PROTOCOL_ERROR(Err_DoesNotExistInDirectory);
+	}
+
+	// Clients read a file a range at a time, so keep it open for the
+	// next one, as finding the blocks of a patch means reading the
+	// whole block index of every object in its chain.
+	IOStream *pfile = rContext.GetFileRangeStream(mObjectID);
+	if(pfile == 0)
+	{
+		std::vector<int64_t> patchChain;
+		if(!FindPatchChain(rContext, rdir, mObjectID, patchChain))
+		{
+			return PROTOCOL_ERROR(Err_PatchConsistencyError);
+		}
+
+		std::auto_ptr<IOStream> file;
+		if(patchChain.size() > 1)
+		{
+			std::auto_ptr<IOStream> t(OpenPatchChain(rContext,
+				patchChain, true /* file order */));
+			file = t;
+		}
+		else
+		{
+			// Already complete, and on disc in file order
+			std::auto_ptr<IOStream> t(rContext.OpenObject(mObjectID));
+			file = t;
+		}
+		pfile = file.get();
+		rContext.SetFileRangeStream(mObjectID, file);
+	}
+
+	pfile->Seek(0, IOStream::SeekType_Absolute);
+	int64_t size = pfile->BytesLeftToRead();
+
+	if(mOffset >= 0 && mOffset < size && mLength > 0)
+	{
+		pfile->Seek(mOffset, IOStream::SeekType_Absolute);
+		int64_t length = size - mOffset;
+		if(length > mLength)
+		{
+			length = mLength;
+		}
+
+		// The context keeps the file open while this is sent
+		std::auto_ptr<IOStream> range(new PartialReadStream(*pfile,
+			length));
+		rProtocol.SendStreamAfterCommand(range);
+	}
+
+	return std::auto_ptr<BackupProtocolMessage>(new BackupProtocolSuccess(size));
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1030,7 +1343,7 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetObjectName2::DoCommand(Bac
 			}
 
 			// Store the name in the stream
-			en->GetName().WriteToStream(*stream);
+			en->WriteNameToStream(*stream);
 
 			// Count of name elements
 			++numNameElements;
@@ -1148,7 +1461,7 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetObjectName::DoCommand(Back
 			}
 
 			// Store the name in the stream
-			en->GetName().WriteToStream(*stream);
+			en->WriteNameToStream(*stream);
 
 			// Count of name elements
 			++numNameElements;
@@ -1176,6 +1489,40 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetObjectName::DoCommand(Back
 
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    OpenBlockIndex(BackupStoreContext &, int64_t, int64_t)
+//		Purpose: Open a file with its position at the block index. A
+//			 file stored as a patch from an older version gets the
+//			 index of the complete file, made from both indices.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static std::auto_ptr<IOStream> OpenBlockIndex(BackupStoreContext &rContext,
+	int64_t ObjectID, int64_t InDirectory)
+{
+	std::auto_ptr<IOStream> stream(rContext.OpenObject(ObjectID));
+
+	BackupStoreDirectory::Entry *en = 0;
+	if(rContext.ObjectExists(InDirectory,
+		BackupStoreContext::ObjectExists_Directory))
+	{
+		en = rContext.GetDirectory(InDirectory).FindEntryByID(ObjectID);
+	}
+
+	if(en == 0 || !en->IsPatchFromOlder())
+	{
+		BackupStoreFile::MoveStreamPositionToBlockIndex(*stream);
+		return stream;
+	}
+
+	std::auto_ptr<IOStream> from(rContext.OpenObject(en->GetDependsOlder()));
+	return BackupStoreFile::CombineFileIndices(*(stream.release()), *from,
+		false, false, true /* take ownership of the patch */);
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1188,11 +1535,14 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetBlockIndexByID::DoCommand(
 {
 	CHECK_PHASE(Phase_Commands)
 
-	// Open the file
-	std::auto_ptr<IOStream> stream(rContext.OpenObject(mObjectID));
+	// Find the directory the file was stored in
+	bool isDirectory = false;
+	int64_t containerID = 0;
+	rContext.GetObjectInfos(mObjectID, isDirectory, containerID);
 
-	// Move the file pointer to the block index
-	BackupStoreFile::MoveStreamPositionToBlockIndex(*stream);
+	// Open the file at the block index
+	std::auto_ptr<IOStream> stream(OpenBlockIndex(rContext, mObjectID,
+		containerID));
 
 	// Return the stream to the client
 	rProtocol.SendStreamAfterCommand(stream);
@@ -1223,7 +1573,7 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetBlockIndexByName::DoComman
 	BackupStoreDirectory::Entry *en = 0;
 	while((en = i.Next(BackupStoreDirectory::Entry::Flags_File)) != 0)
 	{
-		if(en->GetName() == mFilename)
+		if(en->NameMatches(mFilename))
 		{
 			// Store the ID, if it's a newer ID than the last one
 			if(en->GetObjectID() > objectID)
@@ -1240,11 +1590,9 @@ std::auto_ptr<BackupProtocolMessage> BackupProtocolGetBlockIndexByName::DoComman
 		return std::auto_ptr<BackupProtocolMessage>(new BackupProtocolSuccess(0));
 	}
 
-	// Open the file
-	std::auto_ptr<IOStream> stream(rContext.OpenObject(objectID));
-
-	// Move the file pointer to the block index
-	BackupStoreFile::MoveStreamPositionToBlockIndex(*stream);
+	// Open the file at the block index
+	std::auto_ptr<IOStream> stream(OpenBlockIndex(rContext, objectID,
+		mInDirectory));
 
 	// Return the stream to the client
 	rProtocol.SendStreamAfterCommand(stream);
@@ -571,7 +571,14 @@ int BackupStoreAccountsControl::CheckAccount(int32_t ID, bool FixErrors, bool Qu
 	}
 
 	// Check it
-	BackupStoreCheck check(rootDir, discSetNum, ID, FixErrors, Quiet);
+	int threads = mConfig.GetKeyValueInt("CheckThreads", 0);
+	std::string indexDir;
+	if(mConfig.KeyExists("CheckIndexDirectory"))
+	{
+		indexDir = mConfig.GetKeyValue("CheckIndexDirectory");
+	}
+	BackupStoreCheck check(rootDir, discSetNum, ID, FixErrors, Quiet,
+		(threads > 0) ? threads : 0, indexDir);
 	check.Check();
 
 	if(ReturnNumErrorsFound)
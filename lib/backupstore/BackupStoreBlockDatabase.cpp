@@ -0,0 +1,553 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreBlockDatabase.cpp
+//		Purpose: Index of the blocks in the files of an account, by
+//			 fingerprint, so that new files can reuse them
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <stdio.h>
+
+#include "BackupStoreAccounts.h"
+#include "BackupStoreBlockDatabase.h"
+#include "BackupStoreRefCountDatabase.h"
+#include "BufferedStream.h"
+#include "CommonException.h"
+#include "RaidFileController.h"
+#include "RaidFileUtil.h"
+#include "Utils.h"
+
+#include "MemLeakFindOn.h"
+
+#define BLOCKDB_MAGIC_VALUE	0x426c6b32 // Blk2
+#define BLOCKDB_FILENAME	"blocks"
+
+// Most unsorted records held in memory at once, by a session looking blocks
+// up, or by housekeeping sorting them. 16 bytes each on disc, a few times
+// that in memory.
+#define BLOCKDB_MAX_RECORDS_IN_MEMORY	(256 * 1024)
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::BackupStoreBlockDatabase(
+//			 const std::string &, int32_t, int64_t, int64_t)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreBlockDatabase::BackupStoreBlockDatabase(
+	const std::string &rFilename, int32_t AccountID,
+	int64_t NumSortedRecords, int64_t NumRecords)
+: mFilename(rFilename),
+  mAccountID(AccountID),
+  mNumSortedRecords(NumSortedRecords),
+  mNumRecords(NumRecords),
+  mIsInMemory(false)
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::~BackupStoreBlockDatabase()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreBlockDatabase::~BackupStoreBlockDatabase()
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::GetFilename(
+//			 const BackupStoreAccountDatabase::Entry &,
+//			 const char *)
+//		Purpose: The database is a plain file in the account's root
+//			 on the first disc, next to the refcount database.
+//			 Housekeeping writes the new one to files with the
+//			 suffixes X and Y.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::string BackupStoreBlockDatabase::GetFilename(const
+	BackupStoreAccountDatabase::Entry& rAccount, const char *pSuffix)
+{
+	std::string RootDir = BackupStoreAccounts::GetAccountRoot(rAccount);
+	ASSERT(RootDir[RootDir.size() - 1] == '/' ||
+		RootDir[RootDir.size() - 1] == DIRECTORY_SEPARATOR_ASCHAR);
+
+	std::string fn(RootDir + BLOCKDB_FILENAME ".db");
+	fn += pSuffix;
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(rAccount.GetDiscSet()));
+	return RaidFileUtil::MakeWriteFileName(rdiscSet, fn);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::ReadHeader(
+//			 const std::string &, int32_t, int64_t &, int64_t &)
+//		Purpose: Private. Checks the header, and that there's no
+//			 partly written record, which later records would be
+//			 misaligned with. Returns false if the database is
+//			 damaged.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreBlockDatabase::ReadHeader(const std::string &rFilename,
+	int32_t AccountID, int64_t &rNumSortedRecordsOut,
+	int64_t &rNumRecordsOut)
+{
+	FileStream file(rFilename, O_RDONLY | O_BINARY);
+	int64_t size = file.BytesLeftToRead();
+	blockdb_StreamFormat hdr;
+	if(!file.ReadFullBuffer(&hdr, sizeof(hdr), 0) ||
+		ntohl(hdr.mMagicValue) != BLOCKDB_MAGIC_VALUE ||
+		(int32_t)ntohl(hdr.mAccountID) != AccountID ||
+		((size - sizeof(hdr)) % sizeof(blockdb_Record)) != 0)
+	{
+		return false;
+	}
+
+	rNumRecordsOut = (size - sizeof(hdr)) / sizeof(blockdb_Record);
+	rNumSortedRecordsOut = box_ntoh64(hdr.mNumSortedRecords);
+	return rNumSortedRecordsOut >= 0 &&
+		rNumSortedRecordsOut <= rNumRecordsOut;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::Open(
+//			 const BackupStoreAccountDatabase::Entry &)
+//		Purpose: Open the account's database to add to it. If there
+//			 isn't one, or it's damaged, an empty one is created.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupStoreBlockDatabase> BackupStoreBlockDatabase::Open(
+	const BackupStoreAccountDatabase::Entry& rAccount)
+{
+	std::string Filename = GetFilename(rAccount);
+
+	int64_t numSorted = 0, numRecords = 0;
+	if(FileExists(Filename) &&
+		!ReadHeader(Filename, rAccount.GetID(), numSorted, numRecords))
+	{
+		BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Block database "
+			"is damaged, starting a new one"));
+		Create(Filename, rAccount.GetID());
+		numSorted = numRecords = 0;
+	}
+	else if(!FileExists(Filename))
+	{
+		Create(Filename, rAccount.GetID());
+	}
+
+	std::auto_ptr<BackupStoreBlockDatabase> db(
+		new BackupStoreBlockDatabase(Filename, rAccount.GetID(),
+			numSorted, numRecords));
+	db->mapAppendFile.reset(new FileStream(Filename,
+		O_WRONLY | O_APPEND | O_BINARY));
+	db->mapReadFile.reset(new FileStream(Filename, O_RDONLY | O_BINARY));
+	return db;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::AddBlocks(int64_t,
+//			 const std::vector<uint64_t> &)
+//		Purpose: Record that a file contains these blocks
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreBlockDatabase::AddBlocks(int64_t ObjectID,
+	const std::vector<uint64_t> &rFingerprints)
+{
+	if(rFingerprints.empty())
+	{
+		return;
+	}
+
+	std::vector<blockdb_Record> records(rFingerprints.size());
+	for(size_t i = 0; i < rFingerprints.size(); ++i)
+	{
+		records[i].mFingerprint = box_hton64(rFingerprints[i]);
+		records[i].mObjectID = box_hton64(ObjectID);
+	}
+
+	// One write, so that a record can only be cut short at the end
+	mapAppendFile->Write(&records[0],
+		records.size() * sizeof(blockdb_Record));
+	mNumRecords += records.size();
+
+	if(mIsInMemory)
+	{
+		for(size_t i = 0; i < rFingerprints.size() &&
+			mRecentFileWithBlock.size() < BLOCKDB_MAX_RECORDS_IN_MEMORY;
+			++i)
+		{
+			mRecentFileWithBlock[rFingerprints[i]] = ObjectID;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::FindBlock(uint64_t)
+//		Purpose: Returns the ID of the file which most recently
+//			 recorded this block, or 0 if none has. Blocks added
+//			 since housekeeping last ran may not be found if a
+//			 great many have been.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreBlockDatabase::FindBlock(uint64_t Fingerprint)
+{
+	if(!mIsInMemory)
+	{
+		// Only the most recent, if there are too many
+		int64_t count = mNumRecords - mNumSortedRecords;
+		if(count > BLOCKDB_MAX_RECORDS_IN_MEMORY)
+		{
+			count = BLOCKDB_MAX_RECORDS_IN_MEMORY;
+		}
+		ReadUnsortedRecords(*mapReadFile, mNumRecords - count, count,
+			mRecentFileWithBlock);
+		mIsInMemory = true;
+	}
+
+	std::map<uint64_t, int64_t>::const_iterator i(
+		mRecentFileWithBlock.find(Fingerprint));
+	if(i != mRecentFileWithBlock.end())
+	{
+		return i->second;
+	}
+
+	return FindSortedRecord(Fingerprint);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::FindSortedRecord(uint64_t)
+//		Purpose: Private. Binary search of the sorted records on
+//			 disc. Returns the file ID, or 0 if not found.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreBlockDatabase::FindSortedRecord(uint64_t Fingerprint)
+{
+	int64_t low = 0, high = mNumSortedRecords;
+	while(low < high)
+	{
+		int64_t mid = low + (high - low) / 2;
+		mapReadFile->Seek(sizeof(blockdb_StreamFormat) +
+			mid * sizeof(blockdb_Record), IOStream::SeekType_Absolute);
+		blockdb_Record record;
+		if(!mapReadFile->ReadFullBuffer(&record, sizeof(record), 0))
+		{
+			THROW_FILE_ERROR("Failed to read block database record",
+				mFilename, CommonException, OSFileReadError);
+		}
+
+		uint64_t fingerprint = box_ntoh64(record.mFingerprint);
+		if(fingerprint == Fingerprint)
+		{
+			return box_ntoh64(record.mObjectID);
+		}
+		else if(fingerprint < Fingerprint)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	return 0;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::ReadUnsortedRecords(
+//			 FileStream &, int64_t, int64_t,
+//			 std::map<uint64_t, int64_t> &)
+//		Purpose: Private. Read Count records starting at the record
+//			 numbered First, later ones replacing earlier ones for
+//			 the same block.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreBlockDatabase::ReadUnsortedRecords(FileStream &rFile,
+	int64_t First, int64_t Count,
+	std::map<uint64_t, int64_t> &rRecordsOut)
+{
+	rFile.Seek(sizeof(blockdb_StreamFormat) + First * sizeof(blockdb_Record),
+		IOStream::SeekType_Absolute);
+	BufferedStream buf(rFile);
+
+	for(int64_t r = 0; r < Count; ++r)
+	{
+		blockdb_Record record;
+		if(!buf.ReadFullBuffer(&record, sizeof(record), 0))
+		{
+			THROW_FILE_ERROR("Failed to read block database record",
+				rFile.GetFileName(), CommonException,
+				OSFileReadError);
+		}
+		rRecordsOut[box_ntoh64(record.mFingerprint)] =
+			box_ntoh64(record.mObjectID);
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::WriteHeader(FileStream &,
+//			 int32_t, int64_t)
+//		Purpose: Private. Writes the header of a new database.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreBlockDatabase::WriteHeader(FileStream &rFile,
+	int32_t AccountID, int64_t NumSortedRecords)
+{
+	blockdb_StreamFormat hdr;
+	hdr.mMagicValue = htonl(BLOCKDB_MAGIC_VALUE);
+	hdr.mAccountID = htonl(AccountID);
+	hdr.mNumSortedRecords = box_hton64(NumSortedRecords);
+	rFile.Write(&hdr, sizeof(hdr));
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::Create(const std::string &,
+//			 int32_t)
+//		Purpose: Private. Replace the database with an empty one.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreBlockDatabase::Create(const std::string &rFilename,
+	int32_t AccountID)
+{
+	FileStream file(rFilename, O_CREAT | O_TRUNC | O_BINARY | O_WRONLY);
+	WriteHeader(file, AccountID, 0);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::WriteMerged(
+//			 const std::string &, int64_t,
+//			 const std::map<uint64_t, int64_t> &,
+//			 const BackupStoreRefCountDatabase &,
+//			 const std::string &, int32_t)
+//		Purpose: Private. Writes a new database with no unsorted
+//			 records, merging the sorted records at the start of
+//			 one file with some newer ones, which replace them
+//			 for the same block. Records of files which are no
+//			 longer referenced are left out. Returns the number
+//			 of records written.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreBlockDatabase::WriteMerged(
+	const std::string &rSortedFilename, int64_t NumSortedRecords,
+	const std::map<uint64_t, int64_t> &rNewRecords,
+	const BackupStoreRefCountDatabase &rRefCount,
+	const std::string &rOutFilename, int32_t AccountID)
+{
+	FileStream in(rSortedFilename, O_RDONLY | O_BINARY);
+	in.Seek(sizeof(blockdb_StreamFormat), IOStream::SeekType_Absolute);
+	BufferedStream inBuf(in);
+
+	FileStream out(rOutFilename, O_CREAT | O_TRUNC | O_BINARY | O_RDWR);
+	WriteHeader(out, AccountID, 0);
+	std::vector<blockdb_Record> outBuf;
+	outBuf.reserve(4096);
+	int64_t written = 0;
+	int64_t lastObjectID = rRefCount.GetLastObjectIDUsed();
+
+	std::map<uint64_t, int64_t>::const_iterator n(rNewRecords.begin());
+	blockdb_Record sorted;
+	int64_t sortedLeft = NumSortedRecords;
+	bool haveSorted = false;
+
+	while(true)
+	{
+		if(!haveSorted && sortedLeft > 0)
+		{
+			if(!inBuf.ReadFullBuffer(&sorted, sizeof(sorted), 0))
+			{
+				THROW_FILE_ERROR("Failed to read block database "
+					"record", rSortedFilename,
+					CommonException, OSFileReadError);
+			}
+			sortedLeft--;
+			haveSorted = true;
+		}
+
+		uint64_t fingerprint;
+		int64_t objectID;
+		if(haveSorted && (n == rNewRecords.end() ||
+			box_ntoh64(sorted.mFingerprint) <= n->first))
+		{
+			fingerprint = box_ntoh64(sorted.mFingerprint);
+			objectID = box_ntoh64(sorted.mObjectID);
+			haveSorted = false;
+			if(n != rNewRecords.end() && n->first == fingerprint)
+			{
+				// The newer record wins
+				objectID = (n++)->second;
+			}
+		}
+		else if(n != rNewRecords.end())
+		{
+			fingerprint = n->first;
+			objectID = (n++)->second;
+		}
+		else
+		{
+			break;
+		}
+
+		if(objectID < 1 || objectID > lastObjectID ||
+			rRefCount.GetRefCount(objectID) == 0)
+		{
+			continue;
+		}
+
+		blockdb_Record record;
+		record.mFingerprint = box_hton64(fingerprint);
+		record.mObjectID = box_hton64(objectID);
+		outBuf.push_back(record);
+		if(outBuf.size() == outBuf.capacity())
+		{
+			out.Write(&outBuf[0], outBuf.size() * sizeof(record));
+			written += outBuf.size();
+			outBuf.clear();
+		}
+	}
+
+	if(!outBuf.empty())
+	{
+		out.Write(&outBuf[0], outBuf.size() * sizeof(blockdb_Record));
+		written += outBuf.size();
+	}
+
+	out.Seek(0, IOStream::SeekType_Absolute);
+	WriteHeader(out, AccountID, written);
+	out.Close();
+	return written;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreBlockDatabase::Prune(
+//			 const BackupStoreAccountDatabase::Entry &,
+//			 const BackupStoreRefCountDatabase &, bool)
+//		Purpose: Rewrite the database with all its records sorted,
+//			 without those of files which are no longer
+//			 referenced, or of blocks which a later record says
+//			 are in another file. Unsorted records are merged in
+//			 batches, so memory use is bounded, and nothing is
+//			 done if there are none and ObjectsDeleted is false.
+//			 Does nothing if the account has no database.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreBlockDatabase::Prune(
+	const BackupStoreAccountDatabase::Entry& rAccount,
+	const BackupStoreRefCountDatabase &rRefCount, bool ObjectsDeleted)
+{
+	std::string Filename = GetFilename(rAccount);
+	if(!FileExists(Filename))
+	{
+		return;
+	}
+
+	int64_t numSorted = 0, numRecords = 0;
+	if(!ReadHeader(Filename, rAccount.GetID(), numSorted, numRecords))
+	{
+		BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Block database "
+			"is damaged, starting a new one"));
+		Create(Filename, rAccount.GetID());
+		return;
+	}
+
+	if(numSorted == numRecords && !ObjectsDeleted)
+	{
+		return;
+	}
+
+	// Each batch of unsorted records is merged with the output of the
+	// last one, alternating between the two temporary files
+	std::string tempFilenames[2] = {
+		GetFilename(rAccount, "X"), GetFilename(rAccount, "Y") };
+	std::string sortedFilename = Filename;
+	int64_t sortedCount = numSorted;
+	int64_t next = numSorted;
+	int pass = 0;
+
+	FileStream file(Filename, O_RDONLY | O_BINARY);
+	do
+	{
+		int64_t count = numRecords - next;
+		if(count > BLOCKDB_MAX_RECORDS_IN_MEMORY)
+		{
+			count = BLOCKDB_MAX_RECORDS_IN_MEMORY;
+		}
+
+		std::map<uint64_t, int64_t> batch;
+		ReadUnsortedRecords(file, next, count, batch);
+		next += count;
+
+		std::string &rOut(tempFilenames[pass++ % 2]);
+		sortedCount = WriteMerged(sortedFilename, sortedCount, batch,
+			rRefCount, rOut, rAccount.GetID());
+		sortedFilename = rOut;
+	}
+	while(next < numRecords);
+	file.Close();
+
+	BOX_INFO("Sorted " << (numRecords - numSorted) << " new records into "
+		"block database for account " <<
+		BOX_FORMAT_ACCOUNT(rAccount.GetID()) << ", removing " <<
+		(numRecords - sortedCount) << " of " << numRecords);
+
+	#ifdef WIN32
+	if(EMU_UNLINK(Filename.c_str()) != 0)
+	{
+		THROW_EMU_FILE_ERROR("Failed to delete old block database",
+			Filename, CommonException, OSFileError);
+	}
+	#endif
+
+	if(rename(sortedFilename.c_str(), Filename.c_str()) != 0)
+	{
+		THROW_EMU_ERROR("Failed to rename temporary block database "
+			"from " << sortedFilename << " to " << Filename,
+			CommonException, OSFileError);
+	}
+
+	if(pass > 1)
+	{
+		// The other one is left over from the pass before
+		EMU_UNLINK(tempFilenames[pass % 2].c_str());
+	}
+}
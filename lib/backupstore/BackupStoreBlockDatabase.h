@@ -0,0 +1,138 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreBlockDatabase.h
+//		Purpose: Index of the blocks in the files of an account, by
+//			 fingerprint, so that new files can reuse them
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTOREBLOCKDATABASE__H
+#define BACKUPSTOREBLOCKDATABASE__H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BackupStoreAccountDatabase.h"
+#include "FileStream.h"
+
+class BackupStoreRefCountDatabase;
+
+// set packing to one byte
+#ifdef STRUCTURE_PACKING_FOR_WIRE_USE_HEADERS
+#include "BeginStructPackForWire.h"
+#else
+BEGIN_STRUCTURE_PACKING_FOR_WIRE
+#endif
+
+typedef struct
+{
+	uint32_t mMagicValue;	// also the version number
+	uint32_t mAccountID;
+	int64_t mNumSortedRecords;
+} blockdb_StreamFormat;
+
+typedef struct
+{
+	uint64_t mFingerprint;
+	int64_t mObjectID;
+} blockdb_Record;
+
+// Use default packing
+#ifdef STRUCTURE_PACKING_FOR_WIRE_USE_HEADERS
+#include "EndStructPackForWire.h"
+#else
+END_STRUCTURE_PACKING_FOR_WIRE
+#endif
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreBlockDatabase
+//		Purpose: Maps the fingerprints of blocks, which clients send
+//			 after uploading a file (see
+//			 BackupStoreFile::GetBlockFingerprint()), to the ID of
+//			 a file which contains them. A client about to upload
+//			 a new file can then find another file to diff it
+//			 against, such as the one it was copied from. This
+//			 only saves upload bandwidth: the new file is still
+//			 stored in full, as files don't share blocks on disc.
+//
+//			 The file starts with records sorted by fingerprint,
+//			 one for each block, which are searched on disc.
+//			 Records added since are appended after them, and the
+//			 most recent of those are kept in memory, up to a
+//			 limit. Housekeeping merges them into the sorted part
+//			 (see Prune()).
+//
+//			 Records are only ever appended during a session, so
+//			 some may refer to files which have since been deleted
+//			 or turned into patches. Callers must check before
+//			 using a file, and housekeeping removes the records of
+//			 files which no longer exist. A damaged database is
+//			 simply started again, as it only saves bandwidth.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreBlockDatabase
+{
+public:
+	~BackupStoreBlockDatabase();
+private:
+	// Creation through static functions only
+	BackupStoreBlockDatabase(const std::string &rFilename,
+		int32_t AccountID, int64_t NumSortedRecords,
+		int64_t NumRecords);
+	// No copying allowed
+	BackupStoreBlockDatabase(const BackupStoreBlockDatabase &);
+	BackupStoreBlockDatabase &operator=(const BackupStoreBlockDatabase &);
+
+public:
+	// Open the database for appending, creating it if necessary
+	static std::auto_ptr<BackupStoreBlockDatabase> Open(
+		const BackupStoreAccountDatabase::Entry& rAccount);
+
+	void AddBlocks(int64_t ObjectID,
+		const std::vector<uint64_t> &rFingerprints);
+	// Returns the most recently added file containing the block, or 0
+	int64_t FindBlock(uint64_t Fingerprint);
+
+	// Sort the records added since the last time, and remove those of
+	// files with no references left if any have been deleted
+	static void Prune(const BackupStoreAccountDatabase::Entry& rAccount,
+		const BackupStoreRefCountDatabase &rRefCount,
+		bool ObjectsDeleted);
+
+private:
+	static std::string GetFilename(const BackupStoreAccountDatabase::Entry&
+		rAccount, const char *pSuffix = "");
+	static bool ReadHeader(const std::string &rFilename, int32_t AccountID,
+		int64_t &rNumSortedRecordsOut, int64_t &rNumRecordsOut);
+	static void ReadUnsortedRecords(FileStream &rFile, int64_t First,
+		int64_t Count, std::map<uint64_t, int64_t> &rRecordsOut);
+	static int64_t WriteMerged(const std::string &rSortedFilename,
+		int64_t NumSortedRecords,
+		const std::map<uint64_t, int64_t> &rNewRecords,
+		const BackupStoreRefCountDatabase &rRefCount,
+		const std::string &rOutFilename, int32_t AccountID);
+	static void Create(const std::string &rFilename, int32_t AccountID);
+	static void WriteHeader(FileStream &rFile, int32_t AccountID,
+		int64_t NumSortedRecords);
+	int64_t FindSortedRecord(uint64_t Fingerprint);
+
+	std::string mFilename;
+	int32_t mAccountID;
+	int64_t mNumSortedRecords;
+	int64_t mNumRecords;
+	std::auto_ptr<FileStream> mapAppendFile;
+	std::auto_ptr<FileStream> mapReadFile;
+	// The most recent unsorted records, read when first needed, and
+	// kept up to date after
+	bool mIsInMemory;
+	std::map<uint64_t, int64_t> mRecentFileWithBlock;
+};
+
+#endif // BACKUPSTOREBLOCKDATABASE__H
@@ -0,0 +1,324 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreChangeJournal.cpp
+//		Purpose: Journal of the directories changed in an account since
+//			 it was last housekept
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <stdio.h>
+
+#include "BackupStoreAccounts.h"
+#include "BackupStoreChangeJournal.h"
+#include "BufferedStream.h"
+#include "CommonException.h"
+#include "RaidFileController.h"
+#include "RaidFileUtil.h"
+#include "Utils.h"
+
+#include "MemLeakFindOn.h"
+
+#define CHANGEJOURNAL_MAGIC_VALUE	0x43684a32 // ChJ2
+#define CHANGEJOURNAL_FILENAME		"dirchanges"
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::BackupStoreChangeJournal(
+//			 const std::string &, std::auto_ptr<FileStream>)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreChangeJournal::BackupStoreChangeJournal(
+	const std::string &rFilename, std::auto_ptr<FileStream> apJournalFile)
+: mFilename(rFilename),
+  mapJournalFile(apJournalFile)
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::~BackupStoreChangeJournal()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreChangeJournal::~BackupStoreChangeJournal()
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::GetFilename(
+//			 const BackupStoreAccountDatabase::Entry &, bool)
+//		Purpose: The journal is a plain file in the account's root
+//			 on the first disc, next to the refcount database.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::string BackupStoreChangeJournal::GetFilename(const
+	BackupStoreAccountDatabase::Entry& rAccount, bool Temporary)
+{
+	std::string RootDir = BackupStoreAccounts::GetAccountRoot(rAccount);
+	ASSERT(RootDir[RootDir.size() - 1] == '/' ||
+		RootDir[RootDir.size() - 1] == DIRECTORY_SEPARATOR_ASCHAR);
+
+	std::string fn(RootDir + CHANGEJOURNAL_FILENAME ".jnl");
+	if(Temporary)
+	{
+		fn += "X";
+	}
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(rAccount.GetDiscSet()));
+	return RaidFileUtil::MakeWriteFileName(rdiscSet, fn);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::OpenForRecording(
+//			 const BackupStoreAccountDatabase::Entry &)
+//		Purpose: Open the account's journal to append to it. Returns
+//			 an empty pointer if there isn't one, because then
+//			 housekeeping will scan every directory anyway.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupStoreChangeJournal>
+	BackupStoreChangeJournal::OpenForRecording(
+		const BackupStoreAccountDatabase::Entry& rAccount)
+{
+	std::auto_ptr<BackupStoreChangeJournal> journal;
+
+	std::string Filename = GetFilename(rAccount, false);
+	if(!FileExists(Filename))
+	{
+		BOX_TRACE("Account " << BOX_FORMAT_ACCOUNT(rAccount.GetID()) <<
+			" has no change journal, not recording changes");
+		return journal;
+	}
+
+	std::auto_ptr<FileStream> file(new FileStream(Filename,
+		O_WRONLY | O_APPEND | O_BINARY));
+	journal.reset(new BackupStoreChangeJournal(Filename, file));
+	return journal;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::RecordDirectoryChanged(int64_t)
+//		Purpose: Add a directory to the journal, if it isn't there
+//			 already. If that fails, the journal is removed rather
+//			 than left incomplete.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreChangeJournal::RecordDirectoryChanged(int64_t ObjectID)
+{
+	if(!mapJournalFile.get() ||
+		mRecorded.find(ObjectID) != mRecorded.end())
+	{
+		return;
+	}
+
+	changejournal_Record record;
+	record.mObjectID = box_hton64(ObjectID);
+	record.mCheck = box_hton64(~ObjectID);
+
+	try
+	{
+		mapJournalFile->Write(&record, sizeof(record));
+	}
+	catch(BoxException &e)
+	{
+		BOX_WARNING(BOX_FILE_MESSAGE(mFilename, "Failed to record "
+			"change to directory " << BOX_FORMAT_OBJECTID(ObjectID) <<
+			", removing change journal so that housekeeping scans "
+			"the whole account: " << e.what()));
+		mapJournalFile.reset();
+		if(EMU_UNLINK(mFilename.c_str()) != 0)
+		{
+			THROW_EMU_FILE_ERROR("Failed to remove incomplete "
+				"change journal", mFilename, CommonException,
+				OSFileError);
+		}
+		return;
+	}
+
+	mRecorded.insert(ObjectID);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::Read(
+//			 const BackupStoreAccountDatabase::Entry &,
+//			 std::set<int64_t> &, int32_t &)
+//		Purpose: Read the IDs of the directories changed since the
+//			 journal was last reset, and the number of times it
+//			 was reset since the last full scan. Returns false if
+//			 the journal is missing or damaged, in which case the
+//			 caller must assume that any directory may have
+//			 changed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreChangeJournal::Read(
+	const BackupStoreAccountDatabase::Entry& rAccount,
+	std::set<int64_t> &rDirectoriesOut, int32_t &rRunsSinceFullScanOut)
+{
+	std::string Filename = GetFilename(rAccount, false);
+	if(!FileExists(Filename))
+	{
+		BOX_INFO("Account " << BOX_FORMAT_ACCOUNT(rAccount.GetID()) <<
+			" has no change journal yet");
+		return false;
+	}
+
+	try
+	{
+		FileStream file(Filename, O_RDONLY | O_BINARY);
+		BufferedStream buf(file);
+
+		changejournal_StreamFormat hdr;
+		if(!buf.ReadFullBuffer(&hdr, sizeof(hdr),
+			0 /* not interested in bytes read if this fails */))
+		{
+			BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Change journal "
+				"is damaged: short header"));
+			return false;
+		}
+
+		if(ntohl(hdr.mMagicValue) != CHANGEJOURNAL_MAGIC_VALUE ||
+			(int32_t)ntohl(hdr.mAccountID) != rAccount.GetID())
+		{
+			BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Change journal "
+				"is damaged: bad magic number"));
+			return false;
+		}
+		rRunsSinceFullScanOut = ntohl(hdr.mRunsSinceFullScan);
+
+		while(true)
+		{
+			changejournal_Record record;
+			int bytesRead = 0;
+			if(!buf.ReadFullBuffer(&record, sizeof(record),
+				&bytesRead))
+			{
+				if(bytesRead == 0)
+				{
+					break;
+				}
+
+				BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Change "
+					"journal is damaged: short record"));
+				return false;
+			}
+
+			int64_t id = box_ntoh64(record.mObjectID);
+			if(id <= 0 || (int64_t)box_ntoh64(record.mCheck) != ~id)
+			{
+				BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Change "
+					"journal is damaged: bad record"));
+				return false;
+			}
+
+			rDirectoriesOut.insert(id);
+		}
+	}
+	catch(BoxException &e)
+	{
+		BOX_WARNING(BOX_FILE_MESSAGE(Filename, "Failed to read change "
+			"journal: " << e.what()));
+		return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::Reset(
+//			 const BackupStoreAccountDatabase::Entry &,
+//			 int32_t, const std::set<int64_t> &)
+//		Purpose: Replace the journal with one which lists only
+//			 rStillChanged, creating it if necessary, and records
+//			 how many runs there have been since the last full
+//			 scan (0 after one). Only call this when every other
+//			 change up to now has been dealt with.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreChangeJournal::Reset(
+	const BackupStoreAccountDatabase::Entry& rAccount,
+	int32_t RunsSinceFullScan, const std::set<int64_t> &rStillChanged)
+{
+	changejournal_StreamFormat hdr;
+	hdr.mMagicValue = htonl(CHANGEJOURNAL_MAGIC_VALUE);
+	hdr.mAccountID = htonl(rAccount.GetID());
+	hdr.mRunsSinceFullScan = htonl(RunsSinceFullScan);
+
+	std::string TempFilename = GetFilename(rAccount, true);
+	std::string Filename = GetFilename(rAccount, false);
+
+	{
+		FileStream file(TempFilename,
+			O_CREAT | O_TRUNC | O_BINARY | O_WRONLY);
+		file.Write(&hdr, sizeof(hdr));
+		for(std::set<int64_t>::const_iterator i(rStillChanged.begin());
+			i != rStillChanged.end(); i++)
+		{
+			changejournal_Record record;
+			record.mObjectID = box_hton64(*i);
+			record.mCheck = box_hton64(~*i);
+			file.Write(&record, sizeof(record));
+		}
+		file.Close();
+	}
+
+	#ifdef WIN32
+	if(FileExists(Filename) && EMU_UNLINK(Filename.c_str()) != 0)
+	{
+		THROW_EMU_FILE_ERROR("Failed to delete old change journal",
+			Filename, CommonException, OSFileError);
+	}
+	#endif
+
+	if(rename(TempFilename.c_str(), Filename.c_str()) != 0)
+	{
+		THROW_EMU_ERROR("Failed to rename temporary change journal "
+			"from " << TempFilename << " to " << Filename,
+			CommonException, OSFileError);
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreChangeJournal::Remove(
+//			 const BackupStoreAccountDatabase::Entry &)
+//		Purpose: Delete the journal, so that changes are no longer
+//			 recorded and the next housekeeping scans every
+//			 directory.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreChangeJournal::Remove(
+	const BackupStoreAccountDatabase::Entry& rAccount)
+{
+	std::string Filename = GetFilename(rAccount, false);
+	if(FileExists(Filename) && EMU_UNLINK(Filename.c_str()) != 0)
+	{
+		THROW_EMU_FILE_ERROR("Failed to delete change journal",
+			Filename, CommonException, OSFileError);
+	}
+}
@@ -0,0 +1,106 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreChangeJournal.h
+//		Purpose: Journal of the directories changed in an account since
+//			 it was last housekept
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTORECHANGEJOURNAL__H
+#define BACKUPSTORECHANGEJOURNAL__H
+
+#include <memory>
+#include <set>
+#include <string>
+
+#include "BackupStoreAccountDatabase.h"
+#include "FileStream.h"
+
+// set packing to one byte
+#ifdef STRUCTURE_PACKING_FOR_WIRE_USE_HEADERS
+#include "BeginStructPackForWire.h"
+#else
+BEGIN_STRUCTURE_PACKING_FOR_WIRE
+#endif
+
+typedef struct
+{
+	uint32_t mMagicValue;	// also the version number
+	uint32_t mAccountID;
+	int32_t mRunsSinceFullScan;
+} changejournal_StreamFormat;
+
+typedef struct
+{
+	int64_t mObjectID;
+	int64_t mCheck;		// bitwise inverse of mObjectID
+} changejournal_Record;
+
+// Use default packing
+#ifdef STRUCTURE_PACKING_FOR_WIRE_USE_HEADERS
+#include "EndStructPackForWire.h"
+#else
+END_STRUCTURE_PACKING_FOR_WIRE
+#endif
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreChangeJournal
+//		Purpose: Records the ID of every directory written by a client
+//			 session, so that housekeeping can rescan only those
+//			 directories instead of the whole account.
+//
+//			 The journal is only appended to if it already exists.
+//			 Housekeeping creates it empty after scanning the whole
+//			 account, so a missing journal means that changes may
+//			 not have been recorded, and a damaged one cannot be
+//			 trusted. In both cases housekeeping falls back to
+//			 scanning every directory. It also does so every so
+//			 often anyway, in case a change was missed, so the
+//			 journal counts the runs since the last full scan.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreChangeJournal
+{
+public:
+	~BackupStoreChangeJournal();
+private:
+	// Creation through static functions only
+	BackupStoreChangeJournal(const std::string &rFilename,
+		std::auto_ptr<FileStream> apJournalFile);
+	// No copying allowed
+	BackupStoreChangeJournal(const BackupStoreChangeJournal &);
+	BackupStoreChangeJournal &operator=(const BackupStoreChangeJournal &);
+
+public:
+	// Open the journal for appending, or return an empty pointer if
+	// the account doesn't have one.
+	static std::auto_ptr<BackupStoreChangeJournal> OpenForRecording(
+		const BackupStoreAccountDatabase::Entry& rAccount);
+	// Must be called before the directory is written
+	void RecordDirectoryChanged(int64_t ObjectID);
+
+	// Returns false if the journal is missing or damaged
+	static bool Read(const BackupStoreAccountDatabase::Entry& rAccount,
+		std::set<int64_t> &rDirectoriesOut,
+		int32_t &rRunsSinceFullScanOut);
+	static void Reset(const BackupStoreAccountDatabase::Entry& rAccount,
+		int32_t RunsSinceFullScan,
+		const std::set<int64_t> &rStillChanged = std::set<int64_t>());
+	static void Remove(const BackupStoreAccountDatabase::Entry& rAccount);
+
+private:
+	static std::string GetFilename(const BackupStoreAccountDatabase::Entry&
+		rAccount, bool Temporary);
+
+	std::string mFilename;
+	std::auto_ptr<FileStream> mapJournalFile;
+	// Directories already in the journal, which needn't be added again
+	std::set<int64_t> mRecorded;
+};
+
+#endif // BACKUPSTORECHANGEJOURNAL__H
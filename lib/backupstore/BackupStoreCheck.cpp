@@ -12,12 +12,16 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <deque>
+#include <iomanip>
+
 #ifdef HAVE_UNISTD_H
 #	include <unistd.h>
 #endif
 
 #include "autogen_BackupStoreException.h"
 #include "BackupStoreAccountDatabase.h"
+#include "BackupStoreChangeJournal.h"
 #include "BackupStoreCheck.h"
 #include "BackupStoreConstants.h"
 #include "BackupStoreDirectory.h"
@@ -39,21 +43,29 @@
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreCheck::BackupStoreCheck(const std::string &, int, int32_t, bool, bool)
-//		Purpose: Constructor
+//		Name:    BackupStoreCheck::BackupStoreCheck(const std::string &, int, int32_t, bool, bool, int, const std::string &)
+//		Purpose: Constructor. With NumThreads greater than zero,
+//			 objects are read and verified on that many threads
+//			 in phases 1 and 2. If rIndexDirectory is given, the
+//			 index of objects is kept in temporary files there
+//			 rather than in memory.
 //		Created: 21/4/04
 //
 // --------------------------------------------------------------------------
-BackupStoreCheck::BackupStoreCheck(const std::string &rStoreRoot, int DiscSetNumber, int32_t AccountID, bool FixErrors, bool Quiet)
+BackupStoreCheck::BackupStoreCheck(const std::string &rStoreRoot, int DiscSetNumber, int32_t AccountID, bool FixErrors, bool Quiet,
+	int NumThreads, const std::string &rIndexDirectory)
 	: mStoreRoot(rStoreRoot),
 	  mDiscSetNumber(DiscSetNumber),
 	  mAccountID(AccountID),
 	  mFixErrors(FixErrors),
 	  mQuiet(Quiet),
+	  mNumThreads(NumThreads),
+	  mIndexDirectory(rIndexDirectory),
+	  mOperationStartTime(GetCurrentBoxTime()),
+	  mPhaseStartTime(0),
+	  mLastProgressTime(0),
 	  mNumberErrorsFound(0),
 	  mLastIDInInfo(0),
-	  mpInfoLastBlock(0),
-	  mInfoLastBlockEntries(0),
 	  mLostDirNameSerial(0),
 	  mLostAndFoundDirectoryID(0),
 	  mBlocksUsed(0),
@@ -65,7 +77,8 @@ BackupStoreCheck::BackupStoreCheck(const std::string &rStoreRoot, int DiscSetNum
 	  mNumOldFiles(0),
 	  mNumDeletedFiles(0),
 	  mNumDirectories(0),
-	  mOperationStartTime(GetCurrentBoxTime())
+	  mNumFilesFound(0),
+	  mNumDirectoriesFound(0)
 {
 	BackupsList list(RaidFileController::DiscSetPathToFileSystemPath(DiscSetNumber, rStoreRoot, 1));
 	mBackupsList = list;
@@ -131,6 +144,9 @@ void BackupStoreCheck::Check()
 
 	BackupStoreAccountDatabase::Entry account(mAccountID, mDiscSetNumber);
 	mapNewRefs = BackupStoreRefCountDatabase::Create(account);
+	// A reference is added for every object found, so build the counts
+	// in memory and only write the file when committing.
+	mapNewRefs->LoadIntoMemory();
 
 	// Phase 1, check objects
 	if(!mQuiet)
@@ -138,15 +154,26 @@ void BackupStoreCheck::Check()
 		BOX_INFO("Checking store account ID " <<
 			BOX_FORMAT_ACCOUNT(mAccountID) << "...");
 		BOX_INFO("Phase 1, check objects...");
+		if(mNumThreads > 0)
+		{
+			BOX_INFO("Reading objects on " << mNumThreads <<
+				" threads");
+		}
 	}
+	StartPhase();
 	CheckObjects();
+	ReportThroughput("objects", mNumDirectoriesFound + mNumFilesFound,
+		mBlocksUsed);
 
 	// Phase 2, check directories
 	if(!mQuiet)
 	{
 		BOX_INFO("Phase 2, check directories...");
 	}
+	StartPhase();
 	CheckDirectories();
+	ReportThroughput("directories", mNumDirectoriesFound,
+		mBlocksInDirectories);
 
 	// Phase 3, check root
 	if(!mQuiet)
@@ -188,6 +215,7 @@ void BackupStoreCheck::Check()
 		// (temporary) open but not yet committed.
 		std::auto_ptr<BackupStoreRefCountDatabase> apOldRefs =
 			BackupStoreRefCountDatabase::Load(account, false);
+		apOldRefs->LoadIntoMemory();
 
 		// If we have created a new lost+found directory (and thus allocated it a nonzero
 		// object ID) then it's not surprising that the previous refcount DB did not have
@@ -206,6 +234,13 @@ void BackupStoreCheck::Check()
 	if(mFixErrors)
 	{
 		mapNewRefs->Commit();
+
+		// Directories repaired here aren't in the change journal, so
+		// make the next housekeeping scan all of them.
+		if(mNumberErrorsFound > 0)
+		{
+			BackupStoreChangeJournal::Remove(account);
+		}
 	}
 	else
 	{
@@ -253,6 +288,83 @@ void BackupStoreCheck::Check()
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheck::StartPhase()
+//		Purpose: Start timing a phase of the check
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheck::StartPhase()
+{
+	mPhaseStartTime = GetCurrentBoxTime();
+	mLastProgressTime = mPhaseStartTime;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheck::ReportProgress(const char *, int64_t, int64_t)
+//		Purpose: Report how far through the current phase the check
+//			 is, at most once every
+//			 BACKUPSTORECHECK_PROGRESS_INTERVAL seconds
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheck::ReportProgress(const char *What, int64_t Done,
+	int64_t Total)
+{
+	box_time_t now = GetCurrentBoxTime();
+	if(mQuiet || now - mLastProgressTime <
+		SecondsToBoxTime(BACKUPSTORECHECK_PROGRESS_INTERVAL))
+	{
+		return;
+	}
+	mLastProgressTime = now;
+
+	BOX_INFO("Checked " << Done << " of " << Total << " " << What <<
+		" (" << (Total > 0 ? (Done * 100) / Total : 100) << "%) in " <<
+		BoxTimeToSeconds(now - mPhaseStartTime) << " seconds");
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheck::ReportThroughput(const char *, int64_t, int64_t)
+//		Purpose: Report how many objects were read in the current
+//			 phase, and how quickly
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheck::ReportThroughput(const char *What, int64_t Count,
+	int64_t Blocks)
+{
+	if(mQuiet)
+	{
+		return;
+	}
+
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(mDiscSetNumber));
+	int64_t bytes = Blocks * rdiscSet.GetBlockSize();
+
+	uint64_t ms = BoxTimeToMilliSeconds(GetCurrentBoxTime() - mPhaseStartTime);
+	if(ms == 0)
+	{
+		ms = 1;
+	}
+
+	BOX_INFO("Read " << Count << " " << What << " (" <<
+		HumanReadableSize(bytes) << ") in " << (ms / 1000) << "." <<
+		std::setw(3) << std::setfill('0') << (ms % 1000) <<
+		" seconds: " << ((Count * 1000) / ms) << " " << What <<
+		"/s, " << HumanReadableSize((bytes * 1000) / ms) << "/s");
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -327,10 +439,39 @@ void BackupStoreCheck::CheckObjects()
 			BOX_FORMAT_OBJECTID(maxDir));
 	}
 
-	// Then go through and scan all the objects within those directories
-	for(int64_t d = 0; d <= maxDir; d += (1<<STORE_ID_SEGMENT_LENGTH))
+	// No object can have a higher ID than the last one in the last
+	// directory, so the index never needs to grow. The store info is
+	// not used to size it, as it may be one of the things to fix.
+	mIndex.Allocate(maxDir + (1<<STORE_ID_SEGMENT_LENGTH) - 1,
+		mIndexDirectory);
+	BOX_INFO("Using " << mIndex.GetNumBytes() / 1024 << " KB " <<
+		(mIndex.IsInFiles() ? ("of files in " + mIndexDirectory) :
+			std::string("of memory")) <<
+		" to index up to " << mIndex.GetMaxID() << " objects");
+
+	// Then go through and scan all the objects within those directories.
+	// The objects of later directories are queued for reading while there's
+	// room, but everything found is dealt with in order of object ID.
+	BackupStoreCheckReader reader(mDiscSetNumber, mNumThreads,
+		BACKUPSTORECHECK_OBJECTS_PER_THREAD);
+	std::deque<ObjectsDir> dirs;
+	int64_t numDirs = (maxDir >> STORE_ID_SEGMENT_LENGTH) + 1;
+	int64_t dirsChecked = 0;
+	int64_t d = 0;
+
+	while(d <= maxDir || !dirs.empty())
 	{
-		CheckObjectsDir(d);
+		while(d <= maxDir && (dirs.empty() ||
+			reader.HasRoomFor(1<<STORE_ID_SEGMENT_LENGTH)))
+		{
+			dirs.push_back(ObjectsDir());
+			QueueObjectsDir(d, dirs.back(), reader);
+			d += (1<<STORE_ID_SEGMENT_LENGTH);
+		}
+
+		CheckObjectsDir(dirs.front(), reader);
+		dirs.pop_front();
+		ReportProgress("object directories", ++dirsChecked, numDirs);
 	}
 }
 
@@ -417,16 +558,22 @@ int64_t BackupStoreCheck::CheckObjectsScanDir(int64_t StartID, int Level, const
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreCheck::CheckObjectsDir(int64_t)
-//		Purpose: Check all the files within this directory which has
-//			 the given starting ID.
-//		Created: 22/4/04
+//		Name:    BackupStoreCheck::QueueObjectsDir(int64_t, ObjectsDir &, BackupStoreCheckReader &)
+//		Purpose: List the files within the directory which has the
+//			 given starting ID, and queue the objects found there
+//			 with the reader, in order. Nothing is reported or
+//			 fixed until CheckObjectsDir() is called.
+//		Created: 2026/10/18
 //
 // --------------------------------------------------------------------------
-void BackupStoreCheck::CheckObjectsDir(int64_t StartID)
+void BackupStoreCheck::QueueObjectsDir(int64_t StartID, ObjectsDir &rDirOut,
+	BackupStoreCheckReader &rReader)
 {
+	rDirOut.mStartID = StartID;
+	rDirOut.mNumObjects = 0;
+
 	// Make directory name -- first generate the filename of an entry in it
-	std::string dirName;
+	std::string &dirName(rDirOut.mDirName);
 	StoreStructure::MakeObjectFilename(StartID, mStoreRoot, mDiscSetNumber, dirName, false /* don't make sure the dir exists */);
 	// Check expectations
 	ASSERT(dirName.size() > 4 &&
@@ -435,9 +582,9 @@ void BackupStoreCheck::CheckObjectsDir(int64_t StartID)
 	dirName.resize(dirName.size() - 4); // four chars for "/o00"
 
 	// Check directory exists
-	if(!RaidFileRead::DirectoryExists(mDiscSetNumber, dirName))
+	rDirOut.mExists = RaidFileRead::DirectoryExists(mDiscSetNumber, dirName);
+	if(!rDirOut.mExists)
 	{
-		BOX_WARNING("RaidFile dir " << dirName << " does not exist");
 		return;
 	}
 
@@ -472,9 +619,13 @@ void BackupStoreCheck::CheckObjectsDir(int64_t StartID)
 		{
 			fileOK = false;
 		}
-		// info and refcount databases are OK in the root directory
+		// info, refcount and block databases and the change journal
+		// are OK in the root directory
 		else if(*i == "info" || *i == "refcount.db" ||
-			*i == "refcount.rdb" || *i == "refcount.rdbX")
+			*i == "refcount.rdb" || *i == "refcount.rdbX" ||
+			*i == "dirchanges.jnl" || *i == "dirchanges.jnlX" ||
+			*i == "blocks.db" || *i == "blocks.dbX" ||
+			*i == "blocks.dbY")
 		{
 			fileOK = true;
 		}
@@ -485,41 +636,22 @@ void BackupStoreCheck::CheckObjectsDir(int64_t StartID)
 
 		if(!fileOK)
 		{
-			// Unexpected or bad file, delete it
-			BOX_ERROR("Spurious file " << dirName <<
-				DIRECTORY_SEPARATOR << (*i) << " found" <<
-				(mFixErrors?", deleting":""));
-			++mNumberErrorsFound;
-			if(mFixErrors)
-			{
-				RaidFileWrite del(mDiscSetNumber, dirName + DIRECTORY_SEPARATOR + *i);
-				del.Delete();
-			}
+			// Unexpected or bad file, to be deleted
+			rDirOut.mSpuriousFiles.push_back(*i);
 		}
 	}
 
-	// Check all the objects found in this directory
+	// Queue all the objects found in this directory
 	for(int i = 0; i < (1<<STORE_ID_SEGMENT_LENGTH); ++i)
 	{
 		if(idsPresent[i])
 		{
-			// Check the object is OK, and add entry
 			char leaf[8];
 			::snprintf(leaf, sizeof(leaf),
 				DIRECTORY_SEPARATOR "o%02x", i);
-			if(!CheckAndAddObject(StartID | i, dirName + leaf))
-			{
-				// File was bad, delete it
-				BOX_ERROR("Corrupted file " << dirName <<
-					leaf << " found" <<
-					(mFixErrors?", deleting":""));
-				++mNumberErrorsFound;
-				if(mFixErrors)
-				{
-					RaidFileWrite del(mDiscSetNumber, dirName + leaf);
-					del.Delete();
-				}
-			}
+			rReader.Queue(BackupStoreCheckReader::Read_VerifyObject,
+				StartID | i, dirName + leaf);
+			rDirOut.mNumObjects++;
 		}
 	}
 }
@@ -528,85 +660,107 @@ void BackupStoreCheck::CheckObjectsDir(int64_t StartID)
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreCheck::CheckAndAddObject(int64_t,
-//			 const std::string &)
-//		Purpose: Check a specific object and add it to the list
-//			 if it's OK. If there are any errors with the
-//			 reading, return false and it'll be deleted.
-//		Created: 21/4/04
+//		Name:    BackupStoreCheck::CheckObjectsDir(const ObjectsDir &, BackupStoreCheckReader &)
+//		Purpose: Check all the files within a directory listed by
+//			 QueueObjectsDir(), collecting its objects from the
+//			 reader.
+//		Created: 22/4/04
 //
 // --------------------------------------------------------------------------
-bool BackupStoreCheck::CheckAndAddObject(int64_t ObjectID,
-	const std::string &rFilename)
+void BackupStoreCheck::CheckObjectsDir(const ObjectsDir &rDir,
+	BackupStoreCheckReader &rReader)
 {
-	// Info on object...
-	bool isFile = true;
-	int64_t containerID = -1;
-	int64_t size = -1;
+	const std::string &dirName(rDir.mDirName);
 
-	try
+	if(!rDir.mExists)
 	{
-		// Open file
-		std::auto_ptr<RaidFileRead> file(
-			RaidFileRead::Open(mDiscSetNumber, rFilename));
-		size = file->GetDiscUsageInBlocks();
-
-		// Read in first four bytes -- don't have to worry about
-		// retrying if not all bytes read as is RaidFile
-		uint32_t signature;
-		if(file->Read(&signature, sizeof(signature)) != sizeof(signature))
+		BOX_WARNING("RaidFile dir " << dirName << " does not exist");
+		return;
+	}
+
+	for(std::vector<std::string>::const_iterator i(rDir.mSpuriousFiles.begin());
+		i != rDir.mSpuriousFiles.end(); ++i)
+	{
+		// Unexpected or bad file, delete it
+		BOX_ERROR("Spurious file " << dirName <<
+			DIRECTORY_SEPARATOR << (*i) << " found" <<
+			(mFixErrors?", deleting":""));
+		++mNumberErrorsFound;
+		if(mFixErrors)
 		{
-			// Too short, can't read signature from it
-			return false;
+			RaidFileWrite del(mDiscSetNumber, dirName + DIRECTORY_SEPARATOR + *i);
+			del.Delete();
 		}
-		// Seek back to beginning
-		file->Seek(0, IOStream::SeekType_Absolute);
+	}
 
-		// Then... check depending on the type
-		switch(ntohl(signature))
+	// Check all the objects found in this directory
+	for(int i = 0; i < rDir.mNumObjects; ++i)
+	{
+		// Check the object is OK, and add entry
+		std::auto_ptr<BackupStoreCheckReader::Object> apObject(
+			rReader.GetNext());
+		ASSERT((apObject->mObjectID & ~(int64_t)((1<<STORE_ID_SEGMENT_LENGTH) - 1))
+			== rDir.mStartID);
+		if(!CheckAndAddObject(*apObject))
 		{
-		case OBJECTMAGIC_FILE_MAGIC_VALUE_V1:
-#ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
-		case OBJECTMAGIC_FILE_MAGIC_VALUE_V0:
-#endif
-			// File... check
-			containerID = CheckFile(ObjectID, *file);
-			break;
-
-		case OBJECTMAGIC_DIR_MAGIC_VALUE_V1:
-#ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
-		case OBJECTMAGIC_DIR_MAGIC_VALUE_V0:
-#endif			
-			isFile = false;
-			containerID = CheckDirInitial(ObjectID, *file);
-			break;
-
-		default:
-			// Unknown signature. Bad file. Very bad file.
-			return false;
-			break;
+			// File was bad, delete it
+			BOX_ERROR("Corrupted file " << apObject->mFilename <<
+				" found" << (mFixErrors?", deleting":""));
+			++mNumberErrorsFound;
+			if(mFixErrors)
+			{
+				RaidFileWrite del(mDiscSetNumber, apObject->mFilename);
+				del.Delete();
+			}
 		}
 	}
-	catch(...)
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheck::CheckAndAddObject(const BackupStoreCheckReader::Object &)
+//		Purpose: Add an object verified by the reader to the list
+//			 if it's OK. If there were any errors with the
+//			 reading, return false and it'll be deleted.
+//		Created: 21/4/04
+//
+// --------------------------------------------------------------------------
+bool BackupStoreCheck::CheckAndAddObject(
+	const BackupStoreCheckReader::Object &rObject)
+{
+	if(rObject.mResult == BackupStoreCheckReader::Object_Bad)
 	{
-		// Error caught, not a good file then, let it be deleted
 		return false;
 	}
 
-	// Got a container ID? (ie check was successful)
-	if(containerID == -1)
+	bool isFile = (rObject.mResult == BackupStoreCheckReader::Object_File);
+	int64_t size = rObject.mSizeInBlocks;
+	const std::string &rFilename(rObject.mFilename);
+
+	// Check that it's not the root directory ID. Having a file as
+	// the root directory would be bad.
+	if(isFile && rObject.mObjectID == BACKUPSTORE_ROOT_DIRECTORY_ID)
 	{
+		// Get that dodgy thing deleted!
+		BOX_ERROR("Have file as root directory. This is bad.");
 		return false;
 	}
 
 	// Add to list of IDs known about
-	AddID(ObjectID, containerID, size, isFile);
+	AddID(rObject.mObjectID, rObject.mContainerID, size, isFile);
 
 	// Add to usage counts
 	mBlocksUsed += size;
-	if(!isFile)
+	if(isFile)
+	{
+		mNumFilesFound++;
+	}
+	else
 	{
 		mBlocksInDirectories += size;
+		mNumDirectoriesFound++;
 	}
 
 	// If it looks like a good object, and it's non-RAID, and
@@ -654,67 +808,6 @@ bool BackupStoreCheck::CheckAndAddObject(int64_t ObjectID,
 }
 
 
-// --------------------------------------------------------------------------
-//
-// Function
-//		Name:    BackupStoreCheck::CheckFile(int64_t, IOStream &)
-//		Purpose: Do check on file, return original container ID
-//			 if OK, or -1 on error
-//		Created: 22/4/04
-//
-// --------------------------------------------------------------------------
-int64_t BackupStoreCheck::CheckFile(int64_t ObjectID, IOStream &rStream)
-{
-	// Check that it's not the root directory ID. Having a file as
-	// the root directory would be bad.
-	if(ObjectID == BACKUPSTORE_ROOT_DIRECTORY_ID)
-	{
-		// Get that dodgy thing deleted!
-		BOX_ERROR("Have file as root directory. This is bad.");
-		return -1;
-	}
-
-	// Check the format of the file, and obtain the container ID
-	int64_t originalContainerID = -1;
-	if(!BackupStoreFile::VerifyEncodedFileFormat(rStream,
-		0 /* don't want diffing from ID */,
-		&originalContainerID))
-	{
-		// Didn't verify
-		return -1;
-	}
-
-	return originalContainerID;
-}
-
-
-// --------------------------------------------------------------------------
-//
-// Function
-//		Name:    BackupStoreCheck::CheckDirInitial(int64_t, IOStream &)
-//		Purpose: Do initial check on directory, return container ID
-//			 if OK, or -1 on error
-//		Created: 22/4/04
-//
-// --------------------------------------------------------------------------
-int64_t BackupStoreCheck::CheckDirInitial(int64_t ObjectID, IOStream &rStream)
-{
-	// Simply attempt to read in the directory
-	BackupStoreDirectory dir;
-	dir.ReadFromStream(rStream, IOStream::TimeOutInfinite);
-
-	// Check object ID
-	if(dir.GetObjectID() != ObjectID)
-	{
-		// Wrong object ID
-		return -1;
-	}
-
-	// Return container ID
-	return dir.GetContainerID();
-}
-
-
 // --------------------------------------------------------------------------
 //
 // Function
@@ -737,60 +830,88 @@ void BackupStoreCheck::CheckDirectories()
 	// somewhere, so we'll count it here.
 	mNumDirectories++;
 
-	// Scan all objects.
-	for(Info_t::const_iterator i(mInfo.begin()); i != mInfo.end(); ++i)
-	{
-		IDBlock *pblock = i->second;
-		int32_t bentries = (pblock == mpInfoLastBlock)?mInfoLastBlockEntries:BACKUPSTORECHECK_BLOCK_SIZE;
+	// Scan all objects, reading directories ahead while earlier ones
+	// are checked. Checking one directory only changes that directory,
+	// so reading the later ones early makes no difference to them.
+	BackupStoreCheckReader reader(mDiscSetNumber, mNumThreads,
+		BACKUPSTORECHECK_DIRECTORIES_PER_THREAD);
+	BackupStoreCheck_ID_t id = mIndex.GetNextID(0);
+	int64_t dirsChecked = 0;
 
-		for(int e = 0; e < bentries; ++e)
+	while(true)
+	{
+		while(id != 0 &&
+			(reader.GetNumQueued() == 0 || reader.HasRoomFor(1)))
 		{
-			uint8_t flags = GetFlags(pblock, e);
+			uint8_t flags = mIndex.GetFlags(id);
 			if(flags & Flags_IsDir)
 			{
 				// Found a directory. Read it in.
 				std::string filename;
-				StoreStructure::MakeObjectFilename(pblock->mID[e], mStoreRoot, mDiscSetNumber, filename, false /* no dir creation */);
-				BackupStoreDirectory dir;
-				{
-					std::auto_ptr<RaidFileRead> file(RaidFileRead::Open(mDiscSetNumber, filename));
-					dir.ReadFromStream(*file, IOStream::TimeOutInfinite);
-				}
-				
-				// Flag for modifications
-				bool isModified = CheckDirectory(dir);
+				StoreStructure::MakeObjectFilename(id, mStoreRoot, mDiscSetNumber, filename, false /* no dir creation */);
+				reader.Queue(BackupStoreCheckReader::Read_Directory,
+					id, filename);
+			}
+			id = mIndex.GetNextID(id);
+		}
 
-				// Check the directory again, now that entries have been removed
-				if(dir.CheckAndFix())
-				{
-					// Wasn't quite right, and has been modified
-					BOX_ERROR("Directory ID " <<
-						BOX_FORMAT_OBJECTID(pblock->mID[e]) <<
-						" was still bad after all checks");
-					++mNumberErrorsFound;
-					isModified = true;
-				}
-				else if(isModified)
-				{
-					BOX_INFO("Directory ID " <<
-						BOX_FORMAT_OBJECTID(pblock->mID[e]) <<
-						" was OK after fixing");
-				}
+		if(reader.GetNumQueued() == 0)
+		{
+			break;
+		}
 
-				if(isModified && mFixErrors)
-				{
-					BOX_WARNING("Writing modified directory to disk: " <<
-						BOX_FORMAT_OBJECTID(pblock->mID[e]));
-					RaidFileWrite fixed(mDiscSetNumber, filename);
-					fixed.Open(true /* allow overwriting */);
-					dir.WriteToStream(fixed);
-					fixed.Commit(true /* convert to raid representation now */);
-				}
+		std::auto_ptr<BackupStoreCheckReader::Object> apObject(
+			reader.GetNext());
+		CheckDirectoryObject(*apObject);
+		ReportProgress("directories", ++dirsChecked,
+			mNumDirectoriesFound);
+	}
+}
 
-				CountDirectoryEntries(dir);
-			}
-		}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheck::CheckDirectoryObject(BackupStoreCheckReader::Object &)
+//		Purpose: Check and fix a directory read in by the reader
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheck::CheckDirectoryObject(BackupStoreCheckReader::Object &rObject)
+{
+	BackupStoreDirectory &dir(*rObject.mapDirectory);
+
+	// Flag for modifications
+	bool isModified = CheckDirectory(dir);
+
+	// Check the directory again, now that entries have been removed
+	if(dir.CheckAndFix())
+	{
+		// Wasn't quite right, and has been modified
+		BOX_ERROR("Directory ID " <<
+			BOX_FORMAT_OBJECTID(rObject.mObjectID) <<
+			" was still bad after all checks");
+		++mNumberErrorsFound;
+		isModified = true;
 	}
+	else if(isModified)
+	{
+		BOX_INFO("Directory ID " <<
+			BOX_FORMAT_OBJECTID(rObject.mObjectID) <<
+			" was OK after fixing");
+	}
+
+	if(isModified && mFixErrors)
+	{
+		BOX_WARNING("Writing modified directory to disk: " <<
+			BOX_FORMAT_OBJECTID(rObject.mObjectID));
+		RaidFileWrite fixed(mDiscSetNumber, rObject.mFilename);
+		fixed.Open(true /* allow overwriting */);
+		dir.WriteToStream(fixed);
+		fixed.Commit(true /* convert to raid representation now */);
+	}
+
+	CountDirectoryEntries(dir);
 }
 
 bool BackupStoreCheck::CheckDirectory(BackupStoreDirectory& dir)
@@ -821,10 +942,8 @@ bool BackupStoreCheck::CheckDirectory(BackupStoreDirectory& dir)
 		while((en = i.Next()) != 0)
 		{
 			// Lookup the item
-			int32_t iIndex;
-			IDBlock *piBlock = LookupID(en->GetObjectID(), iIndex);
 			bool badEntry = false;
-			if(piBlock != 0)
+			if(mIndex.Contains(en->GetObjectID()))
 			{
 				badEntry = !CheckDirectoryEntry(*en,
 					dir.GetObjectID(), isModified);
@@ -886,25 +1005,25 @@ void BackupStoreCheck::CountDirectoryEntries(BackupStoreDirectory& dir)
 	BackupStoreDirectory::Entry *en = 0;
 	while((en = i.Next()) != 0)
 	{
-		int32_t iIndex;
-		IDBlock *piBlock = LookupID(en->GetObjectID(), iIndex);
+		BackupStoreCheck_ID_t id = en->GetObjectID();
+		bool inIndex = mIndex.Contains(id);
 		bool badEntry = false;
 		bool wasAlreadyContained = false;
 
-		ASSERT(piBlock != 0 ||
+		ASSERT(inIndex ||
 			mDirsWhichContainLostDirs.find(en->GetObjectID())
 			!= mDirsWhichContainLostDirs.end());
 
-		if (piBlock)
+		if (inIndex)
 		{
 			// Normally it would exist and this
 			// check would not be necessary, but
 			// we might have missing directories
 			// that we will recreate later.
 			// cf mDirsWhichContainLostDirs.
-			uint8_t iflags = GetFlags(piBlock, iIndex);
+			uint8_t iflags = mIndex.GetFlags(id);
 			wasAlreadyContained = (iflags & Flags_IsContained);
-			SetFlags(piBlock, iIndex, iflags | Flags_IsContained);
+			mIndex.SetFlags(id, Flags_IsContained);
 		}
 
 		if(wasAlreadyContained)
@@ -925,9 +1044,9 @@ void BackupStoreCheck::CountDirectoryEntries(BackupStoreDirectory& dir)
 		else // it's a file
 		{
 			// Add to sizes?
-			// If piBlock was zero, then wasAlreadyContained
+			// If inIndex was false, then wasAlreadyContained
 			// might be uninitialized; but we only process
-			// files here, and if a file's piBlock was zero
+			// files here, and if a file's inIndex was false
 			// then badEntry would be set above, so we
 			// wouldn't be here.
 			ASSERT(!badEntry)
@@ -969,11 +1088,10 @@ void BackupStoreCheck::CountDirectoryEntries(BackupStoreDirectory& dir)
 bool BackupStoreCheck::CheckDirectoryEntry(BackupStoreDirectory::Entry& rEntry,
 	int64_t DirectoryID, bool& rIsModified)
 {
-	int32_t IndexInDirBlock;
-	IDBlock *piBlock = LookupID(rEntry.GetObjectID(), IndexInDirBlock);
-	ASSERT(piBlock != 0);
+	BackupStoreCheck_ID_t id = rEntry.GetObjectID();
+	ASSERT(mIndex.Contains(id));
 
-	uint8_t iflags = GetFlags(piBlock, IndexInDirBlock);
+	uint8_t iflags = mIndex.GetFlags(id);
 
 
 	
@@ -1008,7 +1126,7 @@ bool BackupStoreCheck::CheckDirectoryEntry(BackupStoreDirectory::Entry& rEntry,
 	// the directory and removing all bad entries.
 	
 	// Check that the container ID of the object is correct
-	if(piBlock->mContainer[IndexInDirBlock] != DirectoryID)
+	if(mIndex.GetContainer(id) != DirectoryID)
 	{
 		// Needs fixing...
 		if(iflags & Flags_IsDir)
@@ -1030,27 +1148,25 @@ bool BackupStoreCheck::CheckDirectoryEntry(BackupStoreDirectory::Entry& rEntry,
 		}
 		
 		// Fix entry for now
-		piBlock->mContainer[IndexInDirBlock] = DirectoryID;
+		mIndex.SetContainer(id, DirectoryID);
 	}
 
 	// Check the object size
-	if(rEntry.GetSizeInBlocks() != piBlock->mObjectSizeInBlocks[IndexInDirBlock])
+	if(rEntry.GetSizeInBlocks() != mIndex.GetSizeInBlocks(id))
 	{
 		// Wrong size, correct it.
 		BOX_ERROR("Directory " << BOX_FORMAT_OBJECTID(DirectoryID) <<
 			" entry for " << BOX_FORMAT_OBJECTID(rEntry.GetObjectID()) <<
 			" has wrong size " << rEntry.GetSizeInBlocks() <<
-			", should be " << piBlock->mObjectSizeInBlocks[IndexInDirBlock]);
+			", should be " << mIndex.GetSizeInBlocks(id));
 
-		rEntry.SetSizeInBlocks(piBlock->mObjectSizeInBlocks[IndexInDirBlock]);
+		rEntry.SetSizeInBlocks(mIndex.GetSizeInBlocks(id));
 
 		// Mark as changed
 		rIsModified = true;
 		++mNumberErrorsFound;
 	}
 
-	EMU_STRUCT_STAT file_st = GetObjectStat(DirectoryID);
-
 	if ( rEntry.GetBackupTime()==0 )
 	{
 		SessionInfos *firstSession = mBackupsList.GetFirst();
@@ -1116,23 +1232,3 @@ bool BackupStoreCheck::CheckDirectoryEntry(BackupStoreDirectory::Entry& rEntry,
 
 	return true; // don't delete this entry
 }
-
-
-EMU_STRUCT_STAT BackupStoreCheck::GetObjectStat(int64_t objectID)
-{
-	std::string dirName;
-	StoreStructure::MakeObjectFilename(objectID, mStoreRoot, mDiscSetNumber, dirName, false /* don't make sure the dir exists */);
-
-	EMU_STRUCT_STAT file_st;
-	RaidFileController &rcontroller(RaidFileController::GetController());
-	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(mDiscSetNumber));
-
-	std::string writeFilename(RaidFileUtil::MakeWriteFileName(rdiscSet, dirName));
-
-	if(EMU_LSTAT(writeFilename.c_str(), &file_st) != 0) {
-			THROW_SYS_FILE_ERROR("Failed to stat file", writeFilename,
-				RaidFileException, OSError);
-	}
-
-	return file_st;
-}
\ No newline at end of file
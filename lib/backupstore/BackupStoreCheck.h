@@ -16,6 +16,8 @@
 #include <set>
 
 #include "NamedLock.h"
+#include "BackupStoreCheckIndex.h"
+#include "BackupStoreCheckReader.h"
 #include "BackupStoreDirectory.h"
 #include "BackupsList.h"
 
@@ -52,17 +54,15 @@ The following problems can be fixed:
 */
 
 
-// Size of blocks in the list of IDs
-#ifdef BOX_RELEASE_BUILD
-	#define BACKUPSTORECHECK_BLOCK_SIZE		(64*1024)
-#else
-	#define BACKUPSTORECHECK_BLOCK_SIZE		8
-#endif
+// Number of objects read ahead for each thread in phase 1, which is a
+// whole directory of the store
+#define BACKUPSTORECHECK_OBJECTS_PER_THREAD	256
+// and the number of directories read ahead for each thread in phase 2,
+// which are held in memory until checked
+#define BACKUPSTORECHECK_DIRECTORIES_PER_THREAD	16
 
-// The object ID type -- can redefine to uint32_t to produce a lower memory version for smaller stores
-typedef int64_t BackupStoreCheck_ID_t;
-// Can redefine the size type for lower memory usage too
-typedef int64_t BackupStoreCheck_Size_t;
+// Seconds between progress reports in the longer phases
+#define BACKUPSTORECHECK_PROGRESS_INTERVAL	60
 
 // --------------------------------------------------------------------------
 //
@@ -75,13 +75,13 @@ typedef int64_t BackupStoreCheck_Size_t;
 class BackupStoreCheck
 {
 public:
-	BackupStoreCheck(const std::string &rStoreRoot, int DiscSetNumber, int32_t AccountID, bool FixErrors, bool Quiet);
+	BackupStoreCheck(const std::string &rStoreRoot, int DiscSetNumber, int32_t AccountID, bool FixErrors, bool Quiet,
+		int NumThreads = 0, const std::string &rIndexDirectory = "");
 	~BackupStoreCheck();
 private:
 	// no copying
 	BackupStoreCheck(const BackupStoreCheck &);
 	BackupStoreCheck &operator=(const BackupStoreCheck &);
-	EMU_STRUCT_STAT GetObjectStat(int64_t objectID );
 
 public:
 
@@ -99,25 +99,9 @@ private:
 	{
 		// Bit mask
 		Flags_IsDir = 1,
-		Flags_IsContained = 2,
-		// Mask
-		Flags__MASK = 3,
-		// Number of bits
-		Flags__NumFlags = 2,
-		// Items per uint8_t
-		Flags__NumItemsPerEntry = 4	// ie 8 / 2
+		Flags_IsContained = 2
 	};
 
-	typedef struct
-	{
-		// Note use arrays within the block, rather than the more obvious array of
-		// objects, to be more memory efficient -- think alignment of the byte values.
-		uint8_t mFlags[BACKUPSTORECHECK_BLOCK_SIZE * Flags__NumFlags / Flags__NumItemsPerEntry];
-		BackupStoreCheck_ID_t mID[BACKUPSTORECHECK_BLOCK_SIZE];
-		BackupStoreCheck_ID_t mContainer[BACKUPSTORECHECK_BLOCK_SIZE];
-		BackupStoreCheck_Size_t mObjectSizeInBlocks[BACKUPSTORECHECK_BLOCK_SIZE];
-	} IDBlock;
-	
 	// Phases of the check
 	void CheckObjects();
 	void CheckDirectories();
@@ -128,16 +112,35 @@ private:
 	void WriteNewStoreInfo();
 	void WriteNewBackupsList();
 	
+	// The contents of one directory of objects in the store, listed
+	// while the objects of earlier directories are still being read
+	typedef struct
+	{
+		int64_t mStartID;
+		std::string mDirName;
+		bool mExists;
+		std::vector<std::string> mSpuriousFiles;
+		// Number of objects queued with the reader
+		int mNumObjects;
+	} ObjectsDir;
+
 	// Checking functions
 	int64_t CheckObjectsScanDir(int64_t StartID, int Level, const std::string &rDirName);
-	void CheckObjectsDir(int64_t StartID);
-	bool CheckAndAddObject(int64_t ObjectID, const std::string &rFilename);
+	void QueueObjectsDir(int64_t StartID, ObjectsDir &rDirOut,
+		BackupStoreCheckReader &rReader);
+	void CheckObjectsDir(const ObjectsDir &rDir,
+		BackupStoreCheckReader &rReader);
+	bool CheckAndAddObject(const BackupStoreCheckReader::Object &rObject);
+	void CheckDirectoryObject(BackupStoreCheckReader::Object &rObject);
 	bool CheckDirectory(BackupStoreDirectory& dir);
 	bool CheckDirectoryEntry(BackupStoreDirectory::Entry& rEntry,
 		int64_t DirectoryID, bool& rIsModified);
 	void CountDirectoryEntries(BackupStoreDirectory& dir);
-	int64_t CheckFile(int64_t ObjectID, IOStream &rStream);
-	int64_t CheckDirInitial(int64_t ObjectID, IOStream &rStream);
+
+	// Progress reports
+	void StartPhase();
+	void ReportProgress(const char *What, int64_t Done, int64_t Total);
+	void ReportThroughput(const char *What, int64_t Count, int64_t Blocks);
 
 	// Fixing functions
 	bool TryToRecreateDirectory(int64_t MissingDirectoryID);
@@ -148,23 +151,6 @@ private:
 	// Data handling
 	void FreeInfo();
 	void AddID(BackupStoreCheck_ID_t ID, BackupStoreCheck_ID_t Container, BackupStoreCheck_Size_t ObjectSize, bool IsFile);
-	IDBlock *LookupID(BackupStoreCheck_ID_t ID, int32_t &rIndexOut);
-	inline void SetFlags(IDBlock *pBlock, int32_t Index, uint8_t Flags)
-	{
-		ASSERT(pBlock != 0);
-		ASSERT(Index < BACKUPSTORECHECK_BLOCK_SIZE);
-		ASSERT(Flags < (1 << Flags__NumFlags));
-		
-		pBlock->mFlags[Index / Flags__NumItemsPerEntry]
-			|= (Flags << ((Index % Flags__NumItemsPerEntry) * Flags__NumFlags));
-	}
-	inline uint8_t GetFlags(IDBlock *pBlock, int32_t Index)
-	{
-		ASSERT(pBlock != 0);
-		ASSERT(Index < BACKUPSTORECHECK_BLOCK_SIZE);
-
-		return (pBlock->mFlags[Index / Flags__NumItemsPerEntry] >> ((Index % Flags__NumItemsPerEntry) * Flags__NumFlags)) & Flags__MASK;
-	}
 	
 #ifndef BOX_RELEASE_BUILD
 	void DumpObjectInfo();
@@ -181,10 +167,14 @@ private:
 	int32_t mOptions;
 	bool mFixErrors;
 	bool mQuiet;
+	int mNumThreads;
+	std::string mIndexDirectory;
 	BackupsList mBackupsList;
 	SessionInfos mNewSessionsInfos; 
 
 	box_time_t mOperationStartTime;
+	box_time_t mPhaseStartTime;
+	box_time_t mLastProgressTime;
 	
 	int64_t mNumberErrorsFound;
 	
@@ -192,11 +182,8 @@ private:
 	NamedLock mAccountLock;
 	
 	// Storage for ID data
-	typedef std::map<BackupStoreCheck_ID_t, IDBlock*> Info_t;
-	Info_t mInfo;
+	BackupStoreCheckIndex mIndex;
 	BackupStoreCheck_ID_t mLastIDInInfo;
-	IDBlock *mpInfoLastBlock;
-	int32_t mInfoLastBlockEntries;
 	
 	// List of stuff to fix
 	std::vector<BackupStoreCheck_ID_t> mDirsWithWrongContainerID;
@@ -224,6 +211,10 @@ private:
 	int64_t mNumOldFiles;
 	int64_t mNumDeletedFiles;
 	int64_t mNumDirectories;
+	// Objects which passed phase 1; the directories are read again
+	// in phase 2
+	int64_t mNumFilesFound;
+	int64_t mNumDirectoriesFound;
 };
 
 #endif // BACKUPSTORECHECK__H
@@ -40,13 +40,10 @@
 // --------------------------------------------------------------------------
 void BackupStoreCheck::CheckRoot()
 {
-	int32_t index = 0;
-	IDBlock *pblock = LookupID(BACKUPSTORE_ROOT_DIRECTORY_ID, index);
-
-	if(pblock != 0)
+	if(mIndex.Contains(BACKUPSTORE_ROOT_DIRECTORY_ID))
 	{
 		// Found it. Which is lucky. Mark it as contained.
-		SetFlags(pblock, index, Flags_IsContained);
+		mIndex.SetFlags(BACKUPSTORE_ROOT_DIRECTORY_ID, Flags_IsContained);
 	}
 	else
 	{
@@ -129,140 +126,134 @@ void BackupStoreCheck::CheckUnattachedObjects()
 	fixers_t fixers;
 
 	// Scan all objects, finding ones which have no container
-	for(Info_t::const_iterator i(mInfo.begin()); i != mInfo.end(); ++i)
+	for(BackupStoreCheck_ID_t id = mIndex.GetNextID(0); id != 0;
+		id = mIndex.GetNextID(id))
 	{
-		IDBlock *pblock = i->second;
-		int32_t bentries = (pblock == mpInfoLastBlock)?mInfoLastBlockEntries:BACKUPSTORECHECK_BLOCK_SIZE;
-
-		for(int e = 0; e < bentries; ++e)
+		uint8_t flags = mIndex.GetFlags(id);
+		if((flags & Flags_IsContained) == 0)
 		{
-			uint8_t flags = GetFlags(pblock, e);
-			if((flags & Flags_IsContained) == 0)
-			{
-				// Unattached object...
-				int64_t ObjectID = pblock->mID[e];
-				BOX_ERROR("Object " <<
-					BOX_FORMAT_OBJECTID(ObjectID) <<
-					" is unattached.");
-				++mNumberErrorsFound;
+			// Unattached object...
+			int64_t ObjectID = id;
+			BOX_ERROR("Object " <<
+				BOX_FORMAT_OBJECTID(ObjectID) <<
+				" is unattached.");
+			++mNumberErrorsFound;
 
-				// What's to be done?
-				int64_t putIntoDirectoryID = 0;
+			// What's to be done?
+			int64_t putIntoDirectoryID = 0;
 
-				if((flags & Flags_IsDir) == Flags_IsDir)
-				{
-					// Directory. Just put into lost and found.
-					// (It doesn't contain its filename, so we
-					// can't recreate the entry in the parent)
-					putIntoDirectoryID = GetLostAndFoundDirID();
-				}
-				else
+			if((flags & Flags_IsDir) == Flags_IsDir)
+			{
+				// Directory. Just put into lost and found.
+				// (It doesn't contain its filename, so we
+				// can't recreate the entry in the parent)
+				putIntoDirectoryID = GetLostAndFoundDirID();
+			}
+			else
+			{
+				// File. Only attempt to attach it somewhere if it isn't a patch
 				{
-					// File. Only attempt to attach it somewhere if it isn't a patch
+					int64_t diffFromObjectID = 0;
+					std::string filename;
+					StoreStructure::MakeObjectFilename(ObjectID,
+						mStoreRoot, mDiscSetNumber, filename,
+						false /* don't attempt to make sure the dir exists */);
+
+					// The easiest way to do this is to verify it again. Not such a bad penalty, because
+					// this really shouldn't be done very often.
 					{
-						int64_t diffFromObjectID = 0;
-						std::string filename;
-						StoreStructure::MakeObjectFilename(ObjectID,
-							mStoreRoot, mDiscSetNumber, filename,
-							false /* don't attempt to make sure the dir exists */);
-
-						// The easiest way to do this is to verify it again. Not such a bad penalty, because
-						// this really shouldn't be done very often.
-						{
-							std::auto_ptr<RaidFileRead> file(RaidFileRead::Open(mDiscSetNumber, filename));
-							BackupStoreFile::VerifyEncodedFileFormat(*file, &diffFromObjectID);
-						}
-
-						// If not zero, then it depends on another file, which may or may not be available.
-						// Just delete it to be safe.
-						if(diffFromObjectID != 0)
-						{
-							BOX_WARNING("Object " << BOX_FORMAT_OBJECTID(ObjectID) << " is unattached, and is a patch. Deleting, cannot reliably recover.");
-
-							// Delete this object instead
-							if(mFixErrors)
-							{
-								RaidFileWrite del(mDiscSetNumber, filename);
-								del.Delete();
-							}
-
-							mBlocksUsed -= pblock->mObjectSizeInBlocks[e];
-
-							// Move on to next item
-							continue;
-						}
+						std::auto_ptr<RaidFileRead> file(RaidFileRead::Open(mDiscSetNumber, filename));
+						BackupStoreFile::VerifyEncodedFileFormat(*file, &diffFromObjectID);
 					}
 
-					// Files contain their original filename, so perhaps the orginal directory still exists,
-					// or we can infer the existance of a directory?
-					// Look for a matching entry in the mDirsWhichContainLostDirs map.
-					// Can't do this with a directory, because the name just wouldn't be known, which is
-					// pretty useless as bbackupd would just delete it. So better to put it in lost+found
-					// where the admin can do something about it.
-					int32_t dirindex;
-					IDBlock *pdirblock = LookupID(pblock->mContainer[e], dirindex);
-					if(pdirblock != 0)
+					// If not zero, then it depends on another file, which may or may not be available.
+					// Just delete it to be safe.
+					if(diffFromObjectID != 0)
 					{
-						// Something with that ID has been found. Is it a directory?
-						if(GetFlags(pdirblock, dirindex) & Flags_IsDir)
-						{
-							// Directory exists, add to that one
-							putIntoDirectoryID = pblock->mContainer[e];
-						}
-						else
+						BOX_WARNING("Object " << BOX_FORMAT_OBJECTID(ObjectID) << " is unattached, and is a patch. Deleting, cannot reliably recover.");
+
+						// Delete this object instead
+						if(mFixErrors)
 						{
-							// Not a directory. Use lost and found dir
-							putIntoDirectoryID = GetLostAndFoundDirID();
+							RaidFileWrite del(mDiscSetNumber, filename);
+							del.Delete();
 						}
+
+						mBlocksUsed -= mIndex.GetSizeInBlocks(id);
+
+						// Move on to next item
+						continue;
 					}
-					else if(mDirsAdded.find(pblock->mContainer[e]) != mDirsAdded.end()
-						|| TryToRecreateDirectory(pblock->mContainer[e]))
+				}
+
+				// Files contain their original filename, so perhaps the orginal directory still exists,
+				// or we can infer the existance of a directory?
+				// Look for a matching entry in the mDirsWhichContainLostDirs map.
+				// Can't do this with a directory, because the name just wouldn't be known, which is
+				// pretty useless as bbackupd would just delete it. So better to put it in lost+found
+				// where the admin can do something about it.
+				BackupStoreCheck_ID_t containerID = mIndex.GetContainer(id);
+				if(mIndex.Contains(containerID))
+				{
+					// Something with that ID has been found. Is it a directory?
+					if(mIndex.GetFlags(containerID) & Flags_IsDir)
 					{
-						// The directory reappeared, or was created somehow elsewhere
-						putIntoDirectoryID = pblock->mContainer[e];
+						// Directory exists, add to that one
+						putIntoDirectoryID = containerID;
 					}
 					else
 					{
+						// Not a directory. Use lost and found dir
 						putIntoDirectoryID = GetLostAndFoundDirID();
 					}
 				}
-				ASSERT(putIntoDirectoryID != 0);
-
-				if (!mFixErrors)
+				else if(mDirsAdded.find(containerID) != mDirsAdded.end()
+					|| TryToRecreateDirectory(containerID))
 				{
-					continue;
-				}
-
-				BackupStoreDirectoryFixer* pFixer;
-				fixers_t::iterator fi = 
-					fixers.find(putIntoDirectoryID);
-				if (fi == fixers.end())
-				{
-					// no match, create a new one
-					pFixer = new BackupStoreDirectoryFixer(
-						mStoreRoot, mDiscSetNumber,
-						putIntoDirectoryID);
-					fixers.insert(fixer_pair_t(
-						putIntoDirectoryID, pFixer));
+					// The directory reappeared, or was created somehow elsewhere
+					putIntoDirectoryID = containerID;
 				}
 				else
 				{
-					pFixer = fi->second;
+					putIntoDirectoryID = GetLostAndFoundDirID();
 				}
+			}
+			ASSERT(putIntoDirectoryID != 0);
 
-				int32_t lostDirNameSerial = 0;
+			if (!mFixErrors)
+			{
+				continue;
+			}
 
-				if(flags & Flags_IsDir)
-				{
-					lostDirNameSerial = mLostDirNameSerial++;
-				}
+			BackupStoreDirectoryFixer* pFixer;
+			fixers_t::iterator fi = 
+				fixers.find(putIntoDirectoryID);
+			if (fi == fixers.end())
+			{
+				// no match, create a new one
+				pFixer = new BackupStoreDirectoryFixer(
+					mStoreRoot, mDiscSetNumber,
+					putIntoDirectoryID);
+				fixers.insert(fixer_pair_t(
+					putIntoDirectoryID, pFixer));
+			}
+			else
+			{
+				pFixer = fi->second;
+			}
+
+			int32_t lostDirNameSerial = 0;
 
-				// Add it to the directory
-				pFixer->InsertObject(ObjectID,
-					((flags & Flags_IsDir) == Flags_IsDir),
-					lostDirNameSerial);
-				mapNewRefs->AddReference(ObjectID);
+			if(flags & Flags_IsDir)
+			{
+				lostDirNameSerial = mLostDirNameSerial++;
 			}
+
+			// Add it to the directory
+			pFixer->InsertObject(ObjectID,
+				((flags & Flags_IsDir) == Flags_IsDir),
+				lostDirNameSerial);
+			mapNewRefs->AddReference(ObjectID);
 		}
 	}
 
@@ -501,9 +492,7 @@ void BackupStoreCheck::FixDirsWithWrongContainerID()
 	for(std::vector<BackupStoreCheck_ID_t>::iterator i(mDirsWithWrongContainerID.begin());
 			i != mDirsWithWrongContainerID.end(); ++i)
 	{
-		int32_t index = 0;
-		IDBlock *pblock = LookupID(*i, index);
-		if(pblock == 0) continue;
+		if(!mIndex.Contains(*i)) continue;
 
 		// Load in
 		BackupStoreDirectory dir;
@@ -515,7 +504,7 @@ void BackupStoreCheck::FixDirsWithWrongContainerID()
 		}
 
 		// Adjust container ID
-		dir.SetContainerID(pblock->mContainer[index]);
+		dir.SetContainerID(mIndex.GetContainer(*i));
 
 		// Write it out
 		RaidFileWrite root(mDiscSetNumber, filename);
@@ -546,9 +535,7 @@ void BackupStoreCheck::FixDirsWithLostDirs()
 	for(std::map<BackupStoreCheck_ID_t, BackupStoreCheck_ID_t>::iterator i(mDirsWhichContainLostDirs.begin());
 			i != mDirsWhichContainLostDirs.end(); ++i)
 	{
-		int32_t index = 0;
-		IDBlock *pblock = LookupID(i->second, index);
-		if(pblock == 0) continue;
+		if(!mIndex.Contains(i->second)) continue;
 
 		// Load in
 		BackupStoreDirectory dir;
@@ -844,6 +831,24 @@ bool BackupStoreDirectory::CheckAndFix()
 				changed = true;
 			}
 
+			// A patch from an older version is no use without it
+			if((*i)->IsPatchFromOlder() &&
+				((*i)->GetDependsOlder() == 0 ||
+				 FindEntryByID((*i)->GetDependsOlder()) == 0))
+			{
+				BOX_WARNING("Entry id " << FMT_i <<
+					" removed because it is a patch from "
+					"older version " <<
+					FMT_OID((*i)->GetDependsOlder()) <<
+					" which doesn't exist");
+
+				DeleteEntryObject(*i);
+				mEntries.erase(i);
+				changed = true;
+				restart = true;
+				break;
+			}
+
 			if(dependsNewer != 0)
 			{
 				BackupStoreDirectory::Entry *newerEn = FindEntryByID(dependsNewer);
@@ -858,7 +863,7 @@ bool BackupStoreDirectory::CheckAndFix()
 						" which doesn't exist");
 
 					// Remove
-					delete *i;
+					DeleteEntryObject(*i);
 					mEntries.erase(i);
 
 					// Mark as changed
@@ -1016,7 +1021,7 @@ bool BackupStoreDirectory::CheckAndFix()
 				mEntries.erase(i);
 
 				// And delete the entry object
-				delete pentry;
+				DeleteEntryObject(pentry);
 
 				// Stop going around this loop, as the iterator is now invalid
 				break;
@@ -1084,7 +1089,7 @@ bool BackupStoreDirectory::NameInUse(const BackupStoreFilename &rName)
 {
 	for(std::vector<Entry*>::iterator i(mEntries.begin()); i != mEntries.end(); ++i)
 	{
-		if((*i)->GetName() == rName)
+		if((*i)->NameMatches(rName))
 		{
 			return true;
 		}
@@ -0,0 +1,422 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreCheckIndex.cpp
+//		Purpose: Compact index of the objects found by BackupStoreCheck
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#	include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#	include <sys/mman.h>
+#endif
+
+#include <new>
+#include <vector>
+
+#include "BackupStoreCheckIndex.h"
+#include "CommonException.h"
+
+#include "MemLeakFindOn.h"
+
+// Stored in a slot when the real value is in one of the overflow maps
+#define CONTAINER_DELTA_OVERFLOW	INT32_MIN
+#define SIZE_OVERFLOW			UINT32_MAX
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Array::Array()
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckIndex::Array::Array()
+: mpData(0),
+  mSize(0),
+  mFileHandle(-1)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Array::~Array()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckIndex::Array::~Array()
+{
+	Free();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Array::Free()
+//		Purpose: Frees the memory, and closes the file, which
+//			 deletes it
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Array::Free()
+{
+#ifdef HAVE_SYS_MMAN_H
+	if(mFileHandle != -1)
+	{
+		if(mpData != 0)
+		{
+			::munmap(mpData, mSize);
+		}
+		::close(mFileHandle);
+		mFileHandle = -1;
+	}
+	else
+#endif
+	if(mpData != 0)
+	{
+		::free(mpData);
+	}
+
+	mpData = 0;
+	mSize = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Array::Resize(size_t, const std::string &)
+//		Purpose: Grows the array to the given size, zeroing the new
+//			 part. If a directory is given, the array is kept in
+//			 a temporary file there which is mapped into memory.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Array::Resize(size_t Size,
+	const std::string &rFileDirectory)
+{
+	ASSERT(Size >= mSize);
+	if(Size == mSize)
+	{
+		return;
+	}
+
+	if(rFileDirectory.empty())
+	{
+		void *pnew = ::realloc(mpData, Size);
+		if(pnew == 0)
+		{
+			throw std::bad_alloc();
+		}
+		::memset(((uint8_t *)pnew) + mSize, 0, Size - mSize);
+		mpData = pnew;
+		mSize = Size;
+		return;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	if(mFileHandle == -1)
+	{
+		std::string filename(rFileDirectory + DIRECTORY_SEPARATOR
+			"bbstoreaccounts-check-XXXXXX");
+		std::vector<char> name(filename.begin(), filename.end());
+		name.push_back('\0');
+
+		mFileHandle = ::mkstemp(&name[0]);
+		if(mFileHandle == -1)
+		{
+			THROW_SYS_FILE_ERROR("Failed to create temporary "
+				"file for the check index", filename,
+				CommonException, OSFileOpenError);
+		}
+
+		// Nobody else needs to see it, and it's deleted when closed
+		::unlink(&name[0]);
+	}
+
+	// Zero-filled by the filesystem, and sparse until used
+	if(::ftruncate(mFileHandle, Size) != 0)
+	{
+		THROW_SYS_ERROR("Failed to resize temporary file for the "
+			"check index to " << Size << " bytes",
+			CommonException, OSFileWriteError);
+	}
+
+	if(mpData != 0)
+	{
+		::munmap(mpData, mSize);
+		mpData = 0;
+	}
+	mSize = Size;
+
+	void *pmapped = ::mmap(0, Size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		mFileHandle, 0);
+	if(pmapped == MAP_FAILED)
+	{
+		THROW_SYS_ERROR("Failed to map temporary file for the check "
+			"index into memory", CommonException, OSFileError);
+	}
+	mpData = pmapped;
+#else
+	THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+		"Keeping the check index in files is not supported on "
+		"this platform");
+#endif
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::BackupStoreCheckIndex()
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckIndex::BackupStoreCheckIndex()
+: mMaxID(0)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::~BackupStoreCheckIndex()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckIndex::~BackupStoreCheckIndex()
+{
+	Free();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Allocate(BackupStoreCheck_ID_t, const std::string &)
+//		Purpose: Makes room for objects with IDs up to MaxID, which
+//			 can be added in any order. The index is kept in
+//			 temporary files in the given directory, if any.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Allocate(BackupStoreCheck_ID_t MaxID,
+	const std::string &rFileDirectory)
+{
+	Free();
+	mFileDirectory = rFileDirectory;
+	Grow(MaxID);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Free()
+//		Purpose: Forgets all the objects, and frees the arrays
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Free()
+{
+	mFlags.Free();
+	mContainerDeltas.Free();
+	mSizes.Free();
+	mOverflowContainers.clear();
+	mOverflowSizes.clear();
+	mMaxID = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Grow(BackupStoreCheck_ID_t)
+//		Purpose: Private. Makes room for IDs up to MaxID.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Grow(BackupStoreCheck_ID_t MaxID)
+{
+	if(MaxID <= mMaxID && mFlags.GetSize() != 0)
+	{
+		return;
+	}
+
+	// Slot 0 is never used, as there is no object 0
+	size_t slots = (size_t)MaxID + 1;
+	mFlags.Resize((slots + 1) / 2, mFileDirectory);
+	mContainerDeltas.Resize(slots * sizeof(int32_t), mFileDirectory);
+	mSizes.Resize(slots * sizeof(uint32_t), mFileDirectory);
+	mMaxID = MaxID;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::Add(BackupStoreCheck_ID_t, BackupStoreCheck_ID_t, BackupStoreCheck_Size_t, uint8_t)
+//		Purpose: Add an object to the index, growing it if the ID
+//			 is higher than expected
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::Add(BackupStoreCheck_ID_t ID,
+	BackupStoreCheck_ID_t Container, BackupStoreCheck_Size_t ObjectSize,
+	uint8_t Flags)
+{
+	if(ID <= 0)
+	{
+		THROW_EXCEPTION(CommonException, BadArguments)
+	}
+	if(ID > mMaxID)
+	{
+		// Leave some room for more
+		Grow(ID + (ID / 8));
+	}
+	ASSERT(!Contains(ID));
+
+	mFlags.Get<uint8_t>()[ID >> 1] |=
+		(Slot_Present << ((ID & 1) * Slot__NumBits));
+	SetFlags(ID, Flags);
+	SetContainer(ID, Container);
+
+	if(ObjectSize >= 0 && ObjectSize < SIZE_OVERFLOW)
+	{
+		mSizes.Get<uint32_t>()[ID] = (uint32_t)ObjectSize;
+	}
+	else
+	{
+		mSizes.Get<uint32_t>()[ID] = SIZE_OVERFLOW;
+		mOverflowSizes[ID] = ObjectSize;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::GetContainer(BackupStoreCheck_ID_t)
+//		Purpose: Returns the ID of the directory containing the object
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheck_ID_t BackupStoreCheckIndex::GetContainer(
+	BackupStoreCheck_ID_t ID) const
+{
+	ASSERT(Contains(ID));
+	int32_t delta = mContainerDeltas.Get<int32_t>()[ID];
+	if(delta != CONTAINER_DELTA_OVERFLOW)
+	{
+		return ID - delta;
+	}
+
+	std::map<BackupStoreCheck_ID_t, BackupStoreCheck_ID_t>::const_iterator
+		i(mOverflowContainers.find(ID));
+	ASSERT(i != mOverflowContainers.end());
+	return i->second;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::SetContainer(BackupStoreCheck_ID_t, BackupStoreCheck_ID_t)
+//		Purpose: Records the ID of the directory containing the object
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckIndex::SetContainer(BackupStoreCheck_ID_t ID,
+	BackupStoreCheck_ID_t Container)
+{
+	ASSERT(Contains(ID));
+	int64_t delta = ID - Container;
+	if(delta > INT32_MIN && delta <= INT32_MAX)
+	{
+		mContainerDeltas.Get<int32_t>()[ID] = (int32_t)delta;
+		mOverflowContainers.erase(ID);
+	}
+	else
+	{
+		mContainerDeltas.Get<int32_t>()[ID] = CONTAINER_DELTA_OVERFLOW;
+		mOverflowContainers[ID] = Container;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::GetSizeInBlocks(BackupStoreCheck_ID_t)
+//		Purpose: Returns the size of the object on disc
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheck_Size_t BackupStoreCheckIndex::GetSizeInBlocks(
+	BackupStoreCheck_ID_t ID) const
+{
+	ASSERT(Contains(ID));
+	uint32_t size = mSizes.Get<uint32_t>()[ID];
+	if(size != SIZE_OVERFLOW)
+	{
+		return size;
+	}
+
+	std::map<BackupStoreCheck_ID_t, BackupStoreCheck_Size_t>::const_iterator
+		i(mOverflowSizes.find(ID));
+	ASSERT(i != mOverflowSizes.end());
+	return i->second;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckIndex::GetNextID(BackupStoreCheck_ID_t)
+//		Purpose: Returns the lowest ID above After which the index
+//			 contains, or 0 if there are none, skipping a byte
+//			 of flags at a time where possible
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheck_ID_t BackupStoreCheckIndex::GetNextID(
+	BackupStoreCheck_ID_t After) const
+{
+	const uint8_t *pflags = mFlags.Get<uint8_t>();
+	const uint8_t presentInByte = Slot_Present |
+		(Slot_Present << Slot__NumBits);
+
+	for(BackupStoreCheck_ID_t id = After + 1; id <= mMaxID; ++id)
+	{
+		if((id & 1) == 0 && (pflags[id >> 1] & presentInByte) == 0)
+		{
+			// Neither this ID nor the next one
+			++id;
+			continue;
+		}
+		if(GetSlot(id) & Slot_Present)
+		{
+			return id;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreCheckIndex.h
+//		Purpose: Compact index of the objects found by BackupStoreCheck
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTORECHECKINDEX__H
+#define BACKUPSTORECHECKINDEX__H
+
+#include <map>
+#include <string>
+
+// The object ID type
+typedef int64_t BackupStoreCheck_ID_t;
+// The size type
+typedef int64_t BackupStoreCheck_Size_t;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreCheckIndex
+//		Purpose: Records what is known about every object in a store,
+//			 in arrays indexed directly by object ID. Object IDs
+//			 are allocated in sequence, so most of the slots up to
+//			 the highest ID are used.
+//
+//			 Each slot takes 4 bits of flags, the difference
+//			 between the object's ID and its container's ID in 32
+//			 bits, and its size in blocks in 32 bits. The rare
+//			 values which don't fit are kept separately.
+//
+//			 The arrays are in memory, or in unlinked temporary
+//			 files mapped into memory, so that the operating
+//			 system can page them out when checking a huge store.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreCheckIndex
+{
+public:
+	BackupStoreCheckIndex();
+	~BackupStoreCheckIndex();
+private:
+	// no copying
+	BackupStoreCheckIndex(const BackupStoreCheckIndex &);
+	BackupStoreCheckIndex &operator=(const BackupStoreCheckIndex &);
+
+public:
+	enum
+	{
+		// Bits available to the caller in each slot
+		Flags__MASK = 7
+	};
+
+	void Allocate(BackupStoreCheck_ID_t MaxID,
+		const std::string &rFileDirectory = "");
+	void Free();
+
+	void Add(BackupStoreCheck_ID_t ID, BackupStoreCheck_ID_t Container,
+		BackupStoreCheck_Size_t ObjectSize, uint8_t Flags);
+
+	bool Contains(BackupStoreCheck_ID_t ID) const
+	{
+		return ID > 0 && ID <= mMaxID &&
+			(GetSlot(ID) & Slot_Present) != 0;
+	}
+
+	// These may only be used for IDs which the index contains
+	uint8_t GetFlags(BackupStoreCheck_ID_t ID) const
+	{
+		ASSERT(Contains(ID));
+		return GetSlot(ID) & Flags__MASK;
+	}
+	// Sets the given flags, leaving the others as they were
+	void SetFlags(BackupStoreCheck_ID_t ID, uint8_t Flags)
+	{
+		ASSERT(Contains(ID));
+		ASSERT((Flags & ~Flags__MASK) == 0);
+		mFlags.Get<uint8_t>()[ID >> 1] |=
+			(Flags << ((ID & 1) * Slot__NumBits));
+	}
+	BackupStoreCheck_ID_t GetContainer(BackupStoreCheck_ID_t ID) const;
+	void SetContainer(BackupStoreCheck_ID_t ID,
+		BackupStoreCheck_ID_t Container);
+	BackupStoreCheck_Size_t GetSizeInBlocks(BackupStoreCheck_ID_t ID) const;
+
+	// The next ID after the given one which the index contains, or 0
+	// if there are none
+	BackupStoreCheck_ID_t GetNextID(BackupStoreCheck_ID_t After) const;
+
+	BackupStoreCheck_ID_t GetMaxID() const { return mMaxID; }
+	int64_t GetNumBytes() const
+	{
+		return mFlags.GetSize() + mContainerDeltas.GetSize() +
+			mSizes.GetSize();
+	}
+	bool IsInFiles() const { return !mFileDirectory.empty(); }
+
+private:
+	enum
+	{
+		Slot_Present = 8,
+		Slot__NumBits = 4
+	};
+
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupStoreCheckIndex::Array
+	//		Purpose: A block of zeroed memory, optionally backed
+	//			 by a temporary file, which can grow
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class Array
+	{
+	public:
+		Array();
+		~Array();
+		void Resize(size_t Size, const std::string &rFileDirectory);
+		void Free();
+		template <typename T> T *Get() { return (T *)mpData; }
+		template <typename T> const T *Get() const
+		{
+			return (const T *)mpData;
+		}
+		size_t GetSize() const { return mSize; }
+	private:
+		// no copying
+		Array(const Array &);
+		Array &operator=(const Array &);
+
+		void *mpData;
+		size_t mSize;
+		int mFileHandle;
+	};
+
+	uint8_t GetSlot(BackupStoreCheck_ID_t ID) const
+	{
+		return (mFlags.Get<uint8_t>()[ID >> 1] >>
+			((ID & 1) * Slot__NumBits)) & 0xf;
+	}
+	void Grow(BackupStoreCheck_ID_t MaxID);
+
+	BackupStoreCheck_ID_t mMaxID;
+	std::string mFileDirectory;
+	Array mFlags;
+	Array mContainerDeltas;
+	Array mSizes;
+	std::map<BackupStoreCheck_ID_t, BackupStoreCheck_ID_t> mOverflowContainers;
+	std::map<BackupStoreCheck_ID_t, BackupStoreCheck_Size_t> mOverflowSizes;
+};
+
+#endif // BACKUPSTORECHECKINDEX__H
@@ -0,0 +1,345 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreCheckReader.cpp
+//		Purpose: Read and verify the objects of a store on several
+//			 threads for BackupStoreCheck
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include "BackupStoreCheckReader.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFile.h"
+#include "BackupStoreObjectMagic.h"
+#include "RaidFileRead.h"
+
+#include "MemLeakFindOn.h"
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::Object::Object(int, int64_t, const std::string &)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckReader::Object::Object(int Type, int64_t ObjectID,
+	const std::string &rFilename)
+: mType(Type),
+  mObjectID(ObjectID),
+  mFilename(rFilename),
+  mResult(Object_Bad),
+  mContainerID(-1),
+  mSizeInBlocks(-1),
+  mState(Object_Queued)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::Object::Read(int)
+//		Purpose: Private. Reads the object, recording any exception
+//			 to be rethrown by GetNext(). Safe to call on any
+//			 thread.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckReader::Object::Read(int DiscSetNumber)
+{
+	try
+	{
+		if(mType == Read_VerifyObject)
+		{
+			VerifyObject(DiscSetNumber);
+		}
+		else
+		{
+			std::auto_ptr<RaidFileRead> file(
+				RaidFileRead::Open(DiscSetNumber, mFilename));
+			mapDirectory.reset(new BackupStoreDirectory);
+			mapDirectory->ReadFromStream(*file,
+				IOStream::TimeOutInfinite);
+		}
+	}
+	catch(...)
+	{
+		mError = std::current_exception();
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::Object::VerifyObject(int)
+//		Purpose: Private. Works out whether the object is a file or
+//			 a directory, checks that it's readable and in the
+//			 right format, and finds its original container ID.
+//			 Any error leaves it as Object_Bad.
+//		Created: 21/4/04
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckReader::Object::VerifyObject(int DiscSetNumber)
+{
+	try
+	{
+		// Open file
+		std::auto_ptr<RaidFileRead> file(
+			RaidFileRead::Open(DiscSetNumber, mFilename));
+		mSizeInBlocks = file->GetDiscUsageInBlocks();
+
+		// Read in first four bytes -- don't have to worry about
+		// retrying if not all bytes read as is RaidFile
+		uint32_t signature;
+		if(file->Read(&signature, sizeof(signature)) != sizeof(signature))
+		{
+			// Too short, can't read signature from it
+			return;
+		}
+		// Seek back to beginning
+		file->Seek(0, IOStream::SeekType_Absolute);
+
+		// Then... check depending on the type
+		switch(ntohl(signature))
+		{
+		case OBJECTMAGIC_FILE_MAGIC_VALUE_V1:
+#ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
+		case OBJECTMAGIC_FILE_MAGIC_VALUE_V0:
+#endif
+			// File... check the format, and obtain the
+			// container ID
+			if(BackupStoreFile::VerifyEncodedFileFormat(*file,
+				0 /* don't want diffing from ID */,
+				&mContainerID) && mContainerID != -1)
+			{
+				mResult = Object_File;
+			}
+			break;
+
+		case OBJECTMAGIC_DIR_MAGIC_VALUE_V1:
+#ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
+		case OBJECTMAGIC_DIR_MAGIC_VALUE_V0:
+#endif
+			{
+				// Simply attempt to read in the directory,
+				// and check its object ID
+				BackupStoreDirectory dir;
+				dir.ReadFromStream(*file,
+					IOStream::TimeOutInfinite);
+				if(dir.GetObjectID() == mObjectID)
+				{
+					mContainerID = dir.GetContainerID();
+					mResult = Object_Directory;
+				}
+			}
+			break;
+
+		default:
+			// Unknown signature. Bad file. Very bad file.
+			break;
+		}
+	}
+	catch(...)
+	{
+		// Error caught, not a good file then, let it be deleted
+		mResult = Object_Bad;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::BackupStoreCheckReader(int, int, int)
+//		Purpose: Constructor. Starts the worker threads, if any.
+//			 HasRoomFor() allows MaxObjectsPerThread objects to
+//			 be queued for each of them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckReader::BackupStoreCheckReader(int DiscSetNumber,
+	int NumThreads, int MaxObjectsPerThread)
+: mDiscSetNumber(DiscSetNumber),
+  mMaxObjectsInFlight(NumThreads * MaxObjectsPerThread),
+  mStopping(false)
+{
+	try
+	{
+		for(int t = 0; t < NumThreads; ++t)
+		{
+			mThreads.push_back(std::thread(
+				&BackupStoreCheckReader::WorkerThread, this));
+		}
+	}
+	catch(...)
+	{
+		Shutdown();
+		throw;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::~BackupStoreCheckReader()
+//		Purpose: Destructor. Stops the worker threads, abandoning any
+//			 objects which have not been collected.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreCheckReader::~BackupStoreCheckReader()
+{
+	Shutdown();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::Shutdown()
+//		Purpose: Private. Waits for the worker threads to exit, and
+//			 frees the objects.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckReader::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for(std::vector<std::thread>::iterator i = mThreads.begin();
+		i != mThreads.end(); ++i)
+	{
+		i->join();
+	}
+	mThreads.clear();
+
+	for(std::deque<Object *>::iterator i = mObjects.begin();
+		i != mObjects.end(); ++i)
+	{
+		delete *i;
+	}
+	mObjects.clear();
+	mQueue.clear();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::Queue(int, int64_t, const std::string &)
+//		Purpose: Adds an object to be read. The caller should keep
+//			 HasRoomFor() true by collecting objects with
+//			 GetNext(), which is not enforced.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckReader::Queue(int Type, int64_t ObjectID,
+	const std::string &rFilename)
+{
+	std::auto_ptr<Object> apObject(new Object(Type, ObjectID, rFilename));
+	mObjects.push_back(apObject.get());
+	Object *pobject = apObject.release();
+
+	if(!mThreads.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueue.push_back(pobject);
+		}
+		mWorkAvailable.notify_one();
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::GetNext()
+//		Purpose: Returns the oldest object queued, waiting for it to
+//			 be read if necessary. Errors reading a directory are
+//			 rethrown here.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupStoreCheckReader::Object> BackupStoreCheckReader::GetNext()
+{
+	if(mObjects.empty())
+	{
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+
+	Object *pobject = mObjects.front();
+	if(mThreads.empty())
+	{
+		pobject->Read(mDiscSetNumber);
+	}
+	else
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(pobject->mState != Object_Read)
+		{
+			mWorkDone.wait(lock);
+		}
+	}
+
+	mObjects.pop_front();
+	std::auto_ptr<Object> apObject(pobject);
+
+	if(apObject->mError)
+	{
+		std::rethrow_exception(apObject->mError);
+	}
+
+	return apObject;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreCheckReader::WorkerThread()
+//		Purpose: Private. Body of each worker thread: reads queued
+//			 objects until stopped.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreCheckReader::WorkerThread()
+{
+	while(true)
+	{
+		Object *pobject = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while(!mStopping && mQueue.empty())
+			{
+				mWorkAvailable.wait(lock);
+			}
+			if(mStopping)
+			{
+				return;
+			}
+			pobject = mQueue.front();
+			mQueue.pop_front();
+			pobject->mState = Object_Reading;
+		}
+
+		pobject->Read(mDiscSetNumber);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			pobject->mState = Object_Read;
+		}
+		mWorkDone.notify_all();
+	}
+}
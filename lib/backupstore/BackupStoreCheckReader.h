@@ -0,0 +1,146 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreCheckReader.h
+//		Purpose: Read and verify the objects of a store on several
+//			 threads for BackupStoreCheck
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTORECHECKREADER__H
+#define BACKUPSTORECHECKREADER__H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BackupStoreDirectory.h"
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreCheckReader
+//		Purpose: Reads the objects of a store from disc and verifies
+//			 or parses them on a pool of worker threads, while
+//			 BackupStoreCheck makes all the decisions about them.
+//
+//			 Objects are returned by GetNext() in the order in
+//			 which they were queued, so the check sees exactly the
+//			 same sequence as reading them one at a time, and what
+//			 it fixes does not depend on the number of threads.
+//			 With no threads, each object is read by GetNext() on
+//			 the calling thread.
+//
+//			 The workers only read. They never touch the check's
+//			 list of IDs, and never write to the store.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreCheckReader
+{
+public:
+	BackupStoreCheckReader(int DiscSetNumber, int NumThreads,
+		int MaxObjectsPerThread);
+	~BackupStoreCheckReader();
+private:
+	// no copying
+	BackupStoreCheckReader(const BackupStoreCheckReader &);
+	BackupStoreCheckReader &operator=(const BackupStoreCheckReader &);
+
+public:
+	enum
+	{
+		// Check the signature and format of any object (phase 1)
+		Read_VerifyObject = 0,
+		// Read in a directory (phase 2)
+		Read_Directory = 1
+	};
+
+	enum
+	{
+		Object_Bad = 0,
+		Object_File = 1,
+		Object_Directory = 2
+	};
+
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupStoreCheckReader::Object
+	//		Purpose: An object to read, and what was found
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class Object
+	{
+	public:
+		Object(int Type, int64_t ObjectID, const std::string &rFilename);
+
+		int mType;
+		int64_t mObjectID;
+		std::string mFilename;
+
+		// Read_VerifyObject: what kind of object it is, or
+		// Object_Bad if it should be deleted, and its original
+		// container ID and size on disc
+		int mResult;
+		int64_t mContainerID;
+		int64_t mSizeInBlocks;
+
+		// Read_Directory: the directory as read from disc
+		std::auto_ptr<BackupStoreDirectory> mapDirectory;
+
+	private:
+		friend class BackupStoreCheckReader;
+		void Read(int DiscSetNumber);
+		void VerifyObject(int DiscSetNumber);
+
+		int mState;
+		std::exception_ptr mError;
+	};
+
+	void Queue(int Type, int64_t ObjectID, const std::string &rFilename);
+	std::auto_ptr<Object> GetNext();
+
+	size_t GetNumQueued() const { return mObjects.size(); }
+	// True if another Count objects can be queued without holding
+	// more than the limit in memory
+	bool HasRoomFor(size_t Count) const
+	{
+		return mObjects.size() + Count <= mMaxObjectsInFlight;
+	}
+	int GetNumThreads() const { return (int)mThreads.size(); }
+
+private:
+	enum
+	{
+		Object_Queued = 0,
+		Object_Reading = 1,
+		Object_Read = 2
+	};
+
+	void WorkerThread();
+	void Shutdown();
+
+	int mDiscSetNumber;
+	size_t mMaxObjectsInFlight;
+
+	// Every object queued and not yet collected, in order
+	std::deque<Object *> mObjects;
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	// Objects waiting for a worker, the oldest first
+	std::deque<Object *> mQueue;
+	bool mStopping;
+};
+
+#endif // BACKUPSTORECHECKREADER__H
@@ -39,6 +39,18 @@ static const ConfigurationVerifyKey verifyrootkeys[] =
 	ConfigurationVerifyKey("ExtendedLogging", ConfigTest_IsBool, false),
 	ConfigurationVerifyKey("DisableHouseKeeping", ConfigTest_IsBool, false),
 	// make value "yes" to enable in config file
+	ConfigurationVerifyKey("DirectoryCacheSize", ConfigTest_IsInt),
+	// maximum bytes of directory data cached for each connection
+	ConfigurationVerifyKey("HousekeepingWorkers", ConfigTest_IsInt, 1),
+	// number of accounts housekept at the same time
+	ConfigurationVerifyKey("CheckThreads", ConfigTest_IsInt, 0),
+	// number of threads reading objects for bbstoreaccounts check
+	ConfigurationVerifyKey("CheckIndexDirectory", 0),
+	// where bbstoreaccounts check keeps its index, if not in memory
+	ConfigurationVerifyKey("RaidWriteBehind", ConfigTest_IsBool, false),
+	// reply to clients before uploaded files are split across the discs
+	ConfigurationVerifyKey("DeferReverseDiffs", ConfigTest_IsBool, false),
+	// store patches from clients as they are, for housekeeping to reverse
 	ConfigurationVerifyKey("RaidFileConf", ConfigTest_LastEntry)
 
 };
@@ -14,6 +14,31 @@
 
 #define BACKUP_STORE_SERVER_VERSION		1
 
+// Clients asking for this version may send more commands before reading the
+// replies to earlier ones (see SendAsync() in the protocol classes)
+#define BACKUP_STORE_SERVER_VERSION_PIPELINING	2
+
+// Servers accepting this version also understand ListDirectoryTree, as well
+// as pipelining
+#define BACKUP_STORE_SERVER_VERSION_TREE_LISTING	3
+
+// Servers accepting this version also keep an index of the blocks in each
+// account's files (AddBlockFingerprints and FindBlockFingerprints), and
+// accept diffs from files other than an older version of the same file
+#define BACKUP_STORE_SERVER_VERSION_SHARED_BLOCKS	4
+
+// Servers accepting this version also accept StoreFiles, which stores many
+// files in one directory at once
+#define BACKUP_STORE_SERVER_VERSION_BATCHED_UPLOAD	5
+
+// Servers accepting this version also accept GetFileRange, which reads part
+// of a file without sending the whole thing
+#define BACKUP_STORE_SERVER_VERSION_FILE_RANGES	6
+
+// Number of directories a client asks for in each ListDirectoryTree, so that
+// the listings it holds at once are bounded. It asks again for the rest.
+#define BACKUPSTORE_TREE_LISTING_MAX_DIRECTORIES	1024
+
 // Minimum size for a chunk to be compressed
 #define BACKUP_FILE_MIN_COMPRESSED_CHUNK_SIZE	256
 
@@ -21,6 +46,13 @@
 #define BACKUP_FILE_MIN_BLOCK_SIZE				4096
 #define BACKUP_FILE_MAX_BLOCK_SIZE				(512*1024)
 
+// Content defined chunking cuts blocks of about this size, and no bigger
+// than the maximum, see BackupStoreFileChunker. These and the minimum block
+// size are doubled for bigger files, as fixed size blocks are, until the
+// maximum reaches BACKUP_FILE_MAX_BLOCK_SIZE.
+#define BACKUP_FILE_CHUNK_NORMAL_SIZE			(16*1024)
+#define BACKUP_FILE_CHUNK_MAX_SIZE				(64*1024)
+
 // Increase the block size if there are more than this number of blocks
 #define BACKUP_FILE_INCREASE_BLOCK_SIZE_AFTER 	4096
 
@@ -40,5 +72,12 @@
 // This is a multiple of the number of blocks in the diff from file.
 #define BACKUP_FILE_DIFF_MAX_BLOCK_FIND_MULTIPLE	4096
 
+// Upper limit on the number of threads encoding blocks of a single file
+#define BACKUP_FILE_MAX_ENCODING_THREADS		64
+
+// Number of blocks each encoding thread may have queued or finished ahead
+// of the block being sent, which bounds the memory used by the pipeline.
+#define BACKUP_FILE_ENCODING_BLOCKS_PER_THREAD	2
+
 #endif // BACKUPSTORECONSTANTS__H
 
@@ -11,8 +11,10 @@
 
 #include <stdio.h>
 #include <iostream>
+#include "Archive.h"
 #include "BackupConstants.h"
 #include "BackupStoreContext.h"
+#include "BackupStoreDeferredPatch.h"
 #include "BackupStoreDirectory.h"
 #include "BackupStoreException.h"
 #include "BackupStoreFile.h"
@@ -20,10 +22,12 @@
 #include "BackupsList.h"
 #include "BackupStoreObjectMagic.h"
 #include "BackupStoreFileResumeInfo.h"
+#include "BackupStoreFileWire.h"
 #include "BufferedStream.h"
 #include "BufferedWriteStream.h"
 #include "FileStream.h"
 #include "InvisibleTempFileStream.h"
+#include "PartialReadStream.h"
 #include "RaidFileController.h"
 #include "RaidFileRead.h"
 #include "RaidFileWrite.h"
@@ -32,16 +36,23 @@
 #include "MemLeakFindOn.h"
 
 
-// Maximum number of directories to keep in the cache When the cache is bigger
-// than this, everything gets deleted. In tests, we set the cache size to zero
-// to ensure that it's always flushed, which is very inefficient but helps to
-// catch programming errors (use of freed data).
+// Default maximum total size of the directories in the cache, in bytes of
+// memory used by them. When the cache is bigger than this, the least recently
+// used directories are evicted. In tests, we set the cache size to zero to
+// ensure that everything else is evicted whenever a directory is loaded or
+// saved, which is very inefficient but helps to catch programming errors (use
+// of freed data).
 #ifdef BOX_RELEASE_BUILD
-	#define	MAX_CACHE_SIZE	32
+	#define	DEFAULT_DIRECTORY_CACHE_MAX_SIZE	(8*1024*1024)
 #else
-	#define	MAX_CACHE_SIZE	0
+	#define	DEFAULT_DIRECTORY_CACHE_MAX_SIZE	0
 #endif
 
+// In debug builds, the number of evicted directories kept in memory (but
+// invalidated) to catch use of references to them. Older ones are deleted,
+// so that a long session doesn't keep every directory it ever loaded.
+#define MAX_EVICTED_DIRECTORIES_KEPT	256
+
 // Allow the housekeeping process 4 seconds to release an account
 #define MAX_WAIT_FOR_HOUSEKEEPING_TO_RELEASE_ACCOUNT	4
 
@@ -60,13 +71,21 @@ BackupStoreContext::BackupStoreContext(int32_t ClientID,
 	HousekeepingInterface* pHousekeeping, const std::string& rConnectionDetails)
 : mConnectionDetails(rConnectionDetails),
   mClientID(ClientID),
+  mProtocolVersion(PROTOCOL_CURRENT_VERSION),
   mpHousekeeping(pHousekeeping),
   mProtocolPhase(Phase_START),
   mClientHasAccount(false),
   mStoreDiscSet(-1),
   mReadOnly(true),
   mSaveStoreInfoDelay(STORE_INFO_SAVE_DELAY),
-  mProtocolVersion(PROTOCOL_CURRENT_VERSION),
+  mDirectoryCacheSize(0),
+  mDirectoryCacheMaxSize(DEFAULT_DIRECTORY_CACHE_MAX_SIZE),
+  mDirectoryCacheHits(0),
+  mDirectoryCacheMisses(0),
+  mDirectoryCacheEvictions(0),
+  mBatchDirectoryID(0),
+  mDeferReverseDiffs(false),
+  mFileRangeObjectID(0),
   mpTestHook(NULL)// If you change the initialisers, be sure to update
 // BackupStoreContext::ReceivedFinishCommand as well!
 {
@@ -90,12 +109,94 @@ BackupStoreContext::~BackupStoreContext()
 void BackupStoreContext::ClearDirectoryCache()
 {
 	// Delete the objects in the cache
-	for(std::map<int64_t, BackupStoreDirectory*>::iterator i(mDirectoryCache.begin());
+	for(std::map<int64_t, CachedDirectory>::iterator i(mDirectoryCache.begin());
 		i != mDirectoryCache.end(); ++i)
 	{
-		delete (i->second);
+		delete (i->second.mpDirectory);
 	}
 	mDirectoryCache.clear();
+	mDirectoryCacheLRU.clear();
+	mDirectoryCacheSize = 0;
+
+#ifndef BOX_RELEASE_BUILD
+	for(std::deque<BackupStoreDirectory*>::iterator
+		i(mEvictedDirectories.begin());
+		i != mEvictedDirectories.end(); ++i)
+	{
+		delete *i;
+	}
+	mEvictedDirectories.clear();
+#endif
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::SetDirectoryCacheMaxSize(int64_t)
+//		Purpose: Sets the maximum total size of the directories in
+//			 the cache, in bytes of memory, evicting
+//			 directories immediately if it's now too big.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::SetDirectoryCacheMaxSize(int64_t MaxSize)
+{
+	mDirectoryCacheMaxSize = (MaxSize < 0) ? 0 : MaxSize;
+	TrimDirectoryCache(0 /* not a valid object ID, so keep nothing */);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::TrimDirectoryCache(int64_t)
+//		Purpose: Evicts the least recently used directories, except
+//			 KeepObjectID, until the cache is within its maximum
+//			 size. Any references to evicted directories become
+//			 invalid.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::TrimDirectoryCache(int64_t KeepObjectID)
+{
+	std::list<int64_t>::iterator i(mDirectoryCacheLRU.end());
+	while(mDirectoryCacheSize > mDirectoryCacheMaxSize &&
+		i != mDirectoryCacheLRU.begin())
+	{
+		--i;
+		if(*i == KeepObjectID)
+		{
+			continue;
+		}
+
+		std::map<int64_t, CachedDirectory>::iterator
+			item(mDirectoryCache.find(*i));
+		ASSERT(item != mDirectoryCache.end());
+
+		BOX_TRACE("Evicting object " << BOX_FORMAT_OBJECTID(*i) <<
+			" from cache");
+
+		// In debug builds, leave the directory in memory but
+		// invalidate it instead, so that any attempt to access it
+		// will cause an assertion failure that helps to track down
+		// the error. Only the most recently evicted ones are kept.
+#ifdef BOX_RELEASE_BUILD
+		delete item->second.mpDirectory;
+#else
+		item->second.mpDirectory->Invalidate();
+		mEvictedDirectories.push_back(item->second.mpDirectory);
+		if(mEvictedDirectories.size() > MAX_EVICTED_DIRECTORIES_KEPT)
+		{
+			delete mEvictedDirectories.front();
+			mEvictedDirectories.pop_front();
+		}
+#endif
+		mDirectoryCacheSize -= item->second.mSize;
+		mDirectoryCache.erase(item);
+		i = mDirectoryCacheLRU.erase(i);
+		++mDirectoryCacheEvictions;
+	}
 }
 
 
@@ -156,6 +257,10 @@ void BackupStoreContext::ReceivedFinishCommand()
 	mpTestHook = NULL;
 	mapStoreInfo.reset();
 	mapRefCount.reset();
+	mapChangeJournal.reset();
+	mapBlockDatabase.reset();
+	mCanDiffFromFile.clear();
+	mapFileRangeStream.reset();
 	ClearDirectoryCache();
 }
 
@@ -248,6 +353,12 @@ void BackupStoreContext::LoadStoreInfo()
 			"account. Housekeeping will fix this automatically "
 			"when it next runs.");
 	}
+
+	if(!mReadOnly)
+	{
+		mapChangeJournal =
+			BackupStoreChangeJournal::OpenForRecording(account);
+	}
 }
 
 
@@ -316,9 +427,9 @@ void BackupStoreContext::MakeObjectFilename(int64_t ObjectID, std::string &rOutp
 //			 is called. Mainly this function, and creation of
 //			 files. Private version of this, which returns
 //			 non-const directories. Unless called with
-//			 AllowFlushCache == false, the cache may be flushed,
-//			 invalidating all directory references that you may
-//			 be holding, so beware.
+//			 AllowFlushCache == false, other directories may be
+//			 evicted from the cache, invalidating any directory
+//			 references that you may be holding, so beware.
 //		Created: 2003/09/02
 //
 // --------------------------------------------------------------------------
@@ -331,58 +442,37 @@ BackupStoreDirectory &BackupStoreContext::GetDirectoryInternal(int64_t ObjectID,
 	int64_t oldRevID = 0, newRevID = 0;
 
 	// Already in cache?
-	std::map<int64_t, BackupStoreDirectory*>::iterator item(mDirectoryCache.find(ObjectID));
+	std::map<int64_t, CachedDirectory>::iterator item(mDirectoryCache.find(ObjectID));
 	if(item != mDirectoryCache.end()) {
-#ifndef BOX_RELEASE_BUILD // it might be in the cache, but invalidated
-		// in which case, delete it instead of returning it.
-		if(!item->second->IsInvalidated())
-#else
-		if(true)
-#endif
-		{
-			oldRevID = item->second->GetRevisionID();
+		BackupStoreDirectory *pcached = item->second.mpDirectory;
+		ASSERT(!pcached->IsInvalidated());
+		oldRevID = pcached->GetRevisionID();
 
-			// Check the revision ID of the file -- does it need refreshing?
-			if(!RaidFileRead::FileExists(mStoreDiscSet, filename, &newRevID))
-			{
-				THROW_EXCEPTION(BackupStoreException, DirectoryHasBeenDeleted)
-			}
+		// Check the revision ID of the file -- does it need refreshing?
+		if(!RaidFileRead::FileExists(mStoreDiscSet, filename, &newRevID))
+		{
+			THROW_EXCEPTION(BackupStoreException, DirectoryHasBeenDeleted)
+		}
 
-			if(newRevID == oldRevID)
-			{
-				// Looks good... return the cached object
-				BOX_TRACE("Returning object " <<
-					BOX_FORMAT_OBJECTID(ObjectID) <<
-					" from cache, modtime = " << newRevID)
-				return *(item->second);
-			}
+		if(newRevID == oldRevID)
+		{
+			// Looks good... return the cached object, which is
+			// now the most recently used.
+			BOX_TRACE("Returning object " <<
+				BOX_FORMAT_OBJECTID(ObjectID) <<
+				" from cache, modtime = " << newRevID)
+			mDirectoryCacheLRU.splice(mDirectoryCacheLRU.begin(),
+				mDirectoryCacheLRU, item->second.mLRUPosition);
+			++mDirectoryCacheHits;
+			return *pcached;
 		}
 
 		// Delete this cached object
-		delete item->second;
-		mDirectoryCache.erase(item);
+		RemoveDirectoryFromCache(ObjectID);
 	}
 
 	// Need to load it up
-
-	// First check to see if the cache is too big
-	if(mDirectoryCache.size() > MAX_CACHE_SIZE && AllowFlushCache)
-	{
-		// Very simple. Just delete everything! But in debug builds,
-		// leave the entries in the cache and invalidate them instead,
-		// so that any attempt to access them will cause an assertion
-		// failure that helps to track down the error.
-#ifdef BOX_RELEASE_BUILD
-		ClearDirectoryCache();
-#else
-		for(std::map<int64_t, BackupStoreDirectory*>::iterator
-			i = mDirectoryCache.begin();
-			i != mDirectoryCache.end(); i++)
-		{
-			i->second->Invalidate();
-		}
-#endif
-	}
+	++mDirectoryCacheMisses;
 
 	// Get a RaidFileRead to read it
 	std::auto_ptr<RaidFileRead> objectFile(RaidFileRead::Open(mStoreDiscSet,
@@ -412,17 +502,29 @@ BackupStoreDirectory &BackupStoreContext::GetDirectoryInternal(int64_t ObjectID,
 	ASSERT(dirSize > 0);
 	dir->SetUserInfo1_SizeInBlocks(dirSize);
 
-	// Store in cache
-	BackupStoreDirectory *pdir = dir.release();
+	// Store in cache, as the most recently used
+	CachedDirectory cached;
+	cached.mpDirectory = dir.get();
+	cached.mSize = dir->GetMemoryUsage();
+	mDirectoryCacheLRU.push_front(ObjectID);
 	try
 	{
-		mDirectoryCache[ObjectID] = pdir;
+		cached.mLRUPosition = mDirectoryCacheLRU.begin();
+		mDirectoryCache[ObjectID] = cached;
 	}
 	catch(...)
 	{
-		delete pdir;
+		mDirectoryCacheLRU.pop_front();
 		throw;
 	}
+	mDirectoryCacheSize += cached.mSize;
+	BackupStoreDirectory *pdir = dir.release();
+
+	// Make room for it, if we're allowed to
+	if(AllowFlushCache)
+	{
+		TrimDirectoryCache(ObjectID);
+	}
 
 	// Return it
 	return *pdir;
@@ -519,6 +621,11 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 
 
 
+	// Files stored by AddFiles() are written to the directory and the
+	// store info once all of them have been stored, and are small enough
+	// that there's no point in resuming them.
+	bool inBatch = (InDirectory == mBatchDirectoryID);
+
 	// Checking the resume before any ID allocation
 	BackupStoreResumeFileInfo resume(RaidFileController::DiscSetPathToFileSystemPath(mStoreDiscSet, this->GetAccountRoot(), 1));
 	if(ResumeOffset > 0) 
@@ -543,7 +650,7 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 		}
 
 		BOX_INFO("Going to try resume transfert of " << resume.GetFilePath() << " at offset " << ResumeOffset);
-	} else {
+	} else if(!inBatch) {
 		// no resume asked, cleanup any previous resume file in case of a previous failed upload
 		resume.Cleanup();
 	}
@@ -552,6 +659,23 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 	// Get the directory we want to modify
 	BackupStoreDirectory &dir(GetDirectoryInternal(InDirectory));
 
+	// An older version which is still a patch from the one before it
+	// can't be diffed against, or deleted to keep within the version
+	// limit, so reverse it now. That costs as much as the reverse diff
+	// which was deferred, so only do it when one of those can happen:
+	// full uploads, including every file in a batch, leave it to
+	// housekeeping.
+	if(mapStoreInfo->GetVersionCountLimit() > 0 || DiffFromFileID != 0)
+	{
+		BackupStoreDirectory::Entry *pdiffFrom =
+			dir.FindEntryByID(DiffFromFileID);
+		if(mapStoreInfo->GetVersionCountLimit() > 0 ||
+			(pdiffFrom != 0 && pdiffFrom->NameMatches(rFilename)))
+		{
+			ResolveDeferredPatches(dir, rFilename);
+		}
+	}
+
 	// Allocate the next ID
 	int64_t id = AllocateObjectID();
 
@@ -573,6 +697,11 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 	int64_t oldVersionNewBlocksUsed = 0;
 	BackupStoreInfo::Adjustment adjustment = {};
 	IOStream::pos_type offset = 0;
+	// Diffed against a file other than an older version of this one,
+	// which must be left alone (see FindFileWithBlock)
+	bool diffFromOtherFile = false;
+	// Stored as the patch, see BackupStoreDeferredPatch
+	bool deferReverseDiff = false;
 
 	try
 	{
@@ -591,7 +720,7 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 				// resuming...
 				storeFile.Seek(ResumeOffset, IOStream::SeekType_Absolute);
 			}
-			else
+			else if(!inBatch)
 			{
 				// preparing for resuming
 				resume.Set(new BackupStoreResumeInfos(storeFile.GetTempFilename(), id, AttributesHash));
@@ -612,10 +741,19 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 				BOX_FORMAT_OBJECTID(DiffFromFileID) << " and resume offset " <<
 				ResumeOffset); 
 
-			// Check that the diffed from ID actually exists in the directory
-			if(dir.FindEntryByID(DiffFromFileID) == 0)
+			// Check that the diffed from ID actually exists, usually
+			// as an older version of the file in the same directory
+			BackupStoreDirectory::Entry *pdiffFromEntry =
+				dir.FindEntryByID(DiffFromFileID);
+			if(pdiffFromEntry == 0 || !pdiffFromEntry->NameMatches(rFilename))
 			{
-				THROW_EXCEPTION(BackupStoreException, DiffFromIDNotFoundInDirectory)
+				// It must be complete, as the patch can only
+				// refer to blocks in the file it was diffed from
+				if(!CanDiffFromOtherFile(DiffFromFileID))
+				{
+					THROW_EXCEPTION(BackupStoreException, DiffFromIDNotFoundInDirectory)
+				}
+				diffFromOtherFile = true;
 			}
 
 			// Diff file, needs to be recreated.
@@ -671,10 +809,31 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 
 				// Reassemble that diff -- open previous file, and combine the patch and file
 				std::auto_ptr<RaidFileRead> from(RaidFileRead::Open(mStoreDiscSet, oldVersionFilename));
-				BackupStoreFile::CombineFile(diff, diff2, *from, storeFile);
-				BOX_NOTICE("Diff CombineFile done");
+				deferReverseDiff = mDeferReverseDiffs &&
+					!diffFromOtherFile &&
+					mapStoreInfo->GetVersionCountLimit() != 1;
+				if(deferReverseDiff)
+				{
+					// Store the patch as it is, leaving the old
+					// version complete, for housekeeping to
+					// combine and reverse later
+					if(!diff.CopyStreamTo(storeFile))
+					{
+						THROW_EXCEPTION(BackupStoreException, ReadFileFromStreamTimedOut)
+					}
+					BOX_NOTICE("Diff stored, reversing it deferred");
+				}
+				else
+				{
+					BackupStoreFile::CombineFile(diff, diff2, *from, storeFile);
+					BOX_NOTICE("Diff CombineFile done");
+				}
 
-				if ( mapStoreInfo->GetVersionCountLimit()==1 ) {
+				if(diffFromOtherFile || deferReverseDiff)
+				{
+					// The other file stays as it is.
+				}
+				else if ( mapStoreInfo->GetVersionCountLimit()==1 ) {
 					// we'll keep only one version, dismiss the patch
 					adjustment.mBlocksUsed -= from->GetDiscUsageInBlocks();
 					adjustment.mBlocksInCurrentFiles -= from->GetDiscUsageInBlocks();
@@ -743,7 +902,10 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 		storeFile.Commit(BACKUP_STORE_CONVERT_TO_RAID_IMMEDIATELY);
 		
 		// transfert is done, cleanup resume
-		resume.Delete();
+		if(!inBatch)
+		{
+			resume.Delete();
+		}
 	}
 	catch(...)
 	{
@@ -776,21 +938,25 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 
 	// Modify the directory -- first make all files with the same name
 	// marked as an old version
+	std::vector<int64_t> markedOld;
 	try
 	{
 		// Adjust the entry for the object that we replaced with a
 		// patch, above.
 		BackupStoreDirectory::Entry *poldEntry = NULL;
 
-		if(DiffFromFileID != 0)
+		if(DiffFromFileID != 0 && !diffFromOtherFile)
 		{
 			// Get old version entry
 			poldEntry = dir.FindEntryByID(DiffFromFileID);
 			ASSERT(poldEntry != 0);
 
-			// Adjust size of old entry
+			// Adjust size of old entry, unless it's still complete
 			int64_t oldSize = poldEntry->GetSizeInBlocks();
-			poldEntry->SetSizeInBlocks(oldVersionNewBlocksUsed);
+			if(!deferReverseDiff)
+			{
+				poldEntry->SetSizeInBlocks(oldVersionNewBlocksUsed);
+			}
 		}
 
 		if(MarkFileWithSameNameAsOldVersions)
@@ -806,7 +972,7 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
                 {
 					// Compare name
 
-					if(e->GetName() == rFilename)
+					if(e->NameMatches(rFilename))
 					{
                         if(! e->IsOld()) {
                             // Check that it's definately not an old version
@@ -814,6 +980,7 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 
                             // Set old version flag
                             e->AddFlags(BackupStoreDirectory::Entry::Flags_OldVersion);
+                            markedOld.push_back(e->GetObjectID());
                             // Can safely do this, because we know we won't be here if it's already
                             // an old version
                             adjustment.mBlocksInOldFiles += e->GetSizeInBlocks();
@@ -857,6 +1024,7 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
                         {
                             RaidFileWrite del(mStoreDiscSet, objFilename, refs);
                             del.Delete();
+                            mCanDiffFromFile.erase(objectID);
                         }
 
                         if ( oldestVersionToKeep ) {
@@ -879,14 +1047,23 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 			AttributesHash);
 
 		// Adjust dependency info of file?
-		if(ppreviousVerStoreFile && !reversedDiffIsCompletelyDifferent)
+		if(deferReverseDiff)
+		{
+			pnewEntry->AddFlags(BackupStoreDirectory::Entry::Flags_PatchFromOlder);
+			poldEntry->SetDependsNewer(id);
+			pnewEntry->SetDependsOlder(DiffFromFileID);
+		}
+		else if(ppreviousVerStoreFile && !reversedDiffIsCompletelyDifferent)
 		{
 			poldEntry->SetDependsNewer(id);
 			pnewEntry->SetDependsOlder(DiffFromFileID);
 		}
 
 		// Write the directory back to disc
-		SaveDirectory(dir);
+		if(!inBatch)
+		{
+			SaveDirectory(dir);
+		}
 
 		// Commit the old version's new patched version, now that the directory safely reflects
 		// the state of the files on disc.
@@ -895,6 +1072,9 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 			ppreviousVerStoreFile->Commit(BACKUP_STORE_CONVERT_TO_RAID_IMMEDIATELY);
 			delete ppreviousVerStoreFile;
 			ppreviousVerStoreFile = 0;
+
+			// It's a patch now, so no longer any use to other files
+			mCanDiffFromFile.erase(DiffFromFileID);
 		}
 	}
 	catch(...)
@@ -903,8 +1083,33 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 		RaidFileWrite del(mStoreDiscSet, fn);
 		del.Delete();
 
-		// Remove this entry from the cache
-		RemoveDirectoryFromCache(InDirectory);
+		if(inBatch)
+		{
+			// The cached directory also lists the files stored
+			// earlier in the batch, which AddFiles() will save,
+			// so only back out the changes for this one. Old
+			// versions deleted above are gone from the directory
+			// and the disc alike, so they're consistent already.
+			if(dir.FindEntryByID(id) != 0)
+			{
+				dir.DeleteEntry(id);
+			}
+			for(std::vector<int64_t>::const_iterator
+				i(markedOld.begin()); i != markedOld.end(); i++)
+			{
+				BackupStoreDirectory::Entry *e =
+					dir.FindEntryByID(*i);
+				if(e != 0)
+				{
+					e->RemoveFlags(BackupStoreDirectory::Entry::Flags_OldVersion);
+				}
+			}
+		}
+		else
+		{
+			// Remove this entry from the cache
+			RemoveDirectoryFromCache(InDirectory);
+		}
 
 		// Delete any previous version store file
 		if(ppreviousVerStoreFile != 0)
@@ -936,13 +1141,215 @@ int64_t BackupStoreContext::AddFile(IOStream &rFile, int64_t InDirectory,
 
 	// Save the store info -- can cope if this exceptions because infomation
 	// will be rebuilt by housekeeping, and ID allocation can recover.
-	SaveStoreInfo(false);
+	if(!inBatch)
+	{
+		SaveStoreInfo(false);
+	}
 
 	// Return the ID to the caller
 	return id;
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::AddFiles(IOStream &, int64_t,
+//			 int32_t, std::vector<int64_t> &)
+//		Purpose: Add a batch of complete files to a directory, read
+//			 from a stream in the format described for StoreFiles
+//			 in BackupProtocol.txt. The IDs of the new files are
+//			 appended to rIDsOut. The directory is written back
+//			 once, after the last file, or after the last file
+//			 stored if one of them fails.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::AddFiles(IOStream &rFiles, int64_t InDirectory,
+	int32_t NumberOfFiles, std::vector<int64_t> &rIDsOut)
+{
+	if(mapStoreInfo.get() == 0)
+	{
+		THROW_EXCEPTION(BackupStoreException, StoreInfoNotLoaded)
+	}
+
+	if(mReadOnly)
+	{
+		THROW_EXCEPTION(BackupStoreException, ContextIsReadOnly)
+	}
+
+	if(NumberOfFiles < 0)
+	{
+		THROW_EXCEPTION(BackupStoreException, BadStoreFilesStream)
+	}
+
+	// Make sure it's a directory that exists before storing anything
+	GetDirectoryInternal(InDirectory);
+
+	Archive archive(rFiles, BACKUP_STORE_TIMEOUT);
+	size_t alreadyStored = rIDsOut.size();
+	mBatchDirectoryID = InDirectory;
+
+	try
+	{
+		for(int32_t n = 0; n < NumberOfFiles; ++n)
+		{
+			int64_t modificationTime, attributesHash;
+			archive.Read(modificationTime);
+			archive.Read(attributesHash);
+
+			BackupStoreFilename filename;
+			filename.ReadFromStream(rFiles, BACKUP_STORE_TIMEOUT);
+
+			int64_t numFingerprints;
+			archive.Read(numFingerprints);
+			if(numFingerprints < 0)
+			{
+				THROW_EXCEPTION(BackupStoreException,
+					BadStoreFilesStream)
+			}
+			std::vector<uint64_t> fingerprints;
+			for(int64_t f = 0; f < numFingerprints; ++f)
+			{
+				uint64_t fingerprint;
+				archive.Read(fingerprint);
+				fingerprints.push_back(fingerprint);
+			}
+
+			int64_t encodedSize;
+			archive.Read(encodedSize);
+			if(encodedSize <= 0)
+			{
+				THROW_EXCEPTION(BackupStoreException,
+					BadStoreFilesStream)
+			}
+
+			PartialReadStream encoded(rFiles, encodedSize);
+			int64_t id = AddFile(encoded, InDirectory,
+				modificationTime, attributesHash,
+				0 /* not a diff */, filename,
+				true /* mark files with same name as old versions */,
+				0 /* not resuming */);
+			rIDsOut.push_back(id);
+
+			if(!fingerprints.empty())
+			{
+				AddBlockFingerprints(id, fingerprints);
+			}
+		}
+	}
+	catch(...)
+	{
+		// Keep the files which were stored. AddFile() leaves them
+		// in the cached directory when one file fails, and only
+		// drops the directory after saving them.
+		mBatchDirectoryID = 0;
+		if(rIDsOut.size() > alreadyStored)
+		{
+			try
+			{
+				if(mDirectoryCache.find(InDirectory) !=
+					mDirectoryCache.end())
+				{
+					SaveDirectory(GetDirectoryInternal(InDirectory));
+				}
+				SaveStoreInfo(false);
+			}
+			catch(BoxException &e)
+			{
+				BOX_ERROR("Failed to save directory " <<
+					BOX_FORMAT_OBJECTID(InDirectory) <<
+					" after failing to store a batch of "
+					"files in it: " << e.what());
+			}
+		}
+		throw;
+	}
+
+	mBatchDirectoryID = 0;
+	if(rIDsOut.size() > alreadyStored)
+	{
+		SaveDirectory(GetDirectoryInternal(InDirectory));
+		SaveStoreInfo(false);
+	}
+}
+
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::ResolveDeferredPatches(
+//			 BackupStoreDirectory &, const BackupStoreFilename &)
+//		Purpose: Private. Reverse the patches of any versions of the
+//			 file which are stored as patches from older ones,
+//			 before something else changes them. Saves the
+//			 directory if anything was done.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::ResolveDeferredPatches(BackupStoreDirectory &rDir,
+	const BackupStoreFilename &rFilename)
+{
+	std::vector<BackupStoreDirectory::Entry *> pending;
+	BackupStoreDirectory::Iterator i(rDir);
+	BackupStoreDirectory::Entry *e = 0;
+	while((e = i.Next(BackupStoreDirectory::Entry::Flags_File |
+		BackupStoreDirectory::Entry::Flags_PatchFromOlder)) != 0)
+	{
+		if(e->NameMatches(rFilename))
+		{
+			pending.push_back(e);
+		}
+	}
+
+	if(pending.empty())
+	{
+		return;
+	}
+
+	if(rDir.GetObjectID() == mBatchDirectoryID)
+	{
+		// The directory is dropped from the cache if this fails,
+		// so write out the files stored earlier in the batch first
+		SaveDirectory(rDir);
+	}
+
+	BackupStoreDeferredPatch resolver(mStoreDiscSet, mAccountRootDir);
+	BackupStoreInfo::Adjustment adjustment = {};
+	try
+	{
+		for(std::vector<BackupStoreDirectory::Entry *>::iterator
+			p(pending.begin()); p != pending.end(); p++)
+		{
+			// Both versions change, so neither can be used for
+			// diffing as this session last saw them
+			mCanDiffFromFile.erase((*p)->GetObjectID());
+			mCanDiffFromFile.erase((*p)->GetDependsOlder());
+			BOX_INFO("Reversing deferred patch " <<
+				BOX_FORMAT_OBJECTID((*p)->GetObjectID()) <<
+				" before changing it");
+			resolver.Resolve(rDir, (*p)->GetObjectID(), adjustment);
+		}
+
+		SaveDirectory(rDir);
+	}
+	catch(...)
+	{
+		RemoveDirectoryFromCache(rDir.GetObjectID());
+		throw;
+	}
+
+	resolver.Commit();
+
+	mapStoreInfo->ChangeBlocksUsed(adjustment.mBlocksUsed);
+	mapStoreInfo->ChangeBlocksInCurrentFiles(adjustment.mBlocksInCurrentFiles);
+	mapStoreInfo->ChangeBlocksInOldFiles(adjustment.mBlocksInOldFiles);
+	mapStoreInfo->ChangeBlocksInDeletedFiles(adjustment.mBlocksInDeletedFiles);
+	SaveStoreInfo();
+}
+
+
 
 // --------------------------------------------------------------------------
 //
@@ -988,7 +1395,7 @@ bool BackupStoreContext::DeleteFile(const BackupStoreFilename &rFilename, int64_
 		while((e = i.Next(BackupStoreDirectory::Entry::Flags_File)) != 0)
 		{
 			// Compare name
-			if(e->GetName() == rFilename)
+			if(e->NameMatches(rFilename))
 			{
 
 				if(DeleteFromStore) 
@@ -1211,11 +1618,13 @@ bool BackupStoreContext::UndeleteFile(int64_t ObjectID, int64_t InDirectory)
 // --------------------------------------------------------------------------
 void BackupStoreContext::RemoveDirectoryFromCache(int64_t ObjectID)
 {
-	std::map<int64_t, BackupStoreDirectory*>::iterator item(mDirectoryCache.find(ObjectID));
+	std::map<int64_t, CachedDirectory>::iterator item(mDirectoryCache.find(ObjectID));
 	if(item != mDirectoryCache.end())
 	{
 		// Delete this cached object
-		delete item->second;
+		delete item->second.mpDirectory;
+		mDirectoryCacheSize -= item->second.mSize;
+		mDirectoryCacheLRU.erase(item->second.mLRUPosition);
 		// Erase the entry form the map
 		mDirectoryCache.erase(item);
 	}
@@ -1226,11 +1635,33 @@ void BackupStoreContext::RemoveDirectoryFromCache(int64_t ObjectID)
 //
 // Function
 //		Name:    BackupStoreContext::SaveDirectory(BackupStoreDirectory &)
-//		Purpose: Save directory back to disc, update time in cache
+//		Purpose: Save directory back to disc, update time in cache.
+//			 Other directories may then be evicted from the
+//			 cache, but rDir is still valid.
 //		Created: 2003/09/04
 //
 // --------------------------------------------------------------------------
 void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
+{
+	int64_t ObjectID = rDir.GetObjectID();
+	WriteDirectory(rDir);
+
+	// A session which only writes would otherwise grow the cache
+	// without limit
+	TrimDirectoryCache(ObjectID);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::WriteDirectory(BackupStoreDirectory &)
+//		Purpose: Private. Writes a directory, and its size into its
+//			 parent, without evicting anything from the cache.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::WriteDirectory(BackupStoreDirectory &rDir)
 {
 	if(mapStoreInfo.get() == 0)
 	{
@@ -1239,6 +1670,9 @@ void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
 
 	int64_t ObjectID = rDir.GetObjectID();
 
+	// Any file in it might be about to change
+	mapFileRangeStream.reset();
+
 	try
 	{
 		// Write to disc, adjust size in store info
@@ -1246,6 +1680,11 @@ void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
 		MakeObjectFilename(ObjectID, dirfn);
 		int64_t old_dir_size = rDir.GetUserInfo1_SizeInBlocks();
 
+		if(mapChangeJournal.get())
+		{
+			mapChangeJournal->RecordDirectoryChanged(ObjectID);
+		}
+
 		{
 			RaidFileWrite writeDir(mStoreDiscSet, dirfn);
 			writeDir.Open(true /* allow overwriting */);
@@ -1254,6 +1693,16 @@ void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
 			rDir.WriteToStream(buffer);
 			buffer.Flush();
 
+			// Keep the size of the cache up to date
+			std::map<int64_t, CachedDirectory>::iterator
+				item(mDirectoryCache.find(ObjectID));
+			if(item != mDirectoryCache.end())
+			{
+				mDirectoryCacheSize -= item->second.mSize;
+				item->second.mSize = rDir.GetMemoryUsage();
+				mDirectoryCacheSize += item->second.mSize;
+			}
+
 			// get the disc usage (must do this before commiting it)
 			int64_t dirSize = writeDir.GetDiscUsageInBlocks();
 
@@ -1292,8 +1741,8 @@ void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
 		{
 			int64_t ContainerID = rDir.GetContainerID();
 			BackupStoreDirectory& parent(
-				GetDirectoryInternal(ContainerID));
-			// rDir is now invalid
+				GetDirectoryInternal(ContainerID,
+					false /* don't evict rDir */));
 			BackupStoreDirectory::Entry* en =
 				parent.FindEntryByID(ObjectID);
 			if(!en)
@@ -1308,7 +1757,7 @@ void BackupStoreContext::SaveDirectory(BackupStoreDirectory &rDir)
 			{
 				ASSERT(en->GetSizeInBlocks() == old_dir_size);
 				en->SetSizeInBlocks(new_dir_size);
-				SaveDirectory(parent);
+				WriteDirectory(parent);
 			}
 		}
 	}
@@ -1361,7 +1810,7 @@ int64_t BackupStoreContext::AddDirectory(int64_t InDirectory,
 		while((en = i.Next(BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING,
 			BackupStoreDirectory::Entry::Flags_Deleted | BackupStoreDirectory::Entry::Flags_OldVersion)) != 0)	// Ignore deleted and old directories
 		{
-			if(en->GetName() == rFilename)
+			if(en->NameMatches(rFilename))
 			{
 				// Already exists
 				rAlreadyExists = true;
@@ -1383,6 +1832,11 @@ int64_t BackupStoreContext::AddDirectory(int64_t InDirectory,
 		// add the atttribues
 		emptyDir.SetAttributes(Attributes, AttributesModTime);
 
+		if(mapChangeJournal.get())
+		{
+			mapChangeJournal->RecordDirectoryChanged(id);
+		}
+
 		// Write...
 		RaidFileWrite dirFile(mStoreDiscSet, fn);
 		dirFile.Open(false /* no overwriting */);
@@ -1813,9 +2267,12 @@ void BackupStoreContext::ChangeDirAttributes(int64_t Directory, const Streamable
 
 		// Set attributes
 		dir.SetAttributes(Attributes, AttributesModTime);
-		
+		int64_t ContainerID = dir.GetContainerID();
+
+		// Save back, before getting the parent might evict it
+		SaveDirectory(dir);
+
 		if (ModificationTime != 0) {
-				int64_t ContainerID = dir.GetContainerID();
 				BackupStoreDirectory& parent(
 					GetDirectoryInternal(ContainerID));
 			
@@ -1825,9 +2282,6 @@ void BackupStoreContext::ChangeDirAttributes(int64_t Directory, const Streamable
 				en->SetModificationTime(ModificationTime);
 				SaveDirectory(parent);
 		}
-
-		// Save back
-		SaveDirectory(dir);
 	}
 	catch(...)
 	{
@@ -1870,7 +2324,7 @@ bool BackupStoreContext::ChangeFileAttributes(const BackupStoreFilename &rFilena
 			BackupStoreDirectory::Entry::Flags_Deleted | BackupStoreDirectory::Entry::Flags_OldVersion)
 			) != 0)
 		{
-			if(en->GetName() == rFilename)
+			if(en->NameMatches(rFilename))
 			{
 				// Set attributes
 				en->SetAttributes(Attributes, AttributesHash);
@@ -1945,6 +2399,125 @@ void BackupStoreContext::GetObjectInfos(int64_t ObjectID, bool &rIsDirectory, in
 
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::GetBlockDatabase()
+//		Purpose: Private. Opens the account's block database, if
+//			 this session hasn't already.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreBlockDatabase &BackupStoreContext::GetBlockDatabase()
+{
+	if(mReadOnly)
+	{
+		THROW_EXCEPTION(BackupStoreException, ContextIsReadOnly)
+	}
+
+	if(mapBlockDatabase.get() == 0)
+	{
+		BackupStoreAccountDatabase::Entry account(mClientID,
+			mStoreDiscSet);
+		mapBlockDatabase = BackupStoreBlockDatabase::Open(account);
+	}
+
+	return *mapBlockDatabase;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::AddBlockFingerprints(int64_t,
+//			 const std::vector<uint64_t> &)
+//		Purpose: Record the blocks in a file, which must exist, so
+//			 that later uploads can find them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::AddBlockFingerprints(int64_t ObjectID,
+	const std::vector<uint64_t> &rFingerprints)
+{
+	if(!ObjectExists(ObjectID, ObjectExists_File))
+	{
+		THROW_EXCEPTION(BackupStoreException, ObjectDoesNotExist)
+	}
+
+	GetBlockDatabase().AddBlocks(ObjectID, rFingerprints);
+
+	// It was just uploaded, so it's complete unless it's a patch
+	// already, and that will be checked if it's ever found.
+	mCanDiffFromFile.erase(ObjectID);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::FindFileWithBlock(uint64_t)
+//		Purpose: Returns the ID of a file containing the block, which
+//			 a client can diff a new file against, or 0. Files
+//			 which have been deleted or turned into patches of
+//			 newer versions since they recorded the block can't
+//			 be used.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreContext::FindFileWithBlock(uint64_t Fingerprint)
+{
+	int64_t id = GetBlockDatabase().FindBlock(Fingerprint);
+	if(id == 0 || !CanDiffFromOtherFile(id))
+	{
+		return 0;
+	}
+
+	return id;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::CanDiffFromOtherFile(int64_t)
+//		Purpose: Private. Whether a file exists and is stored
+//			 complete, rather than as a patch, so that a new file
+//			 in another directory can be diffed against it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreContext::CanDiffFromOtherFile(int64_t ObjectID)
+{
+	std::map<int64_t, bool>::const_iterator i(
+		mCanDiffFromFile.find(ObjectID));
+	if(i != mCanDiffFromFile.end())
+	{
+		return i->second;
+	}
+
+	bool canDiff = false;
+	if(ObjectID > 0 && ObjectID <= mapRefCount->GetLastObjectIDUsed() &&
+		mapRefCount->GetRefCount(ObjectID) > 0 &&
+		ObjectExists(ObjectID, ObjectExists_File))
+	{
+		// A file which depends on another has a block index which
+		// refers to that file, and can't be diffed against.
+		std::auto_ptr<IOStream> object(OpenObject(ObjectID));
+		BackupStoreFile::MoveStreamPositionToBlockIndex(*object);
+		file_BlockIndexHeader hdr;
+		if(object->ReadFullBuffer(&hdr, sizeof(hdr), 0) &&
+			ntohl(hdr.mMagicValue) == OBJECTMAGIC_FILE_BLOCKS_MAGIC_VALUE_V1 &&
+			hdr.mOtherFileID == 0)
+		{
+			canDiff = true;
+		}
+	}
+
+	mCanDiffFromFile[ObjectID] = canDiff;
+	return canDiff;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -2040,6 +2613,46 @@ std::auto_ptr<IOStream> BackupStoreContext::OpenObject(int64_t ObjectID)
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::GetFileRangeStream(int64_t)
+//		Purpose: Returns the stream of the complete file last given to
+//			 SetFileRangeStream(), if it's for this object, or 0.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream *BackupStoreContext::GetFileRangeStream(int64_t ObjectID)
+{
+	if(mapFileRangeStream.get() == 0 || mFileRangeObjectID != ObjectID)
+	{
+		return 0;
+	}
+
+	return mapFileRangeStream.get();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreContext::SetFileRangeStream(int64_t,
+//			 std::auto_ptr<IOStream>)
+//		Purpose: Keeps a seekable stream of a complete file, which may
+//			 be expensive to set up if it's stored as a patch, for
+//			 reading more ranges from. It's discarded as soon as
+//			 any directory is written.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreContext::SetFileRangeStream(int64_t ObjectID,
+	std::auto_ptr<IOStream> apStream)
+{
+	mFileRangeObjectID = ObjectID;
+	mapFileRangeStream = apStream;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -2162,13 +2775,20 @@ void BackupStoreContext::MoveObject(int64_t ObjectID, int64_t MoveFromDirectory,
 				THROW_EXCEPTION(BackupStoreException, CouldNotFindEntryInDirectory)
 			}
 
+			// A version still stored as a patch from the one
+			// before must not be separated from it by name
+			if(en->IsFile())
+			{
+				ResolveDeferredPatches(dir, en->GetName());
+			}
+
 			// Check the new name doens't already exist (optionally ignoring deleted files)
 			{
 				BackupStoreDirectory::Iterator i(dir);
 				BackupStoreDirectory::Entry *c = 0;
 				while((c = i.Next(BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING, targetSearchExcludeFlags)) != 0)
 				{
-					if(c->GetName() == rNewFilename)
+					if(c->NameMatches(rNewFilename))
 					{
 						THROW_EXCEPTION(BackupStoreException, NameAlreadyExistsInDirectory)
 					}
@@ -2183,7 +2803,7 @@ void BackupStoreContext::MoveObject(int64_t ObjectID, int64_t MoveFromDirectory,
 				BackupStoreDirectory::Entry *c = 0;
 				while((c = i.Next()) != 0)
 				{
-					if(c->GetName() == en->GetName())
+					if(c->NameMatches(*en))
 					{
 						// Rename this one
 						c->SetName(rNewFilename);
@@ -2235,6 +2855,12 @@ void BackupStoreContext::MoveObject(int64_t ObjectID, int64_t MoveFromDirectory,
 				THROW_EXCEPTION(BackupStoreException, CouldNotFindEntryInDirectory)
 			}
 
+			// Likewise, it must stay in the same directory
+			if(en->IsFile())
+			{
+				ResolveDeferredPatches(from, en->GetName());
+			}
+
 			// Need to get all the entries with the same name?
 			if(MoveAllWithSameName)
 			{
@@ -2243,7 +2869,7 @@ void BackupStoreContext::MoveObject(int64_t ObjectID, int64_t MoveFromDirectory,
 				BackupStoreDirectory::Entry *c = 0;
 				while((c = i.Next()) != 0)
 				{
-					if(c->GetName() == en->GetName())
+					if(c->NameMatches(*en))
 					{
 						// Copy
 						moving.push_back(new BackupStoreDirectory::Entry(*c));
@@ -2276,7 +2902,7 @@ void BackupStoreContext::MoveObject(int64_t ObjectID, int64_t MoveFromDirectory,
 				BackupStoreDirectory::Entry *c = 0;
 				while((c = i.Next(BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING, targetSearchExcludeFlags)) != 0)
 				{
-					if(c->GetName() == rNewFilename)
+					if(c->NameMatches(rNewFilename))
 					{
 						THROW_EXCEPTION(BackupStoreException, NameAlreadyExistsInDirectory)
 					}
@@ -10,12 +10,17 @@
 #ifndef BACKUPCONTEXT__H
 #define BACKUPCONTEXT__H
 
+#include <deque>
 #include <string>
+#include <list>
 #include <map>
 #include <memory>
 #include <iostream>
+#include <vector>
 
 #include "autogen_BackupProtocol.h"
+#include "BackupStoreBlockDatabase.h"
+#include "BackupStoreChangeJournal.h"
 #include "BackupStoreInfo.h"
 #include "BackupStoreRefCountDatabase.h"
 #include "NamedLock.h"
@@ -292,6 +297,10 @@ public:
 		const BackupStoreFilename &rFilename,
 		bool MarkFileWithSameNameAsOldVersions,
 		uint64_t ResumeOffset);
+	void AddFiles(IOStream &rFiles,
+		int64_t InDirectory,
+		int32_t NumberOfFiles,
+		std::vector<int64_t> &rIDsOut);
 	int64_t AddDirectory(int64_t InDirectory,
 		const BackupStoreFilename &rFilename,
 		const StreamableMemBlock &Attributes,
@@ -314,7 +323,14 @@ public:
 	};
 	bool ObjectExists(int64_t ObjectID, int MustBe = ObjectExists_Anything);
 	std::auto_ptr<IOStream> OpenObject(int64_t ObjectID);
+	IOStream *GetFileRangeStream(int64_t ObjectID);
+	void SetFileRangeStream(int64_t ObjectID, std::auto_ptr<IOStream> apStream);
 	void GetObjectInfos(int64_t ObjectID, bool &rIsDirectory, int64_t &rContainerID);
+
+	// Blocks shared between files, see BackupStoreBlockDatabase
+	void AddBlockFingerprints(int64_t ObjectID,
+		const std::vector<uint64_t> &rFingerprints);
+	int64_t FindFileWithBlock(uint64_t Fingerprint);
 	
 	// Info
 	int32_t GetClientID() const {return mClientID;}
@@ -326,14 +342,31 @@ public:
 	SessionInfos &GetSessionInfos() { return mSessionInfos; }
 	box_time_t GetSessionStartTime() { return mSessionInfos.GetStartTime(); }
 
+	// Directory cache size limit, in bytes of memory used by the cached
+	// directories, and statistics
+	void SetDirectoryCacheMaxSize(int64_t MaxSize);
+	int64_t GetDirectoryCacheMaxSize() const {return mDirectoryCacheMaxSize;}
+	int64_t GetDirectoryCacheSize() const {return mDirectoryCacheSize;}
+	int64_t GetDirectoryCacheHits() const {return mDirectoryCacheHits;}
+	int64_t GetDirectoryCacheMisses() const {return mDirectoryCacheMisses;}
+	int64_t GetDirectoryCacheEvictions() const {return mDirectoryCacheEvictions;}
+
+	// Store patches from older versions as they are, and leave them for
+	// housekeeping to reverse, see BackupStoreDeferredPatch
+	void SetDeferReverseDiffs(bool Defer) {mDeferReverseDiffs = Defer;}
+
 private:
 	void MakeObjectFilename(int64_t ObjectID, std::string &rOutput, bool EnsureDirectoryExists = false);
 	BackupStoreDirectory &GetDirectoryInternal(int64_t ObjectID,
 		bool AllowFlushCache = true);
 	void SaveDirectory(BackupStoreDirectory &rDir);
+	void WriteDirectory(BackupStoreDirectory &rDir);
 	void RemoveDirectoryFromCache(int64_t ObjectID);
+	void TrimDirectoryCache(int64_t KeepObjectID);
 	void ClearDirectoryCache();
 	void DeleteDirectoryRecurse(int64_t ObjectID, bool Undelete, uint16_t Flags = 0, bool DeleteFromStore = false);
+	void ResolveDeferredPatches(BackupStoreDirectory &rDir,
+		const BackupStoreFilename &rFilename);
 	int64_t AllocateObjectID();
 
 	std::string mConnectionDetails;
@@ -355,8 +388,47 @@ private:
 	// Refcount database
 	std::auto_ptr<BackupStoreRefCountDatabase> mapRefCount;
 
-	// Directory cache
-	std::map<int64_t, BackupStoreDirectory*> mDirectoryCache;
+	// Directories written in this session, for housekeeping to rescan
+	std::auto_ptr<BackupStoreChangeJournal> mapChangeJournal;
+
+	// Opened when first used. Whether each file it has returned can be
+	// diffed against is remembered for the rest of the session.
+	std::auto_ptr<BackupStoreBlockDatabase> mapBlockDatabase;
+	std::map<int64_t, bool> mCanDiffFromFile;
+	BackupStoreBlockDatabase &GetBlockDatabase();
+	bool CanDiffFromOtherFile(int64_t ObjectID);
+
+	// Directory cache. The most recently used directories are at the
+	// front of mDirectoryCacheLRU, and the least recently used are
+	// evicted from the back when the total size is over the limit.
+	typedef struct
+	{
+		BackupStoreDirectory *mpDirectory;
+		int64_t mSize;
+		std::list<int64_t>::iterator mLRUPosition;
+	} CachedDirectory;
+	std::map<int64_t, CachedDirectory> mDirectoryCache;
+	std::list<int64_t> mDirectoryCacheLRU;
+	int64_t mDirectoryCacheSize;
+	int64_t mDirectoryCacheMaxSize;
+	int64_t mDirectoryCacheHits;
+	int64_t mDirectoryCacheMisses;
+	int64_t mDirectoryCacheEvictions;
+
+	// Directory which AddFiles() is adding to, which AddFile() leaves
+	// to it to write back, or 0
+	int64_t mBatchDirectoryID;
+	bool mDeferReverseDiffs;
+
+	// The complete file which GetFileRange last read from, kept for the
+	// next range of it until anything is written
+	int64_t mFileRangeObjectID;
+	std::auto_ptr<IOStream> mapFileRangeStream;
+#ifndef BOX_RELEASE_BUILD
+	// The most recently evicted directories are kept, invalidated, to
+	// catch any use of references to them.
+	std::deque<BackupStoreDirectory*> mEvictedDirectories;
+#endif
 
 	// SessionInfos
 	SessionInfos mSessionInfos;
@@ -0,0 +1,259 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreDeferredPatch.cpp
+//		Purpose: Reverse the patches of file versions which were stored
+//			 as patches from the versions before them
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <memory>
+
+#include "BackupConstants.h"
+#include "BackupStoreDeferredPatch.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFile.h"
+#include "BackupStoreFileWire.h"
+#include "RaidFileRead.h"
+#include "RaidFileWrite.h"
+#include "StoreStructure.h"
+
+#include "MemLeakFindOn.h"
+
+namespace
+{
+	// Change the size of an entry, and the counts of whichever kinds
+	// of file it's counted as
+	void SetEntrySize(BackupStoreDirectory::Entry &rEntry,
+		int64_t NewSizeInBlocks,
+		BackupStoreInfo::Adjustment &rAdjustment)
+	{
+		int64_t delta = NewSizeInBlocks - rEntry.GetSizeInBlocks();
+		rAdjustment.mBlocksUsed += delta;
+		if(rEntry.IsOld())
+		{
+			rAdjustment.mBlocksInOldFiles += delta;
+		}
+		if(rEntry.IsDeleted())
+		{
+			rAdjustment.mBlocksInDeletedFiles += delta;
+		}
+		if(!rEntry.IsOld() && !rEntry.IsDeleted())
+		{
+			rAdjustment.mBlocksInCurrentFiles += delta;
+		}
+		rEntry.SetSizeInBlocks(NewSizeInBlocks);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::BackupStoreDeferredPatch(
+//			 int, const std::string &)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDeferredPatch::BackupStoreDeferredPatch(int DiscSet,
+	const std::string &rStoreRoot)
+	: mDiscSet(DiscSet),
+	  mStoreRoot(rStoreRoot)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::~BackupStoreDeferredPatch()
+//		Purpose: Destructor. Discards any old versions which weren't
+//			 committed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDeferredPatch::~BackupStoreDeferredPatch()
+{
+	for(std::vector<RaidFileWrite *>::iterator i(mOlderVersions.begin());
+		i != mOlderVersions.end(); i++)
+	{
+		delete *i;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::MakeObjectFilename(int64_t,
+//			 std::string &)
+//		Purpose: Private. Generate the filename of an object.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDeferredPatch::MakeObjectFilename(int64_t ObjectID,
+	std::string &rFilenameOut)
+{
+	StoreStructure::MakeObjectFilename(ObjectID, mStoreRoot, mDiscSet,
+		rFilenameOut, false /* don't bother ensuring the directory exists */);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::IsPending(
+//			 const BackupStoreDirectory &,
+//			 BackupStoreDirectory::Entry &)
+//		Purpose: Returns true if the entry is a patch from an older
+//			 version, or is that older version.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreDeferredPatch::IsPending(
+	const BackupStoreDirectory &rDirectory,
+	BackupStoreDirectory::Entry &rEntry)
+{
+	if(rEntry.IsPatchFromOlder())
+	{
+		return true;
+	}
+
+	if(rEntry.GetDependsNewer() == 0)
+	{
+		return false;
+	}
+
+	BackupStoreDirectory::Entry *pnewer =
+		rDirectory.FindEntryByID(rEntry.GetDependsNewer());
+	return pnewer != 0 && pnewer->IsPatchFromOlder();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::Resolve(
+//			 BackupStoreDirectory &, int64_t,
+//			 BackupStoreInfo::Adjustment &)
+//		Purpose: Combine the patch of a file version with the older
+//			 version, and make the older version a patch from the
+//			 result. Updates the entries of both versions, and adds
+//			 the changes in their sizes to the adjustment.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDeferredPatch::Resolve(BackupStoreDirectory &rDirectory,
+	int64_t ObjectID, BackupStoreInfo::Adjustment &rAdjustment)
+{
+	BackupStoreDirectory::Entry *pnewer = rDirectory.FindEntryByID(ObjectID);
+	if(pnewer == 0 || !pnewer->IsPatchFromOlder())
+	{
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+
+	int64_t olderID = pnewer->GetDependsOlder();
+	BackupStoreDirectory::Entry *polder = (olderID == 0) ? 0 :
+		rDirectory.FindEntryByID(olderID);
+	if(polder == 0 || polder->GetDependsNewer() != ObjectID)
+	{
+		THROW_EXCEPTION(BackupStoreException, PatchChainInfoBadInDirectory)
+	}
+
+	std::string newerFilename, olderFilename;
+	MakeObjectFilename(ObjectID, newerFilename);
+	MakeObjectFilename(olderID, olderFilename);
+
+	// If the directory couldn't be saved after the complete version was
+	// committed last time, there's no patch left to reverse, so the two
+	// versions just stop depending on each other.
+	std::auto_ptr<RaidFileRead> patch(RaidFileRead::Open(mDiscSet,
+		newerFilename));
+	BackupStoreFile::MoveStreamPositionToBlockIndex(*patch);
+	file_BlockIndexHeader hdr;
+	if(!patch->ReadFullBuffer(&hdr, sizeof(hdr), 0))
+	{
+		THROW_EXCEPTION(BackupStoreException,
+			CouldntReadEntireStructureFromStream)
+	}
+
+	if(box_ntoh64(hdr.mOtherFileID) == 0)
+	{
+		BOX_WARNING("Object " << BOX_FORMAT_OBJECTID(ObjectID) <<
+			" is already complete, so " <<
+			BOX_FORMAT_OBJECTID(olderID) << " stays complete too");
+		SetEntrySize(*pnewer, patch->GetDiscUsageInBlocks(),
+			rAdjustment);
+		pnewer->RemoveFlags(BackupStoreDirectory::Entry::Flags_PatchFromOlder);
+		pnewer->SetDependsOlder(0);
+		polder->SetDependsNewer(0);
+		return;
+	}
+
+	// Open everything twice, as CombineFile() and ReverseDiffFile() need
+	std::auto_ptr<RaidFileRead> patch2(RaidFileRead::Open(mDiscSet,
+		newerFilename));
+	std::auto_ptr<RaidFileRead> from(RaidFileRead::Open(mDiscSet,
+		olderFilename));
+	std::auto_ptr<RaidFileRead> from2(RaidFileRead::Open(mDiscSet,
+		olderFilename));
+	patch->Seek(0, IOStream::SeekType_Absolute);
+
+	RaidFileWrite combined(mDiscSet, newerFilename);
+	combined.Open(true /* allow overwriting */);
+	BackupStoreFile::CombineFile(*patch, *patch2, *from, combined);
+
+	std::auto_ptr<RaidFileWrite> reversed(new RaidFileWrite(mDiscSet,
+		olderFilename));
+	reversed->Open(true /* allow overwriting */);
+	patch->Seek(0, IOStream::SeekType_Absolute);
+	from->Seek(0, IOStream::SeekType_Absolute);
+	bool completelyDifferent = false;
+	BackupStoreFile::ReverseDiffFile(*patch, *from, *from2, *reversed,
+		olderID, &completelyDifferent);
+
+	// Sizes must be found before committing
+	int64_t newerSize = combined.GetDiscUsageInBlocks();
+	int64_t olderSize = reversed->GetDiscUsageInBlocks();
+
+	// Until the directory is saved, it says that the newer version is
+	// still a patch. If it never is, the check above deals with that.
+	combined.Commit(BACKUP_STORE_CONVERT_TO_RAID_IMMEDIATELY);
+	mOlderVersions.push_back(reversed.release());
+
+	SetEntrySize(*pnewer, newerSize, rAdjustment);
+	SetEntrySize(*polder, olderSize, rAdjustment);
+	pnewer->RemoveFlags(BackupStoreDirectory::Entry::Flags_PatchFromOlder);
+	if(completelyDifferent)
+	{
+		pnewer->SetDependsOlder(0);
+		polder->SetDependsNewer(0);
+	}
+
+	BOX_TRACE("Reversed deferred patch " << BOX_FORMAT_OBJECTID(ObjectID) <<
+		" from " << BOX_FORMAT_OBJECTID(olderID));
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDeferredPatch::Commit()
+//		Purpose: Commit the older versions which are now patches, once
+//			 the directory which says so has been saved.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDeferredPatch::Commit()
+{
+	while(!mOlderVersions.empty())
+	{
+		std::auto_ptr<RaidFileWrite> older(mOlderVersions.back());
+		mOlderVersions.pop_back();
+		older->Commit(BACKUP_STORE_CONVERT_TO_RAID_IMMEDIATELY);
+	}
+}
@@ -0,0 +1,67 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreDeferredPatch.h
+//		Purpose: Reverse the patches of file versions which were stored
+//			 as patches from the versions before them
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTOREDEFERREDPATCH__H
+#define BACKUPSTOREDEFERREDPATCH__H
+
+#include <string>
+#include <vector>
+
+#include "BackupStoreDirectory.h"
+#include "BackupStoreInfo.h"
+
+class RaidFileWrite;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreDeferredPatch
+//		Purpose: When the store defers reversing a patch uploaded by a
+//			 client, the new version is stored as that patch, with
+//			 Flags_PatchFromOlder set, and the version it's from
+//			 stays a complete file. The usual DependsOlder and
+//			 DependsNewer links join the two.
+//
+//			 Resolve() makes the new version complete and the old
+//			 one a patch back from it, as if it had been done when
+//			 the file was uploaded. The new version is committed
+//			 straight away, but the old one must not be until the
+//			 caller has saved the directory, then called Commit().
+//			 Otherwise the changes are discarded.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreDeferredPatch
+{
+public:
+	BackupStoreDeferredPatch(int DiscSet, const std::string &rStoreRoot);
+	~BackupStoreDeferredPatch();
+private:
+	// no copying
+	BackupStoreDeferredPatch(const BackupStoreDeferredPatch &);
+	BackupStoreDeferredPatch &operator=(const BackupStoreDeferredPatch &);
+
+public:
+	void Resolve(BackupStoreDirectory &rDirectory, int64_t ObjectID,
+		BackupStoreInfo::Adjustment &rAdjustment);
+	void Commit();
+
+	static bool IsPending(const BackupStoreDirectory &rDirectory,
+		BackupStoreDirectory::Entry &rEntry);
+
+private:
+	void MakeObjectFilename(int64_t ObjectID, std::string &rFilenameOut);
+
+	int mDiscSet;
+	std::string mStoreRoot;
+	std::vector<RaidFileWrite *> mOlderVersions;
+};
+
+#endif // BACKUPSTOREDEFERREDPATCH__H
@@ -10,12 +10,16 @@
 #include "Box.h"
 
 #include <sys/types.h>
-#include <map>
+#include <string.h>
+
+#include <algorithm>
+
 #include "BackupConstants.h"
 #include "BackupStoreDirectory.h"
 #include "IOStream.h"
 #include "BackupStoreException.h"
 #include "BackupStoreObjectMagic.h"
+#include "MemBlockStream.h"
 
 #include "MemLeakFindOn.h"
 
@@ -117,11 +121,106 @@ BackupStoreDirectory::BackupStoreDirectory(int64_t ObjectID, int64_t ContainerID
 //
 // --------------------------------------------------------------------------
 BackupStoreDirectory::~BackupStoreDirectory()
+{
+	DeleteAllEntries();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::DeleteEntryObject(Entry *)
+//		Purpose: Private. Deletes an entry which has been removed
+//			 from mEntries, unless it belongs to mEntriesRead.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::DeleteEntryObject(Entry *pEntry)
+{
+	if(EntryWasRead(pEntry))
+	{
+		return;
+	}
+	delete pEntry;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::DeleteAllEntries()
+//		Purpose: Private. Deletes every entry, and what was read
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::DeleteAllEntries()
 {
 	for(std::vector<Entry*>::iterator i(mEntries.begin()); i != mEntries.end(); ++i)
 	{
-		delete (*i);
+		DeleteEntryObject(*i);
+	}
+	mEntries.clear();
+	mEntriesRead.clear();
+	mEncodedData.clear();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::GetMemoryUsage()
+//		Purpose: Estimates the memory used by the directory and its
+//			 entries, in bytes, which may be several times the
+//			 size of its stream format.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreDirectory::GetMemoryUsage() const
+{
+	ASSERT(!mInvalidated); // Compiled out of release builds
+	int64_t size = sizeof(*this) +
+		mEntries.capacity() * sizeof(Entry *) +
+		mEntriesRead.capacity() * sizeof(Entry) +
+		mEncodedData.capacity() + mAttributes.GetSize();
+
+	for(std::vector<Entry*>::const_iterator i(mEntries.begin());
+		i != mEntries.end(); ++i)
+	{
+		const Entry *pEntry = *i;
+		if(!EntryWasRead(pEntry))
+		{
+			size += sizeof(Entry);
+		}
+
+		// Names and attributes still in mEncodedData are counted
+		// already, but once used they have copies of their own
+		if(pEntry->mpEncodedName == 0)
+		{
+			size += pEntry->mName.GetEncodedFilename().size();
+		}
+		if(pEntry->mpEncodedAttributes == 0)
+		{
+			size += pEntry->mAttributes.GetSize();
+		}
+	}
+
+	return size;
+}
+
+
+// Appends Size bytes from the stream to rBuffer, and returns the offset
+// at which they start
+static int ReadEncodedData(IOStream &rStream, int Timeout,
+	std::vector<char> &rBuffer, int Size)
+{
+	int offset = rBuffer.size();
+	rBuffer.resize(offset + Size);
+	if(Size > 0 && !rStream.ReadFullBuffer(&rBuffer[offset], Size,
+		0 /* not interested in bytes read if this fails */, Timeout))
+	{
+		THROW_EXCEPTION(BackupStoreException, CouldntReadEntireStructureFromStream)
 	}
+	return offset;
 }
 
 // --------------------------------------------------------------------------
@@ -171,32 +270,78 @@ void BackupStoreDirectory::ReadFromStream(IOStream &rStream, int Timeout)
 
 	// Decode count
 	int count = ntohl(hdr.mNumEntries);
-
-	// Clear existing list
-	for(std::vector<Entry*>::iterator i = mEntries.begin();
-		i != mEntries.end(); i++)
+	if(count < 0)
 	{
-		delete (*i);
+		THROW_EXCEPTION(BackupStoreException, BadDirectoryFormat)
 	}
-	mEntries.clear();
 
-	// Read them in!
+	// Clear existing list
+	DeleteAllEntries();
+
+	// Read them in, into one array of entries and one buffer for all
+	// the names and attributes. The buffer may move as it grows, so
+	// remember offsets, and point the entries at them at the end.
+	std::vector<Entry> entries(count);
+	std::vector<char> encoded;
+	std::vector<int> offsets(count * 2);
 	for(int c = 0; c < count; ++c)
 	{
-		Entry *pen = new Entry;
-		try
-		{
-			// Read from stream
-			pen->ReadFromStream(rStream, Timeout, magicValue);
+		Entry &en(entries[c]);
 
-			// Add to list
-			mEntries.push_back(pen);
+		en_StreamFormat entry;
+		if(!rStream.ReadFullBuffer(&entry, sizeof(entry),
+			0 /* not interested in bytes read if this fails */, Timeout))
+		{
+			THROW_EXCEPTION(BackupStoreException, CouldntReadEntireStructureFromStream)
+		}
+		en.mModificationTime = box_ntoh64(entry.mModificationTime);
+		en.mObjectID = box_ntoh64(entry.mObjectID);
+		en.mSizeInBlocks = box_ntoh64(entry.mSizeInBlocks);
+		en.mAttributesHash = box_ntoh64(entry.mAttributesHash);
+		en.mFlags = ntohs(entry.mFlags);
+
+		// The name, checked as BackupStoreFilename would check it
+		char nameHdr[2];
+		if(!rStream.ReadFullBuffer(nameHdr, sizeof(nameHdr), 0, Timeout))
+		{
+			THROW_EXCEPTION(BackupStoreException, CouldntReadEntireStructureFromStream)
+		}
+		int nameSize = BACKUPSTOREFILENAME_GET_SIZE(nameHdr);
+		int encoding = BACKUPSTOREFILENAME_GET_ENCODING(nameHdr);
+		if(nameSize < (int)sizeof(nameHdr) ||
+			encoding < BackupStoreFilename::Encoding_Min ||
+			encoding > BackupStoreFilename::Encoding_Max)
+		{
+			THROW_EXCEPTION(BackupStoreException, InvalidBackupStoreFilename)
 		}
-		catch(...)
+		offsets[c * 2] = encoded.size();
+		encoded.insert(encoded.end(), nameHdr, nameHdr + sizeof(nameHdr));
+		ReadEncodedData(rStream, Timeout, encoded,
+			nameSize - sizeof(nameHdr));
+		en.mEncodedNameSize = nameSize;
+
+		// The attributes, as a StreamableMemBlock
+		int32_t attrSize;
+		if(!rStream.ReadFullBuffer(&attrSize, sizeof(attrSize), 0, Timeout))
 		{
-			delete pen;
-			throw;
+			THROW_EXCEPTION(CommonException, StreamableMemBlockIncompleteRead)
 		}
+		attrSize = ntohl(attrSize);
+		if(attrSize < 0)
+		{
+			THROW_EXCEPTION(BackupStoreException, BadDirectoryFormat)
+		}
+		offsets[c * 2 + 1] = ReadEncodedData(rStream, Timeout, encoded,
+			attrSize);
+		en.mEncodedAttributesSize = attrSize;
+
+		en.ReadTimesFromStream(rStream, Timeout, magicValue);
+	}
+
+	for(int c = 0; c < count; ++c)
+	{
+		entries[c].mpEncodedName = encoded.data() + offsets[c * 2];
+		entries[c].mpEncodedAttributes = encoded.data() + offsets[c * 2 + 1];
 	}
 
 	// Read in dependency info?
@@ -205,66 +350,118 @@ void BackupStoreDirectory::ReadFromStream(IOStream &rStream, int Timeout)
 		// Read in extra dependency data
 		for(int c = 0; c < count; ++c)
 		{
-			mEntries[c]->ReadFromStreamDependencyInfo(rStream, Timeout);
+			entries[c].ReadFromStreamDependencyInfo(rStream, Timeout);
 		}
 	}
+
+	// Swapping vectors doesn't move their contents, so the pointers into
+	// them are still good
+	mEntriesRead.swap(entries);
+	mEncodedData.swap(encoded);
+	mEntries.reserve(count);
+	for(int c = 0; c < count; ++c)
+	{
+		mEntries.push_back(&mEntriesRead[c]);
+	}
 }
 
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreDirectory::WriteToStream(IOStream &, int16_t, int16_t, bool, bool)
-//		Purpose: Writes a selection of entries to a stream
-//		Created: 2003/08/26
+//		Name:    BackupStoreDirectory::GetEntriesToList(int16_t,
+//			 int16_t, box_time_t, std::vector<Entry *> &)
+//		Purpose: Selects the entries which WriteToStream() would write
+//			 with the same arguments, in the same order
+//		Created: 2026/10/18
 //
 // --------------------------------------------------------------------------
-#include "autogen_BackupProtocol.h"
-#include <iostream>
-#include <BoxTimeToText.h>
+namespace
+{
+	struct EntryNameLess
+	{
+		bool operator()(const BackupStoreDirectory::Entry *pA,
+			const BackupStoreDirectory::Entry *pB) const
+		{
+			return pA->CompareName(*pB) < 0;
+		}
+	};
+}
 
-void BackupStoreDirectory::WriteToStream(IOStream &rStream, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, box_time_t SnapshotTime, bool StreamAttributes, bool StreamDependencyInfo, uint32_t ProtocolVersion) const
+void BackupStoreDirectory::GetEntriesToList(int16_t FlagsMustBeSet,
+	int16_t FlagsNotToBeSet, box_time_t SnapshotTime,
+	std::vector<Entry *> &rEntriesOut) const
 {
 	ASSERT(!mInvalidated); // Compiled out of release builds
-	
-
-	std::multimap<std::string, BackupStoreDirectory::Entry*> entries;
- 
-	// we'll use this to filter deleted versions for the snapshot
-	bool hide_deleted = FlagsNotToBeSet & BackupProtocolListDirectory::Flags_Deleted;
 
 	// If we're travelling in time we won't filter old or deleted objects
  	if( SnapshotTime != 0 )
 	{
-		FlagsNotToBeSet &= ~BackupProtocolListDirectory::Flags_OldVersion;
-		FlagsNotToBeSet &= ~BackupProtocolListDirectory::Flags_Deleted;
+		FlagsNotToBeSet &= ~BackupStoreDirectory::Entry::Flags_OldVersion;
+		FlagsNotToBeSet &= ~BackupStoreDirectory::Entry::Flags_Deleted;
 	}
 
+	rEntriesOut.clear();
 	Entry *pen = 0;
 	Iterator i(*this);
 	while((pen = i.Next(FlagsMustBeSet, FlagsNotToBeSet)) != 0)
 	{
-		if ( SnapshotTime != 0 ) {
-
-			// if object was backed up before the SnapshotTime
-			// and it wasn't deleted before the SnapshotTime (in case we are hiding deleted objects)
-			if( pen->GetBackupTime() <= SnapshotTime &&
-				!(pen->IsDeleted() && pen->GetDeleteTime() > 0 && pen->GetDeleteTime() <= SnapshotTime)
-				)  {
-				if( auto res = entries.find(pen->mName.GetEncodedFilename()); res != entries.end() ) {
-					// Be sure to keep the newest version
-					if ( res->second->mBackupTime < pen->mBackupTime ) {
-						res->second = pen;
-					}
-				} else {
-					entries.insert({pen->mName.GetEncodedFilename(),  pen});	
-				}			
-			}
+		// if object was backed up before the SnapshotTime
+		// and it wasn't deleted before the SnapshotTime (in case we are hiding deleted objects)
+		if(SnapshotTime == 0 || (pen->GetBackupTime() <= SnapshotTime &&
+			!(pen->IsDeleted() && pen->GetDeleteTime() > 0 && pen->GetDeleteTime() <= SnapshotTime)))
+		{
+			rEntriesOut.push_back(pen);
+		}
+	}
 
-		} else {
-			entries.insert({pen->mName.GetEncodedFilename(), pen});
+	// Sorted by encoded name, keeping the directory's order for entries
+	// with the same name
+	std::stable_sort(rEntriesOut.begin(), rEntriesOut.end(),
+		EntryNameLess());
+
+	if(SnapshotTime == 0)
+	{
+		return;
+	}
+
+	// Only the newest version of each name existed at the SnapshotTime
+	std::vector<Entry *>::iterator out(rEntriesOut.begin());
+	for(std::vector<Entry *>::iterator e(rEntriesOut.begin());
+		e != rEntriesOut.end(); )
+	{
+		Entry *pnewest = *e;
+		for(++e; e != rEntriesOut.end() && (*e)->NameMatches(*pnewest); ++e)
+		{
+			if(pnewest->mBackupTime < (*e)->mBackupTime)
+			{
+				pnewest = *e;
+			}
 		}
+		*(out++) = pnewest;
 	}
-	
+	rEntriesOut.erase(out, rEntriesOut.end());
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::WriteToStream(IOStream &, int16_t, int16_t, bool, bool)
+//		Purpose: Writes a selection of entries to a stream
+//		Created: 2003/08/26
+//
+// --------------------------------------------------------------------------
+#include "autogen_BackupProtocol.h"
+#include <iostream>
+#include <BoxTimeToText.h>
+
+void BackupStoreDirectory::WriteToStream(IOStream &rStream, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, box_time_t SnapshotTime, bool StreamAttributes, bool StreamDependencyInfo, uint32_t ProtocolVersion) const
+{
+	ASSERT(!mInvalidated); // Compiled out of release builds
+
+	std::vector<Entry *> entries;
+	GetEntriesToList(FlagsMustBeSet, FlagsNotToBeSet, SnapshotTime,
+		entries);
+
 	// Check that sensible IDs have been set
 	ASSERT(mObjectID != 0);
 	ASSERT(mContainerID != 0);
@@ -274,7 +471,7 @@ void BackupStoreDirectory::WriteToStream(IOStream &rStream, int16_t FlagsMustBeS
 	if(StreamDependencyInfo)
 	{
 		for ( auto local_it = entries.cbegin(); local_it!= entries.cend(); ++local_it ) {
-			Entry *pen = local_it->second;
+			Entry *pen = *local_it;
 			if(pen->HasDependencies())
 			{
 				dependencyInfoRequired = true;
@@ -316,7 +513,7 @@ void BackupStoreDirectory::WriteToStream(IOStream &rStream, int16_t FlagsMustBeS
 
 	// Then write all the entries
 	for ( auto local_it = entries.cbegin(); local_it!= entries.cend(); ++local_it ) {
-		Entry *pen = local_it->second;
+		Entry *pen = *local_it;
 		pen->WriteToStream(rStream, ProtocolVersion < PROTOCOL_VERSION_V2);
 	}
 	
@@ -325,7 +522,7 @@ void BackupStoreDirectory::WriteToStream(IOStream &rStream, int16_t FlagsMustBeS
 	if(dependencyInfoRequired)
 	{
 		for ( auto local_it = entries.cbegin(); local_it!= entries.cend(); ++local_it ) {
-			Entry *pen = local_it->second;
+			Entry *pen = *local_it;
 			pen->WriteToStreamDependencyInfo(rStream);
 		}
 	}
@@ -402,7 +599,7 @@ void BackupStoreDirectory::DeleteEntry(int64_t ObjectID)
 		if((*i)->mObjectID == ObjectID)
 		{
 			// Delete
-			delete (*i);
+			DeleteEntryObject(*i);
 			// Remove from list
 			mEntries.erase(i);
 			// Done
@@ -456,6 +653,10 @@ BackupStoreDirectory::Entry::Entry()
 #ifndef BOX_RELEASE_BUILD
   mInvalidated(false),
 #endif
+  mpEncodedName(0),
+  mEncodedNameSize(0),
+  mpEncodedAttributes(0),
+  mEncodedAttributesSize(0),
   mModificationTime(0),
   mBackupTime(0),
   mDeleteTime(0),
@@ -495,7 +696,11 @@ BackupStoreDirectory::Entry::Entry(const Entry &rToCopy)
 #ifndef BOX_RELEASE_BUILD
   mInvalidated(false),
 #endif
-  mName(rToCopy.mName),
+  mpEncodedName(0),
+  mEncodedNameSize(0),
+  mpEncodedAttributes(0),
+  mEncodedAttributesSize(0),
+  mName(rToCopy.GetName()),
   mModificationTime(rToCopy.mModificationTime),
   mBackupTime(rToCopy.mBackupTime),
   mDeleteTime(rToCopy.mDeleteTime),
@@ -503,7 +708,7 @@ BackupStoreDirectory::Entry::Entry(const Entry &rToCopy)
   mSizeInBlocks(rToCopy.mSizeInBlocks),
   mFlags(rToCopy.mFlags),
   mAttributesHash(rToCopy.mAttributesHash),
-  mAttributes(rToCopy.mAttributes),
+  mAttributes(rToCopy.GetAttributes()),
   mMinMarkNumber(rToCopy.mMinMarkNumber),
   mMarkNumber(rToCopy.mMarkNumber),
   mDependsNewer(rToCopy.mDependsNewer),
@@ -525,6 +730,10 @@ BackupStoreDirectory::Entry::Entry(const BackupStoreFilename &rName, box_time_t
 #ifndef BOX_RELEASE_BUILD
   mInvalidated(false),
 #endif
+  mpEncodedName(0),
+  mEncodedNameSize(0),
+  mpEncodedAttributes(0),
+  mEncodedAttributesSize(0),
   mName(rName),
   mModificationTime(ModificationTime),
   mBackupTime(BackupTime),
@@ -574,10 +783,29 @@ void BackupStoreDirectory::Entry::ReadFromStream(IOStream &rStream, int Timeout,
 	mAttributesHash =		box_ntoh64(entry.mAttributesHash);
 	mFlags = 				ntohs(entry.mFlags);
 	mName =					name;
+	mpEncodedName = 0;
 
 	// Get the attributes
 	mAttributes.ReadFromStream(rStream, Timeout);
+	mpEncodedAttributes = 0;
 
+	ReadTimesFromStream(rStream, Timeout, magicValue);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::ReadTimesFromStream(
+//			 IOStream &, int, uint32_t)
+//		Purpose: Private. Reads the backup and delete times which
+//			 end an entry, if the format has them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::Entry::ReadTimesFromStream(IOStream &rStream,
+	int Timeout, uint32_t magicValue)
+{
 	if( magicValue == OBJECTMAGIC_DIR_MAGIC_VALUE_V0 ) {
 		mBackupTime = 0;
 		mDeleteTime = 0;
@@ -637,10 +865,22 @@ void BackupStoreDirectory::Entry::WriteToStream(IOStream &rStream, bool IgnoreBa
 	rStream.Write(&entry, sizeof(entry));
 
 	// Write the filename
-	mName.WriteToStream(rStream);
+	WriteNameToStream(rStream);
 
 	// Write any attributes
-	mAttributes.WriteToStream(rStream);
+	if(mpEncodedAttributes != 0)
+	{
+		int32_t sizenbo = htonl(mEncodedAttributesSize);
+		rStream.Write(&sizenbo, sizeof(sizenbo));
+		if(mEncodedAttributesSize > 0)
+		{
+			rStream.Write(mpEncodedAttributes, mEncodedAttributesSize);
+		}
+	}
+	else
+	{
+		mAttributes.WriteToStream(rStream);
+	}
 
 	if( !IgnoreBackupTime ) {
 		// Write the backup time
@@ -697,3 +937,168 @@ void BackupStoreDirectory::Entry::WriteToStreamDependencyInfo(IOStream &rStream)
 	// Write
 	rStream.Write(&depends, sizeof(depends));
 }
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::MakeNameAvailable()
+//		Purpose: Private. Makes mName from the encoded name left in
+//			 the directory's buffer when it was read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::Entry::MakeNameAvailable() const
+{
+	MemBlockStream stream(mpEncodedName, mEncodedNameSize);
+	mName.ReadFromStream(stream, IOStream::TimeOutInfinite);
+	mpEncodedName = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::MakeAttributesAvailable()
+//		Purpose: Private. Makes mAttributes from the attributes left
+//			 in the directory's buffer when it was read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::Entry::MakeAttributesAvailable() const
+{
+	mAttributes.Set(const_cast<char *>(mpEncodedAttributes),
+		mEncodedAttributesSize);
+	mpEncodedAttributes = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::GetEncodedName(
+//			 const char *&, int &)
+//		Purpose: Private. Returns the encoded name, wherever it is.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::Entry::GetEncodedName(const char *&rpName,
+	int &rSize) const
+{
+	if(mpEncodedName != 0)
+	{
+		rpName = mpEncodedName;
+		rSize = mEncodedNameSize;
+	}
+	else
+	{
+		rpName = mName.GetEncodedFilename().c_str();
+		rSize = mName.GetEncodedFilename().size();
+	}
+}
+
+
+// Orders encoded names as std::string::compare() would
+static int CompareEncodedNames(const char *pA, int SizeA, const char *pB,
+	int SizeB)
+{
+	int r = ::memcmp(pA, pB, (SizeA < SizeB) ? SizeA : SizeB);
+	if(r != 0)
+	{
+		return r;
+	}
+	return (SizeA < SizeB) ? -1 : ((SizeA > SizeB) ? 1 : 0);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::CompareName(const Entry &)
+//		Purpose: Compares the encoded names of two entries, returning
+//			 less than, equal to or greater than zero
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreDirectory::Entry::CompareName(const Entry &rOther) const
+{
+	ASSERT(!mInvalidated); // Compiled out of release builds
+	const char *pA, *pB;
+	int sizeA, sizeB;
+	GetEncodedName(pA, sizeA);
+	rOther.GetEncodedName(pB, sizeB);
+	return CompareEncodedNames(pA, sizeA, pB, sizeB);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::CompareName(
+//			 const BackupStoreFilename &)
+//		Purpose: Compares the encoded name of this entry with another
+//			 encoded name
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreDirectory::Entry::CompareName(const BackupStoreFilename &rName) const
+{
+	ASSERT(!mInvalidated); // Compiled out of release builds
+	const char *p;
+	int size;
+	GetEncodedName(p, size);
+	const std::string &rOther(rName.GetEncodedFilename());
+	return CompareEncodedNames(p, size, rOther.c_str(), rOther.size());
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::NameMatches(
+//			 const BackupStoreFilename &)
+//		Purpose: Whether the entry has exactly this encoded name
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreDirectory::Entry::NameMatches(const BackupStoreFilename &rName) const
+{
+	return CompareName(rName) == 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::NameMatches(const Entry &)
+//		Purpose: Whether the two entries have the same encoded name
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreDirectory::Entry::NameMatches(const Entry &rOther) const
+{
+	return CompareName(rOther) == 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectory::Entry::WriteNameToStream(IOStream &)
+//		Purpose: Writes the encoded name, as
+//			 BackupStoreFilename::WriteToStream() would
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectory::Entry::WriteNameToStream(IOStream &rStream) const
+{
+	ASSERT(!mInvalidated); // Compiled out of release builds
+	if(mpEncodedName != 0)
+	{
+		rStream.Write(mpEncodedName, mEncodedNameSize);
+	}
+	else
+	{
+		mName.WriteToStream(rStream);
+	}
+}
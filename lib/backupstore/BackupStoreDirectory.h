@@ -105,8 +105,19 @@ public:
 		const BackupStoreFilename &GetName() const
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
+			if(mpEncodedName != 0)
+			{
+				MakeNameAvailable();
+			}
 			return mName;
 		}
+		// These don't need the name to be made available, so are
+		// cheaper than GetName() when looking through a directory
+		bool NameMatches(const BackupStoreFilename &rName) const;
+		bool NameMatches(const Entry &rOther) const;
+		int CompareName(const Entry &rOther) const;
+		int CompareName(const BackupStoreFilename &rName) const;
+		void WriteNameToStream(IOStream &rStream) const;
 		box_time_t GetModificationTime() const
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
@@ -175,6 +186,7 @@ public:
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
 			mName = rNewName;
+			mpEncodedName = 0;
 		}
 		void SetSizeInBlocks(int64_t SizeInBlocks)
 		{
@@ -186,17 +198,26 @@ public:
 		bool HasAttributes() const
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
+			if(mpEncodedAttributes != 0)
+			{
+				return mEncodedAttributesSize != 0;
+			}
 			return !mAttributes.IsEmpty();
 		}
 		void SetAttributes(const StreamableMemBlock &rAttr, uint64_t AttributesHash)
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
 			mAttributes.Set(rAttr);
+			mpEncodedAttributes = 0;
 			mAttributesHash = AttributesHash;
 		}
 		const StreamableMemBlock &GetAttributes() const
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
+			if(mpEncodedAttributes != 0)
+			{
+				MakeAttributesAvailable();
+			}
 			return mAttributes;
 		}
 		uint64_t GetAttributesHash() const
@@ -225,15 +246,16 @@ public:
 		{
 			Flags_INCLUDE_EVERYTHING 	= -1,
 			Flags_EXCLUDE_NOTHING 		= 0,
-			Flags_EXCLUDE_EVERYTHING	= 31,	// make sure this is kept as sum of ones below!
+			Flags_EXCLUDE_EVERYTHING	= 63,	// make sure this is kept as sum of ones below!
 			Flags_File					= 1,
 			Flags_Dir					= 2,
 			Flags_Deleted				= 4,
 			Flags_OldVersion			= 8,
 			Flags_RemoveASAP			= 16,	// if this flag is set, housekeeping will remove it as it is marked Deleted or OldVersion
+			Flags_PatchFromOlder		= 32,	// stored as a patch from DependsOlder, see BackupStoreDeferredPatch
 		};
 		// characters for textual listing of files -- see bbackupquery/BackupQueries
-		#define BACKUPSTOREDIRECTORY_ENTRY_FLAGS_DISPLAY_NAMES "fdXoR"
+		#define BACKUPSTOREDIRECTORY_ENTRY_FLAGS_DISPLAY_NAMES "fdXoRp"
 
 		// convenience methods
 		bool inline IsDir()
@@ -261,6 +283,11 @@ public:
 			ASSERT(!mInvalidated); // Compiled out of release builds
 			return GetFlags() & Flags_RemoveASAP;
 		}
+		bool inline IsPatchFromOlder()
+		{
+			ASSERT(!mInvalidated); // Compiled out of release builds
+			return GetFlags() & Flags_PatchFromOlder;
+		}
 		bool inline MatchesFlags(int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet)
 		{
 			ASSERT(!mInvalidated); // Compiled out of release builds
@@ -302,7 +329,22 @@ public:
 		void WriteToStreamDependencyInfo(IOStream &rStream) const;
 
 	private:
-		BackupStoreFilename mName;
+		void ReadTimesFromStream(IOStream &rStream, int Timeout,
+			uint32_t magicValue);
+		void MakeNameAvailable() const;
+		void MakeAttributesAvailable() const;
+		void GetEncodedName(const char *&rpName, int &rSize) const;
+
+		// Entries read by BackupStoreDirectory::ReadFromStream() leave
+		// their name and attributes in the directory's buffer until
+		// they're asked for, so these point into it until then. Not
+		// safe for two threads to ask for them at the same time.
+		mutable const char *mpEncodedName;
+		int mEncodedNameSize;
+		mutable const char *mpEncodedAttributes;
+		int mEncodedAttributesSize;
+
+		mutable BackupStoreFilename mName;
 		box_time_t mModificationTime;
 		box_time_t mBackupTime;
 		box_time_t mDeleteTime;
@@ -310,7 +352,7 @@ public:
 		int64_t mSizeInBlocks;
 		int16_t mFlags;
 		uint64_t mAttributesHash;
-		StreamableMemBlock mAttributes;
+		mutable StreamableMemBlock mAttributes;
 		uint32_t mMinMarkNumber;
 		uint32_t mMarkNumber;
 
@@ -332,6 +374,8 @@ public:
 			box_time_t SnapshotTime = 0,
 			bool StreamAttributes = true, bool StreamDependencyInfo = true, 
 			uint32_t ProtocolVersion = PROTOCOL_CURRENT_VERSION) const;
+	void GetEntriesToList(int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+		box_time_t SnapshotTime, std::vector<Entry *> &rEntriesOut) const;
 			
 	Entry *AddEntry(const Entry &rEntryToCopy);
 	Entry *AddEntry(const BackupStoreFilename &rName,
@@ -376,6 +420,7 @@ public:
 		ASSERT(!mInvalidated); // Compiled out of release builds
 		return mEntries.size();
 	}
+	int64_t GetMemoryUsage() const;
 
 	// User info -- not serialised into streams
 	int64_t GetUserInfo1_SizeInBlocks() const
@@ -516,10 +561,22 @@ public:
 	void Dump(void *clibFileHandle, bool ToTrace); // first arg is FILE *, but avoid including stdio.h everywhere
 
 private:
+	void DeleteEntryObject(Entry *pEntry);
+	void DeleteAllEntries();
+	bool EntryWasRead(const Entry *pEntry) const
+	{
+		return !mEntriesRead.empty() && pEntry >= &mEntriesRead.front()
+			&& pEntry <= &mEntriesRead.back();
+	}
+
 	int64_t mRevisionID;
 	int64_t mObjectID;
 	int64_t mContainerID;
 	std::vector<Entry*> mEntries;
+	// The entries read from a stream are allocated together, and their
+	// names and attributes are kept as they were read, in one buffer
+	std::vector<Entry> mEntriesRead;
+	std::vector<char> mEncodedData;
 	box_time_t mAttributesModTime;
 	StreamableMemBlock mAttributes;
 	int64_t mUserInfo1;
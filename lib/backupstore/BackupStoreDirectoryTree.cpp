@@ -0,0 +1,434 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreDirectoryTree.cpp
+//		Purpose: Listings of a whole tree of directories, sent in one
+//			 stream by the ListDirectoryTree command
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include "Archive.h"
+#include "autogen_BackupProtocol.h"
+#include "autogen_ConnectionException.h"
+#include "BackupStoreContext.h"
+#include "BackupStoreDirectoryTree.h"
+#include "BackupStoreException.h"
+#include "RaidFileException.h"
+
+#include "MemLeakFindOn.h"
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::BackupStoreDirectoryTree(
+//			 BackupProtocolCallable &, int16_t, int16_t,
+//			 box_time_t, int32_t)
+//		Purpose: Constructor. The flags and snapshot time are those
+//			 of ListDirectory. Nothing is listed until List() or
+//			 Take() is called.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDirectoryTree::BackupStoreDirectoryTree(
+	BackupProtocolCallable &rConnection, int16_t FlagsMustBeSet,
+	int16_t FlagsNotToBeSet, box_time_t SnapshotTime,
+	int32_t MaxDirectories)
+: mrConnection(rConnection),
+  mFlagsMustBeSet(FlagsMustBeSet),
+  mFlagsNotToBeSet(FlagsNotToBeSet),
+  mSnapshotTime(SnapshotTime),
+  mMaxDirectories(MaxDirectories),
+  mBatchesCut(false),
+  mNumBatches(0)
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::~BackupStoreDirectoryTree()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDirectoryTree::~BackupStoreDirectoryTree()
+{
+	Clear();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::Clear()
+//		Purpose: Frees all the listings not yet taken
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectoryTree::Clear()
+{
+	for(std::map<int64_t, Listing>::iterator i = mDirectories.begin();
+		i != mDirectories.end(); i++)
+	{
+		delete i->second.second;
+	}
+	mDirectories.clear();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::List(int64_t)
+//		Purpose: Lists the next batch of the tree, starting at the
+//			 given directory, adding to the listings held.
+//			 Exceptions if the directory can't be listed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectoryTree::List(int64_t ObjectID)
+{
+	mrConnection.QueryListDirectoryTree(ObjectID, mFlagsMustBeSet,
+		mFlagsNotToBeSet, true /* want attributes */, mSnapshotTime,
+		mMaxDirectories);
+	std::auto_ptr<IOStream> treestream(mrConnection.ReceiveStream());
+	int read = ReadFromStream(*treestream, mrConnection.GetTimeout());
+	mNumBatches++;
+
+	if(mMaxDirectories > 0 && read >= mMaxDirectories)
+	{
+		mBatchesCut = true;
+	}
+
+	BOX_TRACE("Listed " << read << " directories below " <<
+		BOX_FORMAT_OBJECTID(ObjectID) << " at once" <<
+		(mBatchesCut ? ", more may follow" : ""));
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::ReadFromStream(IOStream &, int)
+//		Purpose: Private. Reads one batch of the listings sent in
+//			 reply to ListDirectoryTree, replacing any copies of
+//			 them held already, and returns the number read.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreDirectoryTree::ReadFromStream(IOStream &rStream, int Timeout)
+{
+	// Directories read from this stream, as the parent of each must be
+	// one of them
+	std::set<int64_t> read;
+
+	Archive archive(rStream, Timeout);
+	while(true)
+	{
+		int64_t objectID;
+		archive.Read(objectID);
+		if(objectID == 0)
+		{
+			break;
+		}
+
+		int64_t parentID;
+		archive.Read(parentID);
+
+		// Depth first, so the parent has always been read already
+		if(read.find(objectID) != read.end() ||
+			(parentID == 0) != read.empty() ||
+			(parentID != 0 && read.find(parentID) == read.end()))
+		{
+			THROW_EXCEPTION_MESSAGE(BackupStoreException,
+				BadDirectoryFormat, "Directory " <<
+				BOX_FORMAT_OBJECTID(objectID) << " in " <<
+				BOX_FORMAT_OBJECTID(parentID) << " is out of "
+				"place in the tree listing");
+		}
+		read.insert(objectID);
+
+		std::auto_ptr<BackupStoreDirectory> apDir(
+			new BackupStoreDirectory);
+		apDir->ReadFromStream(rStream, Timeout);
+
+		std::map<int64_t, Listing>::iterator i(
+			mDirectories.find(objectID));
+		if(i != mDirectories.end())
+		{
+			delete i->second.second;
+			mDirectories.erase(i);
+		}
+		mDirectories[objectID] = Listing(parentID, apDir.release());
+	}
+
+	// The protocol marks the end of the stream after the last byte, and
+	// it must be read before the next command.
+	while(rStream.StreamDataLeft())
+	{
+		uint8_t byte;
+		if(rStream.Read(&byte, sizeof(byte), Timeout) != 0)
+		{
+			THROW_EXCEPTION_MESSAGE(BackupStoreException,
+				BadDirectoryFormat, "Unexpected data after the "
+				"end of the tree listing");
+		}
+	}
+
+	return read.size();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::GetParentID(int64_t)
+//		Purpose: Returns the ID of the directory in which the given
+//			 one was listed, or 0 for the top of the tree
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int64_t BackupStoreDirectoryTree::GetParentID(int64_t ObjectID) const
+{
+	std::map<int64_t, Listing>::const_iterator i(
+		mDirectories.find(ObjectID));
+	if(i == mDirectories.end())
+	{
+		THROW_EXCEPTION(BackupStoreException, ObjectDoesNotExist)
+	}
+	return i->second.first;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTree::Take(int64_t)
+//		Purpose: Returns the listing of a directory, which is no
+//			 longer held by the tree, listing the next batch if
+//			 it might not have been read yet, or an empty pointer
+//			 if the store doesn't list it
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupStoreDirectory> BackupStoreDirectoryTree::Take(
+	int64_t ObjectID)
+{
+	std::map<int64_t, Listing>::iterator i(mDirectories.find(ObjectID));
+	if(i == mDirectories.end() && (mNumBatches == 0 || mBatchesCut))
+	{
+		try
+		{
+			List(ObjectID);
+		}
+		catch(ConnectionException &e)
+		{
+			if(e.GetSubType() !=
+				ConnectionException::Protocol_UnexpectedReply)
+			{
+				throw;
+			}
+			// The store replied with an error, which the caller
+			// will see when it asks for the directory itself
+			return std::auto_ptr<BackupStoreDirectory>();
+		}
+		i = mDirectories.find(ObjectID);
+	}
+	if(i == mDirectories.end())
+	{
+		return std::auto_ptr<BackupStoreDirectory>();
+	}
+
+	std::auto_ptr<BackupStoreDirectory> apDir(i->second.second);
+	mDirectories.erase(i);
+	return apDir;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::BackupStoreDirectoryTreeStream(
+//			 BackupStoreContext &, int64_t, int16_t, int16_t,
+//			 box_time_t, bool, int32_t)
+//		Purpose: Constructor. The arguments are those of the
+//			 ListDirectoryTree command.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDirectoryTreeStream::BackupStoreDirectoryTreeStream(
+	BackupStoreContext &rContext, int64_t ObjectID,
+	int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+	box_time_t SnapshotTime, bool SendAttributes, int32_t MaxDirectories)
+: mrContext(rContext),
+  mFlagsMustBeSet(FlagsMustBeSet),
+  mFlagsNotToBeSet(FlagsNotToBeSet),
+  mSnapshotTime(SnapshotTime),
+  mSendAttributes(SendAttributes),
+  mMaxDirectories(MaxDirectories),
+  mNumSent(0),
+  mFinished(false)
+{
+	mToList.push_back(std::make_pair(ObjectID, (int64_t)0));
+	mBuffer.SetForReading();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::~BackupStoreDirectoryTreeStream()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDirectoryTreeStream::~BackupStoreDirectoryTreeStream()
+{
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::ListNextDirectory()
+//		Purpose: Fills the buffer with the record for the next
+//			 directory, and queues the directories listed in it,
+//			 or with the end marker if there are none left, or
+//			 enough have been sent. The
+//			 buffer is left empty if the directory is skipped.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectoryTreeStream::ListNextDirectory()
+{
+	mBuffer.Reset();
+	Archive archive(mBuffer, IOStream::TimeOutInfinite);
+
+	if(mToList.empty() ||
+		(mMaxDirectories > 0 && mNumSent >= mMaxDirectories))
+	{
+		// The client asks again for any directories left over
+		archive.Write((int64_t)0);
+		mFinished = true;
+		mBuffer.SetForReading();
+		return;
+	}
+
+	int64_t objectID = mToList.back().first;
+	int64_t parentID = mToList.back().second;
+	mToList.pop_back();
+
+	if(!mListed.insert(objectID).second)
+	{
+		BOX_WARNING("Directory " << BOX_FORMAT_OBJECTID(objectID) <<
+			" appears more than once in the tree below " <<
+			BOX_FORMAT_OBJECTID(parentID) << ", only listing it "
+			"once. Run bbstoreaccounts check to fix it.");
+		mBuffer.SetForReading();
+		return;
+	}
+
+	// Descend into the directories which appear in the listing
+	int16_t dirFlags = BackupStoreDirectory::Entry::Flags_Dir;
+	if(mFlagsMustBeSet != BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING)
+	{
+		dirFlags |= mFlagsMustBeSet;
+	}
+	std::vector<BackupStoreDirectory::Entry *> subdirs;
+
+	try
+	{
+		// The reference is only valid until the next directory is
+		// read, so everything needed from it is taken now.
+		const BackupStoreDirectory &rdir(
+			mrContext.GetDirectory(objectID));
+		archive.Write(objectID);
+		archive.Write(parentID);
+		rdir.WriteToStream(mBuffer, mFlagsMustBeSet,
+			mFlagsNotToBeSet, mSnapshotTime, mSendAttributes,
+			false /* never send dependency info to the client */,
+			mrContext.GetProtocolVersion());
+
+		rdir.GetEntriesToList(dirFlags, mFlagsNotToBeSet,
+			mSnapshotTime, subdirs);
+		for(std::vector<BackupStoreDirectory::Entry *>::reverse_iterator
+			i = subdirs.rbegin(); i != subdirs.rend(); i++)
+		{
+			mToList.push_back(std::make_pair((*i)->GetObjectID(),
+				objectID));
+		}
+		mNumSent++;
+	}
+	catch(BoxException &e)
+	{
+		if(e.GetType() != BackupStoreException::ExceptionType &&
+			e.GetType() != RaidFileException::ExceptionType)
+		{
+			throw;
+		}
+
+		// Leave it out. The client will see the error if it asks
+		// for this directory with ListDirectory.
+		BOX_WARNING("Failed to read directory " <<
+			BOX_FORMAT_OBJECTID(objectID) << " for the tree "
+			"listing, leaving it out: " << e.what());
+		mBuffer.Reset();
+	}
+
+	mBuffer.SetForReading();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::Read(void *, int, int)
+//		Purpose: As interface. Reads more directories as needed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreDirectoryTreeStream::Read(void *pBuffer, int NBytes,
+	int Timeout)
+{
+	while(!mBuffer.StreamDataLeft() && !mFinished)
+	{
+		ListNextDirectory();
+	}
+
+	return mBuffer.Read(pBuffer, NBytes, Timeout);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::Write(const void *, int, int)
+//		Purpose: As interface. Exceptions.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDirectoryTreeStream::Write(const void *pBuffer, int NBytes,
+	int Timeout)
+{
+	THROW_EXCEPTION(BackupStoreException, CantWriteToDirectoryTreeStream)
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::StreamDataLeft()
+//		Purpose: As interface
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreDirectoryTreeStream::StreamDataLeft()
+{
+	return !mFinished || mBuffer.StreamDataLeft();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDirectoryTreeStream::StreamClosed()
+//		Purpose: As interface
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreDirectoryTreeStream::StreamClosed()
+{
+	// Can't write to this stream
+	return true;
+}
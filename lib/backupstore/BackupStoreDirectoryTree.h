@@ -0,0 +1,149 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreDirectoryTree.h
+//		Purpose: Listings of a whole tree of directories, sent in one
+//			 stream by the ListDirectoryTree command
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTOREDIRECTORYTREE__H
+#define BACKUPSTOREDIRECTORYTREE__H
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "BackupStoreConstants.h"
+#include "BackupStoreDirectory.h"
+#include "CollectInBufferStream.h"
+#include "IOStream.h"
+
+class BackupProtocolCallable;
+class BackupStoreContext;
+
+// The stream is a series of records, one for each directory, depth first:
+//
+//	int64	ObjectID of the directory
+//	int64	ObjectID of the directory it was listed in, or 0 for the top
+//	...	the directory, exactly as ListDirectory sends it
+//
+// and ends with an ObjectID of zero, either after the last directory or
+// after the maximum number of directories asked for.
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreDirectoryTree
+//		Purpose: The client side: lists a tree of directories in
+//			 batches of at most MaxDirectories, holding the
+//			 listings until each of them is taken. When a
+//			 directory is taken which wasn't in the batches read
+//			 so far, the tree below it is listed next, so only
+//			 about one batch is held at a time.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreDirectoryTree
+{
+public:
+	BackupStoreDirectoryTree(BackupProtocolCallable &rConnection,
+		int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+		box_time_t SnapshotTime,
+		int32_t MaxDirectories = BACKUPSTORE_TREE_LISTING_MAX_DIRECTORIES);
+	~BackupStoreDirectoryTree();
+private:
+	// no copying
+	BackupStoreDirectoryTree(const BackupStoreDirectoryTree &);
+	BackupStoreDirectoryTree &operator=(const BackupStoreDirectoryTree &);
+
+public:
+	void List(int64_t ObjectID);
+
+	size_t GetNumberOfDirectories() const { return mDirectories.size(); }
+	bool Contains(int64_t ObjectID) const
+	{
+		return mDirectories.find(ObjectID) != mDirectories.end();
+	}
+	int64_t GetParentID(int64_t ObjectID) const;
+	int GetNumberOfBatches() const { return mNumBatches; }
+
+	// Returns the listing and forgets it, listing the tree below it
+	// first if it might have been left out of the batches read so far.
+	// Returns an empty pointer if the store doesn't list it, so that
+	// the caller can ask for it with ListDirectory and see the error.
+	std::auto_ptr<BackupStoreDirectory> Take(int64_t ObjectID);
+
+private:
+	int ReadFromStream(IOStream &rStream, int Timeout);
+	void Clear();
+
+	BackupProtocolCallable &mrConnection;
+	int16_t mFlagsMustBeSet;
+	int16_t mFlagsNotToBeSet;
+	box_time_t mSnapshotTime;
+	int32_t mMaxDirectories;
+	// Set once a batch stops at mMaxDirectories, after which any
+	// directory not held may still be waiting to be listed
+	bool mBatchesCut;
+	int mNumBatches;
+
+	typedef std::pair<int64_t, BackupStoreDirectory *> Listing;
+	// Parent IDs and listings, by directory ID
+	std::map<int64_t, Listing> mDirectories;
+};
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreDirectoryTreeStream
+//		Purpose: The server side: walks the tree as the stream is
+//			 read, so only the directories waiting to be listed
+//			 are held in memory, and the first listings are sent
+//			 while the rest are still being read from disc.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreDirectoryTreeStream : public IOStream
+{
+public:
+	BackupStoreDirectoryTreeStream(BackupStoreContext &rContext,
+		int64_t ObjectID, int16_t FlagsMustBeSet,
+		int16_t FlagsNotToBeSet, box_time_t SnapshotTime,
+		bool SendAttributes, int32_t MaxDirectories);
+	~BackupStoreDirectoryTreeStream();
+private:
+	// no copying
+	BackupStoreDirectoryTreeStream(const BackupStoreDirectoryTreeStream &);
+	BackupStoreDirectoryTreeStream &operator=(const BackupStoreDirectoryTreeStream &);
+
+public:
+	virtual int Read(void *pBuffer, int NBytes,
+		int Timeout = IOStream::TimeOutInfinite);
+	virtual void Write(const void *pBuffer, int NBytes,
+		int Timeout = IOStream::TimeOutInfinite);
+	virtual bool StreamDataLeft();
+	virtual bool StreamClosed();
+
+private:
+	void ListNextDirectory();
+
+	BackupStoreContext &mrContext;
+	int16_t mFlagsMustBeSet;
+	int16_t mFlagsNotToBeSet;
+	box_time_t mSnapshotTime;
+	bool mSendAttributes;
+	int32_t mMaxDirectories;
+	int32_t mNumSent;
+	// Directories still to be listed, with their parents, the next one
+	// at the back
+	std::vector<std::pair<int64_t, int64_t> > mToList;
+	// Guards against loops in a damaged store
+	std::set<int64_t> mListed;
+	CollectInBufferStream mBuffer;
+	bool mFinished;
+};
+
+#endif // BACKUPSTOREDIRECTORYTREE__H
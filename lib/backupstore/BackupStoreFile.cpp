@@ -15,6 +15,7 @@
 
 #include <sys/stat.h>
 #include <string.h>
+#include <algorithm>
 #include <new>
 #include <string.h>
 
@@ -56,6 +57,7 @@ using namespace BackupStoreFileCryptVar;
 
 // Statistics
 BackupStoreFileStats BackupStoreFile::msStats = {0,0,0};
+int BackupStoreFile::msEncodingThreads = 0;
 
 #ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
 	bool sWarnedAboutBackwardsCompatiblity = false;
@@ -665,10 +667,13 @@ void BackupStoreFile::VerifyStream::Close(bool CloseCopyStream)
 // Function
 //		Name:    BackupStoreFile::DecodeFile(IOStream &, const char *)
 //		Purpose: Decode a file. Will set file attributes. File must not exist.
+//			 If pAttributesOut is set, the attributes are returned
+//			 there for the caller to write instead.
 //		Created: 2003/08/28
 //
 // --------------------------------------------------------------------------
-void BackupStoreFile::DecodeFile(IOStream &rEncodedFile, const char *DecodedFilename, int Timeout, const BackupClientFileAttributes *pAlterativeAttr)
+void BackupStoreFile::DecodeFile(IOStream &rEncodedFile, const char *DecodedFilename, int Timeout, const BackupClientFileAttributes *pAlterativeAttr,
+	BackupClientFileAttributes *pAttributesOut)
 {
 	// Does file exist?
 	EMU_STRUCT_STAT st;
@@ -709,6 +714,12 @@ void BackupStoreFile::DecodeFile(IOStream &rEncodedFile, const char *DecodedFile
 		// doesn't hurt!
 		// ASSERT(drained == 0);
 
+		if(pAttributesOut != 0)
+		{
+			*pAttributesOut = stream->GetAttributes();
+			return;
+		}
+
 		// Write the attributes
 		try
 		{
@@ -731,20 +742,23 @@ void BackupStoreFile::DecodeFile(IOStream &rEncodedFile, const char *DecodedFile
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreFile::DecodeFileStream(IOStream &, int, const BackupClientFileAttributes *)
+//		Name:    BackupStoreFile::DecodeFileStream(IOStream &, int, const BackupClientFileAttributes *, bool)
 //		Purpose: Return a stream which will decode the encrypted file data on the fly.
 //				 Accepts streams in block index first, or main header first, order. In the latter case,
 //				 the stream must be Seek()able.
 //
+//				 If Seekable is true, the returned stream can Seek() too, only decoding the
+//				 blocks which are read. The file must be complete, in file order.
+//
 //				 Before you use the returned stream, call IsSymLink() -- symlink streams won't allow
 //				 you to read any data to enforce correct logic. See BackupStoreFile::DecodeFile() implementation.
 //		Created: 9/12/03
 //
 // --------------------------------------------------------------------------
-std::auto_ptr<BackupStoreFile::DecodedStream> BackupStoreFile::DecodeFileStream(IOStream &rEncodedFile, int Timeout, const BackupClientFileAttributes *pAlterativeAttr)
+std::auto_ptr<BackupStoreFile::DecodedStream> BackupStoreFile::DecodeFileStream(IOStream &rEncodedFile, int Timeout, const BackupClientFileAttributes *pAlterativeAttr, bool Seekable)
 {
 	// Create stream
-	std::auto_ptr<DecodedStream> stream(new DecodedStream(rEncodedFile, Timeout));
+	std::auto_ptr<DecodedStream> stream(new DecodedStream(rEncodedFile, Timeout, Seekable));
 
 	// Get it ready
 	stream->Setup(pAlterativeAttr);
@@ -757,12 +771,12 @@ std::auto_ptr<BackupStoreFile::DecodedStream> BackupStoreFile::DecodeFileStream(
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreFile::DecodedStream::DecodedStream(IOStream &, int)
+//		Name:    BackupStoreFile::DecodedStream::DecodedStream(IOStream &, int, bool)
 //		Purpose: Constructor
 //		Created: 9/12/03
 //
 // --------------------------------------------------------------------------
-BackupStoreFile::DecodedStream::DecodedStream(IOStream &rEncodedFile, int Timeout)
+BackupStoreFile::DecodedStream::DecodedStream(IOStream &rEncodedFile, int Timeout, bool Seekable)
 	: mrEncodedFile(rEncodedFile),
 	  mTimeout(Timeout),
 	  mNumBlocks(0),
@@ -777,6 +791,8 @@ BackupStoreFile::DecodedStream::DecodedStream(IOStream &rEncodedFile, int Timeou
 #ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
 	  , mIsOldVersion(false)
 #endif
+	  , mSeekable(Seekable),
+	  mSkipInNextBlock(0)
 {
 }
 
@@ -853,6 +869,13 @@ void BackupStoreFile::DecodedStream::Setup(const BackupClientFileAttributes *pAl
 		THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
 	}
 
+	// Seeking needs to know where the blocks are in the file
+	if(mSeekable && (!inFileOrder ||
+		fileSize == IOStream::SizeOfStreamUnknown))
+	{
+		THROW_EXCEPTION(BackupStoreException, StreamDoesntHaveRequiredFeatures)
+	}
+
 	// If not in file order, then the index list must be read now
 	if(!inFileOrder)
 	{
@@ -937,6 +960,11 @@ void BackupStoreFile::DecodedStream::Setup(const BackupClientFileAttributes *pAl
 
 		// Seek back to the end of header position, ready for reading the chunks
 		mrEncodedFile.Seek(endOfHeaderPos, IOStream::SeekType_Absolute);
+
+		if(mSeekable)
+		{
+			CalculateBlockPositions(endOfHeaderPos);
+		}
 	}
 
 	// Check view of blocks from block header and file header match
@@ -1047,6 +1075,57 @@ void BackupStoreFile::DecodedStream::ReadBlockIndex(bool MagicAlreadyRead)
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodedStream::CalculateBlockPositions(int64_t)
+//		Purpose: Work out where each block starts, in the clear data
+//				 and in the encoded file, so the stream can seek. The
+//				 clear sizes are only in the encrypted part of the
+//				 block index entries.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::DecodedStream::CalculateBlockPositions(int64_t BlockDataStart)
+{
+#ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
+	if(mIsOldVersion)
+	{
+		// Might need the IV the other way round, see Read()
+		THROW_EXCEPTION(BackupStoreException, StreamDoesntHaveRequiredFeatures)
+	}
+#endif
+
+	mClearPositions.resize(mNumBlocks + 1);
+	mEncodedPositions.resize(mNumBlocks + 1);
+	mClearPositions[0] = 0;
+	mEncodedPositions[0] = BlockDataStart;
+
+	const file_BlockIndexEntry *entry = (file_BlockIndexEntry *)mpBlockIndex;
+	for(int64_t b = 0; b < mNumBlocks; ++b)
+	{
+		int64_t encodedSize = box_ntoh64(entry[b].mEncodedSize);
+		if(encodedSize <= 0)
+		{
+			THROW_EXCEPTION(BackupStoreException, CannotDecodeDiffedFilesWithoutCombining)
+		}
+
+		uint64_t iv = box_hton64(mEntryIVBase + b);
+		BlowfishDecryptBlockEntry().SetIV(&iv);
+		file_BlockIndexEntryEnc entryEnc;
+		int sectionSize = BlowfishDecryptBlockEntry().TransformBlock(&entryEnc, sizeof(entryEnc),
+				entry[b].mEnEnc, sizeof(entry[b].mEnEnc));
+		if(sectionSize != sizeof(entryEnc))
+		{
+			THROW_EXCEPTION(BackupStoreException, BlockEntryEncodingDidntGiveExpectedLength)
+		}
+
+		mClearPositions[b + 1] = mClearPositions[b] + (int32_t)ntohl(entryEnc.mSize);
+		mEncodedPositions[b + 1] = mEncodedPositions[b] + encodedSize;
+	}
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1130,11 +1209,11 @@ int BackupStoreFile::DecodedStream::Read(void *pBuffer, int NBytes, int Timeout)
 			// Convert to network byte order before encrypting with it, so that restores work on
 			// platforms with different endiannesses.
 			iv = box_hton64(iv);
-			sBlowfishDecryptBlockEntry.SetIV(&iv);
+			BlowfishDecryptBlockEntry().SetIV(&iv);
 
 			// Decrypt the encrypted section
 			file_BlockIndexEntryEnc entryEnc;
-			int sectionSize = sBlowfishDecryptBlockEntry.TransformBlock(&entryEnc, sizeof(entryEnc),
+			int sectionSize = BlowfishDecryptBlockEntry().TransformBlock(&entryEnc, sizeof(entryEnc),
 					entry[mCurrentBlock].mEnEnc, sizeof(entry[mCurrentBlock].mEnEnc));
 			if(sectionSize != sizeof(entryEnc))
 			{
@@ -1152,8 +1231,8 @@ int BackupStoreFile::DecodedStream::Read(void *pBuffer, int NBytes, int Timeout)
 				// Versions 0.05 and previous of Box Backup didn't properly handle endianess of the
 				// IV for the encrypted section. Try again, with the thing the other way round
 				iv = box_swap64(iv);
-				sBlowfishDecryptBlockEntry.SetIV(&iv);
-				int sectionSize = sBlowfishDecryptBlockEntry.TransformBlock(&entryEnc, sizeof(entryEnc),
+				BlowfishDecryptBlockEntry().SetIV(&iv);
+				int sectionSize = BlowfishDecryptBlockEntry().TransformBlock(&entryEnc, sizeof(entryEnc),
 						entry[mCurrentBlock].mEnEnc, sizeof(entry[mCurrentBlock].mEnEnc));
 				if(sectionSize != sizeof(entryEnc))
 				{
@@ -1187,7 +1266,12 @@ int BackupStoreFile::DecodedStream::Read(void *pBuffer, int NBytes, int Timeout)
 			}
 
 			// Set vars to say what's happening
-			mPositionInCurrentBlock = 0;
+			mPositionInCurrentBlock = mSkipInNextBlock;
+			mSkipInNextBlock = 0;
+			if(mPositionInCurrentBlock > mCurrentBlockClearSize)
+			{
+				THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
+			}
 		}
 	}
 
@@ -1269,6 +1353,125 @@ bool BackupStoreFile::DecodedStream::StreamClosed()
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodedStream::BytesLeftToRead()
+//		Purpose: As interface. Only known if the stream is seekable.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream::pos_type BackupStoreFile::DecodedStream::BytesLeftToRead()
+{
+	if(!mSeekable)
+	{
+		return IOStream::SizeOfStreamUnknown;
+	}
+
+	return mClearPositions[mNumBlocks] - GetPosition();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodedStream::GetPosition()
+//		Purpose: As interface. Only if the stream is seekable.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream::pos_type BackupStoreFile::DecodedStream::GetPosition() const
+{
+	if(!mSeekable)
+	{
+		THROW_EXCEPTION(BackupStoreException, StreamDoesntHaveRequiredFeatures)
+	}
+
+	if(mCurrentBlock >= mNumBlocks)
+	{
+		return mClearPositions[mNumBlocks];
+	}
+
+	if(mPositionInCurrentBlock >= mCurrentBlockClearSize)
+	{
+		// Finished with this block, the next one isn't read yet
+		return mClearPositions[mCurrentBlock + 1] + mSkipInNextBlock;
+	}
+
+	return mClearPositions[mCurrentBlock] + mPositionInCurrentBlock;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodedStream::Seek(pos_type, int)
+//		Purpose: As interface. Only if the stream is seekable. The
+//				 encoded file is seeked to the start of the block
+//				 containing the new position, which is decoded when
+//				 it's read, unless it's the one already decoded.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::DecodedStream::Seek(pos_type Offset, int SeekType)
+{
+	if(!mSeekable)
+	{
+		THROW_EXCEPTION(BackupStoreException, StreamDoesntHaveRequiredFeatures)
+	}
+
+	int64_t size = mClearPositions[mNumBlocks];
+	int64_t newPosition = Offset;
+	switch(SeekType)
+	{
+	case IOStream::SeekType_Absolute:
+		break;
+	case IOStream::SeekType_Relative:
+		newPosition += GetPosition();
+		break;
+	case IOStream::SeekType_End:
+		newPosition += size;
+		break;
+	default:
+		THROW_EXCEPTION(CommonException, IOStreamBadSeekType)
+	}
+
+	if(newPosition < 0 || newPosition > size)
+	{
+		THROW_EXCEPTION(BackupStoreException, SeekOutsideDecodedFile)
+	}
+
+	if(newPosition == size)
+	{
+		// Nothing more to read
+		mCurrentBlock = mNumBlocks - 1;
+		mPositionInCurrentBlock = 0;
+		mCurrentBlockClearSize = 0;
+		mSkipInNextBlock = 0;
+		return;
+	}
+
+	// Find the block it's in
+	int64_t block = (std::upper_bound(mClearPositions.begin(),
+		mClearPositions.end(), newPosition) - mClearPositions.begin()) - 1;
+	ASSERT(block >= 0 && block < mNumBlocks);
+
+	if(block == mCurrentBlock && mCurrentBlockClearSize > 0)
+	{
+		// Already decoded
+		mPositionInCurrentBlock = newPosition - mClearPositions[block];
+		mSkipInNextBlock = 0;
+		return;
+	}
+
+	mrEncodedFile.Seek(mEncodedPositions[block], IOStream::SeekType_Absolute);
+	mCurrentBlock = block - 1;
+	mPositionInCurrentBlock = 0;
+	mCurrentBlockClearSize = 0;
+	mSkipInNextBlock = newPosition - mClearPositions[block];
+}
+
+
 
 
 
@@ -1322,6 +1525,106 @@ void BackupStoreFile::SetAESKey(const void *pKey, int KeyLength)
 #endif
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodingContexts::DecodingContexts()
+//		Purpose: Constructor. Must be called on a thread which isn't
+//			 decoding anything, after the keys have been set.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFile::DecodingContexts::DecodingContexts()
+: mpBlowfishDecrypt(0),
+  mpAESDecrypt(0),
+  mpBlowfishDecryptBlockEntry(0),
+  mpAttributesDecrypt(0)
+{
+	try
+	{
+		mpBlowfishDecrypt = new CipherContext;
+		mpBlowfishDecrypt->Init(sBlowfishDecrypt);
+#ifndef HAVE_OLD_SSL
+		// Only set if the keys file has an AES key
+		if(sAESDecrypt.IsInitialised())
+		{
+			mpAESDecrypt = new CipherContext;
+			mpAESDecrypt->Init(sAESDecrypt);
+		}
+#endif
+		mpBlowfishDecryptBlockEntry = new CipherContext;
+		mpBlowfishDecryptBlockEntry->Init(sBlowfishDecryptBlockEntry);
+		mpAttributesDecrypt = new CipherContext;
+		BackupClientFileAttributes::CopyDecryptContext(*mpAttributesDecrypt);
+	}
+	catch(...)
+	{
+		delete mpBlowfishDecrypt;
+		delete mpAESDecrypt;
+		delete mpBlowfishDecryptBlockEntry;
+		delete mpAttributesDecrypt;
+		throw;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodingContexts::~DecodingContexts()
+//		Purpose: Destructor. No thread may still be using the contexts.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFile::DecodingContexts::~DecodingContexts()
+{
+	delete mpBlowfishDecrypt;
+	delete mpAESDecrypt;
+	delete mpBlowfishDecryptBlockEntry;
+	delete mpAttributesDecrypt;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodingContexts::Use()
+//		Purpose: Decode with these contexts on the calling thread,
+//			 until StopUsing() is called. Only one thread may use
+//			 them at a time.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::DecodingContexts::Use()
+{
+	spThreadBlowfishDecrypt = mpBlowfishDecrypt;
+#ifndef HAVE_OLD_SSL
+	spThreadAESDecrypt = mpAESDecrypt;
+#endif
+	spThreadBlowfishDecryptBlockEntry = mpBlowfishDecryptBlockEntry;
+	BackupClientFileAttributes::SetThreadDecryptContext(mpAttributesDecrypt);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::DecodingContexts::StopUsing()
+//		Purpose: Go back to the shared contexts on the calling thread
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::DecodingContexts::StopUsing()
+{
+	spThreadBlowfishDecrypt = 0;
+#ifndef HAVE_OLD_SSL
+	spThreadAESDecrypt = 0;
+#endif
+	spThreadBlowfishDecryptBlockEntry = 0;
+	BackupClientFileAttributes::SetThreadDecryptContext(0);
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1353,7 +1656,24 @@ int BackupStoreFile::MaxBlockSizeForChunkSize(int ChunkSize)
 int BackupStoreFile::EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFile::EncodingBuffer &rOutput)
 {
 	ASSERT(spEncrypt != 0);
+	return EncodeChunk(Chunk, ChunkSize, rOutput, *spEncrypt);
+}
 
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::EncodeChunk(const void *, int, BackupStoreFile::EncodingBuffer &, CipherContext &)
+//		Purpose: Encodes a chunk using the given cipher context, which
+//				 must have been set up with the same key and cipher as
+//				 the current encryption context. Allows several threads
+//				 to encode chunks at once, each with its own context.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreFile::EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFile::EncodingBuffer &rOutput,
+	CipherContext &rEncrypt)
+{
 	// Check there's some space in the output block
 	if(rOutput.mBufferSize < 256)
 	{
@@ -1376,12 +1696,12 @@ int BackupStoreFile::EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFi
 
 	// Setup cipher, and store the IV
 	int ivLen = 0;
-	const void *iv = spEncrypt->SetRandomIV(ivLen);
+	const void *iv = rEncrypt.SetRandomIV(ivLen);
 	::memcpy(rOutput.mpBuffer + outOffset, iv, ivLen);
 	outOffset += ivLen;
 
 	// Start encryption process
-	spEncrypt->Begin();
+	rEncrypt.Begin();
 
 	#define ENCODECHUNK_CHECK_SPACE(ToEncryptSize)									\
 		{																			\
@@ -1409,7 +1729,7 @@ int BackupStoreFile::EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFi
 			if(s > 0)
 			{
 				ENCODECHUNK_CHECK_SPACE(s)
-				outOffset += spEncrypt->Transform(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset, buffer, s);
+				outOffset += rEncrypt.Transform(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset, buffer, s);
 			}
 			else
 			{
@@ -1419,15 +1739,15 @@ int BackupStoreFile::EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFi
 			}
 		}
 		ENCODECHUNK_CHECK_SPACE(16)
-		outOffset += spEncrypt->Final(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset);
+		outOffset += rEncrypt.Final(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset);
 	}
 	else
 	{
 		// Straight encryption
 		ENCODECHUNK_CHECK_SPACE(ChunkSize)
-		outOffset += spEncrypt->Transform(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset, Chunk, ChunkSize);
+		outOffset += rEncrypt.Transform(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset, Chunk, ChunkSize);
 		ENCODECHUNK_CHECK_SPACE(16)
-		outOffset += spEncrypt->Final(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset);
+		outOffset += rEncrypt.Final(rOutput.mpBuffer + outOffset, rOutput.mBufferSize - outOffset);
 	}
 
 	ASSERT(outOffset < rOutput.mBufferSize);		// first check should have sorted this -- merely logic check
@@ -1470,14 +1790,14 @@ int BackupStoreFile::DecodeChunk(const void *Encoded, int EncodedSize, void *Out
 
 #ifndef HAVE_OLD_SSL
 	// Choose cipher
-	CipherContext &cipher((encodingType == HEADER_AES_ENCODING)?sAESDecrypt:sBlowfishDecrypt);
+	CipherContext &cipher((encodingType == HEADER_AES_ENCODING)?AESDecrypt():BlowfishDecrypt());
 #else
 	// AES not supported with this version of OpenSSL
 	if(encodingType == HEADER_AES_ENCODING)
 	{
 		THROW_EXCEPTION(BackupStoreException, AEScipherNotSupportedByInstalledOpenSSL)
 	}
-	CipherContext &cipher(sBlowfishDecrypt);
+	CipherContext &cipher(BlowfishDecrypt());
 #endif
 
 	// Check enough space for header, an IV and one byte of input
@@ -1636,6 +1956,28 @@ std::auto_ptr<IOStream> BackupStoreFile::ReorderFileToStreamOrder(IOStream *pStr
 
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::SetEncodingThreads(int)
+//		Purpose: Set the number of worker threads which encode new
+//				 blocks of files being uploaded. Zero (the default)
+//				 encodes each block on the thread reading the stream.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::SetEncodingThreads(int Threads)
+{
+	if(Threads < 0 || Threads > BACKUP_FILE_MAX_ENCODING_THREADS)
+	{
+		THROW_EXCEPTION_MESSAGE(BackupStoreException, Internal,
+			"Invalid number of encoding threads: " << Threads);
+	}
+	msEncodingThreads = Threads;
+}
+
+
+
 // --------------------------------------------------------------------------
 //
 // Function
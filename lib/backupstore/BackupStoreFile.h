@@ -12,6 +12,7 @@
 
 #include <cstdlib>
 #include <memory>
+#include <vector>
 #include <cstdlib>
 
 #include "autogen_BackupProtocol.h"
@@ -30,6 +31,7 @@ typedef struct
 } BackupStoreFileStats;
 
 class BackgroundTask;
+class CipherContext;
 class RunStatusProvider;
 
 // Uncomment to disable backwards compatibility
@@ -81,7 +83,7 @@ public:
 	{
 		friend class BackupStoreFile;
 	private:
-		DecodedStream(IOStream &rEncodedFile, int Timeout);
+		DecodedStream(IOStream &rEncodedFile, int Timeout, bool Seekable);
 		DecodedStream(const DecodedStream &); // not allowed
 		DecodedStream &operator=(const DecodedStream &); // not allowed
 	public:
@@ -93,6 +95,11 @@ public:
 			int Timeout = IOStream::TimeOutInfinite);
 		virtual bool StreamDataLeft();
 		virtual bool StreamClosed();
+
+		// Only if decoded with Seekable set, see DecodeFileStream()
+		virtual pos_type BytesLeftToRead();
+		virtual pos_type GetPosition() const;
+		virtual void Seek(pos_type Offset, int SeekType);
 		
 		// Accessor functions
 		const BackupClientFileAttributes &GetAttributes() {return mAttributes;}
@@ -104,6 +111,7 @@ public:
 	private:
 		void Setup(const BackupClientFileAttributes *pAlterativeAttr);
 		void ReadBlockIndex(bool MagicAlreadyRead);
+		void CalculateBlockPositions(int64_t BlockDataStart);
 			
 	private:
 		IOStream &mrEncodedFile;
@@ -122,6 +130,13 @@ public:
 #ifndef BOX_DISABLE_BACKWARDS_COMPATIBILITY_BACKUPSTOREFILE
 		bool mIsOldVersion;
 #endif
+		bool mSeekable;
+		// Where each block starts in the clear data, and in the
+		// encoded file, with an extra entry for the end of the data
+		std::vector<int64_t> mClearPositions;
+		std::vector<int64_t> mEncodedPositions;
+		// Clear data to skip when the next block is read
+		int mSkipInNextBlock;
 	};
 
 	class VerifyStream : public IOStream
@@ -219,10 +234,19 @@ public:
 	static void CombineFile(IOStream &rDiff, IOStream &rDiff2, IOStream &rFrom, IOStream &rOut);
 	static void CombineDiffs(IOStream &rDiff1, IOStream &rDiff2, IOStream &rDiff2b, IOStream &rOut);
 	static void ReverseDiffFile(IOStream &rDiff, IOStream &rFrom, IOStream &rFrom2, IOStream &rOut, int64_t ObjectIDOfFrom, bool *pIsCompletelyDifferent = 0);
-	static void DecodeFile(IOStream &rEncodedFile, const char *DecodedFilename, int Timeout, const BackupClientFileAttributes *pAlterativeAttr = 0);
-	static std::auto_ptr<BackupStoreFile::DecodedStream> DecodeFileStream(IOStream &rEncodedFile, int Timeout, const BackupClientFileAttributes *pAlterativeAttr = 0);
+	static void DecodeFile(IOStream &rEncodedFile, const char *DecodedFilename, int Timeout, const BackupClientFileAttributes *pAlterativeAttr = 0,
+		BackupClientFileAttributes *pAttributesOut = 0);
+	static std::auto_ptr<BackupStoreFile::DecodedStream> DecodeFileStream(IOStream &rEncodedFile, int Timeout, const BackupClientFileAttributes *pAlterativeAttr = 0, bool Seekable = false);
 	static bool CompareFileContentsAgainstBlockIndex(const char *Filename, IOStream &rBlockIndex, int Timeout);
-	static std::auto_ptr<IOStream> CombineFileIndices(IOStream &rDiff, IOStream &rFrom, bool DiffIsIndexOnly = false, bool FromIsIndexOnly = false);
+	static std::auto_ptr<IOStream> CombineFileIndices(IOStream &rDiff, IOStream &rFrom, bool DiffIsIndexOnly = false, bool FromIsIndexOnly = false, bool TakeOwnershipOfDiff = false);
+	static std::auto_ptr<IOStream> CombinePatchChain(const std::vector<IOStream *> &rChain, bool InFileOrder = false);
+
+	// Block fingerprints, for finding files on the store which contain
+	// the same blocks (see BackupStoreBlockDatabase)
+	static uint64_t GetBlockFingerprint(int32_t ClearSize,
+		uint32_t WeakChecksum, const uint8_t *pStrongChecksum);
+	static void CalculateBlockFingerprints(const std::string &Filename,
+		std::vector<uint64_t> &rFingerprintsOut, int64_t MaxBlocks = 0);
 
 	// Stream manipulation
 	static std::auto_ptr<IOStream> ReorderFileToStreamOrder(IOStream *pStream, bool TakeOwnership);
@@ -282,6 +306,8 @@ public:
 	};
 	static int MaxBlockSizeForChunkSize(int ChunkSize);
 	static int EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFile::EncodingBuffer &rOutput);
+	static int EncodeChunk(const void *Chunk, int ChunkSize, BackupStoreFile::EncodingBuffer &rOutput,
+		CipherContext &rEncrypt);
 
 	// Caller should know how big the output size is, but also allocate a bit more memory to cover various
 	// overheads allowed for in checks
@@ -301,6 +327,53 @@ public:
 	static bool TraceDetailsOfDiffProcess;
 #endif
 
+	// Use the original search for matching blocks, which reads the file
+	// once for each block size, instead of the single pass search.
+	static bool DiffUseMultiPassSearch;
+
+	// Cut new data into blocks at boundaries chosen by its content, see
+	// BackupStoreFileChunker, instead of blocks of a fixed size. Diffs
+	// against a file encoded this way look its blocks up by checksum.
+	static bool ContentDefinedChunking;
+
+	// Number of worker threads used to compress and encrypt new blocks
+	// while a file is being uploaded. Zero encodes on the calling thread.
+	static void SetEncodingThreads(int Threads);
+	static int GetEncodingThreads() { return msEncodingThreads; }
+private:
+	static int msEncodingThreads;
+public:
+
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupStoreFile::DecodingContexts
+	//		Purpose: Copies of the contexts used to decrypt file data,
+	//			 block indexes and attributes, made after the keys
+	//			 are set. A thread which calls Use() can decode files
+	//			 while other threads are decoding too.
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class DecodingContexts
+	{
+	public:
+		DecodingContexts();
+		~DecodingContexts();
+	private:
+		// no copying
+		DecodingContexts(const DecodingContexts &);
+		DecodingContexts &operator=(const DecodingContexts &);
+	public:
+		void Use();
+		void StopUsing();
+	private:
+		CipherContext *mpBlowfishDecrypt;
+		CipherContext *mpAESDecrypt;
+		CipherContext *mpBlowfishDecryptBlockEntry;
+		CipherContext *mpAttributesDecrypt;
+	};
+
 	// For decoding encoded files
 	static void DumpFile(void *clibFileHandle, bool ToTrace, IOStream &rFile);
 };
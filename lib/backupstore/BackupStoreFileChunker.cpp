@@ -0,0 +1,251 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileChunker.cpp
+//		Purpose: Cut file data into blocks at boundaries chosen by the
+//			 content of the data
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <string.h>
+
+#include "BackupStoreConstants.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
+#include "IOStream.h"
+
+#include "MemLeakFindOn.h"
+
+bool BackupStoreFile::ContentDefinedChunking = false;
+
+// Before the normal size, a boundary needs more of the top bits of the hash
+// to be zero than after it, which narrows the spread of block sizes. One
+// more bit is needed each time the sizes are doubled.
+#define CHUNK_MASK_BITS_BEFORE_NORMAL	16
+#define CHUNK_MASK_BITS_AFTER_NORMAL	12
+
+// The gear table must never change, or blocks cut by different versions
+// would not match, so it's generated from a fixed seed.
+#define CHUNK_GEAR_SEED			0x426f784261636b75ULL
+
+namespace
+{
+	class GearTable
+	{
+	public:
+		GearTable()
+		{
+			// splitmix64
+			uint64_t state = CHUNK_GEAR_SEED;
+			for(int i = 0; i < 256; ++i)
+			{
+				state += 0x9e3779b97f4a7c15ULL;
+				uint64_t z = state;
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				mGear[i] = z ^ (z >> 31);
+			}
+		}
+		uint64_t mGear[256];
+	};
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::BackupStoreFileChunker(
+//			 IOStream &, int64_t, int)
+//		Purpose: Constructor. Chunks the next DataSize bytes of the
+//			 stream, which must be available, into blocks of the
+//			 sizes given by SizeShift.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFileChunker::BackupStoreFileChunker(IOStream &rFile,
+	int64_t DataSize, int SizeShift)
+: mrFile(rFile),
+  mBytesLeftToRead(DataSize),
+  mMinSize(BACKUP_FILE_MIN_BLOCK_SIZE << SizeShift),
+  mNormalSize(BACKUP_FILE_CHUNK_NORMAL_SIZE << SizeShift),
+  mMaxSize(BACKUP_FILE_CHUNK_MAX_SIZE << SizeShift),
+  mMaskBeforeNormal(~(~0ULL >> (CHUNK_MASK_BITS_BEFORE_NORMAL + SizeShift))),
+  mMaskAfterNormal(~(~0ULL >> (CHUNK_MASK_BITS_AFTER_NORMAL + SizeShift))),
+  mBuffer(mMaxSize * 2),
+  mBufferStart(0),
+  mBufferEnd(0)
+{
+	ASSERT(SizeShift >= 0 && mMaxSize <= BACKUP_FILE_MAX_BLOCK_SIZE);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::GetSizeShift(int64_t)
+//		Purpose: Static. Returns how far to shift the block sizes
+//			 left for a file of this size. Like the fixed block
+//			 sizes of BackupStoreFileEncodeStream::
+//			 CalculateBlockSizes(), they're doubled until there
+//			 are no more than BACKUP_FILE_INCREASE_BLOCK_SIZE_AFTER
+//			 blocks of the normal size, or they can't get bigger.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreFileChunker::GetSizeShift(int64_t FileSize)
+{
+	int shift = 0;
+	while((BACKUP_FILE_CHUNK_MAX_SIZE << (shift + 1)) <=
+			BACKUP_FILE_MAX_BLOCK_SIZE &&
+		((int64_t)BACKUP_FILE_CHUNK_NORMAL_SIZE << shift) *
+			BACKUP_FILE_INCREASE_BLOCK_SIZE_AFTER < FileSize)
+	{
+		++shift;
+	}
+	return shift;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::~BackupStoreFileChunker()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFileChunker::~BackupStoreFileChunker()
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::NextChunk(const uint8_t *&,
+//			 int32_t &)
+//		Purpose: Find the next chunk in the region. Keeps at least a
+//			 maximum sized block in the buffer, so that a boundary
+//			 is never cut short by the end of the buffer rather
+//			 than the end of the region.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreFileChunker::NextChunk(const uint8_t *&rpChunkOut,
+	int32_t &rSizeOut)
+{
+	int available = mBufferEnd - mBufferStart;
+	if(available < mMaxSize && mBytesLeftToRead > 0)
+	{
+		::memmove(&mBuffer[0], &mBuffer[mBufferStart], available);
+		mBufferStart = 0;
+		mBufferEnd = available;
+
+		int toRead = (int)mBuffer.size() - mBufferEnd;
+		if(toRead > mBytesLeftToRead)
+		{
+			toRead = (int)mBytesLeftToRead;
+		}
+		if(!mrFile.ReadFullBuffer(&mBuffer[mBufferEnd], toRead,
+			0 /* not interested in size if failure */))
+		{
+			// The file has got shorter since its size was read
+			THROW_EXCEPTION(BackupStoreException,
+				Temp_FileEncodeStreamDidntReadBuffer)
+		}
+		mBufferEnd += toRead;
+		mBytesLeftToRead -= toRead;
+		available = mBufferEnd;
+	}
+
+	if(available == 0)
+	{
+		return false;
+	}
+
+	rpChunkOut = &mBuffer[mBufferStart];
+	rSizeOut = FindBoundary(rpChunkOut, available);
+	mBufferStart += rSizeOut;
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::FindBoundary(const uint8_t *,
+//			 int32_t)
+//		Purpose: Private. Returns the size of the block starting at
+//			 pData, where Size bytes are available. If fewer than
+//			 a maximum sized block are available, they must be the
+//			 end of the region.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int32_t BackupStoreFileChunker::FindBoundary(const uint8_t *pData,
+	int32_t Size) const
+{
+	if(Size <= mMinSize)
+	{
+		return Size;
+	}
+
+	static const GearTable table;
+	const uint64_t *gear = table.mGear;
+
+	int32_t normal = mNormalSize;
+	if(normal > Size) normal = Size;
+	int32_t max = mMaxSize;
+	if(max > Size) max = Size;
+
+	// No block may end before the minimum size, so don't hash it. Each
+	// byte is shifted out of the hash after 64 more, so beyond that a
+	// boundary depends only on the data and not on where hashing began.
+	uint64_t hash = 0;
+	int32_t i = mMinSize;
+	for(; i < normal; ++i)
+	{
+		hash = (hash << 1) + gear[pData[i]];
+		if((hash & mMaskBeforeNormal) == 0)
+		{
+			return i + 1;
+		}
+	}
+	for(; i < max; ++i)
+	{
+		hash = (hash << 1) + gear[pData[i]];
+		if((hash & mMaskAfterNormal) == 0)
+		{
+			return i + 1;
+		}
+	}
+
+	return max;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileChunker::CalculateChunkSizes(IOStream &,
+//			 int64_t, int, std::vector<int32_t> &)
+//		Purpose: Chunk the next DataSize bytes of the stream, and
+//			 append the sizes of the blocks to rSizesOut.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileChunker::CalculateChunkSizes(IOStream &rFile,
+	int64_t DataSize, int SizeShift, std::vector<int32_t> &rSizesOut)
+{
+	BackupStoreFileChunker chunker(rFile, DataSize, SizeShift);
+	const uint8_t *pchunk = 0;
+	int32_t size = 0;
+	while(chunker.NextChunk(pchunk, size))
+	{
+		rSizesOut.push_back(size);
+	}
+}
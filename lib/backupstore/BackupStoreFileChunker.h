@@ -0,0 +1,76 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileChunker.h
+//		Purpose: Cut file data into blocks at boundaries chosen by the
+//			 content of the data
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTOREFILECHUNKER__H
+#define BACKUPSTOREFILECHUNKER__H
+
+#include <vector>
+
+class IOStream;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreFileChunker
+//		Purpose: Reads a region of a file and splits it into blocks
+//			 using a gear hash, in the style of FastCDC. A boundary
+//			 depends only on the bytes shortly before it, so an
+//			 insertion or deletion moves the boundaries next to
+//			 the change but leaves the rest where they were, and
+//			 the unchanged blocks can still be found by checksum.
+//
+//			 Blocks are between BACKUP_FILE_MIN_BLOCK_SIZE and
+//			 BACKUP_FILE_CHUNK_MAX_SIZE bytes long, apart from the
+//			 last one in the region, and tend towards
+//			 BACKUP_FILE_CHUNK_NORMAL_SIZE. All three are shifted
+//			 left by SizeShift, see GetSizeShift().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreFileChunker
+{
+public:
+	BackupStoreFileChunker(IOStream &rFile, int64_t DataSize,
+		int SizeShift);
+	~BackupStoreFileChunker();
+private:
+	// no copying
+	BackupStoreFileChunker(const BackupStoreFileChunker &);
+	BackupStoreFileChunker &operator=(const BackupStoreFileChunker &);
+
+public:
+	// Returns false when the whole region has been chunked. Otherwise
+	// the chunk's data is valid until the next call.
+	bool NextChunk(const uint8_t *&rpChunkOut, int32_t &rSizeOut);
+
+	static int GetSizeShift(int64_t FileSize);
+	static void CalculateChunkSizes(IOStream &rFile, int64_t DataSize,
+		int SizeShift, std::vector<int32_t> &rSizesOut);
+
+	int32_t GetMinSize() const {return mMinSize;}
+	int32_t GetNormalSize() const {return mNormalSize;}
+	int32_t GetMaxSize() const {return mMaxSize;}
+
+private:
+	int32_t FindBoundary(const uint8_t *pData, int32_t Size) const;
+
+	IOStream &mrFile;
+	int64_t mBytesLeftToRead;
+	int32_t mMinSize;
+	int32_t mNormalSize;
+	int32_t mMaxSize;
+	uint64_t mMaskBeforeNormal;
+	uint64_t mMaskAfterNormal;
+	std::vector<uint8_t> mBuffer;
+	int mBufferStart;
+	int mBufferEnd;
+};
+
+#endif // BACKUPSTOREFILECHUNKER__H
@@ -0,0 +1,269 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileCmbChain.cpp
+//		Purpose: Rebuild a file from a whole chain of patches at once
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <vector>
+
+#include "BackupStoreFile.h"
+#include "BackupStoreFileWire.h"
+#include "BackupStoreObjectMagic.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFilename.h"
+#include "CollectInBufferStream.h"
+#include "CommonException.h"
+#include "ReadGatherStream.h"
+
+#include "MemLeakFindOn.h"
+
+// Hide from outside world
+namespace
+{
+
+// The block index of one object in the chain
+typedef struct
+{
+	// Length of the header, filename and attributes
+	int64_t mDataStart;
+	file_BlockIndexHeader mHeader;
+	std::vector<file_BlockIndexEntry> mEntries;
+	// Position of each block within the object, or -1 if the block
+	// is a reference to the next object in the chain
+	std::vector<int64_t> mPositions;
+} ChainObjectIndex;
+
+// A contiguous run of blocks from one object
+typedef struct
+{
+	int mObject;
+	int64_t mPosition;
+	int64_t mLength;
+} ChainRun;
+
+};
+
+static void LoadChainObjectIndex(IOStream &rObject, ChainObjectIndex &rIndex);
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::CombinePatchChain(const std::vector<IOStream *> &, bool)
+//		Purpose: Rebuilds a complete file from a chain of patches, and
+//				 returns it as a stream in stream order, ready to send,
+//				 or in file order if InFileOrder is true, in which case
+//				 the returned stream can Seek() too.
+//				 rChain[0] is the version wanted, each object is a
+//				 patch from the next one, and the last is complete.
+//
+//				 Only the block indices are read in advance. They are
+//				 composed into a single map from each block of the
+//				 result to the object that actually holds its data,
+//				 which is read directly from there as the result is
+//				 streamed, so no intermediate versions are written.
+//
+//				 The streams must be seekable. On success, they belong
+//				 to the returned stream and are deleted with it. If an
+//				 exception is thrown, they still belong to the caller.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<IOStream> BackupStoreFile::CombinePatchChain(
+	const std::vector<IOStream *> &rChain, bool InFileOrder)
+{
+	if(rChain.empty())
+	{
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+
+	// Load all the indices
+	std::vector<ChainObjectIndex> indices(rChain.size());
+	for(size_t o = 0; o < rChain.size(); ++o)
+	{
+		LoadChainObjectIndex(*(rChain[o]), indices[o]);
+	}
+
+	// Follow each block of the wanted version to the object which
+	// contains it, filling in its size in the new index as we go,
+	// and merging neighbouring blocks into runs which can be copied
+	// in one go.
+	ChainObjectIndex &rwanted(indices[0]);
+	std::vector<ChainRun> runs;
+	int64_t numBlocks = rwanted.mEntries.size();
+	for(int64_t b = 0; b < numBlocks; ++b)
+	{
+		int o = 0;
+		int64_t block = b;
+		int64_t encodedSize = box_ntoh64(rwanted.mEntries[b].mEncodedSize);
+		while(encodedSize <= 0)
+		{
+			// It's in the next object along
+			++o;
+			block = 0 - encodedSize;
+			if(o >= (int)indices.size())
+			{
+				THROW_EXCEPTION(BackupStoreException,
+					OnCombineFromFileIsIncomplete)
+			}
+			if(block >= (int64_t)indices[o].mEntries.size())
+			{
+				// References a block which doesn't actually exist
+				THROW_EXCEPTION(BackupStoreException,
+					BadBackupStoreFile)
+			}
+			encodedSize = box_ntoh64(
+				indices[o].mEntries[block].mEncodedSize);
+		}
+
+		rwanted.mEntries[b].mEncodedSize = box_hton64(encodedSize);
+
+		int64_t position = indices[o].mPositions[block];
+		if(!runs.empty() && runs.back().mObject == o &&
+			runs.back().mPosition + runs.back().mLength == position)
+		{
+			runs.back().mLength += encodedSize;
+		}
+		else
+		{
+			ChainRun run;
+			run.mObject = o;
+			run.mPosition = position;
+			run.mLength = encodedSize;
+			runs.push_back(run);
+		}
+	}
+
+	// Write the new index, which no longer refers to any other file
+	std::auto_ptr<CollectInBufferStream> newIndex(new CollectInBufferStream);
+	{
+		file_BlockIndexHeader hdr(rwanted.mHeader);
+		hdr.mOtherFileID = box_hton64(0);
+		newIndex->Write(&hdr, sizeof(hdr));
+		if(numBlocks > 0)
+		{
+			newIndex->Write(&(rwanted.mEntries[0]),
+				numBlocks * sizeof(file_BlockIndexEntry));
+		}
+		newIndex->SetForReading();
+	}
+
+	// Stream order is the index, then the header, filename and
+	// attributes of the wanted version, then all the block data.
+	// File order has the index at the end instead.
+	std::auto_ptr<IOStream> combined(new ReadGatherStream(true));
+	ReadGatherStream &rcombined(*((ReadGatherStream*)combined.get()));
+	int64_t indexSize = sizeof(file_BlockIndexHeader) +
+		(numBlocks * sizeof(file_BlockIndexEntry));
+	int indexComponent = rcombined.AddComponent(newIndex.release());
+	if(!InFileOrder)
+	{
+		rcombined.AddBlock(indexComponent, indexSize, true, 0);
+	}
+	for(size_t o = 0; o < rChain.size(); ++o)
+	{
+		// Components are numbered in order, so this is component o + 1
+		rcombined.AddComponent(rChain[o]);
+	}
+	rcombined.AddBlock(1, rwanted.mDataStart, true, 0);
+	for(std::vector<ChainRun>::const_iterator i(runs.begin());
+		i != runs.end(); ++i)
+	{
+		rcombined.AddBlock(i->mObject + 1, i->mLength, true,
+			i->mPosition);
+	}
+	if(InFileOrder)
+	{
+		rcombined.AddBlock(indexComponent, indexSize, true, 0);
+	}
+
+	return combined;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static LoadChainObjectIndex(IOStream &, ChainObjectIndex &)
+//		Purpose: Static. Reads the header and block index of an object
+//				 in a patch chain, and works out where each block of
+//				 data in it is. Leaves the stream at an undefined
+//				 position.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void LoadChainObjectIndex(IOStream &rObject, ChainObjectIndex &rIndex)
+{
+	rObject.Seek(0, IOStream::SeekType_Absolute);
+
+	file_StreamFormat hdr;
+	if(!rObject.ReadFullBuffer(&hdr, sizeof(hdr), 0))
+	{
+		THROW_EXCEPTION(BackupStoreException, FailedToReadBlockOnCombine)
+	}
+	if(ntohl(hdr.mMagicValue) != OBJECTMAGIC_FILE_MAGIC_VALUE_V1)
+	{
+		THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
+	}
+
+	// Skip over the filename and attributes to find the data
+	{
+		BackupStoreFilename filename;
+		filename.ReadFromStream(rObject, IOStream::TimeOutInfinite);
+		int32_t size_s;
+		if(!rObject.ReadFullBuffer(&size_s, sizeof(size_s), 0 /* not interested in bytes read if this fails */))
+		{
+			THROW_EXCEPTION(CommonException, StreamableMemBlockIncompleteRead)
+		}
+		rObject.Seek(ntohl(size_s), IOStream::SeekType_Relative);
+	}
+	rIndex.mDataStart = rObject.GetPosition();
+
+	// Read the index from the end of the file
+	int64_t numBlocks = box_ntoh64(hdr.mNumBlocks);
+	rObject.Seek(0 - ((numBlocks * sizeof(file_BlockIndexEntry)) + sizeof(file_BlockIndexHeader)), IOStream::SeekType_End);
+	if(!rObject.ReadFullBuffer(&rIndex.mHeader, sizeof(rIndex.mHeader), 0))
+	{
+		THROW_EXCEPTION(BackupStoreException, FailedToReadBlockOnCombine)
+	}
+	if(ntohl(rIndex.mHeader.mMagicValue) != OBJECTMAGIC_FILE_BLOCKS_MAGIC_VALUE_V1
+		|| (int64_t)box_ntoh64(rIndex.mHeader.mNumBlocks) != numBlocks)
+	{
+		THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
+	}
+
+	rIndex.mEntries.resize(numBlocks);
+	rIndex.mPositions.resize(numBlocks);
+
+	// Read the entries in chunks, rather than one at a time
+	const int64_t entriesPerRead = 1024;
+	for(int64_t b = 0; b < numBlocks; b += entriesPerRead)
+	{
+		int64_t n = numBlocks - b;
+		if(n > entriesPerRead) n = entriesPerRead;
+		if(!rObject.ReadFullBuffer(&(rIndex.mEntries[b]),
+			n * sizeof(file_BlockIndexEntry), 0))
+		{
+			THROW_EXCEPTION(BackupStoreException, FailedToReadBlockOnCombine)
+		}
+	}
+
+	int64_t position = rIndex.mDataStart;
+	for(int64_t b = 0; b < numBlocks; ++b)
+	{
+		int64_t encodedSize = box_ntoh64(rIndex.mEntries[b].mEncodedSize);
+		if(encodedSize > 0)
+		{
+			rIndex.mPositions[b] = position;
+			position += encodedSize;
+		}
+		else
+		{
+			rIndex.mPositions[b] = -1;
+		}
+	}
+}
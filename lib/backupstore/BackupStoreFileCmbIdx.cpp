@@ -28,18 +28,20 @@ namespace
 class BSFCombinedIndexStream : public IOStream
 {
 public:
-	BSFCombinedIndexStream(IOStream *pDiff);
+	BSFCombinedIndexStream(IOStream *pDiff, bool TakeOwnershipOfDiff);
 	~BSFCombinedIndexStream();
 	
 	virtual int Read(void *pBuffer, int NBytes, int Timeout = IOStream::TimeOutInfinite);
 	virtual void Write(const void *pBuffer, int NBytes,
 		int Timeout = IOStream::TimeOutInfinite);
+	virtual pos_type BytesLeftToRead();
 	virtual bool StreamDataLeft();
 	virtual bool StreamClosed();
 	virtual void Initialise(IOStream &rFrom);
 	
 private:
 	IOStream *mpDiff;
+	bool mOwnsDiff;
 	bool mIsInitialised;
 	bool mHeaderWritten;
 	file_BlockIndexHeader mHeader;
@@ -53,7 +55,7 @@ private:
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BackupStoreFile::CombineFileIndices(IOStream &, IOStream &, bool)
+//		Name:    BackupStoreFile::CombineFileIndices(IOStream &, IOStream &, bool, bool, bool)
 //		Purpose: Given a diff file and the file it's a diff from, return a stream from which
 //				 can be read the index of the combined file, without actually combining them.
 //				 The stream of the diff must have a lifetime greater than or equal to the
@@ -63,13 +65,17 @@ private:
 //				 get an error or bad results. So don't do that.
 //				 If DiffIsIndexOnly is true, then rDiff is assumed to be a stream positioned
 //				 at the beginning of the block index. Similarly for FromIsIndexOnly.
+//				 If TakeOwnershipOfDiff is true, the returned stream deletes rDiff.
 //				 WARNING: Reads of the returned streams with buffer sizes less than 64 bytes
 //				 will not return any data.
 //		Created: 8/7/04
 //
 // --------------------------------------------------------------------------
-std::auto_ptr<IOStream> BackupStoreFile::CombineFileIndices(IOStream &rDiff, IOStream &rFrom, bool DiffIsIndexOnly, bool FromIsIndexOnly)
+std::auto_ptr<IOStream> BackupStoreFile::CombineFileIndices(IOStream &rDiff, IOStream &rFrom, bool DiffIsIndexOnly, bool FromIsIndexOnly, bool TakeOwnershipOfDiff)
 {
+	// Create object
+	std::auto_ptr<IOStream> stream(new BSFCombinedIndexStream(&rDiff, TakeOwnershipOfDiff));
+
 	// Reposition file pointers?
 	if(!DiffIsIndexOnly)
 	{
@@ -80,9 +86,6 @@ std::auto_ptr<IOStream> BackupStoreFile::CombineFileIndices(IOStream &rDiff, IOS
 		MoveStreamPositionToBlockIndex(rFrom);
 	}
 
-	// Create object
-	std::auto_ptr<IOStream> stream(new BSFCombinedIndexStream(&rDiff));
-
 	// Initialise it
 	((BSFCombinedIndexStream *)stream.get())->Initialise(rFrom);
 
@@ -94,13 +97,14 @@ std::auto_ptr<IOStream> BackupStoreFile::CombineFileIndices(IOStream &rDiff, IOS
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    BSFCombinedIndexStream::BSFCombinedIndexStream()
+//		Name:    BSFCombinedIndexStream::BSFCombinedIndexStream(IOStream *, bool)
 //		Purpose: Private class. Constructor.
 //		Created: 8/7/04
 //
 // --------------------------------------------------------------------------
-BSFCombinedIndexStream::BSFCombinedIndexStream(IOStream *pDiff)
+BSFCombinedIndexStream::BSFCombinedIndexStream(IOStream *pDiff, bool TakeOwnershipOfDiff)
 	: mpDiff(pDiff),
+	  mOwnsDiff(TakeOwnershipOfDiff),
 	  mIsInitialised(false),
 	  mHeaderWritten(false),
 	  mNumEntriesToGo(0),
@@ -126,6 +130,12 @@ BSFCombinedIndexStream::~BSFCombinedIndexStream()
 		::free(mFromBlockSizes);
 		mFromBlockSizes = 0;
 	}
+
+	if(mOwnsDiff)
+	{
+		delete mpDiff;
+		mpDiff = 0;
+	}
 }
 
 
@@ -297,6 +307,27 @@ void BSFCombinedIndexStream::Write(const void *pBuffer, int NBytes,
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BSFCombinedIndexStream::BytesLeftToRead()
+//		Purpose: Private class. As interface. Known once initialised,
+//			 so the index can be sent without chunking.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+IOStream::pos_type BSFCombinedIndexStream::BytesLeftToRead()
+{
+	if(!mIsInitialised)
+	{
+		return IOStream::SizeOfStreamUnknown;
+	}
+
+	return (mHeaderWritten ? 0 : sizeof(mHeader)) +
+		(mNumEntriesToGo * sizeof(file_BlockIndexEntry));
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
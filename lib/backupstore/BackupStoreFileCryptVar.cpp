@@ -29,3 +29,9 @@ uint8_t BackupStoreFileCryptVar::sEncryptCipherType = HEADER_BLOWFISH_ENCODING;
 CipherContext BackupStoreFileCryptVar::sBlowfishEncryptBlockEntry;
 CipherContext BackupStoreFileCryptVar::sBlowfishDecryptBlockEntry;
 
+thread_local CipherContext *BackupStoreFileCryptVar::spThreadBlowfishDecrypt = 0;
+#ifndef HAVE_OLD_SSL
+	thread_local CipherContext *BackupStoreFileCryptVar::spThreadAESDecrypt = 0;
+#endif
+thread_local CipherContext *BackupStoreFileCryptVar::spThreadBlowfishDecryptBlockEntry = 0;
+
@@ -33,6 +33,34 @@ namespace BackupStoreFileCryptVar
 	// Keys for the block indicies
 	extern CipherContext sBlowfishEncryptBlockEntry;
 	extern CipherContext sBlowfishDecryptBlockEntry;
+
+	// Private copies of the decryption contexts, set on a thread which
+	// decodes files at the same time as others. When they are not set,
+	// the shared contexts above are used. See
+	// BackupStoreFile::DecodingContexts.
+	extern thread_local CipherContext *spThreadBlowfishDecrypt;
+#ifndef HAVE_OLD_SSL
+	extern thread_local CipherContext *spThreadAESDecrypt;
+#endif
+	extern thread_local CipherContext *spThreadBlowfishDecryptBlockEntry;
+
+	inline CipherContext &BlowfishDecrypt()
+	{
+		return spThreadBlowfishDecrypt ? *spThreadBlowfishDecrypt
+			: sBlowfishDecrypt;
+	}
+#ifndef HAVE_OLD_SSL
+	inline CipherContext &AESDecrypt()
+	{
+		return spThreadAESDecrypt ? *spThreadAESDecrypt : sAESDecrypt;
+	}
+#endif
+	inline CipherContext &BlowfishDecryptBlockEntry()
+	{
+		return spThreadBlowfishDecryptBlockEntry
+			? *spThreadBlowfishDecryptBlockEntry
+			: sBlowfishDecryptBlockEntry;
+	}
 }
 
 #endif // BACKUPSTOREFILECRYPTVAR__H
@@ -13,6 +13,7 @@
 
 #include <new>
 #include <map>
+#include <vector>
 
 #ifdef HAVE_TIME_H
 	#include <time.h>
@@ -23,6 +24,7 @@
 #include "BackupStoreConstants.h"
 #include "BackupStoreException.h"
 #include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
 #include "BackupStoreFileCryptVar.h"
 #include "BackupStoreFileEncodeStream.h"
 #include "BackupStoreFileWire.h"
@@ -46,15 +48,35 @@ using namespace BackupStoreFileCreation;
 	bool BackupStoreFile::TraceDetailsOfDiffProcess = false;
 #endif
 
+// Use the single pass search for matching blocks unless told otherwise. The
+// original one pass per block size search is kept so the test can compare them.
+bool BackupStoreFile::DiffUseMultiPassSearch = false;
+
 static void LoadIndex(IOStream &rBlockIndex, int64_t ThisID, BlocksAvailableEntry **ppIndex, int64_t &rNumBlocksOut, int Timeout, bool &rCanDiffFromThis);
 static void FindMostUsedSizes(BlocksAvailableEntry *pIndex, int64_t NumBlocks, int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES]);
 static void SearchForMatchingBlocks(IOStream &rFile, 
 	std::map<int64_t, int64_t> &rFoundBlocks, BlocksAvailableEntry *pIndex, 
 	int64_t NumBlocks, int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES],
 	DiffTimer *pDiffTimer);
+static void SearchForMatchingBlocksMultiPass(IOStream &rFile, 
+	std::map<int64_t, int64_t> &rFoundBlocks, BlocksAvailableEntry *pIndex, 
+	int64_t NumBlocks, int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES],
+	DiffTimer *pDiffTimer);
+static void SearchForMatchingBlocksSinglePass(IOStream &rFile, 
+	std::map<int64_t, int64_t> &rFoundBlocks, BlocksAvailableEntry *pIndex, 
+	int64_t NumBlocks, int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES],
+	DiffTimer *pDiffTimer);
+static bool IndexLooksChunked(BlocksAvailableEntry *pIndex, int64_t NumBlocks);
+static void SearchForMatchingChunks(IOStream &rFile, int64_t FileSize,
+	std::map<int64_t, int64_t> &rFoundBlocks, BlocksAvailableEntry *pIndex,
+	int64_t NumBlocks, std::vector<int32_t> &rNewChunkSizes,
+	DiffTimer *pDiffTimer);
 static void SetupHashTable(BlocksAvailableEntry *pIndex, int64_t NumBlocks, int32_t BlockSize, BlocksAvailableEntry **pHashTable);
 static bool SecondStageMatch(BlocksAvailableEntry *pFirstInHashList, RollingChecksum &fastSum, uint8_t *pBeginnings, uint8_t *pEndings, int Offset, int32_t BlockSize, int64_t FileBlockNumber,
 BlocksAvailableEntry *pIndex, std::map<int64_t, int64_t> &rFoundBlocks);
+static bool SecondStageMatchInWindow(BlocksAvailableEntry *pFirstInHashList, uint32_t Checksum, const uint8_t *pWindow, int32_t BlockSize, int64_t FileOffset,
+BlocksAvailableEntry *pIndex, std::map<int64_t, int64_t> &rFoundBlocks);
+static void TraceFoundBlocks(BlocksAvailableEntry *pIndex, std::map<int64_t, int64_t> &rFoundBlocks);
 static void GenerateRecipe(BackupStoreFileEncodeStream::Recipe &rRecipe, BlocksAvailableEntry *pIndex, int64_t NumBlocks, std::map<int64_t, int64_t> &rFoundBlocks, int64_t SizeOfInputFile);
 
 // --------------------------------------------------------------------------
@@ -190,14 +212,31 @@ std::auto_ptr<BackupStoreFileEncodeStream> BackupStoreFile::EncodeFileDiff
 			// Search the file to find matching blocks
 			std::map<int64_t, int64_t> foundBlocks; // map of offset in file to index in block index
 			int64_t sizeOfInputFile = 0;
+			// Sizes of the new blocks, if the file was chunked by content
+			std::vector<int32_t> newChunkSizes;
+			bool chunked = false;
 			// BLOCK
 			{
 				FileStream file(Filename);
 				// Get size of file
 				sizeOfInputFile = file.BytesLeftToRead();
-				// Find all those lovely matching blocks
-				SearchForMatchingBlocks(file, foundBlocks, pindex, 
-					blocksInIndex, sizesToScan, pDiffTimer);
+				// Find all those lovely matching blocks. If the old
+				// file was chunked by content, chunking this one the
+				// same way finds them without a rolling search.
+				if(BackupStoreFile::ContentDefinedChunking &&
+					IndexLooksChunked(pindex, blocksInIndex))
+				{
+					SearchForMatchingChunks(file, sizeOfInputFile,
+						foundBlocks, pindex, blocksInIndex,
+						newChunkSizes, pDiffTimer);
+					chunked = true;
+				}
+				else
+				{
+					SearchForMatchingBlocks(file, foundBlocks,
+						pindex, blocksInIndex, sizesToScan,
+						pDiffTimer);
+				}
 				
 				// Is it completely different?
 				completelyDifferent = (foundBlocks.size() == 0);
@@ -210,6 +249,14 @@ std::auto_ptr<BackupStoreFileEncodeStream> BackupStoreFile::EncodeFileDiff
 			
 			// Fill it in
 			GenerateRecipe(*precipe, pindexKeptRef, blocksInIndex, foundBlocks, sizeOfInputFile);
+
+			// The gaps between the blocks found are exactly the
+			// chunks which weren't, so there's no need for the
+			// encoder to read them twice.
+			if(chunked)
+			{
+				precipe->SetChunkSizes(newChunkSizes);
+			}
 		}
 		// foundBlocks no longer required
 		
@@ -470,13 +517,47 @@ static void FindMostUsedSizes(BlocksAvailableEntry *pIndex, int64_t NumBlocks, i
 //
 // Function
 //		Name:    static SearchForMatchingBlocks(IOStream &, std::map<int64_t, int64_t> &, BlocksAvailableEntry *, int64_t, int32_t[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES])
-//		Purpose: Find the matching blocks within the file.
+//		Purpose: Find the matching blocks within the file, using the
+//			 search selected by BackupStoreFile::DiffUseMultiPassSearch.
 //		Created: 12/1/04
 //
 // --------------------------------------------------------------------------
 static void SearchForMatchingBlocks(IOStream &rFile, std::map<int64_t, int64_t> &rFoundBlocks,
 	BlocksAvailableEntry *pIndex, int64_t NumBlocks, 
 	int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES], DiffTimer *pDiffTimer)
+{
+	if(BackupStoreFile::DiffUseMultiPassSearch)
+	{
+		SearchForMatchingBlocksMultiPass(rFile, rFoundBlocks, pIndex,
+			NumBlocks, Sizes, pDiffTimer);
+	}
+	else
+	{
+		SearchForMatchingBlocksSinglePass(rFile, rFoundBlocks, pIndex,
+			NumBlocks, Sizes, pDiffTimer);
+	}
+
+#ifndef BOX_RELEASE_BUILD
+	if(BackupStoreFile::TraceDetailsOfDiffProcess)
+	{
+		TraceFoundBlocks(pIndex, rFoundBlocks);
+	}
+#endif
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static SearchForMatchingBlocksMultiPass(IOStream &, std::map<int64_t, int64_t> &, BlocksAvailableEntry *, int64_t, int32_t[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES])
+//		Purpose: Find the matching blocks within the file, reading the
+//			 whole file once for each block size.
+//		Created: 12/1/04
+//
+// --------------------------------------------------------------------------
+static void SearchForMatchingBlocksMultiPass(IOStream &rFile, std::map<int64_t, int64_t> &rFoundBlocks,
+	BlocksAvailableEntry *pIndex, int64_t NumBlocks, 
+	int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES], DiffTimer *pDiffTimer)
 {
 	Timer maximumDiffingTime(0, "MaximumDiffingTime");
 
@@ -505,9 +586,9 @@ static void SearchForMatchingBlocks(IOStream &rFile, std::map<int64_t, int64_t>
 		THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
 	}
 	
-	// TODO: Because we read in the file a scanned block size at a time,
-	// it is likely to be inefficient. Probably will be much better to
-	// calculate checksums for all block sizes in a single pass.
+	// NOTE: This reads in the file a scanned block size at a time, which
+	// is inefficient. SearchForMatchingBlocksSinglePass() calculates
+	// checksums for all block sizes in a single pass instead.
 
 	// Allocate the buffers.
 	uint8_t *pbuffer0 = (uint8_t *)::malloc(bufSize);
@@ -743,28 +824,570 @@ static void SearchForMatchingBlocks(IOStream &rFile, std::map<int64_t, int64_t>
 		if(phashTable != 0) ::free(phashTable);
 		throw;
 	}
+}
+
+
+// Per block size state for SearchForMatchingBlocksSinglePass(). Each one
+// behaves exactly as one pass of SearchForMatchingBlocksMultiPass() would,
+// but in terms of absolute file offsets instead of buffer positions.
+typedef struct
+{
+	int32_t mBlockSize;
+	RollingChecksum mRolling;	// checksum of the window at the current position
+	int64_t mSkipUntil;		// don't look for matches before this offset
+	int64_t mNextChunkStart;	// start of the next BlockSize sized chunk of the file to check for bigger matches
+	int64_t mNextKeepAlive;		// offset at which to call DoKeepAlive() again
+	const uint8_t *mpHashFilter;	// one bit per hash value of blocks of this size
+} SinglePassScanState;
+
+#define SINGLE_PASS_HASH_FILTER_SIZE	((64*1024) / 8)
+
+// Number of window positions to calculate checksums for at once
+#define SINGLE_PASS_CHECKSUM_BATCH	256
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static NextInFilter(const uint32_t *, int, int)
+//		Purpose: Returns the first position from From to To (exclusive)
+//			 whose bit is set in the flags from RollForwardBatch(),
+//			 or To if there isn't one.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static inline int NextInFilter(const uint32_t *pInFilter, int From, int To)
+{
+	while(From < To)
+	{
+		uint32_t bits = pInFilter[From / 32] >> (From % 32);
+		if(bits == 0)
+		{
+			// Nothing more in this word
+			From = (From - (From % 32)) + 32;
+			continue;
+		}
+
+#ifdef __GNUC__
+		From += __builtin_ctz(bits);
+#else
+		while((bits & 1) == 0)
+		{
+			bits >>= 1;
+			++From;
+		}
+#endif
+		return (From < To) ? From : To;
+	}
+
+	return To;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static SinglePassScanRange(SinglePassScanState &, const uint8_t *, int64_t, int64_t, int64_t, ...)
+//		Purpose: Scan the window positions From to To (exclusive) for one
+//			 block size. The buffer must hold the file from BufferStart,
+//			 including To + BlockSize bytes. Returns false if the search
+//			 should be abandoned because too many blocks were found.
+//
+//			 DoKeepAlive() is called once for every BlockSize bytes
+//			 scanned, as often as the multi-pass search calls it.
+//
+//			 The checksums are rolled, and the hash filter probed at
+//			 every position, a batch at a time by RollForwardBatch(),
+//			 so only the positions in the filter and the start of each
+//			 chunk need to be looked at here.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static bool SinglePassScanRange(SinglePassScanState &rState, const uint8_t *pBuffer,
+	int64_t BufferStart, int64_t From, int64_t To, BlocksAvailableEntry **pHashTable,
+	BlocksAvailableEntry *pIndex, int64_t NumBlocks,
+	std::map<int64_t, int32_t> &rGoodnessOfFit, std::map<int64_t, int64_t> &rFoundBlocks,
+	DiffTimer *pDiffTimer)
+{
+	const int32_t blockSize = rState.mBlockSize;
+	uint32_t checksums[SINGLE_PASS_CHECKSUM_BATCH + 1];
+	uint32_t inFilter[SINGLE_PASS_CHECKSUM_BATCH / 32];
+
+	for(int64_t batchStart = From; batchStart < To; batchStart += SINGLE_PASS_CHECKSUM_BATCH)
+	{
+		int count = SINGLE_PASS_CHECKSUM_BATCH;
+		if(To - batchStart < count)
+		{
+			count = To - batchStart;
+		}
+		const uint8_t *pbatch = pBuffer + (batchStart - BufferStart);
+
+		while(rState.mNextKeepAlive < batchStart + count)
+		{
+			if(pDiffTimer)
+			{
+				pDiffTimer->DoKeepAlive();
+			}
+			rState.mNextKeepAlive += blockSize;
+		}
+
+		// This leaves the checksum at the end of the batch, whatever
+		// is found in it
+		rState.mRolling.RollForwardBatch(pbatch, blockSize, count,
+			rState.mpHashFilter, checksums, inFilter);
+
+		int i = 0;
+		while(i < count)
+		{
+			int64_t fileOffset = batchStart + i;
+			if(fileOffset < rState.mSkipUntil)
+			{
+				if(rState.mSkipUntil - batchStart >= count)
+				{
+					break;
+				}
+				i = rState.mSkipUntil - batchStart;
+				continue;
+			}
+
+			if(fileOffset >= rState.mNextChunkStart)
+			{
+				// The multi-pass search skips over bigger blocks
+				// already matched at the first offset it looks at
+				// in each chunk.
+				rState.mNextChunkStart = ((fileOffset / blockSize) + 1) * blockSize;
+				std::map<int64_t, int32_t>::const_iterator
+					fit(rGoodnessOfFit.find(fileOffset));
+				if(fit != rGoodnessOfFit.end() && fit->second >= blockSize)
+				{
+					rState.mSkipUntil = fileOffset + fit->second;
+					++i;
+					continue;
+				}
+			}
+
+			// Move on to the next position in the filter, but not
+			// past the end of this chunk, as the next chunk has to
+			// be checked first.
+			int end = count;
+			if(rState.mNextChunkStart - batchStart < end)
+			{
+				end = rState.mNextChunkStart - batchStart;
+			}
+			i = NextInFilter(inFilter, i, end);
+			if(i == end)
+			{
+				continue;
+			}
+
+			fileOffset = batchStart + i;
+			uint16_t hash = RollingChecksum::ExtractHashingComponent(checksums[i]);
+			std::map<int64_t, int32_t>::const_iterator
+				fit(rGoodnessOfFit.find(fileOffset));
+			if(fit == rGoodnessOfFit.end() || fit->second < blockSize)
+			{
+				if(SecondStageMatchInWindow(pHashTable[hash],
+					checksums[i], pbatch + i,
+					blockSize, fileOffset, pIndex, rFoundBlocks))
+				{
+					BOX_TRACE("Found block match of " << blockSize << " bytes with hash " << hash << " at offset " << fileOffset);
+					rGoodnessOfFit[fileOffset] = blockSize;
+
+					// Don't look for any more matches inside this block,
+					// as the multi-pass search doesn't either.
+					rState.mSkipUntil = fileOffset + blockSize;
+				}
+				else if(static_cast<int64_t>(rFoundBlocks.size()) >
+					NumBlocks * BACKUP_FILE_DIFF_MAX_BLOCK_FIND_MULTIPLE)
+				{
+					return false;
+				}
+			}
+
+			++i;
+		}
+	}
+
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static SearchForMatchingBlocksSinglePass(IOStream &, std::map<int64_t, int64_t> &, BlocksAvailableEntry *, int64_t, int32_t[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES])
+//		Purpose: Find the matching blocks within the file, reading it only
+//			 once and keeping a rolling checksum for every block size.
+//			 Finds the same blocks as SearchForMatchingBlocksMultiPass(),
+//			 except that the search may be abandoned at a different
+//			 point if too many blocks are found or the time runs out.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void SearchForMatchingBlocksSinglePass(IOStream &rFile, std::map<int64_t, int64_t> &rFoundBlocks,
+	BlocksAvailableEntry *pIndex, int64_t NumBlocks, 
+	int32_t Sizes[BACKUP_FILE_DIFF_MAX_BLOCK_SIZES], DiffTimer *pDiffTimer)
+{
+	Timer maximumDiffingTime(0, "MaximumDiffingTime");
+
+	if(pDiffTimer && pDiffTimer->IsManaged())
+	{
+		maximumDiffingTime = Timer(pDiffTimer->GetMaximumDiffingTime() *
+			MILLI_SEC_IN_SEC, "MaximumDiffingTime");
+	}
 	
-#ifndef BOX_RELEASE_BUILD
-	if(BackupStoreFile::TraceDetailsOfDiffProcess)
+	std::map<int64_t, int32_t> goodnessOfFit;
+
+	// Set up the states in the order that the multi-pass search would
+	// scan the sizes, which matters when matches are found at the same
+	// offset for different block sizes.
+	std::vector<SinglePassScanState> states;
+	std::map<int32_t, int> sizeToState;
+	int32_t maxBlockSize = 0;
+	for(int s = BACKUP_FILE_DIFF_MAX_BLOCK_SIZES - 1; s >= 0; --s)
+	{
+		if(Sizes[s] == 0)
+		{
+			// empty entry
+			continue;
+		}
+
+		SinglePassScanState state = {Sizes[s], RollingChecksum(0, 0), 0, 0, 0, 0};
+		sizeToState[Sizes[s]] = states.size();
+		states.push_back(state);
+		if(Sizes[s] > maxBlockSize) maxBlockSize = Sizes[s];
+	}
+
+	if(states.empty())
+	{
+		// Nothing to look for
+		return;
+	}
+
+	if(maxBlockSize > BACKUP_FILE_MAX_BLOCK_SIZE)
+	{
+		THROW_EXCEPTION(BackupStoreException, BadBackupStoreFile)
+	}
+
+	// The buffer holds everything from the current position to one
+	// maximum block size past the end of the range being scanned, and
+	// should be big enough to make the moves at each refill cheap.
+	int bufSize = (maxBlockSize + 4) * 4;
+
+	// Allocate the hash lookup table, which holds blocks of all the
+	// sizes being scanned, and the filters of hash values for each size.
+	BlocksAvailableEntry **phashTable = (BlocksAvailableEntry **)::malloc(sizeof(BlocksAvailableEntry *) * (64*1024));
+	uint8_t *phashFilters = (uint8_t *)::malloc(SINGLE_PASS_HASH_FILTER_SIZE * states.size());
+	uint8_t *pbuffer = (uint8_t *)::malloc(bufSize);
+	try
+	{
+		// Check buffer allocation
+		if(pbuffer == 0 || phashFilters == 0 || phashTable == 0)
+		{
+			// If a buffer got allocated, it will be cleaned up in the catch block
+			throw std::bad_alloc();
+		}
+
+		::memset(phashTable, 0, (sizeof(BlocksAvailableEntry *) * (64*1024)));
+		::memset(phashFilters, 0, SINGLE_PASS_HASH_FILTER_SIZE * states.size());
+		for(unsigned int t = 0; t < states.size(); ++t)
+		{
+			states[t].mpHashFilter = phashFilters + (SINGLE_PASS_HASH_FILTER_SIZE * t);
+		}
+
+		// Build the hash table in the same way as SetupHashTable(), so
+		// that blocks with the same size are in the same order in each
+		// list, and the same block is chosen when there are duplicates.
+		for(int64_t b = 0; b < NumBlocks; ++b)
+		{
+			std::map<int32_t, int>::const_iterator i(sizeToState.find(pIndex[b].mSize));
+			if(i == sizeToState.end())
+			{
+				// Not a size we're looking for
+				continue;
+			}
+
+			uint16_t hash = RollingChecksum::ExtractHashingComponent(pIndex[b].mWeakChecksum);
+			pIndex[b].mpNextInHashList = phashTable[hash];
+			phashTable[hash] = pIndex + b;
+			phashFilters[(SINGLE_PASS_HASH_FILTER_SIZE * i->second) + (hash >> 3)] |= (1 << (hash & 7));
+		}
+
+		// Shift file position to beginning
+		rFile.Seek(0, IOStream::SeekType_Absolute);
+
+		int64_t bufferStart = 0;	// offset in file of the first byte in the buffer
+		int bytesInBuffer = 0;
+		int64_t position = 0;		// all sizes have scanned the windows before this offset
+		bool endOfFile = false;
+		bool firstRead = true;
+
+		while(!endOfFile)
+		{
+			// Move the data still needed to the start of the buffer
+			int keep = bytesInBuffer - (position - bufferStart);
+			if(keep > 0 && position != bufferStart)
+			{
+				::memmove(pbuffer, pbuffer + (position - bufferStart), keep);
+			}
+			bufferStart = position;
+			bytesInBuffer = keep;
+
+			// And fill up the rest
+			while(!endOfFile && bytesInBuffer < bufSize)
+			{
+				int bytes = rFile.Read(pbuffer + bytesInBuffer, bufSize - bytesInBuffer);
+				bytesInBuffer += bytes;
+				if(bytes == 0 && !rFile.StreamDataLeft())
+				{
+					endOfFile = true;
+				}
+			}
+
+			int64_t dataEnd = bufferStart + bytesInBuffer;
+
+			if(firstRead)
+			{
+				// Calculate the first checksums, ready for rolling.
+				// Sizes bigger than the file are never scanned.
+				for(unsigned int t = 0; t < states.size(); ++t)
+				{
+					if(states[t].mBlockSize <= dataEnd)
+					{
+						states[t].mRolling = RollingChecksum(pbuffer, states[t].mBlockSize);
+					}
+				}
+				firstRead = false;
+			}
+
+			// All sizes scan the same range of the file, except at the
+			// end, where each finishes at the last window which fits.
+			int64_t scanEnd = dataEnd - maxBlockSize;
+			bool abortSearch = false;
+
+			for(unsigned int t = 0; t < states.size(); ++t)
+			{
+				SinglePassScanState &state(states[t]);
+				if(state.mBlockSize > dataEnd)
+				{
+					// File too short to match, and we have all of it
+					ASSERT(endOfFile);
+					continue;
+				}
+
+				if(maximumDiffingTime.HasExpired())
+				{
+					ASSERT(pDiffTimer != NULL);
+					BOX_INFO("MaximumDiffingTime reached - "
+						"suspending file diff");
+					abortSearch = true;
+					break;
+				}
+
+				int64_t lastWindow = dataEnd - state.mBlockSize;
+				if(!SinglePassScanRange(state, pbuffer, bufferStart,
+					position, endOfFile ? lastWindow : scanEnd,
+					phashTable, pIndex, NumBlocks, goodnessOfFit,
+					rFoundBlocks, pDiffTimer))
+				{
+					abortSearch = true;
+					break;
+				}
+
+				if(endOfFile)
+				{
+					// Check the final block. Like the multi-pass
+					// search, this is done even if it overlaps a
+					// block which has already been matched.
+					uint16_t hash = state.mRolling.GetComponentForHashing();
+					if((state.mpHashFilter[hash >> 3] & (1 << (hash & 7))) != 0 &&
+						(goodnessOfFit.count(lastWindow) == 0 || goodnessOfFit[lastWindow] < state.mBlockSize))
+					{
+						if(SecondStageMatchInWindow(phashTable[hash],
+							state.mRolling.GetChecksum(),
+							pbuffer + (lastWindow - bufferStart),
+							state.mBlockSize, lastWindow, pIndex,
+							rFoundBlocks))
+						{
+							goodnessOfFit[lastWindow] = state.mBlockSize;
+						}
+					}
+				}
+			}
+
+			if(abortSearch) break;
+
+			position = scanEnd;
+		}
+
+		// Free buffers and hash table
+		::free(pbuffer);
+		pbuffer = 0;
+		::free(phashFilters);
+		phashFilters = 0;
+		::free(phashTable);
+		phashTable = 0;
+	}
+	catch(...)
+	{
+		// Cleanup and throw
+		if(pbuffer != 0) ::free(pbuffer);
+		if(phashFilters != 0) ::free(phashFilters);
+		if(phashTable != 0) ::free(phashTable);
+		throw;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static TraceFoundBlocks(BlocksAvailableEntry *, std::map<int64_t, int64_t> &)
+//		Purpose: Trace out the found blocks in debug mode
+//		Created: 12/1/04
+//
+// --------------------------------------------------------------------------
+static void TraceFoundBlocks(BlocksAvailableEntry *pIndex, std::map<int64_t, int64_t> &rFoundBlocks)
+{
+	BOX_TRACE("Diff: list of found blocks");
+	BOX_TRACE("======== ======== ======== ========");
+	BOX_TRACE("  Offset   BlkIdx     Size Movement");
+	for(std::map<int64_t, int64_t>::const_iterator i(rFoundBlocks.begin()); i != rFoundBlocks.end(); ++i)
 	{
-		// Trace out the found blocks in debug mode
-		BOX_TRACE("Diff: list of found blocks");
-		BOX_TRACE("======== ======== ======== ========");
-		BOX_TRACE("  Offset   BlkIdx     Size Movement");
-		for(std::map<int64_t, int64_t>::const_iterator i(rFoundBlocks.begin()); i != rFoundBlocks.end(); ++i)
+		int64_t orgLoc = 0;
+		for(int64_t b = 0; b < i->second; ++b)
 		{
-			int64_t orgLoc = 0;
-			for(int64_t b = 0; b < i->second; ++b)
+			orgLoc += pIndex[b].mSize;
+		}
+		BOX_TRACE(std::setw(8) << i->first << " " <<
+			std::setw(8) << i->second << " " <<
+			std::setw(8) << pIndex[i->second].mSize << 
+			" " << 
+			std::setw(8) << (i->first - orgLoc));
+	}
+	BOX_TRACE("======== ======== ======== ========");
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static IndexLooksChunked(BlocksAvailableEntry *, int64_t)
+//		Purpose: Guess whether a file was encoded with content defined
+//			 chunking. Fixed size encoding makes nearly all of the
+//			 file out of blocks of one size, chunking doesn't.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static bool IndexLooksChunked(BlocksAvailableEntry *pIndex, int64_t NumBlocks)
+{
+	std::map<int32_t, int64_t> areaOfSize;
+	int64_t totalArea = 0;
+	for(int64_t b = 0; b < NumBlocks; ++b)
+	{
+		areaOfSize[pIndex[b].mSize] += pIndex[b].mSize;
+		totalArea += pIndex[b].mSize;
+	}
+
+	int64_t largestArea = 0;
+	for(std::map<int32_t, int64_t>::const_iterator i(areaOfSize.begin());
+		i != areaOfSize.end(); ++i)
+	{
+		if(i->second > largestArea) largestArea = i->second;
+	}
+
+	return NumBlocks > 1 && (largestArea * 2) < totalArea;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static SearchForMatchingChunks(IOStream &, int64_t,
+//			 std::map<int64_t, int64_t> &, BlocksAvailableEntry *,
+//			 int64_t, std::vector<int32_t> &, DiffTimer *)
+//		Purpose: Cut the file into blocks with BackupStoreFileChunker,
+//			 and look each one up in the index by its checksums.
+//			 The sizes of the blocks not found are returned in
+//			 rNewChunkSizes, in file order.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void SearchForMatchingChunks(IOStream &rFile, int64_t FileSize,
+	std::map<int64_t, int64_t> &rFoundBlocks, BlocksAvailableEntry *pIndex,
+	int64_t NumBlocks, std::vector<int32_t> &rNewChunkSizes,
+	DiffTimer *pDiffTimer)
+{
+	Timer maximumDiffingTime(0, "MaximumDiffingTime");
+
+	if(pDiffTimer && pDiffTimer->IsManaged())
+	{
+		maximumDiffingTime = Timer(pDiffTimer->GetMaximumDiffingTime() *
+			MILLI_SEC_IN_SEC, "MaximumDiffingTime");
+	}
+
+	// One hash list for blocks of all sizes, earliest block first
+	std::vector<BlocksAvailableEntry *> hashTable(64*1024, 0);
+	int64_t oldFileSize = 0;
+	for(int64_t b = NumBlocks - 1; b >= 0; --b)
+	{
+		uint16_t hash = RollingChecksum::ExtractHashingComponent(pIndex[b].mWeakChecksum);
+		pIndex[b].mpNextInHashList = hashTable[hash];
+		hashTable[hash] = pIndex + b;
+		oldFileSize += pIndex[b].mSize;
+	}
+
+	// Cut blocks of the sizes that the old file was cut into, even if
+	// the file has grown or shrunk enough to change them, or none of
+	// the boundaries would be in the same places.
+	rFile.Seek(0, IOStream::SeekType_Absolute);
+	BackupStoreFileChunker chunker(rFile, FileSize,
+		BackupStoreFileChunker::GetSizeShift(oldFileSize));
+
+	int64_t fileOffset = 0;
+	bool abortSearch = false;
+	const uint8_t *pchunk = 0;
+	int32_t size = 0;
+	while(chunker.NextChunk(pchunk, size))
+	{
+		// Once the time is up, the rest of the file is new blocks,
+		// but their sizes are still needed.
+		if(!abortSearch && maximumDiffingTime.HasExpired())
+		{
+			ASSERT(pDiffTimer != NULL);
+			BOX_INFO("MaximumDiffingTime reached - "
+				"suspending file diff");
+			abortSearch = true;
+		}
+
+		bool found = false;
+		if(!abortSearch)
+		{
+			if(pDiffTimer)
 			{
-				orgLoc += pIndex[b].mSize;
+				pDiffTimer->DoKeepAlive();
 			}
-			BOX_TRACE(std::setw(8) << i->first << " " <<
-				std::setw(8) << i->second << " " <<
-				std::setw(8) << pIndex[i->second].mSize << 
-				" " << 
-				std::setw(8) << (i->first - orgLoc));
+
+			uint32_t weak = RollingChecksum(pchunk, size).GetChecksum();
+			BlocksAvailableEntry *pfirst = hashTable[
+				RollingChecksum::ExtractHashingComponent(weak)];
+			if(pfirst != 0)
+			{
+				found = SecondStageMatchInWindow(pfirst, weak,
+					pchunk, size, fileOffset, pIndex,
+					rFoundBlocks);
+			}
+		}
+
+		if(!found)
+		{
+			rNewChunkSizes.push_back(size);
 		}
-		BOX_TRACE("======== ======== ======== ========");
+		fileOffset += size;
+	}
+
+#ifndef BOX_RELEASE_BUILD
+	if(BackupStoreFile::TraceDetailsOfDiffProcess)
+	{
+		TraceFoundBlocks(pIndex, rFoundBlocks);
 	}
 #endif
 }
@@ -897,6 +1520,63 @@ static bool SecondStageMatch(BlocksAvailableEntry *pFirstInHashList, RollingChec
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static bool SecondStageMatchInWindow(xxx)
+//		Purpose: As SecondStageMatch(), but for a window held contiguously
+//			 in memory, and a hash list containing blocks of all sizes.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static bool SecondStageMatchInWindow(BlocksAvailableEntry *pFirstInHashList, uint32_t Checksum, const uint8_t *pWindow,
+	int32_t BlockSize, int64_t FileOffset, BlocksAvailableEntry *pIndex, std::map<int64_t, int64_t> &rFoundBlocks)
+{
+	// Check parameters
+	ASSERT(pWindow != 0);
+	ASSERT(BlockSize > 0);
+	ASSERT(pFirstInHashList != 0);
+	ASSERT(pIndex != 0);
+
+	// Before we go to the expense of the MD5, make sure it's a darn good match on the checksum we already know.
+	BlocksAvailableEntry *scan = pFirstInHashList;
+	bool found=false;
+	while(scan != 0)
+	{
+		if(scan->mSize == BlockSize && scan->mWeakChecksum == Checksum)
+		{
+			found = true;
+			break;
+		}
+		scan = scan->mpNextInHashList;
+	}
+	if(!found)
+	{
+		return false;
+	}
+
+	// Calculate the strong MD5 digest for this block
+	MD5Digest strong;
+	strong.Add(pWindow, BlockSize);
+	strong.Finish();
+	
+	// Then go through the entries of this size in the hash list, comparing with the strong digest calculated
+	for(scan = pFirstInHashList; scan != 0; scan = scan->mpNextInHashList)
+	{
+		if(scan->mSize == BlockSize && strong.DigestMatches(scan->mStrongChecksum))
+		{
+			// Found! Add to list of found blocks. As with SecondStageMatch(),
+			// the caller makes sure that this won't replace a better match.
+			rFoundBlocks[FileOffset] = (scan - pIndex);
+			return true;
+		}
+	}
+	
+	// Not matched
+	return false;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -0,0 +1,403 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileEncodePipeline.cpp
+//		Purpose: Encode the new blocks of a file on several threads
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "BackupStoreConstants.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFileCryptVar.h"
+#include "BackupStoreFileEncodePipeline.h"
+#include "CipherContext.h"
+#include "IOStream.h"
+#include "RollingChecksum.h"
+
+#include "MemLeakFindOn.h"
+
+using namespace BackupStoreFileCryptVar;
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::BackupStoreFileEncodePipeline(IOStream &, const BackupStoreFileEncodeStream::Recipe &, int, int)
+//		Purpose: Constructor. rFile must be positioned at the start of
+//			 the file, and the recipe must outlive this object.
+//			 Starts the worker threads, each with its own copy of
+//			 the current encryption context.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFileEncodePipeline::BackupStoreFileEncodePipeline(IOStream &rFile,
+	const BackupStoreFileEncodeStream::Recipe &rRecipe, int NumThreads,
+	int MaxBlockClearSize)
+: mrFile(rFile),
+  mrRecipe(rRecipe),
+  mReadInstruction(-1),
+  mReadBlock(0),
+  mReadNumBlocks(0),
+  mReadBlockSize(0),
+  mReadLastBlockSize(0),
+  mReadFinished(false),
+  mNextToCollect(0),
+  mNextToRead(0),
+  mJobsInFlight(0),
+  mEncodedBufferSize(BackupStoreFile::MaxBlockSizeForChunkSize(MaxBlockClearSize)),
+  mStopping(false)
+{
+	ASSERT(spEncrypt != 0);
+	if(NumThreads < 1 || NumThreads > BACKUP_FILE_MAX_ENCODING_THREADS)
+	{
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+
+	try
+	{
+		for(int j = 0; j < NumThreads * BACKUP_FILE_ENCODING_BLOCKS_PER_THREAD; ++j)
+		{
+			Job *pjob = new Job;
+			pjob->mState = Job_Free;
+			pjob->mpRawBuffer = 0;
+			pjob->mClearSize = 0;
+			pjob->mEncodedSize = 0;
+			pjob->mWeakChecksum = 0;
+			mJobs.push_back(pjob);
+
+			pjob->mpRawBuffer = (uint8_t*)::malloc(MaxBlockClearSize + 1);
+			if(pjob->mpRawBuffer == 0)
+			{
+				throw std::bad_alloc();
+			}
+			pjob->mEncoded.Allocate(mEncodedBufferSize);
+		}
+
+		// Copy the encryption context on this thread, so that
+		// nothing else can be using it at the same time.
+		for(int t = 0; t < NumThreads; ++t)
+		{
+			CipherContext *pencrypt = new CipherContext;
+			mEncryptContexts.push_back(pencrypt);
+			pencrypt->Init(*spEncrypt);
+		}
+
+		for(int t = 0; t < NumThreads; ++t)
+		{
+			mThreads.push_back(std::thread(
+				&BackupStoreFileEncodePipeline::WorkerThread, this,
+				mEncryptContexts[t]));
+		}
+	}
+	catch(...)
+	{
+		Shutdown();
+		throw;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::~BackupStoreFileEncodePipeline()
+//		Purpose: Destructor. Stops the worker threads, abandoning any
+//			 blocks which have not been collected.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreFileEncodePipeline::~BackupStoreFileEncodePipeline()
+{
+	Shutdown();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::Shutdown()
+//		Purpose: Private. Waits for the worker threads to exit, and
+//			 frees the jobs and encryption contexts.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileEncodePipeline::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for(std::vector<std::thread>::iterator i = mThreads.begin();
+		i != mThreads.end(); ++i)
+	{
+		i->join();
+	}
+	mThreads.clear();
+
+	for(std::vector<Job *>::iterator i = mJobs.begin(); i != mJobs.end(); ++i)
+	{
+		if((*i)->mpRawBuffer != 0)
+		{
+			::free((*i)->mpRawBuffer);
+		}
+		delete *i;
+	}
+	mJobs.clear();
+	mQueue.clear();
+
+	for(std::vector<CipherContext *>::iterator i = mEncryptContexts.begin();
+		i != mEncryptContexts.end(); ++i)
+	{
+		delete *i;
+	}
+	mEncryptContexts.clear();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::NextRawBlockSize(int32_t &)
+//		Purpose: Private. Moves the reader to the next block which has
+//			 to be encoded, seeking over blocks reused from the
+//			 previous version of the file. Returns false when there
+//			 are no more blocks.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupStoreFileEncodePipeline::NextRawBlockSize(int32_t &rSizeOut)
+{
+	while(mReadBlock >= mReadNumBlocks)
+	{
+		if(mReadInstruction >= 0)
+		{
+			// Skip over the blocks this instruction reuses
+			const BackupStoreFileEncodeStream::RecipeInstruction &inst
+				= mrRecipe[mReadInstruction];
+			if(inst.mpStartBlock != 0 && inst.mBlocks != 0)
+			{
+				int64_t sizeToSkip = 0;
+				for(int32_t b = 0; b < inst.mBlocks; ++b)
+				{
+					sizeToSkip += inst.mpStartBlock[b].mSize;
+				}
+				mrFile.Seek(sizeToSkip, IOStream::SeekType_Relative);
+			}
+		}
+
+		++mReadInstruction;
+		if(mReadInstruction >= static_cast<int64_t>(mrRecipe.size()))
+		{
+			mReadFinished = true;
+			return false;
+		}
+
+		if(mrRecipe.IsChunked())
+		{
+			mReadNumBlocks = mrRecipe.GetNumChunks(mReadInstruction);
+		}
+		else
+		{
+			BackupStoreFileEncodeStream::CalculateBlockSizes(
+				mrRecipe[mReadInstruction].mSpaceBefore,
+				mReadNumBlocks, mReadBlockSize,
+				mReadLastBlockSize);
+		}
+		mReadBlock = 0;
+	}
+
+	if(mrRecipe.IsChunked())
+	{
+		rSizeOut = mrRecipe.GetChunkSize(mReadInstruction, mReadBlock);
+	}
+	else
+	{
+		rSizeOut = (mReadBlock == (mReadNumBlocks - 1))
+			? mReadLastBlockSize : mReadBlockSize;
+	}
+	++mReadBlock;
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::QueueBlocks()
+//		Purpose: Private. Reads blocks into every free job slot and
+//			 queues them for the workers.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileEncodePipeline::QueueBlocks()
+{
+	while(!mReadFinished && mJobsInFlight < static_cast<int>(mJobs.size()))
+	{
+		int32_t blockRawSize = 0;
+		if(!NextRawBlockSize(blockRawSize))
+		{
+			break;
+		}
+
+		// Slots are only freed in order, so this one can't be in use
+		Job *pjob = mJobs[mNextToRead];
+		ASSERT(pjob->mState == Job_Free);
+
+		// The caller may have swapped in a smaller buffer. Grow it
+		// here, rather than have a worker reallocate it.
+		if(pjob->mEncoded.mBufferSize < mEncodedBufferSize)
+		{
+			pjob->mEncoded.Reallocate(mEncodedBufferSize);
+		}
+
+		if(!mrFile.ReadFullBuffer(pjob->mpRawBuffer, blockRawSize,
+			0 /* not interested in size if failure */))
+		{
+			THROW_EXCEPTION(BackupStoreException,
+				Temp_FileEncodeStreamDidntReadBuffer)
+		}
+		pjob->mClearSize = blockRawSize;
+		pjob->mError = std::exception_ptr();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			pjob->mState = Job_Queued;
+			mQueue.push_back(pjob);
+		}
+		mWorkAvailable.notify_one();
+
+		mNextToRead = (mNextToRead + 1) % mJobs.size();
+		++mJobsInFlight;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::GetNextBlock(BackupStoreFile::EncodingBuffer &, int32_t &, uint32_t &, uint8_t *)
+//		Purpose: Returns the next new block of the file, encoded into
+//			 rOutput (whose buffer may be exchanged for another of
+//			 at least the same size), with its clear size and
+//			 checksums. Returns the encoded size. Rethrows any
+//			 exception raised while encoding the block.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupStoreFileEncodePipeline::GetNextBlock(
+	BackupStoreFile::EncodingBuffer &rOutput, int32_t &rClearSizeOut,
+	uint32_t &rWeakChecksumOut, uint8_t *pStrongChecksumOut)
+{
+	// Keep the workers busy while waiting for this block
+	QueueBlocks();
+
+	if(mJobsInFlight == 0)
+	{
+		// Caller asked for more blocks than the recipe contains
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+
+	Job *pjob = mJobs[mNextToCollect];
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(pjob->mState != Job_Done)
+		{
+			mWorkDone.wait(lock);
+		}
+	}
+
+	mNextToCollect = (mNextToCollect + 1) % mJobs.size();
+	--mJobsInFlight;
+	pjob->mState = Job_Free;
+
+	if(pjob->mError)
+	{
+		std::rethrow_exception(pjob->mError);
+	}
+
+	// Hand over the encoded data without copying it
+	std::swap(rOutput.mpBuffer, pjob->mEncoded.mpBuffer);
+	std::swap(rOutput.mBufferSize, pjob->mEncoded.mBufferSize);
+
+	rClearSizeOut = pjob->mClearSize;
+	rWeakChecksumOut = pjob->mWeakChecksum;
+	::memcpy(pStrongChecksumOut, pjob->mStrongChecksum,
+		MD5Digest::DigestLength);
+	int encodedSize = pjob->mEncodedSize;
+
+	// And read the block which can reuse the slot just freed
+	QueueBlocks();
+
+	return encodedSize;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodePipeline::WorkerThread(CipherContext *)
+//		Purpose: Private. Body of each worker thread: encodes queued
+//			 blocks with its own encryption context until stopped.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileEncodePipeline::WorkerThread(CipherContext *pEncrypt)
+{
+	while(true)
+	{
+		Job *pjob = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while(!mStopping && mQueue.empty())
+			{
+				mWorkAvailable.wait(lock);
+			}
+			if(mStopping)
+			{
+				return;
+			}
+			pjob = mQueue.front();
+			mQueue.pop_front();
+			pjob->mState = Job_Encoding;
+		}
+
+		try
+		{
+			pjob->mEncodedSize = BackupStoreFile::EncodeChunk(
+				pjob->mpRawBuffer, pjob->mClearSize,
+				pjob->mEncoded, *pEncrypt);
+
+			RollingChecksum weakChecksum(pjob->mpRawBuffer,
+				pjob->mClearSize);
+			pjob->mWeakChecksum = weakChecksum.GetChecksum();
+
+			MD5Digest strongChecksum;
+			strongChecksum.Add(pjob->mpRawBuffer, pjob->mClearSize);
+			strongChecksum.Finish();
+			::memcpy(pjob->mStrongChecksum,
+				strongChecksum.DigestAsData(),
+				MD5Digest::DigestLength);
+		}
+		catch(...)
+		{
+			pjob->mError = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			pjob->mState = Job_Done;
+		}
+		mWorkDone.notify_all();
+	}
+}
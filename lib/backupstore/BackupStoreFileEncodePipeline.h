@@ -0,0 +1,119 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileEncodePipeline.h
+//		Purpose: Encode the new blocks of a file on several threads
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPSTOREFILEENCODEPIPELINE__H
+#define BACKUPSTOREFILEENCODEPIPELINE__H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BackupStoreFile.h"
+#include "BackupStoreFileEncodeStream.h"
+#include "MD5Digest.h"
+
+class CipherContext;
+class IOStream;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupStoreFileEncodePipeline
+//		Purpose: Reads the blocks of a file which are not reused from a
+//			 previous version, as described by a Recipe, and hands
+//			 them to a pool of worker threads which compress, encrypt
+//			 and checksum them. The encoded blocks are returned in
+//			 file order by GetNextBlock(), so the caller sees exactly
+//			 the same sequence as encoding them one at a time.
+//
+//			 The file is only read on the thread calling
+//			 GetNextBlock(), which keeps a bounded number of blocks
+//			 in flight ahead of the one being collected.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupStoreFileEncodePipeline
+{
+public:
+	BackupStoreFileEncodePipeline(IOStream &rFile,
+		const BackupStoreFileEncodeStream::Recipe &rRecipe,
+		int NumThreads, int MaxBlockClearSize);
+	~BackupStoreFileEncodePipeline();
+private:
+	// no copying
+	BackupStoreFileEncodePipeline(const BackupStoreFileEncodePipeline &);
+	BackupStoreFileEncodePipeline &operator=(const BackupStoreFileEncodePipeline &);
+
+public:
+	int GetNextBlock(BackupStoreFile::EncodingBuffer &rOutput,
+		int32_t &rClearSizeOut, uint32_t &rWeakChecksumOut,
+		uint8_t *pStrongChecksumOut);
+
+	int GetNumThreads() const { return (int)mThreads.size(); }
+
+private:
+	typedef struct
+	{
+		int mState;
+		uint8_t *mpRawBuffer;
+		int32_t mClearSize;
+		BackupStoreFile::EncodingBuffer mEncoded;
+		int mEncodedSize;
+		uint32_t mWeakChecksum;
+		uint8_t mStrongChecksum[MD5Digest::DigestLength];
+		std::exception_ptr mError;
+	} Job;
+
+	enum
+	{
+		Job_Free = 0,
+		Job_Queued = 1,
+		Job_Encoding = 2,
+		Job_Done = 3
+	};
+
+	bool NextRawBlockSize(int32_t &rSizeOut);
+	void QueueBlocks();
+	void WorkerThread(CipherContext *pEncrypt);
+	void Shutdown();
+
+	IOStream &mrFile;
+	const BackupStoreFileEncodeStream::Recipe &mrRecipe;
+
+	// Position of the reader in the recipe, which follows the same
+	// steps as BackupStoreFileEncodeStream but skips reused blocks by
+	// seeking the file instead of writing their index entries.
+	int64_t mReadInstruction;
+	int64_t mReadBlock;
+	int64_t mReadNumBlocks;
+	int32_t mReadBlockSize;
+	int32_t mReadLastBlockSize;
+	bool mReadFinished;
+
+	// Ring of jobs, in file order: mNextToCollect is the block to be
+	// returned next, mNextToRead is the slot to be filled next.
+	std::vector<Job *> mJobs;
+	std::vector<CipherContext *> mEncryptContexts;
+	int mNextToCollect;
+	int mNextToRead;
+	int mJobsInFlight;
+	int mEncodedBufferSize;
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	std::deque<Job *> mQueue;
+	bool mStopping;
+};
+
+#endif // BACKUPSTOREFILEENCODEPIPELINE__H
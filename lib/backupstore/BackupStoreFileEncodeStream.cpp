@@ -16,7 +16,9 @@
 #include "BackupStoreConstants.h"
 #include "BackupStoreException.h"
 #include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
 #include "BackupStoreFileCryptVar.h"
+#include "BackupStoreFileEncodePipeline.h"
 #include "BackupStoreFileEncodeStream.h"
 #include "BackupStoreFileWire.h"
 #include "BackupStoreObjectMagic.h"
@@ -62,7 +64,11 @@ BackupStoreFileEncodeStream::BackupStoreFileEncodeStream()
   mTotalBytesSent(0),
   mpRawBuffer(0),
   mAllocatedBufferSize(0),
-  mEntryIVBase(0)
+  mEntryIVBase(0),
+  mMaxBlockClearSize(0),
+  mUseEncodePipeline(false),
+  mpEncodePipeline(0),
+  mCollectBlockFingerprints(false)
 {
 }
 
@@ -76,6 +82,13 @@ BackupStoreFileEncodeStream::BackupStoreFileEncodeStream()
 // --------------------------------------------------------------------------
 BackupStoreFileEncodeStream::~BackupStoreFileEncodeStream()
 {
+	// Stop the encoding threads before the file and recipe go away
+	if(mpEncodePipeline)
+	{
+		delete mpEncodePipeline;
+		mpEncodePipeline = 0;
+	}
+
 	// Free buffers
 	if(mpRawBuffer)
 	{
@@ -153,12 +166,34 @@ void BackupStoreFileEncodeStream::Setup(const std::string& Filename,
 			*pModificationTime = modTime;
 		}
 
+		// Content defined chunking has to read the new data to find
+		// out how many blocks it will make, as the header says.
+		if(BackupStoreFile::ContentDefinedChunking && !attr.IsSymLink()
+			&& !pRecipe->IsChunked())
+		{
+			FileStream file(Filename);
+			pRecipe->ChunkNewData(file, fileSize);
+		}
+
 		// Go through each instruction in the recipe and work out how many blocks
 		// it will add, and the max clear size of these blocks
 		int maxBlockClearSize = 0;
+		int64_t newBlocks = 0;
 		for(uint64_t inst = 0; inst < pRecipe->size(); ++inst)
 		{
-			if((*pRecipe)[inst].mSpaceBefore > 0)
+			if((*pRecipe)[inst].mSpaceBefore > 0 && pRecipe->IsChunked())
+			{
+				int64_t numBlocks = pRecipe->GetNumChunks(inst);
+				mTotalBlocks += numBlocks;
+				newBlocks += numBlocks;
+				mBytesToUpload += (*pRecipe)[inst].mSpaceBefore;
+				for(int64_t b = 0; b < numBlocks; ++b)
+				{
+					int32_t size = pRecipe->GetChunkSize(inst, b);
+					if(size > maxBlockClearSize) maxBlockClearSize = size;
+				}
+			}
+			else if((*pRecipe)[inst].mSpaceBefore > 0)
 			{
 				// Calculate the number of blocks the space before requires
 				int64_t numBlocks;
@@ -166,6 +201,7 @@ void BackupStoreFileEncodeStream::Setup(const std::string& Filename,
 				CalculateBlockSizes((*pRecipe)[inst].mSpaceBefore, numBlocks, blockSize, lastBlockSize);
 				// Add to accumlated total
 				mTotalBlocks += numBlocks;
+				newBlocks += numBlocks;
 				mBytesToUpload += (*pRecipe)[inst].mSpaceBefore;
 				// Update maximum clear size
 				if(blockSize > maxBlockClearSize) maxBlockClearSize = blockSize;
@@ -250,6 +286,12 @@ void BackupStoreFileEncodeStream::Setup(const std::string& Filename,
 #else
 			mEncodedBuffer.Allocate(mAllocatedBufferSize);
 #endif
+
+			// Encode on worker threads if configured, and there's more
+			// than one block to keep them busy
+			mMaxBlockClearSize = maxBlockClearSize;
+			mUseEncodePipeline = (BackupStoreFile::GetEncodingThreads() > 0
+				&& newBlocks > 1);
 		}
 		else
 		{
@@ -531,8 +573,12 @@ void BackupStoreFileEncodeStream::SkipPreviousBlocksInInstruction()
 		sizeToSkip += (*mpRecipe)[mInstructionNumber].mpStartBlock[b].mSize;
 	}
 
-	// Move forward in the stream
-	mpLogging->Seek(sizeToSkip, IOStream::SeekType_Relative);
+	// Move forward in the stream, unless the encoding pipeline is
+	// reading it, in which case it skips these blocks itself
+	if(!mUseEncodePipeline)
+	{
+		mpLogging->Seek(sizeToSkip, IOStream::SeekType_Relative);
+	}
 }
 
 
@@ -547,7 +593,14 @@ void BackupStoreFileEncodeStream::SkipPreviousBlocksInInstruction()
 void BackupStoreFileEncodeStream::SetForInstruction()
 {
 	// Calculate block sizes
-	CalculateBlockSizes((*mpRecipe)[mInstructionNumber].mSpaceBefore, mNumBlocks, mBlockSize, mLastBlockSize);
+	if(mpRecipe->IsChunked())
+	{
+		mNumBlocks = mpRecipe->GetNumChunks(mInstructionNumber);
+	}
+	else
+	{
+		CalculateBlockSizes((*mpRecipe)[mInstructionNumber].mSpaceBefore, mNumBlocks, mBlockSize, mLastBlockSize);
+	}
 
 	// Set variables
 	mCurrentBlock = 0;
@@ -569,7 +622,12 @@ void BackupStoreFileEncodeStream::EncodeCurrentBlock()
 {
 	// How big is the block, raw?
 	int blockRawSize = mBlockSize;
-	if(mCurrentBlock == (mNumBlocks - 1))
+	if(mpRecipe->IsChunked())
+	{
+		blockRawSize = mpRecipe->GetChunkSize(mInstructionNumber,
+			mCurrentBlock);
+	}
+	else if(mCurrentBlock == (mNumBlocks - 1))
 	{
 		blockRawSize = mLastBlockSize;
 	}
@@ -582,6 +640,34 @@ void BackupStoreFileEncodeStream::EncodeCurrentBlock()
 		THROW_EXCEPTION(BackupStoreException, Internal)
 	}
 
+	if(mUseEncodePipeline)
+	{
+		// Collect the block from the worker threads, which read the
+		// file ahead of this point and encode it in the same order
+		if(mpEncodePipeline == 0)
+		{
+			mpEncodePipeline = new BackupStoreFileEncodePipeline(
+				*mpLogging, *mpRecipe,
+				BackupStoreFile::GetEncodingThreads(),
+				mMaxBlockClearSize);
+		}
+
+		int32_t clearSize = 0;
+		uint32_t weakChecksum = 0;
+		uint8_t strongChecksum[MD5Digest::DigestLength];
+		mCurrentBlockEncodedSize = mpEncodePipeline->GetNextBlock(
+			mEncodedBuffer, clearSize, weakChecksum, strongChecksum);
+		ASSERT(clearSize == blockRawSize);
+
+		mBytesUploaded += blockRawSize;
+
+		StoreBlockIndexEntry(mCurrentBlockEncodedSize, blockRawSize,
+			weakChecksum, strongChecksum);
+
+		mPositionInCurrentBlock = 0;
+		return;
+	}
+
 	// Read the data in
 	if(!mpLogging->ReadFullBuffer(mpRawBuffer, blockRawSize,
 		0 /* not interested in size if failure */))
@@ -656,6 +742,12 @@ void BackupStoreFileEncodeStream::StoreBlockIndexEntry(int64_t EncSizeOrBlkIndex
 
 	// Save to data block for sending at the end of the stream
 	mData.Write(&entry, sizeof(entry));
+
+	if(mCollectBlockFingerprints)
+	{
+		mBlockFingerprints.push_back(BackupStoreFile::GetBlockFingerprint(
+			ClearSize, WeakChecksum, pStrongChecksum));
+	}
 }
 
 
@@ -849,5 +941,77 @@ BackupStoreFileEncodeStream::Recipe::~Recipe()
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodeStream::Recipe::ChunkNewData(IOStream &, int64_t)
+//		Purpose: Read the file from the start, and cut the space before
+//			 each instruction into blocks with BackupStoreFileChunker,
+//			 sized for the whole file. Blocks reused from the other
+//			 file are skipped.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileEncodeStream::Recipe::ChunkNewData(IOStream &rFile,
+	int64_t FileSize)
+{
+	int sizeShift = BackupStoreFileChunker::GetSizeShift(FileSize);
+	std::vector<int32_t> sizes;
+	for(uint64_t inst = 0; inst < size(); ++inst)
+	{
+		const RecipeInstruction &instruction((*this)[inst]);
+		BackupStoreFileChunker::CalculateChunkSizes(rFile,
+			instruction.mSpaceBefore, sizeShift, sizes);
+
+		int64_t sizeToSkip = 0;
+		for(int32_t b = 0; b < instruction.mBlocks; ++b)
+		{
+			sizeToSkip += instruction.mpStartBlock[b].mSize;
+		}
+		if(sizeToSkip > 0 && inst < (size() - 1))
+		{
+			rFile.Seek(sizeToSkip, IOStream::SeekType_Relative);
+		}
+	}
+
+	SetChunkSizes(sizes);
+}
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFileEncodeStream::Recipe::SetChunkSizes(
+//			 const std::vector<int32_t> &)
+//		Purpose: Set the sizes of all the new blocks, in file order,
+//			 which must add up to each instruction's space before.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFileEncodeStream::Recipe::SetChunkSizes(
+	const std::vector<int32_t> &rChunkSizes)
+{
+	std::vector<int64_t> firstChunk;
+	size_t chunk = 0;
+	for(uint64_t inst = 0; inst < size(); ++inst)
+	{
+		firstChunk.push_back(chunk);
+		int64_t space = (*this)[inst].mSpaceBefore;
+		while(space > 0 && chunk < rChunkSizes.size())
+		{
+			space -= rChunkSizes[chunk++];
+		}
+		if(space != 0)
+		{
+			// Chunks don't fit the instructions
+			THROW_EXCEPTION(BackupStoreException, Internal)
+		}
+	}
+	if(chunk != rChunkSizes.size())
+	{
+		THROW_EXCEPTION(BackupStoreException, Internal)
+	}
+	firstChunk.push_back(chunk);
 
+	mChunkSizes = rChunkSizes;
+	mFirstChunk.swap(firstChunk);
+}
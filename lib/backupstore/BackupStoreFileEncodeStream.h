@@ -20,6 +20,8 @@
 #include "ReadLoggingStream.h"
 #include "RunStatusProvider.h"
 
+class BackupStoreFileEncodePipeline;
+
 namespace BackupStoreFileCreation
 {
 	// Diffing and creation of files share some implementation details.
@@ -68,11 +70,30 @@ public:
 		{
 			return pBlock - mpBlockIndex;
 		}
+
+		// With content defined chunking, the sizes of the new blocks
+		// in each instruction's space before are worked out from the
+		// data before encoding starts. Otherwise they're calculated
+		// by CalculateBlockSizes().
+		void ChunkNewData(IOStream &rFile, int64_t FileSize);
+		void SetChunkSizes(const std::vector<int32_t> &rChunkSizes);
+		bool IsChunked() const {return !mFirstChunk.empty();}
+		int64_t GetNumChunks(int64_t Instruction) const
+		{
+			return mFirstChunk[Instruction + 1] - mFirstChunk[Instruction];
+		}
+		int32_t GetChunkSize(int64_t Instruction, int64_t Chunk) const
+		{
+			return mChunkSizes[mFirstChunk[Instruction] + Chunk];
+		}
 	
 	private:
 		BackupStoreFileCreation::BlocksAvailableEntry *mpBlockIndex;
 		int64_t mNumBlocksInIndex;
 		int64_t mOtherFileID;
+		std::vector<int32_t> mChunkSizes;
+		// Index of each instruction's first chunk, and one past the last
+		std::vector<int64_t> mFirstChunk;
 	};
 	
 	void Setup(const std::string& Filename, Recipe *pRecipe, int64_t ContainerID,
@@ -89,6 +110,15 @@ public:
 	virtual bool StreamClosed();
 	uint64_t SeekToBlockOffset(pos_type BlockOffset);
 
+	// Fingerprint each block of the file as it will be stored, including
+	// those reused from the file it's diffed against, for
+	// BackupStoreBlockDatabase. Call before reading from the stream.
+	void CollectBlockFingerprints() { mCollectBlockFingerprints = true; }
+	const std::vector<uint64_t> &GetBlockFingerprints() const
+	{
+		return mBlockFingerprints;
+	}
+
 	int64_t GetBytesToUpload() { return mBytesToUpload; }
 	int64_t GetTotalBytesSent() { return mTotalBytesSent; }
 
@@ -138,6 +168,12 @@ private:
 										// buffer for encoded data
 	int32_t mAllocatedBufferSize;		// size of above two allocated blocks
 	uint64_t mEntryIVBase;				// base for block entry IV
+	// Encoding on worker threads, see BackupStoreFile::SetEncodingThreads()
+	int mMaxBlockClearSize;
+	bool mUseEncodePipeline;			// reading the file is left to the pipeline
+	BackupStoreFileEncodePipeline *mpEncodePipeline;	// created on first block
+	bool mCollectBlockFingerprints;
+	std::vector<uint64_t> mBlockFingerprints;
 };
 
 
@@ -0,0 +1,153 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupStoreFileFingerprint.cpp
+//		Purpose: Fingerprints of the blocks of a file, which the store
+//			 can index without learning their checksums
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "BackupStoreConstants.h"
+#include "BackupStoreException.h"
+#include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
+#include "BackupStoreFileCryptVar.h"
+#include "BackupStoreFileEncodeStream.h"
+#include "BackupStoreFileWire.h"
+#include "FileStream.h"
+#include "MD5Digest.h"
+#include "RollingChecksum.h"
+
+#include "MemLeakFindOn.h"
+
+using namespace BackupStoreFileCryptVar;
+
+// Every fingerprint is made with the same IV, so that the same block always
+// gets the same fingerprint, unlike the block index entries.
+#define BLOCK_FINGERPRINT_IV	0x426c6b4650000000ULL
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::GetBlockFingerprint(int32_t,
+//			 uint32_t, const uint8_t *)
+//		Purpose: Returns the fingerprint of a block with the given
+//			 size and checksums. This is the last part of the
+//			 block index entry encrypted with the block entry key,
+//			 so it depends on all of the entry, and the store
+//			 can't work out the checksums from it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+uint64_t BackupStoreFile::GetBlockFingerprint(int32_t ClearSize,
+	uint32_t WeakChecksum, const uint8_t *pStrongChecksum)
+{
+	file_BlockIndexEntryEnc entryEnc;
+	entryEnc.mSize = htonl(ClearSize);
+	entryEnc.mWeakChecksum = htonl(WeakChecksum);
+	::memcpy(entryEnc.mStrongChecksum, pStrongChecksum,
+		sizeof(entryEnc.mStrongChecksum));
+
+	if(sBlowfishEncryptBlockEntry.GetIVLength() != sizeof(uint64_t))
+	{
+		THROW_EXCEPTION(BackupStoreException, IVLengthForEncodedBlockSizeDoesntMeetLengthRequirements)
+	}
+	uint64_t iv = box_hton64(BLOCK_FINGERPRINT_IV);
+	sBlowfishEncryptBlockEntry.SetIV(&iv);
+
+	uint8_t encrypted[sizeof(entryEnc)];
+	int encodedSize = sBlowfishEncryptBlockEntry.TransformBlock(encrypted,
+		sizeof(encrypted), &entryEnc, sizeof(entryEnc));
+	if(encodedSize != sizeof(encrypted))
+	{
+		THROW_EXCEPTION(BackupStoreException, BlockEntryEncodingDidntGiveExpectedLength)
+	}
+
+	uint64_t fingerprint;
+	::memcpy(&fingerprint, encrypted + sizeof(encrypted) - sizeof(fingerprint),
+		sizeof(fingerprint));
+	return box_ntoh64(fingerprint);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreFile::CalculateBlockFingerprints(
+//			 const std::string &, std::vector<uint64_t> &,
+//			 int64_t)
+//		Purpose: Reads a file, and appends the fingerprint of each
+//			 block to rFingerprintsOut, or only of the first
+//			 MaxBlocks if it's not 0. The blocks are cut as
+//			 EncodeFile() would cut them, so that a copy of a
+//			 file has the same fingerprints as the original.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreFile::CalculateBlockFingerprints(const std::string &Filename,
+	std::vector<uint64_t> &rFingerprintsOut, int64_t MaxBlocks)
+{
+	FileStream file(Filename);
+	int64_t fileSize = file.BytesLeftToRead();
+
+	if(ContentDefinedChunking)
+	{
+		BackupStoreFileChunker chunker(file, fileSize,
+			BackupStoreFileChunker::GetSizeShift(fileSize));
+		const uint8_t *pchunk = 0;
+		int32_t size = 0;
+		for(int64_t b = 0; (MaxBlocks == 0 || b < MaxBlocks) &&
+			chunker.NextChunk(pchunk, size); ++b)
+		{
+			RollingChecksum weak(pchunk, size);
+			MD5Digest strong;
+			strong.Add(pchunk, size);
+			strong.Finish();
+			rFingerprintsOut.push_back(GetBlockFingerprint(size,
+				weak.GetChecksum(), strong.DigestAsData()));
+		}
+		return;
+	}
+
+	int64_t numBlocks = 0;
+	int32_t blockSize = 0, lastBlockSize = 0;
+	if(fileSize > 0)
+	{
+		BackupStoreFileEncodeStream::CalculateBlockSizes(fileSize,
+			numBlocks, blockSize, lastBlockSize);
+	}
+	int64_t blocksToRead = numBlocks;
+	if(MaxBlocks != 0 && MaxBlocks < blocksToRead)
+	{
+		blocksToRead = MaxBlocks;
+	}
+
+	std::vector<uint8_t> buffer(lastBlockSize > blockSize ?
+		lastBlockSize : blockSize);
+	for(int64_t b = 0; b < blocksToRead; ++b)
+	{
+		int32_t size = (b == numBlocks - 1) ? lastBlockSize : blockSize;
+		if(!file.ReadFullBuffer(&buffer[0], size,
+			0 /* not interested in size if failure */))
+		{
+			// The file has got shorter since its size was read
+			THROW_EXCEPTION(BackupStoreException,
+				Temp_FileEncodeStreamDidntReadBuffer)
+		}
+
+		RollingChecksum weak(&buffer[0], size);
+		MD5Digest strong;
+		strong.Add(&buffer[0], size);
+		strong.Finish();
+		rFingerprintsOut.push_back(GetBlockFingerprint(size,
+			weak.GetChecksum(), strong.DigestAsData()));
+	}
+}
@@ -43,7 +43,10 @@ BackupStoreRefCountDatabase::BackupStoreRefCountDatabase(const
   mReadOnly(ReadOnly),
   mIsModified(false),
   mIsTemporaryFile(Temporary),
-  mapDatabaseFile(apDatabaseFile)
+  mapDatabaseFile(apDatabaseFile),
+  mIsInMemory(false),
+  mDirtyFirstID(0),
+  mDirtyLastID(0)
 {
 	ASSERT(!(ReadOnly && Temporary)); // being both doesn't make sense
 }
@@ -62,8 +65,11 @@ void BackupStoreRefCountDatabase::Commit()
 			"Reference count database is already closed");
 	}
 
+	Flush();
 	mapDatabaseFile->Close();
 	mapDatabaseFile.reset();
+	mRefCounts.clear();
+	mIsInMemory = false;
 
 	std::string Final_Filename = GetFilename(mAccount, false);
 
@@ -106,6 +112,11 @@ void BackupStoreRefCountDatabase::Discard()
 		mapDatabaseFile.reset();
 	}
 
+	// Any changes not yet written are thrown away with the file
+	mRefCounts.clear();
+	mIsInMemory = false;
+	mDirtyFirstID = mDirtyLastID = 0;
+
 	if(EMU_UNLINK(mFilename.c_str()) != 0)
 	{
 		THROW_EMU_FILE_ERROR("Failed to delete temporary refcount "
@@ -142,6 +153,20 @@ BackupStoreRefCountDatabase::~BackupStoreRefCountDatabase()
 				"in destructor: " << e.what());
 		}
 	}
+	else if (mIsInMemory && mDirtyLastID != 0 && mapDatabaseFile.get())
+	{
+		// A permanent database is updated in place, so write back
+		// anything that the caller didn't Flush().
+		try
+		{
+			Flush();
+		}
+		catch(BoxException &e)
+		{
+			BOX_LOG_SYS_ERROR("Failed to flush BackupStoreRefCountDatabase "
+				"in destructor: " << e.what());
+		}
+	}
 }
 
 std::string BackupStoreRefCountDatabase::GetFilename(const
@@ -265,6 +290,81 @@ std::auto_ptr<BackupStoreRefCountDatabase> BackupStoreRefCountDatabase::Load(
 	return refcount;
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreRefCountDatabase::LoadIntoMemory()
+//		Purpose: Reads all the reference counts into memory with a
+//			 single read. After this, GetRefCount() and the
+//			 modification functions only use the copy in memory,
+//			 and changes are written back by Flush(), Commit() or
+//			 the destructor, as a single write of the range of
+//			 entries which changed. The file format is unchanged.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreRefCountDatabase::LoadIntoMemory()
+{
+	if (!mapDatabaseFile.get())
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"Reference count database is already closed");
+	}
+
+	if (mIsInMemory)
+	{
+		return;
+	}
+
+	int64_t numEntries = GetLastObjectIDUsed();
+	std::vector<refcount_t> refcounts(numEntries);
+
+	if (numEntries > 0)
+	{
+		mapDatabaseFile->Seek(GetOffset(1), SEEK_SET);
+		if (!mapDatabaseFile->ReadFullBuffer(&refcounts[0],
+			numEntries * sizeof(refcount_t), 0))
+		{
+			THROW_FILE_ERROR("Failed to read refcount database: "
+				"short read loading into memory", mFilename,
+				BackupStoreException, CouldNotLoadStoreInfo);
+		}
+	}
+
+	mRefCounts.swap(refcounts);
+	mDirtyFirstID = mDirtyLastID = 0;
+	mIsInMemory = true;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreRefCountDatabase::Flush()
+//		Purpose: In memory mode, writes back the range of entries
+//			 changed since the last flush, in one go. Does
+//			 nothing otherwise, as changes are written at once.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreRefCountDatabase::Flush()
+{
+	if (!mIsInMemory || mDirtyLastID == 0)
+	{
+		return;
+	}
+
+	if (mReadOnly)
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"Cannot flush a read-only reference count database");
+	}
+
+	mapDatabaseFile->Seek(GetOffset(mDirtyFirstID), SEEK_SET);
+	mapDatabaseFile->Write(&mRefCounts[mDirtyFirstID - 1],
+		(mDirtyLastID - mDirtyFirstID + 1) * sizeof(refcount_t));
+	mDirtyFirstID = mDirtyLastID = 0;
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -278,6 +378,19 @@ std::auto_ptr<BackupStoreRefCountDatabase> BackupStoreRefCountDatabase::Load(
 BackupStoreRefCountDatabase::refcount_t
 BackupStoreRefCountDatabase::GetRefCount(int64_t ObjectID) const
 {
+	if (mIsInMemory)
+	{
+		if (ObjectID < 1 || ObjectID > (int64_t)mRefCounts.size())
+		{
+			THROW_FILE_ERROR("Failed to read refcount database: "
+				"attempted read of unknown refcount for object " <<
+				BOX_FORMAT_OBJECTID(ObjectID), mFilename,
+				BackupStoreException, UnknownObjectRefCountRequested);
+		}
+
+		return ntohl(mRefCounts[ObjectID - 1]);
+	}
+
 	IOStream::pos_type offset = GetOffset(ObjectID);
 
 	if (GetSize() < offset + GetEntrySize())
@@ -304,6 +417,11 @@ BackupStoreRefCountDatabase::GetRefCount(int64_t ObjectID) const
 
 int64_t BackupStoreRefCountDatabase::GetLastObjectIDUsed() const
 {
+	if (mIsInMemory)
+	{
+		return mRefCounts.size();
+	}
+
 	return (GetSize() - sizeof(refcount_StreamFormat)) /
 		sizeof(refcount_t);
 }
@@ -331,6 +449,36 @@ void BackupStoreRefCountDatabase::AddReference(int64_t ObjectID)
 void BackupStoreRefCountDatabase::SetRefCount(int64_t ObjectID,
 	refcount_t NewRefCount)
 {
+	if (mIsInMemory)
+	{
+		ASSERT(ObjectID >= 1);
+		if (mReadOnly)
+		{
+			THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+				"Cannot modify a read-only reference count database");
+		}
+
+		if (ObjectID > (int64_t)mRefCounts.size())
+		{
+			// Objects skipped over have no references, just like
+			// the hole left by writing past the end of the file
+			mRefCounts.resize(ObjectID, 0);
+		}
+		mRefCounts[ObjectID - 1] = htonl(NewRefCount);
+
+		if (mDirtyLastID == 0)
+		{
+			mDirtyFirstID = mDirtyLastID = ObjectID;
+		}
+		else
+		{
+			mDirtyFirstID = std::min(mDirtyFirstID, ObjectID);
+			mDirtyLastID = std::max(mDirtyLastID, ObjectID);
+		}
+		mIsModified = true;
+		return;
+	}
+
 	IOStream::pos_type offset = GetOffset(ObjectID);
 	mapDatabaseFile->Seek(offset, SEEK_SET);
 	refcount_t RefCountNetOrder = htonl(NewRefCount);
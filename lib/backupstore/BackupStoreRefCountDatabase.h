@@ -77,6 +77,12 @@ public:
 	static std::auto_ptr<BackupStoreRefCountDatabase> Load(const
 		BackupStoreAccountDatabase::Entry& rAccount, bool ReadOnly);
 
+	// Read the whole database into memory, so that lookups and changes
+	// don't touch the file until Flush() or Commit().
+	void LoadIntoMemory();
+	bool IsInMemory() const { return mIsInMemory; }
+	void Flush();
+
 	typedef uint32_t refcount_t;
 
 	// Data access functions
@@ -118,6 +124,13 @@ private:
 	bool mIsTemporaryFile;
 	std::auto_ptr<FileStream> mapDatabaseFile;
 
+	// In memory mode: the counts of all objects, in network byte order
+	// as in the file, and the range of object IDs not yet written back.
+	bool mIsInMemory;
+	std::vector<refcount_t> mRefCounts;
+	int64_t mDirtyFirstID;
+	int64_t mDirtyLastID;
+
 	bool NeedsCommitOrDiscard()
 	{
 		return mapDatabaseFile.get() && mIsModified && mIsTemporaryFile;
@@ -18,7 +18,10 @@
 #include "BackupStoreContext.h"
 #include "BackupsList.h"
 #include "BackupStoreAccountDatabase.h"
+#include "BackupStoreBlockDatabase.h"
+#include "BackupStoreChangeJournal.h"
 #include "BackupStoreConstants.h"
+#include "BackupStoreDeferredPatch.h"
 #include "BackupStoreDirectory.h"
 #include "BackupStoreFile.h"
 #include "BackupStoreInfo.h"
@@ -64,8 +67,10 @@ HousekeepStoreAccount::HousekeepStoreAccount(int AccountID,
 	  mBlocksInOldFilesDelta(0),
 	  mBlocksInDeletedFilesDelta(0),
 	  mBlocksInDirectoriesDelta(0),
+	  mDeferredPatchAdjustment(),
 	  mFilesDeleted(0),
 	  mEmptyDirectoriesDeleted(0),
+	  mScanChangedOnly(false),
 	  mCountUntilNextInterprocessMsgCheck(POLL_INTERPROCESS_MSG_CHECK_FREQUENCY)
 {
 	std::ostringstream tag;
@@ -85,7 +90,8 @@ HousekeepStoreAccount::HousekeepStoreAccount(int AccountID,
 // --------------------------------------------------------------------------
 HousekeepStoreAccount::~HousekeepStoreAccount()
 {
-	if(mapNewRefs.get())
+	// The existing database, when used, writes back its own changes
+	if(mapNewRefs.get() && !mScanChangedOnly)
 	{
 		// Discard() can throw exception, but destructors aren't supposed to do that, so
 		// just catch and log them.
@@ -189,16 +195,73 @@ bool HousekeepStoreAccount::DoHousekeeping(int32_t flags, bool KeepTryingForever
 	}
 
 	BackupStoreAccountDatabase::Entry account(mAccountID, mStoreDiscSet);
-	mapNewRefs = BackupStoreRefCountDatabase::Create(account);
+
+	// If nothing needs the whole tree, and the journal says which
+	// directories have changed since the last run, only those need to be
+	// scanned, and the reference counts which the store keeps up to date
+	// can be used as they are. Every so often the whole tree is scanned
+	// anyway, in case the journal missed something.
+	std::set<int64_t> changedDirectories;
+	int32_t runsSinceFullScan = 0;
+	if(flags == HousekeepStoreAccount::DefaultAction &&
+		mDeletionSizeTarget == 0 &&
+		BackupStoreChangeJournal::Read(account, changedDirectories,
+			runsSinceFullScan))
+	{
+		if(runsSinceFullScan >= HOUSEKEEPING_RUNS_BETWEEN_FULL_SCANS)
+		{
+			BOX_INFO("Scanning all directories, as the last " <<
+				runsSinceFullScan << " runs only scanned those "
+				"which had changed");
+		}
+		else try
+		{
+			mapNewRefs = BackupStoreRefCountDatabase::Load(account,
+				false);
+			mapNewRefs->LoadIntoMemory();
+			if(CheckChangedDirectories(changedDirectories, *info))
+			{
+				mScanChangedOnly = true;
+			}
+			else
+			{
+				mapNewRefs.reset();
+			}
+		}
+		catch(BoxException &e)
+		{
+			BOX_WARNING("Reference count database was missing or "
+				"corrupted, rebuilding it: " << e.what());
+			mapNewRefs.reset();
+		}
+	}
+
+	if(!mScanChangedOnly)
+	{
+		mapNewRefs = BackupStoreRefCountDatabase::Create(account);
+		// Every object's count is touched, so keep them all in memory
+		// (4 bytes each) and write them out once, on Commit().
+		mapNewRefs->LoadIntoMemory();
+	}
 
 	// Scan the directory for potential things to delete
 	// This will also remove eligible items marked with RemoveASAP
 	info->GetVersionCountLimit();
 
-	
-
-	bool continueHousekeeping = ScanDirectory(flags, BACKUPSTORE_ROOT_DIRECTORY_ID,
-		*info);
+	bool continueHousekeeping;
+	if(mScanChangedOnly)
+	{
+		BOX_INFO("Scanning " << changedDirectories.size() <<
+			" directories changed since the last housekeeping");
+		continueHousekeeping = ScanChangedDirectories(
+			changedDirectories, *info);
+	}
+	else
+	{
+		BOX_INFO("Scanning all directories");
+		continueHousekeeping = ScanDirectory(flags,
+			BACKUPSTORE_ROOT_DIRECTORY_ID, *info);
+	}
 
 	if(!continueHousekeeping)
 	{
@@ -248,7 +311,19 @@ bool HousekeepStoreAccount::DoHousekeeping(int32_t flags, bool KeepTryingForever
 
 	if(!continueHousekeeping)
 	{
-		mapNewRefs->Discard();
+		if(mScanChangedOnly)
+		{
+			// Keep the changes made by any deletions, but leave
+			// the journal as it is to scan the same directories
+			// again next time.
+			mapNewRefs->Flush();
+			mapNewRefs.reset();
+		}
+		else
+		{
+			mapNewRefs->Discard();
+		}
+		ApplyDeferredPatchAdjustment(*info);
 		info->Save();
 		return false;
 	}
@@ -256,6 +331,7 @@ bool HousekeepStoreAccount::DoHousekeeping(int32_t flags, bool KeepTryingForever
 	// Report any UNexpected changes, and consider them to be errors.
 	// Do this before applying the expected changes below.
 	mErrorCount += info->ReportChangesTo(*pOldInfo);
+	ApplyDeferredPatchAdjustment(*info);
 	info->Save();
 
 	// Try to load the old reference count database and check whether
@@ -263,18 +339,24 @@ bool HousekeepStoreAccount::DoHousekeeping(int32_t flags, bool KeepTryingForever
 	// apOldRefs before we delete any files, because that will also change
 	// the reference count in a way that's not an error.
 
-	try
+	// When only the changed directories were scanned, there are no new
+	// counts to compare.
+	if(!mScanChangedOnly)
 	{
-		std::auto_ptr<BackupStoreRefCountDatabase> apOldRefs =
-			BackupStoreRefCountDatabase::Load(account, false);
-		mErrorCount += mapNewRefs->ReportChangesTo(*apOldRefs);
-	}
-	catch(BoxException &e)
-	{
-		BOX_WARNING("Reference count database was missing or "
-			"corrupted during housekeeping, cannot check it for "
-			"errors.");
-		mErrorCount++;
+		try
+		{
+			std::auto_ptr<BackupStoreRefCountDatabase> apOldRefs =
+				BackupStoreRefCountDatabase::Load(account, false);
+			apOldRefs->LoadIntoMemory();
+			mErrorCount += mapNewRefs->ReportChangesTo(*apOldRefs);
+		}
+		catch(BoxException &e)
+		{
+			BOX_WARNING("Reference count database was missing or "
+				"corrupted during housekeeping, cannot check it "
+				"for errors.");
+			mErrorCount++;
+		}
 	}
 
 	// Go and delete items from the accounts
@@ -328,10 +410,37 @@ bool HousekeepStoreAccount::DoHousekeeping(int32_t flags, bool KeepTryingForever
 	// Save the store info back
 	info->Save();
 
+	// Forget the blocks of files which have just been deleted
+	BackupStoreBlockDatabase::Prune(account, *mapNewRefs,
+		mFilesDeleted > 0);
+
 	// force file to be saved and closed before releasing the lock below
-	mapNewRefs->Commit();
+	if(mScanChangedOnly)
+	{
+		mapNewRefs->Flush();
+	}
+	else
+	{
+		mapNewRefs->Commit();
+	}
 	mapNewRefs.reset();
 
+	// Every change so far has now been dealt with, except for deferred
+	// patches which couldn't be reversed, unless deleting empty
+	// directories was interrupted. Then the directories which led to them
+	// must be scanned again: the same ones if only those in the journal
+	// were scanned, otherwise all of them.
+	if(!deleteInterrupted)
+	{
+		BackupStoreChangeJournal::Reset(account,
+			mScanChangedOnly ? (runsSinceFullScan + 1) : 0,
+			mDirectoriesToRescan);
+	}
+	else if(!mScanChangedOnly)
+	{
+		BackupStoreChangeJournal::Remove(account);
+	}
+
 	// Explicity release the lock (would happen automatically on
 	// going out of scope, included for code clarity)
 	if ( lock )
@@ -414,6 +523,13 @@ bool HousekeepStoreAccount::ScanDirectory(int32_t flags, int64_t ObjectID,
 	dir.SetUserInfo1_SizeInBlocks(originalDirSizeInBlocks);
 	dirStream->Close();
 
+	// Finish storing the files which clients didn't wait for, before
+	// they are counted or deleted
+	if(!ResolveDeferredPatches(dir, objectFilename))
+	{
+		return false;
+	}
+
 	// Is it empty?
 	if(dir.GetNumberOfEntries() == 0)
 	{
@@ -423,8 +539,9 @@ bool HousekeepStoreAccount::ScanDirectory(int32_t flags, int64_t ObjectID,
 	}
 
 	// Calculate reference counts first, before we start requesting
-	// files to be deleted.
-	// BLOCK
+	// files to be deleted. The existing counts already include this
+	// directory's references if it's only being scanned for changes.
+	if(!mScanChangedOnly)
 	{
 		BackupStoreDirectory::Iterator i(dir);
 		BackupStoreDirectory::Entry *en = 0;
@@ -516,7 +633,7 @@ bool HousekeepStoreAccount::ScanDirectory(int32_t flags, int64_t ObjectID,
 
 				} 
 				
-				if (en->IsFile() && (
+				if (en->IsFile() && !BackupStoreDeferredPatch::IsPending(dir, *en) && (
 					( (enFlags & BackupStoreDirectory::Entry::Flags_RemoveASAP) != 0
 						&& (en->IsDeleted() || en->IsOld())
 					)
@@ -676,8 +793,22 @@ bool HousekeepStoreAccount::ScanDirectory(int32_t flags, int64_t ObjectID,
 		}
 	}
 
-	// Recurse into subdirectories
+	if(mScanChangedOnly)
+	{
+		// A subdirectory may have been emptied in an earlier run, and
+		// only deleted now, without being changed itself. It will be
+		// left alone by DeleteEmptyDirectories() if it isn't empty.
+		BackupStoreDirectory::Iterator i(dir);
+		BackupStoreDirectory::Entry *en = 0;
+		while((en = i.Next(BackupStoreDirectory::Entry::Flags_Dir |
+			BackupStoreDirectory::Entry::Flags_Deleted)) != 0)
+		{
+			mEmptyDirectories.push_back(en->GetObjectID());
+		}
+	}
+	else
 	{
+		// Recurse into subdirectories
 		BackupStoreDirectory::Iterator i(dir);
 		BackupStoreDirectory::Entry *en = 0;
 		while((en = i.Next(BackupStoreDirectory::Entry::Flags_Dir)) != 0)
@@ -705,6 +836,260 @@ bool HousekeepStoreAccount::ScanDirectory(int32_t flags, int64_t ObjectID,
 
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HousekeepStoreAccount::CheckChangedDirectories(
+//			 const std::set<int64_t> &, const BackupStoreInfo &)
+//		Purpose: Private. Check that the directories in the change
+//			 journal agree with the reference counts, which only
+//			 scanning those directories relies on. Returns false,
+//			 so that every directory is scanned and the counts
+//			 rebuilt, if one lists an object which isn't counted,
+//			 or the journal lists an object which isn't a
+//			 directory or was never allocated.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool HousekeepStoreAccount::CheckChangedDirectories(
+	const std::set<int64_t> &rDirectories,
+	const BackupStoreInfo& rBackupStoreInfo)
+{
+	for(std::set<int64_t>::const_iterator i(rDirectories.begin());
+		i != rDirectories.end(); i++)
+	{
+		if(*i > rBackupStoreInfo.GetLastObjectIDUsed())
+		{
+			BOX_WARNING("Change journal lists directory " <<
+				BOX_FORMAT_OBJECTID(*i) << " which doesn't exist "
+				"yet, scanning all directories");
+			return false;
+		}
+
+		std::string objectFilename;
+		MakeObjectFilename(*i, objectFilename);
+		if(!RaidFileRead::FileExists(mStoreDiscSet, objectFilename))
+		{
+			// Deleted since, which ScanChangedDirectories allows
+			continue;
+		}
+
+		BackupStoreDirectory dir;
+		try
+		{
+			std::auto_ptr<RaidFileRead> dirStream(
+				RaidFileRead::Open(mStoreDiscSet,
+					objectFilename));
+			BufferedStream buf(*dirStream);
+			dir.ReadFromStream(buf, IOStream::TimeOutInfinite);
+		}
+		catch(BoxException &e)
+		{
+			BOX_WARNING("Change journal lists " <<
+				BOX_FORMAT_OBJECTID(*i) << " which can't be read "
+				"as a directory, scanning all directories: " <<
+				e.what());
+			return false;
+		}
+
+		BackupStoreDirectory::Iterator j(dir);
+		BackupStoreDirectory::Entry *en = 0;
+		while((en = j.Next()) != 0)
+		{
+			int64_t id = en->GetObjectID();
+			if(id > mapNewRefs->GetLastObjectIDUsed() ||
+				mapNewRefs->GetRefCount(id) == 0)
+			{
+				BOX_WARNING("Directory " <<
+					BOX_FORMAT_OBJECTID(*i) << " contains " <<
+					BOX_FORMAT_OBJECTID(id) << " which has no "
+					"references counted, scanning all "
+					"directories");
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HousekeepStoreAccount::ScanChangedDirectories(
+//			 const std::set<int64_t> &, BackupStoreInfo &)
+//		Purpose: Private. Scan only the given directories, without
+//			 recursing, as ScanDirectory() does for the whole
+//			 tree. Returns true if housekeeping should continue.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool HousekeepStoreAccount::ScanChangedDirectories(
+	const std::set<int64_t> &rDirectories,
+	BackupStoreInfo& rBackupStoreInfo)
+{
+	ASSERT(mScanChangedOnly);
+
+	for(std::set<int64_t>::const_iterator i(rDirectories.begin());
+		i != rDirectories.end(); i++)
+	{
+		// Directories can be deleted after they were changed
+		std::string objectFilename;
+		MakeObjectFilename(*i, objectFilename);
+		if(!RaidFileRead::FileExists(mStoreDiscSet, objectFilename))
+		{
+			BOX_TRACE("Changed directory " << BOX_FORMAT_OBJECTID(*i) <<
+				" no longer exists");
+			continue;
+		}
+
+		if(!ScanDirectory(HousekeepStoreAccount::DefaultAction, *i,
+			rBackupStoreInfo))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HousekeepStoreAccount::ResolveDeferredPatches(
+//			 BackupStoreDirectory &, const std::string &)
+//		Purpose: Private. Reverse the patches of any files in the
+//			 directory which were stored as patches from their
+//			 older versions, and save it if any were. Returns false
+//			 if housekeeping should stop.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool HousekeepStoreAccount::ResolveDeferredPatches(
+	BackupStoreDirectory &rDirectory, const std::string &rDirectoryFilename)
+{
+	std::vector<int64_t> pending;
+	{
+		BackupStoreDirectory::Iterator i(rDirectory);
+		BackupStoreDirectory::Entry *en = 0;
+		while((en = i.Next(BackupStoreDirectory::Entry::Flags_File |
+			BackupStoreDirectory::Entry::Flags_PatchFromOlder)) != 0)
+		{
+			pending.push_back(en->GetObjectID());
+		}
+	}
+
+	if(pending.empty())
+	{
+		return true;
+	}
+
+	BackupStoreDeferredPatch resolver(mStoreDiscSet, mStoreRoot);
+	BackupStoreInfo::Adjustment adjustment = {};
+	bool stop = false;
+	bool failed = false;
+	size_t resolved = 0;
+	for(; resolved < pending.size(); resolved++)
+	{
+#ifndef WIN32
+		// Each one can take a while, if the file is large
+		if(resolved > 0 && mpHousekeepingCallback &&
+			mpHousekeepingCallback->CheckForInterProcessMsg(mAccountID))
+		{
+			stop = true;
+			break;
+		}
+#endif
+
+		try
+		{
+			resolver.Resolve(rDirectory, pending[resolved],
+				adjustment);
+		}
+		catch(BoxException &e)
+		{
+			BOX_ERROR("Housekeeping on account " <<
+				BOX_FORMAT_ACCOUNT(mAccountID) << " failed to "
+				"reverse deferred patch " <<
+				BOX_FORMAT_OBJECTID(pending[resolved]) << ": " <<
+				e.what());
+			mErrorCount++;
+			failed = true;
+			break;
+		}
+	}
+
+	if(failed)
+	{
+		// The rest of the directory can still be housekept, but the
+		// journal must keep it so that the patches are tried again
+		mDirectoriesToRescan.insert(rDirectory.GetObjectID());
+	}
+
+	if(resolved == 0)
+	{
+		return !stop;
+	}
+
+	// Save the directory before the older versions become patches
+	{
+		RaidFileWrite writeDir(mStoreDiscSet, rDirectoryFilename);
+		writeDir.Open(true /* allow overwriting */);
+		rDirectory.WriteToStream(writeDir);
+		int64_t new_size = writeDir.GetDiscUsageInBlocks();
+		writeDir.Commit(BACKUP_STORE_CONVERT_TO_RAID_IMMEDIATELY);
+
+		int64_t adjust = new_size - rDirectory.GetUserInfo1_SizeInBlocks();
+		mBlocksUsedDelta += adjust;
+		mBlocksInDirectoriesDelta += adjust;
+		UpdateDirectorySize(rDirectory, new_size);
+	}
+
+	resolver.Commit();
+
+	BOX_INFO("Housekeeping reversed " << resolved << " deferred patches "
+		"in dir " << BOX_FORMAT_OBJECTID(rDirectory.GetObjectID()));
+
+	mDeferredPatchAdjustment.mBlocksUsed += adjustment.mBlocksUsed;
+	mDeferredPatchAdjustment.mBlocksInCurrentFiles +=
+		adjustment.mBlocksInCurrentFiles;
+	mDeferredPatchAdjustment.mBlocksInOldFiles +=
+		adjustment.mBlocksInOldFiles;
+	mDeferredPatchAdjustment.mBlocksInDeletedFiles +=
+		adjustment.mBlocksInDeletedFiles;
+
+	return !stop;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HousekeepStoreAccount::ApplyDeferredPatchAdjustment(
+//			 BackupStoreInfo &)
+//		Purpose: Private. Apply the changes in size from reversing
+//			 deferred patches to the store info, once.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void HousekeepStoreAccount::ApplyDeferredPatchAdjustment(
+	BackupStoreInfo& rBackupStoreInfo)
+{
+	rBackupStoreInfo.ChangeBlocksUsed(mDeferredPatchAdjustment.mBlocksUsed);
+	rBackupStoreInfo.ChangeBlocksInCurrentFiles(
+		mDeferredPatchAdjustment.mBlocksInCurrentFiles);
+	rBackupStoreInfo.ChangeBlocksInOldFiles(
+		mDeferredPatchAdjustment.mBlocksInOldFiles);
+	rBackupStoreInfo.ChangeBlocksInDeletedFiles(
+		mDeferredPatchAdjustment.mBlocksInDeletedFiles);
+
+	BackupStoreInfo::Adjustment none = {};
+	mDeferredPatchAdjustment = none;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -873,6 +1258,15 @@ BackupStoreRefCountDatabase::refcount_t HousekeepStoreAccount::DeleteFile(
 			return refs;
 		}
 
+		// Both versions are needed until a deferred patch between
+		// them has been reversed, which failed or was interrupted
+		if(BackupStoreDeferredPatch::IsPending(rDirectory, *pentry))
+		{
+			BOX_INFO("Not removing " << BOX_FORMAT_OBJECTID(ObjectID) <<
+				" until its deferred patch has been reversed");
+			return refs;
+		}
+
 		// Record the flags it's got set
 		wasDeleted = pentry->IsDeleted();
 		wasOldVersion = pentry->IsOld();
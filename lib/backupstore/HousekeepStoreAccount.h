@@ -21,6 +21,11 @@
 
 class BackupStoreDirectory;
 
+// Housekeeping scans every directory at least this often (in runs), even when
+// the change journal says which have changed, in case it missed a change. With
+// TimeBetweenHousekeeping set to 900 seconds, that's once a day.
+#define HOUSEKEEPING_RUNS_BETWEEN_FULL_SCANS	96
+
 class HousekeepingCallback
 {
 	public:
@@ -63,6 +68,13 @@ private:
 	void MakeObjectFilename(int64_t ObjectID, std::string &rFilenameOut);
 
 	bool ScanDirectory(int32_t flags, int64_t ObjectID, BackupStoreInfo& rBackupStoreInfo);
+	bool CheckChangedDirectories(const std::set<int64_t> &rDirectories,
+		const BackupStoreInfo& rBackupStoreInfo);
+	bool ScanChangedDirectories(const std::set<int64_t> &rDirectories,
+		BackupStoreInfo& rBackupStoreInfo);
+	bool ResolveDeferredPatches(BackupStoreDirectory &rDirectory,
+		const std::string &rDirectoryFilename);
+	void ApplyDeferredPatchAdjustment(BackupStoreInfo& rBackupStoreInfo);
 	bool DeleteFiles(BackupStoreInfo& rBackupStoreInfo);
 	bool DeleteEmptyDirectories(BackupStoreInfo& rBackupStoreInfo, bool ForceDelete = false);
 	void DeleteEmptyDirectory(int64_t dirId, std::vector<int64_t>& rToExamine,
@@ -119,6 +131,13 @@ private:
 	int64_t mBlocksInOldFilesDelta;
 	int64_t mBlocksInDeletedFilesDelta;
 	int64_t mBlocksInDirectoriesDelta;
+
+	// Changes in the sizes of files whose deferred patches were
+	// reversed, which aren't errors
+	BackupStoreInfo::Adjustment mDeferredPatchAdjustment;
+	// Directories with deferred patches which couldn't be reversed, to
+	// be scanned again next time
+	std::set<int64_t> mDirectoriesToRescan;
 	
 	// Deletion count
 	int64_t mFilesDeleted;
@@ -129,8 +148,10 @@ private:
 
 	BackupsList mBackupsList;
 
-	// New reference count list
+	// New reference count list, or the existing one when only scanning
+	// the directories in the change journal
 	std::auto_ptr<BackupStoreRefCountDatabase> mapNewRefs;
+	bool mScanChangedOnly;
 	
 	// Poll frequency
 	int mCountUntilNextInterprocessMsgCheck;
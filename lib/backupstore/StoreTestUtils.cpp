@@ -37,7 +37,8 @@ bool create_account(int soft, int hard)
 	BackupStoreAccountsControl control(*config);
 	
 	Logger::LevelGuard guard(Logging::GetConsole(), Log::WARNING);
-    int result = control.CreateAccount(0x01234567, 0, soft, hard, 0, 0);
+	int result = control.CreateAccount(0x01234567, 0 /* Options */,
+		0 /* DiscNumber */, soft, hard, 0 /* VersionsLimit */);
 	TEST_EQUAL(0, result);
 	return (result == 0);
 }
@@ -0,0 +1,4985 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+
+#include <sstream>
+
+#include "autogen_BackupProtocol.h"
+#include "CollectInBufferStream.h"
+#include "MemBlockStream.h"
+#include "SelfFlushingStream.h"
+#include "SocketStream.h"
+#include "BackupStoreContext.h"
+#include "MemLeakFindOn.h"
+std::auto_ptr<BackupProtocolMessage> BackupProtocolMessage::DoCommand(BackupProtocolReplyable &rProtocol,
+	BackupStoreContext &rContext) const
+{
+	THROW_EXCEPTION(ConnectionException, Protocol_TriedToExecuteReplyCommand)
+}
+
+std::auto_ptr<BackupProtocolMessage> BackupProtocolMessage::DoCommand(BackupProtocolReplyable &rProtocol,
+	BackupStoreContext &rContext, IOStream& rDataStream) const
+{
+	THROW_EXCEPTION(ConnectionException, Protocol_TriedToExecuteReplyCommand)
+}
+BackupProtocolError::BackupProtocolError()
+	: mType(0),
+	  mSubType(0)
+{
+}
+BackupProtocolError::BackupProtocolError(const BackupProtocolError &rToCopy)
+	: mType(rToCopy.mType),
+	  mSubType(rToCopy.mSubType)
+{
+}
+BackupProtocolError::~BackupProtocolError()
+{
+}
+int BackupProtocolError::GetType() const
+{
+	return 0;
+}
+void BackupProtocolError::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mType);
+	rProtocol.Read(mSubType);
+}
+BackupProtocolError::BackupProtocolError(int32_t Type, int32_t SubType)
+	: mType(Type),
+	  mSubType(SubType)
+{
+}
+void BackupProtocolError::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mType);
+	rProtocol.Write(mSubType);
+}
+bool BackupProtocolError::IsError(int &rTypeOut, int &rSubTypeOut) const
+{
+	rTypeOut = mType;
+	rSubTypeOut = mSubType;
+	return true;
+}
+std::string BackupProtocolError::GetMessage(int subtype)
+{
+	switch(subtype)
+	{
+		case Err_WrongVersion: return "WrongVersion = 1";
+		case Err_NotInRightProtocolPhase: return "NotInRightProtocolPhase = 2";
+		case Err_BadLogin: return "BadLogin = 3";
+		case Err_CannotLockStoreForWriting: return "CannotLockStoreForWriting = 4";
+		case Err_SessionReadOnly: return "SessionReadOnly = 5";
+		case Err_FileDoesNotVerify: return "FileDoesNotVerify = 6";
+		case Err_DoesNotExist: return "DoesNotExist = 7";
+		case Err_DirectoryAlreadyExists: return "DirectoryAlreadyExists = 8";
+		case Err_CannotDeleteRoot: return "CannotDeleteRoot = 9";
+		case Err_TargetNameExists: return "TargetNameExists = 10";
+		case Err_StorageLimitExceeded: return "StorageLimitExceeded = 11";
+		case Err_DiffFromFileDoesNotExist: return "DiffFromFileDoesNotExist = 12";
+		case Err_DoesNotExistInDirectory: return "DoesNotExistInDirectory = 13";
+		case Err_PatchConsistencyError: return "PatchConsistencyError = 14";
+		case Err_MultiplyReferencedObject: return "MultiplyReferencedObject = 15";
+		case Err_DisabledAccount: return "DisabledAccount = 16";
+		case Err_CannotResumeUpload: return "CannotResumeUpload = 17";
+		default:
+			std::ostringstream out;
+			out << "Unknown subtype " << subtype;
+			return out.str();
+	}
+}
+std::string BackupProtocolError::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Error(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolError::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Error(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolError::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolVersion::BackupProtocolVersion()
+	: mVersion(0)
+{
+}
+BackupProtocolVersion::BackupProtocolVersion(const BackupProtocolVersion &rToCopy)
+	: mVersion(rToCopy.mVersion)
+{
+}
+BackupProtocolVersion::~BackupProtocolVersion()
+{
+}
+int BackupProtocolVersion::GetType() const
+{
+	return 1;
+}
+void BackupProtocolVersion::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mVersion);
+}
+BackupProtocolVersion::BackupProtocolVersion(int32_t Version)
+	: mVersion(Version)
+{
+}
+void BackupProtocolVersion::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mVersion);
+}
+std::string BackupProtocolVersion::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Version(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolVersion::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Version(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolVersion::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolLogin::BackupProtocolLogin()
+	: mClientID(0),
+	  mFlags(0),
+	  mVersion(0)
+{
+}
+BackupProtocolLogin::BackupProtocolLogin(const BackupProtocolLogin &rToCopy)
+	: mClientID(rToCopy.mClientID),
+	  mFlags(rToCopy.mFlags),
+	  mVersion(rToCopy.mVersion)
+{
+}
+BackupProtocolLogin::~BackupProtocolLogin()
+{
+}
+int BackupProtocolLogin::GetType() const
+{
+	return 2;
+}
+void BackupProtocolLogin::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mClientID);
+	rProtocol.Read(mFlags);
+	rProtocol.ReadWithDefault(mVersion, 1);
+}
+BackupProtocolLogin::BackupProtocolLogin(int32_t ClientID, int32_t Flags, int32_t Version)
+	: mClientID(ClientID),
+	  mFlags(Flags),
+	  mVersion(Version)
+{
+}
+void BackupProtocolLogin::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mClientID);
+	rProtocol.Write(mFlags);
+	rProtocol.Write(mVersion);
+}
+std::string BackupProtocolLogin::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Login(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolLogin::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Login(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolLogin::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolLoginConfirmed::BackupProtocolLoginConfirmed()
+	: mClientStoreMarker(0),
+	  mBlocksUsed(0),
+	  mBlocksSoftLimit(0),
+	  mBlocksHardLimit(0)
+{
+}
+BackupProtocolLoginConfirmed::BackupProtocolLoginConfirmed(const BackupProtocolLoginConfirmed &rToCopy)
+	: mClientStoreMarker(rToCopy.mClientStoreMarker),
+	  mBlocksUsed(rToCopy.mBlocksUsed),
+	  mBlocksSoftLimit(rToCopy.mBlocksSoftLimit),
+	  mBlocksHardLimit(rToCopy.mBlocksHardLimit)
+{
+}
+BackupProtocolLoginConfirmed::~BackupProtocolLoginConfirmed()
+{
+}
+int BackupProtocolLoginConfirmed::GetType() const
+{
+	return 3;
+}
+void BackupProtocolLoginConfirmed::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mClientStoreMarker);
+	rProtocol.Read(mBlocksUsed);
+	rProtocol.Read(mBlocksSoftLimit);
+	rProtocol.Read(mBlocksHardLimit);
+}
+BackupProtocolLoginConfirmed::BackupProtocolLoginConfirmed(int64_t ClientStoreMarker, int64_t BlocksUsed, int64_t BlocksSoftLimit, int64_t BlocksHardLimit)
+	: mClientStoreMarker(ClientStoreMarker),
+	  mBlocksUsed(BlocksUsed),
+	  mBlocksSoftLimit(BlocksSoftLimit),
+	  mBlocksHardLimit(BlocksHardLimit)
+{
+}
+void BackupProtocolLoginConfirmed::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mClientStoreMarker);
+	rProtocol.Write(mBlocksUsed);
+	rProtocol.Write(mBlocksSoftLimit);
+	rProtocol.Write(mBlocksHardLimit);
+}
+std::string BackupProtocolLoginConfirmed::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "LoginConfirmed(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolLoginConfirmed::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "LoginConfirmed(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolLoginConfirmed::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolFinished::BackupProtocolFinished()
+{
+}
+BackupProtocolFinished::BackupProtocolFinished(const BackupProtocolFinished &rToCopy)
+{
+}
+BackupProtocolFinished::~BackupProtocolFinished()
+{
+}
+int BackupProtocolFinished::GetType() const
+{
+	return 4;
+}
+void BackupProtocolFinished::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolFinished::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+bool BackupProtocolFinished::IsConversationEnd() const
+{
+	return true;
+}
+std::string BackupProtocolFinished::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Finished(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolFinished::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Finished(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolFinished::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolSuccess::BackupProtocolSuccess()
+	: mObjectID(0)
+{
+}
+BackupProtocolSuccess::BackupProtocolSuccess(const BackupProtocolSuccess &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolSuccess::~BackupProtocolSuccess()
+{
+}
+int BackupProtocolSuccess::GetType() const
+{
+	return 5;
+}
+void BackupProtocolSuccess::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolSuccess::BackupProtocolSuccess(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolSuccess::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolSuccess::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Success(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolSuccess::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Success(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolSuccess::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolSetClientStoreMarker::BackupProtocolSetClientStoreMarker()
+	: mClientStoreMarker(0)
+{
+}
+BackupProtocolSetClientStoreMarker::BackupProtocolSetClientStoreMarker(const BackupProtocolSetClientStoreMarker &rToCopy)
+	: mClientStoreMarker(rToCopy.mClientStoreMarker)
+{
+}
+BackupProtocolSetClientStoreMarker::~BackupProtocolSetClientStoreMarker()
+{
+}
+int BackupProtocolSetClientStoreMarker::GetType() const
+{
+	return 6;
+}
+void BackupProtocolSetClientStoreMarker::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mClientStoreMarker);
+}
+BackupProtocolSetClientStoreMarker::BackupProtocolSetClientStoreMarker(int64_t ClientStoreMarker)
+	: mClientStoreMarker(ClientStoreMarker)
+{
+}
+void BackupProtocolSetClientStoreMarker::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mClientStoreMarker);
+}
+std::string BackupProtocolSetClientStoreMarker::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "SetClientStoreMarker(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolSetClientStoreMarker::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "SetClientStoreMarker(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolSetClientStoreMarker::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetObject::BackupProtocolGetObject()
+	: mObjectID(0)
+{
+}
+BackupProtocolGetObject::BackupProtocolGetObject(const BackupProtocolGetObject &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolGetObject::~BackupProtocolGetObject()
+{
+}
+int BackupProtocolGetObject::GetType() const
+{
+	return 10;
+}
+void BackupProtocolGetObject::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolGetObject::BackupProtocolGetObject(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolGetObject::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolGetObject::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetObject(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetObject::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetObject(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetObject::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolMoveObject::BackupProtocolMoveObject()
+	: mObjectID(0),
+	  mMoveFromDirectory(0),
+	  mMoveToDirectory(0),
+	  mFlags(0)
+{
+}
+BackupProtocolMoveObject::BackupProtocolMoveObject(const BackupProtocolMoveObject &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mMoveFromDirectory(rToCopy.mMoveFromDirectory),
+	  mMoveToDirectory(rToCopy.mMoveToDirectory),
+	  mFlags(rToCopy.mFlags),
+	  mNewFilename(rToCopy.mNewFilename)
+{
+}
+BackupProtocolMoveObject::~BackupProtocolMoveObject()
+{
+}
+int BackupProtocolMoveObject::GetType() const
+{
+	return 11;
+}
+void BackupProtocolMoveObject::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mMoveFromDirectory);
+	rProtocol.Read(mMoveToDirectory);
+	rProtocol.Read(mFlags);
+	rProtocol.Read(mNewFilename);
+}
+BackupProtocolMoveObject::BackupProtocolMoveObject(int64_t ObjectID, int64_t MoveFromDirectory, int64_t MoveToDirectory, int32_t Flags, const BackupStoreFilenameClear& NewFilename)
+	: mObjectID(ObjectID),
+	  mMoveFromDirectory(MoveFromDirectory),
+	  mMoveToDirectory(MoveToDirectory),
+	  mFlags(Flags),
+	  mNewFilename(NewFilename)
+{
+}
+void BackupProtocolMoveObject::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mMoveFromDirectory);
+	rProtocol.Write(mMoveToDirectory);
+	rProtocol.Write(mFlags);
+	rProtocol.Write(mNewFilename);
+}
+std::string BackupProtocolMoveObject::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "MoveObject(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolMoveObject::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "MoveObject(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolMoveObject::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetObjectName::BackupProtocolGetObjectName()
+	: mObjectID(0),
+	  mContainingDirectoryID(0)
+{
+}
+BackupProtocolGetObjectName::BackupProtocolGetObjectName(const BackupProtocolGetObjectName &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mContainingDirectoryID(rToCopy.mContainingDirectoryID)
+{
+}
+BackupProtocolGetObjectName::~BackupProtocolGetObjectName()
+{
+}
+int BackupProtocolGetObjectName::GetType() const
+{
+	return 12;
+}
+void BackupProtocolGetObjectName::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mContainingDirectoryID);
+}
+BackupProtocolGetObjectName::BackupProtocolGetObjectName(int64_t ObjectID, int64_t ContainingDirectoryID)
+	: mObjectID(ObjectID),
+	  mContainingDirectoryID(ContainingDirectoryID)
+{
+}
+void BackupProtocolGetObjectName::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mContainingDirectoryID);
+}
+std::string BackupProtocolGetObjectName::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetObjectName(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetObjectName::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetObjectName(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetObjectName::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolObjectName::BackupProtocolObjectName()
+	: mNumNameElements(0),
+	  mModificationTime(0),
+	  mAttributesHash(0),
+	  mFlags(0)
+{
+}
+BackupProtocolObjectName::BackupProtocolObjectName(const BackupProtocolObjectName &rToCopy)
+	: mNumNameElements(rToCopy.mNumNameElements),
+	  mModificationTime(rToCopy.mModificationTime),
+	  mAttributesHash(rToCopy.mAttributesHash),
+	  mFlags(rToCopy.mFlags)
+{
+}
+BackupProtocolObjectName::~BackupProtocolObjectName()
+{
+}
+int BackupProtocolObjectName::GetType() const
+{
+	return 13;
+}
+void BackupProtocolObjectName::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mNumNameElements);
+	rProtocol.Read(mModificationTime);
+	rProtocol.Read(mAttributesHash);
+	rProtocol.Read(mFlags);
+}
+BackupProtocolObjectName::BackupProtocolObjectName(int32_t NumNameElements, int64_t ModificationTime, int64_t AttributesHash, int16_t Flags)
+	: mNumNameElements(NumNameElements),
+	  mModificationTime(ModificationTime),
+	  mAttributesHash(AttributesHash),
+	  mFlags(Flags)
+{
+}
+void BackupProtocolObjectName::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mNumNameElements);
+	rProtocol.Write(mModificationTime);
+	rProtocol.Write(mAttributesHash);
+	rProtocol.Write(mFlags);
+}
+std::string BackupProtocolObjectName::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ObjectName(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolObjectName::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ObjectName(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolObjectName::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetObjectInfos::BackupProtocolGetObjectInfos()
+	: mObjectID(0)
+{
+}
+BackupProtocolGetObjectInfos::BackupProtocolGetObjectInfos(const BackupProtocolGetObjectInfos &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolGetObjectInfos::~BackupProtocolGetObjectInfos()
+{
+}
+int BackupProtocolGetObjectInfos::GetType() const
+{
+	return 14;
+}
+void BackupProtocolGetObjectInfos::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolGetObjectInfos::BackupProtocolGetObjectInfos(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolGetObjectInfos::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolGetObjectInfos::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetObjectInfos(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetObjectInfos::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetObjectInfos(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetObjectInfos::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolObjectInfos::BackupProtocolObjectInfos()
+	: mIsDir(0),
+	  mContainerID(0)
+{
+}
+BackupProtocolObjectInfos::BackupProtocolObjectInfos(const BackupProtocolObjectInfos &rToCopy)
+	: mIsDir(rToCopy.mIsDir),
+	  mContainerID(rToCopy.mContainerID)
+{
+}
+BackupProtocolObjectInfos::~BackupProtocolObjectInfos()
+{
+}
+int BackupProtocolObjectInfos::GetType() const
+{
+	return 15;
+}
+void BackupProtocolObjectInfos::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mIsDir);
+	rProtocol.Read(mContainerID);
+}
+BackupProtocolObjectInfos::BackupProtocolObjectInfos(bool IsDir, int64_t ContainerID)
+	: mIsDir(IsDir),
+	  mContainerID(ContainerID)
+{
+}
+void BackupProtocolObjectInfos::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mIsDir);
+	rProtocol.Write(mContainerID);
+}
+std::string BackupProtocolObjectInfos::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ObjectInfos(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolObjectInfos::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ObjectInfos(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolObjectInfos::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetObjectName2::BackupProtocolGetObjectName2()
+	: mObjectID(0),
+	  mContainingDirectoryID(0)
+{
+}
+BackupProtocolGetObjectName2::BackupProtocolGetObjectName2(const BackupProtocolGetObjectName2 &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mContainingDirectoryID(rToCopy.mContainingDirectoryID)
+{
+}
+BackupProtocolGetObjectName2::~BackupProtocolGetObjectName2()
+{
+}
+int BackupProtocolGetObjectName2::GetType() const
+{
+	return 16;
+}
+void BackupProtocolGetObjectName2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mContainingDirectoryID);
+}
+BackupProtocolGetObjectName2::BackupProtocolGetObjectName2(int64_t ObjectID, int64_t ContainingDirectoryID)
+	: mObjectID(ObjectID),
+	  mContainingDirectoryID(ContainingDirectoryID)
+{
+}
+void BackupProtocolGetObjectName2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mContainingDirectoryID);
+}
+std::string BackupProtocolGetObjectName2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetObjectName2(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetObjectName2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetObjectName2(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetObjectName2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolObjectName2::BackupProtocolObjectName2()
+	: mNumNameElements(0),
+	  mModificationTime(0),
+	  mAttributesHash(0),
+	  mBackupTime(0),
+	  mDeleteTime(0),
+	  mFlags(0)
+{
+}
+BackupProtocolObjectName2::BackupProtocolObjectName2(const BackupProtocolObjectName2 &rToCopy)
+	: mNumNameElements(rToCopy.mNumNameElements),
+	  mModificationTime(rToCopy.mModificationTime),
+	  mAttributesHash(rToCopy.mAttributesHash),
+	  mBackupTime(rToCopy.mBackupTime),
+	  mDeleteTime(rToCopy.mDeleteTime),
+	  mFlags(rToCopy.mFlags)
+{
+}
+BackupProtocolObjectName2::~BackupProtocolObjectName2()
+{
+}
+int BackupProtocolObjectName2::GetType() const
+{
+	return 17;
+}
+void BackupProtocolObjectName2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mNumNameElements);
+	rProtocol.Read(mModificationTime);
+	rProtocol.Read(mAttributesHash);
+	rProtocol.Read(mBackupTime);
+	rProtocol.Read(mDeleteTime);
+	rProtocol.Read(mFlags);
+}
+BackupProtocolObjectName2::BackupProtocolObjectName2(int32_t NumNameElements, int64_t ModificationTime, int64_t AttributesHash, int64_t BackupTime, int64_t DeleteTime, int16_t Flags)
+	: mNumNameElements(NumNameElements),
+	  mModificationTime(ModificationTime),
+	  mAttributesHash(AttributesHash),
+	  mBackupTime(BackupTime),
+	  mDeleteTime(DeleteTime),
+	  mFlags(Flags)
+{
+}
+void BackupProtocolObjectName2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mNumNameElements);
+	rProtocol.Write(mModificationTime);
+	rProtocol.Write(mAttributesHash);
+	rProtocol.Write(mBackupTime);
+	rProtocol.Write(mDeleteTime);
+	rProtocol.Write(mFlags);
+}
+std::string BackupProtocolObjectName2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ObjectName2(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolObjectName2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ObjectName2(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolObjectName2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolCreateDirectory::BackupProtocolCreateDirectory()
+	: mContainingDirectoryID(0),
+	  mAttributesModTime(0)
+{
+}
+BackupProtocolCreateDirectory::BackupProtocolCreateDirectory(const BackupProtocolCreateDirectory &rToCopy)
+	: mContainingDirectoryID(rToCopy.mContainingDirectoryID),
+	  mAttributesModTime(rToCopy.mAttributesModTime),
+	  mDirectoryName(rToCopy.mDirectoryName)
+{
+}
+BackupProtocolCreateDirectory::~BackupProtocolCreateDirectory()
+{
+}
+int BackupProtocolCreateDirectory::GetType() const
+{
+	return 20;
+}
+void BackupProtocolCreateDirectory::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mContainingDirectoryID);
+	rProtocol.Read(mAttributesModTime);
+	rProtocol.Read(mDirectoryName);
+}
+BackupProtocolCreateDirectory::BackupProtocolCreateDirectory(int64_t ContainingDirectoryID, int64_t AttributesModTime, const BackupStoreFilenameClear& DirectoryName)
+	: mContainingDirectoryID(ContainingDirectoryID),
+	  mAttributesModTime(AttributesModTime),
+	  mDirectoryName(DirectoryName)
+{
+}
+void BackupProtocolCreateDirectory::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mContainingDirectoryID);
+	rProtocol.Write(mAttributesModTime);
+	rProtocol.Write(mDirectoryName);
+}
+std::string BackupProtocolCreateDirectory::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "CreateDirectory(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolCreateDirectory::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "CreateDirectory(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolCreateDirectory::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolCreateDirectory2::BackupProtocolCreateDirectory2()
+	: mContainingDirectoryID(0),
+	  mAttributesModTime(0),
+	  mModificationTime(0)
+{
+}
+BackupProtocolCreateDirectory2::BackupProtocolCreateDirectory2(const BackupProtocolCreateDirectory2 &rToCopy)
+	: mContainingDirectoryID(rToCopy.mContainingDirectoryID),
+	  mAttributesModTime(rToCopy.mAttributesModTime),
+	  mModificationTime(rToCopy.mModificationTime),
+	  mDirectoryName(rToCopy.mDirectoryName)
+{
+}
+BackupProtocolCreateDirectory2::~BackupProtocolCreateDirectory2()
+{
+}
+int BackupProtocolCreateDirectory2::GetType() const
+{
+	return 46;
+}
+void BackupProtocolCreateDirectory2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mContainingDirectoryID);
+	rProtocol.Read(mAttributesModTime);
+	rProtocol.Read(mModificationTime);
+	rProtocol.Read(mDirectoryName);
+}
+BackupProtocolCreateDirectory2::BackupProtocolCreateDirectory2(int64_t ContainingDirectoryID, int64_t AttributesModTime, int64_t ModificationTime, const BackupStoreFilenameClear& DirectoryName)
+	: mContainingDirectoryID(ContainingDirectoryID),
+	  mAttributesModTime(AttributesModTime),
+	  mModificationTime(ModificationTime),
+	  mDirectoryName(DirectoryName)
+{
+}
+void BackupProtocolCreateDirectory2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mContainingDirectoryID);
+	rProtocol.Write(mAttributesModTime);
+	rProtocol.Write(mModificationTime);
+	rProtocol.Write(mDirectoryName);
+}
+std::string BackupProtocolCreateDirectory2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "CreateDirectory2(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolCreateDirectory2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "CreateDirectory2(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolCreateDirectory2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolListDirectory::BackupProtocolListDirectory()
+	: mObjectID(0),
+	  mFlagsMustBeSet(0),
+	  mFlagsNotToBeSet(0),
+	  mSendAttributes(0),
+	  mSnapshotTime(0)
+{
+}
+BackupProtocolListDirectory::BackupProtocolListDirectory(const BackupProtocolListDirectory &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mFlagsMustBeSet(rToCopy.mFlagsMustBeSet),
+	  mFlagsNotToBeSet(rToCopy.mFlagsNotToBeSet),
+	  mSendAttributes(rToCopy.mSendAttributes),
+	  mSnapshotTime(rToCopy.mSnapshotTime)
+{
+}
+BackupProtocolListDirectory::~BackupProtocolListDirectory()
+{
+}
+int BackupProtocolListDirectory::GetType() const
+{
+	return 21;
+}
+void BackupProtocolListDirectory::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mFlagsMustBeSet);
+	rProtocol.Read(mFlagsNotToBeSet);
+	rProtocol.Read(mSendAttributes);
+	rProtocol.ReadWithDefault(mSnapshotTime, 0);
+}
+BackupProtocolListDirectory::BackupProtocolListDirectory(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime)
+	: mObjectID(ObjectID),
+	  mFlagsMustBeSet(FlagsMustBeSet),
+	  mFlagsNotToBeSet(FlagsNotToBeSet),
+	  mSendAttributes(SendAttributes),
+	  mSnapshotTime(SnapshotTime)
+{
+}
+void BackupProtocolListDirectory::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mFlagsMustBeSet);
+	rProtocol.Write(mFlagsNotToBeSet);
+	rProtocol.Write(mSendAttributes);
+	rProtocol.Write(mSnapshotTime);
+}
+std::string BackupProtocolListDirectory::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ListDirectory(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolListDirectory::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ListDirectory(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolListDirectory::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolChangeDirAttributes::BackupProtocolChangeDirAttributes()
+	: mObjectID(0),
+	  mAttributesModTime(0)
+{
+}
+BackupProtocolChangeDirAttributes::BackupProtocolChangeDirAttributes(const BackupProtocolChangeDirAttributes &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mAttributesModTime(rToCopy.mAttributesModTime)
+{
+}
+BackupProtocolChangeDirAttributes::~BackupProtocolChangeDirAttributes()
+{
+}
+int BackupProtocolChangeDirAttributes::GetType() const
+{
+	return 22;
+}
+void BackupProtocolChangeDirAttributes::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mAttributesModTime);
+}
+BackupProtocolChangeDirAttributes::BackupProtocolChangeDirAttributes(int64_t ObjectID, int64_t AttributesModTime)
+	: mObjectID(ObjectID),
+	  mAttributesModTime(AttributesModTime)
+{
+}
+void BackupProtocolChangeDirAttributes::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mAttributesModTime);
+}
+std::string BackupProtocolChangeDirAttributes::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ChangeDirAttributes(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolChangeDirAttributes::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ChangeDirAttributes(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolChangeDirAttributes::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolChangeDirAttributes2::BackupProtocolChangeDirAttributes2()
+	: mObjectID(0),
+	  mAttributesModTime(0),
+	  mModTime(0)
+{
+}
+BackupProtocolChangeDirAttributes2::BackupProtocolChangeDirAttributes2(const BackupProtocolChangeDirAttributes2 &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mAttributesModTime(rToCopy.mAttributesModTime),
+	  mModTime(rToCopy.mModTime)
+{
+}
+BackupProtocolChangeDirAttributes2::~BackupProtocolChangeDirAttributes2()
+{
+}
+int BackupProtocolChangeDirAttributes2::GetType() const
+{
+	return 26;
+}
+void BackupProtocolChangeDirAttributes2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mAttributesModTime);
+	rProtocol.Read(mModTime);
+}
+BackupProtocolChangeDirAttributes2::BackupProtocolChangeDirAttributes2(int64_t ObjectID, int64_t AttributesModTime, int64_t ModTime)
+	: mObjectID(ObjectID),
+	  mAttributesModTime(AttributesModTime),
+	  mModTime(ModTime)
+{
+}
+void BackupProtocolChangeDirAttributes2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mAttributesModTime);
+	rProtocol.Write(mModTime);
+}
+std::string BackupProtocolChangeDirAttributes2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ChangeDirAttributes2(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolChangeDirAttributes2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ChangeDirAttributes2(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolChangeDirAttributes2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolDeleteDirectory::BackupProtocolDeleteDirectory()
+	: mObjectID(0),
+	  mFlags(0),
+	  mDeleteFromStore(0)
+{
+}
+BackupProtocolDeleteDirectory::BackupProtocolDeleteDirectory(const BackupProtocolDeleteDirectory &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mFlags(rToCopy.mFlags),
+	  mDeleteFromStore(rToCopy.mDeleteFromStore)
+{
+}
+BackupProtocolDeleteDirectory::~BackupProtocolDeleteDirectory()
+{
+}
+int BackupProtocolDeleteDirectory::GetType() const
+{
+	return 23;
+}
+void BackupProtocolDeleteDirectory::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.ReadWithDefault(mFlags, 0);
+	rProtocol.ReadWithDefault(mDeleteFromStore, 0);
+}
+BackupProtocolDeleteDirectory::BackupProtocolDeleteDirectory(int64_t ObjectID, int16_t Flags, bool DeleteFromStore)
+	: mObjectID(ObjectID),
+	  mFlags(Flags),
+	  mDeleteFromStore(DeleteFromStore)
+{
+}
+void BackupProtocolDeleteDirectory::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mFlags);
+	rProtocol.Write(mDeleteFromStore);
+}
+std::string BackupProtocolDeleteDirectory::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "DeleteDirectory(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolDeleteDirectory::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "DeleteDirectory(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolDeleteDirectory::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolUndeleteDirectory::BackupProtocolUndeleteDirectory()
+	: mObjectID(0)
+{
+}
+BackupProtocolUndeleteDirectory::BackupProtocolUndeleteDirectory(const BackupProtocolUndeleteDirectory &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolUndeleteDirectory::~BackupProtocolUndeleteDirectory()
+{
+}
+int BackupProtocolUndeleteDirectory::GetType() const
+{
+	return 24;
+}
+void BackupProtocolUndeleteDirectory::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolUndeleteDirectory::BackupProtocolUndeleteDirectory(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolUndeleteDirectory::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolUndeleteDirectory::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "UndeleteDirectory(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolUndeleteDirectory::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "UndeleteDirectory(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolUndeleteDirectory::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolDeleteDirectoryASAP::BackupProtocolDeleteDirectoryASAP()
+	: mObjectID(0)
+{
+}
+BackupProtocolDeleteDirectoryASAP::BackupProtocolDeleteDirectoryASAP(const BackupProtocolDeleteDirectoryASAP &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolDeleteDirectoryASAP::~BackupProtocolDeleteDirectoryASAP()
+{
+}
+int BackupProtocolDeleteDirectoryASAP::GetType() const
+{
+	return 25;
+}
+void BackupProtocolDeleteDirectoryASAP::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolDeleteDirectoryASAP::BackupProtocolDeleteDirectoryASAP(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolDeleteDirectoryASAP::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolDeleteDirectoryASAP::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "DeleteDirectoryASAP(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolDeleteDirectoryASAP::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "DeleteDirectoryASAP(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolDeleteDirectoryASAP::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolStoreFile::BackupProtocolStoreFile()
+	: mDirectoryObjectID(0),
+	  mModificationTime(0),
+	  mAttributesHash(0),
+	  mDiffFromFileID(0)
+{
+}
+BackupProtocolStoreFile::BackupProtocolStoreFile(const BackupProtocolStoreFile &rToCopy)
+	: mDirectoryObjectID(rToCopy.mDirectoryObjectID),
+	  mModificationTime(rToCopy.mModificationTime),
+	  mAttributesHash(rToCopy.mAttributesHash),
+	  mDiffFromFileID(rToCopy.mDiffFromFileID),
+	  mFilename(rToCopy.mFilename)
+{
+}
+BackupProtocolStoreFile::~BackupProtocolStoreFile()
+{
+}
+int BackupProtocolStoreFile::GetType() const
+{
+	return 30;
+}
+void BackupProtocolStoreFile::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mDirectoryObjectID);
+	rProtocol.Read(mModificationTime);
+	rProtocol.Read(mAttributesHash);
+	rProtocol.Read(mDiffFromFileID);
+	rProtocol.Read(mFilename);
+}
+BackupProtocolStoreFile::BackupProtocolStoreFile(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, const BackupStoreFilenameClear& Filename)
+	: mDirectoryObjectID(DirectoryObjectID),
+	  mModificationTime(ModificationTime),
+	  mAttributesHash(AttributesHash),
+	  mDiffFromFileID(DiffFromFileID),
+	  mFilename(Filename)
+{
+}
+void BackupProtocolStoreFile::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mDirectoryObjectID);
+	rProtocol.Write(mModificationTime);
+	rProtocol.Write(mAttributesHash);
+	rProtocol.Write(mDiffFromFileID);
+	rProtocol.Write(mFilename);
+}
+std::string BackupProtocolStoreFile::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "StoreFile(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolStoreFile::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "StoreFile(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolStoreFile::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetFile::BackupProtocolGetFile()
+	: mInDirectory(0),
+	  mObjectID(0)
+{
+}
+BackupProtocolGetFile::BackupProtocolGetFile(const BackupProtocolGetFile &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolGetFile::~BackupProtocolGetFile()
+{
+}
+int BackupProtocolGetFile::GetType() const
+{
+	return 31;
+}
+void BackupProtocolGetFile::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolGetFile::BackupProtocolGetFile(int64_t InDirectory, int64_t ObjectID)
+	: mInDirectory(InDirectory),
+	  mObjectID(ObjectID)
+{
+}
+void BackupProtocolGetFile::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolGetFile::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetFile(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetFile::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetFile(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetFile::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolSetReplacementFileAttributes::BackupProtocolSetReplacementFileAttributes()
+	: mInDirectory(0),
+	  mAttributesHash(0)
+{
+}
+BackupProtocolSetReplacementFileAttributes::BackupProtocolSetReplacementFileAttributes(const BackupProtocolSetReplacementFileAttributes &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mAttributesHash(rToCopy.mAttributesHash),
+	  mFilename(rToCopy.mFilename)
+{
+}
+BackupProtocolSetReplacementFileAttributes::~BackupProtocolSetReplacementFileAttributes()
+{
+}
+int BackupProtocolSetReplacementFileAttributes::GetType() const
+{
+	return 32;
+}
+void BackupProtocolSetReplacementFileAttributes::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mAttributesHash);
+	rProtocol.Read(mFilename);
+}
+BackupProtocolSetReplacementFileAttributes::BackupProtocolSetReplacementFileAttributes(int64_t InDirectory, int64_t AttributesHash, const BackupStoreFilenameClear& Filename)
+	: mInDirectory(InDirectory),
+	  mAttributesHash(AttributesHash),
+	  mFilename(Filename)
+{
+}
+void BackupProtocolSetReplacementFileAttributes::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mAttributesHash);
+	rProtocol.Write(mFilename);
+}
+std::string BackupProtocolSetReplacementFileAttributes::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "SetReplacementFileAttributes(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolSetReplacementFileAttributes::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "SetReplacementFileAttributes(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolSetReplacementFileAttributes::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolDeleteFile::BackupProtocolDeleteFile()
+	: mInDirectory(0),
+	  mFlags(0),
+	  mDeleteFromStore(0)
+{
+}
+BackupProtocolDeleteFile::BackupProtocolDeleteFile(const BackupProtocolDeleteFile &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mFilename(rToCopy.mFilename),
+	  mFlags(rToCopy.mFlags),
+	  mDeleteFromStore(rToCopy.mDeleteFromStore)
+{
+}
+BackupProtocolDeleteFile::~BackupProtocolDeleteFile()
+{
+}
+int BackupProtocolDeleteFile::GetType() const
+{
+	return 33;
+}
+void BackupProtocolDeleteFile::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mFilename);
+	rProtocol.ReadWithDefault(mFlags, 0);
+	rProtocol.ReadWithDefault(mDeleteFromStore, 0);
+}
+BackupProtocolDeleteFile::BackupProtocolDeleteFile(int64_t InDirectory, const BackupStoreFilenameClear& Filename, int16_t Flags, bool DeleteFromStore)
+	: mInDirectory(InDirectory),
+	  mFilename(Filename),
+	  mFlags(Flags),
+	  mDeleteFromStore(DeleteFromStore)
+{
+}
+void BackupProtocolDeleteFile::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mFilename);
+	rProtocol.Write(mFlags);
+	rProtocol.Write(mDeleteFromStore);
+}
+std::string BackupProtocolDeleteFile::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "DeleteFile(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolDeleteFile::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "DeleteFile(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolDeleteFile::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetBlockIndexByID::BackupProtocolGetBlockIndexByID()
+	: mObjectID(0)
+{
+}
+BackupProtocolGetBlockIndexByID::BackupProtocolGetBlockIndexByID(const BackupProtocolGetBlockIndexByID &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolGetBlockIndexByID::~BackupProtocolGetBlockIndexByID()
+{
+}
+int BackupProtocolGetBlockIndexByID::GetType() const
+{
+	return 34;
+}
+void BackupProtocolGetBlockIndexByID::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolGetBlockIndexByID::BackupProtocolGetBlockIndexByID(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolGetBlockIndexByID::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolGetBlockIndexByID::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetBlockIndexByID(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetBlockIndexByID::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetBlockIndexByID(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetBlockIndexByID::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetBlockIndexByName::BackupProtocolGetBlockIndexByName()
+	: mInDirectory(0)
+{
+}
+BackupProtocolGetBlockIndexByName::BackupProtocolGetBlockIndexByName(const BackupProtocolGetBlockIndexByName &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mFilename(rToCopy.mFilename)
+{
+}
+BackupProtocolGetBlockIndexByName::~BackupProtocolGetBlockIndexByName()
+{
+}
+int BackupProtocolGetBlockIndexByName::GetType() const
+{
+	return 35;
+}
+void BackupProtocolGetBlockIndexByName::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mFilename);
+}
+BackupProtocolGetBlockIndexByName::BackupProtocolGetBlockIndexByName(int64_t InDirectory, const BackupStoreFilenameClear& Filename)
+	: mInDirectory(InDirectory),
+	  mFilename(Filename)
+{
+}
+void BackupProtocolGetBlockIndexByName::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mFilename);
+}
+std::string BackupProtocolGetBlockIndexByName::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetBlockIndexByName(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetBlockIndexByName::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetBlockIndexByName(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetBlockIndexByName::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolUndeleteFile::BackupProtocolUndeleteFile()
+	: mInDirectory(0),
+	  mObjectID(0)
+{
+}
+BackupProtocolUndeleteFile::BackupProtocolUndeleteFile(const BackupProtocolUndeleteFile &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolUndeleteFile::~BackupProtocolUndeleteFile()
+{
+}
+int BackupProtocolUndeleteFile::GetType() const
+{
+	return 36;
+}
+void BackupProtocolUndeleteFile::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolUndeleteFile::BackupProtocolUndeleteFile(int64_t InDirectory, int64_t ObjectID)
+	: mInDirectory(InDirectory),
+	  mObjectID(ObjectID)
+{
+}
+void BackupProtocolUndeleteFile::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolUndeleteFile::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "UndeleteFile(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolUndeleteFile::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "UndeleteFile(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolUndeleteFile::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolDeleteFileASAP::BackupProtocolDeleteFileASAP()
+	: mInDirectory(0)
+{
+}
+BackupProtocolDeleteFileASAP::BackupProtocolDeleteFileASAP(const BackupProtocolDeleteFileASAP &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mFilename(rToCopy.mFilename)
+{
+}
+BackupProtocolDeleteFileASAP::~BackupProtocolDeleteFileASAP()
+{
+}
+int BackupProtocolDeleteFileASAP::GetType() const
+{
+	return 37;
+}
+void BackupProtocolDeleteFileASAP::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mFilename);
+}
+BackupProtocolDeleteFileASAP::BackupProtocolDeleteFileASAP(int64_t InDirectory, const BackupStoreFilenameClear& Filename)
+	: mInDirectory(InDirectory),
+	  mFilename(Filename)
+{
+}
+void BackupProtocolDeleteFileASAP::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mFilename);
+}
+std::string BackupProtocolDeleteFileASAP::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "DeleteFileASAP(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolDeleteFileASAP::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "DeleteFileASAP(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolDeleteFileASAP::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolStoreFileWithResume::BackupProtocolStoreFileWithResume()
+	: mDirectoryObjectID(0),
+	  mModificationTime(0),
+	  mAttributesHash(0),
+	  mDiffFromFileID(0),
+	  mResumeOffset(0)
+{
+}
+BackupProtocolStoreFileWithResume::BackupProtocolStoreFileWithResume(const BackupProtocolStoreFileWithResume &rToCopy)
+	: mDirectoryObjectID(rToCopy.mDirectoryObjectID),
+	  mModificationTime(rToCopy.mModificationTime),
+	  mAttributesHash(rToCopy.mAttributesHash),
+	  mDiffFromFileID(rToCopy.mDiffFromFileID),
+	  mResumeOffset(rToCopy.mResumeOffset),
+	  mFilename(rToCopy.mFilename)
+{
+}
+BackupProtocolStoreFileWithResume::~BackupProtocolStoreFileWithResume()
+{
+}
+int BackupProtocolStoreFileWithResume::GetType() const
+{
+	return 38;
+}
+void BackupProtocolStoreFileWithResume::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mDirectoryObjectID);
+	rProtocol.Read(mModificationTime);
+	rProtocol.Read(mAttributesHash);
+	rProtocol.Read(mDiffFromFileID);
+	rProtocol.Read(mResumeOffset);
+	rProtocol.Read(mFilename);
+}
+BackupProtocolStoreFileWithResume::BackupProtocolStoreFileWithResume(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, int64_t ResumeOffset, const BackupStoreFilenameClear& Filename)
+	: mDirectoryObjectID(DirectoryObjectID),
+	  mModificationTime(ModificationTime),
+	  mAttributesHash(AttributesHash),
+	  mDiffFromFileID(DiffFromFileID),
+	  mResumeOffset(ResumeOffset),
+	  mFilename(Filename)
+{
+}
+void BackupProtocolStoreFileWithResume::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mDirectoryObjectID);
+	rProtocol.Write(mModificationTime);
+	rProtocol.Write(mAttributesHash);
+	rProtocol.Write(mDiffFromFileID);
+	rProtocol.Write(mResumeOffset);
+	rProtocol.Write(mFilename);
+}
+std::string BackupProtocolStoreFileWithResume::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "StoreFileWithResume(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolStoreFileWithResume::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "StoreFileWithResume(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolStoreFileWithResume::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetAccountUsage::BackupProtocolGetAccountUsage()
+{
+}
+BackupProtocolGetAccountUsage::BackupProtocolGetAccountUsage(const BackupProtocolGetAccountUsage &rToCopy)
+{
+}
+BackupProtocolGetAccountUsage::~BackupProtocolGetAccountUsage()
+{
+}
+int BackupProtocolGetAccountUsage::GetType() const
+{
+	return 40;
+}
+void BackupProtocolGetAccountUsage::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolGetAccountUsage::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolGetAccountUsage::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetAccountUsage(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetAccountUsage::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetAccountUsage(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetAccountUsage::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolAccountUsage::BackupProtocolAccountUsage()
+	: mBlocksUsed(0),
+	  mBlocksInOldFiles(0),
+	  mBlocksInDeletedFiles(0),
+	  mBlocksInDirectories(0),
+	  mBlocksSoftLimit(0),
+	  mBlocksHardLimit(0),
+	  mBlockSize(0)
+{
+}
+BackupProtocolAccountUsage::BackupProtocolAccountUsage(const BackupProtocolAccountUsage &rToCopy)
+	: mBlocksUsed(rToCopy.mBlocksUsed),
+	  mBlocksInOldFiles(rToCopy.mBlocksInOldFiles),
+	  mBlocksInDeletedFiles(rToCopy.mBlocksInDeletedFiles),
+	  mBlocksInDirectories(rToCopy.mBlocksInDirectories),
+	  mBlocksSoftLimit(rToCopy.mBlocksSoftLimit),
+	  mBlocksHardLimit(rToCopy.mBlocksHardLimit),
+	  mBlockSize(rToCopy.mBlockSize)
+{
+}
+BackupProtocolAccountUsage::~BackupProtocolAccountUsage()
+{
+}
+int BackupProtocolAccountUsage::GetType() const
+{
+	return 41;
+}
+void BackupProtocolAccountUsage::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mBlocksUsed);
+	rProtocol.Read(mBlocksInOldFiles);
+	rProtocol.Read(mBlocksInDeletedFiles);
+	rProtocol.Read(mBlocksInDirectories);
+	rProtocol.Read(mBlocksSoftLimit);
+	rProtocol.Read(mBlocksHardLimit);
+	rProtocol.Read(mBlockSize);
+}
+BackupProtocolAccountUsage::BackupProtocolAccountUsage(int64_t BlocksUsed, int64_t BlocksInOldFiles, int64_t BlocksInDeletedFiles, int64_t BlocksInDirectories, int64_t BlocksSoftLimit, int64_t BlocksHardLimit, int32_t BlockSize)
+	: mBlocksUsed(BlocksUsed),
+	  mBlocksInOldFiles(BlocksInOldFiles),
+	  mBlocksInDeletedFiles(BlocksInDeletedFiles),
+	  mBlocksInDirectories(BlocksInDirectories),
+	  mBlocksSoftLimit(BlocksSoftLimit),
+	  mBlocksHardLimit(BlocksHardLimit),
+	  mBlockSize(BlockSize)
+{
+}
+void BackupProtocolAccountUsage::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mBlocksUsed);
+	rProtocol.Write(mBlocksInOldFiles);
+	rProtocol.Write(mBlocksInDeletedFiles);
+	rProtocol.Write(mBlocksInDirectories);
+	rProtocol.Write(mBlocksSoftLimit);
+	rProtocol.Write(mBlocksHardLimit);
+	rProtocol.Write(mBlockSize);
+}
+std::string BackupProtocolAccountUsage::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "AccountUsage(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolAccountUsage::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "AccountUsage(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolAccountUsage::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetIsAlive::BackupProtocolGetIsAlive()
+{
+}
+BackupProtocolGetIsAlive::BackupProtocolGetIsAlive(const BackupProtocolGetIsAlive &rToCopy)
+{
+}
+BackupProtocolGetIsAlive::~BackupProtocolGetIsAlive()
+{
+}
+int BackupProtocolGetIsAlive::GetType() const
+{
+	return 42;
+}
+void BackupProtocolGetIsAlive::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolGetIsAlive::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolGetIsAlive::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetIsAlive(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetIsAlive::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetIsAlive(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetIsAlive::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolIsAlive::BackupProtocolIsAlive()
+{
+}
+BackupProtocolIsAlive::BackupProtocolIsAlive(const BackupProtocolIsAlive &rToCopy)
+{
+}
+BackupProtocolIsAlive::~BackupProtocolIsAlive()
+{
+}
+int BackupProtocolIsAlive::GetType() const
+{
+	return 43;
+}
+void BackupProtocolIsAlive::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolIsAlive::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolIsAlive::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "IsAlive(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolIsAlive::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "IsAlive(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolIsAlive::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetAccountUsage2::BackupProtocolGetAccountUsage2()
+{
+}
+BackupProtocolGetAccountUsage2::BackupProtocolGetAccountUsage2(const BackupProtocolGetAccountUsage2 &rToCopy)
+{
+}
+BackupProtocolGetAccountUsage2::~BackupProtocolGetAccountUsage2()
+{
+}
+int BackupProtocolGetAccountUsage2::GetType() const
+{
+	return 44;
+}
+void BackupProtocolGetAccountUsage2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolGetAccountUsage2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolGetAccountUsage2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetAccountUsage2(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetAccountUsage2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetAccountUsage2(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetAccountUsage2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolAccountUsage2::BackupProtocolAccountUsage2()
+	: mAccountEnabled(0),
+	  mClientStoreMarker(0),
+	  mBlockSize(0),
+	  mLastObjectIDUsed(0),
+	  mBlocksUsed(0),
+	  mBlocksInCurrentFiles(0),
+	  mBlocksInOldFiles(0),
+	  mBlocksInDeletedFiles(0),
+	  mBlocksInDirectories(0),
+	  mBlocksSoftLimit(0),
+	  mBlocksHardLimit(0),
+	  mNumCurrentFiles(0),
+	  mNumOldFiles(0),
+	  mNumDeletedFiles(0),
+	  mNumDirectories(0)
+{
+}
+BackupProtocolAccountUsage2::BackupProtocolAccountUsage2(const BackupProtocolAccountUsage2 &rToCopy)
+	: mAccountName(rToCopy.mAccountName),
+	  mAccountEnabled(rToCopy.mAccountEnabled),
+	  mClientStoreMarker(rToCopy.mClientStoreMarker),
+	  mBlockSize(rToCopy.mBlockSize),
+	  mLastObjectIDUsed(rToCopy.mLastObjectIDUsed),
+	  mBlocksUsed(rToCopy.mBlocksUsed),
+	  mBlocksInCurrentFiles(rToCopy.mBlocksInCurrentFiles),
+	  mBlocksInOldFiles(rToCopy.mBlocksInOldFiles),
+	  mBlocksInDeletedFiles(rToCopy.mBlocksInDeletedFiles),
+	  mBlocksInDirectories(rToCopy.mBlocksInDirectories),
+	  mBlocksSoftLimit(rToCopy.mBlocksSoftLimit),
+	  mBlocksHardLimit(rToCopy.mBlocksHardLimit),
+	  mNumCurrentFiles(rToCopy.mNumCurrentFiles),
+	  mNumOldFiles(rToCopy.mNumOldFiles),
+	  mNumDeletedFiles(rToCopy.mNumDeletedFiles),
+	  mNumDirectories(rToCopy.mNumDirectories)
+{
+}
+BackupProtocolAccountUsage2::~BackupProtocolAccountUsage2()
+{
+}
+int BackupProtocolAccountUsage2::GetType() const
+{
+	return 45;
+}
+void BackupProtocolAccountUsage2::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mAccountName);
+	rProtocol.Read(mAccountEnabled);
+	rProtocol.Read(mClientStoreMarker);
+	rProtocol.Read(mBlockSize);
+	rProtocol.Read(mLastObjectIDUsed);
+	rProtocol.Read(mBlocksUsed);
+	rProtocol.Read(mBlocksInCurrentFiles);
+	rProtocol.Read(mBlocksInOldFiles);
+	rProtocol.Read(mBlocksInDeletedFiles);
+	rProtocol.Read(mBlocksInDirectories);
+	rProtocol.Read(mBlocksSoftLimit);
+	rProtocol.Read(mBlocksHardLimit);
+	rProtocol.Read(mNumCurrentFiles);
+	rProtocol.Read(mNumOldFiles);
+	rProtocol.Read(mNumDeletedFiles);
+	rProtocol.Read(mNumDirectories);
+}
+BackupProtocolAccountUsage2::BackupProtocolAccountUsage2(const std::string& AccountName, bool AccountEnabled, int64_t ClientStoreMarker, int32_t BlockSize, int64_t LastObjectIDUsed, int64_t BlocksUsed, int64_t BlocksInCurrentFiles, int64_t BlocksInOldFiles, int64_t BlocksInDeletedFiles, int64_t BlocksInDirectories, int64_t BlocksSoftLimit, int64_t BlocksHardLimit, int64_t NumCurrentFiles, int64_t NumOldFiles, int64_t NumDeletedFiles, int64_t NumDirectories)
+	: mAccountName(AccountName),
+	  mAccountEnabled(AccountEnabled),
+	  mClientStoreMarker(ClientStoreMarker),
+	  mBlockSize(BlockSize),
+	  mLastObjectIDUsed(LastObjectIDUsed),
+	  mBlocksUsed(BlocksUsed),
+	  mBlocksInCurrentFiles(BlocksInCurrentFiles),
+	  mBlocksInOldFiles(BlocksInOldFiles),
+	  mBlocksInDeletedFiles(BlocksInDeletedFiles),
+	  mBlocksInDirectories(BlocksInDirectories),
+	  mBlocksSoftLimit(BlocksSoftLimit),
+	  mBlocksHardLimit(BlocksHardLimit),
+	  mNumCurrentFiles(NumCurrentFiles),
+	  mNumOldFiles(NumOldFiles),
+	  mNumDeletedFiles(NumDeletedFiles),
+	  mNumDirectories(NumDirectories)
+{
+}
+void BackupProtocolAccountUsage2::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mAccountName);
+	rProtocol.Write(mAccountEnabled);
+	rProtocol.Write(mClientStoreMarker);
+	rProtocol.Write(mBlockSize);
+	rProtocol.Write(mLastObjectIDUsed);
+	rProtocol.Write(mBlocksUsed);
+	rProtocol.Write(mBlocksInCurrentFiles);
+	rProtocol.Write(mBlocksInOldFiles);
+	rProtocol.Write(mBlocksInDeletedFiles);
+	rProtocol.Write(mBlocksInDirectories);
+	rProtocol.Write(mBlocksSoftLimit);
+	rProtocol.Write(mBlocksHardLimit);
+	rProtocol.Write(mNumCurrentFiles);
+	rProtocol.Write(mNumOldFiles);
+	rProtocol.Write(mNumDeletedFiles);
+	rProtocol.Write(mNumDirectories);
+}
+std::string BackupProtocolAccountUsage2::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "AccountUsage2(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolAccountUsage2::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "AccountUsage2(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolAccountUsage2::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolListBackups::BackupProtocolListBackups()
+{
+}
+BackupProtocolListBackups::BackupProtocolListBackups(const BackupProtocolListBackups &rToCopy)
+{
+}
+BackupProtocolListBackups::~BackupProtocolListBackups()
+{
+}
+int BackupProtocolListBackups::GetType() const
+{
+	return 47;
+}
+void BackupProtocolListBackups::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolListBackups::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolListBackups::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ListBackups(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolListBackups::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ListBackups(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolListBackups::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolBackups::BackupProtocolBackups()
+{
+}
+BackupProtocolBackups::BackupProtocolBackups(const BackupProtocolBackups &rToCopy)
+{
+}
+BackupProtocolBackups::~BackupProtocolBackups()
+{
+}
+int BackupProtocolBackups::GetType() const
+{
+	return 48;
+}
+void BackupProtocolBackups::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolBackups::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolBackups::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "Backups(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolBackups::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "Backups(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolBackups::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolListDirectoryTree::BackupProtocolListDirectoryTree()
+	: mObjectID(0),
+	  mFlagsMustBeSet(0),
+	  mFlagsNotToBeSet(0),
+	  mSendAttributes(0),
+	  mSnapshotTime(0),
+	  mMaxDirectories(0)
+{
+}
+BackupProtocolListDirectoryTree::BackupProtocolListDirectoryTree(const BackupProtocolListDirectoryTree &rToCopy)
+	: mObjectID(rToCopy.mObjectID),
+	  mFlagsMustBeSet(rToCopy.mFlagsMustBeSet),
+	  mFlagsNotToBeSet(rToCopy.mFlagsNotToBeSet),
+	  mSendAttributes(rToCopy.mSendAttributes),
+	  mSnapshotTime(rToCopy.mSnapshotTime),
+	  mMaxDirectories(rToCopy.mMaxDirectories)
+{
+}
+BackupProtocolListDirectoryTree::~BackupProtocolListDirectoryTree()
+{
+}
+int BackupProtocolListDirectoryTree::GetType() const
+{
+	return 49;
+}
+void BackupProtocolListDirectoryTree::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mFlagsMustBeSet);
+	rProtocol.Read(mFlagsNotToBeSet);
+	rProtocol.Read(mSendAttributes);
+	rProtocol.ReadWithDefault(mSnapshotTime, 0);
+	rProtocol.Read(mMaxDirectories);
+}
+BackupProtocolListDirectoryTree::BackupProtocolListDirectoryTree(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime, int32_t MaxDirectories)
+	: mObjectID(ObjectID),
+	  mFlagsMustBeSet(FlagsMustBeSet),
+	  mFlagsNotToBeSet(FlagsNotToBeSet),
+	  mSendAttributes(SendAttributes),
+	  mSnapshotTime(SnapshotTime),
+	  mMaxDirectories(MaxDirectories)
+{
+}
+void BackupProtocolListDirectoryTree::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mFlagsMustBeSet);
+	rProtocol.Write(mFlagsNotToBeSet);
+	rProtocol.Write(mSendAttributes);
+	rProtocol.Write(mSnapshotTime);
+	rProtocol.Write(mMaxDirectories);
+}
+std::string BackupProtocolListDirectoryTree::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "ListDirectoryTree(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolListDirectoryTree::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "ListDirectoryTree(" << "OPAQUE" << "," << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolListDirectoryTree::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolAddBlockFingerprints::BackupProtocolAddBlockFingerprints()
+	: mObjectID(0)
+{
+}
+BackupProtocolAddBlockFingerprints::BackupProtocolAddBlockFingerprints(const BackupProtocolAddBlockFingerprints &rToCopy)
+	: mObjectID(rToCopy.mObjectID)
+{
+}
+BackupProtocolAddBlockFingerprints::~BackupProtocolAddBlockFingerprints()
+{
+}
+int BackupProtocolAddBlockFingerprints::GetType() const
+{
+	return 50;
+}
+void BackupProtocolAddBlockFingerprints::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mObjectID);
+}
+BackupProtocolAddBlockFingerprints::BackupProtocolAddBlockFingerprints(int64_t ObjectID)
+	: mObjectID(ObjectID)
+{
+}
+void BackupProtocolAddBlockFingerprints::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mObjectID);
+}
+std::string BackupProtocolAddBlockFingerprints::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "AddBlockFingerprints(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolAddBlockFingerprints::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "AddBlockFingerprints(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolAddBlockFingerprints::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolFindBlockFingerprints::BackupProtocolFindBlockFingerprints()
+{
+}
+BackupProtocolFindBlockFingerprints::BackupProtocolFindBlockFingerprints(const BackupProtocolFindBlockFingerprints &rToCopy)
+{
+}
+BackupProtocolFindBlockFingerprints::~BackupProtocolFindBlockFingerprints()
+{
+}
+int BackupProtocolFindBlockFingerprints::GetType() const
+{
+	return 51;
+}
+void BackupProtocolFindBlockFingerprints::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+}
+void BackupProtocolFindBlockFingerprints::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+}
+std::string BackupProtocolFindBlockFingerprints::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "FindBlockFingerprints(" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolFindBlockFingerprints::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "FindBlockFingerprints(" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolFindBlockFingerprints::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolStoreFiles::BackupProtocolStoreFiles()
+	: mDirectoryObjectID(0),
+	  mNumberOfFiles(0)
+{
+}
+BackupProtocolStoreFiles::BackupProtocolStoreFiles(const BackupProtocolStoreFiles &rToCopy)
+	: mDirectoryObjectID(rToCopy.mDirectoryObjectID),
+	  mNumberOfFiles(rToCopy.mNumberOfFiles)
+{
+}
+BackupProtocolStoreFiles::~BackupProtocolStoreFiles()
+{
+}
+int BackupProtocolStoreFiles::GetType() const
+{
+	return 52;
+}
+void BackupProtocolStoreFiles::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mDirectoryObjectID);
+	rProtocol.Read(mNumberOfFiles);
+}
+BackupProtocolStoreFiles::BackupProtocolStoreFiles(int64_t DirectoryObjectID, int32_t NumberOfFiles)
+	: mDirectoryObjectID(DirectoryObjectID),
+	  mNumberOfFiles(NumberOfFiles)
+{
+}
+void BackupProtocolStoreFiles::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mDirectoryObjectID);
+	rProtocol.Write(mNumberOfFiles);
+}
+std::string BackupProtocolStoreFiles::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "StoreFiles(" << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolStoreFiles::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "StoreFiles(" << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolStoreFiles::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolGetFileRange::BackupProtocolGetFileRange()
+	: mInDirectory(0),
+	  mObjectID(0),
+	  mOffset(0),
+	  mLength(0)
+{
+}
+BackupProtocolGetFileRange::BackupProtocolGetFileRange(const BackupProtocolGetFileRange &rToCopy)
+	: mInDirectory(rToCopy.mInDirectory),
+	  mObjectID(rToCopy.mObjectID),
+	  mOffset(rToCopy.mOffset),
+	  mLength(rToCopy.mLength)
+{
+}
+BackupProtocolGetFileRange::~BackupProtocolGetFileRange()
+{
+}
+int BackupProtocolGetFileRange::GetType() const
+{
+	return 53;
+}
+void BackupProtocolGetFileRange::SetPropertiesFromStreamData(Protocol &rProtocol)
+{
+	rProtocol.Read(mInDirectory);
+	rProtocol.Read(mObjectID);
+	rProtocol.Read(mOffset);
+	rProtocol.Read(mLength);
+}
+BackupProtocolGetFileRange::BackupProtocolGetFileRange(int64_t InDirectory, int64_t ObjectID, int64_t Offset, int64_t Length)
+	: mInDirectory(InDirectory),
+	  mObjectID(ObjectID),
+	  mOffset(Offset),
+	  mLength(Length)
+{
+}
+void BackupProtocolGetFileRange::WritePropertiesToStreamData(Protocol &rProtocol) const
+{
+	rProtocol.Write(mInDirectory);
+	rProtocol.Write(mObjectID);
+	rProtocol.Write(mOffset);
+	rProtocol.Write(mLength);
+}
+std::string BackupProtocolGetFileRange::ToString() const
+{
+	std::ostringstream oss;
+	try
+	{
+		oss << "GetFileRange(" << "OPAQUE" << "," << "OPAQUE" << ")";
+	}
+	catch(std::exception &e)
+	{
+		oss << "Failed to log command: " << e.what();
+	}
+	return oss.str();
+}
+void BackupProtocolGetFileRange::LogSysLog(const char *Action) const
+{
+	try
+	{
+		BOX_TRACE(Action << " " << "GetFileRange(" << "OPAQUE" << "," << "OPAQUE" << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_WARNING("Failed to log command: " << Action << ": " <<
+			e.what());
+	}
+}
+void BackupProtocolGetFileRange::LogFile(const char *Action, FILE *File) const
+{
+	::fprintf(File, "%s %s\n", Action, ToString().c_str());
+	::fflush(File);
+}
+BackupProtocolClientServer::BackupProtocolClientServer()
+: mLastErrorType(Protocol::NoError),
+  mLastErrorSubType(Protocol::NoError)
+{ }
+
+BackupProtocolClientServer::~BackupProtocolClientServer()
+{ }
+
+const char *BackupProtocol::GetProtocolIdentString()
+{
+	return "Box-Backup:v=C";
+}
+
+std::auto_ptr<Message> BackupProtocol::MakeMessage(int ObjType)
+{
+	switch(ObjType)
+	{
+	case 0:
+		return std::auto_ptr<Message>(new BackupProtocolError());
+		break;
+	case 1:
+		return std::auto_ptr<Message>(new BackupProtocolVersion());
+		break;
+	case 2:
+		return std::auto_ptr<Message>(new BackupProtocolLogin());
+		break;
+	case 3:
+		return std::auto_ptr<Message>(new BackupProtocolLoginConfirmed());
+		break;
+	case 4:
+		return std::auto_ptr<Message>(new BackupProtocolFinished());
+		break;
+	case 5:
+		return std::auto_ptr<Message>(new BackupProtocolSuccess());
+		break;
+	case 6:
+		return std::auto_ptr<Message>(new BackupProtocolSetClientStoreMarker());
+		break;
+	case 10:
+		return std::auto_ptr<Message>(new BackupProtocolGetObject());
+		break;
+	case 11:
+		return std::auto_ptr<Message>(new BackupProtocolMoveObject());
+		break;
+	case 12:
+		return std::auto_ptr<Message>(new BackupProtocolGetObjectName());
+		break;
+	case 13:
+		return std::auto_ptr<Message>(new BackupProtocolObjectName());
+		break;
+	case 14:
+		return std::auto_ptr<Message>(new BackupProtocolGetObjectInfos());
+		break;
+	case 15:
+		return std::auto_ptr<Message>(new BackupProtocolObjectInfos());
+		break;
+	case 16:
+		return std::auto_ptr<Message>(new BackupProtocolGetObjectName2());
+		break;
+	case 17:
+		return std::auto_ptr<Message>(new BackupProtocolObjectName2());
+		break;
+	case 20:
+		return std::auto_ptr<Message>(new BackupProtocolCreateDirectory());
+		break;
+	case 46:
+		return std::auto_ptr<Message>(new BackupProtocolCreateDirectory2());
+		break;
+	case 21:
+		return std::auto_ptr<Message>(new BackupProtocolListDirectory());
+		break;
+	case 22:
+		return std::auto_ptr<Message>(new BackupProtocolChangeDirAttributes());
+		break;
+	case 26:
+		return std::auto_ptr<Message>(new BackupProtocolChangeDirAttributes2());
+		break;
+	case 23:
+		return std::auto_ptr<Message>(new BackupProtocolDeleteDirectory());
+		break;
+	case 24:
+		return std::auto_ptr<Message>(new BackupProtocolUndeleteDirectory());
+		break;
+	case 25:
+		return std::auto_ptr<Message>(new BackupProtocolDeleteDirectoryASAP());
+		break;
+	case 30:
+		return std::auto_ptr<Message>(new BackupProtocolStoreFile());
+		break;
+	case 31:
+		return std::auto_ptr<Message>(new BackupProtocolGetFile());
+		break;
+	case 32:
+		return std::auto_ptr<Message>(new BackupProtocolSetReplacementFileAttributes());
+		break;
+	case 33:
+		return std::auto_ptr<Message>(new BackupProtocolDeleteFile());
+		break;
+	case 34:
+		return std::auto_ptr<Message>(new BackupProtocolGetBlockIndexByID());
+		break;
+	case 35:
+		return std::auto_ptr<Message>(new BackupProtocolGetBlockIndexByName());
+		break;
+	case 36:
+		return std::auto_ptr<Message>(new BackupProtocolUndeleteFile());
+		break;
+	case 37:
+		return std::auto_ptr<Message>(new BackupProtocolDeleteFileASAP());
+		break;
+	case 38:
+		return std::auto_ptr<Message>(new BackupProtocolStoreFileWithResume());
+		break;
+	case 40:
+		return std::auto_ptr<Message>(new BackupProtocolGetAccountUsage());
+		break;
+	case 41:
+		return std::auto_ptr<Message>(new BackupProtocolAccountUsage());
+		break;
+	case 42:
+		return std::auto_ptr<Message>(new BackupProtocolGetIsAlive());
+		break;
+	case 43:
+		return std::auto_ptr<Message>(new BackupProtocolIsAlive());
+		break;
+	case 44:
+		return std::auto_ptr<Message>(new BackupProtocolGetAccountUsage2());
+		break;
+	case 45:
+		return std::auto_ptr<Message>(new BackupProtocolAccountUsage2());
+		break;
+	case 47:
+		return std::auto_ptr<Message>(new BackupProtocolListBackups());
+		break;
+	case 48:
+		return std::auto_ptr<Message>(new BackupProtocolBackups());
+		break;
+	case 49:
+		return std::auto_ptr<Message>(new BackupProtocolListDirectoryTree());
+		break;
+	case 50:
+		return std::auto_ptr<Message>(new BackupProtocolAddBlockFingerprints());
+		break;
+	case 51:
+		return std::auto_ptr<Message>(new BackupProtocolFindBlockFingerprints());
+		break;
+	case 52:
+		return std::auto_ptr<Message>(new BackupProtocolStoreFiles());
+		break;
+	case 53:
+		return std::auto_ptr<Message>(new BackupProtocolGetFileRange());
+		break;
+	default:
+		THROW_EXCEPTION(ConnectionException, Protocol_UnknownCommandRecieved)
+	}
+}
+
+BackupProtocolReplyable::~BackupProtocolReplyable()
+{
+	// If there were any streams left over, there's no longer any way to
+	// access them, and we're responsible for them, so we'd better delete them.
+	DeleteStreamsToSend();
+}
+
+void BackupProtocolReplyable::SendStreamAfterCommand(std::auto_ptr<IOStream> apStream)
+{
+	ASSERT(apStream.get() != NULL);
+	mStreamsToSend.push_back(apStream.release());
+}
+
+void BackupProtocolReplyable::DeleteStreamsToSend()
+{
+	for(std::list<IOStream*>::iterator i(mStreamsToSend.begin()); i != mStreamsToSend.end(); ++i)
+	{
+		delete (*i);
+	}
+
+	mStreamsToSend.clear();
+}
+
+void BackupProtocolCallable::CheckReply(const std::string& requestCommandName,
+	const std::string& rCommandDescription,
+	const BackupProtocolMessage &rReply, int expectedType)
+{
+	if(rReply.GetType() == expectedType)
+	{
+		// Correct response, do nothing
+		SetLastError(Protocol::NoError, Protocol::NoError);
+	}
+	else
+	{
+		// Set protocol error
+		int type, subType;
+		
+		if(rReply.IsError(type, subType))
+		{
+			SetLastError(type, subType);
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_UnexpectedReply,
+				requestCommandName << " command failed: "
+				"received error " <<
+				((BackupProtocolError&)rReply).GetMessage());
+		}
+		else
+		{
+			SetLastError(Protocol::UnknownError, Protocol::UnknownError);
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_UnexpectedReply,
+				requestCommandName << " command failed: "
+				"received unexpected response type " <<
+				rReply.GetType());
+		}
+	}
+
+	// As a client, if we get an unexpected reply later, we'll want to know
+	// the last command that we executed, and the reply, to help debug the
+	// server.
+	mPreviousCommand = rCommandDescription;
+	mPreviousReply = rReply.ToString();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    Protocol::GetLastError(int &, int &)
+//		Purpose: Returns true if there was an error, and type and subtype if there was.
+//		Created: 2003/08/19
+//
+// --------------------------------------------------------------------------
+bool BackupProtocolClientServer::GetLastError(int &rTypeOut, int &rSubTypeOut)
+{
+	if(mLastErrorType == Protocol::NoError)
+	{
+		// no error.
+		return false;
+	}
+	
+	// Return type and subtype in args
+	rTypeOut = mLastErrorType;
+	rSubTypeOut = mLastErrorSubType;
+	
+	// and unset them
+	mLastErrorType = Protocol::NoError;
+	mLastErrorSubType = Protocol::NoError;
+	
+	return true;
+}
+
+BackupProtocolCallable::BackupProtocolCallable()
+: mNumRepliesToReceive(0),
+  mMaxCommandsInFlight(1)
+{ }
+
+BackupProtocolCallable::~BackupProtocolCallable()
+{
+	// Any replies which were never collected are our responsibility
+	for(std::list<AsyncCommand>::iterator i(mAsyncCommands.begin());
+		i != mAsyncCommands.end(); ++i)
+	{
+		delete i->mpReply;
+	}
+}
+
+void BackupProtocolCallable::CheckReply(const std::string& requestCommandName,
+	const BackupProtocolMessage &rCommand, const BackupProtocolMessage &rReply,
+	int expectedType)
+{
+	CheckReply(requestCommandName, rCommand.ToString(), rReply,
+		expectedType);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolCallable::SetMaxCommandsInFlight(int)
+//		Purpose: Sets how many commands sent by SendAsync() may be
+//			 waiting for their replies at once. 1 (the default)
+//			 waits for each reply before sending the next command.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupProtocolCallable::SetMaxCommandsInFlight(int MaxCommands)
+{
+	if(MaxCommands < 1)
+	{
+		MaxCommands = 1;
+	}
+	mMaxCommandsInFlight = MaxCommands;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolCallable::AddAsyncCommand(...)
+//		Purpose: Records a command sent by SendAsyncCommand(), and its
+//			 reply if that is already known, so that the reply can
+//			 be matched to it later.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupProtocolCallable::AddAsyncCommand(const BackupProtocolMessage &rCommand,
+	const char *pCommandName, int ReplyType,
+	std::auto_ptr<BackupProtocolMessage> apReply)
+{
+	AsyncCommand command;
+	command.mpCommandName = pCommandName;
+	command.mCommandDescription = rCommand.ToString();
+	command.mReplyType = ReplyType;
+	command.mpReply = NULL;
+	mAsyncCommands.push_back(command);
+
+	if(apReply.get() != NULL)
+	{
+		mAsyncCommands.back().mpReply = apReply.release();
+	}
+	else
+	{
+		++mNumRepliesToReceive;
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolCallable::ReceiveAsyncReplies(int)
+//		Purpose: Reads replies to commands sent by SendAsync(), in
+//			 order, until no more than MaxLeftInFlight are still
+//			 to be received. The replies are kept for CollectReply().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupProtocolCallable::ReceiveAsyncReplies(int MaxLeftInFlight)
+{
+	while(mNumRepliesToReceive > MaxLeftInFlight)
+	{
+		// Replies arrive in order, so the oldest command still
+		// waiting is this far from the end of the list.
+		std::list<AsyncCommand>::reverse_iterator i(mAsyncCommands.rbegin());
+		for(int n = 1; n < mNumRepliesToReceive; ++n)
+		{
+			++i;
+		}
+		ASSERT(i->mpReply == NULL);
+
+		i->mpReply = Receive().release();
+		--mNumRepliesToReceive;
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupProtocolCallable::CollectReply()
+//		Purpose: Returns the reply to the oldest command sent by
+//			 SendAsync() which hasn't been collected yet, waiting
+//			 for it if necessary. Throws an exception if the reply
+//			 is an error or of the wrong type, as Query() does.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupProtocolMessage> BackupProtocolCallable::CollectReply()
+{
+	if(mAsyncCommands.empty())
+	{
+		THROW_EXCEPTION_MESSAGE(ConnectionException,
+			Protocol_NoReplyToCollect, "No commands were sent "
+			"with SendAsync() whose replies are uncollected");
+	}
+
+	if(mAsyncCommands.front().mpReply == NULL)
+	{
+		ReceiveAsyncReplies(mNumRepliesToReceive - 1);
+	}
+
+	AsyncCommand command(mAsyncCommands.front());
+	mAsyncCommands.pop_front();
+	std::auto_ptr<BackupProtocolMessage> apReply(command.mpReply);
+
+	CheckReply(command.mpCommandName, command.mCommandDescription,
+		*apReply, command.mReplyType);
+	return apReply;
+}
+
+std::auto_ptr<IOStream> BackupProtocolClient::ReceiveStream()
+{
+	try
+	{
+		return BackupProtocol::ReceiveStream();
+	}
+	catch(ConnectionException &e)
+	{
+		if(e.GetSubType() == ConnectionException::Protocol_ObjWhenStreamExpected)
+		{
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_ObjWhenStreamExpected,
+				"Last exchange was " << mPreviousCommand <<
+				" => " << mPreviousReply);
+		}
+		else
+		{
+			throw;
+		}
+	}
+}
+BackupProtocolClient::BackupProtocolClient(std::auto_ptr<SocketStream> apConn)
+: BackupProtocol(apConn)
+{ }
+BackupProtocolClient::~BackupProtocolClient()
+{
+}
+std::auto_ptr<BackupProtocolMessage> BackupProtocolClient::Receive()
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+
+	try
+	{
+		apReply = std::auto_ptr<BackupProtocolMessage>(
+			static_cast<BackupProtocolMessage *>
+			(BackupProtocol::ReceiveInternal().release()));
+	}
+	catch(ConnectionException &e)
+	{
+		if(e.GetSubType() == ConnectionException::Protocol_StreamWhenObjExpected)
+		{
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_StreamWhenObjExpected,
+				"Last exchange was " << mPreviousCommand <<
+				" => " << mPreviousReply);
+		}
+		else
+		{
+			throw;
+		}
+	}
+
+	if(GetLogToSysLog())
+	{
+		apReply->LogSysLog("Receive");
+	}
+
+	if(GetLogToFile() != 0)
+	{
+		apReply->LogFile("Receive", GetLogToFile());
+	}
+
+	return apReply;
+}
+
+void BackupProtocolClient::Send(const BackupProtocolMessage &rObject)
+{
+	if(GetLogToSysLog())
+	{
+		rObject.LogSysLog("Send");
+	}
+
+	if(GetLogToFile() != 0)
+	{
+		rObject.LogFile("Send", GetLogToFile());
+	}
+
+	Protocol::SendInternal(rObject);
+}
+
+void BackupProtocolClient::SendAsyncCommand(const BackupProtocolMessage &rCommand,
+	IOStream *pStream, const char *pCommandName, int ReplyType)
+{
+	// Make room for this command in the pipeline
+	ReceiveAsyncReplies(GetMaxCommandsInFlight() - 1);
+
+	Send(rCommand);
+	if(pStream != NULL)
+	{
+		try
+		{
+			SendStream(*pStream);
+		}
+		catch (BoxException &e)
+		{
+			BOX_WARNING("Failed to send stream after command: " <<
+				rCommand.ToString() << ": " << e.what());
+			throw;
+		}
+	}
+
+	AddAsyncCommand(rCommand, pCommandName, ReplyType,
+		std::auto_ptr<BackupProtocolMessage>());
+}
+
+std::auto_ptr<BackupProtocolVersion> BackupProtocolClient::Query(const BackupProtocolVersion &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("Version", rQuery, *apReply, 1);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolVersion>(
+		static_cast<BackupProtocolVersion *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolLoginConfirmed> BackupProtocolClient::Query(const BackupProtocolLogin &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("Login", rQuery, *apReply, 3);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolLoginConfirmed>(
+		static_cast<BackupProtocolLoginConfirmed *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolFinished> BackupProtocolClient::Query(const BackupProtocolFinished &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("Finished", rQuery, *apReply, 4);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolFinished>(
+		static_cast<BackupProtocolFinished *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolSetClientStoreMarker &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("SetClientStoreMarker", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolGetObject &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetObject", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolMoveObject &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("MoveObject", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectName> BackupProtocolClient::Query(const BackupProtocolGetObjectName &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetObjectName", rQuery, *apReply, 13);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectName>(
+		static_cast<BackupProtocolObjectName *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectInfos> BackupProtocolClient::Query(const BackupProtocolGetObjectInfos &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetObjectInfos", rQuery, *apReply, 15);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectInfos>(
+		static_cast<BackupProtocolObjectInfos *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectName2> BackupProtocolClient::Query(const BackupProtocolGetObjectName2 &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetObjectName2", rQuery, *apReply, 17);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectName2>(
+		static_cast<BackupProtocolObjectName2 *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolCreateDirectory &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("CreateDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolCreateDirectory2 &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("CreateDirectory2", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolListDirectory &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("ListDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("ChangeDirAttributes", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("ChangeDirAttributes2", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolDeleteDirectory &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("DeleteDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolUndeleteDirectory &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("UndeleteDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolDeleteDirectoryASAP &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("DeleteDirectoryASAP", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolStoreFile &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("StoreFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolGetFile &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("SetReplacementFileAttributes", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolDeleteFile &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("DeleteFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolGetBlockIndexByID &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetBlockIndexByID", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolGetBlockIndexByName &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetBlockIndexByName", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolUndeleteFile &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("UndeleteFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolDeleteFileASAP &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("DeleteFileASAP", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolStoreFileWithResume &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("StoreFileWithResume", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolAccountUsage> BackupProtocolClient::Query(const BackupProtocolGetAccountUsage &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetAccountUsage", rQuery, *apReply, 41);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolAccountUsage>(
+		static_cast<BackupProtocolAccountUsage *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolIsAlive> BackupProtocolClient::Query(const BackupProtocolGetIsAlive &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetIsAlive", rQuery, *apReply, 43);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolIsAlive>(
+		static_cast<BackupProtocolIsAlive *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolAccountUsage2> BackupProtocolClient::Query(const BackupProtocolGetAccountUsage2 &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetAccountUsage2", rQuery, *apReply, 45);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolAccountUsage2>(
+		static_cast<BackupProtocolAccountUsage2 *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolBackups> BackupProtocolClient::Query(const BackupProtocolListBackups &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("ListBackups", rQuery, *apReply, 48);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolBackups>(
+		static_cast<BackupProtocolBackups *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolListDirectoryTree &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("ListDirectoryTree", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolAddBlockFingerprints &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("AddBlockFingerprints", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolFindBlockFingerprints &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("FindBlockFingerprints", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolStoreFiles &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+	// Send stream after the command
+	try
+	{
+		SendStream(*apDataStream);
+	}
+	catch (BoxException &e)
+	{
+		BOX_WARNING("Failed to send stream after command: " <<
+			rQuery.ToString() << ": " << e.what());
+		throw;
+	}
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("StoreFiles", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolClient::Query(const BackupProtocolGetFileRange &rQuery)
+{
+	// Replies to any pipelined commands come first
+	ReceiveAsyncReplies(0);
+
+	// Send query
+	Send(rQuery);
+
+	
+	// Wait for the reply
+	std::auto_ptr<BackupProtocolMessage> apReply = Receive();
+	CheckReply("GetFileRange", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<IOStream> BackupProtocolServer::ReceiveStream()
+{
+	try
+	{
+		return BackupProtocol::ReceiveStream();
+	}
+	catch(ConnectionException &e)
+	{
+		if(e.GetSubType() == ConnectionException::Protocol_ObjWhenStreamExpected)
+		{
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_ObjWhenStreamExpected,
+				"Last exchange was " << mPreviousCommand <<
+				" => " << mPreviousReply);
+		}
+		else
+		{
+			throw;
+		}
+	}
+}
+BackupProtocolServer::BackupProtocolServer(std::auto_ptr<SocketStream> apConn)
+: BackupProtocol(apConn)
+{ }
+BackupProtocolServer::~BackupProtocolServer()
+{
+	DeleteStreamsToSend();
+}
+std::auto_ptr<BackupProtocolMessage> BackupProtocolServer::Receive()
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+
+	try
+	{
+		apReply = std::auto_ptr<BackupProtocolMessage>(
+			static_cast<BackupProtocolMessage *>
+			(BackupProtocol::ReceiveInternal().release()));
+	}
+	catch(ConnectionException &e)
+	{
+		if(e.GetSubType() == ConnectionException::Protocol_StreamWhenObjExpected)
+		{
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_StreamWhenObjExpected,
+				"Last exchange was " << mPreviousCommand <<
+				" => " << mPreviousReply);
+		}
+		else
+		{
+			throw;
+		}
+	}
+
+	if(GetLogToSysLog())
+	{
+		apReply->LogSysLog("Receive");
+	}
+
+	if(GetLogToFile() != 0)
+	{
+		apReply->LogFile("Receive", GetLogToFile());
+	}
+
+	return apReply;
+}
+
+void BackupProtocolServer::Send(const BackupProtocolMessage &rObject)
+{
+	if(GetLogToSysLog())
+	{
+		rObject.LogSysLog("Send");
+	}
+
+	if(GetLogToFile() != 0)
+	{
+		rObject.LogFile("Send", GetLogToFile());
+	}
+
+	Protocol::SendInternal(rObject);
+}
+
+void BackupProtocolServer::DoServer(BackupStoreContext &rContext)
+{
+	// Handshake with client
+	Handshake();
+
+	// Command processing loop
+	bool inProgress = true;
+	while(inProgress)
+	{
+		// Get an object from the conversation
+		std::auto_ptr<BackupProtocolMessage> pobj = Receive();
+		std::auto_ptr<BackupProtocolMessage> preply;
+
+		// Run the command
+		try
+		{
+			try
+			{
+				if(pobj->HasStreamWithCommand())
+				{
+					std::auto_ptr<IOStream> apDataStream = ReceiveStream();
+					SelfFlushingStream autoflush(*apDataStream);
+					preply = pobj->DoCommand(*this, rContext, *apDataStream);
+				}
+				else
+				{
+					preply = pobj->DoCommand(*this, rContext);
+				}
+			}
+			catch(BoxException &e)
+			{
+				// First try a the built-in exception handler
+				preply = HandleException(e);
+			}
+		}
+		catch (...)
+		{
+			// Fallback in case the exception isn't a BoxException
+			// or the exception handler fails as well. This path
+			// throws the exception upwards, killing the process
+			// that handles the current client.
+			Send(BackupProtocolError(-1));
+			throw;
+		}
+
+		// Send the reply
+		Send(*preply);
+
+		// Send any streams
+		for(std::list<IOStream*>::iterator
+			i =  mStreamsToSend.begin();
+			i != mStreamsToSend.end(); ++i)
+		{
+			SendStream(**i);
+		}
+
+		// As a server, if we get an unexpected message later, we'll
+		// want to know the last command that we received, and the
+		// reply, to help debug our response to it.
+		mPreviousCommand = pobj->ToString();
+		std::ostringstream reply;
+		reply << preply->ToString() << " and " <<
+			mStreamsToSend.size() << " streams";
+		mPreviousReply = reply.str();
+
+		// Delete these streams
+		DeleteStreamsToSend();
+
+		// Does this end the conversation?
+		if(pobj->IsConversationEnd())
+		{
+			inProgress = false;
+		}
+	}
+}
+
+BackupProtocolLocal::BackupProtocolLocal(BackupStoreContext &rContext)
+: mrContext(rContext)
+{ }
+BackupProtocolLocal::~BackupProtocolLocal()
+{
+}
+std::auto_ptr<BackupProtocolMessage> BackupProtocolLocal::Receive()
+{
+	return mapLastReply;
+}
+void BackupProtocolLocal::Send(const BackupProtocolMessage &rObject)
+{
+	mapLastReply = rObject.DoCommand(*this, mrContext);
+}
+void BackupProtocolLocal::SendAsyncCommand(const BackupProtocolMessage &rCommand,
+	IOStream *pStream, const char *pCommandName, int ReplyType)
+{
+	// Nothing to wait for locally, so run the command now
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		if(pStream != NULL)
+		{
+			apReply = rCommand.DoCommand(*this, mrContext, *pStream);
+		}
+		else
+		{
+			apReply = rCommand.DoCommand(*this, mrContext);
+		}
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	AddAsyncCommand(rCommand, pCommandName, ReplyType, apReply);
+}
+std::auto_ptr<BackupProtocolVersion> BackupProtocolLocal::Query(const BackupProtocolVersion &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("Version", rQuery, *apReply, 1);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolVersion>(
+		static_cast<BackupProtocolVersion *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolLoginConfirmed> BackupProtocolLocal::Query(const BackupProtocolLogin &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("Login", rQuery, *apReply, 3);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolLoginConfirmed>(
+		static_cast<BackupProtocolLoginConfirmed *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolFinished> BackupProtocolLocal::Query(const BackupProtocolFinished &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("Finished", rQuery, *apReply, 4);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolFinished>(
+		static_cast<BackupProtocolFinished *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolSetClientStoreMarker &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("SetClientStoreMarker", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolGetObject &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetObject", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolMoveObject &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("MoveObject", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectName> BackupProtocolLocal::Query(const BackupProtocolGetObjectName &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetObjectName", rQuery, *apReply, 13);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectName>(
+		static_cast<BackupProtocolObjectName *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectInfos> BackupProtocolLocal::Query(const BackupProtocolGetObjectInfos &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetObjectInfos", rQuery, *apReply, 15);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectInfos>(
+		static_cast<BackupProtocolObjectInfos *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolObjectName2> BackupProtocolLocal::Query(const BackupProtocolGetObjectName2 &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetObjectName2", rQuery, *apReply, 17);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolObjectName2>(
+		static_cast<BackupProtocolObjectName2 *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolCreateDirectory &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("CreateDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolCreateDirectory2 &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("CreateDirectory2", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolListDirectory &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("ListDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("ChangeDirAttributes", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("ChangeDirAttributes2", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolDeleteDirectory &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("DeleteDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolUndeleteDirectory &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("UndeleteDirectory", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolDeleteDirectoryASAP &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("DeleteDirectoryASAP", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolStoreFile &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("StoreFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolGetFile &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("SetReplacementFileAttributes", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolDeleteFile &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("DeleteFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolGetBlockIndexByID &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetBlockIndexByID", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolGetBlockIndexByName &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetBlockIndexByName", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolUndeleteFile &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("UndeleteFile", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolDeleteFileASAP &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("DeleteFileASAP", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolStoreFileWithResume &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("StoreFileWithResume", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolAccountUsage> BackupProtocolLocal::Query(const BackupProtocolGetAccountUsage &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetAccountUsage", rQuery, *apReply, 41);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolAccountUsage>(
+		static_cast<BackupProtocolAccountUsage *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolIsAlive> BackupProtocolLocal::Query(const BackupProtocolGetIsAlive &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetIsAlive", rQuery, *apReply, 43);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolIsAlive>(
+		static_cast<BackupProtocolIsAlive *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolAccountUsage2> BackupProtocolLocal::Query(const BackupProtocolGetAccountUsage2 &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetAccountUsage2", rQuery, *apReply, 45);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolAccountUsage2>(
+		static_cast<BackupProtocolAccountUsage2 *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolBackups> BackupProtocolLocal::Query(const BackupProtocolListBackups &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("ListBackups", rQuery, *apReply, 48);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolBackups>(
+		static_cast<BackupProtocolBackups *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolListDirectoryTree &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("ListDirectoryTree", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolAddBlockFingerprints &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("AddBlockFingerprints", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolFindBlockFingerprints &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("FindBlockFingerprints", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolStoreFiles &rQuery, std::auto_ptr<IOStream> apDataStream)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext, *apDataStream);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("StoreFiles", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
+std::auto_ptr<BackupProtocolSuccess> BackupProtocolLocal::Query(const BackupProtocolGetFileRange &rQuery)
+{
+	std::auto_ptr<BackupProtocolMessage> apReply;
+	try
+	{
+		apReply = rQuery.DoCommand(*this, mrContext);
+	}
+	catch(BoxException &e)
+	{
+		// First try a the built-in exception handler
+		apReply = HandleException(e);
+	}
+	CheckReply("GetFileRange", rQuery, *apReply, 5);
+
+	// Correct response, if no exception thrown by CheckReply
+	return std::auto_ptr<BackupProtocolSuccess>(
+		static_cast<BackupProtocolSuccess *>(apReply.release()));
+}
@@ -0,0 +1,2287 @@
+// Auto-generated file -- do not edit
+
+#ifndef AUTOGEN_BACKUPPROTOCOL_H
+#define AUTOGEN_BACKUPPROTOCOL_H
+
+#include <cstdio>
+#include <list>
+
+#ifndef WIN32
+#include <syslog.h>
+#endif
+
+#include "autogen_ConnectionException.h"
+#include "Protocol.h"
+#include "Message.h"
+#include "SocketStream.h"
+
+#include "BackupStoreFilenameClear.h"
+
+// need utils file for the server
+#include "Utils.h"
+
+class BackupStoreContext;
+
+class BackupProtocol;
+class BackupProtocolClientServer;
+class BackupProtocolCallable;
+class BackupProtocolReplyable;
+
+class BackupProtocolMessage : public Message
+{
+public:
+	virtual std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const;
+	virtual std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const;
+	virtual bool HasStreamWithCommand() const = 0;
+};
+
+class BackupProtocolReply
+{
+};
+
+class BackupProtocolRequest
+{
+};
+
+class BackupProtocolSendReceive {
+public:
+	virtual void Send(const BackupProtocolMessage &rObject) = 0;
+	virtual std::auto_ptr<BackupProtocolMessage> Receive() = 0;
+};
+
+class BackupProtocol : public Protocol
+{
+public:
+	BackupProtocol(std::auto_ptr<SocketStream> apConn)
+	: Protocol(apConn)
+	{ }
+	virtual ~BackupProtocol() { }
+	virtual std::auto_ptr<Message> MakeMessage(int ObjType);
+	virtual const char *GetProtocolIdentString();
+
+private:
+	BackupProtocol(const BackupProtocol &rToCopy);
+};
+
+class BackupProtocolError : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolError();
+	BackupProtocolError(const BackupProtocolError &rToCopy);
+	~BackupProtocolError();
+	int GetType() const;
+	enum
+	{
+		TypeID = 0
+	};
+	enum
+	{
+		ErrorType = 1000,
+		Err_WrongVersion = 1,
+		Err_NotInRightProtocolPhase = 2,
+		Err_BadLogin = 3,
+		Err_CannotLockStoreForWriting = 4,
+		Err_SessionReadOnly = 5,
+		Err_FileDoesNotVerify = 6,
+		Err_DoesNotExist = 7,
+		Err_DirectoryAlreadyExists = 8,
+		Err_CannotDeleteRoot = 9,
+		Err_TargetNameExists = 10,
+		Err_StorageLimitExceeded = 11,
+		Err_DiffFromFileDoesNotExist = 12,
+		Err_DoesNotExistInDirectory = 13,
+		Err_PatchConsistencyError = 14,
+		Err_MultiplyReferencedObject = 15,
+		Err_DisabledAccount = 16,
+		Err_CannotResumeUpload = 17
+	};
+	BackupProtocolError(int SubType) : mType(), mSubType(SubType) { }
+	bool IsError(int &rTypeOut, int &rSubTypeOut) const;
+	std::string GetMessage() const { return GetMessage(mSubType); };
+	static std::string GetMessage(int subtype);
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int32_t GetType() {return mType;}
+	int32_t GetSubType() {return mSubType;}
+	BackupProtocolError(int32_t Type, int32_t SubType);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetType(int32_t Type) {mType = Type;}
+	void SetSubType(int32_t SubType) {mSubType = SubType;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int32_t mType;
+	int32_t mSubType;
+};
+
+class BackupProtocolVersion : public BackupProtocolMessage, public BackupProtocolRequest, public BackupProtocolReply
+{
+public:
+	BackupProtocolVersion();
+	BackupProtocolVersion(const BackupProtocolVersion &rToCopy);
+	~BackupProtocolVersion();
+	int GetType() const;
+	enum
+	{
+		TypeID = 1
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int32_t GetVersion() {return mVersion;}
+	BackupProtocolVersion(int32_t Version);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetVersion(int32_t Version) {mVersion = Version;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int32_t mVersion;
+};
+
+class BackupProtocolLogin : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolLogin();
+	BackupProtocolLogin(const BackupProtocolLogin &rToCopy);
+	~BackupProtocolLogin();
+	int GetType() const;
+	enum
+	{
+		TypeID = 2
+	};
+	enum
+	{
+		Flags_ReadOnly = 1
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int32_t GetClientID() {return mClientID;}
+	int32_t GetFlags() {return mFlags;}
+	int32_t GetVersion() {return mVersion;}
+	BackupProtocolLogin(int32_t ClientID, int32_t Flags, int32_t Version);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetClientID(int32_t ClientID) {mClientID = ClientID;}
+	void SetFlags(int32_t Flags) {mFlags = Flags;}
+	void SetVersion(int32_t Version) {mVersion = Version;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int32_t mClientID;
+	int32_t mFlags;
+	int32_t mVersion;
+};
+
+class BackupProtocolLoginConfirmed : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolLoginConfirmed();
+	BackupProtocolLoginConfirmed(const BackupProtocolLoginConfirmed &rToCopy);
+	~BackupProtocolLoginConfirmed();
+	int GetType() const;
+	enum
+	{
+		TypeID = 3
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetClientStoreMarker() {return mClientStoreMarker;}
+	int64_t GetBlocksUsed() {return mBlocksUsed;}
+	int64_t GetBlocksSoftLimit() {return mBlocksSoftLimit;}
+	int64_t GetBlocksHardLimit() {return mBlocksHardLimit;}
+	BackupProtocolLoginConfirmed(int64_t ClientStoreMarker, int64_t BlocksUsed, int64_t BlocksSoftLimit, int64_t BlocksHardLimit);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetClientStoreMarker(int64_t ClientStoreMarker) {mClientStoreMarker = ClientStoreMarker;}
+	void SetBlocksUsed(int64_t BlocksUsed) {mBlocksUsed = BlocksUsed;}
+	void SetBlocksSoftLimit(int64_t BlocksSoftLimit) {mBlocksSoftLimit = BlocksSoftLimit;}
+	void SetBlocksHardLimit(int64_t BlocksHardLimit) {mBlocksHardLimit = BlocksHardLimit;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mClientStoreMarker;
+	int64_t mBlocksUsed;
+	int64_t mBlocksSoftLimit;
+	int64_t mBlocksHardLimit;
+};
+
+class BackupProtocolFinished : public BackupProtocolMessage, public BackupProtocolRequest, public BackupProtocolReply
+{
+public:
+	BackupProtocolFinished();
+	BackupProtocolFinished(const BackupProtocolFinished &rToCopy);
+	~BackupProtocolFinished();
+	int GetType() const;
+	enum
+	{
+		TypeID = 4
+	};
+	bool IsConversationEnd() const;
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolSuccess : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolSuccess();
+	BackupProtocolSuccess(const BackupProtocolSuccess &rToCopy);
+	~BackupProtocolSuccess();
+	int GetType() const;
+	enum
+	{
+		TypeID = 5
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolSuccess(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolSetClientStoreMarker : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolSetClientStoreMarker();
+	BackupProtocolSetClientStoreMarker(const BackupProtocolSetClientStoreMarker &rToCopy);
+	~BackupProtocolSetClientStoreMarker();
+	int GetType() const;
+	enum
+	{
+		TypeID = 6
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetClientStoreMarker() {return mClientStoreMarker;}
+	BackupProtocolSetClientStoreMarker(int64_t ClientStoreMarker);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetClientStoreMarker(int64_t ClientStoreMarker) {mClientStoreMarker = ClientStoreMarker;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mClientStoreMarker;
+};
+
+class BackupProtocolGetObject : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetObject();
+	BackupProtocolGetObject(const BackupProtocolGetObject &rToCopy);
+	~BackupProtocolGetObject();
+	int GetType() const;
+	enum
+	{
+		TypeID = 10
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolGetObject(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolMoveObject : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolMoveObject();
+	BackupProtocolMoveObject(const BackupProtocolMoveObject &rToCopy);
+	~BackupProtocolMoveObject();
+	int GetType() const;
+	enum
+	{
+		TypeID = 11
+	};
+	enum
+	{
+		Flags_MoveAllWithSameName = 1,
+		Flags_AllowMoveOverDeletedObject = 2
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetMoveFromDirectory() {return mMoveFromDirectory;}
+	int64_t GetMoveToDirectory() {return mMoveToDirectory;}
+	int32_t GetFlags() {return mFlags;}
+	const BackupStoreFilenameClear& GetNewFilename() {return mNewFilename;}
+	BackupProtocolMoveObject(int64_t ObjectID, int64_t MoveFromDirectory, int64_t MoveToDirectory, int32_t Flags, const BackupStoreFilenameClear& NewFilename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetMoveFromDirectory(int64_t MoveFromDirectory) {mMoveFromDirectory = MoveFromDirectory;}
+	void SetMoveToDirectory(int64_t MoveToDirectory) {mMoveToDirectory = MoveToDirectory;}
+	void SetFlags(int32_t Flags) {mFlags = Flags;}
+	void SetNewFilename(const BackupStoreFilenameClear& NewFilename) {mNewFilename = NewFilename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int64_t mMoveFromDirectory;
+	int64_t mMoveToDirectory;
+	int32_t mFlags;
+	BackupStoreFilenameClear mNewFilename;
+};
+
+class BackupProtocolGetObjectName : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetObjectName();
+	BackupProtocolGetObjectName(const BackupProtocolGetObjectName &rToCopy);
+	~BackupProtocolGetObjectName();
+	int GetType() const;
+	enum
+	{
+		TypeID = 12
+	};
+	enum
+	{
+		ObjectID_DirectoryOnly = 0
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetContainingDirectoryID() {return mContainingDirectoryID;}
+	BackupProtocolGetObjectName(int64_t ObjectID, int64_t ContainingDirectoryID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetContainingDirectoryID(int64_t ContainingDirectoryID) {mContainingDirectoryID = ContainingDirectoryID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int64_t mContainingDirectoryID;
+};
+
+class BackupProtocolObjectName : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolObjectName();
+	BackupProtocolObjectName(const BackupProtocolObjectName &rToCopy);
+	~BackupProtocolObjectName();
+	int GetType() const;
+	enum
+	{
+		TypeID = 13
+	};
+	enum
+	{
+		NumNameElements_ObjectDoesntExist = 0
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int32_t GetNumNameElements() {return mNumNameElements;}
+	int64_t GetModificationTime() {return mModificationTime;}
+	int64_t GetAttributesHash() {return mAttributesHash;}
+	int16_t GetFlags() {return mFlags;}
+	BackupProtocolObjectName(int32_t NumNameElements, int64_t ModificationTime, int64_t AttributesHash, int16_t Flags);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetNumNameElements(int32_t NumNameElements) {mNumNameElements = NumNameElements;}
+	void SetModificationTime(int64_t ModificationTime) {mModificationTime = ModificationTime;}
+	void SetAttributesHash(int64_t AttributesHash) {mAttributesHash = AttributesHash;}
+	void SetFlags(int16_t Flags) {mFlags = Flags;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int32_t mNumNameElements;
+	int64_t mModificationTime;
+	int64_t mAttributesHash;
+	int16_t mFlags;
+};
+
+class BackupProtocolGetObjectInfos : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetObjectInfos();
+	BackupProtocolGetObjectInfos(const BackupProtocolGetObjectInfos &rToCopy);
+	~BackupProtocolGetObjectInfos();
+	int GetType() const;
+	enum
+	{
+		TypeID = 14
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolGetObjectInfos(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolObjectInfos : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolObjectInfos();
+	BackupProtocolObjectInfos(const BackupProtocolObjectInfos &rToCopy);
+	~BackupProtocolObjectInfos();
+	int GetType() const;
+	enum
+	{
+		TypeID = 15
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	bool GetIsDir() {return mIsDir;}
+	int64_t GetContainerID() {return mContainerID;}
+	BackupProtocolObjectInfos(bool IsDir, int64_t ContainerID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetIsDir(bool IsDir) {mIsDir = IsDir;}
+	void SetContainerID(int64_t ContainerID) {mContainerID = ContainerID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	bool mIsDir;
+	int64_t mContainerID;
+};
+
+class BackupProtocolGetObjectName2 : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetObjectName2();
+	BackupProtocolGetObjectName2(const BackupProtocolGetObjectName2 &rToCopy);
+	~BackupProtocolGetObjectName2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 16
+	};
+	enum
+	{
+		ObjectID_DirectoryOnly = 0
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetContainingDirectoryID() {return mContainingDirectoryID;}
+	BackupProtocolGetObjectName2(int64_t ObjectID, int64_t ContainingDirectoryID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetContainingDirectoryID(int64_t ContainingDirectoryID) {mContainingDirectoryID = ContainingDirectoryID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int64_t mContainingDirectoryID;
+};
+
+class BackupProtocolObjectName2 : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolObjectName2();
+	BackupProtocolObjectName2(const BackupProtocolObjectName2 &rToCopy);
+	~BackupProtocolObjectName2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 17
+	};
+	enum
+	{
+		NumNameElements_ObjectDoesntExist = 0
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int32_t GetNumNameElements() {return mNumNameElements;}
+	int64_t GetModificationTime() {return mModificationTime;}
+	int64_t GetAttributesHash() {return mAttributesHash;}
+	int64_t GetBackupTime() {return mBackupTime;}
+	int64_t GetDeleteTime() {return mDeleteTime;}
+	int16_t GetFlags() {return mFlags;}
+	BackupProtocolObjectName2(int32_t NumNameElements, int64_t ModificationTime, int64_t AttributesHash, int64_t BackupTime, int64_t DeleteTime, int16_t Flags);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetNumNameElements(int32_t NumNameElements) {mNumNameElements = NumNameElements;}
+	void SetModificationTime(int64_t ModificationTime) {mModificationTime = ModificationTime;}
+	void SetAttributesHash(int64_t AttributesHash) {mAttributesHash = AttributesHash;}
+	void SetBackupTime(int64_t BackupTime) {mBackupTime = BackupTime;}
+	void SetDeleteTime(int64_t DeleteTime) {mDeleteTime = DeleteTime;}
+	void SetFlags(int16_t Flags) {mFlags = Flags;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int32_t mNumNameElements;
+	int64_t mModificationTime;
+	int64_t mAttributesHash;
+	int64_t mBackupTime;
+	int64_t mDeleteTime;
+	int16_t mFlags;
+};
+
+class BackupProtocolCreateDirectory : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolCreateDirectory();
+	BackupProtocolCreateDirectory(const BackupProtocolCreateDirectory &rToCopy);
+	~BackupProtocolCreateDirectory();
+	int GetType() const;
+	enum
+	{
+		TypeID = 20
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetContainingDirectoryID() {return mContainingDirectoryID;}
+	int64_t GetAttributesModTime() {return mAttributesModTime;}
+	const BackupStoreFilenameClear& GetDirectoryName() {return mDirectoryName;}
+	BackupProtocolCreateDirectory(int64_t ContainingDirectoryID, int64_t AttributesModTime, const BackupStoreFilenameClear& DirectoryName);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetContainingDirectoryID(int64_t ContainingDirectoryID) {mContainingDirectoryID = ContainingDirectoryID;}
+	void SetAttributesModTime(int64_t AttributesModTime) {mAttributesModTime = AttributesModTime;}
+	void SetDirectoryName(const BackupStoreFilenameClear& DirectoryName) {mDirectoryName = DirectoryName;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mContainingDirectoryID;
+	int64_t mAttributesModTime;
+	BackupStoreFilenameClear mDirectoryName;
+};
+
+class BackupProtocolCreateDirectory2 : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolCreateDirectory2();
+	BackupProtocolCreateDirectory2(const BackupProtocolCreateDirectory2 &rToCopy);
+	~BackupProtocolCreateDirectory2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 46
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetContainingDirectoryID() {return mContainingDirectoryID;}
+	int64_t GetAttributesModTime() {return mAttributesModTime;}
+	int64_t GetModificationTime() {return mModificationTime;}
+	const BackupStoreFilenameClear& GetDirectoryName() {return mDirectoryName;}
+	BackupProtocolCreateDirectory2(int64_t ContainingDirectoryID, int64_t AttributesModTime, int64_t ModificationTime, const BackupStoreFilenameClear& DirectoryName);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetContainingDirectoryID(int64_t ContainingDirectoryID) {mContainingDirectoryID = ContainingDirectoryID;}
+	void SetAttributesModTime(int64_t AttributesModTime) {mAttributesModTime = AttributesModTime;}
+	void SetModificationTime(int64_t ModificationTime) {mModificationTime = ModificationTime;}
+	void SetDirectoryName(const BackupStoreFilenameClear& DirectoryName) {mDirectoryName = DirectoryName;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mContainingDirectoryID;
+	int64_t mAttributesModTime;
+	int64_t mModificationTime;
+	BackupStoreFilenameClear mDirectoryName;
+};
+
+class BackupProtocolListDirectory : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolListDirectory();
+	BackupProtocolListDirectory(const BackupProtocolListDirectory &rToCopy);
+	~BackupProtocolListDirectory();
+	int GetType() const;
+	enum
+	{
+		TypeID = 21
+	};
+	enum
+	{
+		Flags_INCLUDE_EVERYTHING = -1,
+		Flags_EXCLUDE_NOTHING = 0,
+		Flags_EXCLUDE_EVERYTHING = 15,
+		Flags_File = 1,
+		Flags_Dir = 2,
+		Flags_Deleted = 4,
+		Flags_RemoveASAP = 16,
+		Flags_OldVersion = 8,
+		Flags_PatchFromOlder = 32,
+		RootDirectory = 1
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int16_t GetFlagsMustBeSet() {return mFlagsMustBeSet;}
+	int16_t GetFlagsNotToBeSet() {return mFlagsNotToBeSet;}
+	bool GetSendAttributes() {return mSendAttributes;}
+	int64_t GetSnapshotTime() {return mSnapshotTime;}
+	BackupProtocolListDirectory(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetFlagsMustBeSet(int16_t FlagsMustBeSet) {mFlagsMustBeSet = FlagsMustBeSet;}
+	void SetFlagsNotToBeSet(int16_t FlagsNotToBeSet) {mFlagsNotToBeSet = FlagsNotToBeSet;}
+	void SetSendAttributes(bool SendAttributes) {mSendAttributes = SendAttributes;}
+	void SetSnapshotTime(int64_t SnapshotTime) {mSnapshotTime = SnapshotTime;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int16_t mFlagsMustBeSet;
+	int16_t mFlagsNotToBeSet;
+	bool mSendAttributes;
+	int64_t mSnapshotTime;
+};
+
+class BackupProtocolChangeDirAttributes : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolChangeDirAttributes();
+	BackupProtocolChangeDirAttributes(const BackupProtocolChangeDirAttributes &rToCopy);
+	~BackupProtocolChangeDirAttributes();
+	int GetType() const;
+	enum
+	{
+		TypeID = 22
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetAttributesModTime() {return mAttributesModTime;}
+	BackupProtocolChangeDirAttributes(int64_t ObjectID, int64_t AttributesModTime);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetAttributesModTime(int64_t AttributesModTime) {mAttributesModTime = AttributesModTime;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int64_t mAttributesModTime;
+};
+
+class BackupProtocolChangeDirAttributes2 : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolChangeDirAttributes2();
+	BackupProtocolChangeDirAttributes2(const BackupProtocolChangeDirAttributes2 &rToCopy);
+	~BackupProtocolChangeDirAttributes2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 26
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetAttributesModTime() {return mAttributesModTime;}
+	int64_t GetModTime() {return mModTime;}
+	BackupProtocolChangeDirAttributes2(int64_t ObjectID, int64_t AttributesModTime, int64_t ModTime);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetAttributesModTime(int64_t AttributesModTime) {mAttributesModTime = AttributesModTime;}
+	void SetModTime(int64_t ModTime) {mModTime = ModTime;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int64_t mAttributesModTime;
+	int64_t mModTime;
+};
+
+class BackupProtocolDeleteDirectory : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolDeleteDirectory();
+	BackupProtocolDeleteDirectory(const BackupProtocolDeleteDirectory &rToCopy);
+	~BackupProtocolDeleteDirectory();
+	int GetType() const;
+	enum
+	{
+		TypeID = 23
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int16_t GetFlags() {return mFlags;}
+	bool GetDeleteFromStore() {return mDeleteFromStore;}
+	BackupProtocolDeleteDirectory(int64_t ObjectID, int16_t Flags, bool DeleteFromStore);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetFlags(int16_t Flags) {mFlags = Flags;}
+	void SetDeleteFromStore(bool DeleteFromStore) {mDeleteFromStore = DeleteFromStore;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int16_t mFlags;
+	bool mDeleteFromStore;
+};
+
+class BackupProtocolUndeleteDirectory : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolUndeleteDirectory();
+	BackupProtocolUndeleteDirectory(const BackupProtocolUndeleteDirectory &rToCopy);
+	~BackupProtocolUndeleteDirectory();
+	int GetType() const;
+	enum
+	{
+		TypeID = 24
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolUndeleteDirectory(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolDeleteDirectoryASAP : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolDeleteDirectoryASAP();
+	BackupProtocolDeleteDirectoryASAP(const BackupProtocolDeleteDirectoryASAP &rToCopy);
+	~BackupProtocolDeleteDirectoryASAP();
+	int GetType() const;
+	enum
+	{
+		TypeID = 25
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolDeleteDirectoryASAP(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolStoreFile : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolStoreFile();
+	BackupProtocolStoreFile(const BackupProtocolStoreFile &rToCopy);
+	~BackupProtocolStoreFile();
+	int GetType() const;
+	enum
+	{
+		TypeID = 30
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetDirectoryObjectID() {return mDirectoryObjectID;}
+	int64_t GetModificationTime() {return mModificationTime;}
+	int64_t GetAttributesHash() {return mAttributesHash;}
+	int64_t GetDiffFromFileID() {return mDiffFromFileID;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	BackupProtocolStoreFile(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, const BackupStoreFilenameClear& Filename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetDirectoryObjectID(int64_t DirectoryObjectID) {mDirectoryObjectID = DirectoryObjectID;}
+	void SetModificationTime(int64_t ModificationTime) {mModificationTime = ModificationTime;}
+	void SetAttributesHash(int64_t AttributesHash) {mAttributesHash = AttributesHash;}
+	void SetDiffFromFileID(int64_t DiffFromFileID) {mDiffFromFileID = DiffFromFileID;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mDirectoryObjectID;
+	int64_t mModificationTime;
+	int64_t mAttributesHash;
+	int64_t mDiffFromFileID;
+	BackupStoreFilenameClear mFilename;
+};
+
+class BackupProtocolGetFile : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetFile();
+	BackupProtocolGetFile(const BackupProtocolGetFile &rToCopy);
+	~BackupProtocolGetFile();
+	int GetType() const;
+	enum
+	{
+		TypeID = 31
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolGetFile(int64_t InDirectory, int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	int64_t mObjectID;
+};
+
+class BackupProtocolSetReplacementFileAttributes : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolSetReplacementFileAttributes();
+	BackupProtocolSetReplacementFileAttributes(const BackupProtocolSetReplacementFileAttributes &rToCopy);
+	~BackupProtocolSetReplacementFileAttributes();
+	int GetType() const;
+	enum
+	{
+		TypeID = 32
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	int64_t GetAttributesHash() {return mAttributesHash;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	BackupProtocolSetReplacementFileAttributes(int64_t InDirectory, int64_t AttributesHash, const BackupStoreFilenameClear& Filename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetAttributesHash(int64_t AttributesHash) {mAttributesHash = AttributesHash;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	int64_t mAttributesHash;
+	BackupStoreFilenameClear mFilename;
+};
+
+class BackupProtocolDeleteFile : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolDeleteFile();
+	BackupProtocolDeleteFile(const BackupProtocolDeleteFile &rToCopy);
+	~BackupProtocolDeleteFile();
+	int GetType() const;
+	enum
+	{
+		TypeID = 33
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	int16_t GetFlags() {return mFlags;}
+	bool GetDeleteFromStore() {return mDeleteFromStore;}
+	BackupProtocolDeleteFile(int64_t InDirectory, const BackupStoreFilenameClear& Filename, int16_t Flags, bool DeleteFromStore);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	void SetFlags(int16_t Flags) {mFlags = Flags;}
+	void SetDeleteFromStore(bool DeleteFromStore) {mDeleteFromStore = DeleteFromStore;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	BackupStoreFilenameClear mFilename;
+	int16_t mFlags;
+	bool mDeleteFromStore;
+};
+
+class BackupProtocolGetBlockIndexByID : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetBlockIndexByID();
+	BackupProtocolGetBlockIndexByID(const BackupProtocolGetBlockIndexByID &rToCopy);
+	~BackupProtocolGetBlockIndexByID();
+	int GetType() const;
+	enum
+	{
+		TypeID = 34
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolGetBlockIndexByID(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolGetBlockIndexByName : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetBlockIndexByName();
+	BackupProtocolGetBlockIndexByName(const BackupProtocolGetBlockIndexByName &rToCopy);
+	~BackupProtocolGetBlockIndexByName();
+	int GetType() const;
+	enum
+	{
+		TypeID = 35
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	BackupProtocolGetBlockIndexByName(int64_t InDirectory, const BackupStoreFilenameClear& Filename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	BackupStoreFilenameClear mFilename;
+};
+
+class BackupProtocolUndeleteFile : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolUndeleteFile();
+	BackupProtocolUndeleteFile(const BackupProtocolUndeleteFile &rToCopy);
+	~BackupProtocolUndeleteFile();
+	int GetType() const;
+	enum
+	{
+		TypeID = 36
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolUndeleteFile(int64_t InDirectory, int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	int64_t mObjectID;
+};
+
+class BackupProtocolDeleteFileASAP : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolDeleteFileASAP();
+	BackupProtocolDeleteFileASAP(const BackupProtocolDeleteFileASAP &rToCopy);
+	~BackupProtocolDeleteFileASAP();
+	int GetType() const;
+	enum
+	{
+		TypeID = 37
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	BackupProtocolDeleteFileASAP(int64_t InDirectory, const BackupStoreFilenameClear& Filename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	BackupStoreFilenameClear mFilename;
+};
+
+class BackupProtocolStoreFileWithResume : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolStoreFileWithResume();
+	BackupProtocolStoreFileWithResume(const BackupProtocolStoreFileWithResume &rToCopy);
+	~BackupProtocolStoreFileWithResume();
+	int GetType() const;
+	enum
+	{
+		TypeID = 38
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetDirectoryObjectID() {return mDirectoryObjectID;}
+	int64_t GetModificationTime() {return mModificationTime;}
+	int64_t GetAttributesHash() {return mAttributesHash;}
+	int64_t GetDiffFromFileID() {return mDiffFromFileID;}
+	int64_t GetResumeOffset() {return mResumeOffset;}
+	const BackupStoreFilenameClear& GetFilename() {return mFilename;}
+	BackupProtocolStoreFileWithResume(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, int64_t ResumeOffset, const BackupStoreFilenameClear& Filename);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetDirectoryObjectID(int64_t DirectoryObjectID) {mDirectoryObjectID = DirectoryObjectID;}
+	void SetModificationTime(int64_t ModificationTime) {mModificationTime = ModificationTime;}
+	void SetAttributesHash(int64_t AttributesHash) {mAttributesHash = AttributesHash;}
+	void SetDiffFromFileID(int64_t DiffFromFileID) {mDiffFromFileID = DiffFromFileID;}
+	void SetResumeOffset(int64_t ResumeOffset) {mResumeOffset = ResumeOffset;}
+	void SetFilename(const BackupStoreFilenameClear& Filename) {mFilename = Filename;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mDirectoryObjectID;
+	int64_t mModificationTime;
+	int64_t mAttributesHash;
+	int64_t mDiffFromFileID;
+	int64_t mResumeOffset;
+	BackupStoreFilenameClear mFilename;
+};
+
+class BackupProtocolGetAccountUsage : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetAccountUsage();
+	BackupProtocolGetAccountUsage(const BackupProtocolGetAccountUsage &rToCopy);
+	~BackupProtocolGetAccountUsage();
+	int GetType() const;
+	enum
+	{
+		TypeID = 40
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolAccountUsage : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolAccountUsage();
+	BackupProtocolAccountUsage(const BackupProtocolAccountUsage &rToCopy);
+	~BackupProtocolAccountUsage();
+	int GetType() const;
+	enum
+	{
+		TypeID = 41
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetBlocksUsed() {return mBlocksUsed;}
+	int64_t GetBlocksInOldFiles() {return mBlocksInOldFiles;}
+	int64_t GetBlocksInDeletedFiles() {return mBlocksInDeletedFiles;}
+	int64_t GetBlocksInDirectories() {return mBlocksInDirectories;}
+	int64_t GetBlocksSoftLimit() {return mBlocksSoftLimit;}
+	int64_t GetBlocksHardLimit() {return mBlocksHardLimit;}
+	int32_t GetBlockSize() {return mBlockSize;}
+	BackupProtocolAccountUsage(int64_t BlocksUsed, int64_t BlocksInOldFiles, int64_t BlocksInDeletedFiles, int64_t BlocksInDirectories, int64_t BlocksSoftLimit, int64_t BlocksHardLimit, int32_t BlockSize);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetBlocksUsed(int64_t BlocksUsed) {mBlocksUsed = BlocksUsed;}
+	void SetBlocksInOldFiles(int64_t BlocksInOldFiles) {mBlocksInOldFiles = BlocksInOldFiles;}
+	void SetBlocksInDeletedFiles(int64_t BlocksInDeletedFiles) {mBlocksInDeletedFiles = BlocksInDeletedFiles;}
+	void SetBlocksInDirectories(int64_t BlocksInDirectories) {mBlocksInDirectories = BlocksInDirectories;}
+	void SetBlocksSoftLimit(int64_t BlocksSoftLimit) {mBlocksSoftLimit = BlocksSoftLimit;}
+	void SetBlocksHardLimit(int64_t BlocksHardLimit) {mBlocksHardLimit = BlocksHardLimit;}
+	void SetBlockSize(int32_t BlockSize) {mBlockSize = BlockSize;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mBlocksUsed;
+	int64_t mBlocksInOldFiles;
+	int64_t mBlocksInDeletedFiles;
+	int64_t mBlocksInDirectories;
+	int64_t mBlocksSoftLimit;
+	int64_t mBlocksHardLimit;
+	int32_t mBlockSize;
+};
+
+class BackupProtocolGetIsAlive : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetIsAlive();
+	BackupProtocolGetIsAlive(const BackupProtocolGetIsAlive &rToCopy);
+	~BackupProtocolGetIsAlive();
+	int GetType() const;
+	enum
+	{
+		TypeID = 42
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolIsAlive : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolIsAlive();
+	BackupProtocolIsAlive(const BackupProtocolIsAlive &rToCopy);
+	~BackupProtocolIsAlive();
+	int GetType() const;
+	enum
+	{
+		TypeID = 43
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolGetAccountUsage2 : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetAccountUsage2();
+	BackupProtocolGetAccountUsage2(const BackupProtocolGetAccountUsage2 &rToCopy);
+	~BackupProtocolGetAccountUsage2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 44
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolAccountUsage2 : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolAccountUsage2();
+	BackupProtocolAccountUsage2(const BackupProtocolAccountUsage2 &rToCopy);
+	~BackupProtocolAccountUsage2();
+	int GetType() const;
+	enum
+	{
+		TypeID = 45
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	const std::string& GetAccountName() {return mAccountName;}
+	bool GetAccountEnabled() {return mAccountEnabled;}
+	int64_t GetClientStoreMarker() {return mClientStoreMarker;}
+	int32_t GetBlockSize() {return mBlockSize;}
+	int64_t GetLastObjectIDUsed() {return mLastObjectIDUsed;}
+	int64_t GetBlocksUsed() {return mBlocksUsed;}
+	int64_t GetBlocksInCurrentFiles() {return mBlocksInCurrentFiles;}
+	int64_t GetBlocksInOldFiles() {return mBlocksInOldFiles;}
+	int64_t GetBlocksInDeletedFiles() {return mBlocksInDeletedFiles;}
+	int64_t GetBlocksInDirectories() {return mBlocksInDirectories;}
+	int64_t GetBlocksSoftLimit() {return mBlocksSoftLimit;}
+	int64_t GetBlocksHardLimit() {return mBlocksHardLimit;}
+	int64_t GetNumCurrentFiles() {return mNumCurrentFiles;}
+	int64_t GetNumOldFiles() {return mNumOldFiles;}
+	int64_t GetNumDeletedFiles() {return mNumDeletedFiles;}
+	int64_t GetNumDirectories() {return mNumDirectories;}
+	BackupProtocolAccountUsage2(const std::string& AccountName, bool AccountEnabled, int64_t ClientStoreMarker, int32_t BlockSize, int64_t LastObjectIDUsed, int64_t BlocksUsed, int64_t BlocksInCurrentFiles, int64_t BlocksInOldFiles, int64_t BlocksInDeletedFiles, int64_t BlocksInDirectories, int64_t BlocksSoftLimit, int64_t BlocksHardLimit, int64_t NumCurrentFiles, int64_t NumOldFiles, int64_t NumDeletedFiles, int64_t NumDirectories);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetAccountName(const std::string& AccountName) {mAccountName = AccountName;}
+	void SetAccountEnabled(bool AccountEnabled) {mAccountEnabled = AccountEnabled;}
+	void SetClientStoreMarker(int64_t ClientStoreMarker) {mClientStoreMarker = ClientStoreMarker;}
+	void SetBlockSize(int32_t BlockSize) {mBlockSize = BlockSize;}
+	void SetLastObjectIDUsed(int64_t LastObjectIDUsed) {mLastObjectIDUsed = LastObjectIDUsed;}
+	void SetBlocksUsed(int64_t BlocksUsed) {mBlocksUsed = BlocksUsed;}
+	void SetBlocksInCurrentFiles(int64_t BlocksInCurrentFiles) {mBlocksInCurrentFiles = BlocksInCurrentFiles;}
+	void SetBlocksInOldFiles(int64_t BlocksInOldFiles) {mBlocksInOldFiles = BlocksInOldFiles;}
+	void SetBlocksInDeletedFiles(int64_t BlocksInDeletedFiles) {mBlocksInDeletedFiles = BlocksInDeletedFiles;}
+	void SetBlocksInDirectories(int64_t BlocksInDirectories) {mBlocksInDirectories = BlocksInDirectories;}
+	void SetBlocksSoftLimit(int64_t BlocksSoftLimit) {mBlocksSoftLimit = BlocksSoftLimit;}
+	void SetBlocksHardLimit(int64_t BlocksHardLimit) {mBlocksHardLimit = BlocksHardLimit;}
+	void SetNumCurrentFiles(int64_t NumCurrentFiles) {mNumCurrentFiles = NumCurrentFiles;}
+	void SetNumOldFiles(int64_t NumOldFiles) {mNumOldFiles = NumOldFiles;}
+	void SetNumDeletedFiles(int64_t NumDeletedFiles) {mNumDeletedFiles = NumDeletedFiles;}
+	void SetNumDirectories(int64_t NumDirectories) {mNumDirectories = NumDirectories;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	std::string mAccountName;
+	bool mAccountEnabled;
+	int64_t mClientStoreMarker;
+	int32_t mBlockSize;
+	int64_t mLastObjectIDUsed;
+	int64_t mBlocksUsed;
+	int64_t mBlocksInCurrentFiles;
+	int64_t mBlocksInOldFiles;
+	int64_t mBlocksInDeletedFiles;
+	int64_t mBlocksInDirectories;
+	int64_t mBlocksSoftLimit;
+	int64_t mBlocksHardLimit;
+	int64_t mNumCurrentFiles;
+	int64_t mNumOldFiles;
+	int64_t mNumDeletedFiles;
+	int64_t mNumDirectories;
+};
+
+class BackupProtocolListBackups : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolListBackups();
+	BackupProtocolListBackups(const BackupProtocolListBackups &rToCopy);
+	~BackupProtocolListBackups();
+	int GetType() const;
+	enum
+	{
+		TypeID = 47
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolBackups : public BackupProtocolMessage, public BackupProtocolReply
+{
+public:
+	BackupProtocolBackups();
+	BackupProtocolBackups(const BackupProtocolBackups &rToCopy);
+	~BackupProtocolBackups();
+	int GetType() const;
+	enum
+	{
+		TypeID = 48
+	};
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolListDirectoryTree : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolListDirectoryTree();
+	BackupProtocolListDirectoryTree(const BackupProtocolListDirectoryTree &rToCopy);
+	~BackupProtocolListDirectoryTree();
+	int GetType() const;
+	enum
+	{
+		TypeID = 49
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	int16_t GetFlagsMustBeSet() {return mFlagsMustBeSet;}
+	int16_t GetFlagsNotToBeSet() {return mFlagsNotToBeSet;}
+	bool GetSendAttributes() {return mSendAttributes;}
+	int64_t GetSnapshotTime() {return mSnapshotTime;}
+	int32_t GetMaxDirectories() {return mMaxDirectories;}
+	BackupProtocolListDirectoryTree(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime, int32_t MaxDirectories);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetFlagsMustBeSet(int16_t FlagsMustBeSet) {mFlagsMustBeSet = FlagsMustBeSet;}
+	void SetFlagsNotToBeSet(int16_t FlagsNotToBeSet) {mFlagsNotToBeSet = FlagsNotToBeSet;}
+	void SetSendAttributes(bool SendAttributes) {mSendAttributes = SendAttributes;}
+	void SetSnapshotTime(int64_t SnapshotTime) {mSnapshotTime = SnapshotTime;}
+	void SetMaxDirectories(int32_t MaxDirectories) {mMaxDirectories = MaxDirectories;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+	int16_t mFlagsMustBeSet;
+	int16_t mFlagsNotToBeSet;
+	bool mSendAttributes;
+	int64_t mSnapshotTime;
+	int32_t mMaxDirectories;
+};
+
+class BackupProtocolAddBlockFingerprints : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolAddBlockFingerprints();
+	BackupProtocolAddBlockFingerprints(const BackupProtocolAddBlockFingerprints &rToCopy);
+	~BackupProtocolAddBlockFingerprints();
+	int GetType() const;
+	enum
+	{
+		TypeID = 50
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetObjectID() {return mObjectID;}
+	BackupProtocolAddBlockFingerprints(int64_t ObjectID);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mObjectID;
+};
+
+class BackupProtocolFindBlockFingerprints : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolFindBlockFingerprints();
+	BackupProtocolFindBlockFingerprints(const BackupProtocolFindBlockFingerprints &rToCopy);
+	~BackupProtocolFindBlockFingerprints();
+	int GetType() const;
+	enum
+	{
+		TypeID = 51
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+};
+
+class BackupProtocolStoreFiles : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolStoreFiles();
+	BackupProtocolStoreFiles(const BackupProtocolStoreFiles &rToCopy);
+	~BackupProtocolStoreFiles();
+	int GetType() const;
+	enum
+	{
+		TypeID = 52
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext, IOStream& rDataStream) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+			"This command requires a stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 1; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetDirectoryObjectID() {return mDirectoryObjectID;}
+	int32_t GetNumberOfFiles() {return mNumberOfFiles;}
+	BackupProtocolStoreFiles(int64_t DirectoryObjectID, int32_t NumberOfFiles);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetDirectoryObjectID(int64_t DirectoryObjectID) {mDirectoryObjectID = DirectoryObjectID;}
+	void SetNumberOfFiles(int32_t NumberOfFiles) {mNumberOfFiles = NumberOfFiles;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mDirectoryObjectID;
+	int32_t mNumberOfFiles;
+};
+
+class BackupProtocolGetFileRange : public BackupProtocolMessage, public BackupProtocolRequest
+{
+public:
+	BackupProtocolGetFileRange();
+	BackupProtocolGetFileRange(const BackupProtocolGetFileRange &rToCopy);
+	~BackupProtocolGetFileRange();
+	int GetType() const;
+	enum
+	{
+		TypeID = 53
+	};
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol, 
+		BackupStoreContext &rContext) const; // IMPLEMENT THIS
+
+	std::auto_ptr<BackupProtocolMessage> DoCommand(BackupProtocolReplyable &rProtocol,
+		BackupStoreContext &rContext, IOStream& rDataStream) const
+	{
+		THROW_EXCEPTION_MESSAGE(CommonException, NotSupported,
+			"This command requires no stream parameter");
+	}
+	bool HasStreamWithCommand() const { return 0; }
+	void SetPropertiesFromStreamData(Protocol &rProtocol);
+	int64_t GetInDirectory() {return mInDirectory;}
+	int64_t GetObjectID() {return mObjectID;}
+	int64_t GetOffset() {return mOffset;}
+	int64_t GetLength() {return mLength;}
+	BackupProtocolGetFileRange(int64_t InDirectory, int64_t ObjectID, int64_t Offset, int64_t Length);
+	void WritePropertiesToStreamData(Protocol &rProtocol) const;
+	void SetInDirectory(int64_t InDirectory) {mInDirectory = InDirectory;}
+	void SetObjectID(int64_t ObjectID) {mObjectID = ObjectID;}
+	void SetOffset(int64_t Offset) {mOffset = Offset;}
+	void SetLength(int64_t Length) {mLength = Length;}
+	virtual void LogSysLog(const char *Action) const;
+	virtual void LogFile(const char *Action, FILE *file) const;
+	virtual std::string ToString() const;
+private:
+	int64_t mInDirectory;
+	int64_t mObjectID;
+	int64_t mOffset;
+	int64_t mLength;
+};
+
+
+class BackupProtocolClientServer
+{
+public:
+	BackupProtocolClientServer();
+	virtual ~BackupProtocolClientServer();
+	virtual std::auto_ptr<IOStream> ReceiveStream() = 0;
+	bool GetLastError(int &rTypeOut, int &rSubTypeOut);
+	int GetLastErrorType() { return mLastErrorSubType; }
+
+protected:
+	void SetLastError(int Type, int SubType)
+	{
+		mLastErrorType = Type;
+		mLastErrorSubType = SubType;
+	}
+	std::string mPreviousCommand;
+	std::string mPreviousReply;
+
+private:
+	BackupProtocolClientServer(const BackupProtocolClientServer &rToCopy); /* do not call */
+	int mLastErrorType;
+	int mLastErrorSubType;
+};
+
+class BackupProtocolReplyable : public virtual BackupProtocolClientServer
+{
+public:
+	BackupProtocolReplyable() { }
+	virtual ~BackupProtocolReplyable();
+
+	virtual int GetTimeout() = 0;
+	void SendStreamAfterCommand(std::auto_ptr<IOStream> apStream);
+
+protected:
+	std::list<IOStream*> mStreamsToSend;
+	void DeleteStreamsToSend();
+	virtual std::auto_ptr<BackupProtocolMessage> HandleException(BoxException& e) const;
+
+private:
+	BackupProtocolReplyable(const BackupProtocolReplyable &rToCopy); /* do not call */
+};
+
+class BackupProtocolCallable : public virtual BackupProtocolClientServer,
+	public BackupProtocolSendReceive
+{
+public:
+	BackupProtocolCallable();
+	virtual ~BackupProtocolCallable();
+	virtual int GetTimeout() = 0;
+
+	// Pipelining: commands sent with SendAsync() don't wait for their
+	// replies, which must be collected in the same order by calling
+	// CollectReply(). Only allow more than one command in flight if the
+	// other end is known to cope with it. A Query() made while replies
+	// are outstanding reads them first, and keeps them to be collected.
+	void SetMaxCommandsInFlight(int MaxCommands);
+	int GetMaxCommandsInFlight() const { return mMaxCommandsInFlight; }
+	int GetNumRepliesToCollect() const { return (int)mAsyncCommands.size(); }
+	std::auto_ptr<BackupProtocolMessage> CollectReply();
+	// Call with 0 before using Send() and Receive() directly, so that
+	// the next message received is the reply to that command.
+	void ReceiveAsyncReplies(int MaxLeftInFlight);
+
+protected:
+	void CheckReply(const std::string& requestCommandName,
+		const BackupProtocolMessage &rCommand, 
+		const BackupProtocolMessage &rReply, int expectedType);
+	void CheckReply(const std::string& requestCommandName,
+		const std::string& rCommandDescription,
+		const BackupProtocolMessage &rReply, int expectedType);
+	virtual void SendAsyncCommand(const BackupProtocolMessage &rCommand,
+		IOStream *pStream, const char *pCommandName, int ReplyType) = 0;
+	void AddAsyncCommand(const BackupProtocolMessage &rCommand,
+		const char *pCommandName, int ReplyType,
+		std::auto_ptr<BackupProtocolMessage> apReply);
+
+private:
+	BackupProtocolCallable(const BackupProtocolCallable &rToCopy); /* do not call */
+	typedef struct
+	{
+		const char *mpCommandName;
+		std::string mCommandDescription;
+		int mReplyType;
+		BackupProtocolMessage *mpReply;
+	} AsyncCommand;
+	std::list<AsyncCommand> mAsyncCommands;
+	int mNumRepliesToReceive;
+	int mMaxCommandsInFlight;
+
+public:
+	virtual std::auto_ptr<BackupProtocolVersion> Query(const BackupProtocolVersion &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolLoginConfirmed> Query(const BackupProtocolLogin &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolFinished> Query(const BackupProtocolFinished &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetClientStoreMarker &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetObject &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolMoveObject &rQuery) = 0;
+	void SendAsync(const BackupProtocolMoveObject &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "MoveObject", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolObjectName> Query(const BackupProtocolGetObjectName &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolObjectInfos> Query(const BackupProtocolGetObjectInfos &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolObjectName2> Query(const BackupProtocolGetObjectName2 &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory2 &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectory &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	void SendAsync(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apStream)
+	{
+		SendAsyncCommand(rQuery, apStream.get(), "ChangeDirAttributes", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	void SendAsync(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apStream)
+	{
+		SendAsyncCommand(rQuery, apStream.get(), "ChangeDirAttributes2", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectory &rQuery) = 0;
+	void SendAsync(const BackupProtocolDeleteDirectory &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "DeleteDirectory", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteDirectory &rQuery) = 0;
+	void SendAsync(const BackupProtocolUndeleteDirectory &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "UndeleteDirectory", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectoryASAP &rQuery) = 0;
+	void SendAsync(const BackupProtocolDeleteDirectoryASAP &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "DeleteDirectoryASAP", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFile &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFile &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	void SendAsync(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apStream)
+	{
+		SendAsyncCommand(rQuery, apStream.get(), "SetReplacementFileAttributes", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFile &rQuery) = 0;
+	void SendAsync(const BackupProtocolDeleteFile &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "DeleteFile", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByID &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByName &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteFile &rQuery) = 0;
+	void SendAsync(const BackupProtocolUndeleteFile &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "UndeleteFile", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFileASAP &rQuery) = 0;
+	void SendAsync(const BackupProtocolDeleteFileASAP &rQuery)
+	{
+		SendAsyncCommand(rQuery, NULL, "DeleteFileASAP", 5);
+	}
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFileWithResume &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolAccountUsage> Query(const BackupProtocolGetAccountUsage &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolIsAlive> Query(const BackupProtocolGetIsAlive &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolAccountUsage2> Query(const BackupProtocolGetAccountUsage2 &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolBackups> Query(const BackupProtocolListBackups &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectoryTree &rQuery) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolAddBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolFindBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFiles &rQuery, std::auto_ptr<IOStream> apStream) = 0;
+	virtual std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFileRange &rQuery) = 0;
+
+	inline std::auto_ptr<BackupProtocolVersion> QueryVersion(int32_t Version)
+	{
+		BackupProtocolVersion send(Version);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolLoginConfirmed> QueryLogin(int32_t ClientID, int32_t Flags, int32_t Version)
+	{
+		BackupProtocolLogin send(ClientID, Flags, Version);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolFinished> QueryFinished()
+	{
+		BackupProtocolFinished send;
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QuerySetClientStoreMarker(int64_t ClientStoreMarker)
+	{
+		BackupProtocolSetClientStoreMarker send(ClientStoreMarker);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryGetObject(int64_t ObjectID)
+	{
+		BackupProtocolGetObject send(ObjectID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryMoveObject(int64_t ObjectID, int64_t MoveFromDirectory, int64_t MoveToDirectory, int32_t Flags, const BackupStoreFilenameClear& NewFilename)
+	{
+		BackupProtocolMoveObject send(ObjectID, MoveFromDirectory, MoveToDirectory, Flags, NewFilename);
+		return Query(send);
+	}
+	inline void SendAsyncMoveObject(int64_t ObjectID, int64_t MoveFromDirectory, int64_t MoveToDirectory, int32_t Flags, const BackupStoreFilenameClear& NewFilename)
+	{
+		BackupProtocolMoveObject send(ObjectID, MoveFromDirectory, MoveToDirectory, Flags, NewFilename);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolObjectName> QueryGetObjectName(int64_t ObjectID, int64_t ContainingDirectoryID)
+	{
+		BackupProtocolGetObjectName send(ObjectID, ContainingDirectoryID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolObjectInfos> QueryGetObjectInfos(int64_t ObjectID)
+	{
+		BackupProtocolGetObjectInfos send(ObjectID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolObjectName2> QueryGetObjectName2(int64_t ObjectID, int64_t ContainingDirectoryID)
+	{
+		BackupProtocolGetObjectName2 send(ObjectID, ContainingDirectoryID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryCreateDirectory(int64_t ContainingDirectoryID, int64_t AttributesModTime, const BackupStoreFilenameClear& DirectoryName, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolCreateDirectory send(ContainingDirectoryID, AttributesModTime, DirectoryName);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryCreateDirectory2(int64_t ContainingDirectoryID, int64_t AttributesModTime, int64_t ModificationTime, const BackupStoreFilenameClear& DirectoryName, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolCreateDirectory2 send(ContainingDirectoryID, AttributesModTime, ModificationTime, DirectoryName);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryListDirectory(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime)
+	{
+		BackupProtocolListDirectory send(ObjectID, FlagsMustBeSet, FlagsNotToBeSet, SendAttributes, SnapshotTime);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryChangeDirAttributes(int64_t ObjectID, int64_t AttributesModTime, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolChangeDirAttributes send(ObjectID, AttributesModTime);
+		return Query(send, apStream);
+	}
+	inline void SendAsyncChangeDirAttributes(int64_t ObjectID, int64_t AttributesModTime, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolChangeDirAttributes send(ObjectID, AttributesModTime);
+		SendAsync(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryChangeDirAttributes2(int64_t ObjectID, int64_t AttributesModTime, int64_t ModTime, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolChangeDirAttributes2 send(ObjectID, AttributesModTime, ModTime);
+		return Query(send, apStream);
+	}
+	inline void SendAsyncChangeDirAttributes2(int64_t ObjectID, int64_t AttributesModTime, int64_t ModTime, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolChangeDirAttributes2 send(ObjectID, AttributesModTime, ModTime);
+		SendAsync(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryDeleteDirectory(int64_t ObjectID, int16_t Flags, bool DeleteFromStore)
+	{
+		BackupProtocolDeleteDirectory send(ObjectID, Flags, DeleteFromStore);
+		return Query(send);
+	}
+	inline void SendAsyncDeleteDirectory(int64_t ObjectID, int16_t Flags, bool DeleteFromStore)
+	{
+		BackupProtocolDeleteDirectory send(ObjectID, Flags, DeleteFromStore);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryUndeleteDirectory(int64_t ObjectID)
+	{
+		BackupProtocolUndeleteDirectory send(ObjectID);
+		return Query(send);
+	}
+	inline void SendAsyncUndeleteDirectory(int64_t ObjectID)
+	{
+		BackupProtocolUndeleteDirectory send(ObjectID);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryDeleteDirectoryASAP(int64_t ObjectID)
+	{
+		BackupProtocolDeleteDirectoryASAP send(ObjectID);
+		return Query(send);
+	}
+	inline void SendAsyncDeleteDirectoryASAP(int64_t ObjectID)
+	{
+		BackupProtocolDeleteDirectoryASAP send(ObjectID);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryStoreFile(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, const BackupStoreFilenameClear& Filename, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolStoreFile send(DirectoryObjectID, ModificationTime, AttributesHash, DiffFromFileID, Filename);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryGetFile(int64_t InDirectory, int64_t ObjectID)
+	{
+		BackupProtocolGetFile send(InDirectory, ObjectID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QuerySetReplacementFileAttributes(int64_t InDirectory, int64_t AttributesHash, const BackupStoreFilenameClear& Filename, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolSetReplacementFileAttributes send(InDirectory, AttributesHash, Filename);
+		return Query(send, apStream);
+	}
+	inline void SendAsyncSetReplacementFileAttributes(int64_t InDirectory, int64_t AttributesHash, const BackupStoreFilenameClear& Filename, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolSetReplacementFileAttributes send(InDirectory, AttributesHash, Filename);
+		SendAsync(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryDeleteFile(int64_t InDirectory, const BackupStoreFilenameClear& Filename, int16_t Flags, bool DeleteFromStore)
+	{
+		BackupProtocolDeleteFile send(InDirectory, Filename, Flags, DeleteFromStore);
+		return Query(send);
+	}
+	inline void SendAsyncDeleteFile(int64_t InDirectory, const BackupStoreFilenameClear& Filename, int16_t Flags, bool DeleteFromStore)
+	{
+		BackupProtocolDeleteFile send(InDirectory, Filename, Flags, DeleteFromStore);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryGetBlockIndexByID(int64_t ObjectID)
+	{
+		BackupProtocolGetBlockIndexByID send(ObjectID);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryGetBlockIndexByName(int64_t InDirectory, const BackupStoreFilenameClear& Filename)
+	{
+		BackupProtocolGetBlockIndexByName send(InDirectory, Filename);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryUndeleteFile(int64_t InDirectory, int64_t ObjectID)
+	{
+		BackupProtocolUndeleteFile send(InDirectory, ObjectID);
+		return Query(send);
+	}
+	inline void SendAsyncUndeleteFile(int64_t InDirectory, int64_t ObjectID)
+	{
+		BackupProtocolUndeleteFile send(InDirectory, ObjectID);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryDeleteFileASAP(int64_t InDirectory, const BackupStoreFilenameClear& Filename)
+	{
+		BackupProtocolDeleteFileASAP send(InDirectory, Filename);
+		return Query(send);
+	}
+	inline void SendAsyncDeleteFileASAP(int64_t InDirectory, const BackupStoreFilenameClear& Filename)
+	{
+		BackupProtocolDeleteFileASAP send(InDirectory, Filename);
+		SendAsync(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryStoreFileWithResume(int64_t DirectoryObjectID, int64_t ModificationTime, int64_t AttributesHash, int64_t DiffFromFileID, int64_t ResumeOffset, const BackupStoreFilenameClear& Filename, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolStoreFileWithResume send(DirectoryObjectID, ModificationTime, AttributesHash, DiffFromFileID, ResumeOffset, Filename);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolAccountUsage> QueryGetAccountUsage()
+	{
+		BackupProtocolGetAccountUsage send;
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolIsAlive> QueryGetIsAlive()
+	{
+		BackupProtocolGetIsAlive send;
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolAccountUsage2> QueryGetAccountUsage2()
+	{
+		BackupProtocolGetAccountUsage2 send;
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolBackups> QueryListBackups()
+	{
+		BackupProtocolListBackups send;
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryListDirectoryTree(int64_t ObjectID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet, bool SendAttributes, int64_t SnapshotTime, int32_t MaxDirectories)
+	{
+		BackupProtocolListDirectoryTree send(ObjectID, FlagsMustBeSet, FlagsNotToBeSet, SendAttributes, SnapshotTime, MaxDirectories);
+		return Query(send);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryAddBlockFingerprints(int64_t ObjectID, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolAddBlockFingerprints send(ObjectID);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryFindBlockFingerprints(std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolFindBlockFingerprints send;
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryStoreFiles(int64_t DirectoryObjectID, int32_t NumberOfFiles, std::auto_ptr<IOStream> apStream)
+	{
+		BackupProtocolStoreFiles send(DirectoryObjectID, NumberOfFiles);
+		return Query(send, apStream);
+	}
+	inline std::auto_ptr<BackupProtocolSuccess> QueryGetFileRange(int64_t InDirectory, int64_t ObjectID, int64_t Offset, int64_t Length)
+	{
+		BackupProtocolGetFileRange send(InDirectory, ObjectID, Offset, Length);
+		return Query(send);
+	}
+
+};
+class BackupProtocolClient : public BackupProtocolCallable, public BackupProtocol
+{
+public:
+	virtual ~BackupProtocolClient();
+	BackupProtocolClient(std::auto_ptr<SocketStream> apConn);
+	std::auto_ptr<BackupProtocolMessage> Receive();
+	void Send(const BackupProtocolMessage &rObject);
+	std::auto_ptr<BackupProtocolVersion> Query(const BackupProtocolVersion &rQuery);
+	std::auto_ptr<BackupProtocolLoginConfirmed> Query(const BackupProtocolLogin &rQuery);
+	std::auto_ptr<BackupProtocolFinished> Query(const BackupProtocolFinished &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetClientStoreMarker &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetObject &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolMoveObject &rQuery);
+	std::auto_ptr<BackupProtocolObjectName> Query(const BackupProtocolGetObjectName &rQuery);
+	std::auto_ptr<BackupProtocolObjectInfos> Query(const BackupProtocolGetObjectInfos &rQuery);
+	std::auto_ptr<BackupProtocolObjectName2> Query(const BackupProtocolGetObjectName2 &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory2 &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectoryASAP &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFile &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByID &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByName &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFileASAP &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFileWithResume &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolAccountUsage> Query(const BackupProtocolGetAccountUsage &rQuery);
+	std::auto_ptr<BackupProtocolIsAlive> Query(const BackupProtocolGetIsAlive &rQuery);
+	std::auto_ptr<BackupProtocolAccountUsage2> Query(const BackupProtocolGetAccountUsage2 &rQuery);
+	std::auto_ptr<BackupProtocolBackups> Query(const BackupProtocolListBackups &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectoryTree &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolAddBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolFindBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFiles &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFileRange &rQuery);
+protected:
+	void SendAsyncCommand(const BackupProtocolMessage &rCommand,
+		IOStream *pStream, const char *pCommandName, int ReplyType);
+public:
+	virtual std::auto_ptr<IOStream> ReceiveStream();
+	virtual int GetTimeout()
+	{
+		return BackupProtocol::GetTimeout();
+	}
+
+private:
+	BackupProtocolClient(const BackupProtocolClient &rToCopy); /* no copies */
+};
+
+class BackupProtocolServer : public BackupProtocolReplyable, public BackupProtocol
+{
+public:
+	virtual ~BackupProtocolServer();
+	BackupProtocolServer(std::auto_ptr<SocketStream> apConn);
+	std::auto_ptr<BackupProtocolMessage> Receive();
+	void Send(const BackupProtocolMessage &rObject);
+	void DoServer(BackupStoreContext &rContext);
+
+	virtual std::auto_ptr<IOStream> ReceiveStream();
+	virtual int GetTimeout()
+	{
+		return BackupProtocol::GetTimeout();
+	}
+
+private:
+	BackupProtocolServer(const BackupProtocolServer &rToCopy); /* no copies */
+};
+
+class BackupProtocolLocal : public BackupProtocolReplyable, public BackupProtocolCallable
+{
+public:
+	virtual ~BackupProtocolLocal();
+	BackupProtocolLocal(BackupStoreContext &rContext);
+	BackupProtocolLocal(std::auto_ptr<SocketStream> apConn);
+	std::auto_ptr<BackupProtocolMessage> Receive();
+	void Send(const BackupProtocolMessage &rObject);
+	std::auto_ptr<BackupProtocolVersion> Query(const BackupProtocolVersion &rQuery);
+	std::auto_ptr<BackupProtocolLoginConfirmed> Query(const BackupProtocolLogin &rQuery);
+	std::auto_ptr<BackupProtocolFinished> Query(const BackupProtocolFinished &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetClientStoreMarker &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetObject &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolMoveObject &rQuery);
+	std::auto_ptr<BackupProtocolObjectName> Query(const BackupProtocolGetObjectName &rQuery);
+	std::auto_ptr<BackupProtocolObjectInfos> Query(const BackupProtocolGetObjectInfos &rQuery);
+	std::auto_ptr<BackupProtocolObjectName2> Query(const BackupProtocolGetObjectName2 &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolCreateDirectory2 &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolChangeDirAttributes2 &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteDirectory &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteDirectoryASAP &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFile &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolSetReplacementFileAttributes &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByID &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetBlockIndexByName &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolUndeleteFile &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolDeleteFileASAP &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFileWithResume &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolAccountUsage> Query(const BackupProtocolGetAccountUsage &rQuery);
+	std::auto_ptr<BackupProtocolIsAlive> Query(const BackupProtocolGetIsAlive &rQuery);
+	std::auto_ptr<BackupProtocolAccountUsage2> Query(const BackupProtocolGetAccountUsage2 &rQuery);
+	std::auto_ptr<BackupProtocolBackups> Query(const BackupProtocolListBackups &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolListDirectoryTree &rQuery);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolAddBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolFindBlockFingerprints &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolStoreFiles &rQuery, std::auto_ptr<IOStream> apStream);
+	std::auto_ptr<BackupProtocolSuccess> Query(const BackupProtocolGetFileRange &rQuery);
+protected:
+	void SendAsyncCommand(const BackupProtocolMessage &rCommand,
+		IOStream *pStream, const char *pCommandName, int ReplyType);
+public:
+private:
+	BackupStoreContext &mrContext;
+	std::auto_ptr<BackupProtocolMessage> mapLastReply;
+public:
+	virtual std::auto_ptr<IOStream> ReceiveStream()
+	{
+		if(mStreamsToSend.empty())
+		{
+			THROW_EXCEPTION_MESSAGE(CommonException, Internal,
+				"Tried to ReceiveStream when none was sent or "
+				"made available");
+		}
+
+		std::auto_ptr<IOStream> apStream(mStreamsToSend.front());
+		mStreamsToSend.pop_front();
+		return apStream;
+	}
+	virtual int GetTimeout()
+	{
+		return IOStream::TimeOutInfinite;
+	}
+
+private:
+	BackupProtocolLocal(const BackupProtocolLocal &rToCopy); /* no copies */
+};
+
+#endif // AUTOGEN_BACKUPPROTOCOL_H
+
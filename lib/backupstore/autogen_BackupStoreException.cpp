@@ -0,0 +1,110 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+#include "autogen_BackupStoreException.h"
+
+#include "MemLeakFindOn.h"
+
+unsigned int BackupStoreException::GetType() const throw()
+{
+	return BackupStoreException::ExceptionType;
+}
+
+unsigned int BackupStoreException::GetSubType() const throw()
+{
+	return mSubType;
+}
+
+const char * BackupStoreException::what() const throw()
+{
+	return mWhat.c_str();
+}
+
+const char * BackupStoreException::GetMessage(int SubType)
+{
+	switch(SubType)
+	{
+		case Internal: return "Internal";
+		case BadAccountDatabaseFile: return "BadAccountDatabaseFile";
+		case AccountDatabaseNoSuchEntry: return "AccountDatabaseNoSuchEntry";
+		case InvalidBackupStoreFilename: return "InvalidBackupStoreFilename";
+		case UnknownFilenameEncoding: return "UnknownFilenameEncoding";
+		case CouldntReadEntireStructureFromStream: return "CouldntReadEntireStructureFromStream";
+		case BadDirectoryFormat: return "BadDirectoryFormat";
+		case CouldNotFindEntryInDirectory: return "CouldNotFindEntryInDirectory";
+		case OutputFileAlreadyExists: return "OutputFileAlreadyExists";
+		case OSFileError: return "OSFileError";
+		case StreamDoesntHaveRequiredFeatures: return "StreamDoesntHaveRequiredFeatures";
+		case BadBackupStoreFile: return "BadBackupStoreFile";
+		case CouldNotLoadStoreInfo: return "CouldNotLoadStoreInfo";
+		case BadStoreInfoOnLoad: return "BadStoreInfoOnLoad";
+		case StoreInfoIsReadOnly: return "StoreInfoIsReadOnly";
+		case StoreInfoDirNotInList: return "StoreInfoDirNotInList";
+		case StoreInfoBlockDeltaMakesValueNegative: return "StoreInfoBlockDeltaMakesValueNegative";
+		case DirectoryHasBeenDeleted: return "DirectoryHasBeenDeleted";
+		case StoreInfoNotInitialised: return "StoreInfoNotInitialised";
+		case StoreInfoAlreadyLoaded: return "StoreInfoAlreadyLoaded";
+		case StoreInfoNotLoaded: return "StoreInfoNotLoaded";
+		case ReadFileFromStreamTimedOut: return "ReadFileFromStreamTimedOut";
+		case FileWrongSizeAfterBeingStored: return "FileWrongSizeAfterBeingStored";
+		case AddedFileDoesNotVerify: return "AddedFileDoesNotVerify";
+		case StoreInfoForWrongAccount: return "StoreInfoForWrongAccount";
+		case ContextIsReadOnly: return "ContextIsReadOnly";
+		case AttributesNotLoaded: return "AttributesNotLoaded";
+		case AttributesNotUnderstood: return "AttributesNotUnderstood";
+		case WrongServerVersion: return "WrongServerVersion";
+		case ClientMarkerNotAsExpected: return "ClientMarkerNotAsExpected";
+		case NameAlreadyExistsInDirectory: return "NameAlreadyExistsInDirectory";
+		case BerkelyDBFailure: return "BerkelyDBFailure";
+		case InodeMapIsReadOnly: return "InodeMapIsReadOnly";
+		case InodeMapNotOpen: return "InodeMapNotOpen";
+		case FilenameEncryptionKeyNotKnown: return "FilenameEncryptionKeyNotKnown";
+		case FilenameEncryptionNoKeyForSpecifiedMethod: return "FilenameEncryptionNoKeyForSpecifiedMethod";
+		case FilenameEncryptionNotSetup: return "FilenameEncryptionNotSetup";
+		case CouldntLoadClientKeyMaterial: return "CouldntLoadClientKeyMaterial";
+		case BadEncryptedAttributes: return "BadEncryptedAttributes";
+		case EncryptedAttributesHaveUnknownEncoding: return "EncryptedAttributesHaveUnknownEncoding";
+		case OutputSizeTooSmallForChunk: return "OutputSizeTooSmallForChunk";
+		case BadEncodedChunk: return "BadEncodedChunk";
+		case NotEnoughSpaceToDecodeChunk: return "NotEnoughSpaceToDecodeChunk";
+		case ChunkHasUnknownEncoding: return "ChunkHasUnknownEncoding";
+		case ChunkContainsBadCompressedData: return "ChunkContainsBadCompressedData";
+		case CantWriteToEncodedFileStream: return "CantWriteToEncodedFileStream";
+		case Temp_FileEncodeStreamDidntReadBuffer: return "Temp_FileEncodeStreamDidntReadBuffer";
+		case CantWriteToDecodedFileStream: return "CantWriteToDecodedFileStream";
+		case WhenDecodingExpectedToReadButCouldnt: return "WhenDecodingExpectedToReadButCouldnt";
+		case BackupStoreFileFailedIntegrityCheck: return "BackupStoreFileFailedIntegrityCheck";
+		case ThereIsNoDataInASymLink: return "ThereIsNoDataInASymLink";
+		case IVLengthForEncodedBlockSizeDoesntMeetLengthRequirements: return "IVLengthForEncodedBlockSizeDoesntMeetLengthRequirements";
+		case BlockEntryEncodingDidntGiveExpectedLength: return "BlockEntryEncodingDidntGiveExpectedLength";
+		case CouldNotFindUnusedIDDuringAllocation: return "CouldNotFindUnusedIDDuringAllocation";
+		case AddedFileExceedsStorageLimit: return "AddedFileExceedsStorageLimit";
+		case CannotDiffAnIncompleteStoreFile: return "CannotDiffAnIncompleteStoreFile";
+		case CannotDecodeDiffedFilesWithoutCombining: return "CannotDecodeDiffedFilesWithoutCombining";
+		case FailedToReadBlockOnCombine: return "FailedToReadBlockOnCombine";
+		case OnCombineFromFileIsIncomplete: return "OnCombineFromFileIsIncomplete";
+		case BadNotifySysadminEventCode: return "BadNotifySysadminEventCode";
+		case InternalAlgorithmErrorCheckIDNotMonotonicallyIncreasing: return "InternalAlgorithmErrorCheckIDNotMonotonicallyIncreasing";
+		case CouldNotLockStoreAccount: return "CouldNotLockStoreAccount";
+		case AttributeHashSecretNotSet: return "AttributeHashSecretNotSet";
+		case AEScipherNotSupportedByInstalledOpenSSL: return "AEScipherNotSupportedByInstalledOpenSSL";
+		case SignalReceived: return "SignalReceived";
+		case IncompatibleFromAndDiffFiles: return "IncompatibleFromAndDiffFiles";
+		case DiffFromIDNotFoundInDirectory: return "DiffFromIDNotFoundInDirectory";
+		case PatchChainInfoBadInDirectory: return "PatchChainInfoBadInDirectory";
+		case UnknownObjectRefCountRequested: return "UnknownObjectRefCountRequested";
+		case MultiplyReferencedObject: return "MultiplyReferencedObject";
+		case CorruptReferenceCountDatabase: return "CorruptReferenceCountDatabase";
+		case CancelledByBackgroundTask: return "CancelledByBackgroundTask";
+		case ObjectDoesNotExist: return "ObjectDoesNotExist";
+		case AccountAlreadyExists: return "AccountAlreadyExists";
+		case CannotResumeUpload: return "CannotResumeUpload";
+		case CannotSeekToBlockOffset: return "CannotSeekToBlockOffset";
+		case CantWriteToDirectoryTreeStream: return "CantWriteToDirectoryTreeStream";
+		case BadBlockFingerprintStream: return "BadBlockFingerprintStream";
+		case BadStoreFilesStream: return "BadStoreFilesStream";
+		case SeekOutsideDecodedFile: return "SeekOutsideDecodedFile";
+		default: return "Unknown";
+	}
+}
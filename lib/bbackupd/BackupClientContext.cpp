@@ -17,6 +17,8 @@
 	#include <sys/time.h>
 #endif
 
+#include <vector>
+
 #include "BackupConstants.h"
 #include "BoxPortsAndFiles.h"
 #include "BoxTime.h"
@@ -75,6 +77,11 @@ BackupClientContext::BackupClientContext
   mpExcludeDirs(0),
   mKeepAliveTimer(0, "KeepAliveTime"),
   mbIsManaged(false),
+  mMaxCommandsInFlight(1),
+  mFindBlocksInOtherFiles(false),
+  mServerSharesBlocks(false),
+  mMaxFilesPerUpload(1),
+  mServerStoresBatches(false),
   mrProgressNotifier(rProgressNotifier),
   mrSyncResumeInfo(rSyncResumeInfo),
   mTcpNiceMode(TcpNiceMode),
@@ -103,6 +110,62 @@ BackupClientContext::~BackupClientContext()
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientContext::NegotiateServerVersion(
+//			 BackupProtocolCallable &, const std::vector<int32_t> &)
+//		Purpose: Ask the server for each of the given protocol
+//			 versions in turn, newest first, and return the first
+//			 one it accepts. Versions the server rejects with
+//			 Err_WrongVersion are skipped; if it accepts none of
+//			 them, fall back to the basic version.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int32_t BackupClientContext::NegotiateServerVersion(
+	BackupProtocolCallable &rConnection,
+	const std::vector<int32_t> &rVersions)
+{
+	for(std::vector<int32_t>::const_iterator
+		i(rVersions.begin()); i != rVersions.end(); ++i)
+	{
+		HideSpecificExceptionGuard guard(ConnectionException::ExceptionType,
+			ConnectionException::Protocol_UnexpectedReply);
+		try
+		{
+			std::auto_ptr<BackupProtocolVersion> serverVersion(
+				rConnection.QueryVersion(*i));
+			if(serverVersion->GetVersion() == *i)
+			{
+				return *i;
+			}
+		}
+		catch(ConnectionException &e)
+		{
+			int type, subtype;
+			if(e.GetSubType() != ConnectionException::Protocol_UnexpectedReply ||
+				!rConnection.GetLastError(type, subtype) ||
+				type != BackupProtocolError::ErrorType ||
+				subtype != BackupProtocolError::Err_WrongVersion)
+			{
+				throw;
+			}
+			BOX_INFO("Server does not support protocol version " <<
+				*i);
+		}
+	}
+
+	std::auto_ptr<BackupProtocolVersion> serverVersion(
+		rConnection.QueryVersion(BACKUP_STORE_SERVER_VERSION));
+	if(serverVersion->GetVersion() != BACKUP_STORE_SERVER_VERSION)
+	{
+		THROW_EXCEPTION(BackupStoreException, WrongServerVersion)
+	}
+	return BACKUP_STORE_SERVER_VERSION;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -180,15 +243,32 @@ BackupProtocolCallable &BackupClientContext::GetConnection()
 		// Handshake
 		pClient->Handshake();
 
-		// Check the version of the server
+		// Check the version of the server, asking for the features we
+		// want first, newest first. Older servers reject versions they
+		// don't know, but we can try again with an older one, and
+		// finally the basic one.
+		std::vector<int32_t> versions;
+		if(mMaxFilesPerUpload > 1)
 		{
-			std::auto_ptr<BackupProtocolVersion> serverVersion(
-				mapConnection->QueryVersion(BACKUP_STORE_SERVER_VERSION));
-			if(serverVersion->GetVersion() != BACKUP_STORE_SERVER_VERSION)
-			{
-				THROW_EXCEPTION(BackupStoreException, WrongServerVersion)
-			}
+			versions.push_back(BACKUP_STORE_SERVER_VERSION_BATCHED_UPLOAD);
+		}
+		if(mFindBlocksInOtherFiles)
+		{
+			versions.push_back(BACKUP_STORE_SERVER_VERSION_SHARED_BLOCKS);
 		}
+		if(mMaxCommandsInFlight > 1)
+		{
+			versions.push_back(BACKUP_STORE_SERVER_VERSION_PIPELINING);
+		}
+
+		int32_t version = NegotiateServerVersion(*mapConnection, versions);
+		if(version != BACKUP_STORE_SERVER_VERSION &&
+			mMaxCommandsInFlight > 1)
+		{
+			// Every newer version supports pipelining
+			pClient->SetMaxCommandsInFlight(mMaxCommandsInFlight);
+		}
+		SetServerVersion(version);
 
 		// Login -- if this fails, the Protocol will exception
 		std::auto_ptr<BackupProtocolLoginConfirmed> loginConf(
@@ -422,7 +502,10 @@ bool BackupClientContext::FindFilename(int64_t ObjectID, int64_t ContainingDirec
 	// Make a connection to the server
 	BackupProtocolCallable &connection(GetConnection());
 
-	// Request filenames from the server, in a "safe" manner to ignore errors properly
+	// Request filenames from the server, in a "safe" manner to ignore errors properly.
+	// Replies to pipelined commands must be read first, or they would be taken
+	// for the reply to this one.
+	connection.ReceiveAsyncReplies(0);
 	{
 		BackupProtocolGetObjectName2 send(ObjectID, ContainingDirectory);
 		connection.Send(send);
@@ -513,6 +596,32 @@ void BackupClientContext::SetMaximumDiffingTime(int iSeconds)
 		" seconds");
 }
 
+void BackupClientContext::SetMaxCommandsInFlight(int MaxCommands)
+{
+	mMaxCommandsInFlight = MaxCommands < 1 ? 1 : MaxCommands;
+	BOX_TRACE("Set maximum commands in flight to " <<
+		mMaxCommandsInFlight);
+}
+
+void BackupClientContext::SetFindBlocksInOtherFiles(bool Find)
+{
+	mFindBlocksInOtherFiles = Find;
+}
+
+void BackupClientContext::SetMaxFilesPerUpload(int MaxFiles)
+{
+	mMaxFilesPerUpload = MaxFiles < 1 ? 1 : MaxFiles;
+	BOX_TRACE("Set maximum files per upload to " << mMaxFilesPerUpload);
+}
+
+void BackupClientContext::SetServerVersion(int32_t Version)
+{
+	mServerSharesBlocks = mFindBlocksInOtherFiles &&
+		(Version >= BACKUP_STORE_SERVER_VERSION_SHARED_BLOCKS);
+	mServerStoresBatches =
+		(Version >= BACKUP_STORE_SERVER_VERSION_BATCHED_UPLOAD);
+}
+
 void BackupClientContext::SetKeepAliveTime(int iSeconds)
 {
 	mKeepAliveTime = iSeconds < 0 ? 0 : iSeconds;
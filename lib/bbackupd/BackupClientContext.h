@@ -27,6 +27,7 @@ class BackupDaemon;
 class BackupStoreFilenameClear;
 
 #include <string>
+#include <vector>
 
 class SyncResumeInfo: public FileStream
 {
@@ -121,6 +122,8 @@ private:
 public:
 	// GetConnection() will open a connection if none is currently open.
 	virtual BackupProtocolCallable& GetConnection();
+	static int32_t NegotiateServerVersion(BackupProtocolCallable &rConnection,
+		const std::vector<int32_t> &rVersions);
 	// GetOpenConnection() will not open a connection, just return NULL if there is
 	// no connection already open.
 	virtual BackupProtocolCallable* GetOpenConnection() const;
@@ -224,6 +227,71 @@ public:
 	// --------------------------------------------------------------------------
 	void SetMaximumDiffingTime(int iSeconds);
 
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::SetMaxCommandsInFlight()
+	//		Purpose: Sets how many metadata commands may be sent to
+	//			 the server before waiting for their replies, if the
+	//			 server supports it. 1 disables pipelining. Takes
+	//			 effect on the next connection.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	void SetMaxCommandsInFlight(int MaxCommands);
+
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::SetFindBlocksInOtherFiles()
+	//		Purpose: Sets whether to ask the server for other files
+	//			 containing the blocks of a new file, so that it
+	//			 can be uploaded as a patch. Takes effect on the
+	//			 next connection.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	void SetFindBlocksInOtherFiles(bool Find);
+
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::CanFindBlocksInOtherFiles()
+	//		Purpose: Whether the current connection was set up to
+	//			 find blocks in other files, which needs a server
+	//			 which supports it.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	bool CanFindBlocksInOtherFiles() const { return mServerSharesBlocks; }
+
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::SetMaxFilesPerUpload()
+	//		Purpose: Sets how many small files may be sent to the
+	//			 server in one command, if the server supports it.
+	//			 1 sends each file separately. Takes effect on the
+	//			 next connection.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	void SetMaxFilesPerUpload(int MaxFiles);
+
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::GetMaxFilesPerUpload()
+	//		Purpose: How many files may be sent in one command over
+	//			 the current connection.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	int GetMaxFilesPerUpload() const
+	{
+		return mServerStoresBatches ? mMaxFilesPerUpload : 1;
+	}
+
 	// --------------------------------------------------------------------------
 	//
 	// Function
@@ -292,6 +360,19 @@ public:
 
 	bool mExperimentalSnapshotMode;
 
+protected:
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    BackupClientContext::SetServerVersion(int32_t)
+	//		Purpose: Records which of the features this client wants
+	//			 the server supports, from the protocol version
+	//			 agreed with it.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	void SetServerVersion(int32_t Version);
+
 private:
 	LocationResolver &mrResolver;
 	TLSContext &mrTLSContext;
@@ -315,6 +396,11 @@ private:
 	bool mbIsManaged;
 	int mKeepAliveTime;
 	int mMaximumDiffingTime;
+	int mMaxCommandsInFlight;
+	bool mFindBlocksInOtherFiles;
+	bool mServerSharesBlocks;
+	int mMaxFilesPerUpload;
+	bool mServerStoresBatches;
 	ProgressNotifier &mrProgressNotifier;
 	SyncResumeInfo &mrSyncResumeInfo;
 	bool mTcpNiceMode;
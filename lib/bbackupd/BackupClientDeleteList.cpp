@@ -133,26 +133,45 @@ void BackupClientDeleteList::PerformDeletions(BackupClientContext &rContext, con
 	// Get a connection
 	BackupProtocolCallable &connection(rContext.GetConnection());
 	
-	// Do the deletes
+	// Do the deletes. They are sent without waiting for each reply, if
+	// the server allows it, and each one is reported when its reply is
+	// collected. A failure throws an exception, just as Query would.
+	std::vector<DirToDelete>::iterator dirDone(mDirectoryList.begin());
 	for(std::vector<DirToDelete>::iterator i(mDirectoryList.begin());
 		i != mDirectoryList.end(); ++i)
 	{
-		connection.QueryDeleteDirectory(i->mObjectID, 0, rBackupLocation.mDoNotKeepDeletedFiles);
-		
-		rContext.GetProgressNotifier().NotifyDirectoryDeleted(
-			i->mObjectID, i->mLocalPath);
+		connection.SendAsyncDeleteDirectory(i->mObjectID, 0, rBackupLocation.mDoNotKeepDeletedFiles);
+
+		while(connection.GetNumRepliesToCollect() >=
+			(i + 1 == mDirectoryList.end()
+				? 1 : connection.GetMaxCommandsInFlight()))
+		{
+			connection.CollectReply();
+			rContext.GetProgressNotifier().NotifyDirectoryDeleted(
+				dirDone->mObjectID, dirDone->mLocalPath);
+			++dirDone;
+		}
 	}
 	
 	// Clear the directory list
 	mDirectoryList.clear();
 	
 	// Delete the files
+	std::vector<FileToDelete>::iterator fileDone(mFileList.begin());
 	for(std::vector<FileToDelete>::iterator i(mFileList.begin());
 		i != mFileList.end(); ++i)
 	{
-		connection.QueryDeleteFile(i->mDirectoryID, i->mFilename, 0, rBackupLocation.mDoNotKeepDeletedFiles);
-		rContext.GetProgressNotifier().NotifyFileDeleted(
-			i->mDirectoryID, i->mLocalPath);
+		connection.SendAsyncDeleteFile(i->mDirectoryID, i->mFilename, 0, rBackupLocation.mDoNotKeepDeletedFiles);
+
+		while(connection.GetNumRepliesToCollect() >=
+			(i + 1 == mFileList.end()
+				? 1 : connection.GetMaxCommandsInFlight()))
+		{
+			connection.CollectReply();
+			rContext.GetProgressNotifier().NotifyFileDeleted(
+				fileDone->mDirectoryID, fileDone->mLocalPath);
+			++fileDone;
+		}
 	}
 }
 
@@ -17,6 +17,10 @@
 #include <errno.h>
 #include <string.h>
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include "autogen_BackupProtocol.h"
 #include "autogen_CipherException.h"
 #include "autogen_ClientException.h"
@@ -41,7 +45,118 @@
 
 #include "MemLeakFindOn.h"
 
-typedef std::map<std::string, BackupStoreDirectory::Entry *> DecryptedEntriesMap_t;
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    StoreEntriesIndex::StoreEntriesIndex(BackupStoreDirectory *)
+//		Purpose: Constructor. Indexes the entries of the directory,
+//			 which must outlive this object, or none if it's NULL.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+StoreEntriesIndex::StoreEntriesIndex(BackupStoreDirectory *pDir)
+{
+	if(pDir == NULL)
+	{
+		return;
+	}
+
+	mEntries.reserve(pDir->GetNumberOfEntries());
+	BackupStoreDirectory::Iterator i(*pDir);
+	BackupStoreDirectory::Entry *en = NULL;
+	while((en = i.Next()) != NULL)
+	{
+		mEntries.push_back(Indexed_t(en, mEntries.size()));
+	}
+	std::stable_sort(mEntries.begin(), mEntries.end(), NameLess());
+}
+
+const StoreEntriesIndex::Indexed_t *StoreEntriesIndex::Find(
+	const BackupStoreFilename &rName) const
+{
+	// The last of any entries with the same name, as it was the last
+	// one added to the directory
+	std::vector<Indexed_t>::const_iterator i(std::upper_bound(
+		mEntries.begin(), mEntries.end(), rName, NameLess()));
+	if(i == mEntries.begin() || !(i - 1)->first->NameMatches(rName))
+	{
+		return NULL;
+	}
+	return &(*(i - 1));
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    StoreEntriesIndex::Find(const BackupStoreFilenameClear &, const std::string &, unsigned int &)
+//		Purpose: Returns the entry for a local name, and sets
+//			 rPositionOut to its position in the directory, or
+//			 returns NULL if there isn't one. Names can also be
+//			 stored in the clear, when the server fixes a broken
+//			 store and makes up names for the files it finds, so
+//			 those are looked for too. If both are there, the
+//			 later one in the directory wins, as it always has.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupStoreDirectory::Entry *StoreEntriesIndex::Find(
+	const BackupStoreFilenameClear &rName, const std::string &rClearName,
+	unsigned int &rPositionOut) const
+{
+	if(mEntries.empty())
+	{
+		return NULL;
+	}
+
+	const Indexed_t *pfound = Find(rName);
+
+	BackupStoreFilename clear;
+	clear.SetAsClearFilename(rClearName.c_str());
+	const Indexed_t *pclear = Find(clear);
+	if(pclear != NULL && (pfound == NULL || pclear->second > pfound->second))
+	{
+		pfound = pclear;
+	}
+
+	if(pfound == NULL)
+	{
+		return NULL;
+	}
+	rPositionOut = pfound->second;
+	return pfound->first;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    StoreEntriesIndex::ForgetLeftOverEntry(std::vector<BackupStoreDirectory::Entry *> &, BackupStoreDirectory::Entry *, unsigned int)
+//		Purpose: Static. Zeros an entry in the ones left over, which
+//			 are in the directory's order, looking first at the
+//			 position Find() gave for it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void StoreEntriesIndex::ForgetLeftOverEntry(
+	std::vector<BackupStoreDirectory::Entry *> &rEntriesLeftOver,
+	BackupStoreDirectory::Entry *pEntry, unsigned int PositionHint)
+{
+	if(PositionHint < rEntriesLeftOver.size() &&
+		rEntriesLeftOver[PositionHint] == pEntry)
+	{
+		rEntriesLeftOver[PositionHint] = 0;
+		return;
+	}
+
+	for(unsigned int l = 0; l < rEntriesLeftOver.size(); ++l)
+	{
+		if(rEntriesLeftOver[l] == pEntry)
+		{
+			rEntriesLeftOver[l] = 0;
+			break;
+		}
+	}
+}
 
 // --------------------------------------------------------------------------
 //
@@ -178,6 +293,12 @@ void BackupClientDirectoryRecord::SyncDirectory(
 	// with badly out of sync clocks.
 	rParams.mUploadAfterThisTimeInTheFuture = GetCurrentBoxTime() +
 		rParams.mMaxFileTimeInFuture;
+
+	// Get the contents of the directory, which may have been read in
+	// advance by the scanner threads
+	std::auto_ptr<BackupClientDirectoryScanner::Directory> apScanned(
+		rParams.mScanner.GetDirectory(rLocalPath, rContext));
+	BackupClientDirectoryScanner::Directory &rScanned(*apScanned);
 	
 	// Build the current state checksum to compare against while
 	// getting info from dirs. Note checksum is used locally only,
@@ -189,7 +310,7 @@ void BackupClientDirectoryRecord::SyncDirectory(
 	// If it's a symbolic link, we want the link target here
 	// (as we're about to back up the contents of the directory)
 	{
-		if(EMU_STAT(rLocalPath.c_str(), &dest_st) != 0)
+		if(rScanned.Stat(dest_st) != 0)
 		{
 			// The directory has probably been deleted, so
 			// just ignore this error. In a future scan, this
@@ -252,8 +373,7 @@ void BackupClientDirectoryRecord::SyncDirectory(
 		}
 		else
 		{
-				BackupClientFileAttributes::FillExtendedAttr(xattr,
-				rLocalPath.c_str());
+			xattr.Set(rScanned.GetExtendedAttr());
 		}
 		currentStateChecksum.Add(xattr.GetBuffer(), xattr.GetSize());
 	}
@@ -267,72 +387,63 @@ void BackupClientDirectoryRecord::SyncDirectory(
 	// BLOCK
 	{
 		// read the contents...
-		DIR *dirHandle = 0;
-		try
-		{
-			rNotifier.NotifyScanDirectory(this, local_path_non_vss);
+		rNotifier.NotifyScanDirectory(this, local_path_non_vss);
 
-			dirHandle = ::opendir(rLocalPath.c_str());
-			if(dirHandle == 0)
+		if(rScanned.OpenEntries() != 0)
+		{
+			// Report the error (logs and eventual email to administrator)
+			if (errno == EACCES)
 			{
-				// Report the error (logs and eventual email to administrator)
-				if (errno == EACCES)
-				{
-					rNotifier.NotifyDirListFailed(this, local_path_non_vss,
-						"Access denied");
-				}
-				else
-				{
-					rNotifier.NotifyDirListFailed(this, local_path_non_vss,
-						strerror(errno));
-				}
+				rNotifier.NotifyDirListFailed(this, local_path_non_vss,
+					"Access denied");
+			}
+			else
+			{
+				rNotifier.NotifyDirListFailed(this, local_path_non_vss,
+					strerror(errno));
+			}
 
-				SetErrorWhenReadingFilesystemObject(rParams, local_path_non_vss);
+			SetErrorWhenReadingFilesystemObject(rParams, local_path_non_vss);
 
-				// Ignore this directory for now.
-				return;
-			}
+			// Ignore this directory for now.
+			return;
+		}
 
-			struct dirent *en = 0;
-			int num_entries_found = 0;
+		int num_entries_found = 0;
 
-			while((en = ::readdir(dirHandle)) != 0)
+		BackupClientDirectoryScanner::Entry *pEntry;
+		while((pEntry = rScanned.NextEntry()) != 0)
+		{
+			num_entries_found++;
+			rParams.mrContext.DoKeepAlive();
+			if(rParams.mpBackgroundTask)
 			{
-				num_entries_found++;
-				rParams.mrContext.DoKeepAlive();
-				if(rParams.mpBackgroundTask)
-				{
-					rParams.mpBackgroundTask->RunBackgroundTask(
-						BackgroundTask::Scanning_Dirs,
-						num_entries_found, 0);
-				}
-
-				if (!SyncDirectoryEntry(rParams, rNotifier,
-					rBackupLocation, rLocalPath,
-					currentStateChecksum, en, dest_st, dirs,
-					files, downloadDirectoryRecordBecauseOfFutureFiles))
-				{
-					// This entry is not to be backed up.
-					continue;
-				}
+				rParams.mpBackgroundTask->RunBackgroundTask(
+					BackgroundTask::Scanning_Dirs,
+					num_entries_found, 0);
 			}
-	
-			if(::closedir(dirHandle) != 0)
+
+			if (!SyncDirectoryEntry(rParams, rNotifier,
+				rBackupLocation, rLocalPath,
+				currentStateChecksum, *pEntry,
+				dest_st, dirs, files,
+				downloadDirectoryRecordBecauseOfFutureFiles))
 			{
-				THROW_EXCEPTION(CommonException, OSFileError)
+				// This entry is not to be backed up.
+				continue;
 			}
-			dirHandle = 0;
 		}
-		catch(...)
+
+		if(rScanned.CloseFailed())
 		{
-			if(dirHandle != 0)
-			{
-				::closedir(dirHandle);
-			}
-			throw;
+			THROW_EXCEPTION(CommonException, OSFileError)
 		}
 	}
 
+	// Let the scanner threads read the subdirectories while this one
+	// is synced
+	rParams.mScanner.Prefetch(rLocalPath, rScanned, dirs);
+
 	// Finish off the checksum, and compare with the one currently stored
 	bool checksumDifferent = true;
 	currentStateChecksum.Finish();
@@ -422,7 +533,7 @@ void BackupClientDirectoryRecord::SyncDirectory(
 		// Do the directory reading
 		bool updateCompleteSuccess = UpdateItems(rParams, rLocalPath,
 			rRemotePath, rBackupLocation, apDirOnStore.get(),
-			entriesLeftOver, files, dirs);
+			entriesLeftOver, files, dirs, rScanned);
 		
 		// LAST THING! (think exception safety)
 		// Store the new checksum -- don't fetch things unnecessarily
@@ -468,13 +579,13 @@ bool BackupClientDirectoryRecord::SyncDirectoryEntry(
 	const Location& rBackupLocation,
 	const std::string &rDirLocalPath,
 	MD5Digest& currentStateChecksum,
-	struct dirent *en,
+	BackupClientDirectoryScanner::Entry &rEntry,
 	EMU_STRUCT_STAT dir_st,
 	std::set<std::string>& rDirs,
 	std::set<std::string>& rFiles,
 	bool& rDownloadDirectoryRecordBecauseOfFutureFiles)
 {
-	std::string entry_name = en->d_name;
+	const std::string &entry_name(rEntry.GetName());
 	if(entry_name == "." || entry_name == "..")
 	{
 		// ignore parent directory entries
@@ -496,7 +607,7 @@ bool BackupClientDirectoryRecord::SyncDirectoryEntry(
 	// have the full file attributes.
 
 	int type;
-	if (en->d_type & FILE_ATTRIBUTE_DIRECTORY)
+	if (rEntry.GetDirentType() & FILE_ATTRIBUTE_DIRECTORY)
 	{
 		type = S_IFDIR;
 	}
@@ -507,7 +618,7 @@ bool BackupClientDirectoryRecord::SyncDirectoryEntry(
 #else // !WIN32
 
 	
-	if(EMU_LSTAT(filename.c_str(), &file_st) != 0)
+	if(rEntry.Lstat(filename, file_st) != 0)
 	{
 		// We don't know whether it's a file or a directory, so check
 		// both. This only affects whether a warning message is
@@ -608,7 +719,7 @@ bool BackupClientDirectoryRecord::SyncDirectoryEntry(
 		// parent directory under Vista and later, and causes an
 		// infinite loop:
 		// http://social.msdn.microsoft.com/forums/en-US/windowscompatibility/thread/05d14368-25dd-41c8-bdba-5590bf762a68/
-		if (en->d_type & FILE_ATTRIBUTE_REPARSE_POINT)
+		if (rEntry.GetDirentType() & FILE_ATTRIBUTE_REPARSE_POINT)
 		{
 			rNotifier.NotifyMountPointSkipped(this, realFileName);
 			return false;
@@ -681,7 +792,7 @@ bool BackupClientDirectoryRecord::SyncDirectoryEntry(
 	checksum_info.mAttributeModificationTime = FileAttrModificationTime(file_st);
 	checksum_info.mSize = file_st.st_size;
 	currentStateChecksum.Add(&checksum_info, sizeof(checksum_info));
-	currentStateChecksum.Add(en->d_name, strlen(en->d_name));
+	currentStateChecksum.Add(entry_name.c_str(), entry_name.size());
 	
 	// If the file has been modified madly into the future, download the 
 	// directory record anyway to ensure that it doesn't get uploaded
@@ -847,42 +958,26 @@ bool BackupClientDirectoryRecord::UpdateItems(
 	BackupStoreDirectory *pDirOnStore,
 	std::vector<BackupStoreDirectory::Entry *> &rEntriesLeftOver,
 	std::set<std::string> &rFiles,
-	const std::set<std::string> &rDirs)
+	const std::set<std::string> &rDirs,
+	BackupClientDirectoryScanner::Directory &rScanned)
 {
 	BackupClientContext& rContext(rParams.mrContext);
 	ProgressNotifier& rNotifier(rContext.GetProgressNotifier());
 
 	bool allUpdatedSuccessfully = true;
 
-	// Decrypt all the directory entries.
-	// It would be nice to be able to just compare the encrypted versions, however this doesn't work
-	// in practise because there can be multiple encodings of the same filename using different
-	// methods (although each method will result in the same string for the same filename.) This
-	// happens when the server fixes a broken store, and gives plain text generated filenames.
-	// So if we didn't do things like this, then you wouldn't be able to recover from bad things
-	// happening with the server.
-	DecryptedEntriesMap_t decryptedEntries;
-	if(pDirOnStore != NULL)
-	{
-		BackupStoreDirectory::Iterator i(*pDirOnStore);
-		BackupStoreDirectory::Entry *en = NULL;
-		while((en = i.Next()) != NULL)
-		{
-			std::string filenameClear;
-			try
-			{
-				filenameClear = DecryptFilename(en,
-					rRemotePath);
-				decryptedEntries[filenameClear] = en;
-			}
-			catch (CipherException &e)
-			{
-				BOX_ERROR("Failed to decrypt a filename, "
-					"pretending that the file doesn't "
-					"exist");
-			}
-		}
-	}
+	// Index the directory entries by their encoded names, rather than
+	// decrypting them all
+	StoreEntriesIndex entriesOnStore(pDirOnStore);
+
+	// Attribute changes are sent without waiting for the reply, so that
+	// many of them cost one round trip to the server rather than one each.
+	std::deque<AttributesSent> attributesSent;
+
+	// Small files are sent together, to save a round trip and a
+	// directory rewrite on the server for each one.
+	std::vector<BatchedFile> uploadBatch;
+	std::auto_ptr<CollectInBufferStream> apUploadBatchData;
 
 	// Do files
 	for(std::set<std::string>::const_iterator f = rFiles.begin();
@@ -903,9 +998,9 @@ bool BackupClientDirectoryRecord::UpdateItems(
 		InodeRefType inodeNum = 0;
 		// BLOCK
 		{
-			
 			// if we need to resolve the link...
 			EMU_STRUCT_STAT st;
+			bool linkFollowed = false;
 			if(EMU_LSTAT(filename.c_str(), &st) != 0)
 			{	
 				// Report the error (logs and eventual email to administrator)
@@ -939,13 +1034,33 @@ bool BackupClientDirectoryRecord::UpdateItems(
 				path[readlink_ret] = '\0';
 				filename = path;
 				nonVssFilePath = ConvertVssPathToRealPath(filename, rBackupLocation);
+				linkFollowed = true;
+			}
+
+			// The extended attributes read in advance can be
+			// used if the file hasn't changed since, but not
+			// for a link's target, as they were the link's own
+			BackupClientDirectoryScanner::Entry *pentry =
+				rScanned.FindEntry(*f);
+			if(pentry != NULL && (linkFollowed ||
+				!pentry->StatMatches(st)))
+			{
+				pentry = NULL;
 			}
 			
 			// Extract required data
 			modTime = FileModificationTime(st);
 			fileSize = st.st_size;
 			inodeNum = st.st_ino;
-			attributesHash = BackupClientFileAttributes::GenerateAttributeHash(st, filename, *f);
+			if(pentry != NULL)
+			{
+				attributesHash = BackupClientFileAttributes::GenerateAttributeHash(
+					st, pentry->GetExtendedAttr(filename), *f);
+			}
+			else
+			{
+				attributesHash = BackupClientFileAttributes::GenerateAttributeHash(st, filename, *f);
+			}
 		}
 
 		// See if it's in the listing (if we have one)
@@ -953,13 +1068,13 @@ bool BackupClientDirectoryRecord::UpdateItems(
 
 
 		BackupStoreDirectory::Entry *en = NULL;
+		unsigned int enPosition = 0;
 		int64_t latestObjectID = 0;
 		if(pDirOnStore != NULL)
 		{
-			DecryptedEntriesMap_t::iterator i(decryptedEntries.find(*f));
-			if(i != decryptedEntries.end())
+			en = entriesOnStore.Find(storeFilename, *f, enPosition);
+			if(en != NULL)
 			{
-				en = i->second;
 				latestObjectID = en->GetObjectID();
 			}
 		}
@@ -1128,6 +1243,7 @@ bool BackupClientDirectoryRecord::UpdateItems(
 			" (" << decisionReason << ")");
 
 		bool fileSynced = true;
+		bool uploadBatched = false;
 
 		if(doUpload)
 		{
@@ -1152,27 +1268,59 @@ bool BackupClientDirectoryRecord::UpdateItems(
 				// Surround this in a try/catch block, to
 				// catch errors, but still continue
 				bool uploadSuccess = false;
+
+				// Files which won't be diffed can wait to be
+				// sent with others, and are reported when the
+				// batch has been stored.
+				bool canBatch =
+					rContext.GetMaxFilesPerUpload() > 1 &&
+					(uint64_t)fileSize <= rParams.mBatchedUploadMaxSize &&
+					((uint64_t)fileSize < rParams.mDiffingUploadSizeThreshold ||
+					 (noPreviousVersionOnServer &&
+					  !rContext.CanFindBlocksInOtherFiles()));
+
 				try
 				{
-					latestObjectID = UploadFile(rParams,
-						filename,
-						nonVssFilePath,
-						rRemotePath + "/" + *f,
-						storeFilename,
-						fileSize, modTime,
-						attributesHash,
-						noPreviousVersionOnServer);
-
-					if(latestObjectID == 0)
+					if(canBatch)
 					{
-						// storage limit exceeded
-						rParams.mrContext.SetStorageLimitExceeded();
-						uploadSuccess = false;
-						allUpdatedSuccessfully = false;
+						BatchedFile batched;
+						batched.mLeafName = *f;
+						batched.mInodeNum = inodeNum;
+						batched.mWasPending =
+							(pendingFirstSeenTime != 0);
+						AddToUploadBatch(rParams,
+							filename,
+							nonVssFilePath,
+							rRemotePath + "/" + *f,
+							storeFilename,
+							fileSize, modTime,
+							attributesHash, batched,
+							uploadBatch,
+							apUploadBatchData);
+						uploadBatched = true;
 					}
 					else
 					{
-						uploadSuccess = true;
+						latestObjectID = UploadFile(rParams,
+							filename,
+							nonVssFilePath,
+							rRemotePath + "/" + *f,
+							storeFilename,
+							fileSize, modTime,
+							attributesHash,
+							noPreviousVersionOnServer);
+
+						if(latestObjectID == 0)
+						{
+							// storage limit exceeded
+							rParams.mrContext.SetStorageLimitExceeded();
+							uploadSuccess = false;
+							allUpdatedSuccessfully = false;
+						}
+						else
+						{
+							uploadSuccess = true;
+						}
 					}
 				}
 				catch(ConnectionException &e)
@@ -1217,6 +1365,16 @@ bool BackupClientDirectoryRecord::UpdateItems(
 						mpPendingEntries->erase(*f);
 					}
 				}
+
+				if(uploadBatched && (int)uploadBatch.size() >=
+					rContext.GetMaxFilesPerUpload())
+				{
+					if(!UploadBatchedFiles(rParams, uploadBatch,
+						apUploadBatchData))
+					{
+						allUpdatedSuccessfully = false;
+					}
+				}
 			}
 			else
 			{
@@ -1238,6 +1396,11 @@ bool BackupClientDirectoryRecord::UpdateItems(
 			// space available
 			if(!rContext.StorageLimitExceeded())
 			{
+				// Reported as synchronised by
+				// CollectAttributesReplies(), if and when
+				// the store accepts the change
+				fileSynced = false;
+
 				try
 				{
 					rNotifier.NotifyFileUploadingAttributes(this,
@@ -1249,8 +1412,14 @@ bool BackupClientDirectoryRecord::UpdateItems(
 						false /* put mod times in the attributes, please */);
 					std::auto_ptr<IOStream> attrStream(
 						new MemBlockStream(attr));
-					connection.QuerySetReplacementFileAttributes(mObjectID, attributesHash, storeFilename, attrStream);
-					fileSynced = true;
+					connection.SendAsyncSetReplacementFileAttributes(
+						mObjectID, attributesHash, storeFilename,
+						attrStream);
+
+					AttributesSent sent;
+					sent.mNonVssFilePath = nonVssFilePath;
+					sent.mFileSize = fileSize;
+					attributesSent.push_back(sent);
 				}
 				catch (BoxException &e)
 				{
@@ -1258,6 +1427,11 @@ bool BackupClientDirectoryRecord::UpdateItems(
 						"for '" << nonVssFilePath << "', will try again "
 						"later");
 				}
+
+				// Outside the try block, so that a failed
+				// connection isn't mistaken for a failed file
+				CollectAttributesReplies(rContext, attributesSent,
+					connection.GetMaxCommandsInFlight() - 1);
 			}
 		}
 
@@ -1280,18 +1454,13 @@ bool BackupClientDirectoryRecord::UpdateItems(
 		// Zero pointer in rEntriesLeftOver, if we have a pointer to zero
 		if(en != 0)
 		{
-			for(unsigned int l = 0; l < rEntriesLeftOver.size(); ++l)
-			{
-				if(rEntriesLeftOver[l] == en)
-				{
-					rEntriesLeftOver[l] = 0;
-					break;
-				}
-			}
+			StoreEntriesIndex::ForgetLeftOverEntry(rEntriesLeftOver, en, enPosition);
 		}
 		
-		// Does this file need an entry in the ID map?
-		if(fileSize >= rParams.mFileTrackingSizeThreshold)
+		// Does this file need an entry in the ID map? Batched
+		// files are added when their IDs are known.
+		if((uint64_t)fileSize >= rParams.mFileTrackingSizeThreshold &&
+			!uploadBatched)
 		{
 			// Get the map
 			BackupClientInodeToIDMap &idMap(rContext.GetNewIDMap());
@@ -1348,6 +1517,15 @@ bool BackupClientDirectoryRecord::UpdateItems(
 		}
 	}
 
+	// Send the files still waiting to be uploaded
+	if(!UploadBatchedFiles(rParams, uploadBatch, apUploadBatchData))
+	{
+		allUpdatedSuccessfully = false;
+	}
+
+	// Wait for any attribute changes still in flight
+	CollectAttributesReplies(rContext, attributesSent, 0);
+
 	// Erase contents of files to save space when recursing
 	rFiles.clear();
 
@@ -1415,13 +1593,10 @@ bool BackupClientDirectoryRecord::UpdateItems(
 		// See if it's in the listing (if we have one)
 		BackupStoreFilenameClear storeFilename(*d);
 		BackupStoreDirectory::Entry *en = 0;
+		unsigned int enPosition = 0;
 		if(pDirOnStore != 0)
 		{
-			DecryptedEntriesMap_t::iterator i(decryptedEntries.find(*d));
-			if(i != decryptedEntries.end())
-			{
-				en = i->second;
-			}
+			en = entriesOnStore.Find(storeFilename, *d, enPosition);
 		}
 		
 		// Check that the entry which might have been found is in fact a directory
@@ -1444,14 +1619,7 @@ bool BackupClientDirectoryRecord::UpdateItems(
 		// Zero pointer in rEntriesLeftOver, if we have a pointer to zero
 		if(en != 0)
 		{
-			for(unsigned int l = 0; l < rEntriesLeftOver.size(); ++l)
-			{
-				if(rEntriesLeftOver[l] == en)
-				{
-					rEntriesLeftOver[l] = 0;
-					break;
-				}
-			}
+			StoreEntriesIndex::ForgetLeftOverEntry(rEntriesLeftOver, en, enPosition);
 		}
 
 		// Flag for having created directory, so can optimise the
@@ -1868,6 +2036,68 @@ int64_t BackupClientDirectoryRecord::CreateRemoteDir(const std::string& localDir
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryRecord::CollectAttributesReplies(
+//			 BackupClientContext &, std::deque<AttributesSent> &,
+//			 int)
+//		Purpose: Collects the replies to SetReplacementFileAttributes
+//			 commands sent by UpdateItems(), oldest first, until
+//			 no more than MaxLeftUncollected remain. Each file is
+//			 reported as synchronised, or logged as failed to be
+//			 tried again on the next run if the store refused it.
+//			 Any other failure is rethrown, as the connection
+//			 can't be used any more.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryRecord::CollectAttributesReplies(
+	BackupClientContext &rContext, std::deque<AttributesSent> &rSent,
+	int MaxLeftUncollected)
+{
+	if(rSent.empty())
+	{
+		return;
+	}
+
+	BackupProtocolCallable &connection(rContext.GetConnection());
+	ProgressNotifier& rNotifier(rContext.GetProgressNotifier());
+
+	while((int)rSent.size() > MaxLeftUncollected)
+	{
+		AttributesSent sent(rSent.front());
+		rSent.pop_front();
+
+		try
+		{
+			connection.CollectReply();
+		}
+		catch (ConnectionException &e)
+		{
+			// An error reply means that the store refused this
+			// change, and the connection is still good. Anything
+			// else means that the replies to the rest can't be
+			// trusted either, so give up on them all.
+			int type, subtype;
+			if(e.GetSubType() != ConnectionException::Protocol_UnexpectedReply ||
+				!connection.GetLastError(type, subtype) ||
+				type != BackupProtocolError::ErrorType)
+			{
+				throw;
+			}
+
+			BOX_ERROR("Failed to store file attributes for '" <<
+				sent.mNonVssFilePath << "', will try again "
+				"later: " << e.what());
+			continue;
+		}
+
+		rNotifier.NotifyFileSynchronised(this, sent.mNonVssFilePath,
+			sent.mFileSize);
+	}
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1908,6 +2138,77 @@ void BackupClientDirectoryRecord::RemoveDirectoryInPlaceOfFile(
 
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    MakeBlockFingerprintStream(const std::vector<uint64_t> &)
+//		Purpose: Returns a stream of block fingerprints to send with
+//			 AddBlockFingerprints or FindBlockFingerprints
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static std::auto_ptr<IOStream> MakeBlockFingerprintStream(
+	const std::vector<uint64_t> &rFingerprints)
+{
+	std::auto_ptr<CollectInBufferStream> stream(new CollectInBufferStream);
+	for(std::vector<uint64_t>::const_iterator i = rFingerprints.begin();
+		i != rFingerprints.end(); ++i)
+	{
+		uint64_t fingerprint = box_hton64(*i);
+		stream->Write(&fingerprint, sizeof(fingerprint));
+	}
+	stream->SetForReading();
+	return std::auto_ptr<IOStream>(stream.release());
+}
+
+
+// How many blocks at the start of a new file are looked for in other files
+// on the server, see FindFileWithSameBlocks()
+#define MAX_BLOCKS_TO_FIND_IN_OTHER_FILES	16
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    FindFileWithSameBlocks(BackupProtocolCallable &,
+//			 const std::vector<uint64_t> &)
+//		Purpose: Asks the server which files contain the blocks,
+//			 and returns the ID of the one containing most of
+//			 them, or 0 if none contains any.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static int64_t FindFileWithSameBlocks(BackupProtocolCallable &rConnection,
+	const std::vector<uint64_t> &rFingerprints)
+{
+	std::auto_ptr<BackupProtocolSuccess> found(
+		rConnection.QueryFindBlockFingerprints(
+			MakeBlockFingerprintStream(rFingerprints)));
+	std::auto_ptr<IOStream> ids(rConnection.ReceiveStream());
+
+	std::map<int64_t, int64_t> blocksInFile;
+	int64_t bestID = 0;
+	for(int64_t n = 0; n < found->GetObjectID(); ++n)
+	{
+		int64_t id;
+		if(!ids->ReadFullBuffer(&id, sizeof(id), 0, rConnection.GetTimeout()))
+		{
+			THROW_EXCEPTION(BackupStoreException, BadBlockFingerprintStream)
+		}
+		id = box_ntoh64(id);
+		if(id == 0)
+		{
+			continue;
+		}
+		if(++blocksInFile[id] > blocksInFile[bestID])
+		{
+			bestID = id;
+		}
+	}
+
+	return bestID;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1951,8 +2252,8 @@ int64_t BackupClientDirectoryRecord::UploadFile(
 		// Might an old version be on the server, and is the file
 		// size over the diffing threshold?
 		if(!NoPreviousVersionOnServer &&
-			(rParams.mDiffingUploadMaxSizeThreshold == 0 || FileSize <= rParams.mDiffingUploadMaxSizeThreshold) &&
-			FileSize >= rParams.mDiffingUploadSizeThreshold)
+			(rParams.mDiffingUploadMaxSizeThreshold == 0 || (uint64_t)FileSize <= rParams.mDiffingUploadMaxSizeThreshold) &&
+			(uint64_t)FileSize >= rParams.mDiffingUploadSizeThreshold)
 		{
 			// YES -- try to do diff, if possible
 			// First, query the server to see if there's an old version available
@@ -1993,6 +2294,49 @@ int64_t BackupClientDirectoryRecord::UploadFile(
 			}
 		}
 
+		// No older version of this file, but another file on the
+		// server might have the same blocks, if it's a copy. Only
+		// the first few blocks are read to look for it.
+		if(!apStreamToUpload.get() &&
+			rContext.CanFindBlocksInOtherFiles() &&
+			(rParams.mDiffingUploadMaxSizeThreshold == 0 || (uint64_t)FileSize <= rParams.mDiffingUploadMaxSizeThreshold) &&
+			(uint64_t)FileSize >= rParams.mDiffingUploadSizeThreshold)
+		{
+			std::vector<uint64_t> fingerprints;
+			BackupStoreFile::CalculateBlockFingerprints(rLocalPath,
+				fingerprints, MAX_BLOCKS_TO_FIND_IN_OTHER_FILES);
+			int64_t otherFileID = fingerprints.empty() ? 0 :
+				FindFileWithSameBlocks(connection, fingerprints);
+			if(otherFileID != 0)
+			{
+				BOX_TRACE("Diffing " << rNonVssFilePath <<
+					" against other file " <<
+					BOX_FORMAT_OBJECTID(otherFileID));
+
+				std::auto_ptr<BackupProtocolSuccess> getBlockIndex(
+					connection.QueryGetBlockIndexByID(otherFileID));
+				std::auto_ptr<IOStream> blockIndexStream(connection.ReceiveStream());
+
+				rContext.ManageDiffProcess();
+
+				bool isCompletelyDifferent = false;
+
+				apStreamToUpload = BackupStoreFile::EncodeFileDiff(
+					rLocalPath,
+					mObjectID, /* containing directory */
+					rStoreFilename, otherFileID, *blockIndexStream,
+					connection.GetTimeout(),
+					&rContext, // DiffTimer implementation
+					0 /* not interested in the modification time */, 
+					&isCompletelyDifferent,
+					rParams.mpBackgroundTask);
+
+				diffFromID = isCompletelyDifferent ? 0 : otherFileID;
+
+				rContext.UnManageDiffProcess();
+			}
+		}
+
 		if(apStreamToUpload.get())
 		{
 			rNotifier.NotifyFileUploadingPatch(this, rNonVssFilePath,
@@ -2022,6 +2366,13 @@ int64_t BackupClientDirectoryRecord::UploadFile(
 				rParams.mpBackgroundTask);
 		}
 
+		// So that other files can find the blocks in this one once
+		// it's uploaded, as the server will store them
+		if(rContext.CanFindBlocksInOtherFiles())
+		{
+			apStreamToUpload->CollectBlockFingerprints();
+		}
+
 		rContext.SetNiceMode(true);
 		std::auto_ptr<IOStream> apWrappedStream;
 
@@ -2092,10 +2443,18 @@ int64_t BackupClientDirectoryRecord::UploadFile(
 
 		// done with the resume
 		resumeInfos.Clear();
+
+		if(!apStreamToUpload->GetBlockFingerprints().empty())
+		{
+			connection.QueryAddBlockFingerprints(objID,
+				MakeBlockFingerprintStream(
+					apStreamToUpload->GetBlockFingerprints()));
+		}
 	}
 	catch(BoxException &e)
 	{
 		rContext.UnManageDiffProcess();
+		rContext.SetNiceMode(false);
 
 		if(e.GetType() == ConnectionException::ExceptionType &&
 			e.GetSubType() == ConnectionException::Protocol_UnexpectedReply)
@@ -2155,6 +2514,247 @@ int64_t BackupClientDirectoryRecord::UploadFile(
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryRecord::AddToUploadBatch(
+//			 SyncParams &, const std::string &,
+//			 const std::string &, const std::string &,
+//			 const BackupStoreFilenameClear &, int64_t,
+//			 box_time_t, box_time_t, BatchedFile &,
+//			 std::vector<BatchedFile> &,
+//			 std::auto_ptr<CollectInBufferStream> &)
+//		Purpose: Private. Encode a small file, and add it to the
+//			 files waiting to be sent by UploadBatchedFiles(),
+//			 in the format StoreFiles expects. The caller fills
+//			 in the parts of rFile which it knows about.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryRecord::AddToUploadBatch(SyncParams &rParams,
+	const std::string &rLocalPath,
+	const std::string &rNonVssFilePath,
+	const std::string &rRemotePath,
+	const BackupStoreFilenameClear &rStoreFilename,
+	int64_t FileSize,
+	box_time_t ModificationTime,
+	box_time_t AttributesHash,
+	BatchedFile &rFile,
+	std::vector<BatchedFile> &rBatch,
+	std::auto_ptr<CollectInBufferStream> &rapBatchData)
+{
+	BackupClientContext& rContext(rParams.mrContext);
+	ProgressNotifier& rNotifier(rContext.GetProgressNotifier());
+
+	// if rNonVssFilePath does not contains rRemotePath
+	// this may be a link
+	if(rNonVssFilePath.find(rRemotePath) == std::string::npos)
+	{
+		rNotifier.NotifyFileUploading(this, rNonVssFilePath + " as " + rRemotePath);
+	}
+	else
+	{
+		rNotifier.NotifyFileUploading(this, rNonVssFilePath);
+	}
+
+	// Encode the whole file before adding any of it to the batch, in
+	// case it can't be read. The blocks are fingerprinted as they're
+	// encoded, so that other files can find them.
+	CollectInBufferStream encoded;
+	std::vector<uint64_t> fingerprints;
+	{
+		std::auto_ptr<BackupStoreFileEncodeStream> apEncoded(
+			BackupStoreFile::EncodeFile(
+				rLocalPath, mObjectID, /* containing directory */
+				rStoreFilename, NULL, &rParams,
+				&(rParams.mrRunStatusProvider),
+				rParams.mpBackgroundTask));
+		if(rContext.CanFindBlocksInOtherFiles())
+		{
+			apEncoded->CollectBlockFingerprints();
+		}
+		apEncoded->CopyStreamTo(encoded);
+		fingerprints = apEncoded->GetBlockFingerprints();
+	}
+
+	if(!rapBatchData.get())
+	{
+		rapBatchData.reset(new CollectInBufferStream);
+	}
+
+	Archive archive(*rapBatchData, IOStream::TimeOutInfinite);
+	archive.Write((int64_t)ModificationTime);
+	archive.Write((int64_t)AttributesHash);
+	rStoreFilename.WriteToStream(*rapBatchData);
+	archive.Write((int64_t)fingerprints.size());
+	for(std::vector<uint64_t>::const_iterator i = fingerprints.begin();
+		i != fingerprints.end(); ++i)
+	{
+		archive.Write(*i);
+	}
+	archive.Write((int64_t)encoded.GetSize());
+	rapBatchData->Write(encoded.GetBuffer(), encoded.GetSize());
+
+	rFile.mNonVssFilePath = rNonVssFilePath;
+	rFile.mFileSize = FileSize;
+	rFile.mEncodedSize = encoded.GetSize();
+	rBatch.push_back(rFile);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryRecord::UploadBatchedFiles(
+//			 SyncParams &, std::vector<BatchedFile> &,
+//			 std::auto_ptr<CollectInBufferStream> &)
+//		Purpose: Private. Send the files added by AddToUploadBatch()
+//			 to the server, and record them as UpdateItems() does
+//			 for files uploaded one at a time. Returns false if
+//			 the batch was not stored, because the server is
+//			 full or the upload failed without breaking the
+//			 connection. Either way, the batch is empty
+//			 afterwards.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupClientDirectoryRecord::UploadBatchedFiles(SyncParams &rParams,
+	std::vector<BatchedFile> &rBatch,
+	std::auto_ptr<CollectInBufferStream> &rapBatchData)
+{
+	if(rBatch.empty())
+	{
+		return true;
+	}
+
+	BackupClientContext& rContext(rParams.mrContext);
+	ProgressNotifier& rNotifier(rContext.GetProgressNotifier());
+	BackupProtocolCallable &connection(rContext.GetConnection());
+
+	std::vector<BatchedFile> batch;
+	batch.swap(rBatch);
+	std::auto_ptr<CollectInBufferStream> apData(rapBatchData);
+	apData->SetForReading();
+
+	std::auto_ptr<IOStream> apStreamToSend;
+	if(rParams.mMaxUploadRate > 0)
+	{
+		apStreamToSend.reset(new RateLimitingStream(*apData,
+			rParams.mMaxUploadRate));
+	}
+	else
+	{
+		apStreamToSend.reset(apData.release());
+	}
+
+	std::vector<int64_t> ids;
+	try
+	{
+		rContext.SetNiceMode(true);
+		std::auto_ptr<BackupProtocolSuccess> stored(
+			connection.QueryStoreFiles(mObjectID, batch.size(),
+				apStreamToSend));
+		std::auto_ptr<IOStream> idStream(connection.ReceiveStream());
+		rContext.SetNiceMode(false);
+
+		if(stored->GetObjectID() != (int64_t)batch.size())
+		{
+			THROW_EXCEPTION(BackupStoreException,
+				BadStoreFilesStream)
+		}
+
+		Archive archive(*idStream, connection.GetTimeout());
+		for(size_t n = 0; n < batch.size(); ++n)
+		{
+			int64_t id;
+			archive.Read(id);
+			ids.push_back(id);
+		}
+	}
+	catch(BoxException &e)
+	{
+		rContext.SetNiceMode(false);
+
+		int type, subtype;
+		if(e.GetType() == ConnectionException::ExceptionType &&
+			e.GetSubType() == ConnectionException::Protocol_UnexpectedReply &&
+			connection.GetLastError(type, subtype) &&
+			type == BackupProtocolError::ErrorType)
+		{
+			if(subtype == BackupProtocolError::Err_StorageLimitExceeded)
+			{
+				// The hard limit was exceeded on the server,
+				// notify! The files will be tried again
+				// when there's space.
+				rContext.SetStorageLimitExceeded();
+				rParams.mrSysadminNotifier.NotifySysadmin(
+					SysadminNotifier::StoreFull);
+				return false;
+			}
+
+			// The server refused the batch, but the connection
+			// is still usable, so carry on with the rest of the
+			// directory. The files will be tried again next time.
+			for(std::vector<BatchedFile>::const_iterator
+				i = batch.begin(); i != batch.end(); ++i)
+			{
+				rNotifier.NotifyFileUploadServerError(this,
+					i->mNonVssFilePath, type, subtype);
+			}
+			return false;
+		}
+
+		for(std::vector<BatchedFile>::const_iterator
+			i = batch.begin(); i != batch.end(); ++i)
+		{
+			rNotifier.NotifyFileUploadException(this,
+				i->mNonVssFilePath, e);
+		}
+
+		if(e.GetType() == ConnectionException::ExceptionType ||
+			(e.GetType() == BackupStoreException::ExceptionType &&
+			 e.GetSubType() == BackupStoreException::SignalReceived))
+		{
+			// Connection errors and abort requests are passed
+			// on to the main handler, as UpdateItems() does
+			// for files uploaded one at a time.
+			throw;
+		}
+
+		return false;
+	}
+
+	BackupClientInodeToIDMap &idMap(rContext.GetNewIDMap());
+	for(size_t n = 0; n < batch.size(); ++n)
+	{
+		const BatchedFile &file(batch[n]);
+		rNotifier.NotifyFileUploaded(this, file.mNonVssFilePath,
+			file.mFileSize, file.mEncodedSize, ids[n]);
+
+		if(file.mWasPending && mpPendingEntries != 0)
+		{
+			mpPendingEntries->erase(file.mLeafName);
+		}
+
+		if((uint64_t)file.mFileSize >= rParams.mFileTrackingSizeThreshold)
+		{
+			BOX_TRACE("Storing uploaded file ID " << file.mInodeNum <<
+				" (" << file.mNonVssFilePath << ") in ID map as "
+				"object " << BOX_FORMAT_OBJECTID(ids[n]) <<
+				" with parent " << BOX_FORMAT_OBJECTID(mObjectID));
+			idMap.AddToMap(file.mInodeNum, ids[n],
+				mObjectID /* containing directory */,
+				file.mNonVssFilePath);
+		}
+
+		rNotifier.NotifyFileSynchronised(this, file.mNonVssFilePath,
+			file.mFileSize);
+	}
+
+	return true;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -2205,6 +2805,7 @@ BackupClientDirectoryRecord::SyncParams::SyncParams(
   mMaxFileTimeInFuture(99999999999999999LL),
   mFileTrackingSizeThreshold(16*1024),
   mDiffingUploadSizeThreshold(16*1024),
+  mBatchedUploadMaxSize(0),
   mpBackgroundTask(pBackgroundTask),
   mrRunStatusProvider(rRunStatusProvider),
   mrSysadminNotifier(rSysadminNotifier),
@@ -2414,7 +3015,9 @@ void BackupClientDirectoryRecord::Serialize(Archive & rArchive) const
 //
 // --------------------------------------------------------------------------
 Location::Location()
-: mIDMapIndex(0)
+: mDoNotKeepDeletedFiles(false),
+  mDereferenceLinks(false),
+  mIDMapIndex(0)
 { }
 
 // --------------------------------------------------------------------------
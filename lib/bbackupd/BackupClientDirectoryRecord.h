@@ -10,12 +10,15 @@
 #ifndef BACKUPCLIENTDIRECTORYRECORD__H
 #define BACKUPCLIENTDIRECTORYRECORD__H
 
+#include <deque>
 #include <string>
 #include <map>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "BackgroundTask.h"
+#include "BackupClientDirectoryScanner.h"
 #include "BackupClientFileAttributes.h"
 #include "BackupDaemonInterface.h"
 #include "BackupStoreDirectory.h"
@@ -34,9 +37,55 @@
 class Archive;
 class BackupClientContext;
 class BackupDaemon;
+class BackupStoreFilenameClear;
+class CollectInBufferStream;
 class ExcludeList;
 class Location;
 
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    StoreEntriesIndex
+//		Purpose: The entries of a directory on the store, sorted by
+//			 encoded name. Filename encryption always gives the
+//			 same result for the same name, so local names can be
+//			 looked up by encrypting them, without decrypting any
+//			 of the names on the store.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class StoreEntriesIndex
+{
+public:
+	StoreEntriesIndex(BackupStoreDirectory *pDir);
+	BackupStoreDirectory::Entry *Find(const BackupStoreFilenameClear &rName,
+		const std::string &rClearName, unsigned int &rPositionOut) const;
+	static void ForgetLeftOverEntry(
+		std::vector<BackupStoreDirectory::Entry *> &rEntriesLeftOver,
+		BackupStoreDirectory::Entry *pEntry, unsigned int PositionHint);
+
+private:
+	// Each entry, and its position in the directory
+	typedef std::pair<BackupStoreDirectory::Entry *, unsigned int> Indexed_t;
+
+	const Indexed_t *Find(const BackupStoreFilename &rName) const;
+
+	struct NameLess
+	{
+		bool operator()(const Indexed_t &rA, const Indexed_t &rB) const
+		{
+			return rA.first->CompareName(*rB.first) < 0;
+		}
+		bool operator()(const BackupStoreFilename &rA,
+			const Indexed_t &rB) const
+		{
+			return rB.first->CompareName(rA) > 0;
+		}
+	};
+
+	std::vector<Indexed_t> mEntries;
+};
+
 // --------------------------------------------------------------------------
 //
 // Class
@@ -95,6 +144,7 @@ public:
 		uint64_t mFileTrackingSizeThreshold;
 		uint64_t mDiffingUploadSizeThreshold;
 		uint64_t mDiffingUploadMaxSizeThreshold;
+		uint64_t mBatchedUploadMaxSize;
 		BackgroundTask *mpBackgroundTask;
 		RunStatusProvider &mrRunStatusProvider;
 		SysadminNotifier &mrSysadminNotifier;
@@ -106,6 +156,9 @@ public:
 		// Member variables modified by syncing process
 		box_time_t mUploadAfterThisTimeInTheFuture;
 		bool mHaveLoggedWarningAboutFutureFileTimes;
+
+		// Reads directories ahead of the sync, if it has threads
+		BackupClientDirectoryScanner mScanner;
 	
 		bool StopRun() { return mrRunStatusProvider.StopRun(); }
 		void NotifySysadmin(SysadminNotifier::EventCode Event)
@@ -148,7 +201,7 @@ public:
 		const Location& rBackupLocation,
 		const std::string &rDirLocalPath,
 		MD5Digest& currentStateChecksum,
-		struct dirent *en,
+		BackupClientDirectoryScanner::Entry &rEntry,
 		EMU_STRUCT_STAT dir_st,
 		std::set<std::string>& rDirs,
 		std::set<std::string>& rFiles,
@@ -174,7 +227,8 @@ protected: // to allow tests to hook in before UpdateItems() runs
 		BackupStoreDirectory *pDirOnStore,
 		std::vector<BackupStoreDirectory::Entry *> &rEntriesLeftOver,
 		std::set<std::string> &rFiles,
-		const std::set<std::string> &rDirs);
+		const std::set<std::string> &rDirs,
+		BackupClientDirectoryScanner::Directory &rScanned);
 
 private:
 	BackupStoreDirectory::Entry* CheckForRename(BackupClientContext& context,
@@ -205,6 +259,40 @@ private:
 		int64_t filenameObjectID,
 		const std::string& rRemoteDirectoryPath);
 
+	// Files whose new attributes have been sent to the server, but
+	// whose replies haven't been collected yet.
+	typedef struct
+	{
+		std::string mNonVssFilePath;
+		int64_t mFileSize;
+	} AttributesSent;
+	void CollectAttributesReplies(BackupClientContext &rContext,
+		std::deque<AttributesSent> &rSent, int MaxLeftUncollected);
+
+	// Small files which have been encoded, and are waiting to be sent
+	// to the server together in one StoreFiles command.
+	typedef struct
+	{
+		std::string mLeafName;
+		std::string mNonVssFilePath;
+		int64_t mFileSize;
+		int64_t mEncodedSize;
+		InodeRefType mInodeNum;
+		bool mWasPending;
+	} BatchedFile;
+	void AddToUploadBatch(SyncParams &rParams,
+		const std::string &rFilename,
+		const std::string &rNonVssFilePath,
+		const std::string &rRemotePath,
+		const BackupStoreFilenameClear &rStoreFilename,
+		int64_t FileSize, box_time_t ModificationTime,
+		box_time_t AttributesHash, BatchedFile &rFile,
+		std::vector<BatchedFile> &rBatch,
+		std::auto_ptr<CollectInBufferStream> &rapBatchData);
+	bool UploadBatchedFiles(SyncParams &rParams,
+		std::vector<BatchedFile> &rBatch,
+		std::auto_ptr<CollectInBufferStream> &rapBatchData);
+
 	int64_t 	mObjectID;
 	std::string 	mSubDirName;
 	bool 		mInitialSyncDone;
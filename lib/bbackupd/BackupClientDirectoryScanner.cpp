@@ -0,0 +1,770 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupClientDirectoryScanner.cpp
+//		Purpose: Read directories and stat their contents ahead of the
+//			 backup client's walk of the tree
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "BackupClientContext.h"
+#include "BackupClientDirectoryScanner.h"
+#include "BackupClientFileAttributes.h"
+#include "FileModificationTime.h"
+#include "PathUtils.h"
+
+#include "MemLeakFindOn.h"
+
+// Limits the memory used by directories which have been read in advance
+// but not yet synced
+#define SCANNER_MAX_DIRECTORIES_PER_THREAD	64
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::ExtendedAttributes::ExtendedAttributes()
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::ExtendedAttributes::ExtendedAttributes()
+: mRead(false),
+  mResult(0),
+  mErrno(0)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::ExtendedAttributes::Read(const std::string &)
+//		Purpose: Reads the extended attributes of the file, unless they
+//			 have been read already. Records errors, but doesn't
+//			 report them, so can be called on any thread.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::ExtendedAttributes::Read(
+	const std::string &rFilename)
+{
+	if(mRead)
+	{
+		return;
+	}
+
+	mBlock.Clear();
+	mResult = BackupClientFileAttributes::ReadExtendedAttr(mBlock,
+		rFilename, mErrno, mAttrKey);
+	mRead = true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::ExtendedAttributes::Get(const std::string &)
+//		Purpose: Returns the extended attributes of the file, reading
+//			 them now if necessary. Errors are logged, and thrown,
+//			 exactly as BackupClientFileAttributes::FillExtendedAttr
+//			 would.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+const StreamableMemBlock &BackupClientDirectoryScanner::ExtendedAttributes::Get(
+	const std::string &rFilename)
+{
+	Read(rFilename);
+	BackupClientFileAttributes::ReportExtendedAttr(mResult, mErrno,
+		rFilename, mAttrKey);
+	return mBlock;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Entry::Entry(const std::string &, int)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::Entry::Entry(const std::string &rName,
+	int DirentType)
+: mName(rName),
+  mDirentType(DirentType),
+  mStatDone(false),
+  mStatErrno(0)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Entry::Lstat(const std::string &, EMU_STRUCT_STAT &)
+//		Purpose: Returns the result of EMU_LSTAT() on the entry, which
+//			 is only called the first time. Returns 0 on success, or
+//			 -1 with errno set.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientDirectoryScanner::Entry::Lstat(const std::string &rFilename,
+	EMU_STRUCT_STAT &rStatOut)
+{
+	if(!mStatDone)
+	{
+		mStatErrno = 0;
+		if(EMU_LSTAT(rFilename.c_str(), &mStat) != 0)
+		{
+			mStatErrno = (errno != 0) ? errno : EIO;
+		}
+		mStatDone = true;
+	}
+
+	if(mStatErrno != 0)
+	{
+		errno = mStatErrno;
+		return -1;
+	}
+
+	rStatOut = mStat;
+	return 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Entry::StatMatches(const EMU_STRUCT_STAT &)
+//		Purpose: Returns true if Lstat() succeeded, and found the
+//			 same file, unchanged, as rStat describes. Changes to
+//			 extended attributes change the attribute
+//			 modification time, so they're still right too.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool BackupClientDirectoryScanner::Entry::StatMatches(
+	const EMU_STRUCT_STAT &rStat) const
+{
+	return mStatDone && mStatErrno == 0 &&
+		mStat.st_ino == rStat.st_ino &&
+		mStat.st_mode == rStat.st_mode &&
+		mStat.st_size == rStat.st_size &&
+		FileModificationTime(mStat) == FileModificationTime(rStat) &&
+		FileAttrModificationTime(mStat) ==
+			FileAttrModificationTime(rStat);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Entry::Prefetch(const std::string &)
+//		Purpose: Reads everything the sync will want to know about the
+//			 entry. Called on the worker threads.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::Entry::Prefetch(const std::string &rFilename)
+{
+	EMU_STRUCT_STAT st;
+	if(Lstat(rFilename, st) != 0)
+	{
+		return;
+	}
+
+	int type = st.st_mode & S_IFMT;
+	if(type == S_IFREG || type == S_IFLNK)
+	{
+		mExtendedAttr.Read(rFilename);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::Directory(const std::string &)
+//		Purpose: Constructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::Directory::Directory(const std::string &rPath)
+: mPath(rPath),
+  mState(Directory_Queued),
+  mStatDone(false),
+  mStatErrno(0),
+  mEntriesRead(false),
+  mOpenErrno(0),
+  mCloseFailed(false),
+  mpDirHandle(0),
+  mNextEntry(0)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::~Directory()
+//		Purpose: Destructor
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::Directory::~Directory()
+{
+	if(mpDirHandle != 0)
+	{
+		::closedir(mpDirHandle);
+	}
+	for(std::vector<Entry *>::iterator i = mEntries.begin();
+		i != mEntries.end(); ++i)
+	{
+		delete *i;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::Stat(EMU_STRUCT_STAT &)
+//		Purpose: Returns the result of EMU_STAT() on the directory,
+//			 which is only called the first time. Returns 0 on
+//			 success, or -1 with errno set.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientDirectoryScanner::Directory::Stat(EMU_STRUCT_STAT &rStatOut)
+{
+	if(!mStatDone)
+	{
+		mStatErrno = 0;
+		if(EMU_STAT(mPath.c_str(), &mStat) != 0)
+		{
+			mStatErrno = (errno != 0) ? errno : EIO;
+		}
+		mStatDone = true;
+	}
+
+	if(mStatErrno != 0)
+	{
+		errno = mStatErrno;
+		return -1;
+	}
+
+	rStatOut = mStat;
+	return 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::ReadEntries()
+//		Purpose: Private. Reads the names of all the entries in the
+//			 directory, including . and .., in the order readdir()
+//			 returns them, to be returned by NextEntry() later.
+//			 Called on the worker threads. Returns 0 on success,
+//			 or -1 with errno set if the directory couldn't be
+//			 opened, which is reported by OpenEntries().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientDirectoryScanner::Directory::ReadEntries()
+{
+	ASSERT(!mEntriesRead && mpDirHandle == 0);
+
+	mpDirHandle = ::opendir(mPath.c_str());
+	if(mpDirHandle == 0)
+	{
+		mOpenErrno = (errno != 0) ? errno : EIO;
+	}
+	else
+	{
+		// Anything read before an exception is freed, and the
+		// directory closed, by the destructor
+		struct dirent *en = 0;
+		while((en = ::readdir(mpDirHandle)) != 0)
+		{
+#ifdef WIN32
+			int direntType = en->d_type;
+#else
+			int direntType = 0;
+#endif
+			mEntries.push_back(0);
+			mEntries.back() = new Entry(en->d_name, direntType);
+		}
+		CloseEntries();
+	}
+	mEntriesRead = true;
+
+	if(mOpenErrno != 0)
+	{
+		errno = mOpenErrno;
+		return -1;
+	}
+	return 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::CloseEntries()
+//		Purpose: Private. Closes the directory once all the entries
+//			 have been read from it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::Directory::CloseEntries()
+{
+	mCloseFailed = (::closedir(mpDirHandle) != 0);
+	mpDirHandle = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::OpenEntries()
+//		Purpose: Starts returning the entries of the directory from
+//			 NextEntry(), from those read in advance if there are
+//			 any, or else opening the directory to read them one
+//			 at a time. Returns 0 on success, or -1 with errno set
+//			 if the directory couldn't be opened.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int BackupClientDirectoryScanner::Directory::OpenEntries()
+{
+	mNextEntry = 0;
+
+	if(!mEntriesRead)
+	{
+		if(mpDirHandle != 0)
+		{
+			::closedir(mpDirHandle);
+		}
+		mpDirHandle = ::opendir(mPath.c_str());
+		mOpenErrno = (mpDirHandle != 0) ? 0 :
+			((errno != 0) ? errno : EIO);
+	}
+
+	if(mOpenErrno != 0)
+	{
+		errno = mOpenErrno;
+		return -1;
+	}
+	return 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::NextEntry()
+//		Purpose: Returns the next entry of the directory, including
+//			 . and .., in the order readdir() returns them, or 0
+//			 when there are no more. OpenEntries() must have
+//			 succeeded first.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::Entry *
+BackupClientDirectoryScanner::Directory::NextEntry()
+{
+	if(mEntriesRead)
+	{
+		return (mNextEntry < mEntries.size()) ?
+			mEntries[mNextEntry++] : 0;
+	}
+
+	mapCurrentEntry.reset();
+	if(mpDirHandle == 0)
+	{
+		return 0;
+	}
+
+	struct dirent *en = ::readdir(mpDirHandle);
+	if(en == 0)
+	{
+		CloseEntries();
+		return 0;
+	}
+
+#ifdef WIN32
+	int direntType = en->d_type;
+#else
+	int direntType = 0;
+#endif
+	mapCurrentEntry.reset(new Entry(en->d_name, direntType));
+	return mapCurrentEntry.get();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::FindEntry(const std::string &)
+//		Purpose: Returns the entry with the given name, or 0 if there
+//			 isn't one, or the entries weren't read in advance
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::Entry *
+BackupClientDirectoryScanner::Directory::FindEntry(const std::string &rName)
+{
+	if(mEntryIndex.size() != mEntries.size())
+	{
+		mEntryIndex.clear();
+		for(size_t e = 0; e < mEntries.size(); ++e)
+		{
+			mEntryIndex[mEntries[e]->GetName()] = e;
+		}
+	}
+
+	std::map<std::string, size_t>::const_iterator i(mEntryIndex.find(rName));
+	if(i == mEntryIndex.end())
+	{
+		return 0;
+	}
+	return mEntries[i->second];
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Directory::Prefetch(const std::atomic<bool> &)
+//		Purpose: Reads everything the sync will want to know about the
+//			 directory and its entries, giving up early if rStopping
+//			 is set. Called on the worker threads. Anything which
+//			 isn't read here is read later by the caller. An
+//			 exception is kept for GetDirectory() to throw again.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::Directory::Prefetch(
+	const std::atomic<bool> &rStopping)
+{
+	try
+	{
+		EMU_STRUCT_STAT st;
+		if(Stat(st) != 0)
+		{
+			// Nothing more will be asked for
+			return;
+		}
+		if((st.st_mode & S_IFMT) != S_IFLNK)
+		{
+			mExtendedAttr.Read(mPath);
+		}
+
+		if(ReadEntries() != 0)
+		{
+			return;
+		}
+
+		for(std::vector<Entry *>::iterator i = mEntries.begin();
+			i != mEntries.end() && !rStopping; ++i)
+		{
+			const std::string &name((*i)->GetName());
+			if(name == "." || name == "..")
+			{
+				continue;
+			}
+			(*i)->Prefetch(MakeFullPath(mPath, name));
+		}
+	}
+	catch(std::exception &)
+	{
+		// Any BoxException, or running out of memory. Nothing else
+		// can be thrown here, such as a signal to stop, as that's
+		// only checked on the thread which syncs.
+		mPrefetchFailure = std::current_exception();
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::BackupClientDirectoryScanner()
+//		Purpose: Constructor. There are no worker threads until
+//			 StartThreads() is called.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::BackupClientDirectoryScanner()
+: mStopping(false)
+{
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::~BackupClientDirectoryScanner()
+//		Purpose: Destructor. Stops the worker threads, and discards
+//			 any directories which were read but not collected.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+BackupClientDirectoryScanner::~BackupClientDirectoryScanner()
+{
+	Shutdown();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::StartThreads(int)
+//		Purpose: Starts the worker threads which read directories
+//			 passed to Prefetch(). With none, Prefetch() does
+//			 nothing.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::StartThreads(int NumThreads)
+{
+	try
+	{
+		for(int t = 0; t < NumThreads; ++t)
+		{
+			mThreads.push_back(std::thread(
+				&BackupClientDirectoryScanner::WorkerThread, this));
+		}
+	}
+	catch(std::exception &)
+	{
+		// Failed to start a thread
+		Shutdown();
+		throw;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Shutdown()
+//		Purpose: Private. Waits for the worker threads to exit, and
+//			 frees all the directories still held.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for(std::vector<std::thread>::iterator i = mThreads.begin();
+		i != mThreads.end(); ++i)
+	{
+		i->join();
+	}
+	mThreads.clear();
+
+	mQueue.clear();
+	for(std::map<std::string, Directory *>::iterator
+		i = mDirectories.begin(); i != mDirectories.end(); ++i)
+	{
+		delete i->second;
+	}
+	mDirectories.clear();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::Prefetch(const std::string &, Directory &, const std::set<std::string> &)
+//		Purpose: Queues the named subdirectories of rParent, which is
+//			 at rParentPath, to be read by the worker threads. They
+//			 are read before any directories queued earlier, in
+//			 the order given, which is the order they will be
+//			 synced in. Directories which are already queued, or
+//			 aren't real directories, are skipped, and nothing is
+//			 queued if too many directories are held already.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::Prefetch(const std::string &rParentPath,
+	Directory &rParent, const std::set<std::string> &rSubDirNames)
+{
+	if(mThreads.empty())
+	{
+		return;
+	}
+
+	std::vector<std::string> paths;
+	for(std::set<std::string>::const_iterator i = rSubDirNames.begin();
+		i != rSubDirNames.end(); ++i)
+	{
+		// Symbolic links are synced under the name of their
+		// target, so can't be matched up with the results later
+		Entry *pentry = rParent.FindEntry(*i);
+		EMU_STRUCT_STAT st;
+		std::string path(MakeFullPath(rParentPath, *i));
+		int lstat_ret = (pentry != 0) ? pentry->Lstat(path, st) :
+			EMU_LSTAT(path.c_str(), &st);
+		if(lstat_ret == 0 && (st.st_mode & S_IFMT) == S_IFDIR)
+		{
+			paths.push_back(path);
+		}
+	}
+
+	std::vector<Directory *> queued;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t maxDirectories = mThreads.size() *
+			SCANNER_MAX_DIRECTORIES_PER_THREAD;
+
+		for(std::vector<std::string>::const_iterator i = paths.begin();
+			i != paths.end() && mDirectories.size() < maxDirectories;
+			++i)
+		{
+			if(mDirectories.find(*i) != mDirectories.end())
+			{
+				continue;
+			}
+
+			std::auto_ptr<Directory> apdir(new Directory(*i));
+			mDirectories[*i] = apdir.get();
+			queued.push_back(apdir.release());
+		}
+
+		mQueue.insert(mQueue.begin(), queued.begin(), queued.end());
+	}
+
+	if(!queued.empty())
+	{
+		mWorkAvailable.notify_all();
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::GetDirectory(const std::string &, BackupClientContext &)
+//		Purpose: Returns the directory at rPath, with whatever has been
+//			 read about it in advance. If a worker is reading it now,
+//			 waits for it to finish, keeping the connection to the
+//			 server alive meanwhile. If it hasn't been started, it's
+//			 taken back and read on this thread as the results are
+//			 needed. If reading it in advance threw an exception,
+//			 logs it and throws it again here.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupClientDirectoryScanner::Directory>
+BackupClientDirectoryScanner::GetDirectory(const std::string &rPath,
+	BackupClientContext &rContext)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	std::map<std::string, Directory *>::iterator i(mDirectories.find(rPath));
+	if(i == mDirectories.end())
+	{
+		lock.unlock();
+		return std::auto_ptr<Directory>(new Directory(rPath));
+	}
+
+	// Only this thread changes the map, so i remains valid
+	Directory *pdir = i->second;
+	if(pdir->mState == Directory_Queued)
+	{
+		std::deque<Directory *>::iterator q(
+			std::find(mQueue.begin(), mQueue.end(), pdir));
+		ASSERT(q != mQueue.end());
+		mQueue.erase(q);
+	}
+	else
+	{
+		while(pdir->mState != Directory_Scanned)
+		{
+			if(mWorkDone.wait_for(lock, std::chrono::seconds(1)) ==
+				std::cv_status::timeout)
+			{
+				lock.unlock();
+				rContext.DoKeepAlive();
+				lock.lock();
+			}
+		}
+	}
+
+	mDirectories.erase(i);
+	lock.unlock();
+
+	std::auto_ptr<Directory> apdir(pdir);
+	if(apdir->mPrefetchFailure)
+	{
+		try
+		{
+			std::rethrow_exception(apdir->mPrefetchFailure);
+		}
+		catch(std::exception &e)
+		{
+			BOX_ERROR("Failed to read directory in advance: " <<
+				rPath << ": " << e.what());
+			throw;
+		}
+	}
+	return apdir;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupClientDirectoryScanner::WorkerThread()
+//		Purpose: Private. Body of each worker thread: reads queued
+//			 directories until stopped.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupClientDirectoryScanner::WorkerThread()
+{
+	while(true)
+	{
+		Directory *pdir = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while(!mStopping && mQueue.empty())
+			{
+				mWorkAvailable.wait(lock);
+			}
+			if(mStopping)
+			{
+				return;
+			}
+			pdir = mQueue.front();
+			mQueue.pop_front();
+			pdir->mState = Directory_Scanning;
+		}
+
+		pdir->Prefetch(mStopping);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			pdir->mState = Directory_Scanned;
+		}
+		mWorkDone.notify_all();
+	}
+}
@@ -0,0 +1,235 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    BackupClientDirectoryScanner.h
+//		Purpose: Read directories and stat their contents ahead of the
+//			 backup client's walk of the tree
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef BACKUPCLIENTDIRECTORYSCANNER__H
+#define BACKUPCLIENTDIRECTORYSCANNER__H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_DIRENT_H
+	#include <dirent.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "StreamableMemBlock.h"
+
+class BackupClientContext;
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    BackupClientDirectoryScanner
+//		Purpose: Supplies the contents of local directories to
+//			 BackupClientDirectoryRecord::SyncDirectory(), with the
+//			 results of stat() and the extended attributes of each
+//			 entry.
+//
+//			 Directories which are about to be synced can be passed
+//			 to Prefetch(), and a pool of worker threads reads them
+//			 while the caller is busy with other directories. Any
+//			 directory which hasn't been read in advance is read
+//			 lazily on the calling thread, one system call at a
+//			 time as the results are asked for, and its entries
+//			 aren't kept, so with no threads this behaves exactly
+//			 as reading them directly.
+//
+//			 Errors from system calls are only recorded by the
+//			 workers. They are reported when the result is asked
+//			 for, on the calling thread, in the same order as
+//			 reading directly. Any exception in a worker is logged
+//			 and thrown again by GetDirectory().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class BackupClientDirectoryScanner
+{
+public:
+	BackupClientDirectoryScanner();
+	~BackupClientDirectoryScanner();
+private:
+	// no copying
+	BackupClientDirectoryScanner(const BackupClientDirectoryScanner &);
+	BackupClientDirectoryScanner &operator=(const BackupClientDirectoryScanner &);
+
+public:
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupClientDirectoryScanner::ExtendedAttributes
+	//		Purpose: Extended attributes of a file, read once
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class ExtendedAttributes
+	{
+	public:
+		ExtendedAttributes();
+		void Read(const std::string &rFilename);
+		const StreamableMemBlock &Get(const std::string &rFilename);
+	private:
+		bool mRead;
+		int mResult;
+		int mErrno;
+		std::string mAttrKey;
+		StreamableMemBlock mBlock;
+	};
+
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupClientDirectoryScanner::Entry
+	//		Purpose: One entry of a directory, as returned by readdir()
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class Entry
+	{
+	public:
+		Entry(const std::string &rName, int DirentType);
+
+		const std::string &GetName() const { return mName; }
+		// The d_type of the entry, which is only meaningful on
+		// Windows, where it holds the file attributes
+		int GetDirentType() const { return mDirentType; }
+
+		// Same results as EMU_LSTAT() and FillExtendedAttr()
+		int Lstat(const std::string &rFilename, EMU_STRUCT_STAT &rStatOut);
+		const StreamableMemBlock &GetExtendedAttr(const std::string &rFilename)
+		{
+			return mExtendedAttr.Get(rFilename);
+		}
+
+		// True if the entry was found by Lstat() as it is now, so
+		// that what was read about it then is still right
+		bool StatMatches(const EMU_STRUCT_STAT &rStat) const;
+
+		void Prefetch(const std::string &rFilename);
+
+	private:
+		std::string mName;
+		int mDirentType;
+		bool mStatDone;
+		int mStatErrno;
+		EMU_STRUCT_STAT mStat;
+		ExtendedAttributes mExtendedAttr;
+	};
+
+	// ----------------------------------------------------------------
+	//
+	// Class
+	//		Name:    BackupClientDirectoryScanner::Directory
+	//		Purpose: A directory and its entries
+	//		Created: 2026/10/18
+	//
+	// ----------------------------------------------------------------
+	class Directory
+	{
+	public:
+		Directory(const std::string &rPath);
+		~Directory();
+	private:
+		// no copying
+		Directory(const Directory &);
+		Directory &operator=(const Directory &);
+
+	public:
+		const std::string &GetPath() const { return mPath; }
+
+		// Same results as EMU_STAT() and FillExtendedAttr() on
+		// the directory itself
+		int Stat(EMU_STRUCT_STAT &rStatOut);
+		const StreamableMemBlock &GetExtendedAttr()
+		{
+			return mExtendedAttr.Get(mPath);
+		}
+
+		// Starts reading the entries, returning -1 and setting
+		// errno if the directory can't be opened. Then NextEntry()
+		// returns each of them in turn, and 0 at the end. Unless
+		// the directory was read in advance, each entry is only
+		// valid until the next is read.
+		int OpenEntries();
+		Entry *NextEntry();
+		bool CloseFailed() const { return mCloseFailed; }
+
+		// Only finds entries read in advance, returning 0 for any
+		// others
+		Entry *FindEntry(const std::string &rName);
+
+		void Prefetch(const std::atomic<bool> &rStopping);
+
+	private:
+		friend class BackupClientDirectoryScanner;
+
+		int ReadEntries();
+		void CloseEntries();
+
+		std::string mPath;
+		int mState;
+		bool mStatDone;
+		int mStatErrno;
+		EMU_STRUCT_STAT mStat;
+		ExtendedAttributes mExtendedAttr;
+		bool mEntriesRead;
+		int mOpenErrno;
+		bool mCloseFailed;
+		DIR *mpDirHandle;
+		std::vector<Entry *> mEntries;
+		size_t mNextEntry;
+		// The entry last returned, when reading lazily
+		std::auto_ptr<Entry> mapCurrentEntry;
+		std::map<std::string, size_t> mEntryIndex;
+		// Thrown by Prefetch() on a worker thread
+		std::exception_ptr mPrefetchFailure;
+	};
+
+	void StartThreads(int NumThreads);
+	int GetNumThreads() const { return (int)mThreads.size(); }
+
+	void Prefetch(const std::string &rParentPath, Directory &rParent,
+		const std::set<std::string> &rSubDirNames);
+	std::auto_ptr<Directory> GetDirectory(const std::string &rPath,
+		BackupClientContext &rContext);
+
+private:
+	enum
+	{
+		Directory_Queued = 0,
+		Directory_Scanning = 1,
+		Directory_Scanned = 2
+	};
+
+	void WorkerThread();
+	void Shutdown();
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	// Directories waiting for a worker, the next to be read first
+	std::deque<Directory *> mQueue;
+	// Every directory queued, being read or read, and not yet collected
+	std::map<std::string, Directory *> mDirectories;
+	std::atomic<bool> mStopping;
+};
+
+#endif // BACKUPCLIENTDIRECTORYSCANNER__H
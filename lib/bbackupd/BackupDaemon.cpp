@@ -266,6 +266,10 @@ BackupDaemon::~BackupDaemon()
 {
 	DeleteAllLocations();
 	DeleteAllIDMaps();
+
+	// The client context refers to the resume info
+	mapClientContext.reset();
+	delete mpSyncResumeInfo;
 }
 
 // --------------------------------------------------------------------------
@@ -1021,6 +1025,9 @@ std::auto_ptr<BackupClientContext> BackupDaemon::RunSyncNow()
 	// prepare the resume info object
 	std::string resumeFilename(conf.GetKeyValue("DataDirectory") + DIRECTORY_SEPARATOR_ASCHAR);
 	resumeFilename += "resume.dat";
+	// The old client context refers to the old resume info until it's
+	// replaced below
+	std::auto_ptr<SyncResumeInfo> apOldSyncResumeInfo(mpSyncResumeInfo);
 	mpSyncResumeInfo = new SyncResumeInfo(resumeFilename);
 
 	// Then create a client context object (don't
@@ -1120,6 +1127,8 @@ std::auto_ptr<BackupClientContext> BackupDaemon::RunSyncNow()
 		conf.GetKeyValueUint64("DiffingUploadSizeThreshold");
 	params.mDiffingUploadMaxSizeThreshold =
 		conf.GetKeyValueUint64("DiffingUploadMaxSizeThreshold", 0);
+	params.mBatchedUploadMaxSize =
+		conf.GetKeyValueUint64("BatchedUploadMaxSize");
 	params.mMaxFileTimeInFuture =
 		SecondsToBoxTime(conf.GetKeyValueInt("MaxFileTimeInFuture"));
 
@@ -1155,6 +1164,22 @@ std::auto_ptr<BackupClientContext> BackupDaemon::RunSyncNow()
 
 	mapClientContext->SetMaximumDiffingTime(maximumDiffingTime);
 	mapClientContext->SetKeepAliveTime(keepAliveTime);
+	mapClientContext->SetMaxCommandsInFlight(
+		conf.GetKeyValueInt("MaxCommandsInFlight"));
+	mapClientContext->SetFindBlocksInOtherFiles(
+		conf.GetKeyValueBool("ReuseBlocksFromOtherFiles"));
+	mapClientContext->SetMaxFilesPerUpload(
+		conf.GetKeyValueInt("MaxFilesPerUpload"));
+
+	// Threads used to encode the blocks of files being uploaded
+	BackupStoreFile::SetEncodingThreads(
+		conf.GetKeyValueInt("EncodingThreads"));
+	BackupStoreFile::ContentDefinedChunking =
+		conf.GetKeyValueBool("ContentDefinedChunking");
+
+	// Threads used to read directories before they are synced
+	params.mScanner.StartThreads(
+		conf.GetKeyValueInt("DirectoryScanThreads"));
 
 	// Set store marker
 	mapClientContext->SetClientStoreMarker(mClientStoreMarker);
@@ -2065,13 +2090,17 @@ bool BackupDaemon::RunBackgroundTask(State state, uint64_t progress,
 		", progress = " << progress << "/" << maximum);
 
 
-	if( state == State::Uploading_Full || state == Uploading_Patch ) 
+	// Tests may upload with a client context of their own, without the
+	// daemon having started a sync, so there may be no resume info or
+	// context of ours to update.
+	if((state == State::Uploading_Full || state == Uploading_Patch) &&
+		mpSyncResumeInfo)
 	{
 		// while uploading we'll have the blocks count
 		mpSyncResumeInfo->SetBlocksCount(progress);
 	}
 
-	if( state == State::Seeking_Blocks) 
+	if(state == State::Seeking_Blocks && mapClientContext.get())
 	{
 		// prevent the server to close the connection while seeking blocks (resuming)
 		BOX_TRACE("BackupDaemon::RunBackgroundTask: seeking blocks");
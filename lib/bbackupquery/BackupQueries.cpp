@@ -33,10 +33,12 @@
 #include <set>
 
 #include "BackupClientFileAttributes.h"
+#include "BackupClientFileRangeStream.h"
 #include "BackupClientMakeExcludeList.h"
 #include "BackupClientRestore.h"
 #include "BackupQueries.h"
 #include "BackupStoreDirectory.h"
+#include "BackupStoreDirectoryTree.h"
 #include "BackupStoreException.h"
 #include "BackupStoreFile.h"
 #include "BackupsList.h"
@@ -83,7 +85,10 @@ BackupQueries::BackupQueries(BackupProtocolCallable &rConnection,
 	  mQuitNow(false),
 	  mRunningAsRoot(false),
 	  mWarnedAboutOwnerAttributes(false),
-	  mReturnCode(0)		// default return code
+	  mReturnCode(0),		// default return code
+	  mpRestoreConnectionFactory(NULL),
+	  mTreeListingSupported(false),
+	  mFileRangesSupported(false)
 {
 	#ifdef WIN32
 	mRunningAsRoot = TRUE;
@@ -470,7 +475,8 @@ bool SortByName(BackupStoreDirectory::Entry* a,
 //
 // --------------------------------------------------------------------------
 void BackupQueries::List(int64_t DirID, const std::string &rListRoot,
-	const bool *opts, box_time_t snapshotTime, bool FirstLevel, std::ostream* pOut)
+	const bool *opts, box_time_t snapshotTime, bool FirstLevel, std::ostream* pOut,
+	BackupStoreDirectoryTree *pTree)
 {
 #ifdef WIN32
 	DWORD n_chars;
@@ -482,34 +488,63 @@ void BackupQueries::List(int64_t DirID, const std::string &rListRoot,
 	if(!opts[LIST_OPTION_ALLOWOLD]) excludeFlags |= BackupProtocolListDirectory::Flags_OldVersion;
 	if(!opts[LIST_OPTION_ALLOWDELETED]) excludeFlags |= BackupProtocolListDirectory::Flags_Deleted;
 
-	// Do communication
-	try
+	// Listing recursively? Fetch the whole tree at once if we can.
+	std::auto_ptr<BackupStoreDirectoryTree> apTree;
+	if(FirstLevel && opts[LIST_OPTION_RECURSIVE] && pTree == NULL)
 	{
-		mrConnection.QueryListDirectory(
-			DirID,
-			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-			// both files and directories
-			excludeFlags,
-			true /* want attributes */,
-			snapshotTime);
+		try
+		{
+			apTree = ListDirectoryTree(DirID,
+				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+				excludeFlags, snapshotTime);
+		}
+		catch (std::exception &e)
+		{
+			BOX_ERROR("Failed to list directory tree: " << e.what());
+			SetReturnCode(ReturnCode::Command_Error);
+			return;
+		}
+		pTree = apTree.get();
 	}
-	catch (std::exception &e)
+
+	std::auto_ptr<BackupStoreDirectory> apDir;
+	if(pTree != NULL)
 	{
-		BOX_ERROR("Failed to list directory: " << e.what());
-		SetReturnCode(ReturnCode::Command_Error);
-		return;
+		apDir = pTree->Take(DirID);
 	}
-	catch (...)
+
+	if(apDir.get() == NULL)
 	{
-		BOX_ERROR("Failed to list directory: unknown error");
-		SetReturnCode(ReturnCode::Command_Error);
-		return;
-	}
+		// Do communication
+		try
+		{
+			mrConnection.QueryListDirectory(
+				DirID,
+				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+				// both files and directories
+				excludeFlags,
+				true /* want attributes */,
+				snapshotTime);
+		}
+		catch (std::exception &e)
+		{
+			BOX_ERROR("Failed to list directory: " << e.what());
+			SetReturnCode(ReturnCode::Command_Error);
+			return;
+		}
+		catch (...)
+		{
+			BOX_ERROR("Failed to list directory: unknown error");
+			SetReturnCode(ReturnCode::Command_Error);
+			return;
+		}
 
-	// Retrieve the directory from the stream following
-	BackupStoreDirectory dir;
-	std::auto_ptr<IOStream> dirstream(mrConnection.ReceiveStream());
-	dir.ReadFromStream(*dirstream, mrConnection.GetTimeout());
+		// Retrieve the directory from the stream following
+		apDir.reset(new BackupStoreDirectory);
+		std::auto_ptr<IOStream> dirstream(mrConnection.ReceiveStream());
+		apDir->ReadFromStream(*dirstream, mrConnection.GetTimeout());
+	}
+	BackupStoreDirectory &dir(*apDir);
 
 	// Store entry pointers in a std::vector for sorting
 	BackupStoreDirectory::Iterator i(dir);
@@ -728,7 +763,7 @@ void BackupQueries::List(int64_t DirID, const std::string &rListRoot,
 				subroot += clear.GetClearFilename();
 				List(en->GetObjectID(), subroot, opts, snapshotTime,
 					false /* not the first level to list */,
-					pOut);
+					pOut, pTree);
 			}
 		}
 	}
@@ -1175,6 +1210,35 @@ std::string BackupQueries::GetCurrentDirectoryName()
 	return r;
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupQueries::ListDirectoryTree(int64_t, int16_t,
+//			 int16_t, box_time_t)
+//		Purpose: Fetches the listings of a directory and the
+//			 directories below it, a batch at a time, with
+//			 attributes, or returns an empty pointer if the store
+//			 can't do that. The listings are taken out as they're
+//			 used, and the next batch is fetched when needed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+std::auto_ptr<BackupStoreDirectoryTree> BackupQueries::ListDirectoryTree(
+	int64_t DirID, int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+	box_time_t SnapshotTime)
+{
+	std::auto_ptr<BackupStoreDirectoryTree> apTree;
+	if(!mTreeListingSupported)
+	{
+		return apTree;
+	}
+
+	apTree.reset(new BackupStoreDirectoryTree(mrConnection,
+		FlagsMustBeSet, FlagsNotToBeSet, SnapshotTime));
+	apTree->List(DirID);
+	return apTree;
+}
+
 
 // --------------------------------------------------------------------------
 //
@@ -1482,13 +1546,44 @@ int64_t BackupQueries::FindFileID(const std::string& rNameOrIdString,
 // --------------------------------------------------------------------------
 void BackupQueries::CommandGet(std::vector<std::string> args, const bool *opts)
 {
+	// With -r, the offset and length of the range follow the object,
+	// otherwise the arguments are the same
+	int64_t rangeOffset = 0, rangeLength = 0;
+	bool rangeOK = true;
+	if(opts['r'])
+	{
+		rangeOK = false;
+		if(args.size() >= 3)
+		{
+			char *offsetEnd = 0, *lengthEnd = 0;
+			rangeOffset = ::strtoll(args[1].c_str(), &offsetEnd, 10);
+			rangeLength = ::strtoll(args[2].c_str(), &lengthEnd, 10);
+			rangeOK = !args[1].empty() && *offsetEnd == '\0' &&
+				!args[2].empty() && *lengthEnd == '\0' &&
+				rangeOffset >= 0 && rangeLength >= 0;
+			args.erase(args.begin() + 1, args.begin() + 3);
+		}
+	}
+
 	// At least one argument?
 	// Check args
-	if(args.size() < 1 || (opts['i'] && args.size() != 2) || args.size() > 2)
+	if(!rangeOK || args.size() < 1 || (opts['i'] && args.size() != 2) ||
+		args.size() > 2)
 	{
 		BOX_ERROR("Incorrect usage.\n"
 			"get <remote-filename> [<local-filename>] or\n"
-			"get -i <object-id> <local-filename>");
+			"get -i <object-id> <local-filename> or\n"
+			"get -r <remote-filename> <offset> <length> "
+				"[<local-filename>] or\n"
+			"get -ri <object-id> <offset> <length> <local-filename>");
+		return;
+	}
+
+	if(opts['r'] && !mFileRangesSupported)
+	{
+		BOX_ERROR("The store does not support fetching part of a file, "
+			"get the whole file instead.");
+		SetReturnCode(ReturnCode::Command_Error);
 		return;
 	}
 
@@ -1562,6 +1657,12 @@ void BackupQueries::CommandGet(std::vector<std::string> args, const bool *opts)
 		return;
 	}
 	
+	if(opts['r'])
+	{
+		GetFileRange(dirId, fileId, rangeOffset, rangeLength, localName);
+		return;
+	}
+
 	// Request it from the store
 	try
 	{
@@ -1600,6 +1701,85 @@ void BackupQueries::CommandGet(std::vector<std::string> args, const bool *opts)
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupQueries::GetFileRange(int64_t, int64_t, int64_t,
+//			 int64_t, const std::string &)
+//		Purpose: Write part of a file on the store to a new local
+//			 file, fetching only the blocks which contain it
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupQueries::GetFileRange(int64_t DirID, int64_t FileID, int64_t Offset,
+	int64_t Length, const std::string &rLocalName)
+{
+	try
+	{
+		BackupClientFileRangeStream remote(mrConnection, DirID, FileID);
+		std::auto_ptr<BackupStoreFile::DecodedStream> decoded(
+			BackupStoreFile::DecodeFileStream(remote,
+				mrConnection.GetTimeout(), NULL,
+				true /* seekable */));
+
+		if(decoded->IsSymLink())
+		{
+			BOX_ERROR("Object ID " << BOX_FORMAT_OBJECTID(FileID) <<
+				" is a symbolic link, which has no data to get "
+				"part of.");
+			SetReturnCode(ReturnCode::Command_Error);
+			return;
+		}
+
+		int64_t size = decoded->GetPosition() +
+			decoded->BytesLeftToRead();
+		if(Offset > size)
+		{
+			BOX_ERROR("Object ID " << BOX_FORMAT_OBJECTID(FileID) <<
+				" is only " << size << " bytes long.");
+			SetReturnCode(ReturnCode::Command_Error);
+			return;
+		}
+		decoded->Seek(Offset, IOStream::SeekType_Absolute);
+
+		FileStream out(rLocalName.c_str(), O_WRONLY | O_CREAT | O_EXCL);
+		int64_t written = 0;
+		char buffer[16*1024];
+		while(written < Length && decoded->StreamDataLeft())
+		{
+			int toRead = sizeof(buffer);
+			if(Length - written < toRead)
+			{
+				toRead = (int)(Length - written);
+			}
+			int bytes = decoded->Read(buffer, toRead,
+				mrConnection.GetTimeout());
+			out.Write(buffer, bytes);
+			written += bytes;
+		}
+
+		BOX_INFO("Object ID " << BOX_FORMAT_OBJECTID(FileID) <<
+			" bytes " << Offset << " to " << (Offset + written) <<
+			" of " << size << " fetched successfully, in " <<
+			remote.GetNumberOfFetches() << " requests.");
+	}
+	catch(BoxException &e)
+	{
+		BOX_ERROR("Failed to fetch file: " << e.what());
+		EMU_UNLINK(rLocalName.c_str());
+	}
+	catch(std::exception &e)
+	{
+		BOX_ERROR("Failed to fetch file: " << e.what());
+		EMU_UNLINK(rLocalName.c_str());
+	}
+	catch(...)
+	{
+		BOX_ERROR("Failed to fetch file: unknown error");
+		EMU_UNLINK(rLocalName.c_str());
+	}
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1829,8 +2009,15 @@ void BackupQueries::Compare(const std::string &rStoreDir,
 		return;
 	}
 	
+	// Fetch all the listings at once if we can
+	std::auto_ptr<BackupStoreDirectoryTree> apTree(ListDirectoryTree(dirID,
+		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+		BackupProtocolListDirectory::Flags_OldVersion |
+		BackupProtocolListDirectory::Flags_Deleted, 0));
+
 	// Go!
-	Compare(dirID, storeDirEncoded, localDirEncoded, rParams);
+	Compare(dirID, storeDirEncoded, localDirEncoded, rParams,
+		apTree.get());
 }
 
 void BackupQueries::CompareOneFile(int64_t DirID,
@@ -1997,7 +2184,8 @@ void BackupQueries::CompareOneFile(int64_t DirID,
 //
 // --------------------------------------------------------------------------
 void BackupQueries::Compare(int64_t DirID, const std::string &rStoreDir,
-	const std::string &rLocalDir, BoxBackupCompareParams &rParams)
+	const std::string &rLocalDir, BoxBackupCompareParams &rParams,
+	BackupStoreDirectoryTree *pTree)
 {
 	rParams.NotifyDirComparing(rLocalDir, rStoreDir);
 
@@ -2017,21 +2205,31 @@ void BackupQueries::Compare(int64_t DirID, const std::string &rStoreDir,
 		return;
 	}
 
-	// Get the directory listing from the store
-	mrConnection.QueryListDirectory(
-		DirID,
-		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-		// get everything
-		BackupProtocolListDirectory::Flags_OldVersion |
-		BackupProtocolListDirectory::Flags_Deleted,
-		// except for old versions and deleted files
-		true /* want attributes */,
-		0);
+	// Get the directory listing from the tree, or the store
+	std::auto_ptr<BackupStoreDirectory> apDir;
+	if(pTree != NULL)
+	{
+		apDir = pTree->Take(DirID);
+	}
 
-	// Retrieve the directory from the stream following
-	BackupStoreDirectory dir;
-	std::auto_ptr<IOStream> dirstream(mrConnection.ReceiveStream());
-	dir.ReadFromStream(*dirstream, mrConnection.GetTimeout());
+	if(apDir.get() == NULL)
+	{
+		mrConnection.QueryListDirectory(
+			DirID,
+			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+			// get everything
+			BackupProtocolListDirectory::Flags_OldVersion |
+			BackupProtocolListDirectory::Flags_Deleted,
+			// except for old versions and deleted files
+			true /* want attributes */,
+			0);
+
+		// Retrieve the directory from the stream following
+		apDir.reset(new BackupStoreDirectory);
+		std::auto_ptr<IOStream> dirstream(mrConnection.ReceiveStream());
+		apDir->ReadFromStream(*dirstream, mrConnection.GetTimeout());
+	}
+	BackupStoreDirectory &dir(*apDir);
 
 	// Test out the attributes
 	if(!dir.HasAttributes())
@@ -2289,7 +2487,7 @@ void BackupQueries::Compare(int64_t DirID, const std::string &rStoreDir,
 			{
 				// Compare directory
 				Compare(i->second->GetObjectID(),
-					storePath, localPath, rParams);
+					storePath, localPath, rParams, pTree);
 				
 				// Remove from set so that we know it's been compared
 				localDirs.erase(local);
@@ -2578,7 +2776,10 @@ void BackupQueries::CommandRestore(const std::vector<std::string> &args, const b
 				false /* don't undelete after restore! */, 
 				opts['r'] /* resume? */,
 				opts['f'] /* force continue after errors */,
-				infos /* gather some infos */);
+				infos /* gather some infos */,
+				mpRestoreConnectionFactory,
+				mrConfiguration.GetKeyValueInt("RestoreConnections"),
+				mTreeListingSupported);
 		} else {
 			mrConnection.QueryGetFile(infosreply->GetContainerID(), objectID);
 
@@ -12,6 +12,7 @@
 
 #include <regex>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -20,8 +21,10 @@
 #include "BackupStoreDirectory.h"
 
 class BackupProtocolCallable;
+class BackupStoreDirectoryTree;
 class Configuration;
 class ExcludeList;
+class RestoreConnectionFactory;
 
 typedef enum
 {
@@ -91,11 +94,33 @@ public:
 	// Return code?
 	int GetReturnCode() {return mReturnCode;}
 
+	// Opens the extra connections used by restore, if the
+	// configuration asks for more than one
+	void SetRestoreConnectionFactory(RestoreConnectionFactory *pFactory)
+	{
+		mpRestoreConnectionFactory = pFactory;
+	}
+
+	// Set if the store understands ListDirectoryTree, so that recursive
+	// commands can fetch all the listings they need at once
+	void SetTreeListingSupported(bool Supported)
+	{
+		mTreeListingSupported = Supported;
+	}
+
+	// Set if the store understands GetFileRange, so that get can
+	// fetch only the part of a file it needs
+	void SetFileRangesSupported(bool Supported)
+	{
+		mFileRangesSupported = Supported;
+	}
+
 	
 	// Commands
 	void CommandList(const std::vector<std::string> &args, const bool *opts);
 	void List(int64_t DirID, const std::string &rListRoot, const bool *opts,
-		box_time_t snapshotTime, bool FirstLevel,  std::ostream* pOut = NULL);
+		box_time_t snapshotTime, bool FirstLevel,  std::ostream* pOut = NULL,
+		BackupStoreDirectoryTree *pTree = NULL);
 	void CommandSearch(const std::vector<std::string> &args, const bool *opts);
 	void Search(int64_t DirID, const std::string &rListRoot, const std::string &rSearchPattern, 
 		const bool *opts, box_time_t snapshotTime, bool FirstLevel,  std::ostream* pOut = NULL);
@@ -104,6 +129,8 @@ public:
 	void CommandChangeLocalDir(const std::vector<std::string> &args);
 	void CommandGetObject(const std::vector<std::string> &args, const bool *opts);
 	void CommandGet(std::vector<std::string> args, const bool *opts);
+	void GetFileRange(int64_t DirID, int64_t FileID, int64_t Offset,
+		int64_t Length, const std::string &rLocalName);
 	void CommandCompare(const std::vector<std::string> &args, const bool *opts);
 	void CommandRestore(const std::vector<std::string> &args, const bool *opts);
 	
@@ -368,7 +395,8 @@ public:
 	void Compare(const std::string &rStoreDir,
 		const std::string &rLocalDir, BoxBackupCompareParams &rParams);
 	void Compare(int64_t DirID, const std::string &rStoreDir,
-		const std::string &rLocalDir, BoxBackupCompareParams &rParams);
+		const std::string &rLocalDir, BoxBackupCompareParams &rParams,
+		BackupStoreDirectoryTree *pTree = NULL);
 	void CompareOneFile(int64_t DirID, BackupStoreDirectory::Entry *pEntry,
 		const std::string& rLocalPath, const std::string& rStorePath,
 		BoxBackupCompareParams &rParams);
@@ -402,6 +430,9 @@ private:
 		std::string* pFileNameOut, int16_t flagsInclude,
 		int16_t flagsExclude, int16_t* pFlagsOut);
 	std::string GetCurrentDirectoryName();
+	std::auto_ptr<BackupStoreDirectoryTree> ListDirectoryTree(int64_t DirID,
+		int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+		box_time_t SnapshotTime);
 	void SetReturnCode(int code) {mReturnCode = code;}
 	std::string GetObjectFilename(int64_t ObjectId, bool IsDir, int64_t ContainerId);
 	std::string GetLocalFullPathFromObjectID(int64_t ObjectId, bool IsDir, int64_t ContainerId, bool TranslateRoot = false);
@@ -415,6 +446,9 @@ private:
 	bool mRunningAsRoot;
 	bool mWarnedAboutOwnerAttributes;
 	int mReturnCode;
+	RestoreConnectionFactory *mpRestoreConnectionFactory;
+	bool mTreeListingSupported;
+	bool mFileRangesSupported;
 };
 
 typedef std::vector<std::string> (*CompletionHandler)
@@ -437,7 +437,7 @@ QueryCommandSpecification commands[] =
 	{ "sh", 	"",		Command_sh,	{CompleteDefault} },
 	{ "getobject",	"",		Command_GetObject,
 		{CompleteRemoteId, CompleteLocalDir} },
-	{ "get",	"i",		Command_Get,
+	{ "get",	"ir",		Command_Get,
 		{CompleteGetFileOrId, CompleteLocalDir} },
 	{ "compare",	"alcqAEQ",	Command_Compare,
 		{CompleteCompareLocationOrRemoteDir, CompleteCompareNoneOrLocalDir} },
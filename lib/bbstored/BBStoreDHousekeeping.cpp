@@ -11,12 +11,20 @@
 
 #include <stdio.h>
 
+#ifdef HAVE_SYS_WAIT_H
+	#include <sys/wait.h>
+#endif
+
+#include <algorithm>
+
 #include "BackupStoreDaemon.h"
 #include "BackupStoreAccountDatabase.h"
 #include "BackupStoreAccounts.h"
+#include "BackupStoreInfo.h"
 #include "HousekeepStoreAccount.h"
 #include "BoxTime.h"
 #include "Configuration.h"
+#include "autogen_ServerException.h"
 
 #include "MemLeakFindOn.h"
 
@@ -105,80 +113,364 @@ void BackupStoreDaemon::RunHousekeepingIfNeeded()
 	}
 			
 	SetProcessTitle("housekeeping, active");
-			
-	// Check them all
-	for(std::vector<int32_t>::const_iterator i = accounts.begin(); i != accounts.end(); ++i)
+
+	// Start with the accounts most in need of it
+	SortAccountsForHousekeeping(accounts);
+
+	int numWorkers = rconfig.GetKeyValueInt("HousekeepingWorkers");
+
+#ifndef WIN32
+	// Workers are forked from the housekeeping process, so there are
+	// none when housekeeping runs in the server process itself
+	if(numWorkers > 1 && !IsSingleProcess() && accounts.size() > 1)
 	{
+		RunHousekeepingWorkers(accounts, numWorkers);
+	}
+	else
+#endif
+	{
+		// Check them all, one at a time
+		for(std::vector<int32_t>::const_iterator i = accounts.begin();
+			i != accounts.end(); ++i)
+		{
+			HousekeepAccount(*i);
+
+			int64_t timeNow = GetCurrentBoxTime();
+			time_t secondsToGo = BoxTimeToSeconds(
+				(mLastHousekeepingRun + housekeepingInterval) - 
+				timeNow);
+			if(secondsToGo < 1) secondsToGo = 1;
+			if(secondsToGo > 60) secondsToGo = 60;
+			int32_t millisecondsToGo = ((int)secondsToGo) * 1000;
+
+			// Check to see if there's any message pending
+			CheckForInterProcessMsg(0 /* no account */, millisecondsToGo);
+
+			// Stop early?
+			if(StopRun())
+			{
+				break;
+			}
+		}
+	}
+		
+	BOX_INFO("Finished housekeeping");
+
+	// Placed here for accuracy, if StopRun() is true, for example.
+	SetProcessTitle("housekeeping, idle");
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::SortAccountsForHousekeeping(std::vector<int32_t> &)
+//		Purpose: Orders the accounts so that those furthest over their
+//			 soft limit come first, then the rest by size, biggest
+//			 first, so that the slowest ones are started earliest.
+//			 Accounts whose info can't be read go last.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::SortAccountsForHousekeeping(std::vector<int32_t> &rAccounts)
+{
+	// Sort key for each account, negated so that the default ordering
+	// puts the most urgent first
+	std::vector<std::pair<std::pair<int64_t, int64_t>, int32_t> > order;
+
+	for(std::vector<int32_t>::const_iterator i = rAccounts.begin();
+		i != rAccounts.end(); ++i)
+	{
+		int64_t overLimit = 0, used = 0;
 		try
 		{
 			std::string rootDir;
 			int discSet = 0;
+			mpAccounts->GetAccountRoot(*i, rootDir, discSet);
+			std::auto_ptr<BackupStoreInfo> info(BackupStoreInfo::Load(
+				*i, rootDir, discSet, true /* ReadOnly */));
+			used = info->GetBlocksUsed();
+			overLimit = used - info->GetBlocksSoftLimit();
+			if(overLimit < 0) overLimit = 0;
+		}
+		catch(BoxException &e)
+		{
+			// HousekeepStoreAccount will report it properly
+			BOX_TRACE("Failed to read info for account " <<
+				BOX_FORMAT_ACCOUNT(*i) << " to prioritise "
+				"housekeeping: " << e.what());
+			overLimit = -1;
+		}
+
+		order.push_back(std::make_pair(std::make_pair(-overLimit, -used), *i));
+	}
+
+	// Stable, so accounts otherwise equal stay in database order
+	std::stable_sort(order.begin(), order.end());
+
+	for(size_t i = 0; i < order.size(); ++i)
+	{
+		rAccounts[i] = order[i].second;
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::HousekeepAccount(int32_t)
+//		Purpose: Housekeeps one account, logging any exceptions
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::HousekeepAccount(int32_t AccountID)
+{
+	try
+	{
+		std::string rootDir;
+		int discSet = 0;
+
+		{
+			// Tag log output to identify account
+			std::ostringstream tag;
+			tag << "hk/" << BOX_FORMAT_ACCOUNT(AccountID);
+			Logging::Tagger tagWithClientID(tag.str());
+
+			// Get the account root
+			mpAccounts->GetAccountRoot(AccountID, rootDir, discSet);
+
+			// Reset tagging as HousekeepStoreAccount will
+			// do that itself, to avoid duplicate tagging.
+			// Happens automatically when tagWithClientID
+			// goes out of scope.
+		}
+
+		// Do housekeeping on this account
+		HousekeepStoreAccount housekeeping(AccountID, rootDir,
+			discSet, this);
+		housekeeping.DoHousekeeping();
+	}
+	catch(BoxException &e)
+	{
+		BOX_ERROR("Housekeeping on account " <<
+			BOX_FORMAT_ACCOUNT(AccountID) << " threw exception, "
+			"aborting run for this account: " <<
+			e.what() << " (" <<
+			e.GetType() << "/" << e.GetSubType() << ")");
+	}
+	catch(std::exception &e)
+	{
+		BOX_ERROR("Housekeeping on account " <<
+			BOX_FORMAT_ACCOUNT(AccountID) << " threw exception, "
+			"aborting run for this account: " <<
+			e.what());
+	}
+	catch(...)
+	{
+		BOX_ERROR("Housekeeping on account " <<
+			BOX_FORMAT_ACCOUNT(AccountID) << " threw exception, "
+			"aborting run for this account: "
+			"unknown exception");
+	}
+}
+
+#ifndef WIN32
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::RunHousekeepingWorkers(const std::vector<int32_t> &, int)
+//		Purpose: Housekeeps the accounts in order, keeping up to
+//			 NumWorkers worker processes busy, until all are done or
+//			 the run is stopped. Messages from the server process
+//			 are passed on to the workers while waiting for them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::RunHousekeepingWorkers(
+	const std::vector<int32_t> &rAccounts, int NumWorkers)
+{
+	std::vector<int32_t>::const_iterator next = rAccounts.begin();
+
+	while(true)
+	{
+		while(!StopRun() && next != rAccounts.end() &&
+			(int)mHousekeepingWorkers.size() < NumWorkers)
+		{
+			StartHousekeepingWorker(*next);
+			++next;
+		}
+
+		if(mHousekeepingWorkers.empty())
+		{
+			// All done, or stopped and all workers have finished
+			break;
+		}
 
+		SetProcessTitle("housekeeping, active, %d workers",
+			(int)mHousekeepingWorkers.size());
+
+		// Wait a short time, so that finished workers are noticed
+		// promptly, even if no messages arrive. Without a server
+		// process to listen to, as in the tests, just sleep.
+		if(mInterProcessCommsSocket.IsOpened())
+		{
+			CheckForInterProcessMsg(0 /* no account */, 1000);
+		}
+		else
+		{
+			ShortSleep(MilliSecondsToBoxTime(100), false);
+		}
+		ReapHousekeepingWorkers();
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::StartHousekeepingWorker(int32_t)
+//		Purpose: Forks a worker process to housekeep one account.
+//			 The worker gets its own socket for messages, in place
+//			 of the one to the server process, so it stops for a
+//			 client connection exactly as housekeeping always has.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::StartHousekeepingWorker(int32_t AccountID)
+{
+	int sv[2] = {-1,-1};
+	if(::socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, sv) != 0)
+	{
+		THROW_EXCEPTION(ServerException, SocketPairFailed)
+	}
+
+	pid_t pid = ::fork();
+	if(pid == -1)
+	{
+		::close(sv[0]);
+		::close(sv[1]);
+		THROW_EXCEPTION(ServerException, ServerForkError)
+	}
+
+	if(pid == 0)
+	{
+		// In the worker process
+		try
+		{
+			// Don't hold the other workers' sockets open
+			for(std::map<pid_t, HousekeepingWorker>::iterator
+				i = mHousekeepingWorkers.begin();
+				i != mHousekeepingWorkers.end(); ++i)
 			{
-				// Tag log output to identify account
-				std::ostringstream tag;
-				tag << "hk/" << BOX_FORMAT_ACCOUNT(*i);
-				Logging::Tagger tagWithClientID(tag.str());
-
-				// Get the account root
-				mpAccounts->GetAccountRoot(*i, rootDir, discSet);
-
-				// Reset tagging as HousekeepStoreAccount will
-				// do that itself, to avoid duplicate tagging.
-				// Happens automatically when tagWithClientID
-				// goes out of scope.
+				delete i->second.mpComms;
 			}
-			
-			// Do housekeeping on this account
-			HousekeepStoreAccount housekeeping(*i, rootDir,
-				discSet, this);
-			housekeeping.DoHousekeeping();
+			mHousekeepingWorkers.clear();
+
+			// Talk only to the housekeeping process. Messages
+			// are single short lines, so anything buffered
+			// belongs to the housekeeping process.
+			if(mInterProcessCommsSocket.IsOpened())
+			{
+				mInterProcessCommsSocket.Close();
+			}
+			mInterProcessCommsSocket.Attach(sv[1]);
+			mInterProcessComms.IgnoreBufferedData(
+				mInterProcessComms.GetSizeOfBufferedData());
+			::close(sv[0]);
+
+			SetProcessTitle("housekeeping, account %x", AccountID);
+			HousekeepAccount(AccountID);
 		}
 		catch(BoxException &e)
 		{
-			BOX_ERROR("Housekeeping on account " <<
-				BOX_FORMAT_ACCOUNT(*i) << " threw exception, "
-				"aborting run for this account: " <<
-				e.what() << " (" <<
-				e.GetType() << "/" << e.GetSubType() << ")");
+			BOX_ERROR("Housekeeping worker for account " <<
+				BOX_FORMAT_ACCOUNT(AccountID) << " failed: " <<
+				e.what());
+			_exit(1);
 		}
-		catch(std::exception &e)
+
+		_exit(0);
+	}
+
+	// In the housekeeping process
+	::close(sv[1]);
+	HousekeepingWorker worker;
+	worker.mAccountID = AccountID;
+	worker.mpComms = new SocketStream(sv[0]);
+	mHousekeepingWorkers[pid] = worker;
+
+	BOX_TRACE("Started housekeeping worker " << pid << " for account " <<
+		BOX_FORMAT_ACCOUNT(AccountID));
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::ReapHousekeepingWorkers()
+//		Purpose: Forgets any workers which have finished
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::ReapHousekeepingWorkers()
+{
+	int status = 0;
+	pid_t pid;
+	while((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+	{
+		std::map<pid_t, HousekeepingWorker>::iterator
+			i(mHousekeepingWorkers.find(pid));
+		if(i == mHousekeepingWorkers.end())
 		{
-			BOX_ERROR("Housekeeping on account " <<
-				BOX_FORMAT_ACCOUNT(*i) << " threw exception, "
-				"aborting run for this account: " <<
-				e.what());
+			continue;
 		}
-		catch(...)
+
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
 		{
-			BOX_ERROR("Housekeeping on account " <<
-				BOX_FORMAT_ACCOUNT(*i) << " threw exception, "
-				"aborting run for this account: "
-				"unknown exception");
+			BOX_WARNING("Housekeeping worker for account " <<
+				BOX_FORMAT_ACCOUNT(i->second.mAccountID) <<
+				" exited abnormally (status " << status << ")");
 		}
-	
-		int64_t timeNow = GetCurrentBoxTime();
-		time_t secondsToGo = BoxTimeToSeconds(
-			(mLastHousekeepingRun + housekeepingInterval) - 
-			timeNow);
-		if(secondsToGo < 1) secondsToGo = 1;
-		if(secondsToGo > 60) secondsToGo = 60;
-		int32_t millisecondsToGo = ((int)secondsToGo) * 1000;
 
-		// Check to see if there's any message pending
-		CheckForInterProcessMsg(0 /* no account */, millisecondsToGo);
+		delete i->second.mpComms;
+		mHousekeepingWorkers.erase(i);
+	}
+}
 
-		// Stop early?
-		if(StopRun())
+#endif // !WIN32
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    BackupStoreDaemon::SendMessageToHousekeepingWorkers(const std::string &, int)
+//		Purpose: Passes a message line on to the worker housekeeping
+//			 AccountNum, or to all workers if AccountNum is 0.
+//			 Workers which have gone away are ignored.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void BackupStoreDaemon::SendMessageToHousekeepingWorkers(
+	const std::string &rLine, int AccountNum)
+{
+	std::string message(rLine + "\n");
+
+	for(std::map<pid_t, HousekeepingWorker>::iterator
+		i = mHousekeepingWorkers.begin();
+		i != mHousekeepingWorkers.end(); ++i)
+	{
+		if(AccountNum != 0 && i->second.mAccountID != AccountNum)
 		{
-			break;
+			continue;
 		}
-	}
-		
-	BOX_INFO("Finished housekeeping");
 
-	// Placed here for accuracy, if StopRun() is true, for example.
-	SetProcessTitle("housekeeping, idle");
+		try
+		{
+			i->second.mpComms->Write(message.c_str(), message.size());
+		}
+		catch(BoxException &e)
+		{
+			// It has probably just finished
+			BOX_TRACE("Failed to send message to housekeeping "
+				"worker " << i->first << ": " << e.what());
+		}
+	}
 }
 
 void BackupStoreDaemon::OnIdle()
@@ -217,6 +509,7 @@ bool BackupStoreDaemon::CheckForInterProcessMsg(int AccountNum, int MaximumWaitT
 	if(mInterProcessComms.IsEOF())
 	{
 		SetTerminateWanted();
+		SendMessageToHousekeepingWorkers("t");
 		return true;
 	}
 
@@ -233,16 +526,21 @@ bool BackupStoreDaemon::CheckForInterProcessMsg(int AccountNum, int MaximumWaitT
 		{
 			// HUP signal received by main process
 			SetReloadConfigWanted();
+			SendMessageToHousekeepingWorkers(line);
 			return true;
 		}
 		else if(line == "t")
 		{
 			// Terminate signal received by main process
 			SetTerminateWanted();
+			SendMessageToHousekeepingWorkers(line);
 			return true;
 		}
 		else if(sscanf(line.c_str(), "r%x", &account) == 1)
 		{
+			// Is one of our workers processing it?
+			SendMessageToHousekeepingWorkers(line, account);
+
 			// Main process is trying to lock an account -- are we processing it?
 			if(account == AccountNum)
 			{
@@ -22,6 +22,7 @@
 #include "BackupStoreConfigVerify.h"
 #include "autogen_BackupProtocol.h"
 #include "RaidFileController.h"
+#include "RaidFileWriteBehind.h"
 #include "BackupStoreAccountDatabase.h"
 #include "BackupStoreAccounts.h"
 #include "BannerText.h"
@@ -40,10 +41,14 @@ BackupStoreDaemon::BackupStoreDaemon()
 	: mpAccountDatabase(0),
 	  mpAccounts(0),
 	  mExtendedLogging(false),
+	  mDirectoryCacheSize(-1),
+	  mRaidWriteBehind(false),
+	  mDeferReverseDiffs(false),
 	  mHaveForkedHousekeeping(false),
 	  mIsHousekeepingProcess(false),
 	  mHousekeepingInited(false),
 	  mInterProcessComms(mInterProcessCommsSocket),
+	  mLastHousekeepingRun(0),
 	  mpTestHook(NULL)
 {
 }
@@ -58,6 +63,14 @@ BackupStoreDaemon::BackupStoreDaemon()
 // --------------------------------------------------------------------------
 BackupStoreDaemon::~BackupStoreDaemon()
 {
+	for(std::map<pid_t, HousekeepingWorker>::iterator
+		i = mHousekeepingWorkers.begin();
+		i != mHousekeepingWorkers.end(); ++i)
+	{
+		delete i->second.mpComms;
+	}
+	mHousekeepingWorkers.clear();
+
 	// Must delete this one before the database ...
 	if(mpAccounts != 0)
 	{
@@ -171,11 +184,29 @@ void BackupStoreDaemon::Run()
 	mExtendedLogging = false;
 	const Configuration &config(GetConfiguration());
 	mExtendedLogging = config.GetKeyValueBool("ExtendedLogging");
+	if(config.KeyExists("DirectoryCacheSize"))
+	{
+		mDirectoryCacheSize = config.GetKeyValueInt("DirectoryCacheSize");
+	}
+	mRaidWriteBehind = config.GetKeyValueBool("RaidWriteBehind");
+	mDeferReverseDiffs = config.GetKeyValueBool("DeferReverseDiffs");
 	bool disabledHouseKeeping=false;
 	//if (config.KeyExists("DisableHouseKeeping")) {
 		disabledHouseKeeping=config.GetKeyValueBool("DisableHouseKeeping");
 	//}
 
+	// Finish the RAID transforms of any connections which died before
+	// they could, while nothing else is running which could change the
+	// files. Only needed when starting, not on -HUP.
+	if(!mHaveForkedHousekeeping)
+	{
+		RaidFileController &rcontroller(RaidFileController::GetController());
+		for(int s = 0; s < rcontroller.GetNumDiscSets(); ++s)
+		{
+			RaidFileWriteBehind::Recover(s);
+		}
+	}
+
 	// Fork off housekeeping daemon -- must only do this the first
 	// time Run() is called.  Housekeeping runs synchronously on Win32
 	// because IsSingleProcess() is always true
@@ -339,6 +370,21 @@ void BackupStoreDaemon::Connection2(std::auto_ptr<SocketStreamTLS> apStream)
 	{
 		context.SetTestHook(*mpTestHook);
 	}
+
+	if(mDirectoryCacheSize >= 0)
+	{
+		context.SetDirectoryCacheMaxSize(mDirectoryCacheSize);
+	}
+
+	context.SetDeferReverseDiffs(mDeferReverseDiffs);
+
+	// Declared after the context, so that all the files written are
+	// transformed before it releases the account's write lock
+	std::auto_ptr<RaidFileWriteBehind> apWriteBehind;
+	if(mRaidWriteBehind)
+	{
+		apWriteBehind.reset(new RaidFileWriteBehind);
+	}
 	
 	// See if the client has an account?
 	if(mpAccounts && mpAccounts->AccountExists(id))
@@ -360,22 +406,29 @@ void BackupStoreDaemon::Connection2(std::auto_ptr<SocketStreamTLS> apStream)
 	}
 	catch(...)
 	{
-		LogConnectionStats(id, context.GetAccountName(), server);
+		LogConnectionStats(id, context, server);
 		throw;
 	}
-	LogConnectionStats(id, context.GetAccountName(), server);
+	LogConnectionStats(id, context, server);
 	context.CleanUp();
 }
 
 void BackupStoreDaemon::LogConnectionStats(uint32_t accountId,
-	const std::string& accountName, const BackupProtocolServer &server)
+	BackupStoreContext &rContext, const BackupProtocolServer &server)
 {
 	// Log the amount of data transferred
 	BOX_NOTICE("Connection statistics for " << 
 		BOX_FORMAT_ACCOUNT(accountId) << " "
-		"(name=" << accountName << "):"
+		"(name=" << rContext.GetAccountName() << "):"
 		" IN="  << server.GetBytesRead() <<
 		" OUT=" << server.GetBytesWritten() <<
 		" NET_IN=" << (server.GetBytesRead() - server.GetBytesWritten()) <<
 		" TOTAL=" << (server.GetBytesRead() + server.GetBytesWritten()));
+
+	// And how well the directory cache worked
+	BOX_NOTICE("Directory cache statistics for " <<
+		BOX_FORMAT_ACCOUNT(accountId) << ":"
+		" HITS=" << rContext.GetDirectoryCacheHits() <<
+		" MISSES=" << rContext.GetDirectoryCacheMisses() <<
+		" EVICTIONS=" << rContext.GetDirectoryCacheEvictions());
 }
@@ -10,6 +10,10 @@
 #ifndef BACKUPSTOREDAEMON__H
 #define BACKUPSTOREDAEMON__H
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "ServerTLS.h"
 #include "BoxPortsAndFiles.h"
 #include "BackupConstants.h"
@@ -64,7 +68,7 @@ protected:
 	void HousekeepingProcess();
 
 	void LogConnectionStats(uint32_t accountId,
-		const std::string& accountName, const BackupProtocolServer &server);
+		BackupStoreContext &rContext, const BackupProtocolServer &server);
 
 public:
 	// HousekeepingInterface implementation
@@ -75,6 +79,9 @@ private:
 	BackupStoreAccountDatabase *mpAccountDatabase;
 	BackupStoreAccounts *mpAccounts;
 	bool mExtendedLogging;
+	int mDirectoryCacheSize;
+	bool mRaidWriteBehind;
+	bool mDeferReverseDiffs;
 	bool mHaveForkedHousekeeping;
 	bool mIsHousekeepingProcess;
 	bool mHousekeepingInited;
@@ -86,6 +93,24 @@ private:
 	void HousekeepingInit();
 	int64_t mLastHousekeepingRun;
 
+	void SortAccountsForHousekeeping(std::vector<int32_t> &rAccounts);
+	void HousekeepAccount(int32_t AccountID);
+	void RunHousekeepingWorkers(const std::vector<int32_t> &rAccounts,
+		int NumWorkers);
+	void StartHousekeepingWorker(int32_t AccountID);
+	void ReapHousekeepingWorkers();
+	void SendMessageToHousekeepingWorkers(const std::string &rLine,
+		int AccountNum = 0);
+
+	// Worker processes housekeeping one account each, and the end of
+	// the socket used to pass messages on to them, by process ID.
+	typedef struct
+	{
+		int32_t mAccountID;
+		SocketStream *mpComms;
+	} HousekeepingWorker;
+	std::map<pid_t, HousekeepingWorker> mHousekeepingWorkers;
+
 public:
 	void SetTestHook(BackupStoreContext::TestHook& rTestHook)
 	{
@@ -0,0 +1 @@
+#define BOX_VERSION "1.4.27"
@@ -30,6 +30,8 @@
 
 #include <cstdlib> // for std::atexit
 #include <map>
+#include <mutex>
+#include <new>
 #include <set>
 
 #include "MemLeakFinder.h"
@@ -127,13 +129,33 @@ MemLeakSuppressionGuard::~MemLeakSuppressionGuard()
 }
 
 // these functions may well allocate memory, which we don't want to track.
-static int sInternalAllocDepth = 0;
+// The depth is per thread, so that blocks allocated by other threads at the
+// same time are still tracked.
+static thread_local int sInternalAllocDepth = 0;
+
+// The tracking data is shared by all threads, so it's locked while in use.
+// The lock is never destroyed, because blocks are still freed after static
+// destructors have run.
+static std::recursive_mutex &memleakfinder_lock()
+{
+	static std::recursive_mutex *spLock = new (std::malloc(
+		sizeof(std::recursive_mutex))) std::recursive_mutex;
+	return *spLock;
+}
 
 class InternalAllocGuard
 {
 	public:
-	InternalAllocGuard () { sInternalAllocDepth++; }
-	~InternalAllocGuard() { sInternalAllocDepth--; }
+	InternalAllocGuard ()
+	{
+		memleakfinder_lock().lock();
+		sInternalAllocDepth++;
+	}
+	~InternalAllocGuard()
+	{
+		sInternalAllocDepth--;
+		memleakfinder_lock().unlock();
+	}
 };
 
 void memleakfinder_malloc_add_block(void *b, size_t size, const char *file, int line)
@@ -283,6 +283,31 @@ void FileStream::Write(const void *pBuffer, int NBytes, int Timeout)
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    FileStream::GetSendFileHandle()
+//		Purpose: Returns the file descriptor, which sendfile() can
+//			 read from directly. Not on Windows, where there is
+//			 no sendfile() to use it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int FileStream::GetSendFileHandle()
+{
+#ifdef WIN32
+	return -1;
+#else
+	if(mOSFileHandle == INVALID_FILE) 
+	{
+		THROW_EXCEPTION(CommonException, FileClosed)
+	}
+
+	return mOSFileHandle;
+#endif
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
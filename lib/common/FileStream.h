@@ -46,6 +46,7 @@ public:
 	virtual pos_type GetPosition() const;
 	virtual void Seek(IOStream::pos_type Offset, int SeekType);
 	virtual void Close();
+	virtual int GetSendFileHandle();
 	
 	virtual bool StreamDataLeft();
 	virtual bool StreamClosed();
@@ -51,6 +51,22 @@ void IOStream::Close()
 	// Do nothing by default -- let the destructor clear everything up.
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    IOStream::GetSendFileHandle()
+//		Purpose: Returns the OS file handle which the data read
+//			 comes straight from, so that it can be sent with
+//			 sendfile(). Most streams don't have one, and
+//			 return -1.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int IOStream::GetSendFileHandle()
+{
+	return -1;
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
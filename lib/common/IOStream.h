@@ -56,6 +56,10 @@ public:
 	virtual void Seek(pos_type Offset, int SeekType);
 	virtual void Close();
 
+	// For sending without copying: the OS file handle which Read()
+	// returns data from unchanged, from GetPosition() onwards, or -1
+	virtual int GetSendFileHandle();
+
 	// Has all data that can be read been read?
 	virtual bool StreamDataLeft() = 0;
 	// Has the stream been closed (writing not possible)
@@ -28,6 +28,7 @@
 #include <cstdio>
 #include <cstring>
 #include <iomanip>
+#include <mutex>
 
 #include "BoxTime.h"
 #include "Logging.h"
@@ -142,6 +143,11 @@ void Logging::Log(Log::Level level, const std::string& file, int line,
 	const std::string& function, const Log::Category& category,
 	const std::string& message)
 {
+	// Worker threads may log too, for example when they throw an
+	// exception, so only let one message through at a time.
+	static std::recursive_mutex sLogLock;
+	std::lock_guard<std::recursive_mutex> lock(sLogLock);
+
 	std::string newMessage;
 	
 	if (sContextSet)
@@ -29,7 +29,8 @@ ReadGatherStream::ReadGatherStream(bool DeleteComponentStreamsOnDestruction)
 	  mTotalSize(0),
 	  mCurrentBlock(0),
 	  mPositionInCurrentBlock(0),
-	  mSeekDoneForCurrent(false)
+	  mSeekDoneForCurrent(false),
+	  mSeekAllBlocks(false)
 {
 }
 
@@ -101,6 +102,22 @@ void ReadGatherStream::AddBlock(int Component, pos_type Length, bool Seek, pos_t
 	b.mSeekTo = SeekTo;
 	b.mComponent = Component;
 	b.mSeek = Seek;
+	b.mStart = Seek ? SeekTo : -1;
+
+	// Without a seek, the block follows on from the last one read from
+	// the same component
+	for(std::vector<Block>::const_reverse_iterator i(mBlocks.rbegin());
+		!Seek && i != mBlocks.rend(); ++i)
+	{
+		if(i->mComponent == Component)
+		{
+			if(i->mStart != -1)
+			{
+				b.mStart = i->mStart + i->mLength;
+			}
+			break;
+		}
+	}
 	
 	mBlocks.push_back(b);
 	
@@ -132,12 +149,17 @@ int ReadGatherStream::Read(void *pBuffer, int NBytes, int Timeout)
 		}
 			
 		// Seek?
-		if(mPositionInCurrentBlock == 0 && mBlocks[mCurrentBlock].mSeek && !mSeekDoneForCurrent)
+		if(mPositionInCurrentBlock == 0 && !mSeekDoneForCurrent &&
+			(mBlocks[mCurrentBlock].mSeek || mSeekAllBlocks))
 		{
 			// Do seeks in this manner so that seeks are done regardless of whether the block
 			// has length > 0, and it will only be done once, and at as late a stage as possible.
+			if(mBlocks[mCurrentBlock].mStart == -1)
+			{
+				THROW_EXCEPTION(CommonException, NotSupported)
+			}
 			
-			mComponents[mBlocks[mCurrentBlock].mComponent]->Seek(mBlocks[mCurrentBlock].mSeekTo, IOStream::SeekType_Absolute);
+			mComponents[mBlocks[mCurrentBlock].mComponent]->Seek(mBlocks[mCurrentBlock].mStart, IOStream::SeekType_Absolute);
 		
 			mSeekDoneForCurrent = true;
 		}
@@ -191,6 +213,76 @@ IOStream::pos_type ReadGatherStream::GetPosition() const
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    ReadGatherStream::Seek(pos_type, int)
+//		Purpose: As interface. The component streams must be seekable,
+//			 and the position must be in a block whose position in
+//			 its component is known, i.e. one added with a seek, or
+//			 following on from one in the same component which was.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void ReadGatherStream::Seek(pos_type Offset, int SeekType)
+{
+	pos_type newPosition = Offset;
+	switch(SeekType)
+	{
+	case IOStream::SeekType_Absolute:
+		break;
+	case IOStream::SeekType_Relative:
+		newPosition += mCurrentPosition;
+		break;
+	case IOStream::SeekType_End:
+		newPosition += mTotalSize;
+		break;
+	default:
+		THROW_EXCEPTION(CommonException, IOStreamBadSeekType)
+	}
+
+	if(newPosition < 0 || newPosition > mTotalSize)
+	{
+		THROW_EXCEPTION(CommonException, NotSupported)
+	}
+
+	if(newPosition == mCurrentPosition)
+	{
+		return;
+	}
+
+	// Find the block containing the new position. Empty blocks are
+	// skipped, so the position is always in a block if it's not at
+	// the very end.
+	unsigned int block = 0;
+	pos_type blockStart = 0;
+	while(block < mBlocks.size() &&
+		blockStart + mBlocks[block].mLength <= newPosition)
+	{
+		blockStart += mBlocks[block].mLength;
+		++block;
+	}
+
+	pos_type positionInBlock = newPosition - blockStart;
+	if(block < mBlocks.size())
+	{
+		const Block &rblock(mBlocks[block]);
+		if(rblock.mStart == -1)
+		{
+			THROW_EXCEPTION(CommonException, NotSupported)
+		}
+		mComponents[rblock.mComponent]->Seek(rblock.mStart + positionInBlock,
+			IOStream::SeekType_Absolute);
+	}
+
+	mCurrentBlock = block;
+	mPositionInCurrentBlock = positionInBlock;
+	mSeekDoneForCurrent = true;
+	mSeekAllBlocks = true;
+	mCurrentPosition = newPosition;
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
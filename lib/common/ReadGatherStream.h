@@ -42,6 +42,7 @@ public:
 	virtual bool StreamDataLeft();
 	virtual bool StreamClosed();
 	virtual pos_type GetPosition() const;
+	virtual void Seek(pos_type Offset, int SeekType);
 
 private:
 	bool mDeleteComponentStreamsOnDestruction;
@@ -53,6 +54,9 @@ private:
 		pos_type mSeekTo;
 		int mComponent;
 		bool mSeek;
+		// Position of the block in its component, or -1 if it's only
+		// known by reading the blocks before it
+		pos_type mStart;
 	} Block;
 	
 	std::vector<Block> mBlocks;
@@ -62,6 +66,9 @@ private:
 	unsigned int mCurrentBlock;
 	pos_type mPositionInCurrentBlock;
 	bool mSeekDoneForCurrent;
+	// After Seek(), components may not be where their next blocks
+	// start, so every block whose position is known is seeked to
+	bool mSeekAllBlocks;
 };
 
 
@@ -0,0 +1,64 @@
+
+// Auto-generated file -- do not edit
+
+#ifndef AUTOGEN_CONVERSIONEXCEPTION_H
+#define AUTOGEN_CONVERSIONEXCEPTION_H
+
+#include "BoxException.h"
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    ConversionException
+//		Purpose: Exception
+//		Created: autogen
+//
+// --------------------------------------------------------------------------
+class ConversionException : public BoxException
+{
+public:
+	ConversionException(unsigned int SubType,
+		const std::string& rMessage = "")
+	: mSubType(SubType), mMessage(rMessage),
+	  mWhat(GetMessage(SubType) + std::string(rMessage.empty() ? "" : ": ") + rMessage)
+	{
+	}
+	
+	ConversionException(const ConversionException &rToCopy)
+	: mSubType(rToCopy.mSubType), mMessage(rToCopy.mMessage), mWhat(rToCopy.mWhat)
+	{
+	}
+	
+	~ConversionException() throw ()
+	{
+	}
+	
+	enum
+	{
+		ExceptionType = 12
+	};
+
+	enum
+	{
+		Internal = 0,
+		CannotConvertEmptyStringToInt = 1,
+		BadStringRepresentationOfInt = 2,
+		IntOverflowInConvertFromString = 3,
+		BadIntSize = 4
+	};
+	
+	virtual unsigned int GetType() const throw();
+	virtual unsigned int GetSubType() const throw();
+	virtual const char *what() const throw();
+	virtual const std::string& GetMessage() const
+	{
+		return mMessage;
+	}
+	static const char* GetMessage(int SubType);
+private:
+	unsigned int mSubType;
+	std::string mMessage;
+	std::string mWhat;
+};
+
+#endif // AUTOGEN_CONVERSIONEXCEPTION_H
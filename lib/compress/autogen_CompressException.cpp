@@ -0,0 +1,40 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+#include "autogen_CompressException.h"
+
+#include "MemLeakFindOn.h"
+
+unsigned int CompressException::GetType() const throw()
+{
+	return CompressException::ExceptionType;
+}
+
+unsigned int CompressException::GetSubType() const throw()
+{
+	return mSubType;
+}
+
+const char * CompressException::what() const throw()
+{
+	return mWhat.c_str();
+}
+
+const char * CompressException::GetMessage(int SubType)
+{
+	switch(SubType)
+	{
+		case Internal: return "Internal";
+		case InitFailed: return "InitFailed";
+		case EndFailed: return "EndFailed";
+		case BadUsageInputNotRequired: return "BadUsageInputNotRequired";
+		case TransformFailed: return "TransformFailed";
+		case CopyCompressStreamNotAllowed: return "CopyCompressStreamNotAllowed";
+		case NullPointerPassedToCompressStream: return "NullPointerPassedToCompressStream";
+		case CompressStreamReadSupportNotRequested: return "CompressStreamReadSupportNotRequested";
+		case CompressStreamWriteSupportNotRequested: return "CompressStreamWriteSupportNotRequested";
+		case CannotWriteToClosedCompressStream: return "CannotWriteToClosedCompressStream";
+		default: return "Unknown";
+	}
+}
@@ -154,6 +154,59 @@ void CipherContext::Init(CipherContext::CipherFunction Function, const CipherDes
 	mInitialised = true;
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    CipherContext::Init(const CipherContext &)
+//		Purpose: Initialises the context as a copy of another initialised
+//				 context, with the same function, cipher and key, so that
+//				 each thread can have its own context for the same key.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void CipherContext::Init(const CipherContext &rSource)
+{
+	// Check for bad usage
+	if(mInitialised)
+	{
+		THROW_EXCEPTION(CipherException, AlreadyInitialised);
+	}
+	if(!rSource.mInitialised)
+	{
+		THROW_EXCEPTION(CipherException, NotInitialised);
+	}
+	if(rSource.mWithinTransform)
+	{
+		THROW_EXCEPTION(CipherException, AlreadyInTransform);
+	}
+
+#ifdef HAVE_OLD_SSL
+	// The old version keeps its own copy of the description, so just
+	// initialise from that.
+	Init(rSource.mFunction, *rSource.mpDescription);
+#else
+	BOX_OPENSSL_INIT_CTX(ctx);
+
+	if(EVP_CIPHER_CTX_copy(BOX_OPENSSL_CTX(ctx),
+		BOX_OPENSSL_CTX(const_cast<CipherContext &>(rSource).ctx)) != 1)
+	{
+		BOX_OPENSSL_CLEANUP_CTX(ctx);
+		THROW_EXCEPTION_MESSAGE(CipherException, EVPInitFailure,
+			"Failed to copy " << rSource.mCipherName << ": " <<
+			LogError("copying cipher"));
+	}
+
+	mFunction = rSource.mFunction;
+	mCipherName = rSource.mCipherName;
+	mPaddingOn = rSource.mPaddingOn;
+	mpDescription = rSource.mpDescription;
+
+	// mark as initialised
+	mInitialised = true;
+#endif
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -63,6 +63,7 @@ public:
 	} CipherFunction;
 
 	void Init(CipherContext::CipherFunction Function, const CipherDescription &rDescription);
+	void Init(const CipherContext &rSource);
 	void Reset();
 	
 	void Begin();
@@ -10,8 +10,27 @@
 #include "Box.h"
 #include "RollingChecksum.h"
 
+// AVX2 is enabled per function, after checking that the CPU supports it
+// at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || (__GNUC__ >= 5))
+	#define ROLLINGCHECKSUM_AVX2
+	#include <immintrin.h>
+#endif
+
 #include "MemLeakFindOn.h"
 
+typedef void (*RollForwardBatchFunction)(uint16_t &rA, uint16_t &rB,
+	const uint8_t *pWindow, unsigned int Length, unsigned int Count,
+	const uint8_t *pHashFilter, uint32_t *pChecksumsOut,
+	uint32_t *pInFilterOut);
+
+static int ChooseBatchImplementation();
+static RollForwardBatchFunction GetBatchFunction(int Implementation);
+
+static int sBatchImplementation = ChooseBatchImplementation();
+static RollForwardBatchFunction sBatchFunction = GetBatchFunction(sBatchImplementation);
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -60,3 +79,339 @@ void RollingChecksum::RollForwardSeveral(const uint8_t * const StartOfThisBlock,
 
 	b -= Length * sumBegin;
 }
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RollingChecksum::RollForwardBatch(const uint8_t *, unsigned int, unsigned int, const uint8_t *, uint32_t *, uint32_t *)
+//		Purpose: Writes the checksums of Count + 1 consecutive blocks, starting with
+//				 the current one at pWindow, and flags those of the first Count which
+//				 are in the hash filter. Moves the checksum forward to the last block.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RollingChecksum::RollForwardBatch(const uint8_t * const pWindow, const unsigned int Length, const unsigned int Count, const uint8_t * const pHashFilter, uint32_t * const pChecksumsOut, uint32_t * const pInFilterOut)
+{
+	(*sBatchFunction)(a, b, pWindow, Length, Count, pHashFilter,
+		pChecksumsOut, pInFilterOut);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static RollForwardBatchScalar(uint16_t &, uint16_t &, const uint8_t *, unsigned int, unsigned int, const uint8_t *, uint32_t *, uint32_t *)
+//		Purpose: RollForwardBatch() one byte at a time, exactly as
+//				 RollForward(), probing the filter as it goes.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void RollForwardBatchScalar(uint16_t &rA, uint16_t &rB,
+	const uint8_t *pWindow, unsigned int Length, unsigned int Count,
+	const uint8_t *pHashFilter, uint32_t *pChecksumsOut,
+	uint32_t *pInFilterOut)
+{
+	uint16_t a = rA;
+	uint16_t b = rB;
+	const uint8_t *pout = pWindow;
+	const uint8_t *pin = pWindow + Length;
+
+	for(unsigned int w = 0; w < (Count + 31) / 32; ++w)
+	{
+		unsigned int n = Count - (w * 32);
+		if(n > 32)
+		{
+			n = 32;
+		}
+
+		// Build each word of flags up in a register, not in memory.
+		// Only the checksums of blocks in the filter are wanted, so
+		// the others aren't written.
+		uint32_t inFilter = 0;
+		uint32_t *pchecksum = pChecksumsOut + (w * 32);
+		for(unsigned int i = 0; i < n; ++i, ++pout, ++pin)
+		{
+			pchecksum[i] = ((uint32_t)a) | (((uint32_t)b) << 16);
+			inFilter |= ((uint32_t)((pHashFilter[b >> 3] >> (b & 7)) & 1)) << i;
+
+			a -= *pout;
+			a += *pin;
+			b -= Length * (*pout);
+			b += a;
+		}
+		pInFilterOut[w] = inFilter;
+	}
+
+	pChecksumsOut[Count] = ((uint32_t)a) | (((uint32_t)b) << 16);
+	rA = a;
+	rB = b;
+}
+
+
+#ifdef ROLLINGCHECKSUM_AVX2
+
+// IMPLEMENTATION NOTE: rolling forward N positions at once, with
+// d[i] = pWindow[i + Length] - pWindow[i],
+//
+//	a after step i = a + (d[0] + ... + d[i])
+//	b after step i = b + (g[0] + ... + g[i]), where
+//	g[i] = (a after step i) - (Length * pWindow[i])
+//
+// so each is a prefix sum over a vector of 16 bit lanes, which overflow
+// mod 2^16 just like the scalar uint16_t's. Expanding g[i], the b after
+// step i is b + ((i + 1) * a) + the prefix sum of (d[0] + ... + d[i]) -
+// (Length * pWindow[i]), so both prefix sums depend only on the data, and
+// only a few additions are needed to carry a and b on to the next vector.
+//
+// Shuffles are the bottleneck, so lanes are broadcast with shifts where
+// they can be, rather than with more shuffles.
+
+// Copy 16 bit lane 1 of each 32 bit lane of x to both of its halves
+__attribute__((target("avx2")))
+static inline __m256i BroadcastHighWords(__m256i x)
+{
+	x = _mm256_srli_epi32(x, 16);
+	return _mm256_or_si256(x, _mm256_slli_epi32(x, 16));
+}
+
+// Prefix sum of the sixteen 16 bit lanes of x. AVX2 shifts only work
+// within each 128 bit half, so the total of the low half is added to
+// the high half afterwards.
+__attribute__((target("avx2")))
+static inline __m256i PrefixSum16(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_slli_si256(x, 2));
+	x = _mm256_add_epi16(x, _mm256_slli_si256(x, 4));
+	x = _mm256_add_epi16(x, _mm256_slli_si256(x, 8));
+	__m256i carry = BroadcastHighWords(_mm256_permutevar8x32_epi32(x,
+		_mm256_set1_epi32(3)));
+	return _mm256_add_epi16(x, _mm256_blend_epi32(_mm256_setzero_si256(),
+		carry, 0xf0));
+}
+
+// Broadcast the last 16 bit lane of x to all lanes
+__attribute__((target("avx2")))
+static inline __m256i BroadcastLast16(__m256i x)
+{
+	return BroadcastHighWords(_mm256_permutevar8x32_epi32(x,
+		_mm256_set1_epi32(7)));
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static RollForwardBatchAVX2(uint16_t &, uint16_t &, const uint8_t *, unsigned int, unsigned int, const uint8_t *, uint32_t *, uint32_t *)
+//		Purpose: RollForwardBatch() sixteen positions at a time with
+//				 AVX2, and then probing the filter eight checksums at a
+//				 time by gathering the 32 bit words of the filter which
+//				 hold their bits. The filter is read as little endian
+//				 words, which x86 is.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void RollForwardBatchAVX2(uint16_t &rA, uint16_t &rB,
+	const uint8_t *pWindow, unsigned int Length, unsigned int Count,
+	const uint8_t *pHashFilter, uint32_t *pChecksumsOut,
+	uint32_t *pInFilterOut)
+{
+	const __m256i length = _mm256_set1_epi16((short)Length);
+	const __m256i steps = _mm256_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8,
+		9, 10, 11, 12, 13, 14, 15, 16);
+	// a and b before the next step, in every lane
+	__m256i aBefore = _mm256_set1_epi16((short)rA);
+	__m256i bBefore = _mm256_set1_epi16((short)rB);
+
+	// The checksum of the current block comes first, followed by the
+	// checksums after each step
+	pChecksumsOut[0] = ((uint32_t)rA) | (((uint32_t)rB) << 16);
+
+	unsigned int i = 0;
+	for(; i + 16 <= Count; i += 16)
+	{
+		__m256i out = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+			(const __m128i *)(pWindow + i)));
+		__m256i in = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+			(const __m128i *)(pWindow + i + Length)));
+
+		__m256i sumD = PrefixSum16(_mm256_sub_epi16(in, out));
+		__m256i sumG = PrefixSum16(_mm256_sub_epi16(sumD,
+			_mm256_mullo_epi16(out, length)));
+
+		__m256i aAfter = _mm256_add_epi16(aBefore, sumD);
+		__m256i bAfter = _mm256_add_epi16(_mm256_add_epi16(bBefore, sumG),
+			_mm256_mullo_epi16(aBefore, steps));
+
+		// The unpacks work within each half, giving steps
+		// 0-3 and 8-11, then 4-7 and 12-15
+		__m256i lo = _mm256_unpacklo_epi16(aAfter, bAfter);
+		__m256i hi = _mm256_unpackhi_epi16(aAfter, bAfter);
+		_mm256_storeu_si256((__m256i *)(pChecksumsOut + i + 1),
+			_mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(pChecksumsOut + i + 9),
+			_mm256_permute2x128_si256(lo, hi, 0x31));
+
+		bBefore = _mm256_add_epi16(_mm256_add_epi16(bBefore,
+			BroadcastLast16(sumG)), _mm256_slli_epi16(aBefore, 4));
+		aBefore = _mm256_add_epi16(aBefore, BroadcastLast16(sumD));
+	}
+
+	// Finish off any odd positions at the end
+	uint16_t a = (uint16_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(aBefore));
+	uint16_t b = (uint16_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(bBefore));
+	for(; i < Count; ++i)
+	{
+		a -= pWindow[i];
+		a += pWindow[i + Length];
+		b -= Length * pWindow[i];
+		b += a;
+		pChecksumsOut[i + 1] = ((uint32_t)a) | (((uint32_t)b) << 16);
+	}
+	rA = a;
+	rB = b;
+
+	// Then probe the filter for all but the last checksum
+	const __m256i bitMask = _mm256_set1_epi32(31);
+	for(unsigned int w = 0; w < (Count + 31) / 32; ++w)
+	{
+		uint32_t inFilter = 0;
+		unsigned int p = w * 32;
+		for(; p + 8 <= Count && p < (w + 1) * 32; p += 8)
+		{
+			// The hash is the top 16 bits of the checksum
+			__m256i checksums = _mm256_loadu_si256(
+				(const __m256i *)(pChecksumsOut + p));
+			__m256i words = _mm256_i32gather_epi32(
+				(const int *)pHashFilter,
+				_mm256_srli_epi32(checksums, 16 + 5), 4);
+			__m256i bits = _mm256_srlv_epi32(words, _mm256_and_si256(
+				_mm256_srli_epi32(checksums, 16), bitMask));
+			inFilter |= ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_slli_epi32(bits, 31)))) << (p % 32);
+		}
+		for(; p < Count && p < (w + 1) * 32; ++p)
+		{
+			uint16_t hash = RollingChecksum::ExtractHashingComponent(pChecksumsOut[p]);
+			inFilter |= ((uint32_t)((pHashFilter[hash >> 3] >> (hash & 7)) & 1)) << (p % 32);
+		}
+		pInFilterOut[w] = inFilter;
+	}
+}
+
+#endif // ROLLINGCHECKSUM_AVX2
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static ChooseBatchImplementation()
+//		Purpose: Returns the fastest implementation of RollForwardBatch()
+//				 which this CPU supports.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static int ChooseBatchImplementation()
+{
+#ifdef ROLLINGCHECKSUM_AVX2
+	// May be called from a static initialiser, before the
+	// compiler has initialised its CPU model
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return RollingChecksum::Batch_AVX2;
+	}
+#endif
+	return RollingChecksum::Batch_Scalar;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static GetBatchFunction(int)
+//		Purpose: Returns the function for an implementation of
+//				 RollForwardBatch(), or 0 if it isn't compiled in.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static RollForwardBatchFunction GetBatchFunction(int Implementation)
+{
+	switch(Implementation)
+	{
+	case RollingChecksum::Batch_Scalar:
+		return RollForwardBatchScalar;
+#ifdef ROLLINGCHECKSUM_AVX2
+	case RollingChecksum::Batch_AVX2:
+		return RollForwardBatchAVX2;
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RollingChecksum::SetBatchImplementation(int)
+//		Purpose: Static. Selects the implementation of RollForwardBatch()
+//				 to use, for testing and benchmarking. Returns false if
+//				 this build or CPU doesn't support it. Not thread safe.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool RollingChecksum::SetBatchImplementation(int Implementation)
+{
+	RollForwardBatchFunction function = GetBatchFunction(Implementation);
+	if(function == 0)
+	{
+		return false;
+	}
+
+#ifdef ROLLINGCHECKSUM_AVX2
+	if(Implementation == Batch_AVX2 && !__builtin_cpu_supports("avx2"))
+	{
+		return false;
+	}
+#endif
+
+	sBatchImplementation = Implementation;
+	sBatchFunction = function;
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RollingChecksum::GetBatchImplementation()
+//		Purpose: Static. Returns the implementation of RollForwardBatch()
+//				 in use.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RollingChecksum::GetBatchImplementation()
+{
+	return sBatchImplementation;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RollingChecksum::GetBatchImplementationName(int)
+//		Purpose: Static. Returns the name of an implementation of
+//				 RollForwardBatch(), for logging.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+const char *RollingChecksum::GetBatchImplementationName(int Implementation)
+{
+	switch(Implementation)
+	{
+	case Batch_Scalar:	return "scalar";
+	case Batch_AVX2:	return "AVX2";
+	default:		return "unknown";
+	}
+}
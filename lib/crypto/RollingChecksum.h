@@ -55,6 +55,37 @@ public:
 	// --------------------------------------------------------------------------
 	void RollForwardSeveral(const uint8_t * const StartOfThisBlock, const uint8_t * const LastOfNextBlock, const unsigned int Length, const unsigned int Skip);
 
+	// --------------------------------------------------------------------------
+	//
+	// Function
+	//		Name:    RollingChecksum::RollForwardBatch(const uint8_t *, unsigned int, unsigned int, const uint8_t *, uint32_t *, uint32_t *)
+	//		Purpose: Given a pointer to the first byte of the current block, writes the checksums
+	//				 of the Count + 1 blocks at pWindow to pWindow + Count into pChecksumsOut,
+	//				 and moves the checksum forward to the block at pWindow + Count. Also probes
+	//				 pHashFilter, one bit for each of the 64K values of GetComponentForHashing(),
+	//				 with bit n in bit (n & 7) of byte (n >> 3), for each of the first Count
+	//				 blocks, and sets bit i of pInFilterOut if block i is in it, or clears it if
+	//				 not. pInFilterOut must have room for (Count + 31) / 32 words, and
+	//				 pWindow[0] to pWindow[Count + Length - 1] must be readable. Uses SIMD
+	//				 instructions to roll and probe several positions at once where the CPU
+	//				 has them.
+	//		Created: 2026/10/18
+	//
+	// --------------------------------------------------------------------------
+	void RollForwardBatch(const uint8_t * const pWindow, const unsigned int Length, const unsigned int Count, const uint8_t * const pHashFilter, uint32_t * const pChecksumsOut, uint32_t * const pInFilterOut);
+
+	// Implementations of RollForwardBatch(). The best one which the CPU
+	// supports is chosen at startup; the others are only for testing.
+	enum
+	{
+		Batch_Scalar = 0,
+		Batch_AVX2 = 1,
+		Batch_Max = 2
+	};
+	static bool SetBatchImplementation(int Implementation);
+	static int GetBatchImplementation();
+	static const char *GetBatchImplementationName(int Implementation);
+
 	// --------------------------------------------------------------------------
 	//
 	// Function
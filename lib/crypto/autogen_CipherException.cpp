@@ -0,0 +1,47 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+#include "autogen_CipherException.h"
+
+#include "MemLeakFindOn.h"
+
+unsigned int CipherException::GetType() const throw()
+{
+	return CipherException::ExceptionType;
+}
+
+unsigned int CipherException::GetSubType() const throw()
+{
+	return mSubType;
+}
+
+const char * CipherException::what() const throw()
+{
+	return mWhat.c_str();
+}
+
+const char * CipherException::GetMessage(int SubType)
+{
+	switch(SubType)
+	{
+		case Internal: return "Internal";
+		case UnknownCipherMode: return "UnknownCipherMode";
+		case AlreadyInitialised: return "AlreadyInitialised";
+		case BadArguments: return "BadArguments";
+		case EVPInitFailure: return "EVPInitFailure";
+		case EVPUpdateFailure: return "EVPUpdateFailure";
+		case EVPFinalFailure: return "EVPFinalFailure";
+		case NotInitialised: return "NotInitialised";
+		case OutputBufferTooSmall: return "OutputBufferTooSmall";
+		case EVPBadKeyLength: return "EVPBadKeyLength";
+		case BeginNotCalled: return "BeginNotCalled";
+		case IVSizeImplementationLimitExceeded: return "IVSizeImplementationLimitExceeded";
+		case PseudoRandNotAvailable: return "PseudoRandNotAvailable";
+		case EVPSetPaddingFailure: return "EVPSetPaddingFailure";
+		case RandomInitFailed: return "RandomInitFailed";
+		case LengthRequestedTooLongForRandomHex: return "LengthRequestedTooLongForRandomHex";
+		case AlreadyInTransform: return "AlreadyInTransform";
+		default: return "Unknown";
+	}
+}
@@ -73,9 +73,11 @@ void HTTPQueryDecoder::DecodeChunk(const char *pQueryString, int QueryStringSize
 				mInKey = false;
 				continue;
 			}
-			else if(!mInKey && c == '&')
+			else if(c == '&' && (!mInKey || !mCurrentKey.empty()))
 			{
-				// Need to store the current key/value pair
+				// Need to store the current key/value pair. A
+				// key with no value, such as "uploads" in
+				// "uploads&max-uploads=3", ends here too.
 				mrDecodeInto.insert(HTTPRequest::QueryEn_t(mCurrentKey, mCurrentValue));
 				// Blank the strings
 				mCurrentKey.erase();
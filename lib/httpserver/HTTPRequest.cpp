@@ -12,6 +12,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
 
 #include <sstream>
 
@@ -115,6 +116,7 @@ std::string HTTPRequest::GetMethodName() const
 		case Method_HEAD: return "HEAD";
 		case Method_POST: return "POST";
 		case Method_PUT: return "PUT";
+		case Method_DELETE: return "DELETE";
 		default:
 			std::ostringstream oss;
 			oss << "unknown-" << mMethod;
@@ -178,6 +180,10 @@ bool HTTPRequest::Receive(IOStreamGetLine &rGetLine, int Timeout)
 		{
 			mMethod = Method_PUT;
 		}
+		else if (mHttpVerb == "DELETE")
+		{
+			mMethod = Method_DELETE;
+		}
 		else
 		{
 			mMethod = Method_UNKNOWN;
@@ -294,8 +300,9 @@ bool HTTPRequest::Receive(IOStreamGetLine &rGetLine, int Timeout)
 		mClientKeepAliveRequested = true;
 	}
 
-	// Decode query string?
-	if((mMethod == Method_GET || mMethod == Method_HEAD) && !mQueryString.empty())
+	// Decode query string? Parameters can come with any method, e.g.
+	// the upload ID of an S3 multipart upload with PUT.
+	if(!mQueryString.empty())
 	{
 		HTTPQueryDecoder decoder(mQuery);
 		decoder.DecodeChunk(mQueryString.c_str(), mQueryString.size());
@@ -314,8 +321,11 @@ bool HTTPRequest::Receive(IOStreamGetLine &rGetLine, int Timeout)
 		}
 	}
 
-	// Parse form data?
-	if(mMethod == Method_POST && mContentLength >= 0)
+	// Parse form data? Other kinds of content, such as XML, are left
+	// for the handler to read with ReadContent().
+	if(mMethod == Method_POST && mContentLength >= 0 &&
+		(mContentType.empty() || mContentType.substr(0, 33) ==
+			"application/x-www-form-urlencoded"))
 	{
 		// Too long? Don't allow people to be nasty by sending lots of data
 		if(mContentLength > MAX_CONTENT_SIZE)
@@ -365,6 +375,8 @@ bool HTTPRequest::Receive(IOStreamGetLine &rGetLine, int Timeout)
 			bytesToCopy = mContentLength;
 		}
 		Write(rGetLine.GetBufferedData(), bytesToCopy);
+		// Anything else buffered is the start of the next request
+		rGetLine.IgnoreBufferedData(bytesToCopy);
 		SetForReading();
 		mpStreamToReadFrom = &(rGetLine.GetUnderlyingStream());
 	}
@@ -374,6 +386,12 @@ bool HTTPRequest::Receive(IOStreamGetLine &rGetLine, int Timeout)
 
 void HTTPRequest::ReadContent(IOStream& rStreamToWriteTo)
 {
+	// The rest of the content can only be read from the connection once
+	if (mContentLength > GetSize() && mpStreamToReadFrom == NULL)
+	{
+		THROW_EXCEPTION(HTTPException, RequestAlreadyBeenRead);
+	}
+
 	Seek(0, SeekType_Absolute);
 	
 	CopyStreamTo(rStreamToWriteTo);
@@ -381,16 +399,24 @@ void HTTPRequest::ReadContent(IOStream& rStreamToWriteTo)
 
 	while (bytesCopied < mContentLength)
 	{
-		char buffer[1024];
+		char buffer[16*1024];
 		IOStream::pos_type bytesToCopy = sizeof(buffer);
 		if (bytesToCopy > mContentLength - bytesCopied)
 		{
 			bytesToCopy = mContentLength - bytesCopied;
 		}
 		bytesToCopy = mpStreamToReadFrom->Read(buffer, bytesToCopy);
+		if (bytesToCopy == 0 && !mpStreamToReadFrom->StreamDataLeft())
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, RequestReadFailed,
+				"Connection closed before all of the request "
+				"content was received");
+		}
 		rStreamToWriteTo.Write(buffer, bytesToCopy);
 		bytesCopied += bytesToCopy;
 	}
+
+	mpStreamToReadFrom = NULL;
 }
 
 // --------------------------------------------------------------------------
@@ -417,10 +443,17 @@ bool HTTPRequest::Send(IOStream &rStream, int Timeout, bool ExpectContinue)
 		rStream.Write("POST"); break;
 	case Method_PUT:
 		rStream.Write("PUT"); break;
+	case Method_DELETE:
+		rStream.Write("DELETE"); break;
 	}
 
 	rStream.Write(" ");
 	rStream.Write(mRequestURI.c_str());
+	if (!mQueryString.empty())
+	{
+		rStream.Write("?");
+		rStream.Write(mQueryString.c_str());
+	}
 	rStream.Write(" ");
 
 	switch (mHTTPVersion)
@@ -491,6 +524,56 @@ bool HTTPRequest::Send(IOStream &rStream, int Timeout, bool ExpectContinue)
 	return true;
 }
 
+// Append text to a query string, escaping anything but the characters
+// which never need it
+static void AppendEscaped(std::string &rQueryString, const std::string &rText)
+{
+	for (std::string::const_iterator c = rText.begin(); c != rText.end();
+		c++)
+	{
+		if (isalnum((unsigned char)*c) || *c == '-' || *c == '_' ||
+			*c == '.' || *c == '~')
+		{
+			rQueryString += *c;
+		}
+		else
+		{
+			char escaped[4];
+			::sprintf(escaped, "%%%02X", (unsigned char)*c);
+			rQueryString += escaped;
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HTTPRequest::AddParameter(const std::string &,
+//			 const std::string &)
+//		Purpose: Add a parameter to the query string of a
+//			 hand-crafted request. A parameter with an empty
+//			 value is sent as just its name, e.g. "?uploads".
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void HTTPRequest::AddParameter(const std::string& rName,
+	const std::string& rValue)
+{
+	mQuery.insert(QueryEn_t(rName, rValue));
+
+	if (!mQueryString.empty())
+	{
+		mQueryString += '&';
+	}
+
+	AppendEscaped(mQueryString, rName);
+	if (!rValue.empty())
+	{
+		mQueryString += '=';
+		AppendEscaped(mQueryString, rValue);
+	}
+}
+
 void HTTPRequest::SendWithStream(IOStream &rStreamToSendTo, int Timeout,
 	IOStream* pStreamToSend, HTTPResponse& rResponse)
 {
@@ -41,7 +41,8 @@ public:
 		Method_GET = 1,
 		Method_HEAD = 2,
 		Method_POST = 3,
-		Method_PUT = 4
+		Method_PUT = 4,
+		Method_DELETE = 5
 	};
 	
 	HTTPRequest();
@@ -69,6 +70,12 @@ public:
 	void SendWithStream(IOStream &rStreamToSendTo, int Timeout,
 		IOStream* pStreamToSend, HTTPResponse& rResponse);
 	void ReadContent(IOStream& rStreamToWriteTo);
+	// True if some of the content hasn't been read from the connection
+	// yet, so the next request on it can't be read until it has been
+	bool IsContentWaiting() const
+	{
+		return mpStreamToReadFrom != NULL && mContentLength > GetSize();
+	}
 
 	typedef std::map<std::string, std::string> CookieJar_t;
 	
@@ -98,6 +105,10 @@ public:
 	const Query_t &GetQuery() const {return mQuery;}
 	int GetContentLength() const {return mContentLength;}
 	const std::string &GetContentType() const {return mContentType;}
+	void SetContentType(const std::string& rContentType)
+	{
+		mContentType = rContentType;
+	}
 	const CookieJar_t *GetCookies() const {return mpCookies;} // WARNING: May return NULL
 	bool GetCookie(const char *CookieName, std::string &rValueOut) const;
 	const std::string &GetCookie(const char *CookieName) const;
@@ -139,6 +150,7 @@ public:
 	{
 		mExtraHeaders.push_back(Header(ToLowerCase(rName), rValue));
 	}
+	void AddParameter(const std::string& rName, const std::string& rValue);
 	bool IsExpectingContinue() const { return mExpectContinue; }
 	const char* GetVerb() const
 	{
@@ -154,6 +166,7 @@ public:
 			case Method_HEAD: return "HEAD";
 			case Method_POST: return "POST";
 			case Method_PUT: return "PUT";
+			case Method_DELETE: return "DELETE";
 		}
 		return "Bad";
 	}
@@ -10,6 +10,7 @@
 #include "Box.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "HTTPResponse.h"
@@ -35,7 +36,9 @@ HTTPResponse::HTTPResponse(IOStream* pStreamToSendTo)
 	  mResponseIsDynamicContent(true),
 	  mKeepAlive(false),
 	  mContentLength(-1),
-	  mpStreamToSendTo(pStreamToSendTo)
+	  mpStreamToSendTo(pStreamToSendTo),
+	  mChunkedEncodingAllowed(false),
+	  mChunkedEncodingReceived(false)
 {
 }
 
@@ -53,7 +56,9 @@ HTTPResponse::HTTPResponse()
 	  mResponseIsDynamicContent(true),
 	  mKeepAlive(false),
 	  mContentLength(-1),
-	  mpStreamToSendTo(NULL)
+	  mpStreamToSendTo(NULL),
+	  mChunkedEncodingAllowed(false),
+	  mChunkedEncodingReceived(false)
 {
 }
 
@@ -133,11 +138,32 @@ void HTTPResponse::SetContentType(const char *ContentType)
 }
 
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    WriteChunk(IOStream &, const void *, int)
+//		Purpose: Write one chunk of a response sent with chunked
+//			 transfer encoding
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void WriteChunk(IOStream &rStream, const void *pData, int Bytes)
+{
+	char size[32];
+	int sizeLength = ::sprintf(size, "%x\r\n", Bytes);
+	rStream.Write(size, sizeLength);
+	rStream.Write(pData, Bytes);
+	rStream.Write("\r\n", 2);
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
 //		Name:    HTTPResponse::Send(IOStream &, bool)
 //		Purpose: Build the response, and send via the stream.
+//			 The response stream, if any, is sent after the
+//			 data written to the response, and then released.
 //		Created: 26/3/2004
 //
 // --------------------------------------------------------------------------
@@ -148,21 +174,56 @@ void HTTPResponse::Send(bool OmitContent)
 		THROW_EXCEPTION(HTTPException, NoStreamConfigured);
 	}
 
-	if (GetSize() != 0 && mContentType.empty())
+	if ((GetSize() != 0 || mapResponseStream.get() != NULL) &&
+		mContentType.empty())
 	{
 		THROW_EXCEPTION(HTTPException, NoContentTypeSet);
 	}
 
+	// Work out how the client will find the end of the content. If the
+	// stream's size isn't known, and the client can't take it in chunks,
+	// the only way left is to close the connection after it. A response
+	// to HEAD has the length that the content would have, if known.
+	int64_t contentLength = GetSize();
+	bool chunked = false;
+	if(mapResponseStream.get() != NULL)
+	{
+		IOStream::pos_type streamSize =
+			mapResponseStream->BytesLeftToRead();
+		if(streamSize != IOStream::SizeOfStreamUnknown)
+		{
+			contentLength += streamSize;
+		}
+		else if(OmitContent)
+		{
+			contentLength = -1;
+		}
+		else if(mChunkedEncodingAllowed)
+		{
+			chunked = true;
+		}
+		else
+		{
+			contentLength = -1;
+			mKeepAlive = false;
+		}
+	}
+
 	// Build and send header
 	{
 		std::string header("HTTP/1.1 ");
 		header += ResponseCodeToString(mResponseCode);
 		header += "\r\nContent-Type: ";
 		header += mContentType;
-		header += "\r\nContent-Length: ";
+		if(chunked)
+		{
+			header += "\r\nTransfer-Encoding: chunked";
+		}
+		else if(contentLength >= 0)
 		{
+			header += "\r\nContent-Length: ";
 			char len[32];
-			::sprintf(len, "%d", OmitContent?(0):(GetSize()));
+			::sprintf(len, "%lld", (long long)contentLength);
 			header += len;
 		}
 		// Extra headers...
@@ -199,13 +260,85 @@ void HTTPResponse::Send(bool OmitContent)
 		mpStreamToSendTo->Write(header.c_str(), header.size());
 	}
 
+	std::auto_ptr<IOStream> apStream(mapResponseStream);
+	if(OmitContent)
+	{
+		return;
+	}
+
 	// Send content
-	if(!OmitContent)
+	if(chunked)
 	{
-		mpStreamToSendTo->Write(GetBuffer(), GetSize());
+		if(GetSize() > 0)
+		{
+			WriteChunk(*mpStreamToSendTo, GetBuffer(), GetSize());
+		}
+		char buffer[16*1024];
+		while(apStream->StreamDataLeft())
+		{
+			int bytes = apStream->Read(buffer, sizeof(buffer));
+			if(bytes > 0)
+			{
+				WriteChunk(*mpStreamToSendTo, buffer, bytes);
+			}
+		}
+		mpStreamToSendTo->Write("0\r\n\r\n", 5);
+		return;
+	}
+
+	mpStreamToSendTo->Write(GetBuffer(), GetSize());
+	if(apStream.get() == NULL)
+	{
+		return;
+	}
+
+	// If the length was sent, exactly that much must follow, or the
+	// client would take the next response as part of this one
+	int64_t bytesLeft = contentLength - GetSize();
+	char buffer[16*1024];
+	while(contentLength < 0 || bytesLeft > 0)
+	{
+		int toRead = sizeof(buffer);
+		if(contentLength >= 0 && bytesLeft < toRead)
+		{
+			toRead = (int)bytesLeft;
+		}
+		int bytes = apStream->Read(buffer, toRead);
+		if(bytes == 0 && !apStream->StreamDataLeft())
+		{
+			if(contentLength < 0)
+			{
+				break;
+			}
+			THROW_EXCEPTION(HTTPException, ResponseStreamEndedEarly)
+		}
+		mpStreamToSendTo->Write(buffer, bytes);
+		bytesLeft -= bytes;
 	}
 }
 
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HTTPResponse::CollectResponseStream()
+//		Purpose: Read all of the response stream, if any, into the
+//			 response itself, for when the response is used in
+//			 the same process instead of being sent.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void HTTPResponse::CollectResponseStream()
+{
+	if(mapResponseStream.get() == NULL)
+	{
+		return;
+	}
+
+	std::auto_ptr<IOStream> apStream(mapResponseStream);
+	apStream->CopyStreamTo(*this, IOStream::TimeOutInfinite, 16*1024);
+}
+
 void HTTPResponse::SendContinue()
 {
 	mpStreamToSendTo->Write("HTTP/1.1 100 Continue\r\n");
@@ -280,6 +413,20 @@ void HTTPResponse::ParseHeaders(IOStreamGetLine &rGetLine, int Timeout)
 				// Store rest of string as content type
 				mContentType = h + dataStart;
 			}
+			else if(p == sizeof("Transfer-Encoding")-1
+				&& ::strncasecmp(h, "Transfer-Encoding", sizeof("Transfer-Encoding")-1) == 0)
+			{
+				// Chunked must be the last coding, and there's no
+				// support for any others
+				const char *v = h + dataStart;
+				if(::strcasecmp(v, "chunked") != 0)
+				{
+					THROW_EXCEPTION_MESSAGE(HTTPException,
+						NotImplemented, "Unsupported "
+						"transfer encoding: " << v);
+				}
+				mChunkedEncodingReceived = true;
+			}
 			else if(p == sizeof("Cookie")-1
 				&& ::strncasecmp(h, "Cookie", sizeof("Cookie")-1) == 0)
 			{
@@ -334,7 +481,7 @@ void HTTPResponse::ParseHeaders(IOStreamGetLine &rGetLine, int Timeout)
 	}
 }
 
-void HTTPResponse::Receive(IOStream& rStream, int Timeout)
+void HTTPResponse::Receive(IOStream& rStream, int Timeout, bool OmitContent)
 {
 	IOStreamGetLine rGetLine(rStream);
 
@@ -380,6 +527,23 @@ void HTTPResponse::Receive(IOStream& rStream, int Timeout)
 
 	ParseHeaders(rGetLine, Timeout);
 
+	// No content follows these, whatever the headers say about it, and
+	// waiting for some would block a connection which is kept alive.
+	// GetContentLength() returns the length which a HEAD response gave.
+	if (OmitContent || status == Code_NoContent ||
+		status == Code_NotModified)
+	{
+		SetForReading();
+		return;
+	}
+
+	if (mChunkedEncodingReceived)
+	{
+		ReceiveChunks(rGetLine, Timeout);
+		SetForReading();
+		return;
+	}
+
 	// push back whatever bytes we have left
 	// rGetLine.DetachFile();
 	if (mContentLength > 0)
@@ -395,6 +559,13 @@ void HTTPResponse::Receive(IOStream& rStream, int Timeout)
 		Write(rGetLine.GetBufferedData(),
 			rGetLine.GetSizeOfBufferedData());
 	}
+	else if (mContentLength < 0)
+	{
+		// The content runs until the connection closes, and may
+		// have started arriving with the headers
+		Write(rGetLine.GetBufferedData(),
+			rGetLine.GetSizeOfBufferedData());
+	}
 
 	while (mContentLength != 0) // could be -1 as well
 	{
@@ -416,6 +587,113 @@ void HTTPResponse::Receive(IOStream& rStream, int Timeout)
 	SetForReading();
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HTTPResponse::ReceiveChunks(IOStreamGetLine &, int)
+//		Purpose: Private. Read content sent with chunked transfer
+//			 encoding, up to the end of the response.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void HTTPResponse::ReceiveChunks(IOStreamGetLine &rGetLine, int Timeout)
+{
+	while(true)
+	{
+		std::string sizeLine;
+		if(!rGetLine.GetLine(sizeLine, false /* no preprocess */, Timeout))
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, ResponseReadFailed,
+				"Failed to read the size of the next chunk of the "
+				"response within the timeout");
+		}
+
+		// Any chunk extensions after the size are ignored
+		char *sizeEnd = NULL;
+		long long size = ::strtoll(sizeLine.c_str(), &sizeEnd, 16);
+		if(sizeEnd == sizeLine.c_str() || size < 0)
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, BadResponse,
+				"HTTP server sent an invalid chunk size: " <<
+				sizeLine);
+		}
+
+		if(size == 0)
+		{
+			break;
+		}
+
+		ReceiveFromGetLine(rGetLine, size, Timeout);
+
+		std::string chunkEnd;
+		if(!rGetLine.GetLine(chunkEnd, false /* no preprocess */, Timeout) ||
+			!chunkEnd.empty())
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, BadResponse,
+				"HTTP server sent a chunk longer than its size");
+		}
+	}
+
+	// Skip any trailer headers, up to the blank line ending the response
+	std::string trailer;
+	do
+	{
+		if(!rGetLine.GetLine(trailer, false /* no preprocess */, Timeout))
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, ResponseReadFailed,
+				"Failed to read the end of the response within "
+				"the timeout");
+		}
+	}
+	while(!trailer.empty());
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    HTTPResponse::ReceiveFromGetLine(IOStreamGetLine &,
+//			 int64_t, int)
+//		Purpose: Private. Add exactly Bytes bytes of content to the
+//			 response, using any data already buffered by the
+//			 GetLine object before reading from the stream.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void HTTPResponse::ReceiveFromGetLine(IOStreamGetLine &rGetLine, int64_t Bytes,
+	int Timeout)
+{
+	while(Bytes > 0)
+	{
+		int buffered = rGetLine.GetSizeOfBufferedData();
+		if(buffered > 0)
+		{
+			int bytes = (Bytes < buffered) ? (int)Bytes : buffered;
+			Write(rGetLine.GetBufferedData(), bytes);
+			rGetLine.IgnoreBufferedData(bytes);
+			Bytes -= bytes;
+			continue;
+		}
+
+		char buffer[4096];
+		int bytes = sizeof(buffer);
+		if(Bytes < bytes)
+		{
+			bytes = (int)Bytes;
+		}
+		bytes = rGetLine.GetUnderlyingStream().Read(buffer, bytes, Timeout);
+		if(bytes == 0)
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException, ResponseReadFailed,
+				"Failed to read the whole response within the "
+				"timeout");
+		}
+		Write(buffer, bytes);
+		Bytes -= bytes;
+	}
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -10,10 +10,12 @@
 #ifndef HTTPRESPONSE__H
 #define HTTPRESPONSE__H
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "CollectInBufferStream.h"
+#include "autogen_HTTPException.h"
 
 class IOStreamGetLine;
 
@@ -34,6 +36,7 @@ public:
 
 	// allow copying, but be very careful with the response stream,
 	// you can only read it once! (this class doesn't police it).
+	// Responses with a stream set by SetResponseStream() can't be copied.
 	HTTPResponse(const HTTPResponse& rOther)
 	: mResponseCode(rOther.mResponseCode),
 	  mResponseIsDynamicContent(rOther.mResponseIsDynamicContent),
@@ -41,13 +44,24 @@ public:
 	  mContentType(rOther.mContentType),
 	  mExtraHeaders(rOther.mExtraHeaders),
 	  mContentLength(rOther.mContentLength),
-	  mpStreamToSendTo(rOther.mpStreamToSendTo)
+	  mpStreamToSendTo(rOther.mpStreamToSendTo),
+	  mChunkedEncodingAllowed(rOther.mChunkedEncodingAllowed),
+	  mChunkedEncodingReceived(rOther.mChunkedEncodingReceived)
 	{
+		if(rOther.mapResponseStream.get() != NULL)
+		{
+			THROW_EXCEPTION(HTTPException, ResponseStreamCannotBeCopied)
+		}
 		Write(rOther.GetBuffer(), rOther.GetSize());
+		CopyReadPosition(rOther);
 	}
 		
 	HTTPResponse &operator=(const HTTPResponse &rOther)
 	{
+		if(rOther.mapResponseStream.get() != NULL)
+		{
+			THROW_EXCEPTION(HTTPException, ResponseStreamCannotBeCopied)
+		}
 		Reset();
 		Write(rOther.GetBuffer(), rOther.GetSize());
 		mResponseCode = rOther.mResponseCode;
@@ -57,6 +71,10 @@ public:
 		mExtraHeaders = rOther.mExtraHeaders;
 		mContentLength = rOther.mContentLength;
 		mpStreamToSendTo = rOther.mpStreamToSendTo;
+		mapResponseStream.reset();
+		mChunkedEncodingAllowed = rOther.mChunkedEncodingAllowed;
+		mChunkedEncodingReceived = rOther.mChunkedEncodingReceived;
+		CopyReadPosition(rOther);
 		return *this;
 	}
 	
@@ -73,7 +91,9 @@ public:
 
 	void Send(bool OmitContent = false);
 	void SendContinue();
-	void Receive(IOStream& rStream, int Timeout = IOStream::TimeOutInfinite);
+	// Set OmitContent when receiving the response to a HEAD request
+	void Receive(IOStream& rStream, int Timeout = IOStream::TimeOutInfinite,
+		bool OmitContent = false);
 
 	// void AddHeader(const char *EntireHeaderLine);
 	// void AddHeader(const std::string &rEntireHeaderLine);
@@ -106,10 +126,28 @@ public:
 
 	// Set dynamic content flag, default is content is dynamic
 	void SetResponseIsDynamicContent(bool IsDynamic) {mResponseIsDynamicContent = IsDynamic;}
-	// Set keep alive control, default is to mark as to be closed
+	// Set keep alive control, default is to mark as to be closed.
+	// Send() turns it off if the client can only find the end of the
+	// content by the connection closing.
 	void SetKeepAlive(bool KeepAlive) {mKeepAlive = KeepAlive;}
 	bool IsKeepAlive() {return mKeepAlive;}
 
+	// Send the rest of this stream as the content, after anything written
+	// to the response itself, without holding it all in memory. Pass an
+	// empty pointer to drop a stream that was set.
+	void SetResponseStream(std::auto_ptr<IOStream> apStream)
+	{
+		mapResponseStream = apStream;
+	}
+	bool HasResponseStream() const {return mapResponseStream.get() != NULL;}
+	void CollectResponseStream();
+	// Set if the client understands chunked transfer encoding, which is
+	// used to send response streams whose size isn't known in advance
+	void SetChunkedEncodingAllowed(bool Allowed)
+	{
+		mChunkedEncodingAllowed = Allowed;
+	}
+
 	void SetCookie(const char *Name, const char *Value, const char *Path = "/", int ExpiresAt = 0);
 
 	enum
@@ -167,10 +205,26 @@ private:
 	std::vector<Header> mExtraHeaders;
 	int64_t mContentLength; // only used when reading response from stream
 	IOStream* mpStreamToSendTo; // nonzero only when constructed with a stream
+	std::auto_ptr<IOStream> mapResponseStream;
+	bool mChunkedEncodingAllowed;
+	bool mChunkedEncodingReceived; // only used when reading response from stream
 
 	static std::string msDefaultURIPrefix;
 
 	void ParseHeaders(IOStreamGetLine &rGetLine, int Timeout);
+	void ReceiveChunks(IOStreamGetLine &rGetLine, int Timeout);
+	// A received response can be read from a copy of it, such as the one
+	// returned by a function
+	void CopyReadPosition(const HTTPResponse& rOther)
+	{
+		if(rOther.IsSetForReading())
+		{
+			SetForReading();
+			Seek(rOther.GetPosition(), IOStream::SeekType_Absolute);
+		}
+	}
+	void ReceiveFromGetLine(IOStreamGetLine &rGetLine, int64_t Bytes,
+		int Timeout);
 };
 
 #endif // HTTPRESPONSE__H
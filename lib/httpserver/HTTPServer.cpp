@@ -28,7 +28,9 @@
 //
 // --------------------------------------------------------------------------
 HTTPServer::HTTPServer(int Timeout)
-: mTimeout(Timeout)
+: mTimeout(Timeout),
+  mKeepAliveMaxRequests(1),
+  mKeepAliveTimeout(Timeout)
 {
 }
 
@@ -119,6 +121,10 @@ void HTTPServer::Run()
 	const Configuration &conf(GetConfiguration());
 	HTTPResponse::SetDefaultURIPrefix(conf.GetKeyValue("AddressPrefix"));
 
+	const Configuration &server(conf.GetSubConfiguration("Server"));
+	mKeepAliveMaxRequests = server.GetKeyValueInt("KeepAliveMaxRequests");
+	mKeepAliveTimeout = server.GetKeyValueInt("KeepAliveTimeout") * 1000;
+
 	// Let the base class do the work
 	ServerStream<SocketStream, 80>::Run();
 }
@@ -140,12 +146,17 @@ void HTTPServer::Connection(std::auto_ptr<SocketStream> apConn)
 	// Notify dervived claases
 	HTTPConnectionOpening();
 
+	// Keeping a connection open in a server which doesn't fork would
+	// stop it accepting any others until the client closed it.
+	int requestsLeft = WillForkToHandleRequests() ? mKeepAliveMaxRequests : 1;
 	bool handleRequests = true;
-	while(handleRequests)
+	for(int requestCount = 0; handleRequests; requestCount++)
 	{
-		// Parse the request
+		// Parse the request. Clients get the usual timeout to send the
+		// first one, but only the shorter idle timeout for each next one.
 		HTTPRequest request;
-		if(!request.Receive(getLine, mTimeout))
+		if(!request.Receive(getLine,
+			(requestCount == 0) ? mTimeout : mKeepAliveTimeout))
 		{
 			// Didn't get request, connection probably closed.
 			break;
@@ -153,6 +164,8 @@ void HTTPServer::Connection(std::auto_ptr<SocketStream> apConn)
 
 		// Generate a response
 		HTTPResponse response(apConn.get());
+		response.SetChunkedEncodingAllowed(request.GetHTTPVersion() >=
+			HTTPRequest::HTTPVersion_1_1);
 
 		try
 		{
@@ -170,29 +183,19 @@ void HTTPServer::Connection(std::auto_ptr<SocketStream> apConn)
 			SendInternalErrorResponse("unknown", response);
 		}
 
-		// Keep alive? response.GetSize() works for CollectInBufferStream, but
-		// when we make HTTPResponse stream the response instead, we'll need to
-		// figure out whether we can get the response length from the IOStream
-		// to be streamed, or not. Also, we don't currently support chunked
-		// encoding, and http://tools.ietf.org/html/rfc7230#section-3.3.1 says
-		// that "If any transfer coding other than chunked is applied to a
-		// response payload body, the sender MUST either apply chunked as the
-		// final transfer coding or terminate the message by closing the
-		// connection. So for now, keepalive stays off.
-		if(false && request.GetClientKeepAliveRequested() &&
-			response.GetSize() >= 0)
-		{
-			// Mark the response to the client as supporting keepalive
-			response.SetKeepAlive(true);
-		}
-		else
-		{
-			// Stop now
-			handleRequests = false;
-		}
+		// Keep alive, if the client wants to and we've not handled
+		// too many requests already? Not if the handler left some of
+		// the request content unread, as it would be taken for the
+		// next request. Send() can still turn it off, if the client
+		// can only tell where the response ends by the connection
+		// closing.
+		--requestsLeft;
+		response.SetKeepAlive(request.GetClientKeepAliveRequested() &&
+			requestsLeft > 0 && !request.IsContentWaiting());
 	
 		// Send the response (omit any content if this is a HEAD method request)
 		response.Send(request.GetMethod() == HTTPRequest::Method_HEAD);
+		handleRequests = response.IsKeepAlive();
 	}
 
 	// Notify derived classes
@@ -219,8 +222,10 @@ void HTTPServer::SendInternalErrorResponse(const std::string& rErrorMsg,
 			"<p>Please try again later.</p>" \
 			"</body>\n</html>\n"
 
-	// Generate the error page
+	// Generate the error page, instead of any stream that the handler
+	// set up to send before it failed
 	// rResponse.SetResponseCode(HTTPResponse::Code_InternalServerError);
+	rResponse.SetResponseStream(std::auto_ptr<IOStream>());
 	rResponse.SetContentType("text/html");
 	rResponse.Write(ERROR_HTML_1, sizeof(ERROR_HTML_1) - 1);
 	rResponse.IOStream::Write(rErrorMsg.c_str());
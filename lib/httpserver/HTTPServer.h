@@ -28,7 +28,8 @@ class HTTPServer : public ServerStream<SocketStream, 80>
 {
 public:
 	HTTPServer(int Timeout = 60000);
-	// default timeout leaves 1 minute for clients to get a second request in.
+	// default timeout leaves 1 minute for clients to send a request in,
+	// but kept-alive connections wait KeepAliveTimeout for the next one.
 	~HTTPServer();
 private:
 	// no copying
@@ -60,6 +61,8 @@ protected:
 
 private:
 	int mTimeout;	// Timeout for read operations
+	int mKeepAliveMaxRequests; // Requests on one connection before closing it
+	int mKeepAliveTimeout; // Timeout waiting for the next request, in ms
 	const char *DaemonName() const;
 	const ConfigurationVerify *GetConfigVerify() const;
 	void Run();
@@ -74,8 +77,11 @@ private:
 // AddressPrefix is, for example, http://localhost:1080 -- ie the beginning of the URI
 // This is used for handling redirections.
 
-// Server level
+// Server level. KeepAliveTimeout is in seconds, and a KeepAliveMaxRequests
+// of 1 turns keep-alive off.
 #define HTTPSERVER_VERIFY_SERVER_KEYS(DEFAULT_ADDRESSES) \
+	ConfigurationVerifyKey("KeepAliveMaxRequests", ConfigTest_IsInt, 100), \
+	ConfigurationVerifyKey("KeepAliveTimeout", ConfigTest_IsInt, 15), \
 	SERVERSTREAM_VERIFY_SERVER_KEYS(DEFAULT_ADDRESSES)
 
 #endif // HTTPSERVER__H
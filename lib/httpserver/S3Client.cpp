@@ -10,6 +10,7 @@
 #include "Box.h"
 
 #include <cstring>
+#include <deque>
 
 // #include <cstdio>
 // #include <ctime>
@@ -20,6 +21,7 @@
 #include "HTTPResponse.h"
 #include "HTTPServer.h"
 #include "autogen_HTTPException.h"
+#include "CollectInBufferStream.h"
 #include "IOStream.h"
 #include "Logging.h"
 #include "S3Client.h"
@@ -28,6 +30,26 @@
 
 #include "MemLeakFindOn.h"
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::~S3Client()
+//		Purpose: Destructor. Closes the connections which were kept
+//			 open for more requests.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+S3Client::~S3Client()
+{
+	for (std::vector<SocketStream *>::iterator
+		i  = mIdleConnections.begin();
+		i != mIdleConnections.end(); i++)
+	{
+		delete *i;
+	}
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -79,6 +101,351 @@ HTTPResponse S3Client::PutObject(const std::string& rObjectURI,
 		&rStreamToSend, pContentType);
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::GetObjectAsync(const std::string&)
+//		Purpose: Start retrieving an object on another thread. The
+//			 future returns the response when it's been received,
+//			 or throws whatever exception GetObject() would have.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::future<HTTPResponse> S3Client::GetObjectAsync(
+	const std::string& rObjectURI)
+{
+	return std::async(std::launch::async, &S3Client::FinishAndSendRequest,
+		this, HTTPRequest::Method_GET, rObjectURI, (IOStream *)NULL,
+		(const char *)NULL);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::HeadObjectAsync(const std::string&)
+//		Purpose: Start retrieving the metadata of an object on
+//			 another thread, as GetObjectAsync().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::future<HTTPResponse> S3Client::HeadObjectAsync(
+	const std::string& rObjectURI)
+{
+	return std::async(std::launch::async, &S3Client::FinishAndSendRequest,
+		this, HTTPRequest::Method_HEAD, rObjectURI, (IOStream *)NULL,
+		(const char *)NULL);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::PutObjectAsync(const std::string&,
+//			 IOStream&, const char*)
+//		Purpose: Start uploading a stream on another thread, as
+//			 GetObjectAsync(). The stream, and the content type
+//			 if any, must not be destroyed until the upload has
+//			 finished.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::future<HTTPResponse> S3Client::PutObjectAsync(
+	const std::string& rObjectURI, IOStream& rStreamToSend,
+	const char* pContentType)
+{
+	return std::async(std::launch::async, &S3Client::FinishAndSendRequest,
+		this, HTTPRequest::Method_PUT, rObjectURI, &rStreamToSend,
+		pContentType);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::CreateMultipartUpload(const std::string&,
+//			 const char*)
+//		Purpose: Start a multipart upload of an object, and return
+//			 the ID which S3 gave it. The object isn't created or
+//			 replaced until CompleteMultipartUpload() is called.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::string S3Client::CreateMultipartUpload(const std::string& rObjectURI,
+	const char* pContentType)
+{
+	HTTPRequest request(HTTPRequest::Method_POST, rObjectURI);
+	request.AddParameter("uploads", "");
+	if (pContentType)
+	{
+		request.SetContentType(pContentType);
+	}
+
+	HTTPResponse response = SignAndSendRequest(request);
+	CheckResponse(response, "Failed to start a multipart upload of " +
+		rObjectURI);
+
+	// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadInitiate.html
+	std::string body((const char *)response.GetBuffer(),
+		response.GetSize());
+	std::string::size_type start = body.find("<UploadId>");
+	std::string::size_type end = body.find("</UploadId>");
+	if (start == std::string::npos || end == std::string::npos ||
+		end < start)
+	{
+		THROW_EXCEPTION_MESSAGE(HTTPException, BadResponse,
+			"S3 did not return an upload ID for " << rObjectURI);
+	}
+
+	start += ::strlen("<UploadId>");
+	return body.substr(start, end - start);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::UploadPart(const std::string&,
+//			 const std::string&, int, IOStream&)
+//		Purpose: Upload one part of a multipart upload. The ETag
+//			 header of a successful response must be passed to
+//			 CompleteMultipartUpload().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+HTTPResponse S3Client::UploadPart(const std::string& rObjectURI,
+	const std::string& rUploadID, int PartNumber, IOStream& rStreamToSend)
+{
+	return SendUploadPart(rObjectURI, rUploadID, PartNumber,
+		&rStreamToSend);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::UploadPartAsync(const std::string&,
+//			 const std::string&, int, IOStream&)
+//		Purpose: Start uploading one part of a multipart upload on
+//			 another thread, as PutObjectAsync().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::future<HTTPResponse> S3Client::UploadPartAsync(
+	const std::string& rObjectURI, const std::string& rUploadID,
+	int PartNumber, IOStream& rStreamToSend)
+{
+	return std::async(std::launch::async, &S3Client::SendUploadPart,
+		this, rObjectURI, rUploadID, PartNumber, &rStreamToSend);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::SendUploadPart(std::string, std::string,
+//			 int, IOStream*)
+//		Purpose: Private. Upload one part, taking copies of the
+//			 strings so that it can run on another thread.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+HTTPResponse S3Client::SendUploadPart(std::string ObjectURI,
+	std::string UploadID, int PartNumber, IOStream* pStreamToSend)
+{
+	std::ostringstream partNumber;
+	partNumber << PartNumber;
+
+	HTTPRequest request(HTTPRequest::Method_PUT, ObjectURI);
+	request.AddParameter("partNumber", partNumber.str());
+	request.AddParameter("uploadId", UploadID);
+	return SignAndSendRequest(request, pStreamToSend);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::CompleteMultipartUpload(
+//			 const std::string&, const std::string&,
+//			 const std::vector<std::string>&)
+//		Purpose: Finish a multipart upload, creating or replacing
+//			 the object with the parts joined together. Note that
+//			 S3 may report a failure in the content of a 200 OK
+//			 response.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+HTTPResponse S3Client::CompleteMultipartUpload(const std::string& rObjectURI,
+	const std::string& rUploadID, const std::vector<std::string>& rPartETags)
+{
+	// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadComplete.html
+	std::ostringstream parts;
+	parts << "<CompleteMultipartUpload>\n";
+	for (size_t i = 0; i < rPartETags.size(); i++)
+	{
+		parts << "<Part><PartNumber>" << (i + 1) << "</PartNumber>" <<
+			"<ETag>" << rPartETags[i] << "</ETag></Part>\n";
+	}
+	parts << "</CompleteMultipartUpload>\n";
+
+	CollectInBufferStream content;
+	content.Write(parts.str().c_str(), parts.str().size());
+	content.SetForReading();
+
+	HTTPRequest request(HTTPRequest::Method_POST, rObjectURI);
+	request.AddParameter("uploadId", rUploadID);
+	request.SetContentType("application/xml");
+	return SignAndSendRequest(request, &content);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::AbortMultipartUpload(const std::string&,
+//			 const std::string&)
+//		Purpose: Abandon a multipart upload, and delete the parts
+//			 already uploaded.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+HTTPResponse S3Client::AbortMultipartUpload(const std::string& rObjectURI,
+	const std::string& rUploadID)
+{
+	HTTPRequest request(HTTPRequest::Method_DELETE, rObjectURI);
+	request.AddParameter("uploadId", rUploadID);
+	return SignAndSendRequest(request);
+}
+
+namespace
+{
+	// A part of PutObjectMultipart() which is being uploaded. The
+	// future must be destroyed first, as doing so waits for the upload
+	// to finish with the data.
+	struct MultipartUploadPart
+	{
+		CollectInBufferStream mData;
+		std::future<HTTPResponse> mResponse;
+	};
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::PutObjectMultipart(const std::string&,
+//			 IOStream&, int, const char*)
+//		Purpose: Upload a stream in parts of PartSize bytes, sending
+//			 as many parts at once as there can be connections.
+//			 Only that many parts are held in memory. Throws an
+//			 exception if the upload fails, after abandoning it.
+//			 S3 won't accept parts smaller than
+//			 S3_MULTIPART_MINIMUM_PART_SIZE, except the last.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Client::PutObjectMultipart(const std::string& rObjectURI,
+	IOStream& rStreamToSend, int PartSize, const char* pContentType)
+{
+	ASSERT(PartSize > 0);
+	std::string uploadID = CreateMultipartUpload(rObjectURI,
+		pContentType);
+	std::deque<MultipartUploadPart *> uploading;
+	std::vector<std::string> etags;
+
+	try
+	{
+		bool moreToRead = true;
+		while (moreToRead)
+		{
+			std::auto_ptr<MultipartUploadPart> apPart(
+				new MultipartUploadPart);
+			char buffer[64*1024];
+			while (apPart->mData.GetSize() < PartSize &&
+				rStreamToSend.StreamDataLeft())
+			{
+				int toRead = sizeof(buffer);
+				if (toRead > PartSize - apPart->mData.GetSize())
+				{
+					toRead = PartSize - apPart->mData.GetSize();
+				}
+				int bytes = rStreamToSend.Read(buffer, toRead,
+					mNetworkTimeout);
+				apPart->mData.Write(buffer, bytes);
+			}
+			moreToRead = rStreamToSend.StreamDataLeft();
+
+			// An empty object still needs one part, but the end
+			// of the stream may only be found after the last one
+			int partNumber = etags.size() + uploading.size() + 1;
+			if (apPart->mData.GetSize() > 0 || partNumber == 1)
+			{
+				apPart->mData.SetForReading();
+				apPart->mResponse = UploadPartAsync(rObjectURI,
+					uploadID, partNumber, apPart->mData);
+				uploading.push_back(apPart.release());
+			}
+
+			while (!uploading.empty() && (!moreToRead ||
+				(int)uploading.size() >= mMaxConnections))
+			{
+				std::auto_ptr<MultipartUploadPart> apDone(
+					uploading.front());
+				uploading.pop_front();
+
+				HTTPResponse response = apDone->mResponse.get();
+				std::ostringstream message;
+				message << "Failed to upload part " <<
+					(etags.size() + 1) << " of " << rObjectURI;
+				CheckResponse(response, message.str());
+
+				std::string etag;
+				if (!response.GetHeader("ETag", &etag))
+				{
+					THROW_EXCEPTION_MESSAGE(HTTPException,
+						BadResponse, "S3 did not return "
+						"an ETag for " << message.str());
+				}
+				etags.push_back(etag);
+			}
+		}
+
+		HTTPResponse response = CompleteMultipartUpload(rObjectURI,
+			uploadID, etags);
+		std::string message = "Failed to complete the multipart "
+			"upload of " + rObjectURI;
+		CheckResponse(response, message);
+		std::string body((const char *)response.GetBuffer(),
+			response.GetSize());
+		if (body.find("<Error>") != std::string::npos)
+		{
+			THROW_EXCEPTION_MESSAGE(HTTPException,
+				RequestFailedUnexpectedly, message << ": " << body);
+		}
+	}
+	catch (...)
+	{
+		while (!uploading.empty())
+		{
+			delete uploading.front();
+			uploading.pop_front();
+		}
+
+		try
+		{
+			AbortMultipartUpload(rObjectURI, uploadID);
+		}
+		catch (BoxException &e)
+		{
+			BOX_WARNING("Failed to abort the multipart upload of " <<
+				rObjectURI << ": " << e.what());
+		}
+		throw;
+	}
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -87,13 +454,9 @@ HTTPResponse S3Client::PutObject(const std::string& rObjectURI,
 //			 const std::string& rRequestURI,
 //			 IOStream* pStreamToSend,
 //			 const char* pStreamContentType)
-//		Purpose: Internal method which creates an HTTP request to S3,
-//			 populates the date and authorization header fields,
-//			 and sends it to S3 (or the simulator), attaching
-//			 the specified stream if any to the request. Opens a
-//			 connection to the server if necessary, which may
-//			 throw a ConnectionException. Returns the HTTP
-//			 response returned by S3, which may be a 500 error.
+//		Purpose: Internal method which creates an HTTP request to S3
+//			 and sends it with SignAndSendRequest(), attaching
+//			 the specified stream if any to the request.
 //		Created: 09/01/2009
 //
 // --------------------------------------------------------------------------
@@ -103,11 +466,44 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 	const char* pStreamContentType)
 {
 	HTTPRequest request(Method, rRequestURI);
-	request.SetHostName(mHostName);
+	if (pStreamContentType)
+	{
+		request.SetContentType(pStreamContentType);
+	}
+	return SignAndSendRequest(request, pStreamToSend);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::SignAndSendRequest(HTTPRequest&,
+//			 IOStream*)
+//		Purpose: Internal method which populates the host, date and
+//			 authorization header fields of a request, and sends
+//			 it to S3 (or the simulator) with the specified
+//			 stream if any. Uses a connection which was kept open
+//			 if there is one, or opens a new one, which may throw
+//			 a ConnectionException. Returns the HTTP response
+//			 returned by S3, which may be a 500 error.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+HTTPResponse S3Client::SignAndSendRequest(HTTPRequest& rRequest,
+	IOStream* pStreamToSend)
+{
+	rRequest.SetHostName(mHostName);
 	
 	std::ostringstream date;
 	time_t tt = time(NULL);
+#ifdef WIN32
+	// Requests may be made on several threads at once, and Windows
+	// gmtime() is already thread-safe
 	struct tm *tp = gmtime(&tt);
+#else
+	struct tm tm_buffer;
+	struct tm *tp = gmtime_r(&tt, &tm_buffer);
+#endif
 	if (!tp)
 	{
 		BOX_ERROR("Failed to get current time");
@@ -124,12 +520,7 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 	date << std::setw(2) << tp->tm_hour << ":" <<
 		std::setw(2) << tp->tm_min  << ":" <<
 		std::setw(2) << tp->tm_sec  << " GMT";
-	request.AddHeader("Date", date.str());
-
-	if (pStreamContentType)
-	{
-		request.AddHeader("Content-Type", pStreamContentType);
-	}
+	rRequest.AddHeader("Date", date.str());
 
 	std::string s3suffix = ".s3.amazonaws.com";
 	std::string bucket;
@@ -145,9 +536,9 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 	}
 
 	std::ostringstream data;
-	data << request.GetVerb() << "\n";
+	data << rRequest.GetVerb() << "\n";
 	data << "\n"; /* Content-MD5 */
-	data << request.GetContentType() << "\n";
+	data << rRequest.GetContentType() << "\n";
 	data << date.str() << "\n";
 
 	if (! bucket.empty())
@@ -155,7 +546,8 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 		data << "/" << bucket;
 	}
 
-	data << request.GetRequestURI();
+	data << rRequest.GetRequestURI();
+	data << GetSubResources(rRequest.GetQuery());
 	std::string data_string = data.str();
 
 	unsigned char digest_buffer[EVP_MAX_MD_SIZE];
@@ -175,51 +567,80 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 		auth_code = auth_code.substr(0, auth_code.size() - 1);
 	}
 
-	request.AddHeader("Authorization", auth_code);
+	rRequest.AddHeader("Authorization", auth_code);
 	
 	if (mpSimulator)
 	{
+		// The simulator doesn't expect to handle several requests
+		// at once
+		std::lock_guard<std::mutex> lock(mSimulatorMutex);
+
 		if (pStreamToSend)
 		{
-			pStreamToSend->CopyStreamTo(request);
+			pStreamToSend->CopyStreamTo(rRequest);
 		}
 
-		request.SetForReading();
+		rRequest.SetForReading();
 		CollectInBufferStream response_buffer;
 		HTTPResponse response(&response_buffer);
 	
-		mpSimulator->Handle(request, response);
+		mpSimulator->Handle(rRequest, response);
+		if (rRequest.GetMethod() == HTTPRequest::Method_HEAD)
+		{
+			response.SetResponseStream(std::auto_ptr<IOStream>());
+		}
+		else
+		{
+			response.CollectResponseStream();
+		}
+
+		// Make the content readable, as it is when received from
+		// the network
+		response.SetForReading();
 		return response;
 	}
-	else
+
+	rRequest.SetClientKeepAliveRequested(true);
+	IOStream::pos_type bytesToSend = pStreamToSend ?
+		pStreamToSend->BytesLeftToRead() : 0;
+
+	while (true)
 	{
+		bool reused;
+		std::auto_ptr<SocketStream> apSocket(GetConnection(reused));
+
 		try
 		{
-			if (!mapClientSocket.get())
+			HTTPResponse response = SendRequest(*apSocket, rRequest,
+				pStreamToSend);
+			if (!response.IsKeepAlive())
 			{
-				mapClientSocket.reset(new SocketStream());
-				mapClientSocket->Open(Socket::TypeINET,
-					mHostName, mPort);
+				BOX_TRACE("Server will close the connection, "
+					"closing our end too.");
+				apSocket.reset();
 			}
-			return SendRequest(request, pStreamToSend,
-				pStreamContentType);
+			ReleaseConnection(apSocket);
+			return response;
 		}
-		catch (ConnectionException &ce)
+		catch (BoxException &e)
 		{
-			if (ce.GetType() == ConnectionException::SocketWriteError)
-			{
-				// server may have disconnected us,
-				// try to reconnect, just once
-				mapClientSocket->Open(Socket::TypeINET,
-					mHostName, mPort);
-				return SendRequest(request, pStreamToSend,
-					pStreamContentType);
-			}
-			else
+			ReleaseConnection(std::auto_ptr<SocketStream>());
+
+			// The server may have closed a connection which was
+			// kept open just as we started to use it. Try again
+			// if none of the stream has been sent yet.
+			if (!reused || (pStreamToSend &&
+				(bytesToSend == IOStream::SizeOfStreamUnknown ||
+				 pStreamToSend->BytesLeftToRead() != bytesToSend)))
 			{
-				BOX_TRACE("S3Client: " << mHostName << " ! " << ce.what());
+				BOX_TRACE("S3Client: " << mHostName << " ! " <<
+					e.what());
 				throw;
 			}
+
+			BOX_TRACE("S3Client: " << mHostName << " closed a "
+				"connection which was kept open, trying "
+				"again: " << e.what());
 		}
 	}
 }
@@ -227,46 +648,195 @@ HTTPResponse S3Client::FinishAndSendRequest(HTTPRequest::Method Method,
 // --------------------------------------------------------------------------
 //
 // Function
-//		Name:    S3Client::SendRequest(HTTPRequest& rRequest,
-//			 IOStream* pStreamToSend,
-//			 const char* pStreamContentType)
+//		Name:    S3Client::SendRequest(SocketStream& rSocket,
+//			 HTTPRequest& rRequest,
+//			 IOStream* pStreamToSend)
 //		Purpose: Internal method which sends a pre-existing HTTP 
-//			 request to S3. Attaches the specified stream if any
-//			 to the request. Opens a connection to the server if
-//			 necessary, which may throw a ConnectionException.
-//			 Returns the HTTP response returned by S3, which may
-//			 be a 500 error.
+//			 request to S3 on a connection, attaching the
+//			 specified stream if any to the request. Returns the
+//			 HTTP response returned by S3, which may be a 500
+//			 error.
 //		Created: 09/01/2009
 //
 // --------------------------------------------------------------------------
 
-HTTPResponse S3Client::SendRequest(HTTPRequest& rRequest,
-	IOStream* pStreamToSend, const char* pStreamContentType)
+HTTPResponse S3Client::SendRequest(SocketStream& rSocket,
+	HTTPRequest& rRequest, IOStream* pStreamToSend)
 {
 	HTTPResponse response;
 
 	if (pStreamToSend)
 	{
-		rRequest.SendWithStream(*mapClientSocket, mNetworkTimeout,
+		rRequest.SendWithStream(rSocket, mNetworkTimeout,
 			pStreamToSend, response);
 	}
 	else
 	{
-		rRequest.Send(*mapClientSocket, mNetworkTimeout);
-		response.Receive(*mapClientSocket, mNetworkTimeout);
+		rRequest.Send(rSocket, mNetworkTimeout);
+		response.Receive(rSocket, mNetworkTimeout,
+			rRequest.GetMethod() == HTTPRequest::Method_HEAD);
+	}
+
+	return response;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::GetConnection(bool &)
+//		Purpose: Internal method which returns a connection to the
+//			 server, waiting until there are fewer than the
+//			 maximum in use. It's one which was kept open, if
+//			 there is one which the server hasn't closed yet, and
+//			 rReusedOut is set, or a new one. It must be returned
+//			 with ReleaseConnection().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::auto_ptr<SocketStream> S3Client::GetConnection(bool& rReusedOut)
+{
+	std::unique_lock<std::mutex> lock(mConnectionsMutex);
+	while (mConnectionsInUse >= mMaxConnections)
+	{
+		mConnectionReleased.wait(lock);
+	}
+	mConnectionsInUse++;
+
+	while (!mIdleConnections.empty())
+	{
+		std::auto_ptr<SocketStream> apSocket(mIdleConnections.back());
+		mIdleConnections.pop_back();
+
+		// If the server has closed it, the end of the stream can be
+		// read without waiting. Nothing else should be there.
+		bool closed;
+		try
+		{
+			char unexpected;
+			closed = apSocket->Read(&unexpected, 1, 0) != 0 ||
+				!apSocket->StreamDataLeft();
+		}
+		catch (BoxException &e)
+		{
+			closed = true;
+		}
+
+		if (!closed)
+		{
+			rReusedOut = true;
+			return apSocket;
+		}
+
+		BOX_TRACE("S3Client: " << mHostName << " closed a connection "
+			"which was kept open");
 	}
 
-	if(!response.IsKeepAlive())
+	// Don't keep other threads waiting while connecting
+	lock.unlock();
+
+	std::auto_ptr<SocketStream> apSocket(new SocketStream());
+	try
 	{
-		BOX_TRACE("Server will close the connection, closing our end too.");
-		mapClientSocket.reset();
+		apSocket->Open(Socket::TypeINET, mHostName, mPort);
 	}
-	else
+	catch (...)
 	{
-		BOX_TRACE("Server will keep the connection open for more requests.");
+		ReleaseConnection(std::auto_ptr<SocketStream>());
+		throw;
 	}
 
-	return response;
+	lock.lock();
+	mNumConnectionsOpened++;
+	rReusedOut = false;
+	return apSocket;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::ReleaseConnection(
+//			 std::auto_ptr<SocketStream>)
+//		Purpose: Internal method which returns a connection from
+//			 GetConnection(), to be kept open for the next
+//			 request. Pass an empty pointer if the connection has
+//			 been closed, or can't be used again.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Client::ReleaseConnection(std::auto_ptr<SocketStream> apSocket)
+{
+	std::lock_guard<std::mutex> lock(mConnectionsMutex);
+	ASSERT(mConnectionsInUse > 0);
+	mConnectionsInUse--;
+	if (apSocket.get())
+	{
+		mIdleConnections.push_back(apSocket.release());
+	}
+	mConnectionReleased.notify_one();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::GetNumConnectionsOpened()
+//		Purpose: Returns the number of connections opened to the
+//			 server so far.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+int64_t S3Client::GetNumConnectionsOpened()
+{
+	std::lock_guard<std::mutex> lock(mConnectionsMutex);
+	return mNumConnectionsOpened;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Client::GetSubResources(
+//			 const HTTPRequest::Query_t &)
+//		Purpose: Returns the parameters of a request which are part
+//			 of the resource that S3 signs, such as the upload ID
+//			 of a multipart upload, in the order and form that
+//			 they must be signed.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::string S3Client::GetSubResources(const HTTPRequest::Query_t& rQuery)
+{
+	// http://docs.aws.amazon.com/AmazonS3/latest/dev/RESTAuthentication.html
+	// in lexicographical order
+	static const char *subResources[] =
+	{
+		"acl", "delete", "lifecycle", "location", "logging",
+		"notification", "partNumber", "policy", "requestPayment",
+		"torrent", "uploadId", "uploads", "versionId", "versioning",
+		"versions", "website", NULL
+	};
+
+	std::string result;
+	for (int i = 0; subResources[i] != NULL; i++)
+	{
+		HTTPRequest::Query_t::const_iterator found =
+			rQuery.find(subResources[i]);
+		if (found == rQuery.end())
+		{
+			continue;
+		}
+
+		result += result.empty() ? "?" : "&";
+		result += found->first;
+		if (!found->second.empty())
+		{
+			result += "=" + found->second;
+		}
+	}
+
+	return result;
 }
 
 // --------------------------------------------------------------------------
@@ -10,8 +10,12 @@
 #ifndef S3CLIENT__H
 #define S3CLIENT__H
 
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <string>
 #include <map>
+#include <vector>
 
 #include "HTTPRequest.h"
 #include "SocketStream.h"
@@ -20,11 +24,26 @@ class HTTPResponse;
 class HTTPServer;
 class IOStream;
 
+// Parts of a multipart upload, except the last, can't be smaller than this
+#define S3_MULTIPART_MINIMUM_PART_SIZE	(5*1024*1024)
+
 // --------------------------------------------------------------------------
 //
 // Class
 //		Name:    S3Client
 //		Purpose: Amazon S3 client helper implementation class
+//
+//			 Connections to the server are kept open for more
+//			 requests, and several requests may be in progress at
+//			 once, each on its own connection, up to the maximum
+//			 passed to the constructor. The *Async() methods start
+//			 a request on another thread and return at once, and
+//			 any method may be called by several threads at once.
+//			 Every request must have finished before the client
+//			 is destroyed, and so must any stream passed to it.
+//
+//			 Requests to an in-process simulator are handled one
+//			 at a time.
 //		Created: 09/01/2009
 //
 // --------------------------------------------------------------------------
@@ -37,42 +56,98 @@ class S3Client
 	  mHostName(rHostName),
 	  mAccessKey(rAccessKey),
 	  mSecretKey(rSecretKey),
-	  mNetworkTimeout(30000)
+	  mNetworkTimeout(30000),
+	  mMaxConnections(1),
+	  mConnectionsInUse(0),
+	  mNumConnectionsOpened(0)
 	{ }
 	
 	S3Client(std::string HostName, int Port, const std::string& rAccessKey,
-		const std::string& rSecretKey)
+		const std::string& rSecretKey, int MaxConnections = 4)
 	: mpSimulator(NULL),
 	  mHostName(HostName),
 	  mPort(Port),
 	  mAccessKey(rAccessKey),
 	  mSecretKey(rSecretKey),
-	  mNetworkTimeout(30000)
+	  mNetworkTimeout(30000),
+	  mMaxConnections(MaxConnections),
+	  mConnectionsInUse(0),
+	  mNumConnectionsOpened(0)
 	{ }
-		
+	~S3Client();
+	private:
+	// no copying
+	S3Client(const S3Client &);
+	S3Client &operator=(const S3Client &);
+
+	public:
 	HTTPResponse GetObject(const std::string& rObjectURI);
 	HTTPResponse HeadObject(const std::string& rObjectURI);
 	HTTPResponse PutObject(const std::string& rObjectURI,
 		IOStream& rStreamToSend, const char* pContentType = NULL);
+
+	std::future<HTTPResponse> GetObjectAsync(const std::string& rObjectURI);
+	std::future<HTTPResponse> HeadObjectAsync(const std::string& rObjectURI);
+	std::future<HTTPResponse> PutObjectAsync(const std::string& rObjectURI,
+		IOStream& rStreamToSend, const char* pContentType = NULL);
+
+	// Multipart upload, for objects too big to send in one request.
+	// Parts are numbered from 1, and their ETags are passed to
+	// CompleteMultipartUpload() in that order.
+	std::string CreateMultipartUpload(const std::string& rObjectURI,
+		const char* pContentType = NULL);
+	HTTPResponse UploadPart(const std::string& rObjectURI,
+		const std::string& rUploadID, int PartNumber,
+		IOStream& rStreamToSend);
+	std::future<HTTPResponse> UploadPartAsync(const std::string& rObjectURI,
+		const std::string& rUploadID, int PartNumber,
+		IOStream& rStreamToSend);
+	HTTPResponse CompleteMultipartUpload(const std::string& rObjectURI,
+		const std::string& rUploadID,
+		const std::vector<std::string>& rPartETags);
+	HTTPResponse AbortMultipartUpload(const std::string& rObjectURI,
+		const std::string& rUploadID);
+	void PutObjectMultipart(const std::string& rObjectURI,
+		IOStream& rStreamToSend,
+		int PartSize = S3_MULTIPART_MINIMUM_PART_SIZE,
+		const char* pContentType = NULL);
+
 	void CheckResponse(const HTTPResponse& response, const std::string& message) const;
 	int GetNetworkTimeout() const { return mNetworkTimeout; }
+	int GetMaxConnections() const { return mMaxConnections; }
+	// Number of connections opened to the server so far, for tests
+	int64_t GetNumConnectionsOpened();
+
+	static std::string GetSubResources(const HTTPRequest::Query_t& rQuery);
 
 	private:
 	HTTPServer* mpSimulator;
+	std::mutex mSimulatorMutex;
 	std::string mHostName;
 	int mPort;
-	std::auto_ptr<SocketStream> mapClientSocket;
 	std::string mAccessKey, mSecretKey;
 	int mNetworkTimeout; // milliseconds
 
+	// Connections which are open but not in use
+	std::vector<SocketStream *> mIdleConnections;
+	int mMaxConnections;
+	int mConnectionsInUse;
+	int64_t mNumConnectionsOpened;
+	std::mutex mConnectionsMutex;
+	std::condition_variable mConnectionReleased;
+
 	HTTPResponse FinishAndSendRequest(HTTPRequest::Method Method,
 		const std::string& rRequestURI,
 		IOStream* pStreamToSend = NULL,
 		const char* pStreamContentType = NULL);
-	HTTPResponse SendRequest(HTTPRequest& rRequest,
-		IOStream* pStreamToSend = NULL,
-		const char* pStreamContentType = NULL);
+	HTTPResponse SignAndSendRequest(HTTPRequest& rRequest,
+		IOStream* pStreamToSend = NULL);
+	HTTPResponse SendRequest(SocketStream& rSocket, HTTPRequest& rRequest,
+		IOStream* pStreamToSend = NULL);
+	HTTPResponse SendUploadPart(std::string ObjectURI,
+		std::string UploadID, int PartNumber, IOStream* pStreamToSend);
+	std::auto_ptr<SocketStream> GetConnection(bool& rReusedOut);
+	void ReleaseConnection(std::auto_ptr<SocketStream> apSocket);
 };
 
 #endif // S3CLIENT__H
-
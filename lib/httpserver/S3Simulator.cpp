@@ -11,18 +11,24 @@
 
 #include <algorithm>
 #include <cstring>
+#include <sstream>
 
 // #include <cstdio>
 // #include <ctime>
 
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
+#include <openssl/rand.h>
 
 #include "HTTPRequest.h"
 #include "HTTPResponse.h"
 #include "autogen_HTTPException.h"
+#include "CollectInBufferStream.h"
 #include "IOStream.h"
 #include "Logging.h"
+#include "S3Client.h"
 #include "S3Simulator.h"
+#include "Utils.h"
 #include "decode.h"
 #include "encode.h"
 
@@ -143,6 +149,7 @@ void S3Simulator::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 		}
 
 		data << rRequest.GetRequestURI();
+		data << S3Client::GetSubResources(rRequest.GetQuery());
 		std::string data_string = data.str();
 
 		unsigned char digest_buffer[EVP_MAX_MD_SIZE];
@@ -171,7 +178,8 @@ void S3Simulator::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 			SendInternalErrorResponse("Authentication Failed",
 				rResponse);
 		}
-		else if (rRequest.GetMethod() == HTTPRequest::Method_GET)
+		else if (rRequest.GetMethod() == HTTPRequest::Method_GET ||
+			rRequest.GetMethod() == HTTPRequest::Method_HEAD)
 		{
 			HandleGet(rRequest, rResponse);
 		}
@@ -179,6 +187,14 @@ void S3Simulator::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 		{
 			HandlePut(rRequest, rResponse);
 		}
+		else if (rRequest.GetMethod() == HTTPRequest::Method_POST)
+		{
+			HandlePost(rRequest, rResponse);
+		}
+		else if (rRequest.GetMethod() == HTTPRequest::Method_DELETE)
+		{
+			HandleDelete(rRequest, rResponse);
+		}
 		else
 		{
 			rResponse.SetResponseCode(HTTPResponse::Code_MethodNotAllowed);
@@ -199,7 +215,8 @@ void S3Simulator::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 		SendInternalErrorResponse("Unknown exception", rResponse);
 	}
 
-	if (rResponse.GetResponseCode() != 200 &&
+	if (rResponse.GetResponseCode() != HTTPResponse::Code_OK &&
+		rResponse.GetResponseCode() != HTTPResponse::Code_NoContent &&
 		rResponse.GetSize() == 0)
 	{
 		// no error message written, provide a default
@@ -220,7 +237,7 @@ void S3Simulator::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 //		Name:    S3Simulator::HandleGet(HTTPRequest &rRequest,
 //			 HTTPResponse &rResponse)
 //		Purpose: Handles an S3 GET request, i.e. downloading an
-//			 existing object.
+//			 existing object, or a HEAD request for its metadata.
 //		Created: 09/01/09
 //
 // --------------------------------------------------------------------------
@@ -249,7 +266,9 @@ void S3Simulator::HandleGet(HTTPRequest &rRequest, HTTPResponse &rResponse)
 	}
 
 	// http://docs.amazonwebservices.com/AmazonS3/2006-03-01/UsingRESTOperations.html
-	apFile->CopyStreamTo(rResponse);
+	// Large objects are sent straight from the file, not copied into
+	// memory first.
+	rResponse.SetResponseStream(std::auto_ptr<IOStream>(apFile.release()));
 	rResponse.AddHeader("x-amz-id-2", "qBmKRcEWBBhH6XAqsKU/eg24V3jf/kWKN9dJip1L/FpbYr9FDy7wWFurfdQOEMcY");
 	rResponse.AddHeader("x-amz-request-id", "F2A8CCCA26B4B26D");
 	rResponse.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
@@ -272,6 +291,12 @@ void S3Simulator::HandleGet(HTTPRequest &rRequest, HTTPResponse &rResponse)
 
 void S3Simulator::HandlePut(HTTPRequest &rRequest, HTTPResponse &rResponse)
 {
+	if (rRequest.GetQuery().count("uploadId"))
+	{
+		HandleUploadPart(rRequest, rResponse);
+		return;
+	}
+
 	std::string path = GetConfiguration().GetKeyValue("StoreDirectory");
 	path += rRequest.GetRequestURI();
 	std::auto_ptr<FileStream> apFile;
@@ -310,3 +335,330 @@ void S3Simulator::HandlePut(HTTPRequest &rRequest, HTTPResponse &rResponse)
 	rResponse.AddHeader("Server", "AmazonS3");
 	rResponse.SetResponseCode(HTTPResponse::Code_OK);
 }
+
+// Returns the ETag of a file, as S3 gives it: its MD5 digest, in quotes
+static std::string GetETag(const std::string& rPath)
+{
+	FileStream file(rPath);
+	EVP_MD_CTX *pContext = EVP_MD_CTX_create();
+	EVP_DigestInit_ex(pContext, EVP_md5(), NULL);
+
+	char buffer[16*1024];
+	while (file.StreamDataLeft())
+	{
+		int bytes = file.Read(buffer, sizeof(buffer));
+		EVP_DigestUpdate(pContext, buffer, bytes);
+	}
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestSize = 0;
+	EVP_DigestFinal_ex(pContext, digest, &digestSize);
+	EVP_MD_CTX_destroy(pContext);
+
+	std::ostringstream etag;
+	etag << "\"" << std::hex << std::setfill('0');
+	for (unsigned int i = 0; i < digestSize; i++)
+	{
+		etag << std::setw(2) << (int)digest[i];
+	}
+	etag << "\"";
+	return etag.str();
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Simulator::HandlePost(HTTPRequest &rRequest,
+//			 HTTPResponse &rResponse)
+//		Purpose: Handles an S3 POST request, which starts or
+//			 completes a multipart upload. The upload is recorded
+//			 in a file named after the object, and the parts are
+//			 stored beside it, until it's completed or aborted.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Simulator::HandlePost(HTTPRequest &rRequest, HTTPResponse &rResponse)
+{
+	std::string path = GetConfiguration().GetKeyValue("StoreDirectory");
+	path += rRequest.GetRequestURI();
+	std::ostringstream result;
+	result << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+	if (rRequest.GetQuery().count("uploads"))
+	{
+		// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadInitiate.html
+		unsigned char random[16];
+		if (RAND_bytes(random, sizeof(random)) != 1)
+		{
+			THROW_EXCEPTION(HTTPException, Internal);
+		}
+
+		std::ostringstream uploadID;
+		uploadID << std::hex << std::setfill('0');
+		for (unsigned int i = 0; i < sizeof(random); i++)
+		{
+			uploadID << std::setw(2) << (int)random[i];
+		}
+
+		try
+		{
+			FileStream upload(path + ".upload-" + uploadID.str(),
+				O_CREAT | O_EXCL | O_WRONLY);
+		}
+		catch (CommonException &ce)
+		{
+			if (ce.GetSubType() == CommonException::OSFileOpenError)
+			{
+				rResponse.SetResponseCode(HTTPResponse::Code_NotFound);
+			}
+			else if (ce.GetSubType() == CommonException::AccessDenied)
+			{
+				rResponse.SetResponseCode(HTTPResponse::Code_Forbidden);
+			}
+			throw;
+		}
+
+		result << "<InitiateMultipartUploadResult>"
+			"<Key>" << rRequest.GetRequestURI().substr(1) << "</Key>"
+			"<UploadId>" << uploadID.str() << "</UploadId>"
+			"</InitiateMultipartUploadResult>\n";
+	}
+	else
+	{
+		// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadComplete.html
+		std::string uploadPath = GetUploadPath(rRequest, rResponse);
+
+		if (rRequest.IsExpectingContinue())
+		{
+			rResponse.SendContinue();
+		}
+
+		CollectInBufferStream content;
+		rRequest.ReadContent(content);
+		std::string parts((const char *)content.GetBuffer(),
+			content.GetSize());
+
+		// Check all the parts before changing anything
+		std::vector<std::string> partPaths;
+		std::string::size_type pos = 0;
+		while ((pos = parts.find("<PartNumber>", pos)) !=
+			std::string::npos)
+		{
+			int partNumber = ::strtol(parts.c_str() + pos + 12,
+				NULL, 10);
+			std::string::size_type etagStart =
+				parts.find("<ETag>", pos);
+			std::string::size_type etagEnd =
+				parts.find("</ETag>", pos);
+			std::ostringstream partPath;
+			partPath << uploadPath << "." << partNumber;
+
+			if (etagStart == std::string::npos ||
+				etagEnd == std::string::npos ||
+				partNumber != (int)partPaths.size() + 1 ||
+				!FileExists(partPath.str()) ||
+				parts.substr(etagStart + 6,
+					etagEnd - etagStart - 6) !=
+					GetETag(partPath.str()))
+			{
+				rResponse.SetResponseCode(
+					HTTPResponse::Code_MethodNotAllowed);
+				THROW_EXCEPTION_MESSAGE(HTTPException,
+					BadRequest, "InvalidPart: part " <<
+					(partPaths.size() + 1) << " is missing "
+					"or doesn't match its ETag");
+			}
+
+			partPaths.push_back(partPath.str());
+			pos = etagEnd;
+		}
+
+		if (partPaths.empty())
+		{
+			rResponse.SetResponseCode(HTTPResponse::Code_MethodNotAllowed);
+			THROW_EXCEPTION_MESSAGE(HTTPException, BadRequest,
+				"MalformedXML: no parts were listed");
+		}
+
+		{
+			FileStream object(path, O_CREAT | O_TRUNC | O_WRONLY);
+			for (std::vector<std::string>::iterator
+				i  = partPaths.begin();
+				i != partPaths.end(); i++)
+			{
+				FileStream part(*i);
+				part.CopyStreamTo(object);
+			}
+		}
+
+		DeleteUpload(uploadPath);
+
+		result << "<CompleteMultipartUploadResult>"
+			"<Key>" << rRequest.GetRequestURI().substr(1) << "</Key>"
+			"<ETag>" << GetETag(path) << "</ETag>"
+			"</CompleteMultipartUploadResult>\n";
+	}
+
+	rResponse.SetContentType("application/xml");
+	rResponse.Write(result.str().c_str(), result.str().size());
+	rResponse.AddHeader("x-amz-request-id", "F2A8CCCA26B4B26D");
+	rResponse.AddHeader("Server", "AmazonS3");
+	rResponse.SetResponseCode(HTTPResponse::Code_OK);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Simulator::HandleUploadPart(HTTPRequest &rRequest,
+//			 HTTPResponse &rResponse)
+//		Purpose: Private. Handles an S3 PUT request with an upload
+//			 ID, i.e. uploading one part of a multipart upload.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Simulator::HandleUploadPart(HTTPRequest &rRequest,
+	HTTPResponse &rResponse)
+{
+	// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadUploadPart.html
+	std::string uploadPath = GetUploadPath(rRequest, rResponse);
+
+	HTTPRequest::Query_t::const_iterator i =
+		rRequest.GetQuery().find("partNumber");
+	int partNumber = (i == rRequest.GetQuery().end()) ? 0 :
+		::strtol(i->second.c_str(), NULL, 10);
+	if (partNumber < 1 || partNumber > 10000)
+	{
+		rResponse.SetResponseCode(HTTPResponse::Code_MethodNotAllowed);
+		THROW_EXCEPTION_MESSAGE(HTTPException, BadRequest,
+			"InvalidArgument: part number must be between 1 and "
+			"10000");
+	}
+
+	std::ostringstream partPath;
+	partPath << uploadPath << "." << partNumber;
+
+	if (rRequest.IsExpectingContinue())
+	{
+		rResponse.SendContinue();
+	}
+
+	{
+		FileStream part(partPath.str(), O_CREAT | O_TRUNC | O_WRONLY);
+		rRequest.ReadContent(part);
+	}
+
+	// Record the part, so that it can be deleted with the upload
+	std::ostringstream line;
+	line << partNumber << "\n";
+	FileStream upload(uploadPath, O_WRONLY | O_APPEND);
+	upload.Write(line.str().c_str(), line.str().size());
+
+	rResponse.AddHeader("x-amz-request-id", "F2A8CCCA26B4B26D");
+	rResponse.AddHeader("ETag", GetETag(partPath.str()));
+	rResponse.SetContentType("");
+	rResponse.AddHeader("Server", "AmazonS3");
+	rResponse.SetResponseCode(HTTPResponse::Code_OK);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Simulator::HandleDelete(HTTPRequest &rRequest,
+//			 HTTPResponse &rResponse)
+//		Purpose: Handles an S3 DELETE request with an upload ID,
+//			 i.e. aborting a multipart upload.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Simulator::HandleDelete(HTTPRequest &rRequest, HTTPResponse &rResponse)
+{
+	if (!rRequest.GetQuery().count("uploadId"))
+	{
+		rResponse.SetResponseCode(HTTPResponse::Code_MethodNotAllowed);
+		THROW_EXCEPTION_MESSAGE(HTTPException, NotImplemented,
+			"Only multipart uploads can be deleted");
+	}
+
+	// http://docs.aws.amazon.com/AmazonS3/latest/API/mpUploadAbort.html
+	DeleteUpload(GetUploadPath(rRequest, rResponse));
+	rResponse.AddHeader("x-amz-request-id", "F2A8CCCA26B4B26D");
+	rResponse.AddHeader("Server", "AmazonS3");
+	rResponse.SetResponseCode(HTTPResponse::Code_NoContent);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Simulator::GetUploadPath(HTTPRequest &rRequest,
+//			 HTTPResponse &rResponse)
+//		Purpose: Private. Returns the path of the file which records
+//			 the multipart upload whose ID is in the request, or
+//			 sets a 404 response and throws an exception if there
+//			 is no such upload.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+std::string S3Simulator::GetUploadPath(HTTPRequest &rRequest,
+	HTTPResponse &rResponse)
+{
+	HTTPRequest::Query_t::const_iterator i =
+		rRequest.GetQuery().find("uploadId");
+	std::string uploadID = (i == rRequest.GetQuery().end()) ? "" :
+		i->second;
+
+	std::string path = GetConfiguration().GetKeyValue("StoreDirectory");
+	path += rRequest.GetRequestURI() + ".upload-" + uploadID;
+
+	// The ID is used in file names, so it must be one that we made
+	if (uploadID.empty() ||
+		uploadID.find_first_not_of("0123456789abcdef") !=
+			std::string::npos ||
+		!FileExists(path))
+	{
+		rResponse.SetResponseCode(HTTPResponse::Code_NotFound);
+		THROW_EXCEPTION_MESSAGE(HTTPException, BadRequest,
+			"NoSuchUpload: " << uploadID);
+	}
+
+	return path;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    S3Simulator::DeleteUpload(const std::string &)
+//		Purpose: Private. Deletes the parts of a multipart upload
+//			 and the file which records it.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+void S3Simulator::DeleteUpload(const std::string& rUploadPath)
+{
+	CollectInBufferStream partNumbers;
+	{
+		FileStream upload(rUploadPath);
+		upload.CopyStreamTo(partNumbers);
+	}
+
+	std::istringstream parts(std::string(
+		(const char *)partNumbers.GetBuffer(), partNumbers.GetSize()));
+	int partNumber;
+	while (parts >> partNumber)
+	{
+		std::ostringstream partPath;
+		partPath << rUploadPath << "." << partNumber;
+		// The same part may have been uploaded more than once
+		EMU_UNLINK(partPath.str().c_str());
+	}
+
+	if (EMU_UNLINK(rUploadPath.c_str()) != 0)
+	{
+		THROW_SYS_FILE_ERROR("Failed to delete multipart upload",
+			rUploadPath, CommonException, OSFileError);
+	}
+}
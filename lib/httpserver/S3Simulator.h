@@ -10,6 +10,8 @@
 #ifndef S3SIMULATOR__H
 #define S3SIMULATOR__H
 
+#include <string>
+
 #include "HTTPServer.h"
 
 class ConfigurationVerify;
@@ -36,11 +38,19 @@ public:
 	virtual void Handle(HTTPRequest &rRequest, HTTPResponse &rResponse);
 	virtual void HandleGet(HTTPRequest &rRequest, HTTPResponse &rResponse);
 	virtual void HandlePut(HTTPRequest &rRequest, HTTPResponse &rResponse);
+	virtual void HandlePost(HTTPRequest &rRequest, HTTPResponse &rResponse);
+	virtual void HandleDelete(HTTPRequest &rRequest, HTTPResponse &rResponse);
 
 	virtual const char *DaemonName() const
 	{
 		return "s3simulator";
 	}
+
+private:
+	void HandleUploadPart(HTTPRequest &rRequest, HTTPResponse &rResponse);
+	std::string GetUploadPath(HTTPRequest &rRequest,
+		HTTPResponse &rResponse);
+	void DeleteUpload(const std::string& rUploadPath);
 };
 
 #endif // S3SIMULATOR__H
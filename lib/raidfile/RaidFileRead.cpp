@@ -75,6 +75,7 @@ public:
 	virtual void Close();
 	virtual pos_type GetFileSize() const;
 	virtual bool StreamDataLeft();
+	virtual int GetSendFileHandle();
 
 private:
 	int mOSFileHandle;
@@ -220,6 +221,35 @@ void RaidFileRead_NonRaid::Close()
 	mEOF = true;
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileRead_NonRaid::GetSendFileHandle()
+//		Purpose: Returns the file descriptor, as the data is read
+//			 straight from it. Only used to send the rest of the
+//			 file in one go, so asks the OS to read ahead.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+int RaidFileRead_NonRaid::GetSendFileHandle()
+{
+	// open?
+	if(mOSFileHandle == -1)
+	{
+		THROW_EXCEPTION(RaidFileException, NotOpen)
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	// Only a hint, so errors don't matter. Files read in pieces, such
+	// as by GetFileRange or to find the block index, don't get this, as
+	// readahead would waste disc bandwidth on them.
+	::posix_fadvise(mOSFileHandle, GetPosition(), 0,
+		POSIX_FADV_SEQUENTIAL);
+#endif
+
+	return mOSFileHandle;
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -1045,9 +1075,17 @@ std::auto_ptr<RaidFileRead> RaidFileRead::Open(int SetNumber, const std::string
 			O_RDONLY | O_BINARY, 0);
 		if(osFileHandle == -1)
 		{
+			if(errno == ENOENT)
+			{
+				// Transformed to RAID storage (or deleted) by
+				// RaidFileWriteBehind since it was found, so
+				// look again
+				return Open(SetNumber, Filename, pRevisionID,
+					BufferSizeHint);
+			}
 			THROW_EXCEPTION(RaidFileException, ErrorOpeningFileForRead)
 		}
-		
+
 		// Return a read object for this file
 		try
 		{
@@ -26,19 +26,29 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
+
 #include "Guards.h"
 #include "RaidFileWrite.h"
 #include "RaidFileController.h"
 #include "RaidFileException.h"
 #include "RaidFileUtil.h"
+#include "RaidFileWriteBehind.h"
 #include "Utils.h"
 // For DirectoryExists fn
 #include "RaidFileRead.h"
 
 #include "MemLeakFindOn.h"
 
-// should be a multiple of 2
-#define TRANSFORM_BLOCKS_TO_LOAD		4
+// Amount of the write file to transform at once, rounded down to an even
+// number of blocks of the disc set
+#define TRANSFORM_BUFFER_SIZE			(1024*1024)
 // Must have this number of discs in the set
 #define TRANSFORM_NUMBER_DISCS_REQUIRED	3
 
@@ -144,6 +154,10 @@ void RaidFileWrite::Open(bool AllowOverwrite, bool NoTruncate)
 	{
 		THROW_EXCEPTION(RaidFileException, AlreadyOpen)
 	}
+
+	// A write file still waiting to be transformed mustn't be replaced
+	// under the transform
+	RaidFileWriteBehind::WaitFor(mSetNumber, mFilename);
 	
 	// Get disc set
 	RaidFileController &rcontroller(RaidFileController::GetController());
@@ -390,8 +404,9 @@ void RaidFileWrite::Commit(bool ConvertToRaidNow)
 	mOSFileHandle = -1;
 #endif // !WIN32
 	
-	// Raid it?
-	if(ConvertToRaidNow)
+	// Raid it? Maybe later, if RaidFileWriteBehind is active.
+	if(ConvertToRaidNow &&
+		!RaidFileWriteBehind::Queue(mSetNumber, mFilename))
 	{
 		TransformToRaidStorage();
 	}
@@ -448,6 +463,236 @@ void RaidFileWrite::Discard()
 }
 
 
+// Hide from outside world
+namespace
+{
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RaidComponentWriter
+//		Purpose: Writes buffers to one component file of a RAID file
+//			 being transformed. Once the thread is started, each
+//			 write happens in the background while the next chunk
+//			 is prepared, so the three discs are written in
+//			 parallel. Only one write is outstanding at a time.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RaidComponentWriter
+{
+public:
+	RaidComponentWriter(int FileHandle, const std::string &rFilename)
+	: mFileHandle(FileHandle),
+	  mFilename(rFilename),
+	  mThreaded(false),
+	  mpPending(0),
+	  mPendingSize(0),
+	  mStopping(false),
+	  mErrno(0)
+	{
+	}
+	~RaidComponentWriter()
+	{
+		if(mThreaded)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStopping = true;
+			}
+			mChanged.notify_all();
+			mThread.join();
+		}
+	}
+private:
+	// no copying
+	RaidComponentWriter(const RaidComponentWriter &);
+	RaidComponentWriter &operator=(const RaidComponentWriter &);
+
+public:
+	void StartThread()
+	{
+		mThread = std::thread(&RaidComponentWriter::ThreadMain, this);
+		mThreaded = true;
+	}
+
+	// The buffer must not be changed until the next call to Write()
+	// or Wait() returns.
+	void Write(const void *pBuffer, int Size)
+	{
+		if(!mThreaded)
+		{
+			if(!WriteAll(pBuffer, Size))
+			{
+				ThrowError();
+			}
+			return;
+		}
+
+		Wait();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mpPending = pBuffer;
+			mPendingSize = Size;
+		}
+		mChanged.notify_all();
+	}
+
+	void Wait()
+	{
+		if(!mThreaded)
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(mpPending != 0)
+		{
+			mChanged.wait(lock);
+		}
+		if(mErrno != 0)
+		{
+			errno = mErrno;
+			ThrowError();
+		}
+	}
+
+private:
+	bool WriteAll(const void *pBuffer, int Size)
+	{
+		const char *p = (const char *)pBuffer;
+		while(Size > 0)
+		{
+			int written = ::write(mFileHandle, p, Size);
+			if(written <= 0)
+			{
+				if(written == -1 && errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			p += written;
+			Size -= written;
+		}
+		return true;
+	}
+
+	void ThrowError()
+	{
+		// Only called on the transforming thread, as logging
+		// isn't thread safe
+		THROW_SYS_FILE_ERROR("Failed to write RAID file component",
+			mFilename, RaidFileException, OSError);
+	}
+
+	void ThreadMain()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(true)
+		{
+			while(mpPending == 0 && !mStopping)
+			{
+				mChanged.wait(lock);
+			}
+			if(mpPending == 0)
+			{
+				return;
+			}
+
+			const void *pbuffer = mpPending;
+			int size = mPendingSize;
+			lock.unlock();
+			int error = 0;
+			if(!WriteAll(pbuffer, size))
+			{
+				error = (errno != 0) ? errno : EIO;
+			}
+			lock.lock();
+
+			if(error != 0 && mErrno == 0)
+			{
+				mErrno = error;
+			}
+			mpPending = 0;
+			mChanged.notify_all();
+		}
+	}
+
+	int mFileHandle;
+	std::string mFilename;
+	bool mThreaded;
+	std::thread mThread;
+	std::mutex mMutex;
+	std::condition_variable mChanged;
+	const void *mpPending;
+	int mPendingSize;
+	bool mStopping;
+	int mErrno;
+};
+
+}
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    static SplitStripesAndParity(const uint8_t *, uint8_t *, uint8_t *, uint8_t *, unsigned int, int)
+//		Purpose: Static. Splits NumPairs pairs of blocks from pIn into
+//			 contiguous runs of blocks for the two stripe files, and
+//			 calculates the parity block of each pair, reading the
+//			 input only once.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void SplitStripesAndParity(const uint8_t *pIn, uint8_t *pStripe1,
+	uint8_t *pStripe2, uint8_t *pParity, unsigned int BlockSize,
+	int NumPairs)
+{
+	for(int p = 0; p < NumPairs; ++p)
+	{
+		const uint8_t *pin1 = pIn + ((2 * p) * BlockSize);
+		const uint8_t *pin2 = pin1 + BlockSize;
+		uint8_t *pout1 = pStripe1 + (p * BlockSize);
+		uint8_t *pout2 = pStripe2 + (p * BlockSize);
+		uint8_t *pparity = pParity + (p * BlockSize);
+		unsigned int n = 0;
+
+#ifdef __SSE2__
+		for(; (n + 32) <= BlockSize; n += 32)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i *)(pin1 + n));
+			__m128i a1 = _mm_loadu_si128((const __m128i *)(pin1 + n + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i *)(pin2 + n));
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(pin2 + n + 16));
+			_mm_storeu_si128((__m128i *)(pout1 + n), a0);
+			_mm_storeu_si128((__m128i *)(pout1 + n + 16), a1);
+			_mm_storeu_si128((__m128i *)(pout2 + n), b0);
+			_mm_storeu_si128((__m128i *)(pout2 + n + 16), b1);
+			_mm_storeu_si128((__m128i *)(pparity + n), _mm_xor_si128(a0, b0));
+			_mm_storeu_si128((__m128i *)(pparity + n + 16), _mm_xor_si128(a1, b1));
+		}
+#endif
+
+		for(; (n + sizeof(uint64_t)) <= BlockSize; n += sizeof(uint64_t))
+		{
+			uint64_t a, b;
+			::memcpy(&a, pin1 + n, sizeof(a));
+			::memcpy(&b, pin2 + n, sizeof(b));
+			::memcpy(pout1 + n, &a, sizeof(a));
+			::memcpy(pout2 + n, &b, sizeof(b));
+			a ^= b;
+			::memcpy(pparity + n, &a, sizeof(a));
+		}
+
+		for(; n < BlockSize; ++n)
+		{
+			pout1[n] = pin1[n];
+			pout2[n] = pin2[n];
+			pparity[n] = pin1[n] ^ pin2[n];
+		}
+	}
+}
+
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -507,17 +752,26 @@ void RaidFileWrite::TransformToRaidStorage()
 	
 	// How many blocks is the file? (rounding up)
 	int writeFileSizeInBlocks = (writeFileStat.st_size + (blockSize - 1)) / blockSize;
-	// And how big should the buffer be? (round up to multiple of 2, and no bigger than the preset limit)
-	int bufferSizeBlocks = (writeFileSizeInBlocks + 1) & ~1;
-	if(bufferSizeBlocks > TRANSFORM_BLOCKS_TO_LOAD) bufferSizeBlocks = TRANSFORM_BLOCKS_TO_LOAD;
-	// How big should the buffer be?
-	int bufferSize = (TRANSFORM_BLOCKS_TO_LOAD * blockSize);
+	// Transform an even number of blocks at a time, sized from the block
+	// size of the set, but no more than the file needs
+	int bufferSizeBlocks = (TRANSFORM_BUFFER_SIZE / blockSize) & ~1;
+	if(bufferSizeBlocks < 2) bufferSizeBlocks = 2;
+	int fileSizeInBlocksRoundUp = (writeFileSizeInBlocks + 1) & ~1;
+	if(fileSizeInBlocksRoundUp < 2) fileSizeInBlocksRoundUp = 2;
+	if(bufferSizeBlocks > fileSizeInBlocksRoundUp) bufferSizeBlocks = fileSizeInBlocksRoundUp;
+	int bufferSize = (bufferSizeBlocks * blockSize);
+	// Files bigger than the buffer write all three discs at once, into
+	// one set of output buffers while the other set is being written
+	bool overlapWrites = (writeFileSizeInBlocks > bufferSizeBlocks);
+	int numOutputSets = overlapWrites?2:1;
 	
 	// Allocate buffer...
 	MemoryBlockGuard<char*> buffer(bufferSize);
 	
-	// Allocate buffer for parity file
-	MemoryBlockGuard<char*> parityBuffer(blockSize);
+	// Allocate output buffers for the stripe and parity files (each set
+	// is three consecutive areas of half the input buffer)
+	int outputSize = bufferSize / 2;
+	MemoryBlockGuard<char*> outputBuffers(outputSize * 3 * numOutputSets);
 	
 	// Get filenames of eventual files
 	std::string stripe1Filename(RaidFileUtil::MakeRaidComponentName(rdiscSet, mFilename, (startDisc + 0) % TRANSFORM_NUMBER_DISCS_REQUIRED));
@@ -542,12 +796,50 @@ void RaidFileWrite::TransformToRaidStorage()
 		FileHandleGuard<(O_WRONLY | O_CREAT | O_EXCL | O_BINARY)> parity(parityFilenameW.c_str());
 #endif
 
+		// Writers are destroyed before the files are closed
+		RaidComponentWriter stripe1Writer(stripe1, stripe1FilenameW);
+		RaidComponentWriter stripe2Writer(stripe2, stripe2FilenameW);
+		RaidComponentWriter parityWriter(parity, parityFilenameW);
+		if(overlapWrites)
+		{
+			stripe1Writer.StartThread();
+			stripe2Writer.StartThread();
+			parityWriter.StartThread();
+		}
+
 		// Then... read in data...
 		int bytesRead = -1;
 		bool sizeRecordRequired = false;
 		int blocksDone = 0;
-		while((bytesRead = ::read(writeFile, buffer, bufferSize)) > 0)
+		int outputSet = 0;
+		while(true)
 		{
+			// Fill the buffer, unless the end of the file is reached
+			bytesRead = 0;
+			while(bytesRead < bufferSize)
+			{
+				int r = ::read(writeFile, buffer + bytesRead, bufferSize - bytesRead);
+				if(r == -1 && errno == EINTR)
+				{
+					continue;
+				}
+				if(r == -1)
+				{
+					THROW_SYS_FILE_ERROR("Failed to read file",
+						writeFilename, RaidFileException,
+						OSError);
+				}
+				if(r == 0)
+				{
+					break;
+				}
+				bytesRead += r;
+			}
+			if(bytesRead == 0)
+			{
+				break;
+			}
+
 			// Blocks to do...
 			int blocksToDo = (bytesRead + (blockSize - 1)) / blockSize;
 
@@ -560,97 +852,85 @@ void RaidFileWrite::TransformToRaidStorage()
 				::memset(buffer + bytesRead, 0, zerosEnd - bytesRead);
 			}
 
-			// number of int's to XOR
-			unsigned int num = blockSize / sizeof(unsigned int);
-
-			// Then... calculate and write parity data
-			for(int b = 0; b < blocksToDo; b += 2)
+			// Split into stripes and calculate parity, in one pass
+			char *pstripe1 = outputBuffers + (outputSet * outputSize * 3);
+			char *pstripe2 = pstripe1 + outputSize;
+			char *pparity = pstripe2 + outputSize;
+			int pairsToDo = blocksRoundUp / 2;
+			SplitStripesAndParity((const uint8_t *)(char*)buffer,
+				(uint8_t *)pstripe1, (uint8_t *)pstripe2,
+				(uint8_t *)pparity, blockSize, pairsToDo);
+
+			// Size of parity to write...
+			int parityWriteSize = pairsToDo * blockSize;
+			
+			// Adjust if it's the last block
+			if((blocksDone + blocksRoundUp) >= writeFileSizeInBlocks)
 			{
-				// Calculate int pointers
-				unsigned int *pstripe1 = (unsigned int *)(buffer + (b * blockSize));
-				unsigned int *pstripe2 = (unsigned int *)(buffer + ((b+1) * blockSize));
-				unsigned int *pparity = (unsigned int *)((char*)parityBuffer);
-
-				// Do XOR
-				for(unsigned int n = 0; n < num; ++n)
+				// Yes...
+				int b = blocksRoundUp - 2;
+				unsigned int bytesInLastTwoBlocks = bytesRead - (b * blockSize);
+				
+				// Some special cases...
+				// Zero will never happen... but in the (imaginary) case it does, the file size will be appended
+				// by the test at the end.
+				if(bytesInLastTwoBlocks == sizeof(RaidFileRead::FileSizeType)
+					|| bytesInLastTwoBlocks == blockSize)
 				{
-					pparity[n] = pstripe1[n] ^ pstripe2[n];
+					// Write the entire block, and put the file size at end
+					sizeRecordRequired = true;
 				}
-				
-				// Size of parity to write...
-				int parityWriteSize = blockSize;
-				
-				// Adjust if it's the last block
-				if((blocksDone + (b + 2)) >= writeFileSizeInBlocks)
+				else if(bytesInLastTwoBlocks < blockSize)
 				{
-					// Yes...
-					unsigned int bytesInLastTwoBlocks = bytesRead - (b * blockSize);
-					
-					// Some special cases...
-					// Zero will never happen... but in the (imaginary) case it does, the file size will be appended
-					// by the test at the end.
-					if(bytesInLastTwoBlocks == sizeof(RaidFileRead::FileSizeType)
-						|| bytesInLastTwoBlocks == blockSize)
-					{
-						// Write the entire block, and put the file size at end
-						sizeRecordRequired = true;
-					}
-					else if(bytesInLastTwoBlocks < blockSize)
-					{
-						// write only these bits
-						parityWriteSize = bytesInLastTwoBlocks;
-					}
-					else if(bytesInLastTwoBlocks < ((blockSize * 2) - sizeof(RaidFileRead::FileSizeType)))
-					{
-						// XOR in the size at the end of the parity block
-						ASSERT(sizeof(RaidFileRead::FileSizeType) == (2*sizeof(unsigned int)));
-						ASSERT(sizeof(RaidFileRead::FileSizeType) >= sizeof(off_t));
-						int sizePos = (blockSize/sizeof(unsigned int)) - 2;
-						union { RaidFileRead::FileSizeType l; unsigned int i[2]; } sw;
-
-						sw.l = box_hton64(writeFileStat.st_size);
-						pparity[sizePos+0] = pstripe1[sizePos+0] ^ sw.i[0];
-						pparity[sizePos+1] = pstripe1[sizePos+1] ^ sw.i[1];
-					}
-					else
+					// write only these bits
+					parityWriteSize = (b / 2) * blockSize + bytesInLastTwoBlocks;
+				}
+				else if(bytesInLastTwoBlocks < ((blockSize * 2) - sizeof(RaidFileRead::FileSizeType)))
+				{
+					// XOR in the size at the end of the parity block (the second
+					// stripe is all zeros here, so its parity is just the first)
+					ASSERT(sizeof(RaidFileRead::FileSizeType) >= sizeof(off_t));
+					int sizePos = ((b / 2) * blockSize) + blockSize - sizeof(RaidFileRead::FileSizeType);
+					RaidFileRead::FileSizeType sw = box_hton64(writeFileStat.st_size);
+					for(unsigned int l = 0; l < sizeof(sw); ++l)
 					{
-						// Write the entire block, and put the file size at end
-						sizeRecordRequired = true;
+						pparity[sizePos + l] = pstripe1[sizePos + l] ^ ((char *)&sw)[l];
 					}
 				}
-
-				// Write block
-				if(::write(parity, parityBuffer, parityWriteSize) != parityWriteSize)
+				else
 				{
-					THROW_EXCEPTION(RaidFileException, OSError)
+					// Write the entire block, and put the file size at end
+					sizeRecordRequired = true;
 				}
 			}
 
-			// Write stripes
-			char *writeFrom = buffer;
-			for(int l = 0; l < blocksToDo; ++l)
+			// Write stripes and parity, each in a single write. Even
+			// blocks go on the first stripe, odd ones on the second,
+			// and only the last block of the file may be partial.
+			int lastBlockSize = bytesRead - ((blocksToDo - 1) * blockSize);
+			int stripe1WriteSize = ((blocksToDo + 1) / 2) * blockSize;
+			int stripe2WriteSize = (blocksToDo / 2) * blockSize;
+			if(blocksToDo & 1)
 			{
-				// Write the block
-				int toWrite = (l == (blocksToDo - 1))
-								?(bytesRead - ((blocksToDo-1)*blockSize))
-								:blockSize;
-				if(::write(((l&1)==0)?stripe1:stripe2, writeFrom, toWrite) != toWrite)
-				{
-					THROW_EXCEPTION(RaidFileException, OSError)
-				}			
-
-				// Next block
-				writeFrom += blockSize;
+				stripe1WriteSize -= blockSize - lastBlockSize;
 			}
-			
+			else
+			{
+				stripe2WriteSize -= blockSize - lastBlockSize;
+			}
+			stripe1Writer.Write(pstripe1, stripe1WriteSize);
+			stripe2Writer.Write(pstripe2, stripe2WriteSize);
+			parityWriter.Write(pparity, parityWriteSize);
+
 			// Count of blocks done
 			blocksDone += blocksToDo;
+			outputSet = (outputSet + 1) % numOutputSets;
 		}
-		// Error on read?
-		if(bytesRead == -1)
-		{
-			THROW_EXCEPTION(RaidFileException, OSError)
-		}
+
+		// Wait for the last writes to finish
+		stripe1Writer.Wait();
+		stripe2Writer.Wait();
+		parityWriter.Wait();
 		
 		// Special case for zero length files
 		if(writeFileStat.st_size == 0)
@@ -748,6 +1028,8 @@ void RaidFileWrite::Delete()
 			RaidFileException, RequestedDeleteReferencedFile);
 	}
 
+	RaidFileWriteBehind::WaitFor(mSetNumber, mFilename);
+
 	// Get disc set
 	RaidFileController &rcontroller(RaidFileController::GetController());
 	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(mSetNumber));
@@ -0,0 +1,692 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    RaidFileWriteBehind.cpp
+//		Purpose: Transform committed RAID files in the background
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#include "Box.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#ifdef HAVE_UNISTD_H
+#	include <unistd.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#	include <dirent.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "FdGetLine.h"
+#include "Guards.h"
+#include "RaidFileController.h"
+#include "RaidFileException.h"
+#include "RaidFileUtil.h"
+#include "RaidFileWrite.h"
+#include "RaidFileWriteBehind.h"
+
+#include "MemLeakFindOn.h"
+
+#define WRITE_BEHIND_JOURNAL_PREFIX	"writebehind-"
+#define WRITE_BEHIND_JOURNAL_SUFFIX	".jnl"
+
+RaidFileWriteBehind *RaidFileWriteBehind::spActive = 0;
+
+// Protects spActive, and the map of queues of the active object
+static std::mutex sActiveMutex;
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    TransformFile(int, const std::string &)
+//		Purpose: Transform one file, logging rather than throwing any
+//			 errors, as the write file is still there to be read.
+//			 Returns false if it failed, so that the file can be
+//			 kept in the journal.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static bool TransformFile(int SetNumber, const std::string &rFilename)
+{
+	try
+	{
+		RaidFileWrite file(SetNumber, rFilename);
+		file.TransformToRaidStorage();
+		return true;
+	}
+	catch(BoxException &e)
+	{
+		BOX_ERROR("Failed to transform RaidFile " << SetNumber << " " <<
+			rFilename << " to RAID storage, leaving it as it is: " <<
+			e.what());
+	}
+	catch(std::exception &e)
+	{
+		BOX_ERROR("Failed to transform RaidFile " << SetNumber << " " <<
+			rFilename << " to RAID storage, leaving it as it is: " <<
+			e.what());
+	}
+	return false;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    SyncFile(const std::string &)
+//		Purpose: Make sure the contents of a file are on disc, before
+//			 the journal relies on them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void SyncFile(const std::string &rFilename)
+{
+	FileHandleGuard<O_RDONLY | O_BINARY> file(rFilename.c_str());
+	if(::fsync(file) != 0)
+	{
+		THROW_SYS_FILE_ERROR("Failed to sync file to disc", rFilename,
+			RaidFileException, OSError);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    WriteJournal(int, const std::vector<std::string> &,
+//			 const std::string &)
+//		Purpose: Replace the contents of an open journal with the
+//			 files given, and sync it to disc.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+static void WriteJournal(int JournalHandle,
+	const std::vector<std::string> &rFilenames,
+	const std::string &rJournalFilename)
+{
+	std::string contents;
+	for(std::vector<std::string>::const_iterator i(rFilenames.begin());
+		i != rFilenames.end(); ++i)
+	{
+		contents += *i + "\n";
+	}
+
+	if(::ftruncate(JournalHandle, 0) != 0 ||
+		::lseek(JournalHandle, 0, SEEK_SET) == -1 ||
+		(!contents.empty() && ::write(JournalHandle, contents.c_str(),
+			contents.size()) != (int)contents.size()) ||
+		::fsync(JournalHandle) != 0)
+	{
+		THROW_SYS_FILE_ERROR("Failed to rewrite RaidFile write behind "
+			"journal", rJournalFilename, RaidFileException, OSError);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RaidFileWriteBehind::DiscSetQueue
+//		Purpose: The files of one disc set waiting to be transformed,
+//			 the thread which transforms them, and the journal
+//			 which lists them.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RaidFileWriteBehind::DiscSetQueue
+{
+public:
+	DiscSetQueue(int SetNumber, const std::string &rJournalFilename);
+	~DiscSetQueue();
+private:
+	// no copying
+	DiscSetQueue(const DiscSetQueue &);
+	DiscSetQueue &operator=(const DiscSetQueue &);
+
+public:
+	void Queue(const std::string &rFilename);
+	void WaitFor(const std::string &rFilename);
+	void WaitForAll();
+
+private:
+	void ThreadMain();
+	void FinishedOne(const std::string &rFilename, bool Transformed);
+
+	int mSetNumber;
+	std::string mJournalFilename;
+	int mJournalHandle;
+	std::mutex mMutex;
+	std::condition_variable mChanged;
+	std::deque<std::string> mWaiting;
+	std::string mInProgress;
+	// Files queued but not yet transformed, by anyone
+	int mOutstanding;
+	// Files which couldn't be transformed, kept in the journal
+	std::vector<std::string> mFailed;
+	bool mStopping;
+	std::thread mThread;
+};
+
+
+RaidFileWriteBehind::DiscSetQueue::DiscSetQueue(int SetNumber,
+	const std::string &rJournalFilename)
+: mSetNumber(SetNumber),
+  mJournalFilename(rJournalFilename),
+  mJournalHandle(-1),
+  mOutstanding(0),
+  mStopping(false)
+{
+	mJournalHandle = ::open(mJournalFilename.c_str(),
+		O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_BINARY,
+		S_IRUSR | S_IWUSR | S_IRGRP);
+	if(mJournalHandle == -1)
+	{
+		THROW_SYS_FILE_ERROR("Failed to create RaidFile write behind "
+			"journal", mJournalFilename, RaidFileException, OSError);
+	}
+
+#ifndef WIN32
+	// The journal is no use if its directory entry is lost
+	std::string::size_type lastSep =
+		mJournalFilename.rfind(DIRECTORY_SEPARATOR_ASCHAR);
+	if(lastSep != std::string::npos)
+	{
+		SyncFile(mJournalFilename.substr(0, lastSep));
+	}
+#endif
+
+	mThread = std::thread(&DiscSetQueue::ThreadMain, this);
+}
+
+
+RaidFileWriteBehind::DiscSetQueue::~DiscSetQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mChanged.notify_all();
+	mThread.join();
+
+	::close(mJournalHandle);
+
+	// Anything left in the queue, or which failed, wasn't transformed,
+	// so the journal must stay for Recover() to find
+	if(mOutstanding == 0 && mFailed.empty() &&
+		EMU_UNLINK(mJournalFilename.c_str()) != 0)
+	{
+		BOX_LOG_SYS_WARNING("Failed to delete RaidFile write behind "
+			"journal: " << mJournalFilename);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::DiscSetQueue::Queue(
+//			 const std::string &)
+//		Purpose: Record the file in the journal, then queue it.
+//			 Both the write file and the journal are synced to
+//			 disc first, so that Recover() finds the file intact
+//			 after a crash.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::DiscSetQueue::Queue(const std::string &rFilename)
+{
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet &rdiscSet(rcontroller.GetDiscSet(mSetNumber));
+	SyncFile(RaidFileUtil::MakeWriteFileName(rdiscSet, rFilename));
+
+	std::string line(rFilename + "\n");
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if(::write(mJournalHandle, line.c_str(), line.size()) !=
+			(int)line.size() || ::fsync(mJournalHandle) != 0)
+		{
+			THROW_SYS_FILE_ERROR("Failed to write to RaidFile write "
+				"behind journal", mJournalFilename,
+				RaidFileException, OSError);
+		}
+		mWaiting.push_back(rFilename);
+		mOutstanding++;
+	}
+	mChanged.notify_all();
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::DiscSetQueue::WaitFor(
+//			 const std::string &)
+//		Purpose: Make sure the file isn't waiting to be transformed,
+//			 or being transformed, doing it now if it hasn't been
+//			 started.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::DiscSetQueue::WaitFor(const std::string &rFilename)
+{
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(mInProgress == rFilename)
+		{
+			mChanged.wait(lock);
+		}
+
+		std::deque<std::string>::iterator i(mWaiting.begin());
+		while(i != mWaiting.end() && *i != rFilename)
+		{
+			++i;
+		}
+		if(i == mWaiting.end())
+		{
+			return;
+		}
+		mWaiting.erase(i);
+	}
+
+	bool transformed = TransformFile(mSetNumber, rFilename);
+	FinishedOne(rFilename, transformed);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::DiscSetQueue::WaitForAll()
+//		Purpose: Wait until every file queued has been transformed
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::DiscSetQueue::WaitForAll()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(mOutstanding > 0)
+	{
+		mChanged.wait(lock);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::DiscSetQueue::FinishedOne(
+//			 const std::string &, bool)
+//		Purpose: Count a file as done with. Once none are left, the
+//			 journal is rewritten with only the files which
+//			 failed, so that it doesn't grow, but Recover() can
+//			 still try them again.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::DiscSetQueue::FinishedOne(
+	const std::string &rFilename, bool Transformed)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		std::vector<std::string>::iterator
+			i(std::find(mFailed.begin(), mFailed.end(), rFilename));
+		if(Transformed && i != mFailed.end())
+		{
+			mFailed.erase(i);
+		}
+		else if(!Transformed && i == mFailed.end())
+		{
+			mFailed.push_back(rFilename);
+		}
+
+		mOutstanding--;
+		if(mOutstanding == 0)
+		{
+			try
+			{
+				WriteJournal(mJournalHandle, mFailed,
+					mJournalFilename);
+			}
+			catch(BoxException &e)
+			{
+				// The journal still lists every file which
+				// failed, and some which didn't, so this is
+				// safe to carry on from
+				BOX_WARNING("Failed to rewrite RaidFile write "
+					"behind journal: " << e.what());
+			}
+		}
+	}
+	mChanged.notify_all();
+}
+
+
+void RaidFileWriteBehind::DiscSetQueue::ThreadMain()
+{
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while(mWaiting.empty() && !mStopping)
+			{
+				mChanged.wait(lock);
+			}
+			if(mWaiting.empty())
+			{
+				return;
+			}
+			mInProgress = mWaiting.front();
+			mWaiting.pop_front();
+		}
+
+		bool transformed = TransformFile(mSetNumber, mInProgress);
+
+		std::string filename;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			filename.swap(mInProgress);
+		}
+		FinishedOne(filename, transformed);
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::RaidFileWriteBehind()
+//		Purpose: Constructor. Starts deferring transforms.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RaidFileWriteBehind::RaidFileWriteBehind()
+{
+	std::lock_guard<std::mutex> lock(sActiveMutex);
+	if(spActive != 0)
+	{
+		THROW_EXCEPTION(RaidFileException, WriteBehindAlreadyActive)
+	}
+	spActive = this;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::~RaidFileWriteBehind()
+//		Purpose: Destructor. Waits for every transform to finish.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RaidFileWriteBehind::~RaidFileWriteBehind()
+{
+	WaitForAll();
+
+	std::lock_guard<std::mutex> lock(sActiveMutex);
+	for(std::map<int, DiscSetQueue *>::iterator i(mQueues.begin());
+		i != mQueues.end(); ++i)
+	{
+		delete i->second;
+	}
+	mQueues.clear();
+	spActive = 0;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::GetQueue(int)
+//		Purpose: Private. Returns the queue for a disc set, starting
+//			 it if necessary. sActiveMutex must be held.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+RaidFileWriteBehind::DiscSetQueue &RaidFileWriteBehind::GetQueue(int SetNumber)
+{
+	std::map<int, DiscSetQueue *>::iterator i(mQueues.find(SetNumber));
+	if(i != mQueues.end())
+	{
+		return *(i->second);
+	}
+
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet &rdiscSet(rcontroller.GetDiscSet(SetNumber));
+
+	std::ostringstream journal;
+	journal << rdiscSet[0] << DIRECTORY_SEPARATOR
+		WRITE_BEHIND_JOURNAL_PREFIX << getpid()
+		<< WRITE_BEHIND_JOURNAL_SUFFIX;
+
+	DiscSetQueue *pqueue = new DiscSetQueue(SetNumber, journal.str());
+	mQueues[SetNumber] = pqueue;
+	return *pqueue;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::Queue(int, const std::string &)
+//		Purpose: Queue a committed file to be transformed later, if
+//			 write behind is active and the disc set is RAID.
+//			 Returns false if it isn't queued.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool RaidFileWriteBehind::Queue(int SetNumber, const std::string &rFilename)
+{
+	DiscSetQueue *pqueue = 0;
+	{
+		std::lock_guard<std::mutex> lock(sActiveMutex);
+		if(spActive == 0)
+		{
+			return false;
+		}
+
+		RaidFileController &rcontroller(RaidFileController::GetController());
+		if(rcontroller.GetDiscSet(SetNumber).IsNonRaidSet())
+		{
+			return false;
+		}
+
+		pqueue = &(spActive->GetQueue(SetNumber));
+	}
+
+	pqueue->Queue(rFilename);
+	return true;
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::WaitFor(int, const std::string &)
+//		Purpose: Make sure that no transform of the file is pending,
+//			 before it's changed
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::WaitFor(int SetNumber, const std::string &rFilename)
+{
+	DiscSetQueue *pqueue = 0;
+	{
+		std::lock_guard<std::mutex> lock(sActiveMutex);
+		if(spActive == 0)
+		{
+			return;
+		}
+		std::map<int, DiscSetQueue *>::iterator
+			i(spActive->mQueues.find(SetNumber));
+		if(i == spActive->mQueues.end())
+		{
+			return;
+		}
+		pqueue = i->second;
+	}
+
+	pqueue->WaitFor(rFilename);
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::WaitForAll()
+//		Purpose: Wait until every file queued so far is transformed
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::WaitForAll()
+{
+	std::map<int, DiscSetQueue *> queues;
+	{
+		std::lock_guard<std::mutex> lock(sActiveMutex);
+		queues = mQueues;
+	}
+
+	for(std::map<int, DiscSetQueue *>::iterator i(queues.begin());
+		i != queues.end(); ++i)
+	{
+		i->second->WaitForAll();
+	}
+}
+
+
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    RaidFileWriteBehind::Recover(int)
+//		Purpose: Transform the files in the journals of processes
+//			 which died before they could, and delete those
+//			 journals, or rewrite them with only the files which
+//			 still couldn't be transformed. Must not be called
+//			 while another process could be modifying the files.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+void RaidFileWriteBehind::Recover(int SetNumber)
+{
+	RaidFileController &rcontroller(RaidFileController::GetController());
+	RaidFileDiscSet rdiscSet(rcontroller.GetDiscSet(SetNumber));
+	if(rdiscSet.IsNonRaidSet())
+	{
+		return;
+	}
+
+	// Find the journals first, and deal with them after the directory
+	// is closed
+	std::vector<std::string> journals;
+	DIR *dirHandle = ::opendir(rdiscSet[0].c_str());
+	if(dirHandle == 0)
+	{
+		THROW_SYS_FILE_ERROR("Failed to open disc set directory",
+			rdiscSet[0], RaidFileException, OSError);
+	}
+	struct dirent *en = 0;
+	while((en = ::readdir(dirHandle)) != 0)
+	{
+		std::string name(en->d_name);
+		std::string::size_type prefixLen =
+			sizeof(WRITE_BEHIND_JOURNAL_PREFIX) - 1;
+		std::string::size_type suffixLen =
+			sizeof(WRITE_BEHIND_JOURNAL_SUFFIX) - 1;
+		if(name.size() <= prefixLen + suffixLen ||
+			name.compare(0, prefixLen, WRITE_BEHIND_JOURNAL_PREFIX) != 0 ||
+			name.compare(name.size() - suffixLen, suffixLen,
+				WRITE_BEHIND_JOURNAL_SUFFIX) != 0)
+		{
+			continue;
+		}
+
+		int pid = ::atoi(name.substr(prefixLen,
+			name.size() - prefixLen - suffixLen).c_str());
+		if(pid == getpid())
+		{
+			continue;
+		}
+#ifndef WIN32
+		if(pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM))
+		{
+			// That process is still running
+			continue;
+		}
+#endif
+
+		journals.push_back(rdiscSet[0] + DIRECTORY_SEPARATOR + name);
+	}
+	::closedir(dirHandle);
+
+	for(std::vector<std::string>::const_iterator j(journals.begin());
+		j != journals.end(); ++j)
+	{
+		int transformed = 0;
+		std::vector<std::string> failed;
+		{
+			FileHandleGuard<O_RDONLY | O_BINARY> journal(j->c_str());
+			FdGetLine getLine(journal);
+			while(!getLine.IsEOF())
+			{
+				std::string filename(getLine.GetLine());
+				if(filename.empty() ||
+					RaidFileUtil::RaidFileExists(rdiscSet, filename) !=
+					RaidFileUtil::NonRaid)
+				{
+					continue;
+				}
+
+				// Remove the parts of any transform which was
+				// cut short, or it can't be started again
+				for(unsigned int d = 0; d < rdiscSet.size(); ++d)
+				{
+					std::string partial(
+						RaidFileUtil::MakeRaidComponentName(
+							rdiscSet, filename, d) + 'P');
+					EMU_UNLINK(partial.c_str());
+				}
+
+				if(TransformFile(SetNumber, filename))
+				{
+					transformed++;
+				}
+				else
+				{
+					failed.push_back(filename);
+				}
+			}
+		}
+
+		if(!failed.empty())
+		{
+			BOX_ERROR("Recovered RaidFile write behind journal " <<
+				*j << ", transformed " << transformed <<
+				" files, but " << failed.size() << " failed and "
+				"are kept in the journal");
+			FileHandleGuard<O_WRONLY | O_BINARY> journal(j->c_str());
+			WriteJournal(journal, failed, *j);
+			continue;
+		}
+
+		BOX_NOTICE("Recovered RaidFile write behind journal " << *j <<
+			", transformed " << transformed << " files");
+		if(EMU_UNLINK(j->c_str()) != 0)
+		{
+			BOX_LOG_SYS_WARNING("Failed to delete RaidFile write "
+				"behind journal: " << *j);
+		}
+	}
+}
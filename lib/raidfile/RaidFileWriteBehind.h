@@ -0,0 +1,69 @@
+// --------------------------------------------------------------------------
+//
+// File
+//		Name:    RaidFileWriteBehind.h
+//		Purpose: Transform committed RAID files in the background
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+
+#ifndef RAIDFILEWRITEBEHIND__H
+#define RAIDFILEWRITEBEHIND__H
+
+#include <map>
+#include <string>
+
+// --------------------------------------------------------------------------
+//
+// Class
+//		Name:    RaidFileWriteBehind
+//		Purpose: While an object of this class exists, files which are
+//			 committed with ConvertToRaidNow are left as write
+//			 files, which RaidFileRead reads just as well, and a
+//			 thread for each disc set transforms them to RAID
+//			 storage later. Only one may exist at a time.
+//
+//			 Nothing else may modify the files while they wait, so
+//			 the owner must hold whatever lock protects them until
+//			 this is destroyed, which waits for every transform.
+//			 RaidFileWrite waits for any pending transform of a
+//			 file before opening or deleting it.
+//
+//			 Each disc set has a journal of the files waiting, in
+//			 its first directory, named after the process. If the
+//			 process dies, Recover() transforms them later. Until
+//			 then they are still readable, without redundancy.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+class RaidFileWriteBehind
+{
+public:
+	RaidFileWriteBehind();
+	~RaidFileWriteBehind();
+private:
+	// no copying
+	RaidFileWriteBehind(const RaidFileWriteBehind &);
+	RaidFileWriteBehind &operator=(const RaidFileWriteBehind &);
+
+public:
+	// Called by RaidFileWrite. Queue() returns false if the caller
+	// should transform the file itself.
+	static bool Queue(int SetNumber, const std::string &rFilename);
+	static void WaitFor(int SetNumber, const std::string &rFilename);
+
+	void WaitForAll();
+
+	// Transform the files left by processes which have died
+	static void Recover(int SetNumber);
+
+	class DiscSetQueue;
+
+private:
+	DiscSetQueue &GetQueue(int SetNumber);
+
+	std::map<int, DiscSetQueue *> mQueues;
+	static RaidFileWriteBehind *spActive;
+};
+
+#endif // RAIDFILEWRITEBEHIND__H
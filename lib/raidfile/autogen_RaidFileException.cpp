@@ -0,0 +1,57 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+#include "autogen_RaidFileException.h"
+
+#include "MemLeakFindOn.h"
+
+unsigned int RaidFileException::GetType() const throw()
+{
+	return RaidFileException::ExceptionType;
+}
+
+unsigned int RaidFileException::GetSubType() const throw()
+{
+	return mSubType;
+}
+
+const char * RaidFileException::what() const throw()
+{
+	return mWhat.c_str();
+}
+
+const char * RaidFileException::GetMessage(int SubType)
+{
+	switch(SubType)
+	{
+		case Internal: return "Internal";
+		case CantOpenConfigFile: return "CantOpenConfigFile";
+		case BadConfigFile: return "BadConfigFile";
+		case NoSuchDiscSet: return "NoSuchDiscSet";
+		case CannotOverwriteExistingFile: return "CannotOverwriteExistingFile";
+		case AlreadyOpen: return "AlreadyOpen";
+		case ErrorOpeningWriteFile: return "ErrorOpeningWriteFile";
+		case NotOpen: return "NotOpen";
+		case OSError: return "OSError";
+		case WriteFileOpenOnTransform: return "WriteFileOpenOnTransform";
+		case WrongNumberOfDiscsInSet: return "WrongNumberOfDiscsInSet";
+		case RaidFileDoesntExist: return "RaidFileDoesntExist";
+		case ErrorOpeningFileForRead: return "ErrorOpeningFileForRead";
+		case FileIsDamagedNotRecoverable: return "FileIsDamagedNotRecoverable";
+		case InvalidRaidFile: return "InvalidRaidFile";
+		case DirectoryIncomplete: return "DirectoryIncomplete";
+		case UnexpectedFileInDirPlace: return "UnexpectedFileInDirPlace";
+		case FileExistsInDirectoryCreation: return "FileExistsInDirectoryCreation";
+		case UnsupportedReadWriteOrClose: return "UnsupportedReadWriteOrClose";
+		case CanOnlyGetUsageBeforeCommit: return "CanOnlyGetUsageBeforeCommit";
+		case CanOnlyGetFileSizeBeforeCommit: return "CanOnlyGetFileSizeBeforeCommit";
+		case ErrorOpeningWriteFileOnTruncate: return "ErrorOpeningWriteFileOnTruncate";
+		case FileIsCurrentlyOpenForWriting: return "FileIsCurrentlyOpenForWriting";
+		case RequestedModifyUnreferencedFile: return "RequestedModifyUnreferencedFile";
+		case RequestedModifyMultiplyReferencedFile: return "RequestedModifyMultiplyReferencedFile";
+		case RequestedDeleteReferencedFile: return "RequestedDeleteReferencedFile";
+		case WriteBehindAlreadyActive: return "WriteBehindAlreadyActive";
+		default: return "Unknown";
+	}
+}
@@ -36,6 +36,8 @@
 #endif
 
 #define UNCERTAIN_STREAM_SIZE_BLOCK	(64*1024)
+// Buffer for copying streams of known size which can't be sent directly
+#define FIXED_STREAM_COPY_BUFFER_SIZE	(256*1024)
 
 // --------------------------------------------------------------------------
 //
@@ -766,9 +768,16 @@ void Protocol::SendStream(IOStream &rStream)
 	}
 	else
 	{
-		// Fixed size stream, send it all in one go
-		if(!rStream.CopyStreamTo(*mapConn, GetTimeout(),
-			4096 /* slightly larger buffer */))
+		// Fixed size stream, send it all in one go. If it comes
+		// straight from a file, the connection may be able to send
+		// it without copying it through this process.
+		if(mapConn->SendFile(rStream, streamSize, GetTimeout()))
+		{
+			BOX_TRACE("Sent stream of " << streamSize << " bytes "
+				"directly from file");
+		}
+		else if(!rStream.CopyStreamTo(*mapConn, GetTimeout(),
+			FIXED_STREAM_COPY_BUFFER_SIZE))
 		{
 			THROW_EXCEPTION(ConnectionException, Protocol_TimeOutWhenSendingStream)
 		}
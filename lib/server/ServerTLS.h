@@ -59,6 +59,15 @@ public:
 
 		mContext.Initialise(true /* as server */, certFile.c_str(),
 			keyFile.c_str(), caFile.c_str(), ssl_security_level);
+
+		if(serverconf.KeyExists("KernelTLS") &&
+			serverconf.GetKeyValueBool("KernelTLS") &&
+			!mContext.EnableKernelTLS())
+		{
+			BOX_WARNING("KernelTLS is set, but this Box Backup is "
+				"compiled with a version of OpenSSL which "
+				"doesn't support it, so it will be ignored");
+		}
 	
 		// Then do normal stream server stuff
 		ServerStream<SocketStreamTLS, Port, ListenBacklog,
@@ -82,6 +91,7 @@ private:
 	ConfigurationVerifyKey("TrustedCAsFile", ConfigTest_Exists), \
 	ConfigurationVerifyKey("SSLSecurityLevel", ConfigTest_IsInt, \
 		BOX_DEFAULT_SSL_SECURITY_LEVEL), \
+	ConfigurationVerifyKey("KernelTLS", ConfigTest_IsBool, false), \
 	SERVERSTREAM_VERIFY_SERVER_KEYS(DEFAULT_ADDRESSES)
 
 #endif // SERVERTLS__H
@@ -37,6 +37,10 @@
 	#include <sys/ucred.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+	#include <sys/sendfile.h>
+#endif
+
 #include "autogen_ConnectionException.h"
 #include "autogen_ServerException.h"
 #include "SocketStream.h"
@@ -399,6 +403,100 @@ void SocketStream::Write(const void *pBuffer, int NBytes, int Timeout)
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    SocketStream::SendFile(IOStream &, IOStream::pos_type, int)
+//		Purpose: If the source stream reads straight from a file,
+//			 sends Length bytes of it from its current position
+//			 with sendfile(), without copying them through this
+//			 process, and returns true. Otherwise, or if the
+//			 platform or file can't do that, sends nothing and
+//			 returns false, so the caller should copy the stream
+//			 instead.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool SocketStream::SendFile(IOStream &rSource, IOStream::pos_type Length,
+	int Timeout)
+{
+#if defined HAVE_SENDFILE && defined HAVE_SYS_SENDFILE_H
+	if(mSocketHandle == INVALID_SOCKET_VALUE)
+	{
+		THROW_EXCEPTION(ServerException, BadSocketHandle)
+	}
+
+	int fileHandle = rSource.GetSendFileHandle();
+	if(fileHandle == -1 || Length <= 0)
+	{
+		return false;
+	}
+
+	off_t offset = rSource.GetPosition();
+	IOStream::pos_type bytesLeft = Length;
+	box_time_t start = GetCurrentBoxTime();
+
+	while(bytesLeft > 0)
+	{
+		// Linux sends at most 2 GB in one call
+		size_t chunk = (bytesLeft > 0x40000000) ? 0x40000000 :
+			(size_t)bytesLeft;
+		ssize_t sent = ::sendfile(mSocketHandle, fileHandle, &offset,
+			chunk);
+
+		if(sent == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		else if(sent == -1 && (errno == EINVAL || errno == ENOSYS) &&
+			bytesLeft == Length)
+		{
+			// This file or socket can't be used with sendfile().
+			// Nothing has been sent, so the caller can copy it.
+			BOX_TRACE("Can't use sendfile() on socket " <<
+				mSocketHandle << ", copying instead");
+			return false;
+		}
+		else if(sent == -1 && errno != EAGAIN)
+		{
+			mWriteClosed = true;	// assume can't write again
+			THROW_SYS_ERROR("Failed to send file to socket",
+				ConnectionException, SocketWriteError);
+		}
+		else if(sent == 0)
+		{
+			// The peer has been promised Length bytes, so the
+			// connection can't be used after this
+			mWriteClosed = true;
+			THROW_EXCEPTION_MESSAGE(CommonException,
+				OSFileReadError, "File ended with " <<
+				bytesLeft << " of " << Length << " bytes "
+				"left to send");
+		}
+
+		if(sent > 0)
+		{
+			bytesLeft -= sent;
+			mBytesWritten += sent;
+		}
+
+		// Need to wait until it can send again?
+		if(bytesLeft > 0 && !Poll(POLLOUT, PollTimeout(Timeout, start)))
+		{
+			THROW_EXCEPTION_MESSAGE(ConnectionException,
+				Protocol_Timeout, "Timed out waiting to send " <<
+				bytesLeft << " of " << Length << " bytes");
+		}
+	}
+
+	// Leave the source where reading it would have done
+	rSource.Seek(offset, IOStream::SeekType_Absolute);
+	return true;
+#else
+	return false;
+#endif
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -63,6 +63,9 @@ public:
 
 	virtual void Shutdown(bool Read = true, bool Write = true);
 
+	virtual bool SendFile(IOStream &rSource, IOStream::pos_type Length,
+		int Timeout);
+
 	virtual bool GetPeerCredentials(uid_t &rUidOut, gid_t &rGidOut);
 
 protected:
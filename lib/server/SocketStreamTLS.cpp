@@ -427,6 +427,83 @@ void SocketStreamTLS::Write(const void *pBuffer, int NBytes, int Timeout)
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    SocketStreamTLS::SendFile(IOStream &, IOStream::pos_type, int)
+//		Purpose: See base class. Only possible when the kernel is
+//			 doing the encryption (kTLS), when OpenSSL can pass
+//			 the file to sendfile().
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool SocketStreamTLS::SendFile(IOStream &rSource, IOStream::pos_type Length,
+	int Timeout)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	if(!mpSSL) {THROW_EXCEPTION(ServerException, TLSNoSSLObject)}
+
+	if(!BIO_get_ktls_send(::SSL_get_wbio(mpSSL)))
+	{
+		return false;
+	}
+
+	int fileHandle = rSource.GetSendFileHandle();
+	if(fileHandle == -1 || Length <= 0)
+	{
+		return false;
+	}
+
+	// Make sure we always have a timeout set
+	// Deadlock may occur if we don't
+	if(Timeout == IOStream::TimeOutInfinite) {
+		Timeout = PROTOCOL_DEFAULT_TIMEOUT;
+	}
+
+	IOStream::pos_type offset = rSource.GetPosition();
+	IOStream::pos_type bytesLeft = Length;
+
+	while(bytesLeft > 0)
+	{
+		size_t chunk = (bytesLeft > 0x40000000) ? 0x40000000 :
+			(size_t)bytesLeft;
+		ossl_ssize_t r = ::SSL_sendfile(mpSSL, fileHandle, offset,
+			chunk, 0);
+
+		if(r > 0)
+		{
+			offset += r;
+			bytesLeft -= r;
+			mBytesWritten += r;
+			continue;
+		}
+
+		int se = ::SSL_get_error(mpSSL, (int)r);
+		if(se == SSL_ERROR_WANT_WRITE || se == SSL_ERROR_WANT_READ)
+		{
+			WaitWhenRetryRequired(se, Timeout);
+		}
+		else if(se == SSL_ERROR_ZERO_RETURN)
+		{
+			MarkAsWriteClosed();
+			THROW_EXCEPTION(ConnectionException, TLSClosedWhenWriting)
+		}
+		else
+		{
+			MarkAsWriteClosed();
+			CryptoUtils::LogError("sending file");
+			THROW_EXCEPTION(ConnectionException, TLSWriteFailed)
+		}
+	}
+
+	// Leave the source where reading it would have done
+	rSource.Seek(offset, IOStream::SeekType_Absolute);
+	return true;
+#else
+	return false;
+#endif
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -48,6 +48,8 @@ public:
 		int Timeout = IOStream::TimeOutInfinite);
 	virtual void Close();
 	virtual void Shutdown(bool Read = true, bool Write = true);
+	virtual bool SendFile(IOStream &rSource, IOStream::pos_type Length,
+		int Timeout);
 
 	std::string GetPeerCommonName();
 
@@ -162,6 +162,27 @@ void TLSContext::Initialise(bool AsServer, const char *CertificatesFile, const c
 	}
 }
 
+// --------------------------------------------------------------------------
+//
+// Function
+//		Name:    TLSContext::EnableKernelTLS()
+//		Purpose: Ask OpenSSL to hand the encryption of connections
+//			 over to the kernel where it can, which allows files
+//			 to be sent with sendfile(). Returns false if this
+//			 version of OpenSSL can't.
+//		Created: 2026/10/18
+//
+// --------------------------------------------------------------------------
+bool TLSContext::EnableKernelTLS()
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	::SSL_CTX_set_options(GetRawContext(), SSL_OP_ENABLE_KTLS);
+	return true;
+#else
+	return false;
+#endif
+}
+
 // --------------------------------------------------------------------------
 //
 // Function
@@ -32,6 +32,7 @@ private:
 public:
 	void Initialise(bool AsServer, const char *CertificatesFile, const char *PrivateKeyFile,
 		const char *TrustedCAsFile, int SSLSecurityLevel = -1);
+	bool EnableKernelTLS();
 	SSL_CTX *GetRawContext() const;
 
 private:
@@ -0,0 +1,66 @@
+
+// Auto-generated file -- do not edit
+
+#include "Box.h"
+#include "autogen_ServerException.h"
+
+#include "MemLeakFindOn.h"
+
+unsigned int ServerException::GetType() const throw()
+{
+	return ServerException::ExceptionType;
+}
+
+unsigned int ServerException::GetSubType() const throw()
+{
+	return mSubType;
+}
+
+const char * ServerException::what() const throw()
+{
+	return mWhat.c_str();
+}
+
+const char * ServerException::GetMessage(int SubType)
+{
+	switch(SubType)
+	{
+		case Internal: return "Internal";
+		case FailedToLoadConfiguration: return "FailedToLoadConfiguration";
+		case DaemoniseFailed: return "DaemoniseFailed";
+		case AlreadyDaemonConstructed: return "AlreadyDaemonConstructed";
+		case BadSocketHandle: return "BadSocketHandle";
+		case DupError: return "DupError";
+		case SocketAlreadyOpen: return "SocketAlreadyOpen";
+		case SocketOpenError: return "SocketOpenError";
+		case SocketPollError: return "SocketPollError";
+		case SocketCloseError: return "SocketCloseError";
+		case SocketNameUNIXPathTooLong: return "SocketNameUNIXPathTooLong";
+		case SocketBindError: return "SocketBindError";
+		case SocketAcceptError: return "SocketAcceptError";
+		case ServerStreamBadListenAddrs: return "ServerStreamBadListenAddrs";
+		case ServerForkError: return "ServerForkError";
+		case ServerWaitOnChildError: return "ServerWaitOnChildError";
+		case TooManySocketsInMultiListen: return "TooManySocketsInMultiListen";
+		case ServerStreamTooManyListenAddresses: return "ServerStreamTooManyListenAddresses";
+		case TLSContextNotInitialised: return "TLSContextNotInitialised";
+		case TLSAllocationFailed: return "TLSAllocationFailed";
+		case TLSLoadCertificatesFailed: return "TLSLoadCertificatesFailed";
+		case TLSLoadPrivateKeyFailed: return "TLSLoadPrivateKeyFailed";
+		case TLSLoadTrustedCAsFailed: return "TLSLoadTrustedCAsFailed";
+		case TLSSetCiphersFailed: return "TLSSetCiphersFailed";
+		case SSLLibraryInitialisationError: return "SSLLibraryInitialisationError";
+		case TLSNoSSLObject: return "TLSNoSSLObject";
+		case TLSAlreadyHandshaked: return "TLSAlreadyHandshaked";
+		case TLSServerWeakCertificate: return "TLSServerWeakCertificate";
+		case SocketSetNonBlockingFailed: return "SocketSetNonBlockingFailed";
+		case Protocol_BadUsage: return "Protocol_BadUsage";
+		case Protocol_UnsuitableStreamTypeForSending: return "Protocol_UnsuitableStreamTypeForSending";
+		case CantWriteToProtocolUncertainStream: return "CantWriteToProtocolUncertainStream";
+		case ProtocolUncertainStreamBadBlockHeader: return "ProtocolUncertainStreamBadBlockHeader";
+		case SocketPairFailed: return "SocketPairFailed";
+		case CouldNotChangePIDFileOwner: return "CouldNotChangePIDFileOwner";
+		case SSLRandomInitFailed: return "SSLRandomInitFailed";
+		default: return "Unknown";
+	}
+}
@@ -432,6 +432,15 @@ int console_read(char* pBuffer, size_t BufferSize);
 	} 
 #endif
 
+// Missing from both MinGW and MSVC, but _commit() flushes a file
+// descriptor's data to disc in the same way
+#ifndef HAVE_FSYNC
+	inline int fsync(int __fd)
+	{
+		return _commit(__fd);
+	}
+#endif
+
 #ifdef _MSC_VER
 	/* disable certain compiler warnings to be able to actually see the show-stopper ones */
 	#pragma warning(disable:4101)		// unreferenced local variable
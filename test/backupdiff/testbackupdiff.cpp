@@ -12,16 +12,28 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
 #include "Test.h"
 #include "BackupClientCryptoKeys.h"
+#include "BackupClientFileAttributes.h"
+#include "BackupStoreConstants.h"
 #include "BackupStoreFile.h"
+#include "BackupStoreFileChunker.h"
 #include "BackupStoreFileEncodeStream.h"
 #include "BackupStoreFilenameClear.h"
 #include "FileStream.h"
+#include "MemBlockStream.h"
+#include "MD5Digest.h"
+#include "RollingChecksum.h"
 #include "BackupStoreFileWire.h"
 #include "BackupStoreObjectMagic.h"
 #include "BackupStoreFileCryptVar.h"
 #include "BackupStoreException.h"
+#include "BoxTime.h"
 #include "CollectInBufferStream.h"
 
 #include "MemLeakFindOn.h"
@@ -275,6 +287,7 @@ void test_diff(int from, int to, int new_blocks_expected, int old_blocks_expecte
 		FileStream diff(to_diff);
 		FileStream from(from_encoded);
 		std::auto_ptr<IOStream> indexCmbStr(BackupStoreFile::CombineFileIndices(diff, from));
+		IOStream::pos_type indexCmbSize = indexCmbStr->BytesLeftToRead();
 		CollectInBufferStream indexCmb;
 		indexCmbStr->CopyStreamTo(indexCmb);
 		// Then check that it's as expected!
@@ -283,6 +296,7 @@ void test_diff(int from, int to, int new_blocks_expected, int old_blocks_expecte
 		CollectInBufferStream index;
 		result.CopyStreamTo(index);
 		TEST_THAT(indexCmb.GetSize() == index.GetSize());
+		TEST_THAT(indexCmbSize == index.GetSize());
 		TEST_THAT(::memcmp(indexCmb.GetBuffer(), index.GetBuffer(), index.GetSize()) == 0);
 	}
 	
@@ -319,6 +333,597 @@ void test_diff(int from, int to, int new_blocks_expected, int old_blocks_expecte
 	}
 }
 
+typedef struct
+{
+	int64_t mEncodedSize;	// or 0 - index of block in other file
+	int32_t mSize;
+	uint32_t mWeakChecksum;
+	uint8_t mStrongChecksum[MD5Digest::DigestLength];
+} test_block_index_entry;
+
+void read_block_index(const char *filename, int64_t &rOtherFileID,
+	std::vector<test_block_index_entry> &rEntries)
+{
+	FileStream enc(filename);
+	BackupStoreFile::MoveStreamPositionToBlockIndex(enc);
+	file_BlockIndexHeader hdr;
+	TEST_THAT(enc.ReadFullBuffer(&hdr, sizeof(hdr), 0));
+	rOtherFileID = box_ntoh64(hdr.mOtherFileID);
+
+	int64_t nblocks = box_ntoh64(hdr.mNumBlocks);
+	for(int64_t b = 0; b < nblocks; ++b)
+	{
+		file_BlockIndexEntry en;
+		TEST_THAT(enc.ReadFullBuffer(&en, sizeof(en), 0));
+
+		uint64_t iv = box_ntoh64(hdr.mEntryIVBase);
+		iv += b;
+		iv = box_hton64(iv);
+		sBlowfishDecryptBlockEntry.SetIV(&iv);
+		file_BlockIndexEntryEnc entryEnc;
+		sBlowfishDecryptBlockEntry.TransformBlock(&entryEnc,
+			sizeof(entryEnc), en.mEnEnc, sizeof(en.mEnEnc));
+
+		test_block_index_entry entry;
+		entry.mEncodedSize = box_ntoh64(en.mEncodedSize);
+		entry.mSize = ntohl(entryEnc.mSize);
+		entry.mWeakChecksum = ntohl(entryEnc.mWeakChecksum);
+		::memcpy(entry.mStrongChecksum, entryEnc.mStrongChecksum,
+			sizeof(entry.mStrongChecksum));
+		rEntries.push_back(entry);
+	}
+}
+
+// Check that the single pass search for matching blocks produces the same
+// recipe as the original search which reads the file once per block size,
+// rolling the checksums with the given implementation of RollForwardBatch().
+void test_diff_search_methods_agree(int from, int to, int impl)
+{
+	char from_encoded[256];
+	sprintf(from_encoded, "testfiles/f%d.encoded", from);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", to);
+
+	int64_t other_file_id[2];
+	bool completely_different[2];
+	std::vector<test_block_index_entry> entries[2];
+
+	for(int method = 0; method < 2; ++method)
+	{
+		char to_diff[256];
+		sprintf(to_diff, "testfiles/f%d-f%d.diff%d-%d", from, to, impl,
+			method);
+		BackupStoreFile::DiffUseMultiPassSearch = (method == 1);
+		{
+			FileStream blockindex(from_encoded);
+			BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+			BackupStoreFilenameClear fname("filename");
+			FileStream out(to_diff, O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded(
+				BackupStoreFile::EncodeFileDiff(to_orig, 
+					1 /* dir ID */, fname,
+					1000 + from /* object ID of the file diffing from */, 
+					blockindex, IOStream::TimeOutInfinite,
+					NULL, // DiffTimer interface
+					0, &completely_different[method]));
+			encoded->CopyStreamTo(out);
+		}
+		read_block_index(to_diff, other_file_id[method], entries[method]);
+	}
+	BackupStoreFile::DiffUseMultiPassSearch = false;
+
+	TEST_EQUAL_LINE(completely_different[1], completely_different[0],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(other_file_id[1], other_file_id[0],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(entries[1].size(), entries[0].size(),
+		"f" << from << " to f" << to);
+	if(entries[0].size() != entries[1].size())
+	{
+		return;
+	}
+
+	for(size_t i = 0; i < entries[0].size(); ++i)
+	{
+		// New blocks are compressed and encrypted independently, so
+		// only the blocks reused from the other file must be identical.
+		TEST_EQUAL_LINE((entries[1][i].mEncodedSize > 0),
+			(entries[0][i].mEncodedSize > 0),
+			"f" << from << " to f" << to << " block " << i);
+		if(entries[1][i].mEncodedSize <= 0)
+		{
+			TEST_EQUAL_LINE(entries[1][i].mEncodedSize,
+				entries[0][i].mEncodedSize,
+				"f" << from << " to f" << to << " block " << i);
+		}
+		TEST_EQUAL_LINE(entries[1][i].mSize, entries[0][i].mSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[1][i].mWeakChecksum,
+			entries[0][i].mWeakChecksum,
+			"f" << from << " to f" << to << " block " << i);
+	}
+}
+
+// Check that encoding new blocks on worker threads produces the same blocks
+// as encoding them on the calling thread, both for whole files and for diffs,
+// and that the result decodes to the original file.
+void test_encoding_threads_agree(int from, int to, int threads)
+{
+	char from_encoded[256];
+	sprintf(from_encoded, "testfiles/f%d.encoded", from);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", to);
+
+	std::vector<test_block_index_entry> entries[2];
+	int64_t other_file_id[2];
+
+	for(int method = 0; method < 2; ++method)
+	{
+		char to_encoded[256];
+		sprintf(to_encoded, "testfiles/f%d-f%d.threads%d-%d", from, to,
+			threads, method);
+		BackupStoreFile::SetEncodingThreads((method == 0) ? 0 : threads);
+		{
+			BackupStoreFilenameClear fname("filename");
+			FileStream out(to_encoded, O_WRONLY | O_CREAT | O_EXCL);
+			std::auto_ptr<IOStream> encoded;
+			if(from < 0)
+			{
+				encoded = BackupStoreFile::EncodeFile(to_orig,
+					1 /* dir ID */, fname);
+			}
+			else
+			{
+				FileStream blockindex(from_encoded);
+				BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+				encoded = BackupStoreFile::EncodeFileDiff(to_orig,
+					1 /* dir ID */, fname,
+					1000 + from /* object ID of the file diffing from */,
+					blockindex, IOStream::TimeOutInfinite,
+					NULL, // DiffTimer interface
+					0, 0);
+			}
+			encoded->CopyStreamTo(out);
+		}
+		read_block_index(to_encoded, other_file_id[method], entries[method]);
+
+		if(from < 0)
+		{
+			char decoded[256];
+			sprintf(decoded, "%s.dec", to_encoded);
+			FileStream enc(to_encoded);
+			BackupStoreFile::DecodeFile(enc, decoded,
+				IOStream::TimeOutInfinite);
+			TEST_THAT(files_identical(to_orig, decoded));
+		}
+	}
+	BackupStoreFile::SetEncodingThreads(0);
+
+	TEST_EQUAL_LINE(other_file_id[0], other_file_id[1],
+		"f" << from << " to f" << to);
+	TEST_EQUAL_LINE(entries[0].size(), entries[1].size(),
+		"f" << from << " to f" << to);
+	if(entries[0].size() != entries[1].size())
+	{
+		return;
+	}
+
+	// Each chunk has a random IV, but the compressed and padded sizes
+	// don't depend on it, so everything in the index must match.
+	for(size_t i = 0; i < entries[0].size(); ++i)
+	{
+		TEST_EQUAL_LINE(entries[0][i].mEncodedSize,
+			entries[1][i].mEncodedSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[0][i].mSize, entries[1][i].mSize,
+			"f" << from << " to f" << to << " block " << i);
+		TEST_EQUAL_LINE(entries[0][i].mWeakChecksum,
+			entries[1][i].mWeakChecksum,
+			"f" << from << " to f" << to << " block " << i);
+	}
+}
+
+// Decode the files written by test_encoding_threads_agree() on several
+// threads at once, each using its own copies of the decryption contexts,
+// as a parallel restore does.
+void test_decoding_threads(int threads)
+{
+	std::vector<BackupStoreFile::DecodingContexts *> contexts;
+	for(int t = 0; t < threads; ++t)
+	{
+		contexts.push_back(new BackupStoreFile::DecodingContexts);
+	}
+
+	std::vector<std::thread> workers;
+	std::vector<int> failures(threads, 0);
+	for(int t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([t, &contexts, &failures]()
+		{
+			contexts[t]->Use();
+			for(int to = 0; to <= 9; ++to)
+			{
+				char encoded[256], decoded[256];
+				sprintf(encoded, "testfiles/f-1-f%d.threads3-0", to);
+				sprintf(decoded, "%s.dec-thread%d", encoded, t);
+				try
+				{
+					FileStream enc(encoded);
+					BackupClientFileAttributes attr;
+					BackupStoreFile::DecodeFile(enc, decoded,
+						IOStream::TimeOutInfinite, 0, &attr);
+					// decrypts the attributes on this thread
+					attr.IsSymLink();
+				}
+				catch(...)
+				{
+					failures[t]++;
+				}
+			}
+			contexts[t]->StopUsing();
+		}));
+	}
+
+	for(int t = 0; t < threads; ++t)
+	{
+		workers[t].join();
+		delete contexts[t];
+		TEST_EQUAL_LINE(0, failures[t], "thread " << t);
+
+		for(int to = 0; to <= 9; ++to)
+		{
+			char orig[256], decoded[256];
+			sprintf(orig, "testfiles/f%d", to);
+			sprintf(decoded, "testfiles/f-1-f%d.threads3-0.dec-thread%d",
+				to, t);
+			TEST_THAT(files_identical(orig, decoded));
+		}
+	}
+}
+
+// Not a pass/fail test: report how fast a large file encodes with and
+// without worker threads.
+void test_encoding_threads_throughput(const char *filename, int64_t size)
+{
+	{
+		FileStream out(filename, O_WRONLY | O_CREAT | O_EXCL);
+		// Partly compressible data: pseudo-random bytes from a small
+		// alphabet, so that both the compression and encryption are
+		// doing real work.
+		std::vector<uint8_t> buffer(64*1024);
+		uint32_t seed = 0x12345678;
+		for(int64_t written = 0; written < size; written += buffer.size())
+		{
+			for(size_t i = 0; i < buffer.size(); ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				buffer[i] = 'a' + ((seed >> 16) % 32);
+			}
+			out.Write(&buffer[0], buffer.size());
+		}
+	}
+
+	int thread_counts[] = {0, 2, 4};
+	for(size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); ++t)
+	{
+		BackupStoreFile::SetEncodingThreads(thread_counts[t]);
+		box_time_t start = GetCurrentBoxTime();
+		{
+			BackupStoreFilenameClear fname("throughput");
+			std::auto_ptr<IOStream> encoded(BackupStoreFile::EncodeFile(
+				filename, 1 /* dir ID */, fname));
+			char buffer[64*1024];
+			while(encoded->StreamDataLeft())
+			{
+				encoded->Read(buffer, sizeof(buffer));
+			}
+		}
+		box_time_t elapsed = GetCurrentBoxTime() - start;
+		if(elapsed == 0) elapsed = 1;
+		BOX_NOTICE("Encoded " << (size / (1024*1024)) << " MB with " <<
+			thread_counts[t] << " encoding threads in " <<
+			BOX_FORMAT_MICROSECONDS(elapsed) << ": " <<
+			((double)size * MICRO_SEC_IN_SEC / elapsed / (1024*1024)) <<
+			" MB/s");
+	}
+	BackupStoreFile::SetEncodingThreads(0);
+
+	remove(filename);
+}
+
+// Bigger files are cut into bigger blocks by content, as they are with fixed
+// sizes, so that there aren't too many of them
+void test_chunk_sizes_scale_with_file_size()
+{
+	int64_t normalSizeLimit = (int64_t)BACKUP_FILE_CHUNK_NORMAL_SIZE *
+		BACKUP_FILE_INCREASE_BLOCK_SIZE_AFTER;
+	TEST_EQUAL(0, BackupStoreFileChunker::GetSizeShift(0));
+	TEST_EQUAL(0, BackupStoreFileChunker::GetSizeShift(normalSizeLimit));
+	TEST_EQUAL(1, BackupStoreFileChunker::GetSizeShift(normalSizeLimit + 1));
+	TEST_EQUAL(1, BackupStoreFileChunker::GetSizeShift(normalSizeLimit * 2));
+	TEST_EQUAL(2, BackupStoreFileChunker::GetSizeShift(normalSizeLimit * 2 + 1));
+
+	// But never bigger than the biggest block
+	int maxShift = BackupStoreFileChunker::GetSizeShift(
+		(int64_t)1 << 50);
+	TEST_EQUAL(BACKUP_FILE_MAX_BLOCK_SIZE,
+		(BACKUP_FILE_CHUNK_MAX_SIZE << maxShift));
+
+	const int size = 8*1024*1024;
+	std::vector<uint8_t> data(size);
+	uint32_t seed = 0x12345678;
+	for(int i = 0; i < size; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+
+	int shifts[] = {0, maxShift};
+	for(unsigned int s = 0; s < sizeof(shifts)/sizeof(shifts[0]); s++)
+	{
+		int shift = shifts[s];
+		MemBlockStream stream(&data[0], size);
+		BackupStoreFileChunker chunker(stream, size, shift);
+		TEST_EQUAL((BACKUP_FILE_MIN_BLOCK_SIZE << shift),
+			chunker.GetMinSize());
+		TEST_EQUAL((BACKUP_FILE_CHUNK_NORMAL_SIZE << shift),
+			chunker.GetNormalSize());
+		TEST_EQUAL((BACKUP_FILE_CHUNK_MAX_SIZE << shift),
+			chunker.GetMaxSize());
+
+		std::vector<int32_t> sizes;
+		const uint8_t *pchunk = 0;
+		int32_t chunkSize = 0;
+		while(chunker.NextChunk(pchunk, chunkSize))
+		{
+			sizes.push_back(chunkSize);
+		}
+		TEST_THAT_OR(sizes.size() > 1, continue);
+
+		int64_t total = 0;
+		for(size_t i = 0; i < sizes.size(); ++i)
+		{
+			if(i + 1 < sizes.size())
+			{
+				TEST_THAT(sizes[i] >= chunker.GetMinSize());
+			}
+			TEST_THAT(sizes[i] <= chunker.GetMaxSize());
+			total += sizes[i];
+		}
+		TEST_EQUAL(size, total);
+
+		// Blocks tend towards the normal size
+		int64_t mean = total / sizes.size();
+		TEST_THAT(mean > chunker.GetNormalSize() / 2);
+		TEST_THAT(mean < chunker.GetNormalSize() * 2);
+	}
+}
+
+// Encode a file with content defined chunking, then insert and delete some
+// bytes and check that the diff reuses all but the blocks around the changes,
+// and that both decode to the right thing.
+void test_content_defined_chunking(int threads)
+{
+	const int size = 2*1024*1024;
+	std::vector<uint8_t> data(size);
+	uint32_t seed = 0x9abcdef0;
+	for(int i = 0; i < size; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+	std::vector<uint8_t> changed(data.begin(), data.begin() + 300000);
+	changed.insert(changed.end(), data.begin() + 300050,
+		data.begin() + 1100000);
+	changed.insert(changed.end(), 100, 'x');
+	changed.insert(changed.end(), data.begin() + 1100000, data.end());
+
+	char orig[2][256], encoded[2][256], decoded[2][256];
+	for(int v = 0; v < 2; ++v)
+	{
+		sprintf(orig[v], "testfiles/cdc%d-%d", v, threads);
+		sprintf(encoded[v], "testfiles/cdc%d-%d.encoded", v, threads);
+		sprintf(decoded[v], "testfiles/cdc%d-%d.testdec", v, threads);
+		FileStream out(orig[v], O_WRONLY | O_CREAT | O_EXCL);
+		const std::vector<uint8_t> &rdata((v == 0) ? data : changed);
+		out.Write(&rdata[0], rdata.size());
+	}
+
+	BackupStoreFile::ContentDefinedChunking = true;
+	BackupStoreFile::SetEncodingThreads(threads);
+
+	{
+		BackupStoreFilenameClear fname("cdc");
+		FileStream out(encoded[0], O_WRONLY | O_CREAT | O_EXCL);
+		std::auto_ptr<IOStream> enc(BackupStoreFile::EncodeFile(
+			orig[0], 1 /* dir ID */, fname));
+		enc->CopyStreamTo(out);
+	}
+
+	int64_t other_file_id;
+	std::vector<test_block_index_entry> entries;
+	read_block_index(encoded[0], other_file_id, entries);
+	TEST_THAT(entries.size() > 16);
+	bool all_same_size = true;
+	for(size_t i = 0; i < entries.size(); ++i)
+	{
+		if(i + 1 < entries.size())
+		{
+			TEST_THAT(entries[i].mSize >= BACKUP_FILE_MIN_BLOCK_SIZE);
+		}
+		TEST_THAT(entries[i].mSize <= BACKUP_FILE_CHUNK_MAX_SIZE);
+		if(entries[i].mSize != entries[0].mSize)
+		{
+			all_same_size = false;
+		}
+	}
+	TEST_THAT(!all_same_size);
+
+	{
+		FileStream enc(encoded[0]);
+		BackupStoreFile::DecodeFile(enc, decoded[0],
+			IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(orig[0], decoded[0]));
+	}
+
+	char diff[256];
+	sprintf(diff, "testfiles/cdc1-%d.diff", threads);
+	{
+		FileStream blockindex(encoded[0]);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockindex);
+		BackupStoreFilenameClear fname("cdc");
+		FileStream out(diff, O_WRONLY | O_CREAT | O_EXCL);
+		bool completely_different = true;
+		std::auto_ptr<IOStream> enc(BackupStoreFile::EncodeFileDiff(
+			orig[1], 1 /* dir ID */, fname,
+			2000 /* object ID of the file diffing from */,
+			blockindex, IOStream::TimeOutInfinite,
+			NULL, // DiffTimer interface
+			0, &completely_different));
+		enc->CopyStreamTo(out);
+		TEST_THAT(!completely_different);
+	}
+
+	std::vector<test_block_index_entry> diff_entries;
+	read_block_index(diff, other_file_id, diff_entries);
+	TEST_EQUAL(2000, other_file_id);
+	int new_blocks = 0;
+	for(size_t i = 0; i < diff_entries.size(); ++i)
+	{
+		if(diff_entries[i].mEncodedSize > 0) new_blocks++;
+	}
+	// Each change should only affect the block it's in, and perhaps
+	// the one after it.
+	TEST_THAT(new_blocks >= 2 && new_blocks <= 4);
+	TEST_THAT((int)diff_entries.size() - new_blocks >=
+		(int)entries.size() - 4);
+
+	{
+		FileStream diff1(diff);
+		FileStream diff2(diff);
+		FileStream from(encoded[0]);
+		FileStream out(encoded[1], O_WRONLY | O_CREAT | O_EXCL);
+		BackupStoreFile::CombineFile(diff1, diff2, from, out);
+	}
+	{
+		FileStream enc(encoded[1]);
+		BackupStoreFile::DecodeFile(enc, decoded[1],
+			IOStream::TimeOutInfinite);
+		TEST_THAT(files_identical(orig[1], decoded[1]));
+	}
+
+	BackupStoreFile::SetEncodingThreads(0);
+	BackupStoreFile::ContentDefinedChunking = false;
+}
+
+// Check that the fingerprints calculated from a file are those of the blocks
+// that encoding it creates, and that a changed file keeps most of them.
+void test_block_fingerprints(const char *orig, const char *encoded,
+	const char *changed, bool chunked)
+{
+	BackupStoreFile::ContentDefinedChunking = chunked;
+
+	int64_t other_file_id;
+	std::vector<test_block_index_entry> entries;
+	read_block_index(encoded, other_file_id, entries);
+	TEST_EQUAL(0, other_file_id);
+
+	std::vector<uint64_t> fingerprints;
+	BackupStoreFile::CalculateBlockFingerprints(orig, fingerprints);
+	TEST_EQUAL(entries.size(), fingerprints.size());
+
+	std::set<uint64_t> unique;
+	for(size_t i = 0; i < entries.size() && i < fingerprints.size(); ++i)
+	{
+		TEST_EQUAL(BackupStoreFile::GetBlockFingerprint(entries[i].mSize,
+			entries[i].mWeakChecksum, entries[i].mStrongChecksum),
+			fingerprints[i]);
+		unique.insert(fingerprints[i]);
+	}
+
+	// A copy has the same fingerprints
+	std::vector<uint64_t> again;
+	BackupStoreFile::CalculateBlockFingerprints(orig, again);
+	TEST_THAT(again == fingerprints);
+
+	// Only the first few blocks, when asked
+	std::vector<uint64_t> prefix;
+	BackupStoreFile::CalculateBlockFingerprints(orig, prefix, 2);
+	TEST_EQUAL(2, prefix.size());
+	TEST_THAT(std::equal(prefix.begin(), prefix.end(), fingerprints.begin()));
+
+	// The encoder collects the fingerprints of the blocks of the file as
+	// the store will keep it, after combining a diff with the file it was
+	// made from, so some of them are those of the old blocks.
+	{
+		FileStream blockIndex(encoded);
+		BackupStoreFile::MoveStreamPositionToBlockIndex(blockIndex);
+		BackupStoreFilenameClear name("filename");
+		std::auto_ptr<BackupStoreFileEncodeStream> diff(
+			BackupStoreFile::EncodeFileDiff(changed, 1 /* dir ID */,
+				name, 1000 /* ID of the file diffed from */,
+				blockIndex, IOStream::TimeOutInfinite,
+				NULL /* DiffTimer */, 0 /* modification time */,
+				0 /* completely different */));
+		diff->CollectBlockFingerprints();
+		{
+			FileStream out("testfiles/fingerprints.diff",
+				O_WRONLY | O_CREAT | O_TRUNC);
+			diff->CopyStreamTo(out);
+		}
+		{
+			FileStream diffIn("testfiles/fingerprints.diff");
+			FileStream diffIn2("testfiles/fingerprints.diff");
+			FileStream from(encoded);
+			FileStream out("testfiles/fingerprints.combined",
+				O_WRONLY | O_CREAT | O_TRUNC);
+			BackupStoreFile::CombineFile(diffIn, diffIn2, from, out);
+		}
+
+		std::vector<test_block_index_entry> combined;
+		read_block_index("testfiles/fingerprints.combined",
+			other_file_id, combined);
+		const std::vector<uint64_t> &collected(
+			diff->GetBlockFingerprints());
+		TEST_EQUAL_OR(combined.size(), collected.size(), return);
+		int reused = 0;
+		for(size_t i = 0; i < combined.size(); ++i)
+		{
+			TEST_EQUAL(BackupStoreFile::GetBlockFingerprint(
+				combined[i].mSize, combined[i].mWeakChecksum,
+				combined[i].mStrongChecksum), collected[i]);
+			if(unique.find(collected[i]) != unique.end())
+			{
+				reused++;
+			}
+		}
+		TEST_THAT(reused > 0);
+	}
+
+	std::vector<uint64_t> changed_fingerprints;
+	BackupStoreFile::CalculateBlockFingerprints(changed,
+		changed_fingerprints);
+	int found = 0;
+	for(size_t i = 0; i < changed_fingerprints.size(); ++i)
+	{
+		if(unique.find(changed_fingerprints[i]) != unique.end())
+		{
+			found++;
+		}
+	}
+	if(chunked)
+	{
+		// Only the blocks around the changes are different
+		TEST_THAT(found >= (int)changed_fingerprints.size() - 4);
+	}
+	else
+	{
+		TEST_THAT(found < (int)changed_fingerprints.size());
+	}
+
+	BackupStoreFile::ContentDefinedChunking = false;
+}
+
 void test_combined_diff(int version1, int version2, int serial)
 {
 	char combined_file[256];
@@ -365,6 +970,93 @@ void test_combined_diff(int version1, int version2, int serial)
 
 }
 
+void test_combined_patch_chain(int version1, int version2)
+{
+	// Each diff refers to the blocks of the version before, just as
+	// each reverse diff in the store refers to the version after.
+	std::vector<IOStream *> chain;
+	for(int v = version2; v > version1; --v)
+	{
+		char diff[256];
+		sprintf(diff, "testfiles/f%d.diff", v);
+		chain.push_back(new FileStream(diff));
+	}
+	char orig_enc[256];
+	sprintf(orig_enc, "testfiles/f%d.encoded", version1);
+	chain.push_back(new FileStream(orig_enc));
+
+	std::auto_ptr<IOStream> combined(
+		BackupStoreFile::CombinePatchChain(chain));
+
+	char combined_dec[256];
+	sprintf(combined_dec, "testfiles/chain%d_%d.dec", version1, version2);
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", version2);
+	BackupStoreFile::DecodeFile(*combined, combined_dec,
+		IOStream::TimeOutInfinite);
+	TEST_THAT(files_identical(to_orig, combined_dec));
+}
+
+// Read parts of a version with a seekable decoded stream over its patch
+// chain, in the order the store serves them to GetFileRange.
+void test_file_ranges(int version1, int version2)
+{
+	std::vector<IOStream *> chain;
+	for(int v = version2; v > version1; --v)
+	{
+		char diff[256];
+		sprintf(diff, "testfiles/f%d.diff", v);
+		chain.push_back(new FileStream(diff));
+	}
+	char orig_enc[256];
+	sprintf(orig_enc, "testfiles/f%d.encoded", version1);
+	chain.push_back(new FileStream(orig_enc));
+
+	std::auto_ptr<IOStream> combined(
+		BackupStoreFile::CombinePatchChain(chain,
+			true /* in file order */));
+	std::auto_ptr<BackupStoreFile::DecodedStream> decoded(
+		BackupStoreFile::DecodeFileStream(*combined,
+			IOStream::TimeOutInfinite, NULL, true /* seekable */));
+
+	char to_orig[256];
+	sprintf(to_orig, "testfiles/f%d", version2);
+	CollectInBufferStream expected;
+	{
+		FileStream orig(to_orig);
+		orig.CopyStreamTo(expected);
+	}
+	expected.SetForReading();
+	int64_t size = expected.GetSize();
+	TEST_EQUAL(size, decoded->BytesLeftToRead());
+
+	// Forwards and backwards, within blocks and across them
+	int64_t offsets[] = {size / 2, 0, size - 1, 4095, 4096, size / 3,
+		size / 3 + 10, 1, size};
+	for(unsigned int i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++)
+	{
+		int64_t offset = offsets[i];
+		if(offset < 0 || offset > size) continue;
+		decoded->Seek(offset, IOStream::SeekType_Absolute);
+		TEST_EQUAL(offset, decoded->GetPosition());
+
+		char buffer[10000];
+		int toRead = sizeof(buffer);
+		if(size - offset < toRead) toRead = (int)(size - offset);
+		TEST_THAT(decoded->ReadFullBuffer(buffer, toRead, 0));
+		TEST_THAT(::memcmp(buffer, ((const char *)expected.GetBuffer()) +
+			offset, toRead) == 0);
+	}
+
+	if(size > 0)
+	{
+		decoded->Seek(-1, IOStream::SeekType_End);
+		TEST_EQUAL(size - 1, decoded->GetPosition());
+	}
+	TEST_CHECK_THROWS(decoded->Seek(size + 1, IOStream::SeekType_Absolute),
+		BackupStoreException, SeekOutsideDecodedFile);
+}
+
 #define MAX_DIFF 9
 void test_combined_diffs()
 {
@@ -457,8 +1149,68 @@ int test(int argc, const char *argv[])
 	// diff to zero sized file
 	test_diff(8, 9, 0, 0, true /* completely different expected */);
 	
+	// Check that both searches for matching blocks find the same blocks,
+	// diffing every version against every other, with every way of
+	// rolling the checksums which this CPU supports.
+	int bestBatch = RollingChecksum::GetBatchImplementation();
+	for(int impl = 0; impl < RollingChecksum::Batch_Max; ++impl)
+	{
+		if(!RollingChecksum::SetBatchImplementation(impl))
+		{
+			continue;
+		}
+
+		for(int from = 0; from <= 8; ++from)
+		{
+			for(int to = 0; to <= 9; ++to)
+			{
+				if(from != to)
+				{
+					test_diff_search_methods_agree(from, to, impl);
+				}
+			}
+		}
+	}
+	RollingChecksum::SetBatchImplementation(bestBatch);
+
+	// Check that encoding on worker threads gives the same result, for
+	// whole files and for diffs, with more threads than there are blocks
+	for(int to = 0; to <= 9; ++to)
+	{
+		test_encoding_threads_agree(-1, to, 3);
+	}
+	for(int from = 0; from <= 8; ++from)
+	{
+		test_encoding_threads_agree(from, from + 1, 2);
+		test_encoding_threads_agree(from, from + 1, 16);
+	}
+	test_decoding_threads(4);
+	test_encoding_threads_throughput("testfiles/throughput", 32*1024*1024);
+
+	// Content defined chunking, encoding on the calling thread and on
+	// worker threads
+	test_chunk_sizes_scale_with_file_size();
+	test_content_defined_chunking(0);
+	test_content_defined_chunking(2);
+
+	// Fingerprints of blocks, for finding them in other files
+	test_block_fingerprints("testfiles/f0", "testfiles/f0.encoded",
+		"testfiles/f2", false);
+	test_block_fingerprints("testfiles/cdc0-0", "testfiles/cdc0-0.encoded",
+		"testfiles/cdc1-0", true);
+
 	// Test that combining diffs works
 	test_combined_diffs();
+
+	// Rebuild versions from whole chains of diffs in one go
+	for(int v = 0; v <= MAX_DIFF; ++v)
+	{
+		test_combined_patch_chain(v, v);
+		if(v > 0) test_combined_patch_chain(0, v);
+		if(v > 2) test_combined_patch_chain(v - 2, v);
+		test_file_ranges(v, v);
+		if(v > 0) test_file_ranges(0, v);
+	}
 	
 	// Check zero sized file works OK to encode on its own, using normal encoding
 	{
@@ -9,18 +9,26 @@
 
 #include "Box.h"
 
+#include <algorithm>
 #include <stdlib.h>
 #include <string.h>
 
 #include "Archive.h"
 #include "BackupClientCryptoKeys.h"
+#include "BackupClientFileRangeStream.h"
 #include "BackupClientFileAttributes.h"
 #include "BackupProtocol.h"
 #include "BackupStoreAccountDatabase.h"
 #include "BackupStoreAccounts.h"
+#include "BackupStoreBlockDatabase.h"
+#include "BackupStoreChangeJournal.h"
+#include "BackupStoreCheck.h"
+#include "BackupStoreCheckIndex.h"
 #include "BackupStoreConfigVerify.h"
 #include "BackupStoreConstants.h"
+#include "BackupStoreDaemon.h"
 #include "BackupStoreDirectory.h"
+#include "BackupStoreDirectoryTree.h"
 #include "BackupStoreException.h"
 #include "BackupStoreFile.h"
 #include "BackupStoreFilenameClear.h"
@@ -34,6 +42,7 @@
 #include "FileStream.h"
 #include "HousekeepStoreAccount.h"
 #include "MemBlockStream.h"
+#include "NamedLock.h"
 #include "RaidFileController.h"
 #include "RaidFileException.h"
 #include "RaidFileRead.h"
@@ -380,7 +389,9 @@ bool test_backupstore_directory()
 		BackupStoreDirectory dir1(12, 98);
 		for(int e = 0; e < DIR_NUM; ++e)
 		{
-			dir1.AddEntry(ens[e].fn, ens[e].mod, ens[e].id, ens[e].size, ens[e].flags, ens[e].attrmod);
+			dir1.AddEntry(ens[e].fn, ens[e].mod, 0 /* BackupTime */,
+				0 /* DeleteTime */, ens[e].id, ens[e].size,
+				ens[e].flags, ens[e].attrmod);
 		}
 		// Got the right number
 		TEST_THAT(dir1.GetNumberOfEntries() == DIR_NUM);
@@ -507,7 +518,7 @@ void assert_everything_deleted(BackupProtocolCallable &protocol, int64_t DirID)
 	std::auto_ptr<BackupProtocolSuccess> dirreply(protocol.QueryListDirectory(
 			DirID,
 			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */));
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */, 0));
 	// Stream
 	BackupStoreDirectory dir(protocol.ReceiveStream(), SHORT_TIMEOUT);
 	BackupStoreDirectory::Iterator i(dir);
@@ -615,7 +626,7 @@ void check_dir_after_uploads(BackupProtocolCallable &protocol,
 	std::auto_ptr<BackupProtocolSuccess> dirreply(protocol.QueryListDirectory(
 			BACKUPSTORE_ROOT_DIRECTORY_ID,
 			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */));
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */, 0));
 	TEST_THAT(dirreply->GetObjectID() == BACKUPSTORE_ROOT_DIRECTORY_ID);
 	// Stream
 	BackupStoreDirectory dir(protocol.ReceiveStream(), SHORT_TIMEOUT);
@@ -676,7 +687,7 @@ void recursive_count_objects_r(BackupProtocolCallable &protocol, int64_t id,
 	std::auto_ptr<BackupProtocolSuccess> dirreply(protocol.QueryListDirectory(
 			id,
 			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */));
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */, 0));
 	// Stream
 	BackupStoreDirectory dir(protocol.ReceiveStream(), SHORT_TIMEOUT);
 
@@ -754,6 +765,23 @@ bool check_block_index(const char *encoded_file, IOStream &rBlockIndex)
 	return same;
 }
 
+// Build a modified copy of TEST_FILE_FOR_PATCHING, called ".mod"
+void write_file_for_patching()
+{
+	// Basically just insert a bit in the middle
+	TEST_THAT(TestGetFileSize(TEST_FILE_FOR_PATCHING) == TEST_FILE_FOR_PATCHING_SIZE);
+	FileStream in(TEST_FILE_FOR_PATCHING);
+	void *buf = ::malloc(TEST_FILE_FOR_PATCHING_SIZE);
+	FileStream out(TEST_FILE_FOR_PATCHING ".mod", O_WRONLY | O_CREAT);
+	TEST_THAT(in.Read(buf, TEST_FILE_FOR_PATCHING_PATCH_AT) == TEST_FILE_FOR_PATCHING_PATCH_AT);
+	out.Write(buf, TEST_FILE_FOR_PATCHING_PATCH_AT);
+	char insert[13] = "INSERTINSERT";
+	out.Write(insert, sizeof(insert));
+	TEST_THAT(in.Read(buf, TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT) == TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT);
+	out.Write(buf, TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT);
+	::free(buf);
+}
+
 bool check_files_same(const char *f1, const char *f2)
 {
 	// Open file, and move to the right position
@@ -813,6 +841,94 @@ bool run_housekeeping_and_check_account(BackupProtocolLocal2& protocol)
 	return check_account_status & check_refcount_status;
 }
 
+// Directories read from a stream keep names and attributes in one buffer
+// until they're asked for, which must give the same results as before
+bool test_directory_lazy_entries()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupStoreDirectory dir(100, 1);
+	static const char *names[] = {"zebra", "apple", "mango", "apple"};
+	for(int n = 0; n < 4; ++n)
+	{
+		BackupStoreFilenameClear name(names[n]);
+		BackupStoreDirectory::Entry *en = dir.AddEntry(name, 1000 + n,
+			2000 + n, 0, 200 + n, 10 + n,
+			(n == 1) ? (BackupStoreDirectory::Entry::Flags_File |
+				BackupStoreDirectory::Entry::Flags_OldVersion) :
+			BackupStoreDirectory::Entry::Flags_File, 3000 + n);
+		if(n != 2)
+		{
+			StreamableMemBlock attr((void *)names[n], strlen(names[n]));
+			en->SetAttributes(attr, 3000 + n);
+		}
+	}
+
+	CollectInBufferStream original;
+	dir.WriteToStream(original);
+	original.SetForReading();
+
+	BackupStoreDirectory read(original);
+	TEST_EQUAL(4, read.GetNumberOfEntries());
+
+	// Written back the same without being decoded
+	CollectInBufferStream rewritten;
+	read.WriteToStream(rewritten);
+	rewritten.SetForReading();
+	TEST_EQUAL(original.GetSize(), rewritten.GetSize());
+	TEST_THAT(::memcmp(original.GetBuffer(), rewritten.GetBuffer(),
+		original.GetSize()) == 0);
+
+	std::vector<BackupStoreDirectory::Entry *> listed;
+	read.GetEntriesToList(BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING,
+		BackupStoreDirectory::Entry::Flags_EXCLUDE_NOTHING, 0, listed);
+	TEST_EQUAL(4, listed.size());
+	for(unsigned int e = 1; e < listed.size(); ++e)
+	{
+		TEST_THAT(listed[e - 1]->GetName().GetEncodedFilename() <=
+			listed[e]->GetName().GetEncodedFilename());
+	}
+
+	// Only the newest of the two apples existed at a snapshot time
+	read.GetEntriesToList(BackupStoreDirectory::Entry::Flags_INCLUDE_EVERYTHING,
+		BackupStoreDirectory::Entry::Flags_EXCLUDE_NOTHING, 5000, listed);
+	TEST_EQUAL(3, listed.size());
+
+	// Written in order of name, so found by ID
+	for(int n = 0; n < 4; ++n)
+	{
+		BackupStoreDirectory::Entry *en = read.FindEntryByID(200 + n);
+		TEST_THAT_OR(en != 0, continue);
+		BackupStoreFilenameClear name(names[n]);
+		TEST_THAT(en->NameMatches(name));
+		TEST_THAT(en->GetName() == name);
+		TEST_EQUAL(1000 + n, en->GetModificationTime());
+		TEST_EQUAL((n != 2), en->HasAttributes());
+		if(n != 2)
+		{
+			TEST_EQUAL((int)strlen(names[n]), en->GetAttributes().GetSize());
+			TEST_THAT(::memcmp(en->GetAttributes().GetBuffer(), names[n],
+				strlen(names[n])) == 0);
+		}
+	}
+
+	// Entries read in can be copied into another directory, and deleted
+	BackupStoreDirectory copy(101, 1);
+	copy.AddEntry(*read.FindEntryByID(200));
+	read.DeleteEntry(200);
+	read.DeleteEntry(203);
+	TEST_EQUAL(2, read.GetNumberOfEntries());
+	TEST_THAT(copy.FindEntryByID(200)->NameMatches(
+		BackupStoreFilenameClear(names[0])));
+
+	BackupStoreFilenameClear renamed("kiwi");
+	read.FindEntryByID(202)->SetName(renamed);
+	TEST_THAT(read.FindEntryByID(202)->NameMatches(renamed));
+	TEST_THAT(read.FindEntryByID(202)->CompareName(
+		*read.FindEntryByID(201)) != 0);
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
 bool test_temporary_refcount_db_is_independent()
 {
 	SETUP_TEST_BACKUPSTORE();
@@ -846,6 +962,76 @@ bool test_temporary_refcount_db_is_independent()
 	TEARDOWN_TEST_BACKUPSTORE();
 }
 
+bool test_refcount_db_in_memory_matches_file()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+		BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+	const BackupStoreAccountDatabase::Entry &account(
+		apAccounts->GetEntry(0x1234567));
+
+	{
+		std::auto_ptr<BackupStoreRefCountDatabase> temp(
+			BackupStoreRefCountDatabase::Create(account));
+		temp->LoadIntoMemory();
+		TEST_THAT(temp->IsInMemory());
+		TEST_EQUAL(1, temp->GetLastObjectIDUsed());
+		TEST_EQUAL(1, temp->GetRefCount(BACKUPSTORE_ROOT_DIRECTORY_ID));
+
+		// Objects skipped over have no references
+		temp->AddReference(5);
+		temp->AddReference(5);
+		temp->AddReference(3);
+		TEST_EQUAL(5, temp->GetLastObjectIDUsed());
+		TEST_EQUAL(0, temp->GetRefCount(4));
+		TEST_EQUAL(2, temp->GetRefCount(5));
+		TEST_CHECK_THROWS(temp->GetRefCount(6),
+			BackupStoreException, UnknownObjectRefCountRequested);
+		temp->Commit();
+	}
+
+	{
+		// The file written on Commit() reads back the same without
+		// loading it into memory, and changes to a permanent database
+		// in memory are written back by Flush() or the destructor.
+		std::auto_ptr<BackupStoreRefCountDatabase> perm(
+			BackupStoreRefCountDatabase::Load(account, false));
+		TEST_EQUAL(5, perm->GetLastObjectIDUsed());
+		TEST_EQUAL(2, perm->GetRefCount(5));
+		TEST_EQUAL(1, perm->GetRefCount(3));
+		perm->LoadIntoMemory();
+		TEST_THAT(!perm->RemoveReference(3));
+		perm->AddReference(7);
+		perm->Flush();
+		perm->AddReference(2);
+	}
+
+	{
+		std::auto_ptr<BackupStoreRefCountDatabase> perm(
+			BackupStoreRefCountDatabase::Load(account,
+				true // ReadOnly
+				));
+		TEST_EQUAL(7, perm->GetLastObjectIDUsed());
+		TEST_EQUAL(0, perm->GetRefCount(3));
+		TEST_EQUAL(1, perm->GetRefCount(2));
+		TEST_EQUAL(1, perm->GetRefCount(7));
+		perm->LoadIntoMemory();
+		TEST_EQUAL(1, perm->GetRefCount(7));
+		TEST_CHECK_THROWS(perm->AddReference(2), CommonException,
+			Internal);
+	}
+
+	// Put back the reference counts which the teardown expects
+	{
+		std::auto_ptr<BackupStoreRefCountDatabase> temp(
+			BackupStoreRefCountDatabase::Create(account));
+		temp->Commit();
+	}
+
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
 bool test_server_housekeeping()
 {
 	SETUP_TEST_BACKUPSTORE();
@@ -983,7 +1169,7 @@ bool test_server_housekeeping()
 		std::auto_ptr<BackupProtocolSuccess> dirreply(protocol.QueryListDirectory(
 				BACKUPSTORE_ROOT_DIRECTORY_ID,
 				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */));
+				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */, 0));
 		// Stream
 		BackupStoreDirectory dir(protocol.ReceiveStream(), SHORT_TIMEOUT);
 		TEST_THAT(dir.GetNumberOfEntries() == 1);
@@ -1124,7 +1310,7 @@ bool test_server_housekeeping()
 	// Check that deleting files is accounted for as well
 	protocol.QueryDeleteFile(
 		BACKUPSTORE_ROOT_DIRECTORY_ID, // InDirectory
-		store1name,
+		store1name, 0,
 		false); // Filename
 
 	// The old version file is deleted as well!
@@ -1237,7 +1423,7 @@ bool assert_writable_connection_fails(BackupProtocolCallable& protocol)
 	std::auto_ptr<BackupProtocolVersion> serverVersion
 		(protocol.QueryVersion(BACKUP_STORE_SERVER_VERSION));
 	TEST_THAT(serverVersion->GetVersion() == BACKUP_STORE_SERVER_VERSION);
-	TEST_COMMAND_RETURNS_ERROR_OR(protocol, QueryLogin(0x01234567, 0),
+	TEST_COMMAND_RETURNS_ERROR_OR(protocol, QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION),
 		Err_CannotLockStoreForWriting, return false);
 	protocol.QueryFinished();
 	return true;
@@ -1250,7 +1436,7 @@ int64_t assert_readonly_connection_succeeds(BackupProtocolCallable& protocol)
 		(protocol.QueryVersion(BACKUP_STORE_SERVER_VERSION));
 	TEST_THAT(serverVersion->GetVersion() == BACKUP_STORE_SERVER_VERSION);
 	std::auto_ptr<BackupProtocolLoginConfirmed> loginConf
-		(protocol.QueryLogin(0x01234567, BackupProtocolLogin::Flags_ReadOnly));
+		(protocol.QueryLogin(0x01234567, BackupProtocolLogin::Flags_ReadOnly, PROTOCOL_CURRENT_VERSION));
 	return loginConf->GetClientStoreMarker();
 }
 
@@ -1273,7 +1459,7 @@ bool test_multiple_uploads()
 		apProtocol->QueryListDirectory(
 			BACKUPSTORE_ROOT_DIRECTORY_ID,
 			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
-			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */);
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, false /* no attributes */, 0);
 		// Stream
 		BackupStoreDirectory dir(apProtocol->ReceiveStream(),
 			apProtocol->GetTimeout());
@@ -1286,7 +1472,7 @@ bool test_multiple_uploads()
 		BACKUPSTORE_ROOT_DIRECTORY_ID,
 		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
 		BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-		false /* no attributes */);
+		false /* no attributes */, 0);
 	// Stream
 	BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 		protocolReadOnly.GetTimeout());
@@ -1372,7 +1558,7 @@ bool test_multiple_uploads()
 		{
 			std::auto_ptr<BackupProtocolSuccess> del(apProtocol->QueryDeleteFile(
 				BACKUPSTORE_ROOT_DIRECTORY_ID,
-				uploads[UPLOAD_DELETE_EN].name,
+				uploads[UPLOAD_DELETE_EN].name, 0,
 				false));
 			TEST_THAT(del->GetObjectID() == uploads[UPLOAD_DELETE_EN].allocated_objid);
 			TEST_THAT(check_num_files(UPLOAD_NUM - 4, 3, 2, 1));
@@ -1447,20 +1633,7 @@ bool test_multiple_uploads()
 
 		// Check diffing and rsync like stuff...
 		// Build a modified file
-		{
-			// Basically just insert a bit in the middle
-			TEST_THAT(TestGetFileSize(TEST_FILE_FOR_PATCHING) == TEST_FILE_FOR_PATCHING_SIZE);
-			FileStream in(TEST_FILE_FOR_PATCHING);
-			void *buf = ::malloc(TEST_FILE_FOR_PATCHING_SIZE);
-			FileStream out(TEST_FILE_FOR_PATCHING ".mod", O_WRONLY | O_CREAT);
-			TEST_THAT(in.Read(buf, TEST_FILE_FOR_PATCHING_PATCH_AT) == TEST_FILE_FOR_PATCHING_PATCH_AT);
-			out.Write(buf, TEST_FILE_FOR_PATCHING_PATCH_AT);
-			char insert[13] = "INSERTINSERT";
-			out.Write(insert, sizeof(insert));
-			TEST_THAT(in.Read(buf, TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT) == TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT);
-			out.Write(buf, TEST_FILE_FOR_PATCHING_SIZE - TEST_FILE_FOR_PATCHING_PATCH_AT);
-			::free(buf);
-		}
+		write_file_for_patching();
 
 		TEST_THAT(check_num_files(UPLOAD_NUM - 4, 3, 2, 1));
 
@@ -1607,7 +1780,7 @@ bool test_server_commands()
 				BACKUPSTORE_ROOT_DIRECTORY_ID,
 				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
 				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-				false /* no attributes! */); // Stream
+				false /* no attributes! */, 0); // Stream
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 				SHORT_TIMEOUT);
 
@@ -1648,7 +1821,7 @@ bool test_server_commands()
 					subdirid,
 					BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
 					BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-					true /* get attributes */)->GetObjectID());
+					true /* get attributes */, 0)->GetObjectID());
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 				SHORT_TIMEOUT);
 			TEST_THAT(dir.GetNumberOfEntries() == 1);
@@ -1681,7 +1854,7 @@ bool test_server_commands()
 				subdirid,
 				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
 				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-				false /* no attributes! */);
+				false /* no attributes! */, 0);
 			// Stream
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 				SHORT_TIMEOUT);
@@ -1711,7 +1884,7 @@ bool test_server_commands()
 				subdirid,
 				0,	// no flags
 				BackupProtocolListDirectory::Flags_EXCLUDE_EVERYTHING,
-				true /* get attributes */);
+				true /* get attributes */, 0);
 			// Stream
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 				SHORT_TIMEOUT);
@@ -1740,7 +1913,7 @@ bool test_server_commands()
 
 		// Check that it's in the root directory (it won't be for long)
 		protocolReadOnly.QueryListDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID,
-			0, 0, false);
+			0, 0, false, 0);
 		TEST_THAT(BackupStoreDirectory(protocolReadOnly.ReceiveStream())
 			.FindEntryByID(root_file_id) != NULL);
 
@@ -1818,7 +1991,7 @@ bool test_server_commands()
 
 		// Check it's all gone from the root directory...
 		protocolReadOnly.QueryListDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID,
-			0, 0, false);
+			0, 0, false, 0);
 		TEST_THAT(BackupStoreDirectory(protocolReadOnly.ReceiveStream(),
 			SHORT_TIMEOUT).FindEntryByID(root_file_id) == NULL);
 
@@ -1832,7 +2005,7 @@ bool test_server_commands()
 				subdirid,
 				BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
 				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-				false /* no attributes */);
+				false /* no attributes */, 0);
 
 			// Stream
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
@@ -1986,7 +2159,7 @@ bool test_server_commands()
 
 		{
 			std::auto_ptr<BackupProtocolSuccess> dirdel(apProtocol->QueryDeleteDirectory(
-					dirtodelete, false));
+					dirtodelete, 0, false));
 			TEST_THAT(dirdel->GetObjectID() == dirtodelete);
 		}
 
@@ -2004,7 +2177,7 @@ bool test_server_commands()
 				BackupProtocolListDirectory::Flags_Dir |
 				BackupProtocolListDirectory::Flags_Deleted,
 				BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-				false /* no attributes */);
+				false /* no attributes */, 0);
 			// Stream
 			BackupStoreDirectory dir(protocolReadOnly.ReceiveStream(),
 				SHORT_TIMEOUT);
@@ -2048,7 +2221,7 @@ int get_object_size(BackupProtocolCallable& protocol, int64_t ObjectID,
 	// Get the root directory cached in the read-only connection
 	protocol.QueryListDirectory(ContainerID, 0, // FlagsMustBeSet
 		BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-		false /* no attributes */);
+		false /* no attributes */, 0);
 
 	BackupStoreDirectory dir(protocol.ReceiveStream());
 	BackupStoreDirectory::Entry *en = dir.FindEntryByID(ObjectID);
@@ -2113,7 +2286,7 @@ bool test_directory_parent_entry_tracks_directory_size()
 
 	// Now delete an entry, and check that the size is reduced
 	protocol.QueryDeleteFile(subdirid,
-		BackupStoreFilenameClear(last_added_filename), false);
+		BackupStoreFilenameClear(last_added_filename), 0, false);
 	ExpectedRefCounts[last_added_file_id] = 0;
 
 	// Reduce the limits, to remove it permanently from the store
@@ -2173,7 +2346,7 @@ bool test_directory_parent_entry_tracks_directory_size()
 	}
 	TEST_THAT_OR(en, return false);
 	protocol.Reopen();
-	protocol.QueryDeleteDirectory(en->GetObjectID(), false);
+	protocol.QueryDeleteDirectory(en->GetObjectID(), 0, false);
 	set_refcount(en->GetObjectID(), 0);
 
 	// This should have fixed the error, so we should be able to add the
@@ -2184,7 +2357,7 @@ bool test_directory_parent_entry_tracks_directory_size()
 		BACKUPSTORE_ROOT_DIRECTORY_ID));
 
 	// Delete it again, which should reduce the object size again
-	protocol.QueryDeleteDirectory(dir2id, false);
+	protocol.QueryDeleteDirectory(dir2id, 0, false);
 	set_refcount(dir2id, 0);
 
 	// Reduce the limits, to remove it permanently from the store
@@ -2234,6 +2407,1156 @@ bool test_directory_parent_entry_tracks_directory_size()
 	TEARDOWN_TEST_BACKUPSTORE();
 }
 
+// A local protocol whose store context the tests can reach directly
+class BackupProtocolLocalWithContext : public BackupProtocolLocal2
+{
+public:
+	BackupProtocolLocalWithContext(int32_t AccountNumber,
+		const std::string& ConnectionDetails,
+		const std::string& AccountRootDir, int DiscSetNumber,
+		bool ReadOnly)
+	: BackupProtocolLocal2(AccountNumber, ConnectionDetails,
+		AccountRootDir, DiscSetNumber, ReadOnly)
+	{ }
+	using BackupProtocolLocal2::GetContext;
+};
+
+bool test_directory_cache_evicts_least_recently_used()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocalWithContext protocol(0x01234567, "test",
+		"backup/01234567/", 0, false);
+	BackupStoreContext &rcontext(protocol.GetContext());
+	int64_t subdirid = create_directory(protocol);
+
+	// With room for both directories, reading them again hits the cache
+	rcontext.SetDirectoryCacheMaxSize(1024*1024);
+	int64_t root_size = rcontext.GetDirectory(
+		BACKUPSTORE_ROOT_DIRECTORY_ID).GetMemoryUsage();
+	int64_t subdir_size = rcontext.GetDirectory(subdirid).GetMemoryUsage();
+	TEST_EQUAL(root_size + subdir_size, rcontext.GetDirectoryCacheSize());
+	int64_t hits = rcontext.GetDirectoryCacheHits();
+	int64_t misses = rcontext.GetDirectoryCacheMisses();
+	int64_t evictions = rcontext.GetDirectoryCacheEvictions();
+	rcontext.GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID);
+	rcontext.GetDirectory(subdirid);
+	TEST_EQUAL(hits + 2, rcontext.GetDirectoryCacheHits());
+	TEST_EQUAL(misses, rcontext.GetDirectoryCacheMisses());
+	TEST_EQUAL(evictions, rcontext.GetDirectoryCacheEvictions());
+
+	// Make room for only one directory. Only the least recently used one
+	// should be evicted to make room for another.
+	rcontext.SetDirectoryCacheMaxSize(std::max(root_size, subdir_size));
+	TEST_EQUAL(evictions + 1, rcontext.GetDirectoryCacheEvictions());
+	rcontext.GetDirectory(subdirid);
+	TEST_EQUAL(hits + 3, rcontext.GetDirectoryCacheHits());
+	rcontext.GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID);
+	TEST_EQUAL(misses + 1, rcontext.GetDirectoryCacheMisses());
+	TEST_EQUAL(evictions + 2, rcontext.GetDirectoryCacheEvictions());
+
+	// Writing to a cached directory makes it bigger without reading
+	// anything, so saving it must trim the cache: only the directory
+	// just saved may remain, even though it is now over the limit alone
+	rcontext.SetDirectoryCacheMaxSize(1024*1024);
+	rcontext.GetDirectory(subdirid);
+	rcontext.GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID);
+	rcontext.SetDirectoryCacheMaxSize(rcontext.GetDirectoryCacheSize());
+	evictions = rcontext.GetDirectoryCacheEvictions();
+	create_file(protocol, subdirid, "file1");
+	create_file(protocol, subdirid, "file2");
+	TEST_THAT(rcontext.GetDirectoryCacheEvictions() > evictions);
+	TEST_THAT(rcontext.GetDirectoryCacheSize() >
+		rcontext.GetDirectoryCacheMaxSize());
+	TEST_EQUAL(rcontext.GetDirectory(subdirid).GetMemoryUsage(),
+		rcontext.GetDirectoryCacheSize());
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// Check that ListDirectoryTree returns the same listings as ListDirectory
+// does for each directory in the tree, in the number of batches expected
+bool check_directory_tree_listing(BackupProtocolCallable &protocol,
+	int16_t FlagsMustBeSet, int16_t FlagsNotToBeSet,
+	const std::vector<std::pair<int64_t, int64_t> > &rExpected,
+	int32_t MaxDirectories = 0, int ExpectedBatches = 1)
+{
+	BackupStoreDirectoryTree tree(protocol, FlagsMustBeSet,
+		FlagsNotToBeSet, 0 /* no snapshot */, MaxDirectories);
+	tree.List(BACKUPSTORE_ROOT_DIRECTORY_ID);
+
+	if(MaxDirectories == 0)
+	{
+		TEST_EQUAL_OR(rExpected.size(), tree.GetNumberOfDirectories(),
+			return false);
+		for(std::vector<std::pair<int64_t, int64_t> >::const_iterator
+			i = rExpected.begin(); i != rExpected.end(); i++)
+		{
+			TEST_THAT_OR(tree.Contains(i->first), return false);
+			TEST_EQUAL(i->second, tree.GetParentID(i->first));
+		}
+	}
+	else
+	{
+		TEST_EQUAL_OR(std::min((size_t)MaxDirectories,
+			rExpected.size()), tree.GetNumberOfDirectories(),
+			return false);
+	}
+
+	for(std::vector<std::pair<int64_t, int64_t> >::const_iterator
+		i = rExpected.begin(); i != rExpected.end(); i++)
+	{
+		protocol.QueryListDirectory(i->first, FlagsMustBeSet,
+			FlagsNotToBeSet, true /* want attributes */,
+			0 /* no snapshot */);
+		BackupStoreDirectory dir;
+		{
+			std::auto_ptr<IOStream> dirstream(
+				protocol.ReceiveStream());
+			dir.ReadFromStream(*dirstream, protocol.GetTimeout());
+		}
+
+		// Lists the next batch if this one wasn't in the last
+		std::auto_ptr<BackupStoreDirectory> apFromTree(
+			tree.Take(i->first));
+		TEST_THAT_OR(apFromTree.get() != NULL, return false);
+		CollectInBufferStream expected, actual;
+		dir.WriteToStream(expected);
+		apFromTree->WriteToStream(actual);
+		expected.SetForReading();
+		actual.SetForReading();
+		TEST_EQUAL_OR(expected.GetSize(), actual.GetSize(), continue);
+		TEST_THAT(memcmp(expected.GetBuffer(), actual.GetBuffer(),
+			expected.GetSize()) == 0);
+	}
+
+	TEST_EQUAL(0, tree.GetNumberOfDirectories());
+	TEST_EQUAL(ExpectedBatches, tree.GetNumberOfBatches());
+	return true;
+}
+
+bool test_list_directory_tree()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocal2 protocol(0x01234567, "test", "backup/01234567/",
+		0, false);
+	int64_t subdirid = create_directory(protocol);
+	int64_t subsubdirid = create_directory(protocol, subdirid);
+	create_file(protocol, subdirid, "file_in_subdir");
+	create_file(protocol, subsubdirid, "file_in_subsubdir");
+
+	// Depth first, with the ID of the directory each one is listed in
+	std::vector<std::pair<int64_t, int64_t> > expected;
+	expected.push_back(std::make_pair(
+		(int64_t)BACKUPSTORE_ROOT_DIRECTORY_ID, (int64_t)0));
+	expected.push_back(std::make_pair(subdirid,
+		(int64_t)BACKUPSTORE_ROOT_DIRECTORY_ID));
+	expected.push_back(std::make_pair(subsubdirid, subdirid));
+
+	TEST_THAT(check_directory_tree_listing(protocol,
+		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+		BackupProtocolListDirectory::Flags_OldVersion |
+		BackupProtocolListDirectory::Flags_Deleted, expected));
+
+	// In batches, the directories left out of each are listed when
+	// they're taken
+	TEST_THAT(check_directory_tree_listing(protocol,
+		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+		BackupProtocolListDirectory::Flags_OldVersion |
+		BackupProtocolListDirectory::Flags_Deleted, expected,
+		2 /* max directories */, 2 /* batches */));
+	TEST_THAT(check_directory_tree_listing(protocol,
+		BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+		BackupProtocolListDirectory::Flags_OldVersion |
+		BackupProtocolListDirectory::Flags_Deleted, expected,
+		1 /* max directories */, 3 /* batches */));
+
+	// Taking a directory which the store can't list returns nothing,
+	// and leaves the connection usable
+	{
+		BackupStoreDirectoryTree tree(protocol,
+			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
+			0 /* no snapshot */, 1 /* max directories */);
+		tree.List(BACKUPSTORE_ROOT_DIRECTORY_ID);
+		TEST_THAT(tree.Take(0x7fffffff).get() == NULL);
+		TEST_THAT(tree.Take(subdirid).get() != NULL);
+		TEST_EQUAL(2, tree.GetNumberOfBatches());
+	}
+
+	// Listing only files doesn't descend into any directories
+	expected.resize(1);
+	TEST_THAT(check_directory_tree_listing(protocol,
+		BackupProtocolListDirectory::Flags_File,
+		BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING, expected));
+
+	// A directory which doesn't exist gives an error, as ListDirectory
+	TEST_COMMAND_RETURNS_ERROR(protocol,
+		QueryListDirectoryTree(0x7fffffff,
+			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
+			true, 0, 0),
+		Err_DoesNotExist);
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// Append a file to a batch in the format which StoreFiles expects, with
+// contents which don't verify if Corrupt is set
+void add_to_store_files_batch(CollectInBufferStream &rBatch, int64_t DirID,
+	const std::string &rName, bool Corrupt = false)
+{
+	write_test_file(0);
+	BackupStoreFilenameClear name(rName);
+	int64_t modtime;
+	CollectInBufferStream encoded;
+	if(Corrupt)
+	{
+		std::string garbage(1024, 'x');
+		encoded.Write(garbage.c_str(), garbage.size());
+	}
+	else
+	{
+		std::auto_ptr<IOStream> upload(BackupStoreFile::EncodeFile(
+			"testfiles/test0", DirID, name, &modtime));
+		upload->CopyStreamTo(encoded);
+	}
+
+	Archive archive(rBatch, IOStream::TimeOutInfinite);
+	archive.Write((int64_t)FAKE_MODIFICATION_TIME);
+	archive.Write((int64_t)FAKE_MODIFICATION_TIME); // attributes hash
+	name.WriteToStream(rBatch);
+	archive.Write((int64_t)0); // no block fingerprints
+	archive.Write((int64_t)encoded.GetSize());
+	rBatch.Write(encoded.GetBuffer(), encoded.GetSize());
+}
+
+bool test_store_files_batch()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocal2 protocol(0x01234567, "test", "backup/01234567/",
+		0, false);
+	int64_t subdirid = create_directory(protocol);
+
+	// Three files in one command, which replies with their IDs in order
+	{
+		std::auto_ptr<CollectInBufferStream> batch(
+			new CollectInBufferStream);
+		add_to_store_files_batch(*batch, subdirid, "batch1");
+		add_to_store_files_batch(*batch, subdirid, "batch2");
+		add_to_store_files_batch(*batch, subdirid, "batch3");
+		batch->SetForReading();
+		std::auto_ptr<IOStream> upload(batch.release());
+
+		std::auto_ptr<BackupProtocolSuccess> stored(
+			protocol.QueryStoreFiles(subdirid, 3, upload));
+		TEST_EQUAL(3, stored->GetObjectID());
+		std::auto_ptr<IOStream> idStream(protocol.ReceiveStream());
+		Archive archive(*idStream, IOStream::TimeOutInfinite);
+		std::vector<int64_t> ids;
+		for(int n = 0; n < 3; n++)
+		{
+			int64_t id;
+			archive.Read(id);
+			ids.push_back(id);
+			set_refcount(id, 1);
+		}
+
+		// Each one is listed under its own name, and can be read
+		protocol.QueryListDirectory(subdirid,
+			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
+			false /* no attributes */, 0);
+		BackupStoreDirectory dir(protocol.ReceiveStream(),
+			SHORT_TIMEOUT);
+		TEST_EQUAL(3, dir.GetNumberOfEntries());
+		const char *names[] = {"batch1", "batch2", "batch3"};
+		for(int n = 0; n < 3; n++)
+		{
+			BackupStoreDirectory::Entry *en =
+				dir.FindEntryByID(ids[n]);
+			TEST_THAT_OR(en != 0, return false);
+			TEST_THAT(en->GetName() ==
+				BackupStoreFilenameClear(names[n]));
+			TEST_EQUAL(BackupStoreDirectory::Entry::Flags_File,
+				en->GetFlags());
+			TEST_EQUAL(FAKE_MODIFICATION_TIME,
+				en->GetModificationTime());
+		}
+		protocol.QueryGetFile(subdirid, ids[2]);
+		std::auto_ptr<IOStream> file(protocol.ReceiveStream());
+		test_test_file(0, *file);
+	}
+
+	// A file which fails part way through a batch doesn't lose the
+	// ones stored before it, although the command returns an error
+	{
+		std::auto_ptr<CollectInBufferStream> batch(
+			new CollectInBufferStream);
+		add_to_store_files_batch(*batch, subdirid, "batch4");
+		add_to_store_files_batch(*batch, subdirid, "batch5",
+			true /* corrupt */);
+		add_to_store_files_batch(*batch, subdirid, "batch6");
+		batch->SetForReading();
+		std::auto_ptr<IOStream> upload(batch.release());
+
+		TEST_COMMAND_RETURNS_ERROR(protocol,
+			QueryStoreFiles(subdirid, 3, upload),
+			Err_FileDoesNotVerify);
+
+		protocol.QueryListDirectory(subdirid,
+			BackupProtocolListDirectory::Flags_INCLUDE_EVERYTHING,
+			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
+			false /* no attributes */, 0);
+		BackupStoreDirectory dir(protocol.ReceiveStream(),
+			SHORT_TIMEOUT);
+		TEST_EQUAL(4, dir.GetNumberOfEntries());
+		BackupStoreDirectory::Iterator i(dir);
+		BackupStoreDirectory::Entry *en = i.FindMatchingClearName(
+			BackupStoreFilenameClear("batch4"));
+		TEST_THAT_OR(en != 0, return false);
+		set_refcount(en->GetObjectID(), 1);
+		TEST_THAT(i.FindMatchingClearName(
+			BackupStoreFilenameClear("batch5")) == 0);
+		TEST_THAT(i.FindMatchingClearName(
+			BackupStoreFilenameClear("batch6")) == 0);
+	}
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// Upload TEST_FILE_FOR_PATCHING, then the ".mod" version of it as a patch
+// from the first, returning both IDs
+void upload_file_and_patch(BackupProtocolCallable &protocol,
+	const BackupStoreFilenameClear &rName, int64_t &rOriginalID,
+	int64_t &rPatchedID)
+{
+	int64_t modtime;
+	std::auto_ptr<IOStream> upload(BackupStoreFile::EncodeFile(
+		TEST_FILE_FOR_PATCHING, BACKUPSTORE_ROOT_DIRECTORY_ID, rName,
+		&modtime));
+	rOriginalID = protocol.QueryStoreFile(BACKUPSTORE_ROOT_DIRECTORY_ID,
+		modtime, modtime, 0 /* not a diff */, rName,
+		upload)->GetObjectID();
+	set_refcount(rOriginalID, 1);
+
+	protocol.QueryGetBlockIndexByName(BACKUPSTORE_ROOT_DIRECTORY_ID,
+		rName);
+	std::auto_ptr<IOStream> blockIndex(protocol.ReceiveStream());
+	bool isCompletelyDifferent = true;
+	std::auto_ptr<IOStream> patch(BackupStoreFile::EncodeFileDiff(
+		TEST_FILE_FOR_PATCHING ".mod", BACKUPSTORE_ROOT_DIRECTORY_ID,
+		rName, rOriginalID, *blockIndex, SHORT_TIMEOUT,
+		NULL, // DiffTimer
+		&modtime, &isCompletelyDifferent));
+	TEST_THAT(!isCompletelyDifferent);
+	rPatchedID = protocol.QueryStoreFile(BACKUPSTORE_ROOT_DIRECTORY_ID,
+		modtime, modtime, rOriginalID, rName, patch)->GetObjectID();
+	set_refcount(rPatchedID, 1);
+}
+
+// Check whether the object on disc is a complete file or a patch
+bool check_stored_as_patch(int64_t ObjectID, bool ExpectPatch)
+{
+	int64_t diffFromID = 0;
+	std::auto_ptr<RaidFileRead> file(get_raid_file(ObjectID));
+	TEST_THAT_OR(BackupStoreFile::VerifyEncodedFileFormat(*file,
+		&diffFromID), return false);
+	TEST_EQUAL_OR(ExpectPatch, (diffFromID != 0), return false);
+	return true;
+}
+
+bool check_downloaded_file(BackupProtocolCallable &protocol, int64_t ObjectID,
+	const char *pExpectedContents)
+{
+	protocol.QueryGetFile(BACKUPSTORE_ROOT_DIRECTORY_ID, ObjectID);
+	std::auto_ptr<IOStream> file(protocol.ReceiveStream());
+	UNLINK_IF_EXISTS(TEST_FILE_FOR_PATCHING ".downloaded");
+	BackupStoreFile::DecodeFile(*file,
+		TEST_FILE_FOR_PATCHING ".downloaded", SHORT_TIMEOUT);
+	return check_files_same(TEST_FILE_FOR_PATCHING ".downloaded",
+		pExpectedContents);
+}
+
+bool test_deferred_reverse_diffs()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocalWithContext protocol(0x01234567, "test",
+		"backup/01234567/", 0, false);
+	protocol.GetContext().SetDeferReverseDiffs(true);
+	write_test_file(2); // TEST_FILE_FOR_PATCHING
+	write_file_for_patching();
+
+	// The patch is stored as it was uploaded, leaving the original
+	// version complete
+	BackupStoreFilenameClear name("patched");
+	int64_t originalID, patchedID;
+	upload_file_and_patch(protocol, name, originalID, patchedID);
+	{
+		const BackupStoreDirectory &dir(protocol.GetContext().
+			GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID));
+		BackupStoreDirectory::Entry *en = dir.FindEntryByID(patchedID);
+		TEST_THAT_OR(en != 0, return false);
+		TEST_THAT(en->IsPatchFromOlder());
+		TEST_EQUAL(originalID, en->GetDependsOlder());
+		en = dir.FindEntryByID(originalID);
+		TEST_THAT_OR(en != 0, return false);
+		TEST_THAT(!en->IsPatchFromOlder());
+		TEST_THAT(en->IsOld());
+		TEST_EQUAL(patchedID, en->GetDependsNewer());
+	}
+	TEST_THAT(check_stored_as_patch(originalID, false));
+	TEST_THAT(check_stored_as_patch(patchedID, true));
+
+	// Both versions can be downloaded complete
+	TEST_THAT(check_downloaded_file(protocol, patchedID,
+		TEST_FILE_FOR_PATCHING ".mod"));
+	TEST_THAT(check_downloaded_file(protocol, originalID,
+		TEST_FILE_FOR_PATCHING));
+
+	// The block index of the new version describes the whole file, so
+	// the client can diff against it
+	{
+		std::auto_ptr<BackupProtocolSuccess> getBlockIndex(
+			protocol.QueryGetBlockIndexByName(
+				BACKUPSTORE_ROOT_DIRECTORY_ID, name));
+		TEST_EQUAL(patchedID, getBlockIndex->GetObjectID());
+		std::auto_ptr<IOStream> blockIndex(protocol.ReceiveStream());
+		bool isCompletelyDifferent = true;
+		int64_t modtime;
+		std::auto_ptr<IOStream> patch(BackupStoreFile::EncodeFileDiff(
+			TEST_FILE_FOR_PATCHING ".mod",
+			BACKUPSTORE_ROOT_DIRECTORY_ID, name, patchedID,
+			*blockIndex, SHORT_TIMEOUT, NULL, &modtime,
+			&isCompletelyDifferent));
+		TEST_THAT(!isCompletelyDifferent);
+		CollectInBufferStream patchData;
+		patch->CopyStreamTo(patchData);
+		// Nothing has changed, so nothing is sent but the index
+		TEST_THAT(patchData.GetSize() < 8*1024);
+	}
+
+	// Housekeeping makes the new version complete, and the old one a
+	// patch from it, as if the store had done it while the client waited
+	TEST_THAT(run_housekeeping_and_check_account(protocol));
+	{
+		const BackupStoreDirectory &dir(protocol.GetContext().
+			GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID));
+		BackupStoreDirectory::Entry *en = dir.FindEntryByID(patchedID);
+		TEST_THAT_OR(en != 0, return false);
+		TEST_THAT(!en->IsPatchFromOlder());
+		TEST_EQUAL(originalID, en->GetDependsOlder());
+	}
+	TEST_THAT(check_stored_as_patch(patchedID, false));
+	TEST_THAT(check_stored_as_patch(originalID, true));
+	TEST_THAT(check_downloaded_file(protocol, patchedID,
+		TEST_FILE_FOR_PATCHING ".mod"));
+	TEST_THAT(check_downloaded_file(protocol, originalID,
+		TEST_FILE_FOR_PATCHING));
+
+	// A pending patch whose original version has gone is no use, so the
+	// store check removes it
+	BackupStoreFilenameClear name2("broken");
+	int64_t brokenOriginalID, brokenPatchedID;
+	upload_file_and_patch(protocol, name2, brokenOriginalID,
+		brokenPatchedID);
+	protocol.QueryFinished();
+	{
+		std::string filename;
+		StoreStructure::MakeObjectFilename(brokenOriginalID,
+			"backup/01234567/" /* StoreRoot */, 0 /* DiscSet */,
+			filename, false /* EnsureDirectoryExists */);
+		RaidFileWrite del(0, filename);
+		del.Delete();
+	}
+	TEST_THAT(check_account_for_errors() > 0);
+	protocol.Reopen();
+	{
+		const BackupStoreDirectory &dir(protocol.GetContext().
+			GetDirectory(BACKUPSTORE_ROOT_DIRECTORY_ID));
+		TEST_THAT(dir.FindEntryByID(brokenOriginalID) == 0);
+		TEST_THAT(dir.FindEntryByID(brokenPatchedID) == 0);
+		set_refcount(brokenPatchedID, 0);
+		set_refcount(brokenOriginalID, 0);
+	}
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// Reads part of a file with GetFileRange, and sets rSize to the size of
+// the whole encoded file
+std::string get_file_range(BackupProtocolCallable &protocol,
+	int64_t InDirectory, int64_t ObjectID, int64_t Offset, int64_t Length,
+	int64_t &rSize)
+{
+	std::auto_ptr<BackupProtocolSuccess> reply(protocol.QueryGetFileRange(
+		InDirectory, ObjectID, Offset, Length));
+	rSize = reply->GetObjectID();
+	CollectInBufferStream data;
+	if(Offset < rSize && Length > 0)
+	{
+		std::auto_ptr<IOStream> range(protocol.ReceiveStream());
+		range->CopyStreamTo(data);
+	}
+	data.SetForReading();
+	return std::string((const char *)data.GetBuffer(), data.GetSize());
+}
+
+// Decodes parts of a file on the store, fetching only what's needed with
+// BackupClientFileRangeStream, and checks them against the local file
+bool check_decoded_ranges(BackupProtocolCallable &protocol, int64_t ObjectID,
+	const char *pExpectedContents, int64_t EncodedSize)
+{
+	CollectInBufferStream expected;
+	{
+		FileStream local(pExpectedContents);
+		local.CopyStreamTo(expected);
+	}
+	expected.SetForReading();
+
+	BackupClientFileRangeStream remote(protocol,
+		BACKUPSTORE_ROOT_DIRECTORY_ID, ObjectID, 4096 /* read ahead */);
+	std::auto_ptr<BackupStoreFile::DecodedStream> decoded(
+		BackupStoreFile::DecodeFileStream(remote, SHORT_TIMEOUT, NULL,
+			true /* seekable */));
+	TEST_EQUAL_OR(expected.GetSize(), decoded->BytesLeftToRead(),
+		return false);
+
+	bool same = true;
+	int64_t offsets[] = {TEST_FILE_FOR_PATCHING_PATCH_AT - 50, 0,
+		expected.GetSize() - 100};
+	for(unsigned int i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++)
+	{
+		char buffer[100];
+		decoded->Seek(offsets[i], IOStream::SeekType_Absolute);
+		TEST_THAT_OR(decoded->ReadFullBuffer(buffer, sizeof(buffer), 0),
+			same = false);
+		TEST_THAT_OR(::memcmp(buffer, ((const char *)expected.GetBuffer()) +
+			offsets[i], sizeof(buffer)) == 0, same = false);
+	}
+
+	// Only some of the file was fetched
+	TEST_THAT_OR(remote.GetNumberOfFetches() * 4096 < EncodedSize,
+		same = false);
+	return same;
+}
+
+bool test_get_file_range()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocalWithContext protocol(0x01234567, "test",
+		"backup/01234567/", 0, false);
+	BackupStoreContext &rcontext(protocol.GetContext());
+	write_test_file(2); // TEST_FILE_FOR_PATCHING
+	write_file_for_patching();
+
+	// The original version is stored as a patch from the new one
+	BackupStoreFilenameClear name("ranges");
+	int64_t originalID, patchedID;
+	upload_file_and_patch(protocol, name, originalID, patchedID);
+	TEST_THAT(check_stored_as_patch(patchedID, false));
+	TEST_THAT(check_stored_as_patch(originalID, true));
+
+	// A complete file is read just as it is on disc
+	int64_t patchedSize = 0;
+	{
+		CollectInBufferStream onDisc;
+		rcontext.OpenObject(patchedID)->CopyStreamTo(onDisc);
+		onDisc.SetForReading();
+		std::string expected((const char *)onDisc.GetBuffer(),
+			onDisc.GetSize());
+
+		std::string whole = get_file_range(protocol,
+			BACKUPSTORE_ROOT_DIRECTORY_ID, patchedID, 0,
+			expected.size() + 100, patchedSize);
+		TEST_EQUAL((int64_t)expected.size(), patchedSize);
+		TEST_THAT(whole == expected);
+
+		int64_t size = 0;
+		TEST_THAT(get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID,
+			patchedID, 100, 50, size) == expected.substr(100, 50));
+		TEST_EQUAL(patchedSize, size);
+
+		// Nothing is sent past the end, or for no bytes
+		TEST_THAT(get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID,
+			patchedID, patchedSize, 50, size).empty());
+		TEST_EQUAL(patchedSize, size);
+		TEST_THAT(get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID,
+			patchedID, 10, 0, size).empty());
+	}
+
+	// A patch is read as the complete file it's rebuilt into
+	int64_t originalSize = 0;
+	{
+		std::string whole = get_file_range(protocol,
+			BACKUPSTORE_ROOT_DIRECTORY_ID, originalID, 0,
+			1024*1024*1024, originalSize);
+		TEST_EQUAL((int64_t)whole.size(), originalSize);
+		MemBlockStream wholeStream(whole.c_str(), whole.size());
+		int64_t diffFromID = 0;
+		TEST_THAT(BackupStoreFile::VerifyEncodedFileFormat(wholeStream,
+			&diffFromID));
+		TEST_EQUAL(0, diffFromID);
+
+		int64_t size = 0;
+		TEST_THAT(get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID,
+			originalID, 1000, 5000, size) == whole.substr(1000, 5000));
+		TEST_EQUAL(originalSize, size);
+	}
+
+	// Both decode to the files they were uploaded from
+	TEST_THAT(check_decoded_ranges(protocol, patchedID,
+		TEST_FILE_FOR_PATCHING ".mod", patchedSize));
+	TEST_THAT(check_decoded_ranges(protocol, originalID,
+		TEST_FILE_FOR_PATCHING, originalSize));
+
+	// The file last read is kept open, until any directory is saved
+	int64_t size = 0;
+	get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID, originalID, 0,
+		10, size);
+	TEST_THAT(rcontext.GetFileRangeStream(originalID) != 0);
+	TEST_THAT(rcontext.GetFileRangeStream(patchedID) == 0);
+	int64_t subdirid = create_directory(protocol);
+	TEST_THAT(rcontext.GetFileRangeStream(originalID) == 0);
+
+	// Even when it's open, it's only read in the directory it's in
+	get_file_range(protocol, BACKUPSTORE_ROOT_DIRECTORY_ID, originalID, 0,
+		10, size);
+	TEST_THAT(rcontext.GetFileRangeStream(originalID) != 0);
+	TEST_COMMAND_RETURNS_ERROR(protocol,
+		QueryGetFileRange(subdirid, originalID, 0, 10),
+		Err_DoesNotExistInDirectory);
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// A stream of block fingerprints, as the client sends them
+std::auto_ptr<IOStream> make_fingerprint_stream(
+	const std::vector<uint64_t> &rFingerprints)
+{
+	std::auto_ptr<CollectInBufferStream> stream(new CollectInBufferStream);
+	for(size_t i = 0; i < rFingerprints.size(); i++)
+	{
+		uint64_t fingerprint = box_hton64(rFingerprints[i]);
+		stream->Write(&fingerprint, sizeof(fingerprint));
+	}
+	stream->SetForReading();
+	return std::auto_ptr<IOStream>(stream.release());
+}
+
+// Ask the store which file contains each block
+std::vector<int64_t> find_block_fingerprints(BackupProtocolCallable &protocol,
+	const std::vector<uint64_t> &rFingerprints)
+{
+	std::auto_ptr<BackupProtocolSuccess> found(
+		protocol.QueryFindBlockFingerprints(
+			make_fingerprint_stream(rFingerprints)));
+	TEST_EQUAL(rFingerprints.size(), found->GetObjectID());
+	std::auto_ptr<IOStream> idStream(protocol.ReceiveStream());
+	Archive archive(*idStream, SHORT_TIMEOUT);
+	std::vector<int64_t> ids;
+	for(int64_t n = 0; n < found->GetObjectID(); n++)
+	{
+		int64_t id;
+		archive.Read(id);
+		ids.push_back(id);
+	}
+	return ids;
+}
+
+// Count how many of the blocks were found in the file
+int count_blocks_found_in(const std::vector<int64_t> &rFound, int64_t ObjectID)
+{
+	return std::count(rFound.begin(), rFound.end(), ObjectID);
+}
+
+bool test_block_fingerprints()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	BackupProtocolLocalWithContext protocol(0x01234567, "test",
+		"backup/01234567/", 0, false);
+	write_test_file(2); // TEST_FILE_FOR_PATCHING
+	write_file_for_patching();
+
+	// The encoder fingerprints the blocks as it goes, as reading the
+	// file again would
+	BackupStoreFilenameClear name("original");
+	int64_t modtime;
+	std::vector<uint64_t> fingerprints;
+	int64_t originalID;
+	{
+		std::auto_ptr<BackupStoreFileEncodeStream> encoded(
+			BackupStoreFile::EncodeFile(TEST_FILE_FOR_PATCHING,
+				BACKUPSTORE_ROOT_DIRECTORY_ID, name, &modtime));
+		encoded->CollectBlockFingerprints();
+		std::auto_ptr<CollectInBufferStream> data(
+			new CollectInBufferStream);
+		encoded->CopyStreamTo(*data);
+		data->SetForReading();
+		fingerprints = encoded->GetBlockFingerprints();
+
+		std::vector<uint64_t> expected;
+		BackupStoreFile::CalculateBlockFingerprints(
+			TEST_FILE_FOR_PATCHING, expected);
+		TEST_THAT(fingerprints == expected);
+		TEST_THAT_OR(fingerprints.size() > 1, return false);
+
+		std::auto_ptr<IOStream> upload(data.release());
+		originalID = protocol.QueryStoreFile(
+			BACKUPSTORE_ROOT_DIRECTORY_ID, modtime, modtime,
+			0 /* not a diff */, name, upload)->GetObjectID();
+		set_refcount(originalID, 1);
+	}
+
+	// Nothing is found until the client says which blocks the file has,
+	// and it can only say so for files which exist
+	TEST_EQUAL(0, count_blocks_found_in(
+		find_block_fingerprints(protocol, fingerprints), originalID));
+	TEST_COMMAND_RETURNS_ERROR(protocol,
+		QueryAddBlockFingerprints(originalID + 100,
+			make_fingerprint_stream(fingerprints)),
+		Err_DoesNotExist);
+	protocol.QueryAddBlockFingerprints(originalID,
+		make_fingerprint_stream(fingerprints));
+
+	std::vector<uint64_t> query(fingerprints);
+	query.push_back(0x0123456789abcdefULL); // not in any file
+	std::vector<int64_t> found = find_block_fingerprints(protocol, query);
+	TEST_EQUAL_OR(query.size(), found.size(), return false);
+	TEST_EQUAL(fingerprints.size(), count_blocks_found_in(found,
+		originalID));
+	TEST_EQUAL(0, found.back());
+
+	// A new file with another name can be diffed against it. It's stored
+	// complete, and the original is left alone.
+	BackupStoreFilenameClear copyName("copy");
+	int64_t copyID;
+	std::vector<uint64_t> copyFingerprints;
+	{
+		protocol.QueryGetBlockIndexByID(originalID);
+		std::auto_ptr<IOStream> blockIndex(protocol.ReceiveStream());
+		bool isCompletelyDifferent = true;
+		std::auto_ptr<BackupStoreFileEncodeStream> patch(
+			BackupStoreFile::EncodeFileDiff(
+				TEST_FILE_FOR_PATCHING ".mod",
+				BACKUPSTORE_ROOT_DIRECTORY_ID, copyName, originalID,
+				*blockIndex, SHORT_TIMEOUT, NULL /* DiffTimer */,
+				&modtime, &isCompletelyDifferent));
+		TEST_THAT(!isCompletelyDifferent);
+		patch->CollectBlockFingerprints();
+		std::auto_ptr<CollectInBufferStream> data(
+			new CollectInBufferStream);
+		patch->CopyStreamTo(*data);
+		data->SetForReading();
+		copyFingerprints = patch->GetBlockFingerprints();
+
+		std::auto_ptr<IOStream> upload(data.release());
+		copyID = protocol.QueryStoreFile(BACKUPSTORE_ROOT_DIRECTORY_ID,
+			modtime, modtime, originalID, copyName,
+			upload)->GetObjectID();
+		set_refcount(copyID, 1);
+	}
+	TEST_THAT(check_stored_as_patch(copyID, false));
+	TEST_THAT(check_stored_as_patch(originalID, false));
+	TEST_THAT(check_downloaded_file(protocol, copyID,
+		TEST_FILE_FOR_PATCHING ".mod"));
+	TEST_THAT(check_downloaded_file(protocol, originalID,
+		TEST_FILE_FOR_PATCHING));
+
+	// The blocks it shares with the original are now found in it, as the
+	// most recent file to have them, and the changed ones in the original
+	protocol.QueryAddBlockFingerprints(copyID,
+		make_fingerprint_stream(copyFingerprints));
+	found = find_block_fingerprints(protocol, fingerprints);
+	int inCopy = count_blocks_found_in(found, copyID);
+	int inOriginal = count_blocks_found_in(found, originalID);
+	TEST_THAT(inCopy > 0);
+	TEST_THAT(inOriginal > 0);
+	TEST_EQUAL(fingerprints.size(), inCopy + inOriginal);
+
+	// Housekeeping sorts the records, which are then found on disc by
+	// a new session
+	TEST_THAT(run_housekeeping_and_check_account(protocol));
+	protocol.QueryFinished();
+	protocol.Reopen();
+	TEST_THAT(find_block_fingerprints(protocol, fingerprints) == found);
+
+	// Records of files with no references are removed
+	protocol.QueryFinished();
+	{
+		std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+			BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+		const BackupStoreAccountDatabase::Entry &account(
+			apAccounts->GetEntry(0x1234567));
+		std::auto_ptr<BackupStoreRefCountDatabase> refs(
+			BackupStoreRefCountDatabase::Create(account));
+		refs->AddReference(copyID);
+		BackupStoreBlockDatabase::Prune(account, *refs,
+			true /* objects deleted */);
+		refs->Discard();
+	}
+	protocol.Reopen();
+	found = find_block_fingerprints(protocol, fingerprints);
+	TEST_EQUAL(inCopy, count_blocks_found_in(found, copyID));
+	TEST_EQUAL(0, count_blocks_found_in(found, originalID));
+	TEST_EQUAL(inOriginal, count_blocks_found_in(found, 0));
+
+	// Once the original is a patch from a newer version, it's not found,
+	// and new files can't be diffed against it
+	protocol.QueryAddBlockFingerprints(originalID,
+		make_fingerprint_stream(fingerprints));
+	TEST_EQUAL(fingerprints.size(), count_blocks_found_in(
+		find_block_fingerprints(protocol, fingerprints), originalID));
+	{
+		protocol.QueryGetBlockIndexByName(
+			BACKUPSTORE_ROOT_DIRECTORY_ID, name);
+		std::auto_ptr<IOStream> blockIndex(protocol.ReceiveStream());
+		std::auto_ptr<IOStream> patch(BackupStoreFile::EncodeFileDiff(
+			TEST_FILE_FOR_PATCHING ".mod",
+			BACKUPSTORE_ROOT_DIRECTORY_ID, name, originalID,
+			*blockIndex, SHORT_TIMEOUT, NULL /* DiffTimer */,
+			&modtime));
+		int64_t patchedID = protocol.QueryStoreFile(
+			BACKUPSTORE_ROOT_DIRECTORY_ID, modtime, modtime,
+			originalID, name, patch)->GetObjectID();
+		set_refcount(patchedID, 1);
+	}
+	TEST_THAT(check_stored_as_patch(originalID, true));
+	TEST_EQUAL(0, count_blocks_found_in(
+		find_block_fingerprints(protocol, fingerprints), originalID));
+	{
+		BackupStoreFilenameClear otherName("other");
+		std::auto_ptr<IOStream> upload(BackupStoreFile::EncodeFile(
+			TEST_FILE_FOR_PATCHING, BACKUPSTORE_ROOT_DIRECTORY_ID,
+			otherName, &modtime));
+		TEST_COMMAND_RETURNS_ERROR(protocol,
+			QueryStoreFile(BACKUPSTORE_ROOT_DIRECTORY_ID, modtime,
+				modtime, originalID, otherName, upload),
+			Err_DiffFromFileDoesNotExist);
+	}
+
+	protocol.QueryFinished();
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+// Read the change journal, returning the number of housekeeping runs since
+// the last full scan, or -1 if there's no journal
+int32_t read_change_journal(std::set<int64_t> &rChanged,
+	int32_t AccountID = 0x1234567)
+{
+	std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+		BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+	int32_t runs = -1;
+	if(!BackupStoreChangeJournal::Read(apAccounts->GetEntry(AccountID),
+		rChanged, runs))
+	{
+		return -1;
+	}
+	return runs;
+}
+
+void reset_change_journal(int32_t RunsSinceFullScan,
+	const std::set<int64_t> &rChanged = std::set<int64_t>())
+{
+	std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+		BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+	BackupStoreChangeJournal::Reset(apAccounts->GetEntry(0x1234567),
+		RunsSinceFullScan, rChanged);
+}
+
+bool test_housekeeping_change_journal()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	// The first run scans everything, and starts the journal
+	std::set<int64_t> changed;
+	TEST_EQUAL(-1, read_change_journal(changed));
+	TEST_THAT(run_housekeeping_and_check_account());
+	TEST_EQUAL(0, read_change_journal(changed));
+	TEST_EQUAL(0, changed.size());
+
+	// Sessions record the directories they change, which the next run
+	// scans alone, counting the runs since the full scan
+	int64_t subdirid;
+	{
+		BackupProtocolLocal2 protocol(0x01234567, "test",
+			"backup/01234567/", 0, false);
+		subdirid = create_directory(protocol);
+		protocol.QueryFinished();
+	}
+	TEST_EQUAL(0, read_change_journal(changed));
+	TEST_THAT(changed.find(BACKUPSTORE_ROOT_DIRECTORY_ID) != changed.end());
+	TEST_THAT(run_housekeeping_and_check_account());
+	changed.clear();
+	TEST_EQUAL(1, read_change_journal(changed));
+	TEST_EQUAL(0, changed.size());
+
+	// Until it's time to scan everything again
+	reset_change_journal(HOUSEKEEPING_RUNS_BETWEEN_FULL_SCANS - 1);
+	TEST_THAT(run_housekeeping_and_check_account());
+	TEST_EQUAL(HOUSEKEEPING_RUNS_BETWEEN_FULL_SCANS,
+		read_change_journal(changed));
+	TEST_THAT(run_housekeeping_and_check_account());
+	TEST_EQUAL(0, read_change_journal(changed));
+
+	// A journal which disagrees with the reference counts isn't trusted:
+	// the whole account is scanned, and the counts rebuilt
+	{
+		std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+			BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+		std::auto_ptr<BackupStoreRefCountDatabase> refs(
+			BackupStoreRefCountDatabase::Load(
+				apAccounts->GetEntry(0x1234567),
+				false /* ReadOnly */));
+		refs->RemoveReference(subdirid);
+	}
+	std::set<int64_t> root;
+	root.insert(BACKUPSTORE_ROOT_DIRECTORY_ID);
+	reset_change_journal(5, root);
+	{
+		std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+			BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+		BackupStoreAccountDatabase::Entry account =
+			apAccounts->GetEntry(0x1234567);
+		// The missing reference is an error, which it fixes
+		TEST_EQUAL(1, run_housekeeping(account));
+	}
+	TEST_EQUAL(0, read_change_journal(changed));
+	TEST_THAT(check_reference_counts());
+
+	// So is one which lists an object that was never allocated
+	root.insert(1000000);
+	reset_change_journal(5, root);
+	TEST_THAT(run_housekeeping_and_check_account());
+	TEST_EQUAL(0, read_change_journal(changed));
+
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+//! Fills the account with enough objects to give several reader threads
+//! something to do, then removes the last file uploaded and adds a spurious
+//! one, returning the ID of the file removed.
+int64_t create_store_with_errors()
+{
+	int64_t missing_file_id = 0;
+	{
+		BackupProtocolLocal2 protocol(0x01234567, "test",
+			"backup/01234567/", 0, false);
+		int64_t subdirid = create_directory(protocol);
+		for(int i = 0; i < 20; i++)
+		{
+			std::ostringstream name;
+			name << "file" << i;
+			missing_file_id = create_file(protocol, subdirid,
+				name.str());
+		}
+		protocol.QueryFinished();
+	}
+
+	std::string fn;
+	StoreStructure::MakeObjectFilename(missing_file_id, "backup/01234567/",
+		0, fn, false);
+	RaidFileWrite del(0, fn);
+	del.Delete();
+	set_refcount(missing_file_id, 0);
+
+	RaidFileWrite random(0, "backup/01234567/randomfile");
+	random.Open();
+	random.Write("test", 4);
+	random.Commit(true);
+
+	return missing_file_id;
+}
+
+bool test_check_reads_objects_on_several_threads()
+{
+	SETUP_TEST_BACKUPSTORE();
+	create_store_with_errors();
+
+	// Reading the objects on several threads finds the same errors
+	BackupStoreCheck serial("backup/01234567/", 0, 0x01234567,
+		false /* don't fix */, true /* quiet */);
+	serial.Check();
+	TEST_THAT(serial.GetNumErrorsFound() > 0);
+	{
+		BackupStoreCheck threaded("backup/01234567/", 0, 0x01234567,
+			false /* don't fix */, true /* quiet */, 4 /* threads */);
+		threaded.Check();
+		TEST_EQUAL(serial.GetNumErrorsFound(),
+			threaded.GetNumErrorsFound());
+	}
+
+	// and fixes them, leaving nothing for the next check to find
+	{
+		std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+			BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+		BackupStoreAccounts acc(*apAccounts);
+		NamedLock lock;
+		acc.LockAccount(0x1234567, lock);
+		BackupStoreCheck threaded("backup/01234567/", 0, 0x01234567,
+			true /* fix */, true /* quiet */, 4 /* threads */);
+		threaded.Check();
+		TEST_EQUAL(serial.GetNumErrorsFound(),
+			threaded.GetNumErrorsFound());
+	}
+	TEST_EQUAL(0, check_account_for_errors());
+
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+bool test_check_index_in_files()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	// An index kept in mapped files holds the same as one in memory,
+	// including after growing past its first size, and values which
+	// don't fit in a slot
+	{
+		BackupStoreCheckIndex inMemory, inFiles;
+		inMemory.Allocate(100);
+		inFiles.Allocate(100, "testfiles");
+		TEST_THAT(!inMemory.IsInFiles());
+		TEST_THAT(inFiles.IsInFiles());
+
+		BackupStoreCheck_ID_t ids[] = {1, 2, 3, 99, 100, 5000, 5001};
+		BackupStoreCheck_ID_t containers[] = {0, 1, 1, 2, 0x100000000LL,
+			2, 5000};
+		BackupStoreCheck_Size_t sizes[] = {1, 2, 0x100000000LL, 4, 5,
+			6, 7};
+		for(size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+		{
+			inMemory.Add(ids[i], containers[i], sizes[i], i & 7);
+			inFiles.Add(ids[i], containers[i], sizes[i], i & 7);
+		}
+		TEST_EQUAL(inMemory.GetMaxID(), inFiles.GetMaxID());
+
+		for(BackupStoreCheck_ID_t id = 1; id <= inFiles.GetMaxID(); id++)
+		{
+			TEST_EQUAL_OR(inMemory.Contains(id), inFiles.Contains(id),
+				break);
+			if(!inFiles.Contains(id))
+			{
+				continue;
+			}
+			TEST_EQUAL(inMemory.GetFlags(id), inFiles.GetFlags(id));
+			TEST_EQUAL(inMemory.GetContainer(id),
+				inFiles.GetContainer(id));
+			TEST_EQUAL(inMemory.GetSizeInBlocks(id),
+				inFiles.GetSizeInBlocks(id));
+			TEST_EQUAL(inMemory.GetNextID(id), inFiles.GetNextID(id));
+		}
+		TEST_EQUAL(0x100000000LL, inFiles.GetContainer(100));
+		TEST_EQUAL(0x100000000LL, inFiles.GetSizeInBlocks(3));
+		TEST_EQUAL(5000, inFiles.GetNextID(100));
+	}
+
+	// A check which keeps its index in files finds and fixes the same
+	// errors as one which keeps it in memory
+	create_store_with_errors();
+	BackupStoreCheck serial("backup/01234567/", 0, 0x01234567,
+		false /* don't fix */, true /* quiet */);
+	serial.Check();
+	TEST_THAT(serial.GetNumErrorsFound() > 0);
+	{
+		std::auto_ptr<BackupStoreAccountDatabase> apAccounts(
+			BackupStoreAccountDatabase::Read("testfiles/accounts.txt"));
+		BackupStoreAccounts acc(*apAccounts);
+		NamedLock lock;
+		acc.LockAccount(0x1234567, lock);
+		BackupStoreCheck inFiles("backup/01234567/", 0, 0x01234567,
+			true /* fix */, true /* quiet */, 0 /* threads */,
+			"testfiles");
+		inFiles.Check();
+		TEST_EQUAL(serial.GetNumErrorsFound(),
+			inFiles.GetNumErrorsFound());
+	}
+	TEST_EQUAL(0, check_account_for_errors());
+
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
+bool test_housekeeping_workers()
+{
+	SETUP_TEST_BACKUPSTORE();
+
+	std::string errs;
+	std::auto_ptr<Configuration> config(
+		Configuration::Load("testfiles/bbstored.conf", errs));
+	TEST_EQUAL_LINE(0, errs.size(), "Loading configuration file "
+		"reported errors: " << errs);
+	TEST_THAT_OR(config.get(), FAIL);
+	config->AddKeyValue("HousekeepingWorkers", "3");
+
+	// More accounts than workers, none of which has been housekept yet
+	int32_t accounts[] = {0x01234567, 0x01234568, 0x01234569,
+		0x0123456a, 0x0123456b};
+	const int num_accounts = sizeof(accounts) / sizeof(accounts[0]);
+	{
+		std::auto_ptr<Configuration> verified(
+			Configuration::LoadAndVerify("testfiles/bbstored.conf",
+				&BackupConfigFileVerify, errs));
+		BackupStoreAccountsControl control(*verified);
+		Logger::LevelGuard guard(Logging::GetConsole(), Log::WARNING);
+		for(int i = 1; i < num_accounts; i++)
+		{
+			TEST_EQUAL(0, control.CreateAccount(accounts[i],
+				0 /* Options */, 0 /* DiscNumber */, 10000, 20000,
+				0 /* VersionsLimit */));
+		}
+	}
+
+	for(int i = 0; i < num_accounts; i++)
+	{
+		std::set<int64_t> changed;
+		TEST_EQUAL(-1, read_change_journal(changed, accounts[i]));
+	}
+
+	// Give the first account some work to do
+	{
+		BackupProtocolLocal2 protocol(0x01234567, "test",
+			"backup/01234567/", 0, false);
+		create_file(protocol, create_directory(protocol), "file");
+		protocol.QueryFinished();
+	}
+
+	// Housekeep them all on several worker processes
+	{
+		BackupStoreDaemon daemon;
+		TEST_THAT_OR(daemon.Configure(*config), FAIL);
+		daemon.RunHousekeepingIfNeeded();
+	}
+
+	// Every account has been scanned in full, starting its journal, and
+	// is left without errors
+	std::auto_ptr<Configuration> verified(
+		Configuration::LoadAndVerify("testfiles/bbstored.conf",
+			&BackupConfigFileVerify, errs));
+	BackupStoreAccountsControl control(*verified);
+	for(int i = 0; i < num_accounts; i++)
+	{
+		std::set<int64_t> changed;
+		TEST_EQUAL_LINE(0, read_change_journal(changed, accounts[i]),
+			"account " << BOX_FORMAT_ACCOUNT(accounts[i]));
+		TEST_EQUAL_LINE(0, control.CheckAccount(accounts[i],
+			true, // FixErrors
+			false, // Quiet
+			true), // ReturnNumErrorsFound
+			"account " << BOX_FORMAT_ACCOUNT(accounts[i]));
+	}
+
+	TEARDOWN_TEST_BACKUPSTORE();
+}
+
 bool test_cannot_open_multiple_writable_connections()
 {
 	SETUP_TEST_BACKUPSTORE();
@@ -2570,7 +3893,7 @@ bool test_login_without_account()
 		TEST_THAT(serverVersion->GetVersion() == BACKUP_STORE_SERVER_VERSION);
 
 		// Login
-		TEST_COMMAND_RETURNS_ERROR(protocol, QueryLogin(0x01234567, 0),
+		TEST_COMMAND_RETURNS_ERROR(protocol, QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION),
 			Err_BadLogin);
 
 		// Finish the connection
@@ -2645,7 +3968,7 @@ bool test_login_with_disabled_account()
 		TEST_THAT(serverVersion->GetVersion() == BACKUP_STORE_SERVER_VERSION);
 
 		// Login
-		TEST_COMMAND_RETURNS_ERROR(protocol, QueryLogin(0x01234567, 0),
+		TEST_COMMAND_RETURNS_ERROR(protocol, QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION),
 			Err_DisabledAccount);
 
 		// Finish the connection
@@ -2726,7 +4049,7 @@ bool test_housekeeping_deletes_files()
 		NULL /* pRefCount */);
 
 	TEST_EQUAL(dirtodelete,
-		protocolLocal.QueryDeleteDirectory(dirtodelete, false)->GetObjectID());
+		protocolLocal.QueryDeleteDirectory(dirtodelete, 0, false)->GetObjectID());
 	assert_everything_deleted(protocolLocal, dirtodelete);
 	protocolLocal.QueryFinished();
 
@@ -3126,6 +4449,7 @@ bool test_read_old_backupstoreinfo_files()
 	extra_data.Seek(0, IOStream::SeekType_Absolute);
 	apInfo = BackupStoreInfo::CreateForRegeneration(
 		apInfo->GetAccountID(), "spurtle" /* rAccountName */,
+		apInfo->GetOptions(),
 		"backup/01234567/" /* rRootDir */, 0 /* DiscSet */,
 		apInfo->GetLastObjectIDUsed(),
 		apInfo->GetBlocksUsed(),
@@ -3135,6 +4459,7 @@ bool test_read_old_backupstoreinfo_files()
 		apInfo->GetBlocksInDirectories(),
 		apInfo->GetBlocksSoftLimit(),
 		apInfo->GetBlocksHardLimit(),
+		apInfo->GetVersionCountLimit(),
 		false /* AccountEnabled */,
 		extra_data);
 	// CreateForRegeneration always sets the ClientStoreMarker to 0
@@ -3292,10 +4617,22 @@ int test(int argc, const char *argv[])
 
 	TEST_THAT(test_filename_encoding());
 	TEST_THAT(test_temporary_refcount_db_is_independent());
+	TEST_THAT(test_refcount_db_in_memory_matches_file());
 	TEST_THAT(test_bbstoreaccounts_create());
 	TEST_THAT(test_bbstoreaccounts_delete());
 	TEST_THAT(test_backupstore_directory());
+	TEST_THAT(test_directory_lazy_entries());
 	TEST_THAT(test_directory_parent_entry_tracks_directory_size());
+	TEST_THAT(test_directory_cache_evicts_least_recently_used());
+	TEST_THAT(test_list_directory_tree());
+	TEST_THAT(test_store_files_batch());
+	TEST_THAT(test_deferred_reverse_diffs());
+	TEST_THAT(test_get_file_range());
+	TEST_THAT(test_block_fingerprints());
+	TEST_THAT(test_housekeeping_change_journal());
+	TEST_THAT(test_check_reads_objects_on_several_threads());
+	TEST_THAT(test_check_index_in_files());
+	TEST_THAT(test_housekeeping_workers());
 	TEST_THAT(test_cannot_open_multiple_writable_connections());
 	TEST_THAT(test_encoding());
 	TEST_THAT(test_symlinks());
@@ -210,7 +210,7 @@ void test_dir_fixing()
 	// Test that entries pointing to nonexistent entries are removed
 	{
 		BackupStoreDirectory dir;
-		BackupStoreDirectory::Entry* e = dir.AddEntry(fnames[0], 12,
+		BackupStoreDirectory::Entry* e = dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */,
 			2 /* id */, 1, BackupStoreDirectory::Entry::Flags_File |
 			BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 		e->SetDependsNewer(3);
@@ -229,17 +229,18 @@ void test_dir_fixing()
 		BackupStoreDirectory dir;
 		/*
 		Entry *AddEntry(const BackupStoreFilename &rName,
-			box_time_t ModificationTime, int64_t ObjectID,
+			box_time_t ModificationTime, box_time_t BackupTime,
+			box_time_t DeleteTime, int64_t ObjectID,
 			int64_t SizeInBlocks, int16_t Flags,
 			uint64_t AttributesHash);
 		*/
-		dir.AddEntry(fnames[0], 12, 2 /* id */, 1, 
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 2 /* id */, 1, 
 			BackupStoreDirectory::Entry::Flags_File, 2);
-		dir.AddEntry(fnames[1], 12, 2 /* id */, 1,
+		dir.AddEntry(fnames[1], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 2 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File, 2);
-		dir.AddEntry(fnames[0], 12, 3 /* id */, 1,
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 3 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File, 2);
-		dir.AddEntry(fnames[0], 12, 5 /* id */, 1,
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 5 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File | 
 			BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 
@@ -266,10 +267,10 @@ void test_dir_fixing()
 
 	{
 		BackupStoreDirectory dir;
-		dir.AddEntry(fnames[0], 12, 2 /* id */, 1, BackupStoreDirectory::Entry::Flags_File, 2);
-		dir.AddEntry(fnames[1], 12, 10 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_Dir | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
-		dir.AddEntry(fnames[0], 12, 3 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
-		dir.AddEntry(fnames[0], 12, 5 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 2 /* id */, 1, BackupStoreDirectory::Entry::Flags_File, 2);
+		dir.AddEntry(fnames[1], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 10 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_Dir | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 3 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 5 /* id */, 1, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 
 		dir_en_check ck[] = {
 			{0, 2, BackupStoreDirectory::Entry::Flags_File | BackupStoreDirectory::Entry::Flags_OldVersion},
@@ -287,25 +288,25 @@ void test_dir_fixing()
 	// Test dependency fixing
 	{
 		BackupStoreDirectory dir;
-		BackupStoreDirectory::Entry *e2 = dir.AddEntry(fnames[0], 12,
+		BackupStoreDirectory::Entry *e2 = dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */,
 			2 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File |
 			BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 		TEST_THAT(e2 != 0);
 		e2->SetDependsNewer(3);
-		BackupStoreDirectory::Entry *e3 = dir.AddEntry(fnames[0], 12,
+		BackupStoreDirectory::Entry *e3 = dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */,
 			3 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File |
 			BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 		TEST_THAT(e3 != 0);
 		e3->SetDependsNewer(4); e3->SetDependsOlder(2);
-		BackupStoreDirectory::Entry *e4 = dir.AddEntry(fnames[0], 12,
+		BackupStoreDirectory::Entry *e4 = dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */,
 			4 /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File |
 			BackupStoreDirectory::Entry::Flags_OldVersion, 2);
 		TEST_THAT(e4 != 0);
 		e4->SetDependsNewer(5); e4->SetDependsOlder(3);
-		BackupStoreDirectory::Entry *e5 = dir.AddEntry(fnames[0], 12,
+		BackupStoreDirectory::Entry *e5 = dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */,
 			5 /* id */, 1, BackupStoreDirectory::Entry::Flags_File, 2);
 		TEST_THAT(e5 != 0);
 		e5->SetDependsOlder(4);
@@ -629,7 +630,7 @@ int test(int argc, const char *argv[])
 		BackupStoreDirectory dir;
 		read_bb_dir(1 /* root */, dir);
 
-		dir.AddEntry(fnames[0], 12, 0x1234567890123456LL /* id */, 1,
+		dir.AddEntry(fnames[0], 12, 0 /* BackupTime */, 0 /* DeleteTime */, 0x1234567890123456LL /* id */, 1,
 			BackupStoreDirectory::Entry::Flags_File, 2);
 
 		std::string fn;
@@ -702,11 +703,33 @@ int test(int argc, const char *argv[])
 		random.Commit(true);
 	}
 
+	// Reading the objects on several threads finds the same errors
+	{
+		BackupStoreCheck serial(accountRootDir, discSetNum, 0x01234567,
+			false /* don't fix */, true /* quiet */);
+		serial.Check();
+		BackupStoreCheck threaded(accountRootDir, discSetNum,
+			0x01234567, false /* don't fix */, true /* quiet */,
+			4 /* threads */);
+		threaded.Check();
+		TEST_THAT(serial.GetNumErrorsFound() > 0);
+		TEST_EQUAL(serial.GetNumErrorsFound(),
+			threaded.GetNumErrorsFound());
+
+		// and so does keeping the index of objects in files
+		BackupStoreCheck inFiles(accountRootDir, discSetNum,
+			0x01234567, false /* don't fix */, true /* quiet */,
+			0 /* threads */, "testfiles");
+		inFiles.Check();
+		TEST_EQUAL(serial.GetNumErrorsFound(),
+			inFiles.GetNumErrorsFound());
+	}
+
 	// Fix it
 	RUN_CHECK
 
 	// Check everything is as it was
-	TEST_THAT(::system(PERL_EXECUTABLE 
+	TEST_THAT(::system(PERL_EXECUTABLE
 		" testfiles/testbackupstorefix.pl check 0") == 0);
 	// Check the random file doesn't exist
 	{
@@ -7,6 +7,7 @@
 
 #include "autogen_TestProtocol.h"
 #include "CollectInBufferStream.h"
+#include "FileStream.h"
 
 #include "MemLeakFindOn.h"
 
@@ -106,3 +107,24 @@ std::auto_ptr<TestProtocolMessage> TestProtocolString::DoCommand(TestProtocolRep
 	return std::auto_ptr<TestProtocolMessage>(new TestProtocolString(mTest));
 }
 
+class CopyingFileStream : public FileStream
+{
+public:
+	CopyingFileStream(const std::string &rFilename)
+	: FileStream(rFilename)
+	{ }
+	// make the file stream hide its handle, so that it has to be copied
+	int GetSendFileHandle()
+	{
+		return -1;
+	}
+};
+
+std::auto_ptr<TestProtocolMessage> TestProtocolGetFile::DoCommand(TestProtocolReplyable &rProtocol, TestContext &rContext) const
+{
+	std::auto_ptr<IOStream> apStream(mAllowSendFile ?
+		new FileStream(mFilename) : new CopyingFileStream(mFilename));
+	rProtocol.SendStreamAfterCommand(apStream);
+
+	return std::auto_ptr<TestProtocolMessage>(new TestProtocolGetFile(mFilename, mAllowSendFile));
+}
@@ -15,9 +15,11 @@
 
 #include <typeinfo>
 
+#include "BoxTime.h"
 #include "CollectInBufferStream.h"
 #include "Configuration.h"
 #include "Daemon.h"
+#include "FileStream.h"
 #include "IOStreamGetLine.h"
 #include "ServerControl.h"
 #include "ServerStream.h"
@@ -453,6 +455,71 @@ void TestStreamReceive(TestProtocolClient &protocol, int value, bool uncertainst
 	TEST_THAT(count == (24273*3));	// over 64 k of data, definately
 }
 
+// Fetch a large file from the protocol server over loopback, sent directly
+// with sendfile() where possible and then copied, check that it arrives
+// intact both ways, and report how fast.
+void TestFileSend()
+{
+	const int blockSize = 64*1024;
+	const int numBlocks = 512;
+	{
+		FileStream file("testfiles/sendfile.dat",
+			O_WRONLY | O_CREAT | O_TRUNC | O_BINARY);
+		uint8_t block[blockSize];
+		for(int b = 0; b < numBlocks; ++b)
+		{
+			for(int i = 0; i < blockSize; ++i)
+			{
+				block[i] = (uint8_t)(b + i * 7);
+			}
+			file.Write(block, blockSize);
+		}
+	}
+
+	std::auto_ptr<SocketStream> apConn(new SocketStream);
+	apConn->Open(Socket::TypeINET, "localhost", SERVER_LISTEN_PORT);
+	TestProtocolClient protocol(apConn);
+
+	for(int allow = 1; allow >= 0; --allow)
+	{
+		box_time_t start = GetCurrentBoxTime();
+		std::auto_ptr<TestProtocolGetFile> reply(protocol.QueryGetFile(
+			"testfiles/sendfile.dat", allow != 0));
+		std::auto_ptr<IOStream> stream(protocol.ReceiveStream());
+		TEST_EQUAL((IOStream::pos_type)blockSize * numBlocks,
+			stream->BytesLeftToRead());
+
+		uint8_t block[blockSize];
+		int wrongBytes = 0;
+		for(int b = 0; b < numBlocks; ++b)
+		{
+			if(!stream->ReadFullBuffer(block, blockSize, 0,
+				SHORT_TIMEOUT))
+			{
+				TEST_FAIL_WITH_MESSAGE("File stream ended early");
+				break;
+			}
+			for(int i = 0; i < blockSize; ++i)
+			{
+				if(block[i] != (uint8_t)(b + i * 7)) wrongBytes++;
+			}
+		}
+		TEST_EQUAL(0, wrongBytes);
+		TEST_THAT(!stream->StreamDataLeft());
+
+		box_time_t elapsed = GetCurrentBoxTime() - start;
+		int64_t megabytes = ((int64_t)blockSize * numBlocks) >> 20;
+		BOX_NOTICE("Received " << megabytes << " MB file " <<
+			(allow ? "sent directly" : "copied") <<
+			" over loopback in " << BOX_FORMAT_MICROSECONDS(elapsed) <<
+			": " << (megabytes * 1000000 / (elapsed ? elapsed : 1)) <<
+			" MB/s");
+	}
+
+	protocol.QueryQuit();
+	TEST_THAT(EMU_UNLINK("testfiles/sendfile.dat") == 0);
+}
+
 bool test_security_level(int cert_level, int test_level, bool expect_failure_on_connect = false)
 {
 	int old_num_failures = num_failures;
@@ -938,6 +1005,65 @@ int test(int argc, const char *argv[])
 				std::auto_ptr<TestProtocolSimpleReply> reply(protocol.QuerySimple(q));
 				TEST_THAT(reply->GetValuePlusOne() == (q+1));
 			}
+
+			// Pipelined queries: replies must be collected in the
+			// order that the commands were sent, even when a
+			// synchronous query is made while some are in flight.
+			TEST_CHECK_THROWS(protocol.CollectReply(),
+				ConnectionException, Protocol_NoReplyToCollect);
+			protocol.SetMaxCommandsInFlight(16);
+			TEST_EQUAL(16, protocol.GetMaxCommandsInFlight());
+			for(int q = 0; q < 100; q++)
+			{
+				protocol.SendAsyncSimple(q);
+				if(q == 50)
+				{
+					std::auto_ptr<TestProtocolSimpleReply> reply(
+						protocol.QuerySimple(1000));
+					TEST_EQUAL(1001, reply->GetValuePlusOne());
+				}
+			}
+			TEST_EQUAL(100, protocol.GetNumRepliesToCollect());
+			for(int q = 0; q < 100; q++)
+			{
+				std::auto_ptr<TestProtocolMessage> reply(
+					protocol.CollectReply());
+				TEST_EQUAL(TestProtocolSimpleReply::TypeID,
+					reply->GetType());
+				TEST_EQUAL(q + 1, ((TestProtocolSimpleReply *)
+					reply.get())->GetValuePlusOne());
+			}
+			TEST_EQUAL(0, protocol.GetNumRepliesToCollect());
+
+			// Commands with streams can be pipelined too, and an
+			// error reply is reported when it's collected.
+			for(int q = 0; q < 3; q++)
+			{
+				std::auto_ptr<CollectInBufferStream>
+					s(new CollectInBufferStream());
+				char buf[1000];
+				s->Write(buf, 100 * (q + 1));
+				s->SetForReading();
+				protocol.SendAsyncSendStream(
+					(q == 1) ? 1 : 0x73654353298ffLL,
+					(std::auto_ptr<IOStream>)s);
+			}
+			{
+				std::auto_ptr<TestProtocolMessage> reply(
+					protocol.CollectReply());
+				TEST_EQUAL(100, ((TestProtocolGetStream *)
+					reply.get())->GetStartingValue());
+			}
+			TEST_CHECK_THROWS(protocol.CollectReply(),
+				ConnectionException, Protocol_UnexpectedReply);
+			{
+				std::auto_ptr<TestProtocolMessage> reply(
+					protocol.CollectReply());
+				TEST_EQUAL(300, ((TestProtocolGetStream *)
+					reply.get())->GetStartingValue());
+			}
+			protocol.SetMaxCommandsInFlight(1);
+
 			// Send a list of strings to it
 			{
 				std::vector<std::string> strings;
@@ -959,6 +1085,10 @@ int test(int argc, const char *argv[])
 		
 			// Quit query to finish
 			protocol.QueryQuit();
+
+			// Fetch a file over loopback, which the server sends
+			// without copying where it can
+			TestFileSend();
 		
 			// Kill it
 			TEST_THAT(KillServer(pid));
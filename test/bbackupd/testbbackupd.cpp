@@ -52,6 +52,8 @@
 
 #include "BackupClientCryptoKeys.h"
 #include "BackupClientContext.h"
+#include "BackupClientDirectoryRecord.h"
+#include "BackupClientDirectoryScanner.h"
 #include "BackupClientFileAttributes.h"
 #include "BackupClientInodeToIDMap.h"
 #include "BackupClientRestore.h"
@@ -67,6 +69,7 @@
 #include "BackupStoreException.h"
 #include "BackupStoreConfigVerify.h"
 #include "BackupStoreFileEncodeStream.h"
+#include "BackupStoreFilenameClear.h"
 #include "BoxPortsAndFiles.h"
 #include "BoxTime.h"
 #include "BoxTimeToUnix.h"
@@ -359,6 +362,7 @@ bool unpack_files(const std::string& archive_file,
 }
 
 Daemon* spDaemon = NULL;
+RestoreInfos sRestoreInfos;
 
 bool configure_bbackupd(BackupDaemon& bbackupd, const std::string& config_file)
 {
@@ -618,7 +622,7 @@ int64_t GetDirID(BackupProtocolCallable &protocol, const char *name, int64_t InD
 			InDirectory,
 			BackupProtocolListDirectory::Flags_Dir,
 			BackupProtocolListDirectory::Flags_EXCLUDE_NOTHING,
-			true /* want attributes */);
+			true /* want attributes */, 0);
 	
 	// Retrieve the directory from the stream following
 	BackupStoreDirectory dir;
@@ -662,17 +666,20 @@ void do_interrupted_restore(const TLSContext &context, int64_t restoredirid)
 			protocol.QueryVersion(BACKUP_STORE_SERVER_VERSION);
 			std::auto_ptr<BackupProtocolLoginConfirmed>
 				loginConf(protocol.QueryLogin(0x01234567,
-					BackupProtocolLogin::Flags_ReadOnly));
+					BackupProtocolLogin::Flags_ReadOnly, PROTOCOL_CURRENT_VERSION));
 			
 			// Test the restoration
 			TEST_THAT(BackupClientRestore(protocol, restoredirid,
 				"testfiles/restore-interrupt", /* remote */
 				"testfiles/restore-interrupt", /* local */
+				0 /* SnapshotTime */,
 				true /* print progress dots */,
 				false /* restore deleted */,
+				false /* restore any */,
 				false /* undelete after */,
 				false /* resume */,
-				false /* keep going */) == Restore_Complete);
+				false /* keep going */,
+				sRestoreInfos) == Restore_Complete);
 
 			// Log out
 			protocol.QueryFinished();
@@ -761,7 +768,7 @@ std::auto_ptr<BackupStoreDirectory> ReadDirectory
 )
 {
 	std::auto_ptr<BackupProtocolSuccess> dirreply(
-		rClient.QueryListDirectory(id, false, 0, false));
+		rClient.QueryListDirectory(id, false, 0, false, 0));
 	std::auto_ptr<BackupStoreDirectory> apDir(
 		new BackupStoreDirectory(rClient.ReceiveStream(), SHORT_TIMEOUT));
 	return apDir;
@@ -1108,13 +1115,15 @@ public:
 		bool ExtendedLogToFile,
 		std::string ExtendedLogFile,
 		ProgressNotifier &rProgressNotifier,
+		SyncResumeInfo &rSyncResumeInfo,
 		bool TcpNiceMode,
 		BackupProtocolCallable& rClient
 	)
 	: BackupClientContext(rResolver, rTLSContext,
 		rHostname, Port, AccountNumber, ExtendedLogging,
 		ExtendedLogToFile, ExtendedLogFile,
-		rProgressNotifier, TcpNiceMode),
+		rProgressNotifier, rSyncResumeInfo, TcpNiceMode,
+		PROTOCOL_DEFAULT_TIMEOUT),
 	  mrClient(rClient),
 	  mNumKeepAlivesPolled(0),
 	  mKeepAliveTime(-1)
@@ -1122,6 +1131,8 @@ public:
 
 	BackupProtocolCallable &GetConnection()
 	{
+		// The local protocol supports everything that the store does
+		SetServerVersion(BACKUP_STORE_SERVER_VERSION_FILE_RANGES);
 		return mrClient;
 	}
 
@@ -1163,7 +1174,9 @@ public:
 		bool ExtendedLogToFile,
 		std::string ExtendedLogFile,
 		ProgressNotifier &rProgressNotifier,
-		bool TcpNiceMode
+		SyncResumeInfo &rSyncResumeInfo,
+		bool TcpNiceMode,
+		int ProtocolTimeout
 	)
 	{
 		std::auto_ptr<BackupClientContext> context(
@@ -1171,7 +1184,8 @@ public:
 				rTLSContext, rHostname, Port,
 				AccountNumber, ExtendedLogging,
 				ExtendedLogToFile, ExtendedLogFile,
-				rProgressNotifier, TcpNiceMode, mrClient));
+				rProgressNotifier, rSyncResumeInfo,
+				TcpNiceMode, mrClient));
 		return context;
 	}
 };
@@ -1239,6 +1253,68 @@ bool test_bbackupquery_parser_escape_slashes()
 	TEARDOWN_TEST_BBACKUPD();
 }
 
+bool test_server_version_negotiation()
+{
+	SETUP_TEST_BBACKUPD();
+
+	// A version that no server knows, so it must reply Err_WrongVersion
+	// and the client must carry on with the next one it wants.
+	const int32_t unknown_version = 0x7fff;
+
+	{
+		BackupStoreContext bsContext(0x01234567,
+			(HousekeepingInterface *)NULL, "test");
+		bsContext.SetClientHasAccount("backup/01234567/", 0);
+		BackupProtocolLocal connection(bsContext);
+
+		std::vector<int32_t> versions;
+		versions.push_back(BACKUP_STORE_SERVER_VERSION_PIPELINING);
+		TEST_EQUAL(BACKUP_STORE_SERVER_VERSION_PIPELINING,
+			BackupClientContext::NegotiateServerVersion(connection,
+				versions));
+
+		// The server has moved on to the login phase
+		connection.QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION);
+		connection.QueryFinished();
+	}
+
+	{
+		BackupStoreContext bsContext(0x01234567,
+			(HousekeepingInterface *)NULL, "test");
+		bsContext.SetClientHasAccount("backup/01234567/", 0);
+		BackupProtocolLocal connection(bsContext);
+
+		std::vector<int32_t> versions;
+		versions.push_back(unknown_version);
+		versions.push_back(BACKUP_STORE_SERVER_VERSION_PIPELINING);
+		TEST_EQUAL(BACKUP_STORE_SERVER_VERSION_PIPELINING,
+			BackupClientContext::NegotiateServerVersion(connection,
+				versions));
+		connection.QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION);
+		connection.QueryFinished();
+	}
+
+	{
+		BackupStoreContext bsContext(0x01234567,
+			(HousekeepingInterface *)NULL, "test");
+		bsContext.SetClientHasAccount("backup/01234567/", 0);
+		BackupProtocolLocal connection(bsContext);
+
+		// Nothing we asked for is supported, so we fall back to the
+		// basic version.
+		std::vector<int32_t> versions;
+		versions.push_back(unknown_version);
+		versions.push_back(unknown_version + 1);
+		TEST_EQUAL(BACKUP_STORE_SERVER_VERSION,
+			BackupClientContext::NegotiateServerVersion(connection,
+				versions));
+		connection.QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION);
+		connection.QueryFinished();
+	}
+
+	TEARDOWN_TEST_BBACKUPD();
+}
+
 bool test_getobject_on_nonexistent_file()
 {
 	SETUP_WITH_BBSTORED();
@@ -1333,8 +1409,9 @@ bool test_backup_disappearing_directory()
 			const Location& rBackupLocation,
 			BackupStoreDirectory *pDirOnStore,
 			std::vector<BackupStoreDirectory::Entry *> &rEntriesLeftOver,
-			std::vector<std::string> &rFiles,
-			const std::vector<std::string> &rDirs)
+			std::set<std::string> &rFiles,
+			const std::set<std::string> &rDirs,
+			BackupClientDirectoryScanner::Directory &rScanned)
 		{
 			if(!mDeletedOnce)
 			{
@@ -1344,10 +1421,12 @@ bool test_backup_disappearing_directory()
 
 			return BackupClientDirectoryRecord::UpdateItems(rParams,
 				rLocalPath, rRemotePath, rBackupLocation,
-				pDirOnStore, rEntriesLeftOver, rFiles, rDirs);
+				pDirOnStore, rEntriesLeftOver, rFiles, rDirs,
+				rScanned);
 		}
 	};
 
+	SyncResumeInfo resumeInfo("testfiles/resume.dat");
 	BackupClientContext clientContext
 	(
 		bbackupd, // rLocationResolver
@@ -1359,7 +1438,9 @@ bool test_backup_disappearing_directory()
 		false, // ExtendedLogFile
 		"", // extendedLogFile
 		bbackupd, // rProgressNotifier
-		false // TcpNice
+		resumeInfo, // rSyncResumeInfo
+		false, // TcpNice
+		PROTOCOL_DEFAULT_TIMEOUT
 	);
 
 	BackupClientInodeToIDMap oldMap, newMap;
@@ -1469,6 +1550,7 @@ bool test_ssl_keepalives()
 	// Test that sending a keepalive actually works, when the timeout has expired,
 	// but doesn't send anything at the beginning:
 	{
+		SyncResumeInfo resumeInfo("testfiles/resume.dat");
 		MockClientContext context(
 			bbackupd, // rResolver
 			sTlsContext, // rTLSContext
@@ -1479,6 +1561,7 @@ bool test_ssl_keepalives()
 			false, // ExtendedLogToFile
 			"", // ExtendedLogFile
 			bbackupd, // rProgressNotifier
+			resumeInfo, // rSyncResumeInfo
 			false, // TcpNiceMode
 			connection); // rClient
 		
@@ -3262,6 +3345,281 @@ bool test_excluded_files_are_not_backed_up()
 	TEARDOWN_TEST_BBACKUPD();
 }
 
+// Counts the ways that files are uploaded, and can refuse batches of them
+class UploadCountingBackupProtocolLocal : public BackupProtocolLocal2
+{
+public:
+	int mNumFilesStoredSingly;
+	int mNumBatchesStored;
+	int mNumFilesStoredInBatches;
+	bool mFailBatches;
+
+public:
+	UploadCountingBackupProtocolLocal(int32_t AccountNumber,
+		const std::string& ConnectionDetails,
+		const std::string& AccountRootDir, int DiscSetNumber,
+		bool ReadOnly)
+	: BackupProtocolLocal2(AccountNumber, ConnectionDetails, AccountRootDir,
+		DiscSetNumber, ReadOnly),
+	  mNumFilesStoredSingly(0),
+	  mNumBatchesStored(0),
+	  mNumFilesStoredInBatches(0),
+	  mFailBatches(false)
+	{ }
+
+	std::auto_ptr<BackupProtocolSuccess> Query(
+		const BackupProtocolStoreFileWithResume &rQuery,
+		std::auto_ptr<IOStream> apStream)
+	{
+		mNumFilesStoredSingly++;
+		return BackupProtocolLocal::Query(rQuery, apStream);
+	}
+
+	std::auto_ptr<BackupProtocolSuccess> Query(
+		const BackupProtocolStoreFiles &rQuery,
+		std::auto_ptr<IOStream> apStream)
+	{
+		if(mFailBatches)
+		{
+			THROW_EXCEPTION(BackupStoreException, BadStoreFilesStream);
+		}
+		std::auto_ptr<BackupProtocolSuccess> stored =
+			BackupProtocolLocal::Query(rQuery, apStream);
+		mNumBatchesStored++;
+		// The reply holds the number of files stored
+		mNumFilesStoredInBatches += stored->GetObjectID();
+		return stored;
+	}
+};
+
+void write_file_of_size(const std::string &rFilename, int Size)
+{
+	FileStream fs(rFilename, O_WRONLY | O_CREAT | O_EXCL);
+	std::string data(Size, 'x');
+	fs.Write(data.c_str(), data.size());
+}
+
+bool test_small_files_are_uploaded_in_batches()
+{
+	SETUP_TEST_BBACKUPD();
+
+	UploadCountingBackupProtocolLocal client(0x01234567, "test",
+		"backup/01234567/", 0, false);
+	MockBackupDaemon bbackupd(client);
+	TEST_THAT(configure_bbackupd(bbackupd, "testfiles/bbackupd.conf"));
+
+	// Files up to BatchedUploadMaxSize (16384 bytes by default) are
+	// sent together, and bigger ones on their own
+	TEST_THAT_OR(mkdir("testfiles/TestDir1", 0755) == 0, FAIL);
+	write_file_of_size("testfiles/TestDir1/small", 100);
+	write_file_of_size("testfiles/TestDir1/limit", 16384);
+	write_file_of_size("testfiles/TestDir1/big", 16385);
+	TEST_THAT_OR(mkdir("testfiles/TestDir1/sub", 0755) == 0, FAIL);
+	write_file_of_size("testfiles/TestDir1/sub/big", 16385);
+	wait_for_operation(5, "new files to be old enough");
+
+	// If the server refuses the batch, the rest of the location is
+	// still synchronised, and the batched files are sent next time
+	client.mFailBatches = true;
+	bbackupd.RunSyncNow();
+	TEST_EQUAL(2, client.mNumFilesStoredSingly);
+	TEST_EQUAL(0, client.mNumBatchesStored);
+	TEST_COMPARE_LOCAL(Compare_Different, client);
+
+	client.mFailBatches = false;
+	bbackupd.RunSyncNow();
+	TEST_EQUAL(2, client.mNumFilesStoredSingly);
+	TEST_EQUAL(1, client.mNumBatchesStored);
+	TEST_EQUAL(2, client.mNumFilesStoredInBatches);
+	TEST_COMPARE_LOCAL(Compare_Same, client);
+
+	TEARDOWN_TEST_BBACKUPD();
+}
+
+// Returns the names of the entries in a directory read by the scanner
+std::set<std::string> read_scanned_names(
+	BackupClientDirectoryScanner::Directory &rDir)
+{
+	std::set<std::string> names;
+	TEST_EQUAL_OR(0, rDir.OpenEntries(), return names);
+	BackupClientDirectoryScanner::Entry *pEntry;
+	while((pEntry = rDir.NextEntry()) != 0)
+	{
+		names.insert(pEntry->GetName());
+	}
+	TEST_THAT(!rDir.CloseFailed());
+	return names;
+}
+
+// The scanner returns the same entries whether it reads a directory in
+// advance on its worker threads or lazily, without keeping them, as the
+// sync asks for them
+bool test_directory_scanner()
+{
+	SETUP_TEST_BBACKUPD();
+
+	BackupProtocolLocal2 client(0x01234567, "test", "backup/01234567/",
+		0, false);
+	MockBackupDaemon bbackupd(client);
+	TEST_THAT(configure_bbackupd(bbackupd, "testfiles/bbackupd.conf"));
+	SyncResumeInfo resumeInfo("testfiles/resume.dat");
+	MockClientContext context(bbackupd, sTlsContext, "localhost",
+		BOX_PORT_BBSTORED_TEST, 0x01234567, false, false, "",
+		bbackupd, resumeInfo, false, client);
+
+	TEST_THAT_OR(mkdir("testfiles/TestDir1", 0755) == 0, FAIL);
+	TEST_THAT_OR(mkdir("testfiles/TestDir1/sub1", 0755) == 0, FAIL);
+	TEST_THAT_OR(mkdir("testfiles/TestDir1/sub2", 0755) == 0, FAIL);
+	write_file_of_size("testfiles/TestDir1/f1", 100);
+	write_file_of_size("testfiles/TestDir1/sub1/f2", 100);
+
+	std::set<std::string> expected, subdirs, expectedSub1;
+	expected.insert(".");
+	expected.insert("..");
+	expected.insert("f1");
+	expected.insert("sub1");
+	expected.insert("sub2");
+	subdirs.insert("sub1");
+	subdirs.insert("sub2");
+	expectedSub1.insert(".");
+	expectedSub1.insert("..");
+	expectedSub1.insert("f2");
+
+	// With no threads, nothing is read in advance or kept
+	{
+		BackupClientDirectoryScanner scanner;
+		std::auto_ptr<BackupClientDirectoryScanner::Directory> apDir(
+			scanner.GetDirectory("testfiles/TestDir1", context));
+		TEST_THAT(read_scanned_names(*apDir) == expected);
+		TEST_THAT(apDir->FindEntry("f1") == NULL);
+
+		scanner.Prefetch("testfiles/TestDir1", *apDir, subdirs);
+		apDir = scanner.GetDirectory("testfiles/TestDir1/sub1",
+			context);
+		TEST_THAT(read_scanned_names(*apDir) == expectedSub1);
+		TEST_THAT(apDir->FindEntry("f2") == NULL);
+	}
+
+	// With threads, subdirectories are read in advance, including the
+	// attributes of their entries, which are only used while the
+	// entries are unchanged
+	{
+		BackupClientDirectoryScanner scanner;
+		scanner.StartThreads(2);
+		std::auto_ptr<BackupClientDirectoryScanner::Directory> apDir(
+			scanner.GetDirectory("testfiles/TestDir1", context));
+		TEST_THAT(read_scanned_names(*apDir) == expected);
+
+		scanner.Prefetch("testfiles/TestDir1", *apDir, subdirs);
+		// Let the workers finish, or the directory is taken back
+		// and read lazily
+		ShortSleep(MilliSecondsToBoxTime(500), false);
+		apDir = scanner.GetDirectory("testfiles/TestDir1/sub1",
+			context);
+		TEST_THAT(read_scanned_names(*apDir) == expectedSub1);
+
+		BackupClientDirectoryScanner::Entry *pEntry =
+			apDir->FindEntry("f2");
+		TEST_THAT_OR(pEntry != NULL, FAIL);
+		EMU_STRUCT_STAT st;
+		TEST_THAT(EMU_LSTAT("testfiles/TestDir1/sub1/f2", &st) == 0);
+		TEST_THAT(pEntry->StatMatches(st));
+
+		// Changing the file makes the results stale
+		FileStream fs("testfiles/TestDir1/sub1/f2", O_WRONLY | O_APPEND);
+		fs.Write("x", 1);
+		fs.Close();
+		TEST_THAT(EMU_LSTAT("testfiles/TestDir1/sub1/f2", &st) == 0);
+		TEST_THAT(!pEntry->StatMatches(st));
+
+		apDir = scanner.GetDirectory("testfiles/TestDir1/sub2",
+			context);
+		TEST_EQUAL(2, read_scanned_names(*apDir).size());
+	}
+
+	// A directory which can't be read gives the same error either way
+	{
+		BackupClientDirectoryScanner scanner;
+		scanner.StartThreads(1);
+		std::auto_ptr<BackupClientDirectoryScanner::Directory> apDir(
+			scanner.GetDirectory("testfiles/TestDir1/missing",
+				context));
+		EMU_STRUCT_STAT st;
+		TEST_EQUAL(-1, apDir->Stat(st));
+		TEST_EQUAL(ENOENT, errno);
+		TEST_EQUAL(-1, apDir->OpenEntries());
+		TEST_EQUAL(ENOENT, errno);
+	}
+
+	TEARDOWN_TEST_BBACKUPD();
+}
+
+// The sync looks up local names in the directory on the store by their
+// encrypted or clear encodings, without decrypting the names on the store,
+// and the later of two entries with the same name wins, whichever encoding
+// each uses, as it did when all the names were decrypted
+bool test_store_entries_index()
+{
+	SETUP_TEST_BBACKUPD();
+
+	BackupStoreDirectory dir(100, 1);
+	std::vector<BackupStoreDirectory::Entry *> entries;
+	static const char *names[] = {"alpha", "beta", "beta", "gamma",
+		"gamma", "alpha"};
+	for(int n = 0; n < 6; ++n)
+	{
+		// beta is first in the clear, gamma second
+		BackupStoreFilename name;
+		if(n == 1 || n == 4)
+		{
+			name.SetAsClearFilename(names[n]);
+		}
+		else
+		{
+			name = BackupStoreFilenameClear(names[n]);
+		}
+		entries.push_back(dir.AddEntry(name, 0, 0, 0, 200 + n, 1,
+			BackupStoreDirectory::Entry::Flags_File, 0));
+	}
+
+	StoreEntriesIndex index(&dir);
+	int expected[] = {5, 2, 4};
+	for(int n = 0; n < 3; ++n)
+	{
+		std::string clearName(names[expected[n]]);
+		unsigned int position = 1000;
+		TEST_THAT(index.Find(BackupStoreFilenameClear(clearName),
+			clearName, position) == entries[expected[n]]);
+		TEST_EQUAL_LINE(expected[n], position, clearName);
+	}
+
+	unsigned int position = 1000;
+	TEST_THAT(index.Find(BackupStoreFilenameClear("delta"), "delta",
+		position) == NULL);
+	TEST_EQUAL(1000, position);
+
+	StoreEntriesIndex emptyIndex(NULL);
+	TEST_THAT(emptyIndex.Find(BackupStoreFilenameClear("alpha"), "alpha",
+		position) == NULL);
+
+	// Entries are forgotten at the position given, or wherever they are
+	// if that's wrong, and forgetting one which isn't there does nothing
+	std::vector<BackupStoreDirectory::Entry *> leftOver(entries);
+	StoreEntriesIndex::ForgetLeftOverEntry(leftOver, entries[2], 2);
+	TEST_THAT(leftOver[2] == NULL);
+	StoreEntriesIndex::ForgetLeftOverEntry(leftOver, entries[4], 0);
+	TEST_THAT(leftOver[4] == NULL);
+	TEST_THAT(leftOver[0] == entries[0]);
+	StoreEntriesIndex::ForgetLeftOverEntry(leftOver, entries[2], 2);
+	StoreEntriesIndex::ForgetLeftOverEntry(leftOver, entries[2], 100);
+	for(int n = 0; n < 6; ++n)
+	{
+		TEST_THAT(leftOver[n] == ((n == 2 || n == 4) ? NULL : entries[n]));
+	}
+
+	TEARDOWN_TEST_BBACKUPD();
+}
+
 bool test_read_error_reporting()
 {
 	SETUP_WITH_BBSTORED();
@@ -3434,11 +3792,14 @@ bool test_restore_files_and_directories()
 			TEST_THAT(BackupClientRestore(*client, restoredirid,
 				"Test1" /* remote */,
 				"testfiles/restore-Test1" /* local */,
+				0 /* SnapshotTime */,
 				true /* print progress dots */,
 				false /* restore deleted */,
+				false /* restore any */,
 				false /* undelete after */,
 				false /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_Complete);
 
 			// On Win32 we can't open another connection
@@ -3447,11 +3808,14 @@ bool test_restore_files_and_directories()
 			// Make sure you can't restore a restored directory
 			TEST_THAT(BackupClientRestore(*client, restoredirid,
 				"Test1", "testfiles/restore-Test1",
+				0 /* SnapshotTime */,
 				true /* print progress dots */,
 				false /* restore deleted */,
+				false /* restore any */,
 				false /* undelete after */,
 				false /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_TargetExists);
 
 			// Find ID of the deleted directory
@@ -3462,11 +3826,14 @@ bool test_restore_files_and_directories()
 			// properly later (when bbackupd is stopped)
 			TEST_THAT(BackupClientRestore(*client, deldirid,
 				"Test1", "testfiles/restore-Test1-x1",
+				0 /* SnapshotTime */,
 				true /* print progress dots */,
 				true /* restore deleted */,
+				false /* restore any */,
 				false /* undelete after */,
 				false /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_Complete);
 
 			// Make sure you can't restore to a nonexistant path
@@ -3480,11 +3847,14 @@ bool test_restore_files_and_directories()
 				TEST_THAT(BackupClientRestore(*client,
 					restoredirid, "Test1",
 					"testfiles/no-such-path/subdir", 
+					0 /* SnapshotTime */,
 					true /* print progress dots */, 
 					true /* restore deleted */,
+					false /* restore any */,
 					false /* undelete after */,
 					false /* resume */,
-					false /* keep going */) 
+					false /* keep going */,
+					sRestoreInfos) 
 					== Restore_TargetPathNotFound);
 			}
 
@@ -3499,6 +3869,286 @@ bool test_restore_files_and_directories()
 	TEARDOWN_TEST_BBACKUPD();
 }
 
+// Opens local read-only connections for restoring, the first of which
+// fails after fetching some files, to test that their files are fetched
+// by the others
+class FailingRestoreProtocolLocal : public BackupProtocolLocal2
+{
+public:
+	FailingRestoreProtocolLocal(int FilesBeforeFailure)
+	: BackupProtocolLocal2(0x01234567, "test", "backup/01234567/", 0,
+		true), // read-only
+	  mFilesBeforeFailure(FilesBeforeFailure),
+	  mFailed(false)
+	{ }
+
+	std::auto_ptr<BackupProtocolSuccess> Query(
+		const BackupProtocolGetFile &rQuery)
+	{
+		if(mFilesBeforeFailure-- == 0)
+		{
+			mFailed = true;
+		}
+		CheckAlive();
+		return BackupProtocolLocal::Query(rQuery);
+	}
+
+	std::auto_ptr<BackupProtocolIsAlive> Query(
+		const BackupProtocolGetIsAlive &rQuery)
+	{
+		CheckAlive();
+		return BackupProtocolLocal::Query(rQuery);
+	}
+
+private:
+	void CheckAlive()
+	{
+		if(mFailed)
+		{
+			THROW_EXCEPTION(ConnectionException, SocketReadError);
+		}
+	}
+	// -1 to never fail
+	int mFilesBeforeFailure;
+	bool mFailed;
+};
+
+class LocalRestoreConnectionFactory : public RestoreConnectionFactory
+{
+public:
+	LocalRestoreConnectionFactory(int NumToFail, int FailAfter)
+	: mNumToFail(NumToFail),
+	  mFailAfter(FailAfter),
+	  mNumOpened(0)
+	{ }
+
+	std::auto_ptr<BackupProtocolCallable> OpenConnection()
+	{
+		mNumOpened++;
+		return std::auto_ptr<BackupProtocolCallable>(
+			new FailingRestoreProtocolLocal(
+				mNumOpened <= mNumToFail ? mFailAfter : -1));
+	}
+
+	int mNumToFail;
+	int mFailAfter;
+	int mNumOpened;
+};
+
+// Checks the files written by test_restore_over_several_connections()
+bool check_restored_files(const std::string &rDirName)
+{
+	bool all_ok = true;
+	for(int i = 0; i < 10; i++)
+	{
+		std::ostringstream name;
+		name << rDirName << "/f" << i;
+		TEST_EQUAL_OR(1000 * (i + 1), TestGetFileSize(name.str()),
+			all_ok = false);
+		name.str("");
+		name << rDirName << "/sub/f" << i;
+		TEST_EQUAL_OR(1000 * (i + 1), TestGetFileSize(name.str()),
+			all_ok = false);
+	}
+	return all_ok;
+}
+
+// Part of a file can be got with bbackupquery, without fetching it whole
+bool test_bbackupquery_get_file_range()
+{
+	SETUP_TEST_BBACKUPD();
+
+	// Data which differs at every offset, so that the wrong range can't
+	// look right
+	std::string data;
+	for(int i = 0; i < 200000; i++)
+	{
+		data += (char)('a' + ((i * 7) + (i / 251)) % 26);
+	}
+
+	{
+		BackupProtocolLocal2 client(0x01234567, "test",
+			"backup/01234567/", 0, false);
+		MockBackupDaemon bbackupd(client);
+		TEST_THAT(configure_bbackupd(bbackupd,
+			"testfiles/bbackupd.conf"));
+
+		TEST_THAT_OR(mkdir("testfiles/TestDir1", 0755) == 0, FAIL);
+		{
+			FileStream fs("testfiles/TestDir1/data",
+				O_WRONLY | O_CREAT | O_EXCL);
+			fs.Write(data.c_str(), data.size());
+		}
+		wait_for_operation(5, "new file to be old enough");
+		bbackupd.RunSyncNow();
+		TEST_COMPARE_LOCAL(Compare_Same, client);
+		client.QueryFinished();
+	}
+
+	BackupProtocolLocal2 client(0x01234567, "test", "backup/01234567/", 0,
+		true); // read-only
+	std::auto_ptr<Configuration> config =
+		load_config_file(DEFAULT_BBACKUPD_CONFIG_FILE, BackupDaemonConfigVerify);
+	TEST_THAT_OR(config.get(), FAIL);
+	bool opts[256] = {};
+	opts['r'] = true;
+
+	// Not without a store which supports it
+	{
+		BackupQueries query(client, *config, false); // read-only
+		std::vector<std::string> args;
+		args.push_back("Test1/data");
+		args.push_back("100000");
+		args.push_back("5000");
+		args.push_back("testfiles/range.out");
+		query.CommandGet(args, opts);
+		TEST_EQUAL(BackupQueries::ReturnCode::Command_Error,
+			query.GetReturnCode());
+		TEST_THAT(!FileExists("testfiles/range.out"));
+	}
+
+	BackupQueries query(client, *config, false); // read-only
+	query.SetFileRangesSupported(true);
+	{
+		std::vector<std::string> args;
+		args.push_back("Test1/data");
+		args.push_back("100000");
+		args.push_back("5000");
+		args.push_back("testfiles/range.out");
+		query.CommandGet(args, opts);
+		TEST_EQUAL(BackupQueries::ReturnCode::Command_OK,
+			query.GetReturnCode());
+		TEST_THAT(FileExists("testfiles/range.out"));
+		FileStream fs("testfiles/range.out");
+		CollectInBufferStream got;
+		fs.CopyStreamTo(got);
+		TEST_THAT(std::string((const char *)got.GetBuffer(),
+			got.GetSize()) == data.substr(100000, 5000));
+	}
+
+	// A range which runs off the end stops at the end, and one which
+	// starts after it is an error
+	{
+		std::vector<std::string> args;
+		args.push_back("Test1/data");
+		args.push_back("199000");
+		args.push_back("5000");
+		args.push_back("testfiles/range-end.out");
+		query.CommandGet(args, opts);
+		TEST_EQUAL(BackupQueries::ReturnCode::Command_OK,
+			query.GetReturnCode());
+		TEST_EQUAL(1000, TestGetFileSize("testfiles/range-end.out"));
+
+		args[1] = "200001";
+		args[3] = "testfiles/range-after.out";
+		query.CommandGet(args, opts);
+		TEST_EQUAL(BackupQueries::ReturnCode::Command_Error,
+			query.GetReturnCode());
+		TEST_THAT(!FileExists("testfiles/range-after.out"));
+	}
+
+	client.QueryFinished();
+	TEARDOWN_TEST_BBACKUPD();
+}
+
+bool test_restore_over_several_connections()
+{
+	SETUP_TEST_BBACKUPD();
+
+	{
+		BackupProtocolLocal2 client(0x01234567, "test",
+			"backup/01234567/", 0, false);
+		MockBackupDaemon bbackupd(client);
+		TEST_THAT(configure_bbackupd(bbackupd,
+			"testfiles/bbackupd.conf"));
+
+		TEST_THAT_OR(mkdir("testfiles/TestDir1", 0755) == 0, FAIL);
+		TEST_THAT_OR(mkdir("testfiles/TestDir1/sub", 0755) == 0, FAIL);
+		for(int i = 0; i < 10; i++)
+		{
+			std::ostringstream name;
+			name << "testfiles/TestDir1/f" << i;
+			write_file_of_size(name.str(), 1000 * (i + 1));
+			name.str("");
+			name << "testfiles/TestDir1/sub/f" << i;
+			write_file_of_size(name.str(), 1000 * (i + 1));
+		}
+		wait_for_operation(5, "new files to be old enough");
+		bbackupd.RunSyncNow();
+		TEST_COMPARE_LOCAL(Compare_Same, client);
+		client.QueryFinished();
+	}
+
+	BackupProtocolLocal2 client(0x01234567, "test", "backup/01234567/", 0,
+		true); // read-only
+	int64_t restoredirid = GetDirID(client, "Test1",
+		BackupProtocolListDirectory::RootDirectory);
+	TEST_THAT_OR(restoredirid != 0, FAIL);
+
+	// Fetch the files over three more connections
+	{
+		LocalRestoreConnectionFactory factory(0, 0); // none fail
+		RestoreInfos infos;
+		TEST_EQUAL(Restore_Complete, BackupClientRestore(client,
+			restoredirid, "Test1", "testfiles/restore-several",
+			0 /* SnapshotTime */,
+			false /* print progress dots */,
+			false /* restore deleted */,
+			false /* restore any */,
+			false /* undelete after */,
+			false /* resume */,
+			false /* keep going */,
+			infos, &factory, 3 /* connections */));
+		TEST_EQUAL(3, factory.mNumOpened);
+		TEST_EQUAL(20, infos.totalFilesRestored);
+		TEST_EQUAL(0, infos.totalFilesFailed);
+		TEST_THAT(check_restored_files("testfiles/restore-several"));
+	}
+
+	// When one connection fails, the file it was fetching and the rest
+	// are fetched over the others, and nothing is lost
+	{
+		LocalRestoreConnectionFactory factory(1, 2);
+		RestoreInfos infos;
+		TEST_EQUAL(Restore_Complete, BackupClientRestore(client,
+			restoredirid, "Test1", "testfiles/restore-failing",
+			0 /* SnapshotTime */,
+			false /* print progress dots */,
+			false /* restore deleted */,
+			false /* restore any */,
+			false /* undelete after */,
+			false /* resume */,
+			false /* keep going */,
+			infos, &factory, 2 /* connections */));
+		TEST_EQUAL(20, infos.totalFilesRestored);
+		TEST_EQUAL(0, infos.totalFilesFailed);
+		TEST_EQUAL(0, infos.totalFilesSkipped);
+		TEST_THAT(check_restored_files("testfiles/restore-failing"));
+	}
+
+	// And when all of them fail, over the main connection
+	{
+		LocalRestoreConnectionFactory factory(2, 0);
+		RestoreInfos infos;
+		TEST_EQUAL(Restore_Complete, BackupClientRestore(client,
+			restoredirid, "Test1", "testfiles/restore-failed",
+			0 /* SnapshotTime */,
+			false /* print progress dots */,
+			false /* restore deleted */,
+			false /* restore any */,
+			false /* undelete after */,
+			false /* resume */,
+			false /* keep going */,
+			infos, &factory, 2 /* connections */));
+		TEST_EQUAL(20, infos.totalFilesRestored);
+		TEST_EQUAL(0, infos.totalFilesFailed);
+		TEST_THAT(check_restored_files("testfiles/restore-failed"));
+	}
+
+	client.QueryFinished();
+	TEARDOWN_TEST_BBACKUPD();
+}
+
 bool test_compare_detects_attribute_changes()
 {
 	SETUP_WITH_BBSTORED();
@@ -3712,7 +4362,7 @@ bool test_changing_client_store_marker_pauses_daemon()
 					// Make sure the marker isn't zero,
 					// because that's the default, and
 					// it should have changed
-					std::auto_ptr<BackupProtocolLoginConfirmed> loginConf(protocol->QueryLogin(0x01234567, 0));
+					std::auto_ptr<BackupProtocolLoginConfirmed> loginConf(protocol->QueryLogin(0x01234567, 0, PROTOCOL_CURRENT_VERSION));
 					TEST_THAT(loginConf->GetClientStoreMarker() != 0);
 					
 					// Change it to something else
@@ -3825,21 +4475,27 @@ bool test_interrupted_restore_can_be_recovered()
 			// rather than doing anything
 			TEST_THAT(BackupClientRestore(*client, restoredirid,
 				"Test1", "testfiles/restore-interrupt",
+				0 /* SnapshotTime */,
 				true /* print progress dots */, 
 				false /* restore deleted */, 
+				false /* restore any */,
 				false /* undelete after */, 
 				false /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_ResumePossible);
 
 			// Then resume it
 			TEST_THAT(BackupClientRestore(*client, restoredirid,
 				"Test1", "testfiles/restore-interrupt",
+				0 /* SnapshotTime */,
 				true /* print progress dots */, 
 				false /* restore deleted */, 
+				false /* restore any */,
 				false /* undelete after */, 
 				true /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_Complete);
 
 			client->QueryFinished();
@@ -3910,11 +4566,14 @@ bool test_restore_deleted_files()
 			// Do restore and undelete
 			TEST_THAT(BackupClientRestore(*client, deldirid,
 				"Test1", "testfiles/restore-Test1-x1-2",
+				0 /* SnapshotTime */,
 				true /* print progress dots */, 
 				true /* deleted files */, 
+				false /* restore any */,
 				true /* undelete after */,
 				false /* resume */,
-				false /* keep going */) 
+				false /* keep going */,
+				sRestoreInfos) 
 				== Restore_Complete);
 
 			client->QueryFinished();
@@ -4263,6 +4922,7 @@ int test(int argc, const char *argv[])
 	TEST_THAT(test_basics());
 	TEST_THAT(test_readdirectory_on_nonexistent_dir());
 	TEST_THAT(test_bbackupquery_parser_escape_slashes());
+	TEST_THAT(test_server_version_negotiation());
 	TEST_THAT(test_getobject_on_nonexistent_file());
 	// TEST_THAT(test_replace_zero_byte_file_with_nonzero_byte_file());
 	TEST_THAT(test_backup_disappearing_directory());
@@ -4284,10 +4944,15 @@ int test(int argc, const char *argv[])
 	TEST_THAT(test_file_rename_tracking());
 	TEST_THAT(test_upload_very_old_files());
 	TEST_THAT(test_excluded_files_are_not_backed_up());
+	TEST_THAT(test_small_files_are_uploaded_in_batches());
+	TEST_THAT(test_directory_scanner());
+	TEST_THAT(test_store_entries_index());
 	TEST_THAT(test_read_error_reporting());
 	TEST_THAT(test_continuously_updated_file());
 	TEST_THAT(test_delete_dir_change_attribute());
 	TEST_THAT(test_restore_files_and_directories());
+	TEST_THAT(test_restore_over_several_connections());
+	TEST_THAT(test_bbackupquery_get_file_range());
 	TEST_THAT(test_compare_detects_attribute_changes());
 	TEST_THAT(test_sync_new_files());
 	TEST_THAT(test_rename_operations());
@@ -792,6 +792,49 @@ int test(int argc, const char *argv[])
 		TEST_THAT(r == sizeof(GATHER_RESULT) - 1);
 		TEST_THAT(::memcmp(buffer, GATHER_RESULT, sizeof(GATHER_RESULT) - 1) == 0);
 	}
+
+	// Test seeking in a ReadGatherStream
+	{
+		MemBlockStream s1(GATHER_DATA1, sizeof(GATHER_DATA1));
+		MemBlockStream s2(GATHER_DATA2, sizeof(GATHER_DATA2));
+		ReadGatherStream gather(false /* no deletion */);
+		int s1_c = gather.AddComponent(&s1);
+		int s2_c = gather.AddComponent(&s2);
+		gather.AddBlock(s1_c, 5, true, 10);
+		gather.AddBlock(s2_c, 10, true, 0);
+		gather.AddBlock(s1_c, 5);
+		gather.AddBlock(s2_c, 3, true, 20);
+		// gives "abcdeZYZWVUTSRQfghijGFE"
+
+		char buffer[32];
+		gather.Seek(12, IOStream::SeekType_Absolute);
+		TEST_THAT(gather.GetPosition() == 12);
+		TEST_THAT(gather.BytesLeftToRead() == 11);
+		TEST_THAT(gather.Read(buffer, 8) == 8);
+		TEST_THAT(::memcmp(buffer, "SRQfghij", 8) == 0);
+
+		gather.Seek(-3, IOStream::SeekType_End);
+		TEST_THAT(gather.Read(buffer, sizeof(buffer)) == 3);
+		TEST_THAT(::memcmp(buffer, "GFE", 3) == 0);
+		TEST_THAT(!gather.StreamDataLeft());
+
+		gather.Seek(2, IOStream::SeekType_Absolute);
+		TEST_THAT(gather.Read(buffer, 5) == 5);
+		TEST_THAT(::memcmp(buffer, "cdeZY", 5) == 0);
+		gather.Seek(1, IOStream::SeekType_Relative);
+		TEST_THAT(gather.Read(buffer, 2) == 2);
+		TEST_THAT(::memcmp(buffer, "WV", 2) == 0);
+
+		// Past the end
+		TEST_CHECK_THROWS(gather.Seek(24, IOStream::SeekType_Absolute),
+			CommonException, NotSupported);
+
+		// A block which isn't seeked to has no known position
+		ReadGatherStream gather2(false /* no deletion */);
+		gather2.AddBlock(gather2.AddComponent(&s1), 10);
+		TEST_CHECK_THROWS(gather2.Seek(5, IOStream::SeekType_Absolute),
+			CommonException, NotSupported);
+	}
 	
 	// Test ExcludeList
 	{
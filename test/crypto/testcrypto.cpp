@@ -12,6 +12,10 @@
 #include <string.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
+#include <vector>
+
+#include "BoxTime.h"
 #include "CipherContext.h"
 #include "CipherBlowfish.h"
 #include "CipherAES.h"
@@ -34,6 +38,8 @@
 #define CHECKSUM_BLOCK_SIZE_BASE	(65*1024)
 #define CHECKSUM_BLOCK_SIZE_LAST	(CHECKSUM_BLOCK_SIZE_BASE + 64)
 #define CHECKSUM_ROLLS				16
+#define CHECKSUM_BENCHMARK_SIZE		(16*1024*1024)
+#define CHECKSUM_BENCHMARK_BLOCK	4096
 
 // Copied from BackupClientCryptoKeys.h
 #define BACKUPCRYPTOKEYS_FILENAME_KEY_START				0
@@ -256,6 +262,160 @@ void test_cipher()
 	}
 }
 
+void test_rolling_checksum_batch()
+{
+	// Make sure every implementation gives exactly the same checksums
+	// and filter hits as rolling forward one byte at a time, including
+	// odd lengths and counts which don't fill a whole vector.
+	uint8_t *data = (uint8_t *)malloc(CHECKSUM_DATA_SIZE);
+	RAND_bytes(data, CHECKSUM_DATA_SIZE);
+	int best = RollingChecksum::GetBatchImplementation();
+	std::vector<uint32_t> expected(1025), batch(1025);
+	std::vector<uint32_t> expectedInFilter(32), inFilter(32);
+
+	// Half the hashes are in the filter
+	uint8_t filter[(64*1024) / 8];
+	RAND_bytes(filter, sizeof(filter));
+
+	for(int impl = 0; impl < RollingChecksum::Batch_Max; ++impl)
+	{
+		if(!RollingChecksum::SetBatchImplementation(impl))
+		{
+			BOX_NOTICE("Rolling checksum implementation " <<
+				RollingChecksum::GetBatchImplementationName(impl) <<
+				" not supported, skipping");
+			continue;
+		}
+
+		int sizes[] = {1, 2, 15, 16, 17, 4096, CHECKSUM_BLOCK_SIZE_BASE + 3};
+		int counts[] = {0, 1, 7, 8, 9, 31, 33, 1000, 1024};
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); ++s)
+		{
+			for(size_t c = 0; c < sizeof(counts) / sizeof(*counts); ++c)
+			{
+				const uint8_t *window = data + 5;
+				int count = counts[c];
+				RollingChecksum roll(window, sizes[s]);
+				std::fill(expectedInFilter.begin(), expectedInFilter.end(), 0);
+				for(int i = 0; i <= count; ++i)
+				{
+					expected[i] = roll.GetChecksum();
+					if(i == count)
+					{
+						break;
+					}
+					uint16_t hash = roll.GetComponentForHashing();
+					if((filter[hash >> 3] & (1 << (hash & 7))) != 0)
+					{
+						expectedInFilter[i / 32] |= ((uint32_t)1) << (i % 32);
+					}
+					roll.RollForward(window[i], window[i + sizes[s]], sizes[s]);
+				}
+
+				RollingChecksum rollBatch(window, sizes[s]);
+				rollBatch.RollForwardBatch(window, sizes[s], count,
+					filter, &batch[0], &inFilter[0]);
+				TEST_EQUAL_LINE(roll.GetChecksum(), rollBatch.GetChecksum(),
+					RollingChecksum::GetBatchImplementationName(impl));
+				for(int i = 0; i <= count; ++i)
+				{
+					if(expected[i] != batch[i])
+					{
+						TEST_EQUAL_LINE(expected[i], batch[i],
+							RollingChecksum::GetBatchImplementationName(impl));
+						break;
+					}
+				}
+				for(int w = 0; w < (count + 31) / 32; ++w)
+				{
+					TEST_EQUAL_LINE(expectedInFilter[w], inFilter[w],
+						RollingChecksum::GetBatchImplementationName(impl));
+				}
+			}
+		}
+	}
+
+	RollingChecksum::SetBatchImplementation(best);
+	::free(data);
+}
+
+void test_rolling_checksum_speed()
+{
+	// Measure the speed of rolling the checksum over every position and
+	// probing a filter of hashes at each one, as the diff does: one byte
+	// at a time with RollForward(), and a batch at a time with each
+	// implementation of RollForwardBatch().
+	uint8_t *data = (uint8_t *)malloc(CHECKSUM_BENCHMARK_SIZE);
+	RAND_bytes(data, CHECKSUM_BENCHMARK_SIZE);
+	int positions = CHECKSUM_BENCHMARK_SIZE - CHECKSUM_BENCHMARK_BLOCK;
+	int best = RollingChecksum::GetBatchImplementation();
+
+	// A filter with about as many hashes set as the diff would have
+	// for a 16 MB file
+	uint8_t filter[(64*1024) / 8];
+	::memset(filter, 0, sizeof(filter));
+	for(int h = 0; h < CHECKSUM_BENCHMARK_SIZE / CHECKSUM_BENCHMARK_BLOCK; ++h)
+	{
+		uint16_t hash = Random::RandomInt(0xffff);
+		filter[hash >> 3] |= (1 << (hash & 7));
+	}
+
+	uint32_t checksums[256 + 1];
+	uint32_t inFilter[256 / 32];
+	for(int impl = -1; impl < RollingChecksum::Batch_Max; ++impl)
+	{
+		if(impl >= 0 && !RollingChecksum::SetBatchImplementation(impl))
+		{
+			continue;
+		}
+
+		box_time_t start = GetCurrentBoxTime();
+		RollingChecksum roll(data, CHECKSUM_BENCHMARK_BLOCK);
+		// Count the hits so that the work can't be optimised away
+		int hits = 0;
+		if(impl < 0)
+		{
+			for(int i = 0; i < positions; ++i)
+			{
+				uint16_t hash = roll.GetComponentForHashing();
+				if((filter[hash >> 3] & (1 << (hash & 7))) != 0)
+				{
+					++hits;
+				}
+				roll.RollForward(data[i], data[i + CHECKSUM_BENCHMARK_BLOCK],
+					CHECKSUM_BENCHMARK_BLOCK);
+			}
+		}
+		else
+		{
+			for(int i = 0; i < positions; i += 256)
+			{
+				int count = positions - i;
+				if(count > 256) count = 256;
+				roll.RollForwardBatch(data + i, CHECKSUM_BENCHMARK_BLOCK,
+					count, filter, checksums, inFilter);
+				for(int w = 0; w < (count + 31) / 32; ++w)
+				{
+					for(uint32_t bits = inFilter[w]; bits != 0; bits &= bits - 1)
+					{
+						++hits;
+					}
+				}
+			}
+		}
+		box_time_t elapsed = GetCurrentBoxTime() - start;
+		if(elapsed == 0) elapsed = 1;
+
+		BOX_NOTICE("Rolling checksum, " << ((impl < 0) ? "RollForward" :
+			RollingChecksum::GetBatchImplementationName(impl)) << ": " <<
+			((double)positions * MICRO_SEC_IN_SEC / elapsed / (1024*1024)) <<
+			" MB/s (" << hits << " hits)");
+	}
+
+	RollingChecksum::SetBatchImplementation(best);
+	::free(data);
+}
+
 int test(int argc, const char *argv[])
 {
 	Random::Initialise();
@@ -371,6 +531,9 @@ int test(int argc, const char *argv[])
 	}
 	::free(checkdata_blk);
 
+	test_rolling_checksum_batch();
+	test_rolling_checksum_speed();
+
 	// Random integers
 	check_random_int(0);
 	check_random_int(1);
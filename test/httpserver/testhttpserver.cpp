@@ -21,6 +21,7 @@
 #include <openssl/hmac.h>
 
 #include "autogen_HTTPException.h"
+#include "CollectInBufferStream.h"
 #include "HTTPRequest.h"
 #include "HTTPResponse.h"
 #include "HTTPServer.h"
@@ -29,6 +30,7 @@
 #include "S3Simulator.h"
 #include "ServerControl.h"
 #include "Test.h"
+#include "Utils.h"
 #include "decode.h"
 #include "encode.h"
 
@@ -36,6 +38,18 @@
 
 #define SHORT_TIMEOUT 5000
 
+// A stream which doesn't say how much data it has, so responses which send
+// it can't say how long they are either
+class UnknownSizeStream : public CollectInBufferStream
+{
+public:
+	virtual pos_type BytesLeftToRead() {return IOStream::SizeOfStreamUnknown;}
+};
+
+// Enough for several chunks, as HTTPResponse sends them
+#define STREAM_RESPONSE_REPEATS 4000
+#define STREAM_RESPONSE_TEXT "0123456789"
+
 class TestWebServer : public HTTPServer
 {
 public:
@@ -56,6 +70,21 @@ void TestWebServer::Handle(HTTPRequest &rRequest, HTTPResponse &rResponse)
 		return;
 	}
 
+	// Test streaming a response of unknown size
+	if(rRequest.GetRequestURI() == "/stream")
+	{
+		std::auto_ptr<UnknownSizeStream> apStream(new UnknownSizeStream);
+		for(int i = 0; i < STREAM_RESPONSE_REPEATS; i++)
+		{
+			apStream->IOStream::Write(STREAM_RESPONSE_TEXT);
+		}
+		apStream->SetForReading();
+		rResponse.SetResponseCode(HTTPResponse::Code_OK);
+		rResponse.SetContentType("text/plain");
+		rResponse.SetResponseStream(std::auto_ptr<IOStream>(apStream.release()));
+		return;
+	}
+
 	// Set a cookie?
 	if(rRequest.GetRequestURI() == "/set-cookie")
 	{
@@ -156,7 +185,6 @@ int test(int argc, const char *argv[])
 	// Run the request script
 	TEST_THAT(::system("perl testfiles/testrequests.pl") == 0);
 
-#ifdef ENABLE_KEEPALIVE_SUPPORT // incomplete, need chunked encoding support
 	#ifndef WIN32
 	signal(SIGPIPE, SIG_IGN);
 	#endif
@@ -169,39 +197,16 @@ int test(int argc, const char *argv[])
 		HTTPRequest request(HTTPRequest::Method_GET,
 			"/test-one/34/341s/234?p1=vOne&p2=vTwo");
 
-		if (i < 2)
-		{
-			// first set of passes has keepalive off by default,
-			// so when i == 1 the socket has already been closed
-			// by the server, and we'll get -EPIPE when we try
-			// to send the request.
-			request.SetClientKeepAliveRequested(false);
-		}
-		else
-		{
-			request.SetClientKeepAliveRequested(true);
-		}
-
-		if (i == 1)
-		{
-			sleep(1); // need time for our process to realise
-			// that the peer has died, otherwise no SIGPIPE :(
-			TEST_CHECK_THROWS(
-				request.Send(sock, SHORT_TIMEOUT),
-				ConnectionException, SocketWriteError);
-			sock.Close();
-			sock.Open(Socket::TypeINET, "localhost", 1080);
-			continue;
-		}
-		else
-		{
-			request.Send(sock, SHORT_TIMEOUT);
-		}
+		// first set of passes has keepalive off, so the server closes
+		// the socket after each response, and the rest share one socket.
+		request.SetClientKeepAliveRequested(i >= 2);
+		request.Send(sock, SHORT_TIMEOUT);
 
 		HTTPResponse response;
 		response.Receive(sock, SHORT_TIMEOUT);
 
 		TEST_THAT(response.GetResponseCode() == HTTPResponse::Code_OK);
+		TEST_EQUAL((i >= 2), response.IsKeepAlive());
 		TEST_THAT(response.GetContentType() == "text/html");
 
 		IOStreamGetLine getline(response);
@@ -242,6 +247,9 @@ int test(int argc, const char *argv[])
 		if(!response.IsKeepAlive())
 		{
 			BOX_TRACE("Server will close the connection, closing our end too.");
+			char c;
+			TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+			TEST_THAT(!sock.StreamDataLeft());
 			sock.Close();
 			sock.Open(Socket::TypeINET, "localhost", 1080);
 		}
@@ -252,7 +260,93 @@ int test(int argc, const char *argv[])
 	}
 
 	sock.Close();
-#endif // ENABLE_KEEPALIVE_SUPPORT
+
+	// A response of unknown size is sent in chunks to HTTP/1.1 clients,
+	// and the connection stays open for the next request
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		std::string expected;
+		for(int i = 0; i < STREAM_RESPONSE_REPEATS; i++)
+		{
+			expected += STREAM_RESPONSE_TEXT;
+		}
+
+		HTTPRequest request(HTTPRequest::Method_GET, "/stream");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(response.IsKeepAlive());
+		TEST_EQUAL(expected, std::string((const char *)response.GetBuffer(),
+			response.GetSize()));
+
+		HTTPRequest request2(HTTPRequest::Method_GET, "/after-stream");
+		request2.SetClientKeepAliveRequested(true);
+		request2.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response2;
+		response2.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response2.GetResponseCode());
+		TEST_THAT(response2.IsKeepAlive());
+		IOStreamGetLine getline(response2);
+		std::string line;
+		for(int i = 0; i < 4; i++)
+		{
+			TEST_THAT(getline.GetLine(line));
+		}
+		TEST_EQUAL("<p><b>URI:</b> /after-stream</p>", line);
+
+		// The third request on a connection is the last one, as
+		// configured by KeepAliveMaxRequests
+		HTTPRequest request3(HTTPRequest::Method_GET, "/last");
+		request3.SetClientKeepAliveRequested(true);
+		request3.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response3;
+		response3.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response3.GetResponseCode());
+		TEST_THAT(!response3.IsKeepAlive());
+		char c;
+		TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
+
+	// HTTP/1.0 clients don't understand chunks, so the end of the stream
+	// is marked by closing the connection instead
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		sock.IOStream::Write("GET /stream HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(!response.IsKeepAlive());
+		TEST_EQUAL(STREAM_RESPONSE_REPEATS * (sizeof(STREAM_RESPONSE_TEXT) - 1),
+			response.GetSize());
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
+
+	// Idle kept-alive connections are closed after KeepAliveTimeout
+	sock.Open(Socket::TypeINET, "localhost", 1080);
+	{
+		HTTPRequest request(HTTPRequest::Method_GET, "/idle");
+		request.SetClientKeepAliveRequested(true);
+		request.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response;
+		response.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(HTTPResponse::Code_OK, response.GetResponseCode());
+		TEST_THAT(response.IsKeepAlive());
+
+		char c;
+		TEST_EQUAL(0, sock.Read(&c, 1, SHORT_TIMEOUT));
+		TEST_THAT(!sock.StreamDataLeft());
+	}
+	sock.Close();
 
 	// Kill it
 	TEST_THAT(StopDaemon(pid, "testfiles/httpserver.pid",
@@ -276,6 +370,9 @@ int test(int argc, const char *argv[])
 		simulator.Handle(request, response);
 		TEST_EQUAL(200, response.GetResponseCode());
 
+		// The object is streamed from the file, not in the response yet
+		TEST_THAT(response.HasResponseStream());
+		response.CollectResponseStream();
 		std::string response_data((const char *)response.GetBuffer(),
 			response.GetSize());
 		TEST_EQUAL("omgpuppies!\n", response_data);
@@ -340,8 +437,50 @@ int test(int argc, const char *argv[])
 
 		response = client.GetObject("/newfile");
 		TEST_EQUAL(200, response.GetResponseCode());
-		TEST_THAT(fs.CompareWith(response));
+		FileStream fs2("testfiles/testrequests.pl");
+		TEST_THAT(fs2.CompareWith(response));
 		TEST_EQUAL(0, ::unlink("testfiles/newfile"));
+
+		// Multipart upload, with parts much smaller than S3 allows
+		// to make several of them
+		FileStream original("testfiles/testrequests.pl");
+		client.PutObjectMultipart("/multipart", original, 1000);
+		response = client.GetObject("/multipart");
+		TEST_EQUAL(200, response.GetResponseCode());
+		FileStream original2("testfiles/testrequests.pl");
+		TEST_THAT(original2.CompareWith(response));
+		TEST_EQUAL(0, ::unlink("testfiles/multipart"));
+
+		// A part's ETag is its MD5 digest, and a different one
+		// can't complete the upload
+		std::string uploadID = client.CreateMultipartUpload("/multipart");
+		CollectInBufferStream part;
+		part.Write("hello", 5);
+		part.SetForReading();
+		response = client.UploadPart("/multipart", uploadID, 1, part);
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL("\"5d41402abc4b2a76b9719d911017c592\"",
+			response.GetHeaderValue("ETag"));
+
+		std::vector<std::string> etags;
+		etags.push_back("\"828ef3fdfa96f00ad9f27c383fc9ac7f\"");
+		response = client.CompleteMultipartUpload("/multipart",
+			uploadID, etags);
+		TEST_EQUAL(400, response.GetResponseCode());
+		TEST_THAT(!FileExists("testfiles/multipart"));
+
+		// Aborting it deletes the parts, and the upload can't be
+		// used again
+		response = client.AbortMultipartUpload("/multipart", uploadID);
+		TEST_EQUAL(204, response.GetResponseCode());
+		TEST_THAT(!FileExists("testfiles/multipart.upload-" + uploadID));
+		TEST_THAT(!FileExists("testfiles/multipart.upload-" + uploadID +
+			".1"));
+		part.Seek(0, IOStream::SeekType_Absolute);
+		response = client.UploadPart("/multipart", uploadID, 1, part);
+		TEST_EQUAL(404, response.GetResponseCode());
+		response = client.AbortMultipartUpload("/multipart", uploadID);
+		TEST_EQUAL(404, response.GetResponseCode());
 	}
 
 	{
@@ -452,6 +591,23 @@ int test(int argc, const char *argv[])
 
 		FileStream file("testfiles/testrequests.pl");
 		TEST_THAT(file.CompareWith(response));
+
+		// Objects are streamed with their length, so the connection
+		// can be used again
+		TEST_THAT(response.IsKeepAlive());
+		HTTPRequest request2(HTTPRequest::Method_GET,
+			"/testrequests.pl");
+		request2.SetHostName("quotes.s3.amazonaws.com");
+		request2.AddHeader("Date", "Wed, 01 Mar  2006 12:00:00 GMT");
+		request2.AddHeader("Authorization", "AWS 0PN5J17HBGZHT7JJ3X82:qc1e8u8TVl2BpIxwZwsursIb8U8=");
+		request2.SetClientKeepAliveRequested(true);
+		request2.Send(sock, SHORT_TIMEOUT);
+
+		HTTPResponse response2;
+		response2.Receive(sock, SHORT_TIMEOUT);
+		TEST_EQUAL(200, response2.GetResponseCode());
+		FileStream file2("testfiles/testrequests.pl");
+		TEST_THAT(file2.CompareWith(response2));
 	}
 
 	{
@@ -483,6 +639,73 @@ int test(int argc, const char *argv[])
 		TEST_THAT(EMU_UNLINK("testfiles/newfile") == 0);
 	}
 
+	// S3Client keeps connections to the server open, and can make
+	// several requests at once
+	{
+		S3Client client("localhost", 1080, "0PN5J17HBGZHT7JJ3X82",
+			"uV3F3YluFJax1cknvbcGwgjvx4QpvB+leU8dUj2o",
+			3 /* connections */);
+
+		for (int i = 0; i < 3; i++)
+		{
+			HTTPResponse response =
+				client.GetObject("/testrequests.pl");
+			TEST_EQUAL(200, response.GetResponseCode());
+			FileStream file("testfiles/testrequests.pl");
+			TEST_THAT(file.CompareWith(response));
+		}
+
+		// A HEAD response has the length of the object, but not
+		// the object itself
+		int64_t size;
+		TEST_THAT(FileExists("testfiles/testrequests.pl", &size));
+		HTTPResponse response = client.HeadObject("/testrequests.pl");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(size, response.GetContentLength());
+		TEST_EQUAL(0, response.GetSize());
+		TEST_EQUAL(1, client.GetNumConnectionsOpened());
+
+		std::vector<std::future<HTTPResponse> > responses;
+		for (int i = 0; i < 8; i++)
+		{
+			responses.push_back(
+				client.GetObjectAsync("/testrequests.pl"));
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			HTTPResponse response = responses[i].get();
+			TEST_EQUAL(200, response.GetResponseCode());
+			FileStream file("testfiles/testrequests.pl");
+			TEST_THAT(file.CompareWith(response));
+		}
+		TEST_THAT(client.GetNumConnectionsOpened() <= 3);
+
+		// Parts of a multipart upload are sent several at once
+		CollectInBufferStream original;
+		for (int i = 0; i < 20000; i++)
+		{
+			original.Write(&i, sizeof(i));
+		}
+		original.SetForReading();
+		client.PutObjectMultipart("/multipart", original, 16*1024);
+
+		response = client.GetObject("/multipart");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(original.GetSize(), response.GetSize());
+		TEST_EQUAL(0, memcmp(original.GetBuffer(), response.GetBuffer(),
+			original.GetSize()));
+		TEST_EQUAL(0, EMU_UNLINK("testfiles/multipart"));
+		TEST_THAT(client.GetNumConnectionsOpened() <= 3);
+
+		// The server closes connections which are idle for too long,
+		// and a new one is opened instead
+		int64_t opened = client.GetNumConnectionsOpened();
+		safe_sleep(2);
+		response = client.GetObject("/testrequests.pl");
+		TEST_EQUAL(200, response.GetResponseCode());
+		TEST_EQUAL(opened + 1, client.GetNumConnectionsOpened());
+	}
+
 	// Kill it
 	TEST_THAT(StopDaemon(pid, "testfiles/s3simulator.pid",
 		"s3simulator.memleaks", true));
@@ -19,11 +19,16 @@
 
 #include <string.h>
 
+#include <sstream>
+
 #include "Test.h"
+#include "BoxTime.h"
 #include "RaidFileController.h"
 #include "RaidFileWrite.h"
 #include "RaidFileException.h"
 #include "RaidFileRead.h"
+#include "RaidFileUtil.h"
+#include "RaidFileWriteBehind.h"
 #include "Guards.h"
 #include "intercept.h"
 
@@ -574,6 +579,229 @@ void test_overwrites()
 	writeB.Commit();
 }
 
+static void check_write_behind_file(int set, const char *filename,
+	const char *data, int datasize)
+{
+	std::auto_ptr<RaidFileRead> pread(RaidFileRead::Open(set, filename));
+	TEST_EQUAL(datasize, pread->GetFileSize());
+	MemoryBlockGuard<char*> buffer(datasize + 1);
+	TEST_THAT(pread->ReadFullBuffer(buffer, datasize, 0));
+	TEST_THAT(::memcmp(buffer, data, datasize) == 0);
+}
+
+static RaidFileUtil::ExistType write_behind_exists(int set,
+	const char *filename)
+{
+	RaidFileDiscSet rdiscSet(RaidFileController::GetController().GetDiscSet(set));
+	return RaidFileUtil::RaidFileExists(rdiscSet, filename);
+}
+
+// Files committed while a RaidFileWriteBehind exists are transformed later,
+// but can be read, overwritten and deleted at any time
+void test_write_behind(const char *data, int datasize)
+{
+	static const char *filenames[] = {"wb0", "wb1", "wb2", "wb3"};
+	#define WB_NUM_FILES (sizeof(filenames)/sizeof(filenames[0]))
+
+	{
+		RaidFileWriteBehind writeBehind;
+		TEST_CHECK_THROWS(RaidFileWriteBehind another, RaidFileException,
+			WriteBehindAlreadyActive);
+
+		for(unsigned int f = 0; f < WB_NUM_FILES; ++f)
+		{
+			RaidFileWrite write(f & 1, filenames[f]);
+			write.Open();
+			write.Write(data, datasize - f);
+			write.Commit(true);
+		}
+		for(unsigned int f = 0; f < WB_NUM_FILES; ++f)
+		{
+			check_write_behind_file(f & 1, filenames[f], data,
+				datasize - f);
+		}
+
+		// Overwriting waits for the pending transform
+		{
+			RaidFileWrite write(0, filenames[0]);
+			write.Open(true /* allow overwrite */);
+			write.Write(data + 100, 1000);
+			write.Commit(true);
+		}
+		check_write_behind_file(0, filenames[0], data + 100, 1000);
+
+		{
+			RaidFileWrite deleter(1, filenames[1]);
+			deleter.Delete();
+		}
+		TEST_EQUAL(RaidFileUtil::NoFile, write_behind_exists(1, filenames[1]));
+
+		// Non-RAID sets are never queued
+		{
+			RaidFileWrite write(2, "wbNonRaid");
+			write.Open();
+			write.Write(data, datasize);
+			write.Commit(true);
+		}
+
+		writeBehind.WaitForAll();
+		TEST_EQUAL(RaidFileUtil::AsRaid, write_behind_exists(0, filenames[2]));
+	}
+
+	check_write_behind_file(0, filenames[0], data + 100, 1000);
+	TEST_EQUAL(RaidFileUtil::AsRaid, write_behind_exists(0, filenames[0]));
+	TEST_EQUAL(RaidFileUtil::AsRaid, write_behind_exists(1, filenames[3]));
+	TEST_EQUAL(RaidFileUtil::NonRaid, write_behind_exists(2, "wbNonRaid"));
+	check_write_behind_file(1, filenames[3], data, datasize - 3);
+
+	// The journals are deleted when nothing is left to transform
+	std::ostringstream journal;
+	journal << "testfiles" DIRECTORY_SEPARATOR "0_0" DIRECTORY_SEPARATOR
+		"writebehind-" << getpid() << ".jnl";
+	TEST_THAT(!TestFileExists(journal.str().c_str()));
+
+	// A journal left by a process which died is recovered, including a
+	// transform which was cut short
+	{
+		RaidFileWrite write(1, "wbRecover");
+		write.Open();
+		write.Write(data, datasize);
+		write.Commit(false);
+	}
+	TEST_EQUAL(RaidFileUtil::NonRaid, write_behind_exists(1, "wbRecover"));
+	TEST_THAT(!TestFileExists("testfiles" DIRECTORY_SEPARATOR "1_1"
+		DIRECTORY_SEPARATOR "wbRecover.rf"));
+
+	int partial = ::open("testfiles" DIRECTORY_SEPARATOR "1_2"
+		DIRECTORY_SEPARATOR "wbRecover.rfP",
+		O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0644);
+	TEST_THAT(partial != -1);
+	::close(partial);
+
+	// No process has this ID, as it's higher than Linux allows
+	FILE *deadJournal = ::fopen("testfiles" DIRECTORY_SEPARATOR "1_0"
+		DIRECTORY_SEPARATOR "writebehind-99999999.jnl", "w");
+	TEST_THAT(deadJournal != 0);
+	::fprintf(deadJournal, "wbRecover\nwbMissing\n");
+	::fclose(deadJournal);
+
+	RaidFileWriteBehind::Recover(1);
+	TEST_EQUAL(RaidFileUtil::AsRaid, write_behind_exists(1, "wbRecover"));
+	check_write_behind_file(1, "wbRecover", data, datasize);
+	TEST_THAT(!TestFileExists("testfiles" DIRECTORY_SEPARATOR "1_0"
+		DIRECTORY_SEPARATOR "writebehind-99999999.jnl"));
+
+	// A file which can't be transformed stays in the journal, alone, so
+	// that the next recovery tries it again. Directories in the way of
+	// its partial components make the transform fail.
+	{
+		RaidFileWrite write(1, "wbFail");
+		write.Open();
+		write.Write(data, datasize);
+		write.Commit(false);
+	}
+	static const char *partialDirs[] = {
+		"testfiles" DIRECTORY_SEPARATOR "1_0" DIRECTORY_SEPARATOR "wbFail.rfP",
+		"testfiles" DIRECTORY_SEPARATOR "1_1" DIRECTORY_SEPARATOR "wbFail.rfP",
+		"testfiles" DIRECTORY_SEPARATOR "1_2" DIRECTORY_SEPARATOR "wbFail.rfP"};
+	for(unsigned int d = 0; d < 3; ++d)
+	{
+		TEST_THAT(::mkdir(partialDirs[d], 0755) == 0);
+	}
+
+	deadJournal = ::fopen("testfiles" DIRECTORY_SEPARATOR "1_0"
+		DIRECTORY_SEPARATOR "writebehind-99999999.jnl", "w");
+	TEST_THAT(deadJournal != 0);
+	::fprintf(deadJournal, "wbRecover\nwbFail\n");
+	::fclose(deadJournal);
+
+	RaidFileWriteBehind::Recover(1);
+	TEST_EQUAL(RaidFileUtil::NonRaid, write_behind_exists(1, "wbFail"));
+	check_write_behind_file(1, "wbFail", data, datasize);
+	{
+		FileHandleGuard<O_RDONLY | O_BINARY> journal(
+			"testfiles" DIRECTORY_SEPARATOR "1_0"
+			DIRECTORY_SEPARATOR "writebehind-99999999.jnl");
+		char contents[64];
+		int bytes = ::read(journal, contents, sizeof(contents));
+		TEST_EQUAL(std::string("wbFail\n"), std::string(contents,
+			bytes > 0 ? bytes : 0));
+	}
+
+	for(unsigned int d = 0; d < 3; ++d)
+	{
+		TEST_THAT(::rmdir(partialDirs[d]) == 0);
+	}
+	RaidFileWriteBehind::Recover(1);
+	TEST_EQUAL(RaidFileUtil::AsRaid, write_behind_exists(1, "wbFail"));
+	check_write_behind_file(1, "wbFail", data, datasize);
+	TEST_THAT(!TestFileExists("testfiles" DIRECTORY_SEPARATOR "1_0"
+		DIRECTORY_SEPARATOR "writebehind-99999999.jnl"));
+}
+
+
+// Files which are transformed in several chunks, with the component files
+// written in parallel, and with sizes which end in every awkward place
+void test_large_transforms()
+{
+	#define LARGE_TRANSFORM_SIZE (3*1024*1024 + 3*RAID_BLOCK_SIZE + 5)
+	MemoryBlockGuard<void*> large(LARGE_TRANSFORM_SIZE);
+	R250 random(7321);
+	for(unsigned int l = 0; l < LARGE_TRANSFORM_SIZE; ++l)
+	{
+		((char*)(void*)large)[l] = random.next() & 0xff;
+	}
+
+	static int largesize[] = {1024*1024, 1024*1024 + 1,
+		1024*1024 + RAID_BLOCK_SIZE, 2*1024*1024 - 8,
+		2*1024*1024 + RAID_BLOCK_SIZE + 8, LARGE_TRANSFORM_SIZE};
+	for(unsigned int n = 0; n < (sizeof(largesize)/sizeof(largesize[0])); ++n)
+	{
+		char fn[64];
+		sprintf(fn, "testL%d", largesize[n]);
+		testReadWriteFile(n&1, fn, large, largesize[n]);
+	}
+}
+
+// Not a test as such, but reports how fast files are transformed
+void test_transform_throughput()
+{
+	#define THROUGHPUT_TEST_SIZE (32*1024*1024)
+	#define THROUGHPUT_WRITE_SIZE (64*1024)
+	MemoryBlockGuard<char*> chunk(THROUGHPUT_WRITE_SIZE);
+	R250 random(1009);
+	for(unsigned int l = 0; l < THROUGHPUT_WRITE_SIZE; ++l)
+	{
+		((char*)chunk)[l] = random.next() & 0xff;
+	}
+
+	{
+		RaidFileWrite write(0, "throughput");
+		write.Open();
+		for(int w = 0; w < THROUGHPUT_TEST_SIZE; w += THROUGHPUT_WRITE_SIZE)
+		{
+			write.Write(chunk, THROUGHPUT_WRITE_SIZE);
+		}
+
+		box_time_t start = GetCurrentBoxTime();
+		write.Commit(true);
+		box_time_t elapsed = GetCurrentBoxTime() - start;
+		if(elapsed == 0) elapsed = 1;
+
+		BOX_NOTICE("Transformed " << (THROUGHPUT_TEST_SIZE / (1024*1024)) <<
+			" MB to RAID storage at " <<
+			((double)THROUGHPUT_TEST_SIZE * MICRO_SEC_IN_SEC / elapsed / (1024*1024)) <<
+			" MB/s");
+	}
+
+	std::auto_ptr<RaidFileRead> pread(RaidFileRead::Open(0, "throughput"));
+	TEST_THAT(pread->GetFileSize() == THROUGHPUT_TEST_SIZE);
+	pread.reset();
+
+	RaidFileWrite deleter(0, "throughput");
+	deleter.Delete();
+}
+
 
 int test(int argc, const char *argv[])
 {
@@ -966,6 +1194,10 @@ int test(int argc, const char *argv[])
 		}
 	}
 	
+	test_large_transforms();
+	test_transform_throughput();
+	test_write_behind(data, sizeof(data));
+
 	// Finally, a mega test (not necessary for every run, I would have thought)
 /*	unsigned int megamax = (1024*128) + 9;
 	MemoryBlockGuard<void*> megablock(megamax);